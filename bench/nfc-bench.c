@@ -0,0 +1,503 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-bench.c
+ * @brief Benchmark of transport and protocol hot paths, with CSV or JSON output
+ *
+ * Benchmarks:
+ *  - ping: pn53x_check_communication() round-trip, on every device found
+ *  - detect: nfc_initiator_list_passive_targets() per modulation
+ *  - mifare: full MIFARE Classic 1K/4K dump, with the default transport key
+ *  - transceive: nfc_initiator_transceive_bytes() versus payload size
+ *  - dep: D.E.P. throughput per mode and baud rate
+ *
+ * The transceive and dep benchmarks need two devices: the second one is
+ * driven as an echo D.E.P. target by the first one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#ifndef WIN32
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-mifare.h>
+
+#include "utils/nfc-utils.h"
+#include "libnfc/chips/pn53x.h"
+
+#define MAX_DEVICE_COUNT 16
+#define MAX_TARGET_COUNT 16
+#define DEP_MESSAGE_LEN 4096
+
+enum bench_format {
+  FORMAT_CSV,
+  FORMAT_JSON,
+};
+
+static enum bench_format format = FORMAT_CSV;
+static int iterations = 10;
+static size_t records = 0;
+
+struct bench_sample {
+  uint64_t min;
+  uint64_t max;
+  uint64_t total;
+  int count;
+  int errors;
+  size_t bytes;
+};
+
+// Monotonic time in µs
+static uint64_t
+bench_clock(void)
+{
+#ifndef WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static void
+sample_add(struct bench_sample *ps, const uint64_t start, const size_t bytes)
+{
+  const uint64_t us = bench_clock() - start;
+  if ((ps->count == 0) || (us < ps->min))
+    ps->min = us;
+  if (us > ps->max)
+    ps->max = us;
+  ps->total += us;
+  ps->bytes += bytes;
+  ps->count++;
+}
+
+// Print a string field, quoted for the output format
+static void
+print_string(const char *s)
+{
+  putchar('"');
+  for (; *s; s++) {
+    if ((format == FORMAT_JSON) && ((*s == '"') || (*s == '\\')))
+      putchar('\\');
+    else if ((format == FORMAT_CSV) && (*s == '"'))
+      putchar('"');
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+static void
+report(const char *pcBench, nfc_device *pnd, const char *pcParam, const struct bench_sample *ps)
+{
+  const char *pcSep = (format == FORMAT_JSON) ? ", " : ",";
+  const uint64_t mean = ps->count ? ps->total / ps->count : 0;
+  const double kbps = ps->total ? (8.0 * ps->bytes * 1000) / ps->total : 0;
+
+  if (format == FORMAT_JSON) {
+    printf("%s    { \"bench\": ", records ? ",\n" : "");
+    print_string(pcBench);
+    printf(", \"device\": ");
+    print_string(nfc_device_get_name(pnd));
+    printf(", \"connstring\": ");
+    print_string(nfc_device_get_connstring(pnd));
+    printf(", \"param\": ");
+    print_string(pcParam);
+    printf(", \"iterations\": %d, \"errors\": %d, \"min_us\": %" PRIu64 ", \"mean_us\": %" PRIu64 ", \"max_us\": %" PRIu64 ", \"bytes\": %zu, \"kbps\": %.1f }",
+           ps->count, ps->errors, ps->min, mean, ps->max, ps->bytes, kbps);
+  } else {
+    print_string(pcBench);
+    printf("%s", pcSep);
+    print_string(nfc_device_get_name(pnd));
+    printf("%s", pcSep);
+    print_string(nfc_device_get_connstring(pnd));
+    printf("%s", pcSep);
+    print_string(pcParam);
+    printf(",%d,%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%zu,%.1f\n",
+           ps->count, ps->errors, ps->min, mean, ps->max, ps->bytes, kbps);
+  }
+  records++;
+}
+
+static void
+bench_ping(nfc_device *pnd)
+{
+  struct bench_sample s = { 0 };
+
+  for (int i = 0; i < iterations; i++) {
+    const uint64_t start = bench_clock();
+    if (pn53x_check_communication(pnd) < 0) {
+      s.errors++;
+      continue;
+    }
+    sample_add(&s, start, 0);
+  }
+  report("ping", pnd, "", &s);
+}
+
+static void
+bench_detect(nfc_device *pnd)
+{
+  const nfc_modulation nmModulations[] = {
+    { .nmt = NMT_ISO14443A, .nbr = NBR_106 },
+    { .nmt = NMT_ISO14443B, .nbr = NBR_106 },
+    { .nmt = NMT_FELICA, .nbr = NBR_212 },
+    { .nmt = NMT_FELICA, .nbr = NBR_424 },
+    { .nmt = NMT_ISO14443BI, .nbr = NBR_106 },
+    { .nmt = NMT_ISO14443B2SR, .nbr = NBR_106 },
+    { .nmt = NMT_ISO14443B2CT, .nbr = NBR_106 },
+    { .nmt = NMT_JEWEL, .nbr = NBR_106 },
+  };
+  nfc_target ant[MAX_TARGET_COUNT];
+
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    return;
+  }
+  for (size_t m = 0; m < sizeof(nmModulations) / sizeof(nmModulations[0]); m++) {
+    struct bench_sample s = { 0 };
+    int found = 0;
+    for (int i = 0; i < iterations; i++) {
+      const uint64_t start = bench_clock();
+      const int res = nfc_initiator_list_passive_targets(pnd, nmModulations[m], ant, MAX_TARGET_COUNT);
+      if (res == NFC_EDEVNOTSUPP)
+        break;
+      if (res < 0) {
+        s.errors++;
+        continue;
+      }
+      sample_add(&s, start, 0);
+      found = res;
+    }
+    if (s.count || s.errors) {
+      char acParam[64];
+      snprintf(acParam, sizeof(acParam), "%s@%s:%d", str_nfc_modulation_type(nmModulations[m].nmt), str_nfc_baud_rate(nmModulations[m].nbr), found);
+      report("detect", pnd, acParam, &s);
+    }
+  }
+}
+
+static void
+bench_mifare(nfc_device *pnd)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  const uint8_t abtKey[MIFARE_CLASSIC_KEY_LEN] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  uint8_t abtSector[16 * MIFARE_CLASSIC_BLOCK_LEN];
+  nfc_target nt;
+  uint8_t ui8Sectors;
+
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    return;
+  }
+  if (nfc_initiator_select_passive_target(pnd, nm, NULL, 0, &nt) <= 0) {
+    fprintf(stderr, "mifare: no ISO/IEC 14443A tag found\n");
+    return;
+  }
+  switch (nt.nti.nai.btSak) {
+    case 0x08:
+      ui8Sectors = 16;
+      break;
+    case 0x18:
+      ui8Sectors = MIFARE_CLASSIC_4K_SECTORS;
+      break;
+    default:
+      fprintf(stderr, "mifare: tag is not a MIFARE Classic 1K/4K (SAK 0x%02x)\n", nt.nti.nai.btSak);
+      return;
+  }
+
+  struct bench_sample s = { 0 };
+  for (int i = 0; i < iterations; i++) {
+    size_t szDump = 0;
+    int res = 0;
+    const uint64_t start = bench_clock();
+    // Each dump starts from a fresh selection, like a real reader would
+    if (nfc_initiator_select_passive_target(pnd, nm, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, &nt) <= 0) {
+      s.errors++;
+      continue;
+    }
+    for (uint8_t ui8Sector = 0; ui8Sector < ui8Sectors; ui8Sector++) {
+      if ((res = nfc_mifare_classic_read_sector(pnd, &nt, ui8Sector, MC_AUTH_A, abtKey, abtSector, sizeof(abtSector))) < 0)
+        break;
+      szDump += res;
+    }
+    if (res < 0) {
+      s.errors++;
+      continue;
+    }
+    sample_add(&s, start, szDump);
+  }
+  report("mifare", pnd, (ui8Sectors == 16) ? "1K" : "4K", &s);
+}
+
+#ifndef WIN32
+static volatile bool dep_stop = false;
+
+// Echo D.E.P. target, re-armed every time the initiator releases it
+static void *
+dep_target_thread(void *arg)
+{
+  nfc_device *pnd = (nfc_device *) arg;
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_DEP,
+      .nbr = NBR_UNDEFINED
+    },
+    .nti = {
+      .ndi = {
+        .abtNFCID3 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA },
+        .szGB = 0,
+        .ndm = NDM_UNDEFINED,
+      },
+    },
+  };
+  static uint8_t abtRx[DEP_MESSAGE_LEN];
+
+  while (!dep_stop) {
+    nfc_target ntInit = nt;
+    if (nfc_target_init(pnd, &ntInit, abtRx, sizeof(abtRx), 0) < 0)
+      continue;
+    int res;
+    while ((res = nfc_target_receive_bytes(pnd, abtRx, sizeof(abtRx), 0)) > 0) {
+      if (nfc_target_send_bytes(pnd, abtRx, res, 0) < 0)
+        break;
+    }
+  }
+  return NULL;
+}
+
+// Select the echo target and time szLen bytes messages through it
+static int
+dep_run(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const size_t szLen, struct bench_sample *ps)
+{
+  static uint8_t abtTx[DEP_MESSAGE_LEN];
+  static uint8_t abtRx[DEP_MESSAGE_LEN];
+  nfc_target nt;
+  int res;
+
+  for (size_t n = 0; n < szLen; n++)
+    abtTx[n] = (uint8_t)(n * 7);
+  if ((res = nfc_initiator_init(pnd)) < 0)
+    return res;
+  if ((res = nfc_initiator_select_dep_target(pnd, ndm, nbr, NULL, &nt, 1000)) <= 0)
+    return (res < 0) ? res : NFC_ENOTSUCHDEV;
+  for (int i = 0; i < iterations; i++) {
+    const uint64_t start = bench_clock();
+    res = nfc_initiator_transceive_bytes(pnd, abtTx, szLen, abtRx, sizeof(abtRx), 5000);
+    if ((res != (int) szLen) || memcmp(abtTx, abtRx, szLen)) {
+      ps->errors++;
+      continue;
+    }
+    // Count both directions
+    sample_add(ps, start, 2 * szLen);
+  }
+  return nfc_initiator_deselect_target(pnd);
+}
+
+static void
+bench_dep(nfc_device *pndInitiator, nfc_device *pndTarget, const bool bTransceive, const bool bDep)
+{
+  pthread_t thread;
+
+  dep_stop = false;
+  if (pthread_create(&thread, NULL, dep_target_thread, pndTarget)) {
+    perror("pthread_create");
+    return;
+  }
+  // Wait some time for the other thread to initialise NFC device as target
+  sleep(1);
+
+  if (bTransceive) {
+    for (size_t szLen = 1; szLen <= DEP_MESSAGE_LEN; szLen *= 2) {
+      struct bench_sample s = { 0 };
+      if (dep_run(pndInitiator, NDM_ACTIVE, NBR_424, szLen, &s) < 0)
+        nfc_perror(pndInitiator, "transceive");
+      char acParam[32];
+      snprintf(acParam, sizeof(acParam), "%zu", szLen);
+      report("transceive", pndInitiator, acParam, &s);
+    }
+  }
+  if (bDep) {
+    const nfc_dep_mode ndms[] = { NDM_PASSIVE, NDM_ACTIVE };
+    const nfc_baud_rate nbrs[] = { NBR_106, NBR_212, NBR_424 };
+    for (size_t m = 0; m < sizeof(ndms) / sizeof(ndms[0]); m++) {
+      for (size_t b = 0; b < sizeof(nbrs) / sizeof(nbrs[0]); b++) {
+        struct bench_sample s = { 0 };
+        if (dep_run(pndInitiator, ndms[m], nbrs[b], DEP_MESSAGE_LEN, &s) < 0)
+          nfc_perror(pndInitiator, "dep");
+        char acParam[32];
+        snprintf(acParam, sizeof(acParam), "%s@%s", (ndms[m] == NDM_ACTIVE) ? "active" : "passive", str_nfc_baud_rate(nbrs[b]));
+        report("dep", pndInitiator, acParam, &s);
+      }
+    }
+  }
+
+  dep_stop = true;
+  nfc_abort_command(pndTarget);
+  pthread_join(thread, NULL);
+}
+#endif
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-f csv|json] [-n iterations] [benchmark...]\n", progname);
+  printf("  -f\tOutput format (default: csv)\n");
+  printf("  -n\tIterations per measurement (default: 10)\n");
+  printf("  benchmark\tping, detect, mifare, transceive or dep (default: all)\n");
+}
+
+static bool
+selected(int argc, const char *argv[], int arg, const char *pcBench)
+{
+  if (arg == argc)
+    return true;
+  for (; arg < argc; arg++) {
+    if (!strcmp(argv[arg], pcBench))
+      return true;
+  }
+  return false;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  int arg;
+
+  for (arg = 1; arg < argc; arg++) {
+    if ((0 == strcmp(argv[arg], "-f")) && (arg + 1 < argc)) {
+      arg++;
+      if (0 == strcmp(argv[arg], "json")) {
+        format = FORMAT_JSON;
+      } else if (0 == strcmp(argv[arg], "csv")) {
+        format = FORMAT_CSV;
+      } else {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    } else if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      iterations = atoi(argv[++arg]);
+      if (iterations <= 0) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+      }
+    } else if (argv[arg][0] == '-') {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    } else {
+      break;
+    }
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+  const size_t szFound = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  if (szFound == 0) {
+    ERR("No NFC device found.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_device *pnds[MAX_DEVICE_COUNT];
+  size_t szOpened = 0;
+  for (size_t i = 0; i < szFound; i++) {
+    if ((pnds[szOpened] = nfc_open(context, connstrings[i])) == NULL) {
+      ERR("Unable to open NFC device: %s", connstrings[i]);
+      continue;
+    }
+    szOpened++;
+  }
+  if (szOpened == 0) {
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  if (format == FORMAT_JSON) {
+    printf("{\n  \"libnfc\": \"%s\",\n  \"iterations\": %d,\n  \"results\": [\n", nfc_version(), iterations);
+  } else {
+    printf("bench,device,connstring,param,iterations,errors,min_us,mean_us,max_us,bytes,kbps\n");
+  }
+
+  if (selected(argc, argv, arg, "ping")) {
+    for (size_t i = 0; i < szOpened; i++)
+      bench_ping(pnds[i]);
+  }
+  if (selected(argc, argv, arg, "detect"))
+    bench_detect(pnds[0]);
+  if (selected(argc, argv, arg, "mifare"))
+    bench_mifare(pnds[0]);
+  const bool bTransceive = selected(argc, argv, arg, "transceive");
+  const bool bDep = selected(argc, argv, arg, "dep");
+  if (bTransceive || bDep) {
+#ifndef WIN32
+    if (szOpened >= 2)
+      bench_dep(pnds[0], pnds[1], bTransceive, bDep);
+    else
+      fprintf(stderr, "transceive, dep: at least two NFC devices are needed\n");
+#else
+    fprintf(stderr, "transceive, dep: not available on this platform\n");
+#endif
+  }
+
+  if (format == FORMAT_JSON)
+    printf("\n  ]\n}\n");
+
+  for (size_t i = 0; i < szOpened; i++)
+    nfc_close(pnds[i]);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
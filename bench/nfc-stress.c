@@ -0,0 +1,402 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-stress.c
+ * @brief Access storm: open, init, poll and close readers in a loop, from several threads
+ *
+ * Each iteration lists the devices (unless connection strings are given),
+ * then opens, initialises as initiator, polls for ISO/IEC 14443A targets and
+ * closes each reader. Readers are shared out between the threads, a reader is
+ * never open twice at a time. The connection strings given with -c are reused
+ * in turn until -d readers are reached, e.g. "-c virtual -d 500" drives 500
+ * virtual readers.
+ *
+ * The report gives a latency histogram per phase, the open/close rate, and
+ * the growth of open file descriptors and resident memory between the end of
+ * the first iteration and the end of the run, so leaks show up in long runs.
+ * Exit status is EXIT_FAILURE when errors occurred or file descriptors leaked.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "utils/nfc-utils.h"
+
+#define MAX_DEVICE_COUNT 4096
+#define MAX_THREAD_COUNT 256
+#define MAX_TARGET_COUNT 8
+// Bucket b holds latencies in [2^(b-1), 2^b[ µs, bucket 0 is under 1 µs
+#define HISTOGRAM_BUCKETS 28
+
+enum stress_phase {
+  PHASE_LIST,
+  PHASE_OPEN,
+  PHASE_INIT,
+  PHASE_POLL,
+  PHASE_CLOSE,
+  PHASE_COUNT
+};
+
+static const char *phase_names[PHASE_COUNT] = { "list", "open", "init", "poll", "close" };
+
+struct stress_histogram {
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t errors;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+};
+
+struct stress_thread {
+  pthread_t thread;
+  size_t index;
+  struct stress_histogram phases[PHASE_COUNT];
+};
+
+static nfc_context *context;
+static nfc_connstring connstrings[MAX_DEVICE_COUNT];
+static size_t device_count = 0;
+static bool scan = true;
+static int iterations = 10;
+static size_t thread_count = 1;
+
+// Iterations are run in lock step, so every thread has finished the first one when resources are sampled
+static pthread_barrier_t iteration_barrier;
+static long warm_fds;
+static long warm_rss;
+
+// Monotonic time in µs
+static uint64_t
+stress_clock(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+histogram_add(struct stress_histogram *ph, const uint64_t start, const bool ok)
+{
+  const uint64_t us = stress_clock() - start;
+  size_t b = 0;
+
+  if (!ok) {
+    ph->errors++;
+    return;
+  }
+  while ((b < HISTOGRAM_BUCKETS - 1) && (us >> b))
+    b++;
+  ph->buckets[b]++;
+  if ((ph->count == 0) || (us < ph->min))
+    ph->min = us;
+  if (us > ph->max)
+    ph->max = us;
+  ph->total += us;
+  ph->count++;
+}
+
+static void
+histogram_merge(struct stress_histogram *pDst, const struct stress_histogram *pSrc)
+{
+  if (pSrc->count && ((pDst->count == 0) || (pSrc->min < pDst->min)))
+    pDst->min = pSrc->min;
+  if (pSrc->max > pDst->max)
+    pDst->max = pSrc->max;
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+    pDst->buckets[b] += pSrc->buckets[b];
+  pDst->count += pSrc->count;
+  pDst->errors += pSrc->errors;
+  pDst->total += pSrc->total;
+}
+
+// Upper bound of the bucket holding the given fraction of the samples
+static uint64_t
+histogram_percentile(const struct stress_histogram *ph, const double fraction)
+{
+  uint64_t seen = 0;
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    seen += ph->buckets[b];
+    if ((ph->count) && (seen >= fraction * ph->count))
+      return (b == 0) ? 1 : ((uint64_t) 1 << b);
+  }
+  return ph->max;
+}
+
+// Number of file descriptors open in this process, -1 when it can not be told
+static long
+open_fds(void)
+{
+  const char *dirs[] = { "/proc/self/fd", "/dev/fd" };
+  for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+    DIR *dir = opendir(dirs[i]);
+    if (!dir)
+      continue;
+    long count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+      if (entry->d_name[0] != '.')
+        count++;
+    }
+    closedir(dir);
+    // Do not count the descriptor used to read the directory
+    return count - 1;
+  }
+  return -1;
+}
+
+// Resident memory in KiB, falls back to the peak resident size where /proc is not available
+static long
+resident_kib(void)
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (f) {
+    long size, resident;
+    const int n = fscanf(f, "%ld %ld", &size, &resident);
+    fclose(f);
+    if (n == 2)
+      return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  }
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    return ru.ru_maxrss;
+  return -1;
+}
+
+static void *
+stress_thread_run(void *arg)
+{
+  struct stress_thread *pst = (struct stress_thread *) arg;
+  const nfc_modulation nm = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  nfc_target ant[MAX_TARGET_COUNT];
+
+  for (int n = 0; n < iterations; n++) {
+    uint64_t start;
+    if (scan && (pst->index == 0)) {
+      nfc_connstring found[MAX_DEVICE_COUNT];
+      start = stress_clock();
+      const size_t szFound = nfc_list_devices(context, found, MAX_DEVICE_COUNT);
+      histogram_add(&pst->phases[PHASE_LIST], start, szFound >= device_count);
+    }
+    for (size_t i = pst->index; i < device_count; i += thread_count) {
+      nfc_device *pnd;
+
+      start = stress_clock();
+      pnd = nfc_open(context, connstrings[i]);
+      histogram_add(&pst->phases[PHASE_OPEN], start, pnd != NULL);
+      if (!pnd)
+        continue;
+
+      start = stress_clock();
+      histogram_add(&pst->phases[PHASE_INIT], start, nfc_initiator_init(pnd) >= 0);
+
+      start = stress_clock();
+      histogram_add(&pst->phases[PHASE_POLL], start, nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT) >= 0);
+
+      start = stress_clock();
+      nfc_close(pnd);
+      histogram_add(&pst->phases[PHASE_CLOSE], start, true);
+    }
+    if (pthread_barrier_wait(&iteration_barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+      if (n == 0) {
+        warm_fds = open_fds();
+        warm_rss = resident_kib();
+      }
+    }
+    pthread_barrier_wait(&iteration_barrier);
+  }
+  return NULL;
+}
+
+static void
+print_histogram(const char *pcName, const struct stress_histogram *ph)
+{
+  uint64_t peak = 0;
+
+  printf("%s: %" PRIu64 " calls, %" PRIu64 " errors", pcName, ph->count, ph->errors);
+  if (ph->count == 0) {
+    printf("\n");
+    return;
+  }
+  printf(", min %" PRIu64 " us, mean %" PRIu64 " us, p50 < %" PRIu64 " us, p99 < %" PRIu64 " us, max %" PRIu64 " us\n",
+         ph->min, ph->total / ph->count, histogram_percentile(ph, 0.5), histogram_percentile(ph, 0.99), ph->max);
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    if (ph->buckets[b] > peak)
+      peak = ph->buckets[b];
+  }
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    if (ph->buckets[b] == 0)
+      continue;
+    char bar[41];
+    const size_t len = (size_t)((ph->buckets[b] * 40 + peak - 1) / peak);
+    memset(bar, '#', len);
+    bar[len] = '\0';
+    printf("  < %10" PRIu64 " us %10" PRIu64 " %s\n", (b == 0) ? 1 : ((uint64_t) 1 << b), ph->buckets[b], bar);
+  }
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-n iterations] [-t threads] [-d devices] [-c connstring]...\n", progname);
+  printf("  -n\tIterations (default: 10)\n");
+  printf("  -t\tThreads sharing out the readers (default: 1)\n");
+  printf("  -d\tNumber of readers (default: all devices found, or one per connstring)\n");
+  printf("  -c\tReader to use instead of scanning, may be repeated and is reused up to -d readers\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  size_t szRequested = 0;
+  size_t szGiven = 0;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      iterations = atoi(argv[++arg]);
+    } else if ((0 == strcmp(argv[arg], "-t")) && (arg + 1 < argc)) {
+      thread_count = strtoul(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-d")) && (arg + 1 < argc)) {
+      szRequested = strtoul(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-c")) && (arg + 1 < argc) && (szGiven < MAX_DEVICE_COUNT)) {
+      snprintf(connstrings[szGiven++], sizeof(nfc_connstring), "%s", argv[++arg]);
+    } else {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ((iterations <= 0) || (thread_count == 0) || (thread_count > MAX_THREAD_COUNT) || (szRequested > MAX_DEVICE_COUNT)) {
+    print_usage(argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  if (szGiven) {
+    scan = false;
+    device_count = szRequested ? szRequested : szGiven;
+    for (size_t i = szGiven; i < device_count; i++)
+      memcpy(connstrings[i], connstrings[i % szGiven], sizeof(nfc_connstring));
+  } else {
+    device_count = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+    if (szRequested && (szRequested < device_count))
+      device_count = szRequested;
+  }
+  if (device_count == 0) {
+    ERR("No NFC device found.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if (thread_count > device_count)
+    thread_count = device_count;
+
+  printf("%zu readers, %zu threads, %d iterations\n", device_count, thread_count, iterations);
+
+  struct stress_thread *threads = calloc(thread_count, sizeof(struct stress_thread));
+  if (!threads) {
+    ERR("malloc");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  pthread_barrier_init(&iteration_barrier, NULL, thread_count);
+  const uint64_t start = stress_clock();
+  size_t szStarted;
+  for (szStarted = 0; szStarted < thread_count; szStarted++) {
+    threads[szStarted].index = szStarted;
+    if (pthread_create(&threads[szStarted].thread, NULL, stress_thread_run, &threads[szStarted])) {
+      perror("pthread_create");
+      // Threads already running would wait forever at the barrier
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (size_t i = 0; i < thread_count; i++)
+    pthread_join(threads[i].thread, NULL);
+  const uint64_t elapsed = stress_clock() - start;
+  pthread_barrier_destroy(&iteration_barrier);
+
+  struct stress_histogram total[PHASE_COUNT];
+  memset(total, 0, sizeof(total));
+  uint64_t errors = 0;
+  for (size_t p = 0; p < PHASE_COUNT; p++) {
+    for (size_t i = 0; i < thread_count; i++)
+      histogram_merge(&total[p], &threads[i].phases[p]);
+    errors += total[p].errors;
+    if (total[p].count || total[p].errors)
+      print_histogram(phase_names[p], &total[p]);
+  }
+  free(threads);
+
+  const double seconds = elapsed / 1e6;
+  printf("elapsed: %.3f s, %.1f open/close per second\n", seconds, seconds ? total[PHASE_CLOSE].count / seconds : 0);
+
+  const long fds = open_fds();
+  const long rss = resident_kib();
+  bool leaked = false;
+  if ((fds >= 0) && (warm_fds >= 0)) {
+    printf("file descriptors: %ld after first iteration, %ld at end (%+ld)\n", warm_fds, fds, fds - warm_fds);
+    leaked = (fds > warm_fds);
+  }
+  if ((rss >= 0) && (warm_rss >= 0)) {
+    printf("resident memory: %ld KiB after first iteration, %ld KiB at end (%+ld KiB", warm_rss, rss, rss - warm_rss);
+    if (iterations > 1)
+      printf(", %+.2f KiB per iteration", (double)(rss - warm_rss) / (iterations - 1));
+    printf(")\n");
+  }
+
+  nfc_exit(context);
+  exit(((errors == 0) && !leaked) ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -1,5 +1,5 @@
-# This CMake script wants to use libusb functionality, therefore it looks 
-# for libusb include files and libraries. 
+# This CMake script wants to use libusb-1.0 functionality, therefore it looks 
+# for libusb-1.0 include files and libraries. 
 #
 # Operating Systems Supported:
 # - Unix (requires pkg-config)
@@ -12,7 +12,7 @@
 # Author: F. Kooman <fkooman@tuxed.net>
 #
 
-# FreeBSD has built-in libusb since 800069
+# FreeBSD has built-in libusb (with libusb-1.0 API) since 800069
 IF(CMAKE_SYSTEM_NAME MATCHES FreeBSD)
   EXEC_PROGRAM(sysctl ARGS -n kern.osreldate OUTPUT_VARIABLE FREEBSD_VERSION)
   SET(MIN_FREEBSD_VERSION 800068)
@@ -26,16 +26,16 @@ ENDIF(CMAKE_SYSTEM_NAME MATCHES FreeBSD)
 
 IF(NOT LIBUSB_FOUND)
   IF(WIN32)
-    FIND_PATH(LIBUSB_INCLUDE_DIRS lusb0_usb.h "$ENV{ProgramFiles}/LibUSB-Win32/include" NO_SYSTEM_ENVIRONMENT_PATH)
-    FIND_LIBRARY(LIBUSB_LIBRARIES NAMES libusb PATHS "$ENV{ProgramFiles}/LibUSB-Win32/lib/gcc")
-    SET(LIBUSB_LIBRARY_DIR "$ENV{ProgramFiles}/LibUSB-Win32/bin/x86/")
+    FIND_PATH(LIBUSB_INCLUDE_DIRS libusb.h "$ENV{ProgramFiles}/libusb-1.0/include/libusb-1.0" NO_SYSTEM_ENVIRONMENT_PATH)
+    FIND_LIBRARY(LIBUSB_LIBRARIES NAMES usb-1.0 libusb-1.0 PATHS "$ENV{ProgramFiles}/libusb-1.0/MinGW32/dll")
+    SET(LIBUSB_LIBRARY_DIR "$ENV{ProgramFiles}/libusb-1.0/MinGW32/dll/")
     # Must fix up variable to avoid backslashes during packaging
     STRING(REGEX REPLACE "\\\\" "/" LIBUSB_LIBRARY_DIR ${LIBUSB_LIBRARY_DIR})
   ELSE(WIN32)
     # If not under Windows we use PkgConfig
     FIND_PACKAGE (PkgConfig)
     IF(PKG_CONFIG_FOUND)
-      PKG_CHECK_MODULES(LIBUSB REQUIRED libusb)
+      PKG_CHECK_MODULES(LIBUSB REQUIRED libusb-1.0)
     ELSE(PKG_CONFIG_FOUND)
       MESSAGE(FATAL_ERROR "Could not find PkgConfig")
     ENDIF(PKG_CONFIG_FOUND)
@@ -11,6 +11,36 @@ ELSE(WIN32)
 ENDIF(WIN32)
 SET(LIBNFC_DRIVER_PN532_UART ON CACHE BOOL "Enable PN532 UART support (Use serial port)")
 SET(LIBNFC_DRIVER_PN53X_USB ON CACHE BOOL "Enable PN531 and PN531 USB support (Depends on libusb)")
+SET(LIBNFC_DRIVER_VIRTUAL OFF CACHE BOOL "Enable virtual PN532 support (Software model, for benchmarks and tests)")
+SET(LIBNFC_DRIVER_REPLAY OFF CACHE BOOL "Enable capture replay support (Answers from a pcapng frame capture, for regression tests)")
+IF(NOT WIN32)
+  SET(LIBNFC_DRIVER_REMOTE OFF CACHE BOOL "Enable remote device support (PN53x device shared by pn53x-remote-agent over TCP)")
+  SET(LIBNFC_DRIVER_MUX OFF CACHE BOOL "Enable shared device support (PN53x device shared between processes by pn53x-mux-daemon)")
+ENDIF(NOT WIN32)
+
+# Single-driver build: a specialised library calling the hooks of one driver directly
+SET(LIBNFC_SINGLE_DRIVER "" CACHE STRING "Build for this driver only with static dispatch of its hooks, e.g. pn532_spi (empty for all selected drivers)")
+IF(LIBNFC_SINGLE_DRIVER)
+  SET(SINGLE_DRIVER_FOUND FALSE)
+  FOREACH(driver acr122_pcsc acr122_usb acr122s arygon pn532_i2c pn532_spi pn532_uart pn53x_usb virtual replay remote mux)
+    STRING(TOUPPER ${driver} DRIVER)
+    IF(driver STREQUAL LIBNFC_SINGLE_DRIVER)
+      SET(LIBNFC_DRIVER_${DRIVER} ON)
+      SET(SINGLE_DRIVER_FOUND TRUE)
+    ELSE(driver STREQUAL LIBNFC_SINGLE_DRIVER)
+      SET(LIBNFC_DRIVER_${DRIVER} OFF)
+    ENDIF(driver STREQUAL LIBNFC_SINGLE_DRIVER)
+  ENDFOREACH(driver)
+  IF(NOT SINGLE_DRIVER_FOUND)
+    MESSAGE(FATAL_ERROR "Unknown driver ${LIBNFC_SINGLE_DRIVER} for LIBNFC_SINGLE_DRIVER")
+  ENDIF(NOT SINGLE_DRIVER_FOUND)
+  IF(LIBNFC_SINGLE_DRIVER STREQUAL "arygon")
+    SET(SINGLE_PN53X_IO arygon_tama_io)
+  ELSE(LIBNFC_SINGLE_DRIVER STREQUAL "arygon")
+    SET(SINGLE_PN53X_IO ${LIBNFC_SINGLE_DRIVER}_io)
+  ENDIF(LIBNFC_SINGLE_DRIVER STREQUAL "arygon")
+  ADD_DEFINITIONS("-DNFC_SINGLE_DRIVER=${LIBNFC_SINGLE_DRIVER}_driver" "-DNFC_SINGLE_PN53X_IO=${SINGLE_PN53X_IO}")
+ENDIF(LIBNFC_SINGLE_DRIVER)
 
 IF(LIBNFC_DRIVER_ACR122_PCSC)
   FIND_PACKAGE(PCSC REQUIRED)
@@ -61,4 +91,24 @@ IF(LIBNFC_DRIVER_PN53X_USB)
   SET(USB_REQUIRED TRUE)
 ENDIF(LIBNFC_DRIVER_PN53X_USB)
 
+IF(LIBNFC_DRIVER_VIRTUAL)
+  ADD_DEFINITIONS("-DDRIVER_VIRTUAL_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/virtual")
+ENDIF(LIBNFC_DRIVER_VIRTUAL)
+
+IF(LIBNFC_DRIVER_REPLAY)
+  ADD_DEFINITIONS("-DDRIVER_REPLAY_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/replay")
+ENDIF(LIBNFC_DRIVER_REPLAY)
+
 INCLUDE_DIRECTORIES(${CMAKE_CURRENT_SOURCE_DIR}/drivers)
+
+IF(LIBNFC_DRIVER_REMOTE)
+  ADD_DEFINITIONS("-DDRIVER_REMOTE_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/remote")
+ENDIF(LIBNFC_DRIVER_REMOTE)
+
+IF(LIBNFC_DRIVER_MUX)
+  ADD_DEFINITIONS("-DDRIVER_MUX_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/mux")
+ENDIF(LIBNFC_DRIVER_MUX)
@@ -49,10 +49,21 @@
 #include "contrib/windows.h"
 #define delay_ms( X ) Sleep( X )
 
+// Bytes read ahead by uart_receive(), same size as the POSIX backend
+#define UART_RX_BUFFER_LEN 512
+// Longest time an overlapped ReadFile() waits for its first byte, it is reissued until the deadline
+#define UART_READ_WAIT_MS 1000
+
 struct serial_port_windows {
-  HANDLE  hPort;                // Serial port handle
+  HANDLE  hPort;                // Serial port handle, opened for overlapped I/O
   DCB     dcb;                  // Device control settings
   COMMTIMEOUTS ct;              // Serial port time-out configuration
+  OVERLAPPED olRead;            // Pending ReadFile(), signals its event when done
+  OVERLAPPED olWrite;           // Pending WriteFile(), signals its event when done
+  HANDLE  hAbortEvent;          // Signaled by uart_abort(), wakes uart_receive()
+  uint8_t abtRxBuffer[UART_RX_BUFFER_LEN];  // Bytes read ahead, not received yet
+  size_t  szRxBufferPos;
+  size_t  szRxBufferLen;
 };
 
 serial_port
@@ -63,17 +74,27 @@ uart_open(const char *pcPortName)
 
   if (sp == 0)
     return INVALID_SERIAL_PORT;
+  memset(sp, 0, sizeof(struct serial_port_windows));
+  sp->hPort = INVALID_HANDLE_VALUE;
 
   // Copy the input "com?" to "\\.\COM?" format
   sprintf(acPortName, "\\\\.\\%s", pcPortName);
   _strupr(acPortName);
 
   // Try to open the serial port
-  sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+  sp->hPort = CreateFileA(acPortName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
   if (sp->hPort == INVALID_HANDLE_VALUE) {
     uart_close(sp);
     return INVALID_SERIAL_PORT;
   }
+  // Manual-reset events, reset before each operation
+  sp->olRead.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  sp->olWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  sp->hAbortEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!sp->olRead.hEvent || !sp->olWrite.hEvent || !sp->hAbortEvent) {
+    uart_close(sp);
+    return INVALID_SERIAL_PORT;
+  }
   // Prepare the device control
   memset(&sp->dcb, 0, sizeof(DCB));
   sp->dcb.DCBlength = sizeof(DCB);
@@ -87,10 +108,12 @@ uart_open(const char *pcPortName)
     return INVALID_SERIAL_PORT;
   }
 
-  sp->ct.ReadIntervalTimeout = 30;
-  sp->ct.ReadTotalTimeoutMultiplier = 0;
-  sp->ct.ReadTotalTimeoutConstant = 30;
-  sp->ct.WriteTotalTimeoutMultiplier = 30;
+  // ReadFile() completes as soon as one byte or more is there, with everything the port holds;
+  // deadlines are enforced by waiting on the overlapped events, not by the port
+  sp->ct.ReadIntervalTimeout = MAXDWORD;
+  sp->ct.ReadTotalTimeoutMultiplier = MAXDWORD;
+  sp->ct.ReadTotalTimeoutConstant = UART_READ_WAIT_MS;
+  sp->ct.WriteTotalTimeoutMultiplier = 0;
   sp->ct.WriteTotalTimeoutConstant = 0;
 
   if (!SetCommTimeouts(sp->hPort, &sp->ct)) {
@@ -106,19 +129,51 @@ uart_open(const char *pcPortName)
 void
 uart_close(const serial_port sp)
 {
-  if (((struct serial_port_windows *) sp)->hPort != INVALID_HANDLE_VALUE) {
-    CloseHandle(((struct serial_port_windows *) sp)->hPort);
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+
+  if (spw->hPort != INVALID_HANDLE_VALUE) {
+    CloseHandle(spw->hPort);
   }
+  if (spw->olRead.hEvent)
+    CloseHandle(spw->olRead.hEvent);
+  if (spw->olWrite.hEvent)
+    CloseHandle(spw->olWrite.hEvent);
+  if (spw->hAbortEvent)
+    CloseHandle(spw->hAbortEvent);
   free(sp);
 }
 
+int
+uart_get_fd(const serial_port sp)
+{
+  (void) sp;
+  // Windows serial ports are HANDLEs, they can't be waited with select()
+  return NFC_EDEVNOTSUPP;
+}
+
+size_t
+uart_pending(const serial_port sp)
+{
+  const struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  return spw->szRxBufferLen - spw->szRxBufferPos;
+}
+
+// Drop what the port holds and the bytes read ahead
+static void
+uart_win32_purge(struct serial_port_windows *spw)
+{
+  PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  spw->szRxBufferPos = 0;
+  spw->szRxBufferLen = 0;
+}
+
 void
 uart_flush_input(const serial_port sp)
 {
-  PurgeComm(((struct serial_port_windows *) sp)->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  uart_win32_purge((struct serial_port_windows *) sp);
 }
 
-void
+int
 uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
 {
   struct serial_port_windows *spw;
@@ -133,10 +188,11 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 115200:
     case 230400:
     case 460800:
+    case 921600:
       break;
     default:
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d bauds. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400 or 460800.", uiPortSpeed);
-      return;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d bauds. Speed value must be one of these constants: 9600 (default), 19200, 38400, 57600, 115200, 230400, 460800 or 921600.", uiPortSpeed);
+      return NFC_EINVARG;
   };
   spw = (struct serial_port_windows *) sp;
 
@@ -144,9 +200,10 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
   spw->dcb.BaudRate = uiPortSpeed;
   if (!SetCommState(spw->hPort, &spw->dcb)) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to apply new speed settings.");
-    return;
+    return NFC_EIO;
   }
-  PurgeComm(spw->hPort, PURGE_RXABORT | PURGE_RXCLEAR);
+  uart_win32_purge(spw);
+  return NFC_SUCCESS;
 }
 
 uint32_t
@@ -159,85 +216,136 @@ uart_get_speed(const serial_port sp)
   return 0;
 }
 
-int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+// Wait for an overlapped operation until deadline, or abort when hAbortEvent is given; returns the WaitForMultipleObjects() result
+static DWORD
+uart_win32_wait(struct serial_port_windows *spw, OVERLAPPED *pol, HANDLE hAbortEvent, const nfc_deadline deadline, DWORD *pdwTransferred)
 {
-  DWORD dwBytesToGet = (DWORD)szRx;
-  DWORD dwBytesReceived = 0;
-  DWORD dwTotalBytesReceived = 0;
-  BOOL res;
-
-  // XXX Put this part into uart_win32_timeouts () ?
-  DWORD timeout_ms = timeout;
-  COMMTIMEOUTS timeouts;
-  timeouts.ReadIntervalTimeout = 0;
-  timeouts.ReadTotalTimeoutMultiplier = 0;
-  timeouts.ReadTotalTimeoutConstant = timeout_ms;
-  timeouts.WriteTotalTimeoutMultiplier = 0;
-  timeouts.WriteTotalTimeoutConstant = timeout_ms;
-
-  if (!SetCommTimeouts(((struct serial_port_windows *) sp)->hPort, &timeouts)) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to apply new timeout settings.");
-    return NFC_EIO;
+  HANDLE ahEvents[2] = { pol->hEvent, hAbortEvent };
+  const int timeout = nfc_deadline_timeout(deadline);
+  DWORD dwWait = WAIT_TIMEOUT;
+
+  if (timeout >= 0)
+    dwWait = WaitForMultipleObjects(hAbortEvent ? 2 : 1, ahEvents, FALSE, (timeout == 0) ? INFINITE : (DWORD) timeout);
+  if (dwWait != WAIT_OBJECT_0) {
+    // Timed out or aborted: cancel the operation, bytes already transferred are kept
+    CancelIo(spw->hPort);
   }
-  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeouts are set to %lu ms", timeout_ms);
-
-  // TODO Enhance the reception method
-  // - According to MSDN, it could be better to implement nfc_abort_command() mecanism using Cancello()
-  volatile bool *abort_flag_p = (volatile bool *)abort_p;
-  do {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "ReadFile");
-    res = ReadFile(((struct serial_port_windows *) sp)->hPort, pbtRx + dwTotalBytesReceived,
-                   dwBytesToGet,
-                   &dwBytesReceived, NULL);
-
-    dwTotalBytesReceived += dwBytesReceived;
+  if (!GetOverlappedResult(spw->hPort, pol, pdwTransferred, TRUE) && (GetLastError() != ERROR_OPERATION_ABORTED)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "GetOverlappedResult error: %lu", GetLastError());
+    return WAIT_FAILED;
+  }
+  return dwWait;
+}
 
-    if (!res) {
-      DWORD err = GetLastError();
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "ReadFile error: %lu", err);
-      return NFC_EIO;
-    } else if (dwBytesReceived == 0) {
-      return NFC_ETIMEOUT;
-    }
+// Hand out bytes already read ahead, returns how many were copied
+static size_t
+uart_take_buffered(struct serial_port_windows *spw, uint8_t *pbtRx, const size_t szRx)
+{
+  const size_t szAvailable = spw->szRxBufferLen - spw->szRxBufferPos;
+  const size_t szCopied = MIN(szAvailable, szRx);
+  memcpy(pbtRx, spw->abtRxBuffer + spw->szRxBufferPos, szCopied);
+  spw->szRxBufferPos += szCopied;
+  if (spw->szRxBufferPos == spw->szRxBufferLen) {
+    spw->szRxBufferPos = 0;
+    spw->szRxBufferLen = 0;
+  }
+  return szCopied;
+}
 
-    if (((DWORD)szRx) > dwTotalBytesReceived) {
-      dwBytesToGet -= dwBytesReceived;
+/**
+ * @brief Receive data from UART and copy data to \a pbtRx
+ *
+ * Reads are overlapped: each ReadFile() takes everything the port holds into
+ * a per-port buffer, and the wait for it is bounded by \a deadline (shared by
+ * all the reads of a frame) and woken by uart_abort() when \a abort_p is set.
+ * \a abort_p points to the driver abort flag, cleared when the abort is reported.
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, const nfc_deadline deadline)
+{
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
+  volatile bool *abort_flag_p = (volatile bool *)abort_p;
+  size_t received_bytes_count = uart_take_buffered(spw, pbtRx, szRx);
+
+  while (received_bytes_count < szRx) {
+    DWORD dwBytesReceived = 0;
+    DWORD dwWait = WAIT_OBJECT_0;
+
+    if (abort_flag_p && *abort_flag_p) {
+      dwWait = WAIT_OBJECT_0 + 1;
+    } else if (!ReadFile(spw->hPort, spw->abtRxBuffer + spw->szRxBufferLen,
+                         (DWORD)(sizeof(spw->abtRxBuffer) - spw->szRxBufferLen),
+                         &dwBytesReceived, &spw->olRead)) {
+      if (GetLastError() != ERROR_IO_PENDING) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "ReadFile error: %lu", GetLastError());
+        return NFC_EIO;
+      }
+      dwWait = uart_win32_wait(spw, &spw->olRead, abort_flag_p ? spw->hAbortEvent : NULL, deadline, &dwBytesReceived);
     }
-
-    if (abort_flag_p != NULL && (*abort_flag_p) && dwTotalBytesReceived == 0) {
+    spw->szRxBufferLen += dwBytesReceived;
+    received_bytes_count += uart_take_buffered(spw, pbtRx + received_bytes_count, szRx - received_bytes_count);
+
+    if (dwWait == WAIT_OBJECT_0 + 1) {
+      // Abort requested
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Abort!");
+      *abort_flag_p = false;
+      ResetEvent(spw->hAbortEvent);
       return NFC_EOPABORTED;
     }
-  } while (((DWORD)szRx) > dwTotalBytesReceived);
+    if (dwWait == WAIT_FAILED)
+      return NFC_EIO;
+    // ReadFile() completing empty only means its own wait is over, the deadline decides
+    if ((dwWait == WAIT_TIMEOUT) || ((dwBytesReceived == 0) && (nfc_deadline_timeout(deadline) < 0))) {
+      if (received_bytes_count < szRx) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Timeout!");
+        return NFC_ETIMEOUT;
+      }
+    }
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
 
-  return (dwTotalBytesReceived == (DWORD) szRx) ? 0 : NFC_EIO;
+  return NFC_SUCCESS;
 }
 
+/**
+ * @brief Send \a pbtTx content to UART
+ *
+ * The overlapped write is cancelled if it is not done by \a deadline.
+ *
+ * @return 0 on success, otherwise a driver error is returned
+ */
 int
-uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout)
+uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, const nfc_deadline deadline)
 {
+  struct serial_port_windows *spw = (struct serial_port_windows *) sp;
   DWORD   dwTxLen = 0;
 
-  COMMTIMEOUTS timeouts;
-  timeouts.ReadIntervalTimeout = 0;
-  timeouts.ReadTotalTimeoutMultiplier = 0;
-  timeouts.ReadTotalTimeoutConstant = timeout;
-  timeouts.WriteTotalTimeoutMultiplier = 0;
-  timeouts.WriteTotalTimeoutConstant = timeout;
-
-  if (!SetCommTimeouts(((struct serial_port_windows *) sp)->hPort, &timeouts)) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to apply new timeout settings.");
-    return NFC_EIO;
-  }
-
   LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-  if (!WriteFile(((struct serial_port_windows *) sp)->hPort, pbtTx, szTx, &dwTxLen, NULL)) {
-    return NFC_EIO;
+  if (!WriteFile(spw->hPort, pbtTx, szTx, &dwTxLen, &spw->olWrite)) {
+    if (GetLastError() != ERROR_IO_PENDING) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "WriteFile error: %lu", GetLastError());
+      return NFC_EIO;
+    }
+    const DWORD dwWait = uart_win32_wait(spw, &spw->olWrite, NULL, deadline, &dwTxLen);
+    if (dwWait == WAIT_FAILED)
+      return NFC_EIO;
+    if ((dwWait == WAIT_TIMEOUT) && (dwTxLen != szTx))
+      return NFC_ETIMEOUT;
   }
-  if (!dwTxLen)
-    return NFC_EIO;
-  return 0;
+  return (dwTxLen == szTx) ? NFC_SUCCESS : NFC_EIO;
+}
+
+/**
+ * @brief Wake a uart_receive() waiting on \a sp with an abort flag, e.g. from nfc_abort_command()
+ *
+ * The driver sets its abort flag first; a receive started later aborts at once.
+ */
+void
+uart_abort(serial_port sp)
+{
+  SetEvent(((struct serial_port_windows *) sp)->hAbortEvent);
 }
 
 BOOL is_port_available(int nPort)
@@ -282,3 +390,11 @@ uart_list_ports(void)
 
   return availablePorts;
 }
+
+void
+uart_filter_ports(char **ppcPorts, const char *pcUsbIds)
+{
+  // No USB ids to match serial ports against
+  (void) ppcPorts;
+  (void) pcUsbIds;
+}
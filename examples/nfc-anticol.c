@@ -201,16 +201,9 @@ main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  // Configure the CRC
-  if (nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
-    nfc_close(pnd);
-    nfc_exit(context);
-    exit(EXIT_FAILURE);
-  }
-  // Use raw send/receive methods
-  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false) < 0) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
+  // Handle CRC ourselves and use raw send/receive methods, each raw frame then costs a single exchange
+  if (nfc_initiator_raw_session_begin(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_raw_session_begin");
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
@@ -71,7 +71,6 @@
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
-#include <errno.h>
 #include <signal.h>
 #include <stdlib.h>
 
@@ -117,49 +116,6 @@ static uint8_t __nfcforum_tag2_memory_area[] = {
   0x00, 0x00, 0x00, 0x00,
 };
 
-#define READ 		0x30
-#define WRITE 		0xA2
-#define SECTOR_SELECT 	0xC2
-
-#define HALT 		0x50
-static int
-nfcforum_tag2_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
-{
-  int res = 0;
-
-  uint8_t *nfcforum_tag2_memory_area = (uint8_t *)(emulator->user_data);
-
-  printf("    In: ");
-  print_hex(data_in, data_in_len);
-
-  switch (data_in[0]) {
-    case READ:
-      if (data_out_len >= 16) {
-        memcpy(data_out, nfcforum_tag2_memory_area + (data_in[1] * 4), 16);
-        res = 16;
-      } else {
-        res = -ENOSPC;
-      }
-      break;
-    case HALT:
-      printf("HALT sent\n");
-      res = -ECONNABORTED;
-      break;
-    default:
-      printf("Unknown command: 0x%02x\n", data_in[0]);
-      res = -ENOTSUP;
-  }
-
-  if (res < 0) {
-    ERR("%s (%d)", strerror(-res), -res);
-  } else {
-    printf("    Out: ");
-    print_hex(data_out, res);
-  }
-
-  return res;
-}
-
 int
 main(int argc, char *argv[])
 {
@@ -182,14 +138,11 @@ main(int argc, char *argv[])
     }
   };
 
-  struct nfc_emulation_state_machine state_machine = {
-    .io = nfcforum_tag2_io
-  };
-
-  struct nfc_emulator emulator = {
-    .target = &nt,
-    .state_machine = &state_machine,
-    .user_data = __nfcforum_tag2_memory_area,
+  // READ and HALT are answered by libnfc straight from the memory area
+  struct nfc_emulation_tag tag = {
+    .type = NFC_EMULATION_TAG_TYPE_2,
+    .memory = __nfcforum_tag2_memory_area,
+    .memory_len = sizeof(__nfcforum_tag2_memory_area),
   };
 
   signal(SIGINT, stop_emulation);
@@ -210,7 +163,7 @@ main(int argc, char *argv[])
   printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
   printf("Emulating NDEF tag now, please touch it with a second NFC device\n");
 
-  if (nfc_emulate_target(pnd, &emulator, 0) < 0) {
+  if (nfc_emulate_tag(pnd, &nt, &tag, 0) < 0) {
     nfc_perror(pnd, argv[0]);
     nfc_close(pnd);
     nfc_exit(context);
@@ -43,6 +43,9 @@
  * byte of emulated UID is hard-wired to 0x08 which is the standard way to say
  * this is a random UID.  This example shows how to emulate a fully customized
  * UID by "manually" replying to anti-collision process sent by the initiator.
+ * UID by "manually" replying to anti-collision process sent by the initiator.
+ * UIDs the chip can emulate (4 bytes starting with 0x08) are left to its own
+ * anti-collision, which never misses the reader timings.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -57,21 +60,16 @@
 #include <signal.h>
 
 #include <nfc/nfc.h>
+#include <nfc/nfc-emulation.h>
 
 #include "utils/nfc-utils.h"
 
 #define MAX_FRAME_LEN 264
 
 static uint8_t abtRecv[MAX_FRAME_LEN];
-static int szRecvBits;
 static nfc_device *pnd;
 static nfc_context *context;
 
-// ISO14443A Anti-Collision response
-uint8_t  abtAtqa[2] = { 0x04, 0x00 };
-uint8_t  abtUidBcc[5] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x22 };
-uint8_t  abtSak[9] = { 0x08, 0xb6, 0xdd };
-
 static void
 intr_hdlr(int sig)
 {
@@ -88,20 +86,35 @@ print_usage(char *argv[])
   printf("Usage: %s [OPTIONS] [UID]\n", argv[0]);
   printf("Options:\n");
   printf("\t-h\tHelp. Print this message.\n");
-  printf("\t-q\tQuiet mode. Silent output: received and sent frames will not be shown (improves timing).\n");
+  printf("\t-q\tQuiet mode. Silent output: received frames will not be shown.\n");
   printf("\n");
-  printf("\t[UID]\tUID to emulate, specified as 8 HEX digits (default is DEADBEEF).\n");
+  printf("\t[UID]\tUID to emulate, specified as 8 or 14 HEX digits (default is DEADBEEF).\n");
+  printf("\t\tA 4 bytes UID starting with 08 is emulated by the chip itself.\n");
 }
 
 int
 main(int argc, char *argv[])
 {
-  uint8_t *pbtTx = NULL;
-  size_t  szTxBits;
   bool    quiet_output = false;
-
   int     arg,
-          i;
+          res;
+
+  // ISO14443A target answering REQA, anti-collision and SELECT
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_ISO14443A,
+      .nbr = NBR_UNDEFINED,
+    },
+    .nti = {
+      .nai = {
+        .abtAtqa = { 0x00, 0x04 },
+        .abtUid = { 0xDE, 0xAD, 0xBE, 0xEF },
+        .btSak = 0x08,
+        .szUidLen = 4,
+        .szAtsLen = 0,
+      },
+    },
+  };
 
   // Get commandline options
   for (arg = 1; arg < argc; arg++) {
@@ -111,15 +124,17 @@ main(int argc, char *argv[])
     } else if (0 == strcmp(argv[arg], "-q")) {
       printf("Quiet mode.\n");
       quiet_output = true;
-    } else if ((arg == argc - 1) && (strlen(argv[arg]) == 8)) {         // See if UID was specified as HEX string
+    } else if ((arg == argc - 1) && ((strlen(argv[arg]) == 8) || (strlen(argv[arg]) == 14))) {         // See if UID was specified as HEX string
       uint8_t  abtTmp[3] = { 0x00, 0x00, 0x00 };
       printf("[+] Using UID: %s\n", argv[arg]);
-      abtUidBcc[4] = 0x00;
-      for (i = 0; i < 4; ++i) {
+      nt.nti.nai.szUidLen = strlen(argv[arg]) / 2;
+      for (size_t i = 0; i < nt.nti.nai.szUidLen; ++i) {
         memcpy(abtTmp, argv[arg] + i * 2, 2);
-        abtUidBcc[i] = (uint8_t) strtol((char *) abtTmp, NULL, 16);
-        abtUidBcc[4] ^= abtUidBcc[i];
+        nt.nti.nai.abtUid[i] = (uint8_t) strtol((char *) abtTmp, NULL, 16);
       }
+      // Double size UID
+      if (nt.nti.nai.szUidLen == 7)
+        nt.nti.nai.abtAtqa[1] |= 0x40;
     } else {
       ERR("%s is not supported option.", argv[arg]);
       print_usage(argv);
@@ -150,91 +165,28 @@ main(int argc, char *argv[])
 
   printf("\n");
   printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
-  printf("[+] Try to break out the auto-emulation, this requires a second NFC device!\n");
-  printf("[+] To do this, please send any command after the anti-collision\n");
-  printf("[+] For example, send a RATS command or use the \"nfc-anticol\" or \"nfc-list\" tool.\n");
-
-  // Note: We have to build a "fake" nfc_target in order to do exactly the same that was done before the new nfc_target_init() was introduced.
-  nfc_target nt = {
-    .nm = {
-      .nmt = NMT_ISO14443A,
-      .nbr = NBR_UNDEFINED,
-    },
-    .nti = {
-      .nai = {
-        .abtAtqa = { 0x04, 0x00 },
-        .abtUid = { 0x08, 0xad, 0xbe, 0xef },
-        .btSak = 0x20,
-        .szUidLen = 4,
-        .szAtsLen = 0,
-      },
-    },
-  };
-  if ((szRecvBits = nfc_target_init(pnd, &nt, abtRecv, sizeof(abtRecv), 0)) < 0) {
-    nfc_perror(pnd, "nfc_target_init");
-    ERR("Could not come out of auto-emulation, no command was received");
-    nfc_close(pnd);
-    nfc_exit(context);
-    exit(EXIT_FAILURE);
+  if ((nt.nti.nai.szUidLen == 4) && (nt.nti.nai.abtUid[0] == 0x08)) {
+    printf("[+] The chip emulates this UID by itself\n");
+  } else {
+    printf("[+] Try to break out the auto-emulation, this requires a second NFC device!\n");
+    printf("[+] To do this, please send any command after the anti-collision\n");
+    printf("[+] For example, send a RATS command or use the \"nfc-anticol\" or \"nfc-list\" tool.\n");
   }
-  printf("[+] Received initiator command: ");
-  print_hex_bits(abtRecv, (size_t) szRecvBits);
-  printf("[+] Configuring communication\n");
-  if ((nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) || (nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true) < 0)) {
-    nfc_perror(pnd, "nfc_device_set_property_bool");
-    nfc_close(pnd);
-    nfc_exit(context);
-    exit(EXIT_FAILURE);
-  }
-  printf("[+] Done, the emulated tag is initialized with UID: %02X%02X%02X%02X\n\n", abtUidBcc[0], abtUidBcc[1],
-         abtUidBcc[2], abtUidBcc[3]);
+  printf("[+] Emulating UID: ");
+  print_hex(nt.nti.nai.abtUid, nt.nti.nai.szUidLen);
+  printf("\n");
 
   while (true) {
-    // Test if we received a frame
-    if ((szRecvBits = nfc_target_receive_bits(pnd, abtRecv, sizeof(abtRecv), 0)) > 0) {
-      // Prepare the command to send back for the anti-collision request
-      switch (szRecvBits) {
-        case 7:                  // Request or Wakeup
-          pbtTx = abtAtqa;
-          szTxBits = 16;
-          // New anti-collsion session started
-          if (!quiet_output)
-            printf("\n");
-          break;
-
-        case 16:                 // Select All
-          pbtTx = abtUidBcc;
-          szTxBits = 40;
-          break;
-
-        case 72:                 // Select Tag
-          pbtTx = abtSak;
-          szTxBits = 24;
-          break;
-
-        default:                 // unknown length?
-          szTxBits = 0;
-          break;
-      }
-
-      if (!quiet_output) {
-        printf("R: ");
-        print_hex_bits(abtRecv, (size_t) szRecvBits);
-      }
-      // Test if we know how to respond
-      if (szTxBits) {
-        // Send and print the command to the screen
-        if (nfc_target_send_bits(pnd, pbtTx, szTxBits, NULL) < 0) {
-          nfc_perror(pnd, "nfc_target_send_bits");
-          nfc_close(pnd);
-          nfc_exit(context);
-          exit(EXIT_FAILURE);
-        }
-        if (!quiet_output) {
-          printf("T: ");
-          print_hex_bits(pbtTx, szTxBits);
-        }
-      }
+    // Each command following a selection is shown, then the target waits for a new selection
+    if ((res = nfc_emulate_uid(pnd, &nt, abtRecv, sizeof(abtRecv), 0)) < 0) {
+      nfc_perror(pnd, "nfc_emulate_uid");
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    if (!quiet_output) {
+      printf("R: ");
+      print_hex(abtRecv, (size_t) res);
     }
   }
   nfc_close(pnd);
@@ -231,11 +231,6 @@ main(int argc, char *argv[])
           exit(EXIT_FAILURE);
         }
       }
-      // Print the reader frame to the screen
-      if (!quiet_output) {
-        printf("R: ");
-        print_hex_par(abtReaderRx, (size_t) szReaderRxBits, abtReaderRxPar);
-      }
       // Forward the frame to the original tag
       if ((szTagRxBits = nfc_initiator_transceive_bits
                          (pndReader, abtReaderRx, (size_t) szReaderRxBits, abtReaderRxPar, abtTagRx, sizeof(abtTagRx), abtTagRxPar)) > 0) {
@@ -247,8 +242,12 @@ main(int argc, char *argv[])
           nfc_exit(context);
           exit(EXIT_FAILURE);
         }
-        // Print the tag frame to the screen
-        if (!quiet_output) {
+      }
+      // Print the frames to the screen once the answer is sent, the console stays out of the relay path
+      if (!quiet_output) {
+        printf("R: ");
+        print_hex_par(abtReaderRx, (size_t) szReaderRxBits, abtReaderRxPar);
+        if (szTagRxBits > 0) {
           printf("T: ");
           print_hex_par(abtTagRx, szTagRxBits, abtTagRxPar);
         }
@@ -0,0 +1,455 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file pn53x-mux-daemon.c
+ * @brief Shares a local PN53x device between processes using libnfc's mux driver
+ *
+ * The daemon holds the device and runs the frames clients queue in the
+ * shared segment (see libnfc/drivers/mux.h), one client transaction at a
+ * time, highest priority class first.
+ */
+
+// O_NOFOLLOW is POSIX.1-2008, which _XOPEN_SOURCE 600 hides on glibc
+#define _DEFAULT_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "utils/nfc-utils.h"
+#include "libnfc/chips/pn53x.h"
+#include "libnfc/drivers/mux.h"
+
+struct daemon {
+  nfc_device *pnd;
+  struct mux_header *pHeader;
+  // Slot holding the chip for a transaction, -1 if none
+  int iOwner;
+  // Slot which ran the last frame, -1 if none
+  int iLastOwner;
+  // Slot whose frame runs, read by the abort thread
+  int iRunning;
+  uint64_t ui64OwnerActivity;
+  // Spinning budget, none on a single CPU where it would only delay clients
+  uint64_t ui64SpinUs;
+  size_t szNext;
+  bool abFailed[MUX_SLOTS];
+  uint32_t aui32Aborts[MUX_SLOTS];
+};
+
+static volatile sig_atomic_t quitting = 0;
+static bool verbose = false;
+
+static void
+stop(int sig)
+{
+  (void) sig;
+  quitting = 1;
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-s path] [-v] [connstring]\n", progname);
+  printf("  -s\t shared segment to create (default: %s)\n", MUX_DEFAULT_PATH);
+  printf("  -v\t print when another client takes the chip, and clients leaving\n");
+  printf("  connstring\t device to share (default: first device found)\n");
+}
+
+static uint64_t
+time_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+// Lock a process-shared mutex, false when it stays held (by a client which died holding it)
+static bool
+lock(pthread_mutex_t *pMutex)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec++;
+  return pthread_mutex_timedlock(pMutex, &ts) == 0;
+}
+
+// Wake up the sleepers of a process-shared condition variable
+static void
+wake(pthread_mutex_t *pMutex, pthread_cond_t *pCond)
+{
+  const bool bLocked = lock(pMutex);
+  pthread_cond_broadcast(pCond);
+  if (bLocked)
+    pthread_mutex_unlock(pMutex);
+}
+
+static void
+init_shared(pthread_mutex_t *pMutex, pthread_cond_t *pCond)
+{
+  pthread_mutexattr_t ma;
+  pthread_condattr_t ca;
+
+  pthread_mutexattr_init(&ma);
+  pthread_mutexattr_setpshared(&ma, PTHREAD_PROCESS_SHARED);
+  pthread_mutex_init(pMutex, &ma);
+  pthread_mutexattr_destroy(&ma);
+  pthread_condattr_init(&ca);
+  pthread_condattr_setpshared(&ca, PTHREAD_PROCESS_SHARED);
+  pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+  pthread_cond_init(pCond, &ca);
+  pthread_condattr_destroy(&ca);
+}
+
+// Remove the segment left by a previous daemon, false if it is still served or isn't ours
+static bool
+remove_stale_segment(const char *pcPath)
+{
+  int fd;
+  if ((fd = open(pcPath, O_RDONLY | O_NOFOLLOW)) < 0) {
+    ERR("%s: %s", pcPath, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if ((fstat(fd, &st) < 0) || (!S_ISREG(st.st_mode)) || (st.st_uid != geteuid()) || (st.st_mode & (S_IWOTH | S_IXUSR | S_IXGRP | S_IXOTH))) {
+    ERR("%s is not a segment of ours, remove it or use -s", pcPath);
+    close(fd);
+    return false;
+  }
+  if ((size_t) st.st_size == sizeof(struct mux_header)) {
+    struct mux_header *pHeader = mmap(NULL, sizeof(struct mux_header), PROT_READ, MAP_SHARED, fd, 0);
+    if (pHeader != MAP_FAILED) {
+      const bool bServed = (memcmp(pHeader->abtMagic, MUX_MAGIC, sizeof(pHeader->abtMagic)) == 0) && (kill(pHeader->daemon, 0) == 0);
+      munmap(pHeader, sizeof(struct mux_header));
+      if (bServed) {
+        ERR("%s is served by another daemon", pcPath);
+        close(fd);
+        return false;
+      }
+    }
+  }
+  close(fd);
+  return unlink(pcPath) == 0;
+}
+
+// Create the segment, unless another daemon already serves it
+static struct mux_header *
+create_segment(const char *pcPath, nfc_device *pnd)
+{
+  struct mux_header *pHeader;
+  int fd;
+
+  // A new file only: a link or a file planted in a shared directory such as /tmp is never opened for writing
+  if ((fd = open(pcPath, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0660)) < 0) {
+    if ((errno != EEXIST) || !remove_stale_segment(pcPath) ||
+        ((fd = open(pcPath, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW, 0660)) < 0))
+      return NULL;
+  }
+  if (ftruncate(fd, sizeof(struct mux_header)) < 0) {
+    close(fd);
+    unlink(pcPath);
+    return NULL;
+  }
+  pHeader = mmap(NULL, sizeof(struct mux_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pHeader == MAP_FAILED) {
+    unlink(pcPath);
+    return NULL;
+  }
+
+  pHeader->ui32Version = MUX_VERSION;
+  pHeader->daemon = getpid();
+  snprintf(pHeader->acName, sizeof(pHeader->acName), "%s", nfc_device_get_name(pnd));
+  init_shared(&pHeader->mutex, &pHeader->cond);
+  for (size_t i = 0; i < MUX_SLOTS; i++)
+    init_shared(&pHeader->slots[i].mutex, &pHeader->slots[i].cond);
+  // Clients map the segment once the magic is there
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(pHeader->abtMagic, MUX_MAGIC, sizeof(pHeader->abtMagic));
+  return pHeader;
+}
+
+static bool
+slot_pending(const struct mux_slot *pSlot)
+{
+  return __atomic_load_n(&pSlot->ui32Head, __ATOMIC_ACQUIRE) != pSlot->ui32Done;
+}
+
+// Whether a frame answer tells a failure: commands with status byte only
+static bool
+frame_failed(const uint8_t *pbtTx, const uint8_t *pbtRx, const int res)
+{
+  if (res < 0)
+    return true;
+  switch (pbtTx[0]) {
+    case InDataExchange:
+    case InCommunicateThru:
+      return (res == 0) || ((pbtRx[0] & 0x3f) != 0);
+  }
+  return false;
+}
+
+// Run the next entry of a slot and hand its answer back
+static void
+run_entry(struct daemon *pd, const int iSlot)
+{
+  struct mux_slot *pSlot = &pd->pHeader->slots[iSlot];
+  struct mux_entry *pEntry = &pSlot->ring[pSlot->ui32Done % MUX_RING_LEN];
+  int res = NFC_SUCCESS;
+
+  switch (pEntry->ui8Type) {
+    case MUX_ENTRY_BEGIN:
+      if (pd->iOwner < 0) {
+        pd->iOwner = iSlot;
+        res = (pd->iLastOwner != iSlot) ? 1 : 0;
+        if (verbose && res)
+          printf("Slot %d (pid %d) takes the chip\n", iSlot, (int) pSlot->pid);
+        pd->iLastOwner = iSlot;
+      }
+      pd->abFailed[iSlot] = false;
+      break;
+    case MUX_ENTRY_FRAME:
+      if ((pEntry->ui8Flags & MUX_FLAG_IF_PREVIOUS_OK) && pd->abFailed[iSlot]) {
+        res = NFC_EOPABORTED;
+        break;
+      }
+      if ((pEntry->ui16Tx == 0) || (pEntry->ui16Tx > MUX_FRAME_MAX_LEN)) {
+        res = NFC_EINVARG;
+      } else {
+        pd->iLastOwner = iSlot;
+        __atomic_store_n(&pd->iRunning, iSlot, __ATOMIC_SEQ_CST);
+        res = pn53x_transceive_raw(pd->pnd, pEntry->abtTx, pEntry->ui16Tx, pEntry->abtRx, sizeof(pEntry->abtRx), pEntry->i32Timeout);
+        __atomic_store_n(&pd->iRunning, -1, __ATOMIC_SEQ_CST);
+      }
+      pd->abFailed[iSlot] = (res == NFC_EINVARG) || frame_failed(pEntry->abtTx, pEntry->abtRx, res);
+      break;
+    case MUX_ENTRY_END:
+      if (pd->iOwner == iSlot)
+        pd->iOwner = -1;
+      break;
+    default:
+      res = NFC_EINVARG;
+  }
+  pEntry->i32Res = res;
+  pd->ui64OwnerActivity = time_us();
+
+  __atomic_store_n(&pSlot->ui32Done, pSlot->ui32Done + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pSlot->ui32Sleeping, __ATOMIC_SEQ_CST))
+    wake(&pSlot->mutex, &pSlot->cond);
+}
+
+// Slot to serve next: the transaction running, otherwise the highest priority class, round robin within a class
+static int
+next_slot(struct daemon *pd)
+{
+  if (pd->iOwner >= 0)
+    return slot_pending(&pd->pHeader->slots[pd->iOwner]) ? pd->iOwner : -1;
+  for (uint32_t ui32Class = 0; ui32Class < MUX_PRIORITY_CLASSES; ui32Class++) {
+    for (size_t k = 0; k < MUX_SLOTS; k++) {
+      const size_t i = (pd->szNext + k) % MUX_SLOTS;
+      const struct mux_slot *pSlot = &pd->pHeader->slots[i];
+      if ((__atomic_load_n(&pSlot->ui32State, __ATOMIC_ACQUIRE) == MUX_SLOT_CLAIMED) && (pSlot->ui32Priority == ui32Class) && slot_pending(pSlot)) {
+        pd->szNext = i + 1;
+        return (int) i;
+      }
+    }
+  }
+  return -1;
+}
+
+// Free slots of dead clients, give up transactions which stopped sending frames
+static void
+reap(struct daemon *pd)
+{
+  for (int i = 0; i < MUX_SLOTS; i++) {
+    struct mux_slot *pSlot = &pd->pHeader->slots[i];
+    const bool bClaimed = (__atomic_load_n(&pSlot->ui32State, __ATOMIC_ACQUIRE) == MUX_SLOT_CLAIMED);
+    if (bClaimed && (kill(pSlot->pid, 0) < 0) && (errno == ESRCH)) {
+      if (verbose)
+        printf("Slot %d (pid %d) is gone\n", i, (int) pSlot->pid);
+      __atomic_store_n(&pSlot->ui32Done, __atomic_load_n(&pSlot->ui32Head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+      __atomic_store_n(&pSlot->ui32State, MUX_SLOT_FREE, __ATOMIC_RELEASE);
+      if (pd->iOwner == i)
+        pd->iOwner = -1;
+    } else if ((pd->iOwner == i) && !slot_pending(pSlot) &&
+               ((!bClaimed) || (time_us() - pd->ui64OwnerActivity > (uint64_t) MUX_STALL_TIMEOUT * 1000))) {
+      if (verbose)
+        printf("Slot %d (pid %d) stalled, chip released\n", i, (int) pSlot->pid);
+      pd->iOwner = -1;
+    }
+  }
+}
+
+// Sleep until a client rings, or for a second
+static void
+wait_doorbell(struct daemon *pd, const uint32_t ui32Doorbell)
+{
+  struct mux_header *pHeader = pd->pHeader;
+  const uint64_t ui64SpinEnd = time_us() + pd->ui64SpinUs;
+  while (time_us() < ui64SpinEnd) {
+    if (__atomic_load_n(&pHeader->ui32Doorbell, __ATOMIC_ACQUIRE) != ui32Doorbell)
+      return;
+  }
+  if (!lock(&pHeader->mutex))
+    return;
+  __atomic_store_n(&pHeader->ui32Sleeping, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pHeader->ui32Doorbell, __ATOMIC_SEQ_CST) == ui32Doorbell) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec++;
+    pthread_cond_timedwait(&pHeader->cond, &pHeader->mutex, &ts);
+  }
+  __atomic_store_n(&pHeader->ui32Sleeping, 0, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&pHeader->mutex);
+}
+
+// Abort the running frame when its client asks for it
+static void *
+watch_aborts(void *arg)
+{
+  struct daemon *pd = arg;
+  struct mux_header *pHeader = pd->pHeader;
+
+  while (!quitting) {
+    if (!lock(&pHeader->mutex))
+      continue;
+    for (int i = 0; i < MUX_SLOTS; i++) {
+      const uint32_t ui32Aborts = __atomic_load_n(&pHeader->slots[i].ui32Aborts, __ATOMIC_SEQ_CST);
+      if (ui32Aborts == pd->aui32Aborts[i])
+        continue;
+      pd->aui32Aborts[i] = ui32Aborts;
+      if (__atomic_load_n(&pd->iRunning, __ATOMIC_SEQ_CST) == i)
+        nfc_abort_command(pd->pnd);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec++;
+    pthread_cond_timedwait(&pHeader->cond, &pHeader->mutex, &ts);
+    pthread_mutex_unlock(&pHeader->mutex);
+  }
+  return NULL;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *connstring = NULL;
+  const char *pcPath = MUX_DEFAULT_PATH;
+
+  for (int i = 1; i < argc; i++) {
+    if ((0 == strcmp(argv[i], "-s")) && (i + 1 < argc)) {
+      pcPath = argv[++i];
+    } else if (0 == strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else if ((argv[i][0] != '-') && (!connstring)) {
+      connstring = argv[i];
+    } else {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+  struct daemon d = { .iOwner = -1, .iLastOwner = -1, .iRunning = -1, .szNext = 0 };
+  d.ui64SpinUs = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? MUX_SPIN_US : 0;
+  if (!(d.pnd = nfc_open(context, connstring))) {
+    ERR("%s", "Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if (!(d.pHeader = create_segment(pcPath, d.pnd))) {
+    ERR("Unable to create %s", pcPath);
+    nfc_close(d.pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+  printf("Sharing %s through %s\n", nfc_device_get_name(d.pnd), pcPath);
+  if (verbose)
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+  pthread_t watcher;
+  const bool bWatching = (pthread_create(&watcher, NULL, watch_aborts, &d) == 0);
+  uint64_t ui64LastReap = time_us();
+  while (!quitting) {
+    const uint32_t ui32Doorbell = __atomic_load_n(&d.pHeader->ui32Doorbell, __ATOMIC_ACQUIRE);
+    const int iSlot = next_slot(&d);
+    if (iSlot >= 0) {
+      run_entry(&d, iSlot);
+    } else {
+      wait_doorbell(&d, ui32Doorbell);
+    }
+    if (time_us() - ui64LastReap > 100000) {
+      reap(&d);
+      ui64LastReap = time_us();
+    }
+  }
+
+  // Clients find out the daemon is gone
+  unlink(pcPath);
+  if (bWatching) {
+    wake(&d.pHeader->mutex, &d.pHeader->cond);
+    pthread_join(watcher, NULL);
+  }
+  memset(d.pHeader->abtMagic, 0, sizeof(d.pHeader->abtMagic));
+  munmap(d.pHeader, sizeof(struct mux_header));
+  nfc_close(d.pnd);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,412 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file pn53x-remote-agent.c
+ * @brief Shares a local PN53x device over TCP with the remote driver
+ *
+ * The agent relays TAMA frames received from libnfc's remote driver (see
+ * libnfc/drivers/remote.h for the protocol) to its device, one client at a
+ * time. Frames of an exchange packet are run back to back: packets are read
+ * by their own thread while the previous ones run, so that ABORT packets
+ * interrupt the running command.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <err.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "utils/nfc-utils.h"
+#include "libnfc/chips/pn53x.h"
+#include "libnfc/drivers/remote.h"
+
+// Packets read ahead of the one running
+#define PACKET_QUEUE_LEN 4
+
+struct packet {
+  uint8_t type;
+  uint8_t flags;
+  size_t szPayload;
+  uint8_t abtPayload[REMOTE_PAYLOAD_MAX_LEN];
+};
+
+// Packets read from the client, waiting to be run
+struct session {
+  nfc_device *pnd;
+  int fd;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct packet *queue[PACKET_QUEUE_LEN];
+  size_t szFirst;
+  size_t szQueued;
+  bool closed;
+};
+
+static bool verbose = false;
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-p port] [-v] [connstring]\n", progname);
+  printf("  -p\t TCP port to listen to (default: %d)\n", REMOTE_DEFAULT_PORT);
+  printf("  -v\t print every packet\n");
+  printf("  connstring\t device to share (default: first device found)\n");
+}
+
+static bool
+read_all(const int fd, uint8_t *pbtData, size_t szData)
+{
+  while (szData > 0) {
+    const ssize_t n = recv(fd, pbtData, szData, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    pbtData += n;
+    szData -= n;
+  }
+  return true;
+}
+
+static bool
+write_all(const int fd, const uint8_t *pbtData, size_t szData)
+{
+  while (szData > 0) {
+    const ssize_t n = send(fd, pbtData, szData, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    pbtData += n;
+    szData -= n;
+  }
+  return true;
+}
+
+static bool
+write_packet(const int fd, const uint8_t ui8Type, uint8_t *pbtPacket, const size_t szPayload)
+{
+  pbtPacket[0] = ui8Type;
+  pbtPacket[1] = 0;
+  pbtPacket[2] = szPayload >> 8;
+  pbtPacket[3] = szPayload & 0xff;
+  return write_all(fd, pbtPacket, REMOTE_HEADER_LEN + szPayload);
+}
+
+// Read packets until the client leaves: aborts are handled here, others are queued
+static void *
+read_packets(void *arg)
+{
+  struct session *s = arg;
+  uint8_t abtHeader[REMOTE_HEADER_LEN];
+
+  while (read_all(s->fd, abtHeader, sizeof(abtHeader))) {
+    if (abtHeader[0] == REMOTE_PACKET_ABORT) {
+      if (verbose)
+        printf("Abort\n");
+      nfc_abort_command(s->pnd);
+      continue;
+    }
+    pthread_mutex_lock(&s->mutex);
+    while ((s->szQueued == PACKET_QUEUE_LEN) && !s->closed)
+      pthread_cond_wait(&s->cond, &s->mutex);
+    struct packet *pp = s->closed ? NULL : s->queue[(s->szFirst + s->szQueued) % PACKET_QUEUE_LEN];
+    pthread_mutex_unlock(&s->mutex);
+    if (!pp)
+      break;
+
+    pp->type = abtHeader[0];
+    pp->flags = abtHeader[1];
+    pp->szPayload = (abtHeader[2] << 8) | abtHeader[3];
+    if (!read_all(s->fd, pp->abtPayload, pp->szPayload))
+      break;
+    pthread_mutex_lock(&s->mutex);
+    s->szQueued++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+  }
+  pthread_mutex_lock(&s->mutex);
+  s->closed = true;
+  pthread_cond_broadcast(&s->cond);
+  pthread_mutex_unlock(&s->mutex);
+  return NULL;
+}
+
+// Whether a frame answer tells a failure: commands with status byte only
+static bool
+frame_failed(const uint8_t *pbtTx, const uint8_t *pbtRx, const int res)
+{
+  if (res < 0)
+    return true;
+  switch (pbtTx[0]) {
+    case InDataExchange:
+    case InCommunicateThru:
+      return (res == 0) || ((pbtRx[0] & 0x3f) != 0);
+  }
+  return false;
+}
+
+// Run the frames of an exchange packet, answers are written in abtAnswer after the header room
+static size_t
+run_exchange(struct session *s, const struct packet *pp, uint8_t *pbtAnswer, bool *pbFailed)
+{
+  const uint8_t *pbtPayload = pp->abtPayload;
+  size_t szOffset = 4;
+  size_t szAnswer = 0;
+
+  if ((pp->flags & REMOTE_FLAG_IF_PREVIOUS_OK) && *pbFailed)
+    return 0;
+  *pbFailed = false;
+  if (pp->szPayload < 4) {
+    *pbFailed = true;
+    return 0;
+  }
+  const uint32_t ui32Timeout = ((uint32_t) pbtPayload[0] << 24) | (pbtPayload[1] << 16) | (pbtPayload[2] << 8) | pbtPayload[3];
+  const int timeout = (ui32Timeout > INT32_MAX) ? 0 : (int) ui32Timeout;
+
+  for (size_t n = 0; (n < REMOTE_BATCH_MAX_FRAMES) && (szOffset + 2 <= pp->szPayload); n++) {
+    const size_t szTx = (pbtPayload[szOffset] << 8) | pbtPayload[szOffset + 1];
+    const uint8_t *pbtTx = pbtPayload + szOffset + 2;
+    szOffset += 2 + szTx;
+    uint8_t *pbtRx = pbtAnswer + szAnswer + 2;
+    int res = NFC_EINVARG;
+    if ((szTx > 0) && (szOffset <= pp->szPayload))
+      res = pn53x_transceive_raw(s->pnd, pbtTx, szTx, pbtRx, REMOTE_ANSWER_MAX_LEN, timeout);
+    if (verbose) {
+      printf("Tx: ");
+      print_hex(pbtTx, (szOffset <= pp->szPayload) ? szTx : 0);
+      if (res > 0) {
+        printf("Rx: ");
+        print_hex(pbtRx, res);
+      } else {
+        printf("Rx: %s\n", nfc_strerror(s->pnd));
+      }
+    }
+    pbtAnswer[szAnswer] = ((uint16_t) res) >> 8;
+    pbtAnswer[szAnswer + 1] = ((uint16_t) res) & 0xff;
+    szAnswer += 2 + ((res > 0) ? res : 0);
+    if (frame_failed(pbtTx, pbtRx, res)) {
+      *pbFailed = true;
+      break;
+    }
+  }
+  return szAnswer;
+}
+
+// Serve a client until it leaves or the link fails
+static void
+serve(nfc_device *pnd, const int fd)
+{
+  struct session s = { .pnd = pnd, .fd = fd, .szFirst = 0, .szQueued = 0, .closed = false };
+  uint8_t *pbtPacket = malloc(REMOTE_HEADER_LEN + REMOTE_PAYLOAD_MAX_LEN);
+  size_t szAlloc;
+  pthread_t reader;
+  bool failed = false;
+
+  for (szAlloc = 0; szAlloc < PACKET_QUEUE_LEN; szAlloc++) {
+    if (!(s.queue[szAlloc] = malloc(sizeof(struct packet))))
+      break;
+  }
+  if ((!pbtPacket) || (szAlloc < PACKET_QUEUE_LEN)) {
+    ERR("Unable to allocate packet buffers");
+    goto free;
+  }
+  pthread_mutex_init(&s.mutex, NULL);
+  pthread_cond_init(&s.cond, NULL);
+  if (pthread_create(&reader, NULL, read_packets, &s) != 0) {
+    ERR("Unable to start packet reader");
+    goto destroy;
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&s.mutex);
+    while ((s.szQueued == 0) && !s.closed)
+      pthread_cond_wait(&s.cond, &s.mutex);
+    struct packet *pp = (s.szQueued > 0) ? s.queue[s.szFirst] : NULL;
+    pthread_mutex_unlock(&s.mutex);
+    if (!pp)
+      break;
+
+    bool sent = true;
+    if (pp->type == REMOTE_PACKET_HELLO) {
+      const char *name = nfc_device_get_name(pnd);
+      const size_t szName = MIN(strlen(name), (size_t) 255);
+      pbtPacket[REMOTE_HEADER_LEN] = REMOTE_PROTOCOL_VERSION;
+      memcpy(pbtPacket + REMOTE_HEADER_LEN + 1, name, szName);
+      sent = write_packet(fd, REMOTE_PACKET_HELLO, pbtPacket, 1 + szName);
+    } else if (pp->type == REMOTE_PACKET_EXCHANGE) {
+      const size_t szAnswer = run_exchange(&s, pp, pbtPacket + REMOTE_HEADER_LEN, &failed);
+      sent = write_packet(fd, REMOTE_PACKET_EXCHANGE, pbtPacket, szAnswer);
+    }
+
+    pthread_mutex_lock(&s.mutex);
+    s.szFirst = (s.szFirst + 1) % PACKET_QUEUE_LEN;
+    s.szQueued--;
+    if (!sent)
+      s.closed = true;
+    pthread_cond_broadcast(&s.cond);
+    pthread_mutex_unlock(&s.mutex);
+    if (!sent)
+      break;
+  }
+  // Wakes the reader up if it still waits for the client
+  shutdown(fd, SHUT_RDWR);
+  pthread_join(reader, NULL);
+
+destroy:
+  pthread_cond_destroy(&s.cond);
+  pthread_mutex_destroy(&s.mutex);
+free:
+  while (szAlloc > 0)
+    free(s.queue[--szAlloc]);
+  free(pbtPacket);
+}
+
+static int
+listen_on(const char *port)
+{
+  const struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = AI_PASSIVE };
+  struct addrinfo *res, *ai;
+  int fd = -1;
+
+  if (getaddrinfo(NULL, port, &hints, &res) != 0)
+    return -1;
+  // IPv6 first, it usually takes IPv4 clients as well
+  for (int family = AF_INET6; fd < 0; family = AF_INET) {
+    for (ai = res; ai && (fd < 0); ai = ai->ai_next) {
+      if (ai->ai_family != family)
+        continue;
+      if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+        continue;
+      const int one = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if ((bind(fd, ai->ai_addr, ai->ai_addrlen) < 0) || (listen(fd, 1) < 0)) {
+        close(fd);
+        fd = -1;
+      }
+    }
+    if (family == AF_INET)
+      break;
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *connstring = NULL;
+  char port[8];
+  snprintf(port, sizeof(port), "%d", REMOTE_DEFAULT_PORT);
+
+  for (int i = 1; i < argc; i++) {
+    if ((0 == strcmp(argv[i], "-p")) && (i + 1 < argc)) {
+      snprintf(port, sizeof(port), "%s", argv[++i]);
+    } else if (0 == strcmp(argv[i], "-v")) {
+      verbose = true;
+    } else if ((argv[i][0] != '-') && (!connstring)) {
+      connstring = argv[i];
+    } else {
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+  nfc_device *pnd = nfc_open(context, connstring);
+  if (pnd == NULL) {
+    ERR("%s", "Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  const int fd = listen_on(port);
+  if (fd < 0) {
+    ERR("Unable to listen to port %s", port);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  printf("Sharing %s on port %s\n", nfc_device_get_name(pnd), port);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    const int client = accept(fd, NULL, NULL);
+    if (client < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    const int one = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (verbose)
+      printf("Client connected\n");
+    serve(pnd, client);
+    close(client);
+    if (verbose)
+      printf("Client left\n");
+    // Next client starts from a known state
+    nfc_idle(pnd);
+  }
+
+  close(fd);
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
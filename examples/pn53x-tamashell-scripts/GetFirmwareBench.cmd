@@ -0,0 +1,11 @@
+#!/usr/bin/env pn53x-tamashell
+// Run with: pn53x-tamashell -b GetFirmwareBench.cmd
+
+// Round trip of the shortest command, as seen by the host
+r 1000 02;                        // GetFirmwareVersion
+
+// Same, with a register read in between
+r 100
+  02;                             // GetFirmwareVersion
+  06 63 3d;                       // ReadRegister CIU_BitFraming
+n
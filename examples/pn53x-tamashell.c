@@ -50,6 +50,8 @@
 #endif //HAVE_READLINE
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
@@ -63,6 +65,7 @@
     nanosleep(&xsleep, NULL); \
   } while (0)
 #else
+#  include <windows.h>
 #  include <winbase.h>
 #  define msleep Sleep
 #endif
@@ -74,6 +77,292 @@
 #include "libnfc/chips/pn53x.h"
 
 #define MAX_FRAME_LEN 264
+#define MAX_LINE_LEN 512
+#define MAX_LOOP_DEPTH 16
+
+// One line of a script run in batch mode
+struct script_op {
+  enum { OP_FRAME, OP_PAUSE, OP_REPEAT, OP_NEXT } type;
+  int line;
+  // Pause in ms, repeat count, or index of the matching OP_NEXT for OP_REPEAT
+  int value;
+  int end;
+  uint8_t abtTx[MAX_FRAME_LEN];
+  size_t szTx;
+  // Timings of the frame, in microseconds
+  unsigned long count;
+  unsigned long errors;
+  uint64_t total_us;
+  uint64_t min_us;
+  uint64_t max_us;
+  uint8_t abtRx[MAX_FRAME_LEN];
+  size_t szRx;
+};
+
+struct script {
+  struct script_op *ops;
+  size_t szOps;
+  size_t szAlloc;
+};
+
+static bool verbose = false;
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-b] [-v] [script]\n", progname);
+  printf("  -b\t batch mode: parse the whole script first, then run it back to back and report latencies\n");
+  printf("  -v\t with -b, print every exchange\n");
+}
+
+// Monotonic time in microseconds
+static uint64_t
+time_us(void)
+{
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+#else
+  LARGE_INTEGER freq, counter;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)(counter.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#endif
+}
+
+// Read hexadecimal bytes from cmd + offset, up to the first non-hex character
+static size_t
+parse_frame(const char *cmd, int offset, uint8_t *abtTx)
+{
+  size_t szTx = 0;
+  for (int i = 0; i < MAX_FRAME_LEN; i++) {
+    int size;
+    unsigned int byte;
+    while (isspace(cmd[offset])) {
+      offset++;
+    }
+    size = sscanf(cmd + offset, "%2x", &byte);
+    if (size < 1) {
+      break;
+    }
+    abtTx[i] = byte;
+    szTx++;
+    if (cmd[offset + 1] == 0) { // if last hex was only 1 symbol
+      break;
+    }
+    offset += 2;
+  }
+  return szTx;
+}
+
+// Decimal argument of a one-letter command
+static int
+parse_arg(const char *cmd, int *offset)
+{
+  int value = 0;
+  int n = 0;
+  (*offset)++;
+  while (isspace(cmd[*offset])) {
+    (*offset)++;
+  }
+  if (sscanf(cmd + *offset, "%10d%n", &value, &n) == 1)
+    *offset += n;
+  return value;
+}
+
+static struct script_op *
+script_add(struct script *psc, int type, int line)
+{
+  if (psc->szOps == psc->szAlloc) {
+    size_t szAlloc = psc->szAlloc ? psc->szAlloc * 2 : 64;
+    struct script_op *ops = realloc(psc->ops, szAlloc * sizeof(*ops));
+    if (ops == NULL)
+      return NULL;
+    psc->ops = ops;
+    psc->szAlloc = szAlloc;
+  }
+  struct script_op *pop = &psc->ops[psc->szOps++];
+  memset(pop, 0, sizeof(*pop));
+  pop->type = type;
+  pop->line = line;
+  return pop;
+}
+
+/*
+ * Turn the whole script into binary frames before anything is sent, so that
+ * neither parsing nor echo sit between two commands. Besides frames and
+ * pauses, batch scripts may repeat commands:
+ *   r N <frame>   sends the frame N times
+ *   r N ... n     runs the lines up to the matching "n" N times (blocks nest)
+ */
+static int
+script_parse(struct script *psc, FILE *input)
+{
+  char cmd[MAX_LINE_LEN];
+  size_t aszOpen[MAX_LOOP_DEPTH];
+  size_t szOpen = 0;
+  int line = 0;
+
+  while (fgets(cmd, sizeof(cmd), input) != NULL) {
+    struct script_op *pop;
+    int offset = 0;
+    line++;
+    // Blocks may be indented
+    while (isspace(cmd[offset])) {
+      offset++;
+    }
+    if (cmd[offset] == 'q')
+      break;
+    if (cmd[offset] == 'p') {
+      if ((pop = script_add(psc, OP_PAUSE, line)) == NULL)
+        return -1;
+      pop->value = parse_arg(cmd, &offset);
+      continue;
+    }
+    if (cmd[offset] == 'r') {
+      const int count = parse_arg(cmd, &offset);
+      if (count < 1) {
+        ERR("line %d: repeat count must be positive", line);
+        return -1;
+      }
+      uint8_t abtTx[MAX_FRAME_LEN];
+      const size_t szTx = parse_frame(cmd, offset, abtTx);
+      if (szTx > 0) {
+        // Single frame: a block of one line
+        if ((pop = script_add(psc, OP_REPEAT, line)) == NULL)
+          return -1;
+        pop->value = count;
+        if ((pop = script_add(psc, OP_FRAME, line)) == NULL)
+          return -1;
+        memcpy(pop->abtTx, abtTx, szTx);
+        pop->szTx = szTx;
+        if ((pop = script_add(psc, OP_NEXT, line)) == NULL)
+          return -1;
+        psc->ops[psc->szOps - 3].end = psc->szOps - 1;
+        continue;
+      }
+      if (szOpen == MAX_LOOP_DEPTH) {
+        ERR("line %d: too many nested repeat blocks", line);
+        return -1;
+      }
+      if ((pop = script_add(psc, OP_REPEAT, line)) == NULL)
+        return -1;
+      pop->value = count;
+      aszOpen[szOpen++] = psc->szOps - 1;
+      continue;
+    }
+    if (cmd[offset] == 'n') {
+      if (szOpen == 0) {
+        ERR("line %d: \"n\" without repeat block", line);
+        return -1;
+      }
+      if ((pop = script_add(psc, OP_NEXT, line)) == NULL)
+        return -1;
+      psc->ops[aszOpen[--szOpen]].end = psc->szOps - 1;
+      continue;
+    }
+    uint8_t abtTx[MAX_FRAME_LEN];
+    const size_t szTx = parse_frame(cmd, offset, abtTx);
+    if (szTx < 1)
+      continue;
+    if ((pop = script_add(psc, OP_FRAME, line)) == NULL)
+      return -1;
+    memcpy(pop->abtTx, abtTx, szTx);
+    pop->szTx = szTx;
+  }
+  if (szOpen > 0) {
+    ERR("line %d: repeat block not closed", psc->ops[aszOpen[szOpen - 1]].line);
+    return -1;
+  }
+  return 0;
+}
+
+// Run ops [first, last), timing each frame exchange alone
+static void
+script_run(nfc_device *pnd, struct script *psc, size_t first, size_t last)
+{
+  for (size_t i = first; i < last; i++) {
+    struct script_op *pop = &psc->ops[i];
+    switch (pop->type) {
+      case OP_PAUSE:
+        if (pop->value > 0)
+          msleep(pop->value);
+        break;
+      case OP_REPEAT:
+        for (int n = 0; n < pop->value; n++)
+          script_run(pnd, psc, i + 1, pop->end);
+        i = pop->end;
+        break;
+      case OP_NEXT:
+        break;
+      case OP_FRAME: {
+        const uint64_t start = time_us();
+        const int res = pn53x_transceive(pnd, pop->abtTx, pop->szTx, pop->abtRx, sizeof(pop->abtRx), 0);
+        const uint64_t elapsed = time_us() - start;
+        if ((pop->count == 0) || (elapsed < pop->min_us))
+          pop->min_us = elapsed;
+        if (elapsed > pop->max_us)
+          pop->max_us = elapsed;
+        pop->total_us += elapsed;
+        pop->count++;
+        if (res < 0) {
+          pop->errors++;
+          pop->szRx = 0;
+        } else {
+          pop->szRx = (size_t) res;
+        }
+        if (verbose) {
+          printf("Tx: ");
+          print_hex(pop->abtTx, pop->szTx);
+          if (res < 0) {
+            nfc_perror(pnd, "Rx");
+          } else {
+            printf("Rx: ");
+            print_hex(pop->abtRx, pop->szRx);
+          }
+        }
+      }
+      break;
+    }
+  }
+}
+
+static int
+run_batch(nfc_device *pnd, FILE *input)
+{
+  struct script sc = { NULL, 0, 0 };
+  int res = EXIT_SUCCESS;
+
+  if (script_parse(&sc, input) < 0) {
+    free(sc.ops);
+    return EXIT_FAILURE;
+  }
+  const uint64_t start = time_us();
+  script_run(pnd, &sc, 0, sc.szOps);
+  const uint64_t elapsed = time_us() - start;
+
+  printf("%6s %8s %6s %10s %10s %10s  %s\n", "line", "count", "errors", "min(us)", "avg(us)", "max(us)", "command / last answer");
+  for (size_t i = 0; i < sc.szOps; i++) {
+    const struct script_op *pop = &sc.ops[i];
+    if ((pop->type != OP_FRAME) || (pop->count == 0))
+      continue;
+    printf("%6d %8lu %6lu %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "  ", pop->line, pop->count, pop->errors,
+           pop->min_us, pop->total_us / pop->count, pop->max_us);
+    print_hex(pop->abtTx, pop->szTx);
+    printf("%57s", "");
+    if (pop->errors == pop->count) {
+      printf("(error)\n");
+    } else {
+      print_hex(pop->abtRx, pop->szRx);
+    }
+    if (pop->errors)
+      res = EXIT_FAILURE;
+  }
+  printf("Total: %" PRIu64 " us\n", elapsed);
+  free(sc.ops);
+  return res;
+}
 
 int main(int argc, const char *argv[])
 {
@@ -83,9 +372,20 @@ int main(int argc, const char *argv[])
   size_t szRx = sizeof(abtRx);
   size_t szTx;
   FILE *input = NULL;
+  bool batch = false;
 
-  if (argc >= 2) {
-    if ((input = fopen(argv[1], "r")) == NULL) {
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp("-b", argv[arg])) {
+      batch = true;
+    } else if (0 == strcmp("-v", argv[arg])) {
+      verbose = true;
+    } else if ((argv[arg][0] == '-') || (input != NULL)) {
+      print_usage(argv[0]);
+      if (input != NULL) {
+        fclose(input);
+      }
+      exit(EXIT_FAILURE);
+    } else if ((input = fopen(argv[arg], "r")) == NULL) {
       ERR("%s", "Cannot open file.");
       exit(EXIT_FAILURE);
     }
@@ -121,6 +421,16 @@ int main(int argc, const char *argv[])
     exit(EXIT_FAILURE);
   }
 
+  if (batch) {
+    const int res = run_batch(pnd, (input != NULL) ? input : stdin);
+    if (input != NULL) {
+      fclose(input);
+    }
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(res);
+  }
+
   const char *prompt = "> ";
   while (1) {
     int offset = 0;
@@ -136,7 +446,7 @@ int main(int argc, const char *argv[])
       add_history(cmd);
     } else {
 #endif //HAVE_READLINE
-      size_t n = 512;
+      size_t n = MAX_LINE_LEN;
       char *ret = NULL;
       cmd = malloc(n);
       printf("%s", prompt);
@@ -175,24 +485,7 @@ int main(int argc, const char *argv[])
       free(cmd);
       continue;
     }
-    szTx = 0;
-    for (int i = 0; i < MAX_FRAME_LEN; i++) {
-      int size;
-      unsigned int byte;
-      while (isspace(cmd[offset])) {
-        offset++;
-      }
-      size = sscanf(cmd + offset, "%2x", &byte);
-      if (size < 1) {
-        break;
-      }
-      abtTx[i] = byte;
-      szTx++;
-      if (cmd[offset + 1] == 0) { // if last hex was only 1 symbol
-        break;
-      }
-      offset += 2;
-    }
+    szTx = parse_frame(cmd, offset, abtTx);
 
     if ((int)szTx < 1) {
       free(cmd);
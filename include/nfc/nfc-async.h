@@ -0,0 +1,143 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-async.h
+ * @brief Provide a non-blocking API on top of libnfc
+ */
+
+#ifndef __NFC_ASYNC_H__
+#define __NFC_ASYNC_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/**
+ * @brief Completion callback of an asynchronous request
+ *
+ * @param pnd \a nfc_device on which the request was submitted
+ * @param res result of the request, as returned by its blocking counterpart
+ * @param user_data pointer given when request was submitted
+ */
+typedef void (*nfc_async_callback)(nfc_device *pnd, int res, void *user_data);
+
+NFC_EXPORT int    nfc_async_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_async_initiator_target_monitor(nfc_device *pnd, const nfc_target *pnt, int interval, nfc_async_callback cb, void *user_data);
+
+NFC_EXPORT int    nfc_async_get_fd(nfc_device *pnd);
+NFC_EXPORT int    nfc_async_dispatch(nfc_device *pnd);
+NFC_EXPORT int    nfc_async_cancel(nfc_device *pnd);
+
+/**
+ * @brief Kind of a tap event
+ */
+typedef enum {
+  /** A target entered the field and has been selected */
+  NFC_TAP_ARRIVED,
+  /** The target of the previous NFC_TAP_ARRIVED event left the field */
+  NFC_TAP_REMOVED,
+} nfc_tap_event_type;
+
+/**
+ * @brief Event of a tap stream, see nfc_tap_stream_start()
+ */
+typedef struct {
+  nfc_tap_event_type type;
+  /** Detection time, monotonic clock in µs */
+  uint64_t timestamp_us;
+  nfc_target nt;
+} nfc_tap_event;
+
+/**
+ * @brief What the polling thread does with an event when the queue is full
+ */
+typedef enum {
+  /** The new event is dropped */
+  NFC_TAP_DROP_NEWEST,
+  /** The oldest queued event is dropped to make room */
+  NFC_TAP_DROP_OLDEST,
+  /** Polling is paused until the application pops an event */
+  NFC_TAP_BACKPRESSURE,
+} nfc_tap_overflow;
+
+/**
+ * @brief Counters of a tap stream, see nfc_tap_stream_get_stats()
+ */
+typedef struct {
+  /** Events put in the queue */
+  uint64_t pushed;
+  /** Events lost because the queue was full */
+  uint64_t dropped;
+  /** Times polling was paused by NFC_TAP_BACKPRESSURE */
+  uint64_t stalls;
+  /** Failed polls, they are retried after the polling period */
+  uint64_t errors;
+  /** Highest count of queued events */
+  size_t max_depth;
+} nfc_tap_stats;
+
+NFC_EXPORT int    nfc_tap_stream_start(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPeriod, const size_t szQueue, const nfc_tap_overflow overflow);
+NFC_EXPORT int    nfc_tap_stream_pop(nfc_device *pnd, nfc_tap_event *pnte);
+NFC_EXPORT int    nfc_tap_stream_wait(nfc_device *pnd, nfc_tap_event *pnte, int timeout);
+NFC_EXPORT int    nfc_tap_stream_get_fd(nfc_device *pnd);
+NFC_EXPORT int    nfc_tap_stream_get_stats(nfc_device *pnd, nfc_tap_stats *pnts);
+NFC_EXPORT int    nfc_tap_stream_stop(nfc_device *pnd);
+
+NFC_EXPORT int    nfc_tap_claim(nfc_device *pnd, const nfc_target *pnt);
+
+/**
+ * @brief Reader pool: a fixed count of workers running requests of many devices
+ */
+typedef struct nfc_pool nfc_pool;
+
+NFC_EXPORT nfc_pool *nfc_pool_new(size_t szThreads);
+NFC_EXPORT void   nfc_pool_free(nfc_pool *pool);
+NFC_EXPORT int    nfc_pool_add_device(nfc_pool *pool, nfc_device *pnd);
+NFC_EXPORT int    nfc_pool_remove_device(nfc_pool *pool, nfc_device *pnd);
+NFC_EXPORT int    nfc_pool_cancel(nfc_pool *pool, nfc_device *pnd);
+
+NFC_EXPORT int    nfc_pool_initiator_select_passive_target(nfc_pool *pool, nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_pool_initiator_poll_target(nfc_pool *pool, nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_pool_initiator_transceive_bytes(nfc_pool *pool, nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_pool_target_init(nfc_pool *pool, nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_pool_target_send_bytes(nfc_pool *pool, nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, nfc_async_callback cb, void *user_data);
+NFC_EXPORT int    nfc_pool_target_receive_bytes(nfc_pool *pool, nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __NFC_ASYNC_H__ */
@@ -0,0 +1,103 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-desfire.h
+ * @brief Provide MIFARE DESFire EV1/EV2 commands on top of libnfc ISO14443-4 sessions
+ */
+
+#ifndef __NFC_DESFIRE_H__
+#define __NFC_DESFIRE_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+#include <nfc/nfc-iso14443-4.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** Size of a DESFire AES key */
+#define DESFIRE_AES_KEY_LEN  16
+/** Size of a DESFire application identifier */
+#define DESFIRE_AID_LEN  3
+/** Size of the answer to GetVersion */
+#define DESFIRE_VERSION_LEN  28
+
+/** DESFire native commands */
+#define DESFIRE_AUTHENTICATE_AES  0xaa
+#define DESFIRE_SELECT_APPLICATION  0x5a
+#define DESFIRE_GET_VERSION  0x60
+#define DESFIRE_READ_DATA  0xbd
+#define DESFIRE_ADDITIONAL_FRAME  0xaf
+
+/** DESFire status codes */
+#define DESFIRE_OPERATION_OK  0x00
+#define DESFIRE_AUTHENTICATION_ERROR  0xae
+
+/**
+ * @enum nfc_desfire_comm_mode
+ * @brief Communication mode of a file or command, once authenticated
+ */
+typedef enum {
+  DESFIRE_COMM_PLAIN = 0x00,
+  DESFIRE_COMM_MACED = 0x01,
+  DESFIRE_COMM_ENCIPHERED = 0x03,
+} nfc_desfire_comm_mode;
+
+/**
+ * @struct nfc_desfire_session
+ * @brief DESFire session run by libnfc, fields are private but \a ui8Status
+ * which holds the status code of the last answer
+ */
+typedef struct {
+  nfc_iso14443_4_session iso;
+  bool     bIsoWrapping;
+  uint8_t  ui8Status;
+  // Authenticated key number, -1 when not authenticated
+  int      iKeyNo;
+  // Session key schedules, CMAC subkeys and IV
+  uint8_t  abtEncKeys[176];
+  uint8_t  abtDecKeys[176];
+  uint8_t  abtK1[16];
+  uint8_t  abtK2[16];
+  uint8_t  abtIv[16];
+} nfc_desfire_session;
+
+NFC_EXPORT int nfc_desfire_open(nfc_device *pnd, nfc_target *pnt, nfc_desfire_session *pds, const bool bIsoWrapping);
+NFC_EXPORT int nfc_desfire_transceive(nfc_desfire_session *pds, const uint8_t *pbtCmd, const size_t szCmd, const nfc_desfire_comm_mode mode, uint8_t *pbtRx, const size_t szRx);
+NFC_EXPORT int nfc_desfire_select_application(nfc_desfire_session *pds, const uint32_t ui32Aid);
+NFC_EXPORT int nfc_desfire_authenticate_aes(nfc_desfire_session *pds, const uint8_t ui8KeyNo, const uint8_t *pbtKey);
+NFC_EXPORT int nfc_desfire_get_version(nfc_desfire_session *pds, uint8_t *pbtVersion, const size_t szVersion);
+NFC_EXPORT int nfc_desfire_read_data(nfc_desfire_session *pds, const uint8_t ui8FileNo, const uint32_t ui32Offset, const uint32_t ui32Length,
+                                     const nfc_desfire_comm_mode mode, uint8_t *pbtData, const size_t szData);
+NFC_EXPORT int nfc_desfire_close(nfc_desfire_session *pds, const bool bDeselect);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_DESFIRE_H__ */
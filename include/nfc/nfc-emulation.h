@@ -61,7 +61,83 @@ struct nfc_emulation_state_machine {
   void *data;
 };
 
+/**
+ * @enum nfc_emulation_tag_type
+ * @brief NFC Forum tag types answered by nfc_emulate_tag()
+ */
+typedef enum {
+  /** NFC Forum Type 2 Tag: READ on 4-byte pages, HALT */
+  NFC_EMULATION_TAG_TYPE_2 = 2,
+  /** NFC Forum Type 4 Tag: SELECT, READ BINARY and UPDATE BINARY on the CC and NDEF files */
+  NFC_EMULATION_TAG_TYPE_4 = 4,
+} nfc_emulation_tag_type;
+
+/**
+ * @struct nfc_emulation_tag
+ * @brief Tag memory image answered by nfc_emulate_tag()
+ *
+ * Answers are slices of the image, which may be a mmap()ed file: nothing is
+ * parsed or rebuilt beside the command itself.
+ */
+struct nfc_emulation_tag {
+  nfc_emulation_tag_type type;
+  /** Type 2: memory pages (4 bytes each). Type 4: NDEF file (2-byte NLEN then NDEF message) */
+  uint8_t *memory;
+  size_t memory_len;
+  /** Type 4: Capability Container file, its NDEF File Control TLV gives the NDEF file identifier */
+  const uint8_t *cc;
+  size_t cc_len;
+  /** Type 4: NDEF Tag Application name, NULL for D2760000850101 (mapping version 2.0) */
+  const uint8_t *aid;
+  size_t aid_len;
+  /** Type 4: reject UPDATE BINARY */
+  bool read_only;
+  /** Optional: answers the commands the engine does not handle */
+  struct nfc_emulation_state_machine *state_machine;
+  /** Given as nfc_emulator user_data to state_machine */
+  void *user_data;
+  /** Type 4: currently selected file, engine internal */
+  int current_file;
+};
+
+#define NFC_EMULATION_AID_MAX_LEN 16
+#define NFC_EMULATION_DISPATCHER_SLOTS 64
+
+/**
+ * @struct nfc_emulation_application
+ * @brief ISO7816 application registered in a \a nfc_emulation_dispatcher
+ */
+struct nfc_emulation_application {
+  /** Application identifier, 1 to NFC_EMULATION_AID_MAX_LEN bytes */
+  const uint8_t *aid;
+  size_t aid_len;
+  /** Answers the APDUs once the application is selected, SELECT included */
+  struct nfc_emulation_state_machine *state_machine;
+  /** Given as nfc_emulator user_data to state_machine */
+  void *user_data;
+};
+
+/**
+ * @struct nfc_emulation_dispatcher
+ * @brief Routes APDUs to the application selected by AID
+ *
+ * Use &state_machine as \a nfc_emulator state machine. Applications are kept
+ * in a hash table of NFC_EMULATION_DISPATCHER_SLOTS slots: a SELECT costs one
+ * AID hash whatever the number of applications.
+ */
+struct nfc_emulation_dispatcher {
+  struct nfc_emulation_state_machine state_machine;
+  struct nfc_emulation_application *slots[NFC_EMULATION_DISPATCHER_SLOTS];
+  size_t applications;
+  /** Currently selected application, NULL if none */
+  struct nfc_emulation_application *selected;
+};
+
 NFC_EXPORT int    nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int timeout);
+NFC_EXPORT int    nfc_emulate_tag(nfc_device *pnd, nfc_target *pnt, struct nfc_emulation_tag *tag, const int timeout);
+NFC_EXPORT int    nfc_emulate_uid(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, const int timeout);
+NFC_EXPORT void   nfc_emulation_dispatcher_init(struct nfc_emulation_dispatcher *ped);
+NFC_EXPORT int    nfc_emulation_dispatcher_add(struct nfc_emulation_dispatcher *ped, struct nfc_emulation_application *pea);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,56 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-felica.h
+ * @brief Provide FeliCa commands on top of libnfc
+ */
+
+#ifndef __NFC_FELICA_H__
+#define __NFC_FELICA_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** Size of a FeliCa block */
+#define FELICA_BLOCK_LEN  16
+/** Blocks answered by one Check, so that the answer fits a PN53x frame (264 bytes) */
+#define FELICA_CHECK_MAX_BLOCKS  14
+/** Service code of NFC Forum Type 3 Tags NDEF data (read only access) */
+#define FELICA_SERVICE_NDEF_READ  0x000b
+
+NFC_EXPORT int nfc_felica_check(nfc_device *pnd, nfc_target *pnt, const uint16_t ui16ServiceCode, const uint16_t ui16Block, const size_t szBlocks,
+                                const uint8_t ui8MaxBlocks, uint8_t *pbtData, const size_t szData);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_FELICA_H__ */
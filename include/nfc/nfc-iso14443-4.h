@@ -0,0 +1,68 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-iso14443-4.h
+ * @brief Provide an ISO14443-4 (ISO-DEP) block engine on top of libnfc
+ */
+
+#ifndef __NFC_ISO14443_4_H__
+#define __NFC_ISO14443_4_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** Largest ISO14443-4 frame (FSD/FSC) exchanged through a PN53x, FSDI=8 */
+#define ISO14443_4_FRAME_MAX_LEN  256
+/** Largest extended-length APDU answer: 65536 data bytes and SW1-SW2 */
+#define ISO14443_4_EXTENDED_R_APDU_MAX_LEN  (65536 + 2)
+
+/**
+ * @struct nfc_iso14443_4_session
+ * @brief ISO14443-4 (ISO-DEP) session run by libnfc, fields are private
+ */
+typedef struct {
+  nfc_device *pnd;
+  uint8_t  btBlockNumber;
+  size_t   szFsc;
+  size_t   szFsd;
+  int      iFwt;
+  bool     bEasyFraming;
+} nfc_iso14443_4_session;
+
+NFC_EXPORT int nfc_iso14443_4_open(nfc_device *pnd, nfc_target *pnt, nfc_iso14443_4_session *pis);
+NFC_EXPORT int nfc_iso14443_4_transceive(nfc_iso14443_4_session *pis, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx);
+NFC_EXPORT int nfc_iso14443_4_close(nfc_iso14443_4_session *pis, const bool bDeselect);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_ISO14443_4_H__ */
@@ -0,0 +1,183 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-llcp.h
+ * @brief Provide an LLCP link layer and a SNEP client/server on top of D.E.P.
+ */
+
+#ifndef __NFC_LLCP_H__
+#define __NFC_LLCP_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** Largest link and data link connection MIU offered by libnfc */
+#define NFC_LLCP_MIU_MAX  1024
+/** Largest LLCP frame: PDU header, sequence and information field */
+#define NFC_LLCP_FRAME_MAX_LEN  (3 + NFC_LLCP_MIU_MAX)
+/** Length of the LLCP general bytes built by nfc_llcp_general_bytes() */
+#define NFC_LLCP_GENERAL_BYTES_LEN  20
+/** Outgoing PDU buffers of a link */
+#define NFC_LLCP_POOL_SIZE  8
+/** Data link connections of a link */
+#define NFC_LLCP_CONNECTIONS  4
+/** Services bound on a link */
+#define NFC_LLCP_SERVICES  4
+
+/** Service discovery SAP, connections by service name go there */
+#define NFC_LLCP_SAP_SDP  1
+/** Well-known SAP of the SNEP default server */
+#define NFC_LLCP_SAP_SNEP  4
+/** Service name of the SNEP default server */
+#define NFC_SNEP_SERVICE_NAME  "urn:nfc:sn:snep"
+
+/**
+ * @enum nfc_llcp_connection_state
+ * @brief State of a data link connection
+ */
+typedef enum {
+  NFC_LLCP_CLOSED = 0,
+  NFC_LLCP_CONNECTING,
+  NFC_LLCP_CONNECTED,
+  NFC_LLCP_DISCONNECTING,
+} nfc_llcp_connection_state;
+
+struct nfc_llcp_link;
+
+/**
+ * Called with each SDU received on a connection, the data lives in the link
+ * receive frame and is only valid during the call.
+ * A NULL \a pbtData marks the connection being opened or closed.
+ */
+typedef void (*nfc_llcp_receive_callback)(struct nfc_llcp_link *pll, int iConnection, const uint8_t *pbtData, size_t szData, void *user_data);
+
+/**
+ * @struct nfc_llcp_service
+ * @brief Service accepting connections on a SAP, by SAP or by service name
+ */
+typedef struct {
+  uint8_t ui8Sap;
+  const char *pcServiceName;
+  nfc_llcp_receive_callback cb;
+  void *user_data;
+} nfc_llcp_service;
+
+/**
+ * @struct nfc_llcp_connection
+ * @brief Data link connection, fields are private
+ */
+typedef struct {
+  nfc_llcp_connection_state state;
+  uint8_t  ui8LocalSap;
+  uint8_t  ui8RemoteSap;
+  uint8_t  ui8Vs;
+  uint8_t  ui8Vsa;
+  uint8_t  ui8Vr;
+  uint8_t  ui8Vra;
+  uint8_t  ui8RemoteRw;
+  bool     bRemoteBusy;
+  uint8_t  ui8Reason;
+  size_t   szRemoteMiu;
+  nfc_llcp_receive_callback cb;
+  void    *user_data;
+} nfc_llcp_connection;
+
+/**
+ * @struct nfc_llcp_pdu
+ * @brief Pooled outgoing PDU, fields are private
+ */
+typedef struct {
+  uint8_t  abtPdu[NFC_LLCP_FRAME_MAX_LEN];
+  size_t   szPdu;
+  int      iConnection;
+  int      iNext;
+} nfc_llcp_pdu;
+
+/**
+ * @struct nfc_llcp_link
+ * @brief LLCP link over an activated D.E.P. target or initiator, fields are private
+ */
+typedef struct nfc_llcp_link {
+  nfc_device *pnd;
+  bool     bInitiator;
+  bool     bRxPending;
+  bool     bActive;
+  uint8_t  ui8RemoteVersion;
+  uint16_t ui16RemoteWks;
+  size_t   szRemoteMiu;
+  int      iRemoteLto;
+  nfc_llcp_service *apServices[NFC_LLCP_SERVICES];
+  nfc_llcp_connection aConnections[NFC_LLCP_CONNECTIONS];
+  nfc_llcp_pdu aPool[NFC_LLCP_POOL_SIZE];
+  int      iFree;
+  int      iQueueHead;
+  int      iQueueTail;
+  uint8_t  abtTx[NFC_LLCP_FRAME_MAX_LEN];
+  uint8_t  abtRx[NFC_LLCP_FRAME_MAX_LEN];
+  size_t   szRx;
+} nfc_llcp_link;
+
+/** Called with each complete NDEF message PUT to a SNEP server */
+typedef void (*nfc_snep_put_callback)(const uint8_t *pbtNdef, size_t szNdef, void *user_data);
+
+/**
+ * @struct nfc_snep_server
+ * @brief SNEP default server reassembling PUT requests in a caller buffer, fields are private
+ */
+typedef struct {
+  nfc_llcp_service service;
+  uint8_t *pbtBuffer;
+  size_t   szBuffer;
+  size_t   szMessage;
+  size_t   szReceived;
+  nfc_snep_put_callback cb;
+  void    *user_data;
+} nfc_snep_server;
+
+NFC_EXPORT int nfc_llcp_general_bytes(uint8_t *pbtGB, const size_t szGB);
+NFC_EXPORT int nfc_llcp_atr_req_general_bytes(const uint8_t *pbtAtrReq, const size_t szAtrReq, const uint8_t **ppbtGB);
+NFC_EXPORT int nfc_llcp_link_activate(nfc_llcp_link *pll, nfc_device *pnd, const bool bInitiator, const uint8_t *pbtRemoteGB, const size_t szRemoteGB);
+NFC_EXPORT int nfc_llcp_link_service(nfc_llcp_link *pll, int timeout);
+NFC_EXPORT int nfc_llcp_link_deactivate(nfc_llcp_link *pll, int timeout);
+NFC_EXPORT int nfc_llcp_bind(nfc_llcp_link *pll, nfc_llcp_service *pls);
+NFC_EXPORT int nfc_llcp_connect(nfc_llcp_link *pll, const uint8_t ui8Dsap, const char *pcServiceName, nfc_llcp_receive_callback cb, void *user_data);
+NFC_EXPORT nfc_llcp_connection_state nfc_llcp_connection_get_state(const nfc_llcp_link *pll, const int iConnection);
+NFC_EXPORT int nfc_llcp_send(nfc_llcp_link *pll, const int iConnection, const uint8_t *pbtData, const size_t szData);
+NFC_EXPORT int nfc_llcp_disconnect(nfc_llcp_link *pll, const int iConnection);
+
+NFC_EXPORT int nfc_snep_put(nfc_llcp_link *pll, const uint8_t *pbtNdef, const size_t szNdef, int timeout);
+NFC_EXPORT int nfc_snep_server_bind(nfc_llcp_link *pll, nfc_snep_server *pss, uint8_t *pbtBuffer, const size_t szBuffer, nfc_snep_put_callback cb, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_LLCP_H__ */
@@ -0,0 +1,138 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-mifare.h
+ * @brief Provide MIFARE Classic commands and sector-level operations on top of libnfc
+ */
+
+#ifndef __NFC_MIFARE_H__
+#define __NFC_MIFARE_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** Size of a MIFARE Classic block */
+#define MIFARE_CLASSIC_BLOCK_LEN  16
+/** Size of a MIFARE Classic key */
+#define MIFARE_CLASSIC_KEY_LEN  6
+/** Number of sectors of a MIFARE Classic 4K, the 8 last ones have 16 blocks */
+#define MIFARE_CLASSIC_4K_SECTORS  40
+
+/** Size of a MIFARE Ultralight page */
+#define MIFARE_ULTRALIGHT_PAGE_LEN  4
+/** Size of the answer to GET_VERSION */
+#define MIFARE_ULTRALIGHT_VERSION_LEN  8
+/** Pages read by one FAST_READ, so that the answer fits a PN53x frame (264 bytes) */
+#define MIFARE_ULTRALIGHT_FAST_READ_MAX_PAGES  60
+
+/** MIFARE Ultralight EV1 and NTAG commands */
+#define MIFARE_ULTRALIGHT_GET_VERSION  0x60
+#define MIFARE_ULTRALIGHT_READ_CNT  0x39
+#define MIFARE_ULTRALIGHT_FAST_READ  0x3a
+
+// Compiler directive, set struct alignment to 1 uint8_t for compatibility
+#  pragma pack(1)
+
+typedef enum {
+  MC_AUTH_A = 0x60,
+  MC_AUTH_B = 0x61,
+  MC_READ = 0x30,
+  MC_WRITE = 0xA0,
+  MC_TRANSFER = 0xB0,
+  MC_DECREMENT = 0xC0,
+  MC_INCREMENT = 0xC1,
+  MC_STORE = 0xC2
+} mifare_cmd;
+
+// MIFARE command params
+struct mifare_param_auth {
+  uint8_t  abtKey[6];
+  uint8_t  abtAuthUid[4];
+};
+
+struct mifare_param_data {
+  uint8_t  abtData[16];
+};
+
+struct mifare_param_value {
+  uint8_t  abtValue[4];
+};
+
+typedef union {
+  struct mifare_param_auth mpa;
+  struct mifare_param_data mpd;
+  struct mifare_param_value mpv;
+} mifare_param;
+
+// Reset struct alignment to default
+#  pragma pack()
+
+NFC_EXPORT bool nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp);
+
+NFC_EXPORT uint8_t nfc_mifare_classic_sector_blocks(const uint8_t ui8Sector);
+NFC_EXPORT uint8_t nfc_mifare_classic_sector_first_block(const uint8_t ui8Sector);
+NFC_EXPORT uint8_t nfc_mifare_classic_block_sector(const uint8_t ui8Block);
+
+NFC_EXPORT int nfc_mifare_classic_authenticate(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey);
+NFC_EXPORT int nfc_mifare_classic_find_key(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, uint8_t *pbtKeys, const size_t szKeys);
+NFC_EXPORT int nfc_mifare_classic_read_sector(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Sector, const mifare_cmd mcAuth, const uint8_t *pbtKey, uint8_t *pbtData, const size_t szData);
+NFC_EXPORT int nfc_mifare_classic_write_sector(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Sector, const mifare_cmd mcAuth, const uint8_t *pbtKey, const uint8_t *pbtData, const size_t szData, const bool bWriteTrailer);
+
+NFC_EXPORT int nfc_mifare_classic_value_decode(const uint8_t *pbtBlock, int32_t *pi32Value, uint8_t *pui8Address);
+NFC_EXPORT void nfc_mifare_classic_value_encode(const int32_t i32Value, const uint8_t ui8Address, uint8_t *pbtBlock);
+NFC_EXPORT int nfc_mifare_classic_value_debit(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey, const uint32_t ui32Amount, int32_t *pi32Balance);
+NFC_EXPORT int nfc_mifare_classic_value_credit(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey, const uint32_t ui32Amount, int32_t *pi32Balance);
+
+NFC_EXPORT int nfc_mifare_ultralight_get_version(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtVersion, const size_t szVersion);
+NFC_EXPORT size_t nfc_mifare_ultralight_pages(const uint8_t *pbtVersion);
+NFC_EXPORT int nfc_mifare_ultralight_read_cnt(nfc_device *pnd, const uint8_t ui8Counter, uint32_t *pui32Value);
+NFC_EXPORT int nfc_mifare_ultralight_read_pages(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Page, const size_t szPages, uint8_t *pbtData, const size_t szData);
+
+/**
+ * @brief Persistent cache of MIFARE Classic keys, per card UID
+ */
+typedef struct nfc_mifare_key_cache nfc_mifare_key_cache;
+
+/** nfc_mifare_key_cache_lookup() found the key */
+#define MIFARE_KEY_CACHE_KEY  0x01
+/** nfc_mifare_key_cache_lookup() found the access bits */
+#define MIFARE_KEY_CACHE_ACCESS_BITS  0x02
+
+NFC_EXPORT nfc_mifare_key_cache *nfc_mifare_key_cache_open(const char *pcPath, const size_t szCards);
+NFC_EXPORT void nfc_mifare_key_cache_close(nfc_mifare_key_cache *pmkc);
+NFC_EXPORT int nfc_mifare_key_cache_lookup(const nfc_mifare_key_cache *pmkc, const uint8_t *pbtUid, const size_t szUid, const uint8_t ui8Sector, const mifare_cmd mcAuth, uint8_t *pbtKey, uint8_t *pbtAccessBits);
+NFC_EXPORT int nfc_mifare_key_cache_store(nfc_mifare_key_cache *pmkc, const uint8_t *pbtUid, const size_t szUid, const uint8_t ui8Sector, const mifare_cmd mcAuth, const uint8_t *pbtKey, const uint8_t *pbtAccessBits);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_MIFARE_H__ */
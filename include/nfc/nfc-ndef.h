@@ -0,0 +1,129 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-ndef.h
+ * @brief Provide NDEF messages parsing and reading from NFC Forum tags on top of libnfc
+ */
+
+#ifndef __NFC_NDEF_H__
+#define __NFC_NDEF_H__
+
+#include <sys/types.h>
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/** NDEF record header: Message Begin, Message End, Chunk Flag, Short Record and ID Length flags */
+#define NDEF_RECORD_MB  0x80
+#define NDEF_RECORD_ME  0x40
+#define NDEF_RECORD_CF  0x20
+#define NDEF_RECORD_SR  0x10
+#define NDEF_RECORD_IL  0x08
+/** NDEF record header: Type Name Format field */
+#define NDEF_RECORD_TNF_MASK  0x07
+
+/** Type Name Format values */
+#define NDEF_TNF_EMPTY  0x00
+#define NDEF_TNF_WELL_KNOWN  0x01
+#define NDEF_TNF_MEDIA  0x02
+#define NDEF_TNF_ABSOLUTE_URI  0x03
+#define NDEF_TNF_EXTERNAL  0x04
+#define NDEF_TNF_UNKNOWN  0x05
+#define NDEF_TNF_UNCHANGED  0x06
+
+/** TLV blocks of NFC Forum Type 1 and Type 2 Tags data area */
+#define NDEF_TLV_NULL  0x00
+#define NDEF_TLV_LOCK_CONTROL  0x01
+#define NDEF_TLV_MEMORY_CONTROL  0x02
+#define NDEF_TLV_NDEF_MESSAGE  0x03
+#define NDEF_TLV_PROPRIETARY  0xfd
+#define NDEF_TLV_TERMINATOR  0xfe
+
+/**
+ * @struct nfc_ndef_record
+ * @brief NDEF record, its fields point into the parsed message
+ */
+typedef struct {
+  /** MB, ME, CF, SR and IL flags, and TNF */
+  uint8_t  btHeader;
+  const uint8_t *pbtType;
+  size_t   szType;
+  const uint8_t *pbtId;
+  size_t   szId;
+  const uint8_t *pbtPayload;
+  size_t   szPayload;
+} nfc_ndef_record;
+
+/**
+ * @struct nfc_ndef_iterator
+ * @brief Position in a NDEF message, see nfc_ndef_iterator_next()
+ */
+typedef struct {
+  const uint8_t *pbtMessage;
+  size_t   szMessage;
+  size_t   szOffset;
+} nfc_ndef_iterator;
+
+/**
+ * @struct nfc_ndef_tlv
+ * @brief TLV block of a Type 1 or Type 2 Tag data area, see nfc_ndef_tlv_next()
+ */
+typedef struct {
+  uint8_t  btType;
+  size_t   szLength;
+  /** Offset of the value in the data area, it may end beyond the parsed bytes */
+  size_t   szValueOffset;
+} nfc_ndef_tlv;
+
+/**
+ * @struct nfc_ndef_info
+ * @brief NDEF mapping of a tag, as found by nfc_ndef_read()
+ */
+typedef struct {
+  /** Mapping version, major version in the high nibble */
+  uint8_t  btVersion;
+  /** Largest NDEF message the tag can hold */
+  size_t   szCapacity;
+  /** Length of the NDEF message on the tag */
+  size_t   szLength;
+  bool     bReadOnly;
+} nfc_ndef_info;
+
+NFC_EXPORT void nfc_ndef_iterator_init(nfc_ndef_iterator *pni, const uint8_t *pbtMessage, const size_t szMessage);
+NFC_EXPORT int  nfc_ndef_iterator_next(nfc_ndef_iterator *pni, nfc_ndef_record *pnr);
+NFC_EXPORT int  nfc_ndef_tlv_next(const uint8_t *pbtArea, const size_t szArea, size_t *pszOffset, nfc_ndef_tlv *pntlv);
+NFC_EXPORT int  nfc_ndef_record_uri(const nfc_ndef_record *pnr, char *pcUri, const size_t szUri);
+
+NFC_EXPORT int  nfc_ndef_read(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtMessage, const size_t szMessage, nfc_ndef_info *pnni);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_NDEF_H__ */
@@ -61,6 +61,16 @@ typedef struct nfc_driver nfc_driver;
  */
 typedef char nfc_connstring[NFC_BUFSIZE_CONNSTRING];
 
+/**
+ * Device attachment/removal notification, see nfc_register_device_event_callback()
+ */
+typedef void (*nfc_device_event_callback)(nfc_context *context, const nfc_connstring connstring, bool attached, void *user_data);
+
+/**
+ * Log message receiver (priority 1: error, 2: info, 3: debug), see nfc_set_log_sink()
+ */
+typedef void (*nfc_log_sink)(uint8_t priority, const char *category, const char *message, void *user_data);
+
 /**
  * Properties
  */
@@ -139,6 +149,35 @@ typedef enum {
   NP_FORCE_ISO14443_B,
   /** Force the chip to run at 106 kbps */
   NP_FORCE_SPEED_106,
+  /** Once an ISO14443-4A target is activated, switch it with PPS to the
+   * highest bit rate it shares with the chip (212/424 kbps, 847 kbps with
+   * PN533). Default is false. */
+  NP_AUTO_PPS,
+  /** Learn how fast the current target answers and shorten the communication
+   * timeout (NP_TIMEOUT_COM) for it, down to a safe margin above its slowest
+   * recent answer and never below 10 ms (PN53x based devices). Only reads
+   * are sampled and shortened: writes, ISO-DEP and DEP exchanges keep
+   * NP_TIMEOUT_COM. The first missed answer restores NP_TIMEOUT_COM until the
+   * target has been sampled again. A target which leaves the field is then
+   * noticed much earlier. Default is false. */
+  NP_ADAPTIVE_TIMEOUTS,
+  /** How many times nfc_initiator_transceive_bytes() repeats a command after a
+   * transient RF error (timeout, CRC, parity or framing error, collision),
+   * waking the target up again first when the error made it leave its active
+   * state (PN53x based devices). Only commands which can safely be sent twice
+   * are repeated: ISO14443-A READ, FAST_READ, GET_VERSION, READ_SIG and
+   * READ_CNT (not for MIFARE Classic, whose authentication is lost), FeliCa
+   * commands which don't write, and Jewel read commands. ISO-DEP and DEP
+   * exchanges are never repeated. Default value is 0: errors are returned
+   * straight away. */
+  NP_RF_RETRIES,
+  /** Low-power polling of battery readers (PN532 based devices), as the
+   * interval in ms the chip sleeps between two polls. nfc_initiator_poll_target()
+   * and nfc_initiator_poll_target_stream() then poll each modulation once per
+   * round and put the chip in PowerDown between rounds, woken up by the host
+   * interface or by an external RF field. Waking it up only costs the host
+   * interface wake-up sequence. Default value is 0: the chip keeps polling. */
+  NP_LOW_POWER_POLL,
 } nfc_property;
 
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
@@ -330,6 +369,152 @@ typedef struct {
   nfc_modulation nm;
 } nfc_target;
 
+/**
+ * Longest identifier of a compact target record (NFCID3 of D.E.P. targets)
+ */
+#define NFC_TARGET_COMPACT_UID_LEN 10
+
+/**
+ * @struct nfc_target_compact
+ * @brief Packed record of a target, for large inventories, caches and logs
+ *
+ * Only what tells targets apart is kept: modulation, identifier (UID, PUPI,
+ * IDm, ...) and, for ISO14443A, ATQA and SAK. The ATS, if any, lives in a
+ * \a nfc_target_arena shared by many records. See nfc_target_compact_from().
+ */
+typedef struct {
+  /** \a nfc_modulation_type and \a nfc_baud_rate, on a byte each */
+  uint8_t btModulationType;
+  uint8_t btBaudRate;
+  uint8_t szUidLen;
+  uint8_t abtUid[NFC_TARGET_COMPACT_UID_LEN];
+  uint8_t abtAtqa[2];
+  uint8_t btSak;
+  /** ATS length, 0 when there is none */
+  uint8_t szAtsLen;
+  /** Offset of the ATS in the arena */
+  uint32_t ui32AtsOffset;
+} nfc_target_compact;
+
+/**
+ * @struct nfc_target_arena
+ * @brief Caller supplied storage for the ATS of compact target records
+ */
+typedef struct {
+  uint8_t *pbtData;
+  size_t szSize;
+  /** Bytes used so far, reset it to 0 to reuse the arena */
+  size_t szUsed;
+} nfc_target_arena;
+
+/**
+ * @struct nfc_exchange
+ * @brief One frame of a batch sent to the selected target, see nfc_initiator_transceive_bytes_batch()
+ */
+typedef struct {
+  const uint8_t *pbtTx;
+  size_t szTx;
+  /** Optional buffer for the answer */
+  uint8_t *pbtRx;
+  size_t szRx;
+  /** Received bytes count, libnfc's error code, or NFC_EOPABORTED when the frame was not sent */
+  int res;
+} nfc_exchange;
+
+/**
+ * Target discovery receiver, see nfc_initiator_poll_target_stream()
+ * @return 0 to go on polling, anything else to stop
+ */
+typedef int (*nfc_target_callback)(nfc_device *pnd, const nfc_target *pnt, void *user_data);
+
+/**
+ * Number of buckets of \a nfc_latency_histogram: bucket \e i counts durations of [2^i, 2^(i+1)[ µs
+ */
+#define NFC_LATENCY_BUCKETS 24
+
+/**
+ * @struct nfc_latency_histogram
+ * @brief Distribution of durations, in microseconds
+ */
+typedef struct {
+  uint32_t buckets[NFC_LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t total_us;
+  uint32_t min_us;
+  uint32_t max_us;
+} nfc_latency_histogram;
+
+/**
+ * @struct nfc_device_stats
+ * @brief Activity counters of a device, see nfc_device_get_stats()
+ */
+typedef struct {
+  /** Commands sent to the chip, indexed by TAMA command code */
+  uint32_t commands[256];
+  uint64_t bytes_tx;
+  uint64_t bytes_rx;
+  /** Time spent sending commands (including ACK frames), ie. host to chip transfer */
+  nfc_latency_histogram bus_latency;
+  /** Time from command sent to answer received, ie. chip processing */
+  nfc_latency_histogram chip_latency;
+  /** Frames sent again, ie. NACK requests */
+  uint32_t retries;
+  /** Answers not received in time */
+  uint32_t timeouts;
+  /** Unexpected ACK frames and error frames from the chip */
+  uint32_t naks;
+  /** Additional frames received because of MI (More Information) chaining */
+  uint32_t mi_continuations;
+  /** Target mode: from initiator command received to its answer being sent, ie. host turnaround */
+  nfc_latency_histogram target_turnaround;
+  /** Target mode: time spent sending answers to the chip */
+  nfc_latency_histogram target_bus_latency;
+  /** Target mode: from answer sent to the chip to its acknowledgement, RF transmission included */
+  nfc_latency_histogram target_chip_latency;
+  /** Commands repeated after a transient RF error (see NP_RF_RETRIES) */
+  uint32_t rf_retries;
+  /** Targets woken up again before such a repeat */
+  uint32_t rf_rewakes;
+} nfc_device_stats;
+
+/**
+ * @enum nfc_rf_analog
+ * @brief Set of RF analog settings, see nfc_device_set_rf_analog()
+ *
+ * Settings are CIU registers values, in the order given below.
+ */
+typedef enum {
+  /** 11 bytes: CIU_RFCfg, CIU_GsNOn, CIU_CWGsP, CIU_ModGsP, CIU_DemodRfOn, CIU_RxThreshold, CIU_DemodRfOff, CIU_GsNOff, CIU_ModWidth, CIU_MifNFC, CIU_TxBitPhase */
+  NRA_TYPE_A_106 = 0,
+  /** 8 bytes: CIU_RFCfg, CIU_GsNOn, CIU_CWGsP, CIU_ModGsP, CIU_DemodRfOn, CIU_RxThreshold, CIU_ModWidth, CIU_MifNFC */
+  NRA_TYPE_A_212_424,
+  /** 3 bytes: CIU_GsNOn, CIU_ModGsP, CIU_RxThreshold */
+  NRA_TYPE_B,
+  /** 9 bytes: CIU_RxThreshold, CIU_ModWidth and CIU_MifNFC at 212, 424 then 847 kbps */
+  NRA_ISO14443_4,
+} nfc_rf_analog;
+
+/**
+ * Size of the largest set of RF analog settings, ie. \a NRA_TYPE_A_106
+ */
+#define NFC_RF_ANALOG_MAX_LEN 11
+
+/**
+ * @struct nfc_rf_calibration
+ * @brief Outcome of nfc_initiator_calibrate_rf()
+ */
+typedef struct {
+  /** Best \a NRA_TYPE_A_106 settings found, applied to the device */
+  uint8_t abtSettings[NFC_RF_ANALOG_MAX_LEN];
+  /** Successful exchanges with these settings, out of uiTrials */
+  unsigned int uiSuccesses;
+  unsigned int uiTrials;
+  /** Mean cycles from frame sent to answer received, see nfc_initiator_transceive_bytes_timed() */
+  uint32_t ui32MeanCycles;
+  /** Number of settings tried */
+  unsigned int uiProfiles;
+} nfc_rf_calibration;
+
 // Reset struct alignment to default
 #  pragma pack()
 
@@ -86,33 +86,57 @@ extern  "C" {
 NFC_EXPORT void nfc_init(nfc_context **context) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT void nfc_exit(nfc_context *context) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT int nfc_register_driver(const nfc_driver *driver);
+NFC_EXPORT void nfc_set_log_level(nfc_context *context, uint32_t log_level) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_capture_start(const char *filename);
+NFC_EXPORT void nfc_capture_stop(void);
+NFC_EXPORT void nfc_set_log_sink(nfc_log_sink sink, void *user_data);
+NFC_EXPORT int nfc_log_ring_start(size_t capacity);
+NFC_EXPORT void nfc_log_ring_stop(void);
+NFC_EXPORT size_t nfc_log_ring_dropped(void);
 
 /* NFC Device/Hardware manipulation */
 NFC_EXPORT nfc_device *nfc_open(nfc_context *context, const nfc_connstring connstring) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT void nfc_close(nfc_device *pnd);
 NFC_EXPORT int nfc_abort_command(nfc_device *pnd);
 NFC_EXPORT size_t nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], size_t connstrings_len) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT void nfc_invalidate_device_list(nfc_context *context) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_register_device_event_callback(nfc_context *context, nfc_device_event_callback callback, void *user_data) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_unregister_device_event_callback(nfc_context *context, nfc_device_event_callback callback, void *user_data) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT int nfc_handle_device_events(nfc_context *context, int timeout) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT int nfc_idle(nfc_device *pnd);
 
 /* NFC initiator: act as "reader" */
 NFC_EXPORT int nfc_initiator_init(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_init_secure_element(nfc_device *pnd);
+NFC_EXPORT int nfc_initiator_sam_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
 NFC_EXPORT int nfc_initiator_list_passive_targets(nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_inventory_iso14443b(nfc_device *pnd, const uint8_t ui8Afi, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_set_current_target(nfc_device *pnd, const nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_set_target_cache(nfc_device *pnd, const bool bEnable);
+NFC_EXPORT int nfc_initiator_reselect_target(nfc_device *pnd, const uint8_t *pbtUid, const size_t szUid, nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_set_poll_schedule(nfc_device *pnd, const bool bAdaptive, const nfc_modulation_type *pnmtPriorities, const size_t szPriorities);
 NFC_EXPORT int nfc_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_poll_target_stream(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPeriod, nfc_target_callback cb, void *user_data);
 NFC_EXPORT int nfc_initiator_select_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_poll_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_deselect_target(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_initiator_transceive_bytes_batch(nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout);
 NFC_EXPORT int nfc_initiator_transceive_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
+NFC_EXPORT int nfc_initiator_raw_session_begin(nfc_device *pnd);
+NFC_EXPORT int nfc_initiator_raw_session_end(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_transceive_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
 NFC_EXPORT int nfc_initiator_transceive_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
 NFC_EXPORT int nfc_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_calibrate_rf(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const unsigned int uiTrials, nfc_rf_calibration *pnrc);
 
 /* NFC target: act as tag (i.e. MIFARE Classic) or NFC target device. */
 NFC_EXPORT int nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
 NFC_EXPORT int nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_target_send_receive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 NFC_EXPORT int nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 
@@ -125,18 +149,44 @@ NFC_EXPORT int nfc_device_get_last_error(const nfc_device *pnd);
 /* Special data accessors */
 NFC_EXPORT const char *nfc_device_get_name(nfc_device *pnd);
 NFC_EXPORT const char *nfc_device_get_connstring(nfc_device *pnd);
+NFC_EXPORT int nfc_device_get_fd(nfc_device *pnd);
+NFC_EXPORT int nfc_device_get_pending(nfc_device *pnd);
+NFC_EXPORT int nfc_device_get_stats(const nfc_device *pnd, nfc_device_stats *stats);
+NFC_EXPORT void nfc_device_reset_stats(nfc_device *pnd);
+NFC_EXPORT uint32_t nfc_latency_percentile(const nfc_latency_histogram *histogram, unsigned int percentile);
 NFC_EXPORT int nfc_device_get_supported_modulation(nfc_device *pnd, const nfc_mode mode,  const nfc_modulation_type **const supported_mt);
 NFC_EXPORT int nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
 
 /* Properties accessors */
 NFC_EXPORT int nfc_device_set_property_int(nfc_device *pnd, const nfc_property property, const int value);
 NFC_EXPORT int nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable);
+NFC_EXPORT int nfc_device_begin_properties(nfc_device *pnd);
+NFC_EXPORT int nfc_device_commit_properties(nfc_device *pnd);
+NFC_EXPORT int nfc_device_set_rf_analog(nfc_device *pnd, const nfc_rf_analog nra, const uint8_t *pbtSettings, const size_t szSettings);
+
+/* CRC_A and CRC_B register initial values and final XOR masks, see iso14443_crc_update() */
+#  define ISO14443A_CRC_INIT   0x6363
+#  define ISO14443A_CRC_XOROUT 0x0000
+#  define ISO14443B_CRC_INIT   0xFFFF
+#  define ISO14443B_CRC_XOROUT 0xFFFF
 
 /* Misc. functions */
 NFC_EXPORT void iso14443a_crc(uint8_t *pbtData, size_t szLen, uint8_t *pbtCrc);
 NFC_EXPORT void iso14443a_crc_append(uint8_t *pbtData, size_t szLen);
+NFC_EXPORT bool iso14443a_crc_check(const uint8_t *pbtData, size_t szLen);
+NFC_EXPORT void iso14443b_crc(uint8_t *pbtData, size_t szLen, uint8_t *pbtCrc);
+NFC_EXPORT void iso14443b_crc_append(uint8_t *pbtData, size_t szLen);
+NFC_EXPORT bool iso14443b_crc_check(const uint8_t *pbtData, size_t szLen);
+NFC_EXPORT uint16_t iso14443_crc_update(uint16_t wCrc, const uint8_t *pbtData, size_t szLen);
 NFC_EXPORT uint8_t *iso14443a_locate_historical_bytes(uint8_t *pbtAts, size_t szAts, size_t *pszTk);
 
+/* Compact target records */
+NFC_EXPORT void nfc_target_arena_init(nfc_target_arena *pnta, uint8_t *pbtData, size_t szSize);
+NFC_EXPORT int nfc_target_compact_from(nfc_target_compact *pntc, const nfc_target *pnt, nfc_target_arena *pnta);
+NFC_EXPORT int nfc_target_compact_to(nfc_target *pnt, const nfc_target_compact *pntc, const nfc_target_arena *pnta);
+NFC_EXPORT uint32_t nfc_target_compact_hash(const nfc_target_compact *pntc);
+NFC_EXPORT bool nfc_target_compact_equal(const nfc_target_compact *pntc1, const nfc_target_compact *pntc2);
+
 NFC_EXPORT void nfc_free(void *p);
 NFC_EXPORT const char *nfc_version(void);
 NFC_EXPORT int nfc_device_get_information_about(nfc_device *pnd, char **buf);
@@ -145,6 +195,8 @@ NFC_EXPORT int nfc_device_get_information_about(nfc_device *pnd, char **buf);
 NFC_EXPORT const char *str_nfc_modulation_type(const nfc_modulation_type nmt);
 NFC_EXPORT const char *str_nfc_baud_rate(const nfc_baud_rate nbr);
 NFC_EXPORT int str_nfc_target(char **buf, const nfc_target *pnt, bool verbose);
+NFC_EXPORT int snprint_nfc_target(char *dst, size_t size, const nfc_target *pnt, bool verbose);
+NFC_EXPORT int snprint_nfc_target_json(char *dst, size_t size, const nfc_target *pnt);
 
 /* Error codes */
 /** @ingroup error
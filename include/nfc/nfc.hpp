@@ -0,0 +1,323 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc.hpp
+ * @brief Header-only C++20 binding of libnfc
+ *
+ * Thin wrappers over the C API, nothing is added to the library itself:
+ * - nfc::context and nfc::device are move-only handles, released by their
+ *   destructor (nfc_exit(), nfc_close());
+ * - buffers are std::span, data goes straight between caller storage and the
+ *   driver, without copies;
+ * - nfc::target_view reads the member of the target union matching its
+ *   modulation, in place;
+ * - poll and transceive have co_await-able versions built on the asynchronous
+ *   requests of nfc-async.h: the coroutine is resumed from
+ *   nfc::device::dispatch(), in the thread of the event loop which waits for
+ *   nfc::device::event_fd().
+ *
+ * Like the C API, calls return libnfc's error codes; no exception is thrown,
+ * so the binding also builds with -fno-exceptions.
+ */
+
+#ifndef __NFC_HPP__
+#define __NFC_HPP__
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-async.h>
+
+namespace nfc
+{
+
+/**
+ * @brief Typed read-only view of a \a nfc_target
+ *
+ * Accessors of the other modulations return nullptr: only the member of the
+ * union the modulation selects is ever read. The viewed target has to outlive
+ * the view.
+ */
+class target_view
+{
+public:
+  constexpr target_view(const nfc_target &nt) noexcept : m_pnt(&nt) {}
+
+  constexpr nfc_modulation modulation() const noexcept { return m_pnt->nm; }
+  constexpr nfc_modulation_type type() const noexcept { return m_pnt->nm.nmt; }
+
+  /** Identifier telling targets apart (UID, PUPI, IDm, NFCID3...), empty when the modulation has none */
+  constexpr std::span<const uint8_t> uid() const noexcept
+  {
+    const nfc_target_info &nti = m_pnt->nti;
+    switch (m_pnt->nm.nmt) {
+      case NMT_ISO14443A:
+        return std::span<const uint8_t>(nti.nai.abtUid, nti.nai.szUidLen);
+      case NMT_FELICA:
+        return nti.nfi.abtId;
+      case NMT_ISO14443B:
+        return nti.nbi.abtPupi;
+      case NMT_ISO14443BI:
+        return nti.nii.abtDIV;
+      case NMT_ISO14443B2SR:
+        return nti.nsi.abtUID;
+      case NMT_ISO14443B2CT:
+        return nti.nci.abtUID;
+      case NMT_JEWEL:
+        return nti.nji.btId;
+      case NMT_DEP:
+        return nti.ndi.abtNFCID3;
+      default:
+        return {};
+    }
+  }
+
+  constexpr const nfc_iso14443a_info *iso14443a() const noexcept { return as<NMT_ISO14443A>(&m_pnt->nti.nai); }
+  constexpr const nfc_felica_info *felica() const noexcept { return as<NMT_FELICA>(&m_pnt->nti.nfi); }
+  constexpr const nfc_iso14443b_info *iso14443b() const noexcept { return as<NMT_ISO14443B>(&m_pnt->nti.nbi); }
+  constexpr const nfc_iso14443bi_info *iso14443bi() const noexcept { return as<NMT_ISO14443BI>(&m_pnt->nti.nii); }
+  constexpr const nfc_iso14443b2sr_info *iso14443b2sr() const noexcept { return as<NMT_ISO14443B2SR>(&m_pnt->nti.nsi); }
+  constexpr const nfc_iso14443b2ct_info *iso14443b2ct() const noexcept { return as<NMT_ISO14443B2CT>(&m_pnt->nti.nci); }
+  constexpr const nfc_jewel_info *jewel() const noexcept { return as<NMT_JEWEL>(&m_pnt->nti.nji); }
+  constexpr const nfc_dep_info *dep() const noexcept { return as<NMT_DEP>(&m_pnt->nti.ndi); }
+
+  /** ISO14443A ATS, empty for other modulations */
+  constexpr std::span<const uint8_t> ats() const noexcept
+  {
+    const nfc_iso14443a_info *pnai = iso14443a();
+    return pnai ? std::span<const uint8_t>(pnai->abtAts, pnai->szAtsLen) : std::span<const uint8_t>();
+  }
+
+  constexpr const nfc_target &get() const noexcept { return *m_pnt; }
+
+private:
+  // Member of the union, when it is the one of the target modulation
+  template <nfc_modulation_type nmt, typename T>
+  constexpr const T *as(const T *pInfo) const noexcept { return (m_pnt->nm.nmt == nmt) ? pInfo : nullptr; }
+
+  const nfc_target *m_pnt;
+};
+
+/**
+ * @brief Awaitable asynchronous request, completed by nfc_async_dispatch()
+ *
+ * \a Submit is called with the completion callback and its user data when the
+ * coroutine suspends. The awaiter lives in the coroutine frame, so a request
+ * costs no allocation here; the frame must not be destroyed before completion
+ * (nfc::device::cancel() completes pending requests with NFC_EOPABORTED).
+ */
+template <typename Submit>
+class async_request
+{
+public:
+  explicit async_request(Submit submit) noexcept : m_submit(std::move(submit)) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) noexcept
+  {
+    m_h = h;
+    const int res = m_submit(&async_request::complete, this);
+    if (res < 0) {
+      // Not queued: resume right away with the error
+      m_res = res;
+      return false;
+    }
+    return true;
+  }
+
+  /** Result of the blocking counterpart of the request */
+  int await_resume() const noexcept { return m_res; }
+
+private:
+  static void complete(nfc_device *, int res, void *user_data)
+  {
+    async_request *self = static_cast<async_request *>(user_data);
+    self->m_res = res;
+    self->m_h.resume();
+  }
+
+  Submit m_submit;
+  std::coroutine_handle<> m_h;
+  int m_res = NFC_EOPABORTED;
+};
+
+/**
+ * @brief Opened NFC device, closed by the destructor
+ */
+class device
+{
+public:
+  device() noexcept = default;
+  explicit device(nfc_device *pnd) noexcept : m_pnd(pnd) {}
+  device(device &&other) noexcept : m_pnd(std::exchange(other.m_pnd, nullptr)) {}
+  device &operator=(device &&other) noexcept
+  {
+    if (this != &other) {
+      close();
+      m_pnd = std::exchange(other.m_pnd, nullptr);
+    }
+    return *this;
+  }
+  device(const device &) = delete;
+  device &operator=(const device &) = delete;
+  ~device() { close(); }
+
+  explicit operator bool() const noexcept { return m_pnd != nullptr; }
+  nfc_device *get() const noexcept { return m_pnd; }
+
+  void close() noexcept
+  {
+    if (m_pnd)
+      nfc_close(std::exchange(m_pnd, nullptr));
+  }
+
+  const char *name() const noexcept { return nfc_device_get_name(m_pnd); }
+  const char *connstring() const noexcept { return nfc_device_get_connstring(m_pnd); }
+  int last_error() const noexcept { return nfc_device_get_last_error(m_pnd); }
+  const char *strerror() const noexcept { return nfc_strerror(m_pnd); }
+
+  int initiator_init() noexcept { return nfc_initiator_init(m_pnd); }
+  int idle() noexcept { return nfc_idle(m_pnd); }
+  int abort_command() noexcept { return nfc_abort_command(m_pnd); }
+
+  int select_passive_target(const nfc_modulation nm, nfc_target &nt, std::span<const uint8_t> init = {}) noexcept
+  {
+    return nfc_initiator_select_passive_target(m_pnd, nm, init.data(), init.size(), &nt);
+  }
+
+  int list_passive_targets(const nfc_modulation nm, std::span<nfc_target> targets) noexcept
+  {
+    return nfc_initiator_list_passive_targets(m_pnd, nm, targets.data(), targets.size());
+  }
+
+  int poll_target(std::span<const nfc_modulation> modulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target &nt) noexcept
+  {
+    return nfc_initiator_poll_target(m_pnd, modulations.data(), modulations.size(), uiPollNr, uiPeriod, &nt);
+  }
+
+  int deselect_target() noexcept { return nfc_initiator_deselect_target(m_pnd); }
+  int target_is_present(const nfc_target &nt) noexcept { return nfc_initiator_target_is_present(m_pnd, &nt); }
+
+  /** Returns the count of received bytes, written at the start of \a rx, otherwise libnfc's error code */
+  int transceive(std::span<const uint8_t> tx, std::span<uint8_t> rx, const int timeout = -1) noexcept
+  {
+    return nfc_initiator_transceive_bytes(m_pnd, tx.data(), tx.size(), rx.data(), rx.size(), timeout);
+  }
+
+  /** co_await-able nfc_initiator_poll_target(), \a modulations and \a nt have to remain valid until completion */
+  auto async_poll_target(std::span<const nfc_modulation> modulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target &nt) noexcept
+  {
+    return async_request([pnd = m_pnd, modulations, uiPollNr, uiPeriod, pnt = &nt](nfc_async_callback cb, void *user_data) {
+      return nfc_async_initiator_poll_target(pnd, modulations.data(), modulations.size(), uiPollNr, uiPeriod, pnt, cb, user_data);
+    });
+  }
+
+  /** co_await-able nfc_initiator_select_passive_target(), buffers have to remain valid until completion */
+  auto async_select_passive_target(const nfc_modulation nm, nfc_target &nt, std::span<const uint8_t> init = {}) noexcept
+  {
+    return async_request([pnd = m_pnd, nm, pnt = &nt, init](nfc_async_callback cb, void *user_data) {
+      return nfc_async_initiator_select_passive_target(pnd, nm, init.data(), init.size(), pnt, cb, user_data);
+    });
+  }
+
+  /** co_await-able transceive(), \a tx and \a rx have to remain valid until completion */
+  auto async_transceive(std::span<const uint8_t> tx, std::span<uint8_t> rx, const int timeout = -1) noexcept
+  {
+    return async_request([pnd = m_pnd, tx, rx, timeout](nfc_async_callback cb, void *user_data) {
+      return nfc_async_initiator_transceive_bytes(pnd, tx.data(), tx.size(), rx.data(), rx.size(), timeout, cb, user_data);
+    });
+  }
+
+  /** File descriptor to wait for, readable when asynchronous requests are completed */
+  int event_fd() noexcept { return nfc_async_get_fd(m_pnd); }
+  /** Resume coroutines whose requests are completed, from the calling thread */
+  int dispatch() noexcept { return nfc_async_dispatch(m_pnd); }
+  int cancel() noexcept { return nfc_async_cancel(m_pnd); }
+
+private:
+  nfc_device *m_pnd = nullptr;
+};
+
+/**
+ * @brief libnfc context, released by the destructor
+ */
+class context
+{
+public:
+  context() noexcept = default;
+  context(context &&other) noexcept : m_context(std::exchange(other.m_context, nullptr)) {}
+  context &operator=(context &&other) noexcept
+  {
+    if (this != &other) {
+      if (m_context)
+        nfc_exit(m_context);
+      m_context = std::exchange(other.m_context, nullptr);
+    }
+    return *this;
+  }
+  context(const context &) = delete;
+  context &operator=(const context &) = delete;
+  ~context()
+  {
+    if (m_context)
+      nfc_exit(m_context);
+  }
+
+  /** New context, empty when nfc_init() failed */
+  static context init() noexcept
+  {
+    context c;
+    nfc_init(&c.m_context);
+    return c;
+  }
+
+  explicit operator bool() const noexcept { return m_context != nullptr; }
+  nfc_context *get() const noexcept { return m_context; }
+
+  /** Opened device, empty when it could not be opened; nullptr opens the default device */
+  device open(const char *connstring = nullptr) noexcept
+  {
+    return device(nfc_open(m_context, connstring));
+  }
+
+  size_t list_devices(std::span<nfc_connstring> connstrings) noexcept
+  {
+    return nfc_list_devices(m_context, connstrings.data(), connstrings.size());
+  }
+
+private:
+  nfc_context *m_context = nullptr;
+};
+
+} // namespace nfc
+
+#endif /* __NFC_HPP__ */
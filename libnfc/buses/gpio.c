@@ -0,0 +1,199 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file gpio.c
+ * @brief GPIO interrupt line through the Linux GPIO character device
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+#include "gpio.h"
+
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/gpio.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_COM
+#define LOG_CATEGORY "libnfc.bus.gpio"
+
+// Longest a wait blocks before looking at the abort flag again (ms)
+#define GPIO_IRQ_ABORT_CHECK_INTERVAL 20
+
+struct gpio_irq_linux {
+  int fd;                               // Line event file descriptor
+};
+
+#define GPIO_DATA( X ) ((struct gpio_irq_linux *) X)
+
+/**
+ * @brief Request the falling edge events of an active low IRQ line
+ *
+ * @param pcSpec line specification "<gpiochip device>,<line offset>", optionally followed by ':' and other connstring fields
+ * @return the IRQ line, or INVALID_GPIO_IRQ
+ */
+gpio_irq
+gpio_irq_open(const char *pcSpec)
+{
+  const char *pcComma = strchr(pcSpec, ',');
+  if (pcComma == NULL) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid IRQ line: %s (expected <gpiochip>,<line>)", pcSpec);
+    return INVALID_GPIO_IRQ;
+  }
+  char acChip[PATH_MAX];
+  size_t szChip = pcComma - pcSpec;
+  if (szChip >= sizeof(acChip))
+    return INVALID_GPIO_IRQ;
+  memcpy(acChip, pcSpec, szChip);
+  acChip[szChip] = '\0';
+
+  unsigned int uiLine;
+  if (sscanf(pcComma + 1, "%u", &uiLine) != 1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid IRQ line: %s (expected <gpiochip>,<line>)", pcSpec);
+    return INVALID_GPIO_IRQ;
+  }
+
+  int chip_fd = open(acChip, O_RDONLY);
+  if (chip_fd == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open GPIO chip %s (%s)", acChip, strerror(errno));
+    return INVALID_GPIO_IRQ;
+  }
+
+  struct gpioevent_request req;
+  memset(&req, 0, sizeof(req));
+  req.lineoffset = uiLine;
+  req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+  req.eventflags = GPIOEVENT_REQUEST_FALLING_EDGE;
+  snprintf(req.consumer_label, sizeof(req.consumer_label), "%s", "libnfc");
+  int ret = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &req);
+  close(chip_fd);
+  if (ret == -1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to request events of line %u on %s (%s)", uiLine, acChip, strerror(errno));
+    return INVALID_GPIO_IRQ;
+  }
+  // Events are drained without blocking
+  fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+
+  struct gpio_irq_linux *irq = malloc(sizeof(struct gpio_irq_linux));
+  if (irq == NULL) {
+    close(req.fd);
+    return INVALID_GPIO_IRQ;
+  }
+  irq->fd = req.fd;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Using line %u of %s as IRQ", uiLine, acChip);
+  return irq;
+}
+
+/**
+ * @brief Open the IRQ line named by the "irq=" field of \a connstring, if any
+ *
+ * @return NULL when \a connstring names no IRQ line, the IRQ line, or INVALID_GPIO_IRQ
+ */
+gpio_irq
+gpio_irq_open_connstring(const nfc_connstring connstring)
+{
+  const char *pcSpec = strstr(connstring, GPIO_IRQ_CONNSTRING_PREFIX);
+  if (pcSpec == NULL)
+    return NULL;
+  return gpio_irq_open(pcSpec + strlen(GPIO_IRQ_CONNSTRING_PREFIX));
+}
+
+void
+gpio_irq_close(const gpio_irq irq)
+{
+  close(GPIO_DATA(irq)->fd);
+  free(irq);
+}
+
+// Forget edges already consumed by a read, the line level tells what is pending
+static void
+gpio_irq_drain(gpio_irq irq)
+{
+  struct gpioevent_data event;
+  while (read(GPIO_DATA(irq)->fd, &event, sizeof(event)) == sizeof(event))
+    ;
+}
+
+// The IRQ line is active low
+static int
+gpio_irq_asserted(gpio_irq irq)
+{
+  struct gpiohandle_data data;
+  memset(&data, 0, sizeof(data));
+  if (ioctl(GPIO_DATA(irq)->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == -1)
+    return NFC_EIO;
+  return data.values[0] == 0;
+}
+
+/**
+ * @brief Block until the IRQ line is asserted
+ *
+ * @param deadline time by which the line must be asserted, NFC_DEADLINE_NONE to wait forever
+ * @param abort_flag flag checked at least every GPIO_IRQ_ABORT_CHECK_INTERVAL ms, left set on abort
+ * @return NFC_SUCCESS when asserted, NFC_ETIMEOUT, NFC_EOPABORTED or NFC_EIO
+ */
+int
+gpio_irq_wait(gpio_irq irq, const nfc_deadline deadline, volatile bool *abort_flag)
+{
+  for (;;) {
+    gpio_irq_drain(irq);
+    int res = gpio_irq_asserted(irq);
+    if (res < 0)
+      return res;
+    if (res)
+      return NFC_SUCCESS;
+
+    int slice = GPIO_IRQ_ABORT_CHECK_INTERVAL;
+    if (deadline != NFC_DEADLINE_NONE) {
+      const int left = nfc_deadline_timeout(deadline);
+      if (left < 0) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Timeout waiting for IRQ");
+        return NFC_ETIMEOUT;
+      }
+      if (left < slice)
+        slice = left;
+    }
+
+    struct pollfd pfd = { .fd = GPIO_DATA(irq)->fd, .events = POLLIN | POLLPRI, .revents = 0 };
+    if ((poll(&pfd, 1, slice) == -1) && (errno != EINTR))
+      return NFC_EIO;
+    if (abort_flag && *abort_flag)
+      return NFC_EOPABORTED;
+  }
+}
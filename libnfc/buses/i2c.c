@@ -54,6 +54,7 @@
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
+#include "nfc-trace.h"
 
 #define LOG_GROUP    NFC_LOG_GROUP_COM
 #define LOG_CATEGORY "libnfc.bus.i2c"
@@ -142,6 +143,7 @@ i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx)
       res = recCount;
     }
   }
+  NFC_TRACE2(i2c__read, szRx, res);
   return res;
 }
 
@@ -160,6 +162,7 @@ i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx)
 
   ssize_t writeCount;
   writeCount = write(I2C_DATA(id) ->fd, pbtTx, szTx);
+  NFC_TRACE2(i2c__write, szTx, writeCount);
 
   if ((const ssize_t) szTx == writeCount) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
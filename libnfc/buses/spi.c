@@ -54,6 +54,7 @@
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
+#include "nfc-trace.h"
 
 #define LOG_GROUP    NFC_LOG_GROUP_COM
 #define LOG_CATEGORY "libnfc.bus.spi"
@@ -73,8 +74,16 @@ struct spi_port_unix {
   int 			fd; 			// Serial port file descriptor
   //~ struct termios 	termios_backup; 	// Terminal info before using the port
   //~ struct termios 	termios_new; 		// Terminal info during the transaction
+  uint8_t		mode;			// SPI mode as requested, without bit order
+  bool			lsb_first;		// Controller currently shifts LSB first
+  bool			lsb_first_unsupported;	// Controller refused SPI_LSB_FIRST, reverse bits in software
+  uint8_t	       *scratch;		// Bit-reversed copy of TX data when reversing in software
+  size_t		scratch_len;
 };
 
+// Initial size of the TX scratch buffer, large enough for any PN53x extended frame
+#define SPI_SCRATCH_LEN 512
+
 #define SPI_DATA( X ) ((struct spi_port_unix *) X)
 
 
@@ -86,6 +95,16 @@ spi_open(const char *pcPortName)
   if (sp == 0)
     return INVALID_SPI_PORT;
 
+  sp->mode = 0;
+  sp->lsb_first = false;
+  sp->lsb_first_unsupported = false;
+  sp->scratch_len = SPI_SCRATCH_LEN;
+  sp->scratch = malloc(sp->scratch_len);
+  if (sp->scratch == NULL) {
+    free(sp);
+    return INVALID_SPI_PORT;
+  }
+
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
     spi_close(sp);
@@ -114,11 +133,39 @@ void
 spi_set_mode(spi_port sp, const uint32_t uiPortMode)
 {
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "SPI port mode requested to be set to %d.", uiPortMode);
+  uint8_t mode = uiPortMode & ~SPI_LSB_FIRST;
   int ret;
-  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &uiPortMode);
+  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &mode);
 
   if (ret == -1)  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error setting SPI mode.");
 
+  SPI_DATA(sp)->mode = mode;
+  SPI_DATA(sp)->lsb_first = false;
+}
+
+// Have the controller shift bits in the wanted order, returns false if it has to be done in software
+static bool
+spi_set_bit_order(spi_port sp, bool lsb_first)
+{
+  if (SPI_DATA(sp)->lsb_first == lsb_first)
+    return true;
+  if (lsb_first && SPI_DATA(sp)->lsb_first_unsupported)
+    return false;
+
+  uint8_t mode = SPI_DATA(sp)->mode | (lsb_first ? SPI_LSB_FIRST : 0);
+  uint8_t mode_rd = 0;
+  if ((ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &mode) == -1) ||
+      (ioctl(SPI_DATA(sp)->fd, SPI_IOC_RD_MODE, &mode_rd) == -1) ||
+      (mode_rd != mode)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "SPI controller does not support LSB first mode, reversing bits in software.");
+    mode = SPI_DATA(sp)->mode;
+    ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &mode);
+    SPI_DATA(sp)->lsb_first = false;
+    SPI_DATA(sp)->lsb_first_unsupported = true;
+    return !lsb_first;
+  }
+  SPI_DATA(sp)->lsb_first = lsb_first;
+  return true;
 }
 
 uint32_t
@@ -139,30 +186,41 @@ void
 spi_close(const spi_port sp)
 {
   close(SPI_DATA(sp)->fd);
+  free(SPI_DATA(sp)->scratch);
   free(sp);
 }
 
 
+// Bit-reversed value of each byte
+static const uint8_t bit_reversal_table[256] = {
+  0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+  0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+  0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+  0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+  0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+  0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+  0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+  0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+  0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+  0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+  0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+  0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+  0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+  0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+  0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+  0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
+};
+
 /**
- * @brief Perform bit reversal on one byte \a x
- *
- * @return reversed byte
+ * @brief Reverse bits of each byte of \a pbtSrc into \a pbtDst (which may be \a pbtSrc itself)
  */
-
-static uint8_t
-bit_reversal(const uint8_t x)
+static void
+bit_reversal(uint8_t *pbtDst, const uint8_t *pbtSrc, const size_t szLen)
 {
-  uint8_t ret = x;
-  ret = (((ret & 0xaa) >> 1) | ((ret & 0x55) << 1));
-  ret = (((ret & 0xcc) >> 2) | ((ret & 0x33) << 2));
-  ret = (((ret & 0xf0) >> 4) | ((ret & 0x0f) << 4));
-  return ret;
+  for (size_t i = 0; i < szLen; i++)
+    pbtDst[i] = bit_reversal_table[pbtSrc[i]];
 }
 
-
-
-
-
 /**
  * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
  *
@@ -174,23 +232,22 @@ spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *
   size_t transfers = 0;
   struct spi_ioc_transfer tr[2];
 
-
-  uint8_t *pbtTxLSB = 0;
+  // Prefer the controller's own LSB first mode, otherwise reverse bits around the transfer
+  const bool sw_reversal = !spi_set_bit_order(sp, lsb_first);
 
   if (szTx) {
     LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-    if (lsb_first) {
-      pbtTxLSB = malloc(szTx * sizeof(uint8_t));
-      if (!pbtTxLSB) {
-        return NFC_ESOFT;
-      }
-
-      size_t i;
-      for (i = 0; i < szTx; ++i) {
-        pbtTxLSB[i] = bit_reversal(pbtTx[i]);
+    if (sw_reversal) {
+      if (szTx > SPI_DATA(sp)->scratch_len) {
+        uint8_t *scratch = realloc(SPI_DATA(sp)->scratch, szTx);
+        if (!scratch) {
+          return NFC_ESOFT;
+        }
+        SPI_DATA(sp)->scratch = scratch;
+        SPI_DATA(sp)->scratch_len = szTx;
       }
-
-      pbtTx = pbtTxLSB;
+      bit_reversal(SPI_DATA(sp)->scratch, pbtTx, szTx);
+      pbtTx = SPI_DATA(sp)->scratch;
     }
 
     struct spi_ioc_transfer tr_send = {
@@ -223,21 +280,15 @@ spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *
 
   if (transfers) {
     int ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_MESSAGE(transfers), tr);
-    if (szTx && lsb_first) {
-      free(pbtTxLSB);
-    }
-
+    NFC_TRACE3(spi__transfer, szTx, szRx, ret);
     if (ret != (int)(szRx + szTx)) {
       return NFC_EIO;
     }
 
     // Reverse received bytes if needed
     if (szRx) {
-      if (lsb_first) {
-        size_t i;
-        for (i = 0; i < szRx; ++i) {
-          pbtRx[i] = bit_reversal(pbtRx[i]);
-        }
+      if (sw_reversal) {
+        bit_reversal(pbtRx, pbtRx, szRx);
       }
 
       LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
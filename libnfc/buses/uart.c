@@ -53,6 +53,7 @@
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
+#include "nfc-trace.h"
 
 #define LOG_GROUP    NFC_LOG_GROUP_COM
 #define LOG_CATEGORY "libnfc.bus.uart"
@@ -70,10 +71,16 @@ const char *serial_ports_device_radix[] = { "ttyUSB", "ttyS", "ttyACM", "ttyAMA"
 // Work-around to claim uart interface using the c_iflag (software input processing) from the termios struct
 #  define CCLAIMED 0x80000000
 
+// Big enough for a whole PN53x extended frame
+#  define UART_RX_BUFFER_LEN 512
+
 struct serial_port_unix {
   int 			fd; 			// Serial port file descriptor
   struct termios 	termios_backup; 	// Terminal info before using the port
   struct termios 	termios_new; 		// Terminal info during the transaction
+  uint8_t		abtRxBuffer[UART_RX_BUFFER_LEN];	// Bytes read ahead, not received yet
+  size_t		szRxBufferPos;
+  size_t		szRxBufferLen;
 };
 
 #define UART_DATA( X ) ((struct serial_port_unix *) X)
@@ -87,6 +94,8 @@ uart_open(const char *pcPortName)
 
   if (sp == 0)
     return INVALID_SERIAL_PORT;
+  sp->szRxBufferPos = 0;
+  sp->szRxBufferLen = 0;
 
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
@@ -124,6 +133,9 @@ uart_open(const char *pcPortName)
 void
 uart_flush_input(serial_port sp)
 {
+  // Drop bytes read ahead too
+  UART_DATA(sp)->szRxBufferPos = 0;
+  UART_DATA(sp)->szRxBufferLen = 0;
   // This line seems to produce absolutely no effect on my system (GNU/Linux 2.6.35)
   tcflush(UART_DATA(sp)->fd, TCIFLUSH);
   // So, I wrote this byte-eater
@@ -148,7 +160,7 @@ uart_flush_input(serial_port sp)
   free(rx);
 }
 
-void
+int
 uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
 {
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Serial port speed requested to be set to %d bauds.", uiPortSpeed);
@@ -185,19 +197,30 @@ uart_set_speed(serial_port sp, const uint32_t uiPortSpeed)
     case 460800:
       stPortSpeed = B460800;
       break;
+#  endif
+#  ifdef B921600
+    case 921600:
+      stPortSpeed = B921600;
+      break;
 #  endif
     default:
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set serial port speed to %d bauds. Speed value must be one of those defined in termios(3).",
               uiPortSpeed);
-      return;
+      return NFC_EINVARG;
   };
 
   // Set port speed (Input and Output)
+  const speed_t stPreviousSpeed = cfgetispeed(&(UART_DATA(sp)->termios_new));
   cfsetispeed(&(UART_DATA(sp)->termios_new), stPortSpeed);
   cfsetospeed(&(UART_DATA(sp)->termios_new), stPortSpeed);
   if (tcsetattr(UART_DATA(sp)->fd, TCSADRAIN, &(UART_DATA(sp)->termios_new)) == -1) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to apply new speed settings.");
+    // Keep termios_new in sync with what the port actually runs at
+    cfsetispeed(&(UART_DATA(sp)->termios_new), stPreviousSpeed);
+    cfsetospeed(&(UART_DATA(sp)->termios_new), stPreviousSpeed);
+    return NFC_EIO;
   }
+  return NFC_SUCCESS;
 }
 
 uint32_t
@@ -233,6 +256,11 @@ uart_get_speed(serial_port sp)
     case B460800:
       uiPortSpeed = 460800;
       break;
+#  endif
+#  ifdef B921600
+    case B921600:
+      uiPortSpeed = 921600;
+      break;
 #  endif
   }
 
@@ -257,36 +285,92 @@ uart_close(const serial_port sp)
 }
 
 /**
- * @brief Receive data from UART and copy data to \a pbtRx
+ * @brief Get file descriptor of the serial port, e.g. to wait for incoming data with select(2)
  *
- * @return 0 on success, otherwise driver error code
+ * @return file descriptor
  */
 int
-uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
+uart_get_fd(const serial_port sp)
+{
+  return UART_DATA(sp)->fd;
+}
+
+/**
+ * @brief Count bytes already read ahead from the serial port
+ *
+ * Those bytes are out of the kernel buffer: uart_get_fd() file descriptor
+ * doesn't become readable for them.
+ *
+ * @return number of bytes the next uart_receive() gets without waiting
+ */
+size_t
+uart_pending(const serial_port sp)
 {
+  return UART_DATA(sp)->szRxBufferLen - UART_DATA(sp)->szRxBufferPos;
+}
+
+// Hand out bytes already read ahead, returns how many were copied
+static size_t
+uart_take_buffered(struct serial_port_unix *spu, uint8_t *pbtRx, const size_t szRx)
+{
+  const size_t szAvailable = spu->szRxBufferLen - spu->szRxBufferPos;
+  const size_t szCopied = MIN(szAvailable, szRx);
+  memcpy(pbtRx, spu->abtRxBuffer + spu->szRxBufferPos, szCopied);
+  spu->szRxBufferPos += szCopied;
+  if (spu->szRxBufferPos == spu->szRxBufferLen) {
+    spu->szRxBufferPos = 0;
+    spu->szRxBufferLen = 0;
+  }
+  return szCopied;
+}
+
+// uart_receive() body, served from the per-port buffer first
+static int
+uart_receive_bytes(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, const nfc_deadline deadline)
+{
+  struct serial_port_unix *spu = UART_DATA(sp);
   int iAbortFd = abort_p ? *((int *)abort_p) : 0;
-  int received_bytes_count = 0;
-  int available_bytes_count = 0;
-  const int expected_bytes_count = (int)szRx;
+  size_t received_bytes_count = uart_take_buffered(spu, pbtRx, szRx);
+  bool bReadable = false;
   int res;
   fd_set rfds;
-  do {
+  while (received_bytes_count < szRx) {
+    // Port is non-blocking: try to read first, wait only if nothing is there
+    res = read(spu->fd, spu->abtRxBuffer + spu->szRxBufferLen, sizeof(spu->abtRxBuffer) - spu->szRxBufferLen);
+    if (res > 0) {
+      spu->szRxBufferLen += res;
+      received_bytes_count += uart_take_buffered(spu, pbtRx + received_bytes_count, szRx - received_bytes_count);
+      bReadable = false;
+      continue;
+    }
+    // Stop if the OS has some troubles reading the data
+    if ((res < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error: %s", strerror(errno));
+      return NFC_EIO;
+    }
+    if (bReadable) {
+      // select() told there was something but nothing came
+      return NFC_EIO;
+    }
 select:
     // Reset file descriptor
     FD_ZERO(&rfds);
-    FD_SET(UART_DATA(sp)->fd, &rfds);
+    FD_SET(spu->fd, &rfds);
 
     if (iAbortFd) {
       FD_SET(iAbortFd, &rfds);
     }
 
+    // Time left is computed again on each wait, partial reads don't restart the timeout
     struct timeval timeout_tv;
-    if (timeout > 0) {
-      timeout_tv.tv_sec = (timeout / 1000);
-      timeout_tv.tv_usec = ((timeout % 1000) * 1000);
+    if (deadline != NFC_DEADLINE_NONE) {
+      const uint64_t now = nfc_clock_us();
+      const uint64_t left = (deadline > now) ? deadline - now : 0;
+      timeout_tv.tv_sec = left / 1000000;
+      timeout_tv.tv_usec = left % 1000000;
     }
 
-    res = select(MAX(UART_DATA(sp)->fd, iAbortFd) + 1, &rfds, NULL, NULL, timeout ? &timeout_tv : NULL);
+    res = select(MAX(spu->fd, iAbortFd) + 1, &rfds, NULL, NULL, (deadline != NFC_DEADLINE_NONE) ? &timeout_tv : NULL);
 
     if ((res < 0) && (EINTR == errno)) {
       // The system call was interupted by a signal and a signal handler was
@@ -311,36 +395,43 @@ select:
       close(iAbortFd);
       return NFC_EOPABORTED;
     }
-
-    // Retrieve the count of the incoming bytes
-    res = ioctl(UART_DATA(sp)->fd, FIONREAD, &available_bytes_count);
-    if (res != 0) {
-      return NFC_EIO;
-    }
-    // There is something available, read the data
-    res = read(UART_DATA(sp)->fd, pbtRx + received_bytes_count, MIN(available_bytes_count, (expected_bytes_count - received_bytes_count)));
-    // Stop if the OS has some troubles reading the data
-    if (res <= 0) {
-      return NFC_EIO;
-    }
-    received_bytes_count += res;
-
-  } while (expected_bytes_count > received_bytes_count);
+    bReadable = true;
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
   return NFC_SUCCESS;
 }
 
+/**
+ * @brief Receive data from UART and copy data to \a pbtRx
+ *
+ * Everything the port already holds is read at once into a per-port buffer,
+ * so the following calls (drivers read a frame piece by piece) are served
+ * without any system call.
+ * Waits are bounded by \a deadline, shared by all the reads of a frame.
+ *
+ * @return 0 on success, otherwise driver error code
+ */
+int
+uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, const nfc_deadline deadline)
+{
+  const int res = uart_receive_bytes(sp, pbtRx, szRx, abort_p, deadline);
+  NFC_TRACE2(uart__receive, szRx, res);
+  return res;
+}
+
 /**
  * @brief Send \a pbtTx content to UART
  *
  * @return 0 on success, otherwise a driver error is returned
  */
 int
-uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout)
+uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, const nfc_deadline deadline)
 {
-  (void) timeout;
+  (void) deadline;
   LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-  if ((int) szTx == write(UART_DATA(sp)->fd, pbtTx, szTx))
+  const ssize_t res = write(UART_DATA(sp)->fd, pbtTx, szTx);
+  NFC_TRACE2(uart__send, szTx, res);
+  if ((ssize_t) szTx == res)
     return NFC_SUCCESS;
   else
     return NFC_EIO;
@@ -395,3 +486,89 @@ oom:
 
   return res;
 }
+
+#if defined (__linux__)
+// Read a sysfs attribute holding a hexadecimal number
+static bool
+uart_sysfs_read_hex(const char *pcDir, const char *pcAttribute, unsigned long *pulValue)
+{
+  char acPath[PATH_MAX];
+  char acValue[16];
+  FILE *f;
+  bool res;
+
+  snprintf(acPath, sizeof(acPath), "%s/%s", pcDir, pcAttribute);
+  if (!(f = fopen(acPath, "r")))
+    return false;
+  res = (fgets(acValue, sizeof(acValue), f) != NULL);
+  fclose(f);
+  if (res)
+    *pulValue = strtoul(acValue, NULL, 16);
+  return res;
+}
+
+// Whether the USB device behind a tty has one of the VID:PID of the list
+static bool
+uart_port_matches(const char *pcPortName, const char *pcUsbIds)
+{
+  const char *pcName = strrchr(pcPortName, '/');
+  char acPath[PATH_MAX];
+  char acDevice[PATH_MAX];
+  unsigned long ulVid, ulPid;
+  char *pcSlash;
+
+  snprintf(acPath, sizeof(acPath), "/sys/class/tty/%s/device", (pcName) ? pcName + 1 : pcPortName);
+  if (!realpath(acPath, acDevice))
+    return false;
+  // Walk up from the tty to the USB device, past its interface
+  while (!uart_sysfs_read_hex(acDevice, "idVendor", &ulVid) || !uart_sysfs_read_hex(acDevice, "idProduct", &ulPid)) {
+    if (!(pcSlash = strrchr(acDevice, '/')) || (pcSlash == acDevice))
+      return false;
+    *pcSlash = '\0';
+  }
+  while (*pcUsbIds) {
+    char *pcEnd;
+    const unsigned long ulFilterVid = strtoul(pcUsbIds, &pcEnd, 16);
+    if (*pcEnd == ':') {
+      const unsigned long ulFilterPid = strtoul(pcEnd + 1, &pcEnd, 16);
+      if ((ulFilterVid == ulVid) && (ulFilterPid == ulPid))
+        return true;
+    }
+    pcUsbIds = (pcEnd != pcUsbIds) ? pcEnd : pcUsbIds + 1;
+    while ((*pcUsbIds == ',') || (*pcUsbIds == ' '))
+      pcUsbIds++;
+  }
+  return false;
+}
+#endif
+
+/**
+ * @brief Drop from a uart_list_ports() list the ports of serial adapters left out of a VID:PID list
+ *
+ * @param ppcPorts NULL terminated list, filtered in place
+ * @param pcUsbIds comma separated VID:PID list (eg. "0403:6001,067b:2303"), NULL keeps every port
+ *
+ * USB ids are read from sysfs, elsewhere than on Linux the list is kept as is.
+ */
+void
+uart_filter_ports(char **ppcPorts, const char *pcUsbIds)
+{
+#if defined (__linux__)
+  size_t szKept = 0;
+
+  if (!pcUsbIds)
+    return;
+  for (size_t i = 0; ppcPorts[i]; i++) {
+    if (uart_port_matches(ppcPorts[i], pcUsbIds)) {
+      ppcPorts[szKept++] = ppcPorts[i];
+    } else {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Skipping %s, not a listed USB serial adapter", ppcPorts[i]);
+      free(ppcPorts[i]);
+    }
+  }
+  ppcPorts[szKept] = NULL;
+#else
+  (void) ppcPorts;
+  (void) pcUsbIds;
+#endif
+}
@@ -41,6 +41,7 @@
 
 
 #  include <nfc/nfc-types.h>
+#  include "nfc-internal.h"
 
 // Define shortcut to types to make code more readable
 typedef void *serial_port;
@@ -51,12 +52,19 @@ serial_port uart_open(const char *pcPortName);
 void    uart_close(const serial_port sp);
 void    uart_flush_input(const serial_port sp);
 
-void    uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
+int     uart_set_speed(serial_port sp, const uint32_t uiPortSpeed);
 uint32_t uart_get_speed(const serial_port sp);
 
-int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout);
-int     uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout);
+int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, const nfc_deadline deadline);
+int     uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, const nfc_deadline deadline);
+
+int     uart_get_fd(const serial_port sp);
+size_t  uart_pending(const serial_port sp);
+#  ifdef WIN32
+void    uart_abort(serial_port sp);
+#  endif
 
 char  **uart_list_ports(void);
+void    uart_filter_ports(char **ppcPorts, const char *pcUsbIds);
 
 #endif // __NFC_BUS_UART_H__
@@ -27,7 +27,7 @@
 
 /**
  * @file usbbus.c
- * @brief libusb 0.1 driver wrapper
+ * @brief libusb 1.0 driver wrapper
  */
 
 #ifdef HAVE_CONFIG_H
@@ -35,45 +35,386 @@
 #endif // HAVE_CONFIG_H
 
 #include <stdlib.h>
+#ifndef WIN32
+#  include <pthread.h>
+#endif
+
+#include <nfc/nfc.h>
 
 #include "usbbus.h"
 #include "log.h"
+#include "nfc-trace.h"
 #define LOG_CATEGORY "libnfc.buses.usbbus"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
+static libusb_context *usb_ctx = NULL;
+
+#ifndef WIN32
+/*
+ * When libusb supports hotplug, the list of attached devices is maintained by
+ * hotplug notifications so scanning does not walk (and reopen) every bus.
+ * Notifications are delivered by libusb while some thread handles USB events.
+ */
+struct usb_cached_device {
+  libusb_device *dev;
+  // Set once a driver successfully probed this device during a scan
+  bool probed;
+  struct usb_cached_device *next;
+};
+
+struct usb_hotplug_listener {
+  usb_hotplug_callback callback;
+  void *user_data;
+  struct usb_hotplug_listener *next;
+};
+
+static bool usb_hotplug_enabled = false;
+static struct usb_cached_device *usb_devices = NULL;
+static size_t usb_devices_count = 0;
+static pthread_mutex_t usb_devices_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct usb_hotplug_listener *usb_listeners = NULL;
+static pthread_mutex_t usb_listeners_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int LIBUSB_CALL
+usb_hotplug_event(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data)
+{
+  (void) ctx;
+  (void) user_data;
+  bool attached = (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+
+  pthread_mutex_lock(&usb_devices_lock);
+  struct usb_cached_device **ppEntry = &usb_devices;
+  while (*ppEntry && ((*ppEntry)->dev != dev))
+    ppEntry = &((*ppEntry)->next);
+  if (attached && !*ppEntry) {
+    // Append to keep enumeration order
+    struct usb_cached_device *pEntry = malloc(sizeof(struct usb_cached_device));
+    if (pEntry) {
+      pEntry->dev = libusb_ref_device(dev);
+      pEntry->probed = false;
+      pEntry->next = NULL;
+      *ppEntry = pEntry;
+      usb_devices_count++;
+    }
+  } else if (!attached && *ppEntry) {
+    struct usb_cached_device *pEntry = *ppEntry;
+    *ppEntry = pEntry->next;
+    libusb_unref_device(pEntry->dev);
+    free(pEntry);
+    usb_devices_count--;
+  }
+  pthread_mutex_unlock(&usb_devices_lock);
+
+  struct libusb_device_descriptor descriptor;
+  if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+    return 0;
+
+  pthread_mutex_lock(&usb_listeners_lock);
+  for (struct usb_hotplug_listener *pListener = usb_listeners; pListener; pListener = pListener->next) {
+    pListener->callback(descriptor.idVendor, descriptor.idProduct, libusb_get_bus_number(dev), libusb_get_device_address(dev), attached, pListener->user_data);
+  }
+  pthread_mutex_unlock(&usb_listeners_lock);
+
+  // Keep this callback armed
+  return 0;
+}
+
+// Deliver already queued hotplug notifications, unless another thread is handling events
+static void
+usb_handle_pending_events(void)
+{
+  struct timeval tv = { 0, 0 };
+  if (libusb_try_lock_events(usb_ctx) == 0) {
+    libusb_handle_events_locked(usb_ctx, &tv);
+    libusb_unlock_events(usb_ctx);
+  }
+}
+#endif
+
+#ifndef WIN32
+// Drivers of several threads may prepare the bus at once
+static pthread_mutex_t usb_prepare_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int usb_prepare_once(void);
+
 int usb_prepare(void)
 {
-  static bool usb_initialized = false;
-  if (!usb_initialized) {
+#ifndef WIN32
+  pthread_mutex_lock(&usb_prepare_lock);
+#endif
+  int res = usb_prepare_once();
+#ifndef WIN32
+  pthread_mutex_unlock(&usb_prepare_lock);
+#endif
+  return res;
+}
+
+// usb_prepare() body, usb_prepare_lock is held
+static int
+usb_prepare_once(void)
+{
+  if (usb_ctx == NULL) {
+    int res;
+    if ((res = libusb_init(&usb_ctx)) < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to initialize libusb (%s)", libusb_error_name(res));
+      usb_ctx = NULL;
+      return -1;
+    }
 
-#ifdef ENVVARS
-    char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
+#ifdef LOG
     // Set libusb debug only if asked explicitely:
     // LIBUSB_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
-    if (env_log_level && (((atoi(env_log_level) >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG)) {
-      setenv("USB_DEBUG", "255", 1);
+    if (((log_cached_level >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG) {
+      libusb_set_debug(usb_ctx, LIBUSB_LOG_LEVEL_DEBUG);
     }
 #endif
 
-    usb_init();
-    usb_initialized = true;
+#ifndef WIN32
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+      libusb_hotplug_callback_handle handle;
+      // LIBUSB_HOTPLUG_ENUMERATE fills the cache with already attached devices before returning
+      res = libusb_hotplug_register_callback(usb_ctx, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT, LIBUSB_HOTPLUG_ENUMERATE,
+                                             LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, LIBUSB_HOTPLUG_MATCH_ANY, usb_hotplug_event, NULL, &handle);
+      if (res == LIBUSB_SUCCESS) {
+        usb_hotplug_enabled = true;
+      } else {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to register USB hotplug callback (%s), devices will be rescanned", libusb_error_name(res));
+      }
+    }
+#endif
   }
+  return 0;
+}
 
+libusb_context *
+usb_get_context(void)
+{
+  return usb_ctx;
+}
+
+/**
+ * @brief Get the list of attached USB devices
+ * @return number of devices or libusb error code (negative value)
+ *
+ * With hotplug support, this is a copy of the cached list and no bus is
+ * accessed. The list must be released with libusb_free_device_list(list, 1).
+ */
+ssize_t
+usb_get_device_list(libusb_device ***list)
+{
+#ifndef WIN32
+  if (usb_hotplug_enabled) {
+    usb_handle_pending_events();
+
+    pthread_mutex_lock(&usb_devices_lock);
+    *list = malloc((usb_devices_count + 1) * sizeof(libusb_device *));
+    if (*list == NULL) {
+      pthread_mutex_unlock(&usb_devices_lock);
+      return LIBUSB_ERROR_NO_MEM;
+    }
+    ssize_t szDevices = 0;
+    for (struct usb_cached_device *pEntry = usb_devices; pEntry; pEntry = pEntry->next) {
+      (*list)[szDevices++] = libusb_ref_device(pEntry->dev);
+    }
+    (*list)[szDevices] = NULL;
+    pthread_mutex_unlock(&usb_devices_lock);
+    return szDevices;
+  }
+#endif
+  return libusb_get_device_list(usb_ctx, list);
+}
+
+/**
+ * @brief Tell if a driver already probed this device successfully
+ *
+ * Always false when hotplug is not available so devices are probed on each scan.
+ */
+bool
+usb_device_is_probed(libusb_device *dev)
+{
+  bool res = false;
+#ifndef WIN32
+  pthread_mutex_lock(&usb_devices_lock);
+  for (struct usb_cached_device *pEntry = usb_devices; pEntry; pEntry = pEntry->next) {
+    if (pEntry->dev == dev) {
+      res = pEntry->probed;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&usb_devices_lock);
+#else
+  (void) dev;
+#endif
+  return res;
+}
+
+void
+usb_device_set_probed(libusb_device *dev)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&usb_devices_lock);
+  for (struct usb_cached_device *pEntry = usb_devices; pEntry; pEntry = pEntry->next) {
+    if (pEntry->dev == dev) {
+      pEntry->probed = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&usb_devices_lock);
+#else
+  (void) dev;
+#endif
+}
+
+/**
+ * @brief Register a callback called on each USB device attachment or removal
+ * @return 0 on success, NFC_EDEVNOTSUPP if libusb has no hotplug support
+ *
+ * @a callback is called from the thread handling USB events and must neither
+ * block nor (un)register listeners.
+ */
+int
+usb_hotplug_listen(usb_hotplug_callback callback, void *user_data)
+{
+#ifndef WIN32
+  if (usb_prepare() < 0)
+    return NFC_EIO;
+  if (!usb_hotplug_enabled)
+    return NFC_EDEVNOTSUPP;
+
+  struct usb_hotplug_listener *pListener = malloc(sizeof(struct usb_hotplug_listener));
+  if (!pListener)
+    return NFC_ESOFT;
+  pListener->callback = callback;
+  pListener->user_data = user_data;
+
+  pthread_mutex_lock(&usb_listeners_lock);
+  pListener->next = usb_listeners;
+  usb_listeners = pListener;
+  pthread_mutex_unlock(&usb_listeners_lock);
+  return NFC_SUCCESS;
+#else
+  (void) callback;
+  (void) user_data;
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
+void
+usb_hotplug_unlisten(usb_hotplug_callback callback, void *user_data)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&usb_listeners_lock);
+  struct usb_hotplug_listener **ppListener = &usb_listeners;
+  while (*ppListener) {
+    if (((*ppListener)->callback == callback) && ((*ppListener)->user_data == user_data)) {
+      struct usb_hotplug_listener *pListener = *ppListener;
+      *ppListener = pListener->next;
+      free(pListener);
+      break;
+    }
+    ppListener = &((*ppListener)->next);
+  }
+  pthread_mutex_unlock(&usb_listeners_lock);
+#else
+  (void) callback;
+  (void) user_data;
+#endif
+}
+
+/**
+ * @brief Handle USB events (including hotplug notifications) for at most @a timeout ms
+ * @return 0 on success, otherwise libnfc's error code (negative value)
+ */
+int
+usb_handle_events(int timeout)
+{
+  if (usb_prepare() < 0)
+    return NFC_EIO;
+
+  struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+  int res = libusb_handle_events_timeout_completed(usb_ctx, &tv, NULL);
+  if ((res < 0) && (res != LIBUSB_ERROR_INTERRUPTED)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to handle USB events (%s)", libusb_error_name(res));
+    return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+static void LIBUSB_CALL
+usb_transfer_completed(struct libusb_transfer *transfer)
+{
+  *((int *) transfer->user_data) = 1;
+}
+
+/**
+ * @brief Read from a bulk endpoint, waiting on libusb events rather than polling
+ * @return number of bytes read, NFC_ETIMEOUT, NFC_EOPABORTED or NFC_EIO
+ *
+ * The calling thread sleeps in libusb until either data is received, @a timeout
+ * (in ms, 0 means infinite) expires, or usb_abort_transfer() cancels @a transfer.
+ * @a abort_flag is checked before and after submission so an abort requested
+ * while no transfer is in flight is not lost; it is cleared once honoured.
+ */
+int
+usb_bulk_read_abortable(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, uint8_t *data, int length, unsigned int timeout, volatile bool *abort_flag)
+{
+  int completed = 0;
   int res;
-  // usb_find_busses will find all of the busses on the system. Returns the
-  // number of changes since previous call to this function (total of new
-  // busses and busses removed).
-  if ((res = usb_find_busses()) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB busses (%s)", _usb_strerror(res));
-    return -1;
+
+  if (*abort_flag) {
+    *abort_flag = false;
+    return NFC_EOPABORTED;
   }
-  // usb_find_devices will find all of the devices on each bus. This should be
-  // called after usb_find_busses. Returns the number of changes since the
-  // previous call to this function (total of new device and devices removed).
-  if ((res = usb_find_devices()) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB devices (%s)", _usb_strerror(res));
-    return -1;
+
+  libusb_fill_bulk_transfer(transfer, dev_handle, endpoint, data, length, usb_transfer_completed, &completed, timeout);
+  if ((res = libusb_submit_transfer(transfer)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to submit USB transfer (%s)", libusb_error_name(res));
+    return NFC_EIO;
+  }
+  // An abort may have been requested between the first check and the submission
+  if (*abort_flag)
+    libusb_cancel_transfer(transfer);
+
+  while (!completed) {
+    if ((res = libusb_handle_events_completed(usb_ctx, &completed)) < 0) {
+      if (res == LIBUSB_ERROR_INTERRUPTED)
+        continue;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to handle USB events (%s)", libusb_error_name(res));
+      // The transfer still belongs to libusb: reclaim it before returning
+      libusb_cancel_transfer(transfer);
+      while (!completed) {
+        if (libusb_handle_events_completed(usb_ctx, &completed) < 0)
+          break;
+      }
+      return NFC_EIO;
+    }
+  }
+
+  NFC_TRACE3(usb__bulk__read, length, transfer->status, transfer->actual_length);
+  switch (transfer->status) {
+    case LIBUSB_TRANSFER_COMPLETED:
+      return transfer->actual_length;
+    case LIBUSB_TRANSFER_TIMED_OUT:
+      return NFC_ETIMEOUT;
+    case LIBUSB_TRANSFER_CANCELLED:
+      *abort_flag = false;
+      return NFC_EOPABORTED;
+    default:
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "USB transfer failed (status %d)", transfer->status);
+      return NFC_EIO;
   }
-  return 0;
 }
 
+/**
+ * @brief Request a pending usb_bulk_read_abortable() to return NFC_EOPABORTED
+ *
+ * Safe to call from any thread, whether a transfer is in flight or not.
+ */
+void
+usb_abort_transfer(struct libusb_transfer *transfer, volatile bool *abort_flag)
+{
+  *abort_flag = true;
+  // LIBUSB_ERROR_NOT_FOUND only means nothing is in flight: the flag will be seen on next read
+  libusb_cancel_transfer(transfer);
+}
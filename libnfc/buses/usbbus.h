@@ -27,27 +27,32 @@
 
 /**
  * @file usbbus.h
- * @brief libusb 0.1 driver header
+ * @brief libusb 1.0 driver header
  */
 
 #ifndef __NFC_BUS_USB_H__
 #  define __NFC_BUS_USB_H__
 
-#ifndef _WIN32
-// Under POSIX system, we use libusb (>= 0.1.12)
-#include <usb.h>
-#define USB_TIMEDOUT ETIMEDOUT
-#define _usb_strerror( X ) strerror(-X)
-#else
-// Under Windows we use libusb-win32 (>= 1.2.5)
-#include <lusb0_usb.h>
-#define USB_TIMEDOUT 116
-#define _usb_strerror( X ) usb_strerror()
-#endif
+// We use libusb (>= 1.0.9) on every platform
+#include <libusb.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
 int usb_prepare(void);
+libusb_context *usb_get_context(void);
+
+ssize_t usb_get_device_list(libusb_device ***list);
+bool usb_device_is_probed(libusb_device *dev);
+void usb_device_set_probed(libusb_device *dev);
+
+typedef void (*usb_hotplug_callback)(uint16_t vendor_id, uint16_t product_id, uint8_t bus_number, uint8_t device_address, bool attached, void *user_data);
+int usb_hotplug_listen(usb_hotplug_callback callback, void *user_data);
+void usb_hotplug_unlisten(usb_hotplug_callback callback, void *user_data);
+int usb_handle_events(int timeout);
+
+int usb_bulk_read_abortable(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char endpoint, uint8_t *data, int length, unsigned int timeout, volatile bool *abort_flag);
+void usb_abort_transfer(struct libusb_transfer *transfer, volatile bool *abort_flag);
 
 #endif // __NFC_BUS_USB_H__
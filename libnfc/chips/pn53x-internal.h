@@ -118,6 +118,10 @@
 #  define PN53x_EXTENDED_FRAME__DATA_MAX_LEN            264
 #  define PN53x_EXTENDED_FRAME__OVERHEAD                11
 #  define PN53x_ACK_FRAME__LEN                          6
+// Data carried by one TgSetData/TgSetMetaData command
+#  define PN53x_TG_DATA_MAX_LEN                         262
+// Data carried by one InDataExchange command
+#  define PN53x_IN_DATA_MAX_LEN                         262
 
 typedef struct {
   uint8_t ui8Code;
@@ -141,9 +145,11 @@ typedef enum {
 #else
 #  define PNCMD( X, Y ) { X , Y, #X }
 #  define PNCMD_TRACE( X ) do { \
+    if (!LOG_ENABLED(LOG_GROUP, NFC_LOG_PRIORITY_DEBUG)) \
+      break; \
     for (size_t i=0; i<(sizeof(pn53x_commands)/sizeof(pn53x_command)); i++) { \
       if ( X == pn53x_commands[i].ui8Code ) { \
-        log_put( LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", pn53x_commands[i].abtCommandText ); \
+        log_put_static( LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, pn53x_commands[i].abtCommandText ); \
         break; \
       } \
     } \
@@ -225,6 +231,8 @@ typedef struct {
   } while(0)
 #else
 #  define PNREG_TRACE( X ) do { \
+    if (!LOG_ENABLED(LOG_GROUP, NFC_LOG_PRIORITY_DEBUG)) \
+      break; \
     for (size_t i=0; i<(sizeof(pn53x_registers)/sizeof(pn53x_register)); i++) { \
       if ( X == pn53x_registers[i].ui16Address ) { \
         log_put( LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s (%s)", pn53x_registers[i].abtRegisterText, pn53x_registers[i].abtRegisterDescription ); \
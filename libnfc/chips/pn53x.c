@@ -38,6 +38,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "nfc/nfc.h"
 #include "nfc-internal.h"
@@ -45,10 +46,24 @@
 #include "pn53x-internal.h"
 
 #include "mirror-subr.h"
+#include "nfc-capture.h"
+#include "nfc-trace.h"
 
 #define LOG_CATEGORY "libnfc.chip.pn53x"
 #define LOG_GROUP NFC_LOG_GROUP_CHIP
 
+#define SAK_ISO14443_4_COMPLIANT 0x20
+#define SAK_ISO18092_COMPLIANT   0x40
+
+// Adaptive communication timeout: answers sampled before shortening it, margin over the slowest answer, shortest timeout (ms),
+// which stays above the worst case EEPROM write time should a write ever be sent with it
+#define PN53X_ADAPTIVE_MIN_SAMPLES 4
+#define PN53X_ADAPTIVE_MARGIN      4
+#define PN53X_ADAPTIVE_FLOOR_MS    10
+
+// Longest wait (ms) for a target woken up again before a repeat, as NP_INFINITE_SELECT may be set
+#define PN53X_REWAKE_TIMEOUT 300
+
 const uint8_t pn53x_ack_frame[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
 const uint8_t pn53x_nack_frame[] = { 0x00, 0x00, 0xff, 0xff, 0x00, 0x00 };
 static const uint8_t pn53x_error_frame[] = { 0x00, 0x00, 0xff, 0x01, 0xff, 0x7f, 0x81, 0x00 };
@@ -63,6 +78,19 @@ const nfc_modulation_type pn53x_supported_modulation_as_target[] = {NMT_ISO14443
 /* prototypes */
 int pn53x_reset_settings(struct nfc_device *pnd);
 int pn53x_writeback_register(struct nfc_device *pnd);
+static int pn53x_writeback_register_ext(struct nfc_device *pnd, const uint8_t *pbtExtraWrites, const size_t szExtraWrites);
+static int pn53x_writeback_build(struct nfc_device *pnd, const uint8_t *pbtExtraWrites, const size_t szExtraWrites, uint8_t *pbtWriteRegisterCmd);
+static void pn53x_writeback_applied(struct nfc_device *pnd, const uint8_t *pbtWriteRegisterCmd, const size_t szWriteRegisterCmd);
+static int pn53x_cmd_queue_run(struct nfc_device *pnd, struct pn53x_cmd_queue *pcq, int timeout);
+static int pn53x_flush_parameters(struct nfc_device *pnd);
+static int pn53x_transceive_frame(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const uint8_t **ppbtView, int timeout);
+static uint8_t pn53x_int_to_timeout(const int ms);
+static int pn532_sam_leave(struct nfc_device *pnd);
+static bool pn53x_initiator_cmd_is_idempotent(const struct nfc_device *pnd, const nfc_target *pnt, const uint8_t *pbtTx, const size_t szTx);
+static int pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt, int timeout);
+static int pn53x_InAutoPoll_decode(struct nfc_device *pnd, const uint8_t *pbtRx, const size_t szRx, nfc_target *pntTargets);
+static size_t pn53x_TgInitAsTarget_frame(struct nfc_device *pnd, pn53x_target_mode ptm, const uint8_t *pbtMifareParams, const uint8_t *pbtTkt, size_t szTkt, const uint8_t *pbtFeliCaParams, const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt, uint8_t pbtCmd[PN53X_TG_INIT_FRAME_MAX_LEN]);
+static int pn53x_TgInitAsTarget_send(struct nfc_device *pnd, const uint8_t *pbtCmd, const size_t szCmd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout);
 
 nfc_modulation pn53x_ptt_to_nm(const pn53x_target_type ptt);
 pn53x_modulation pn53x_nm_to_pm(const nfc_modulation nm);
@@ -83,7 +111,7 @@ pn53x_init(struct nfc_device *pnd)
   }
 
   if (!CHIP_DATA(pnd)->supported_modulation_as_initiator) {
-    CHIP_DATA(pnd)->supported_modulation_as_initiator = malloc(sizeof(nfc_modulation_type) * 9);
+    CHIP_DATA(pnd)->supported_modulation_as_initiator = nfc_device_alloc(pnd, sizeof(nfc_modulation_type) * PN53X_INITIATOR_MODULATIONS_LEN);
     if (! CHIP_DATA(pnd)->supported_modulation_as_initiator)
       return NFC_ESOFT;
     int nbSupportedModulation = 0;
@@ -127,42 +155,68 @@ pn53x_init(struct nfc_device *pnd)
   return NFC_SUCCESS;
 }
 
+/*
+ * Check an already initialized device still talks to the same chip, then
+ * restore the settings pn53x_init() leaves: nothing else is identified again.
+ */
+int
+pn53x_resume(struct nfc_device *pnd)
+{
+  int res = 0;
+  const pn53x_type type = CHIP_DATA(pnd)->type;
+  const uint8_t btSupportByte = pnd->btSupportByte;
+  char firmware_text[sizeof(CHIP_DATA(pnd)->firmware_text)];
+  memcpy(firmware_text, CHIP_DATA(pnd)->firmware_text, sizeof(firmware_text));
+
+  // GetFirmwareVersion is the cheapest command every PN53x answers
+  if ((res = pn53x_decode_firmware_version(pnd)) < 0) {
+    return res;
+  }
+  if ((CHIP_DATA(pnd)->type != type) || (pnd->btSupportByte != btSupportByte) ||
+      (strcmp(CHIP_DATA(pnd)->firmware_text, firmware_text) != 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Chip changed from %s to %s", firmware_text, CHIP_DATA(pnd)->firmware_text);
+    return NFC_EIO;
+  }
+
+  if ((res = pn53x_SetParameters(pnd, PARAM_AUTO_ATR_RES | PARAM_AUTO_RATS)) < 0) {
+    return res;
+  }
+  return pn53x_reset_settings(pnd);
+}
+
 int
 pn53x_reset_settings(struct nfc_device *pnd)
 {
   int res = 0;
+  // All settings below reach the chip in a single WriteRegister frame
+  pn53x_begin_properties(pnd);
+  // Settings are back to chip handling, any raw-bit session is over
+  CHIP_DATA(pnd)->raw_session = false;
   // Reset the ending transmission bits register, it is unknown what the last tranmission used there
   CHIP_DATA(pnd)->ui8TxBits = 0;
-  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_TX_LAST_BITS, 0x00)) < 0) {
-    return res;
-  }
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_TX_LAST_BITS, 0x00)) < 0)
+    goto end;
   // Make sure we reset the CRC and parity to chip handling.
   if ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
-    return res;
+    goto end;
   if ((res = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0)
-    return res;
+    goto end;
   // Activate "easy framing" feature by default
   if ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0)
-    return res;
+    goto end;
   // Deactivate the CRYPTO1 cipher, it may could cause problems when still active
   if ((res = pn53x_set_property_bool(pnd, NP_ACTIVATE_CRYPTO1, false)) < 0)
-    return res;
+    goto end;
+  res = NFC_SUCCESS;
 
-  return NFC_SUCCESS;
+end:
+  pn53x_commit_properties(pnd);
+  return res;
 }
 
-int
-pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+static int
+pn53x_resolve_timeout(struct nfc_device *pnd, int timeout)
 {
-  bool mi = false;
-  int res = 0;
-  if (CHIP_DATA(pnd)->wb_trigged) {
-    if ((res = pn53x_writeback_register(pnd)) < 0) {
-      return res;
-    }
-  }
-
-  PNCMD_TRACE(pbtTx[0]);
   if (timeout > 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timeout values: %d", timeout);
   } else if (timeout == 0) {
@@ -172,38 +226,421 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", timeout);
   }
+  return timeout;
+}
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+// Target commands which leave the settings made by pn53x_target_init() in place
+static bool
+pn53x_cmd_keeps_target_armed(const uint8_t ui8Command)
+{
+  switch (ui8Command) {
+    case TgInitAsTarget:
+    case TgGetData:
+    case TgSetData:
+    case TgSetMetaData:
+    case TgGetInitiatorCommand:
+    case TgResponseToInitiator:
+    case TgGetTargetStatus:
+      return true;
+  }
+  return false;
+}
 
-  // Check if receiving buffers are available, if not, replace them
-  if (szRxLen == 0 || !pbtRx) {
-    pbtRx = abtRx;
-  } else {
-    szRx = szRxLen;
+// Identifier telling targets of the same modulation type apart
+static size_t
+pn53x_target_uid(const nfc_target *pnt, const uint8_t **ppbtUid)
+{
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      *ppbtUid = pnt->nti.nai.abtUid;
+      return pnt->nti.nai.szUidLen;
+    case NMT_ISO14443B:
+      *ppbtUid = pnt->nti.nbi.abtPupi;
+      return sizeof(pnt->nti.nbi.abtPupi);
+    case NMT_ISO14443BI:
+      *ppbtUid = pnt->nti.nii.abtDIV;
+      return sizeof(pnt->nti.nii.abtDIV);
+    case NMT_ISO14443B2SR:
+      *ppbtUid = pnt->nti.nsi.abtUID;
+      return sizeof(pnt->nti.nsi.abtUID);
+    case NMT_ISO14443B2CT:
+      *ppbtUid = pnt->nti.nci.abtUID;
+      return sizeof(pnt->nti.nci.abtUID);
+    case NMT_FELICA:
+      *ppbtUid = pnt->nti.nfi.abtId;
+      return sizeof(pnt->nti.nfi.abtId);
+    case NMT_JEWEL:
+      *ppbtUid = pnt->nti.nji.btId;
+      return sizeof(pnt->nti.nji.btId);
+    case NMT_DEP:
+      *ppbtUid = pnt->nti.ndi.abtNFCID3;
+      return sizeof(pnt->nti.ndi.abtNFCID3);
   }
+  *ppbtUid = NULL;
+  return 0;
+}
 
-  // Call the send/receice callback functions of the current driver
-  if ((res = CHIP_DATA(pnd)->io->send(pnd, pbtTx, szTx, timeout)) < 0) {
-    return res;
+// Initiator commands starting a new RF activation
+static bool
+pn53x_cmd_uses_antenna(const uint8_t ui8Command)
+{
+  switch (ui8Command) {
+    case InListPassiveTarget:
+    case InAutoPoll:
+    case InJumpForDEP:
+    case InJumpForPSL:
+    case InATR:
+      return true;
   }
+  return false;
+}
 
-  // Command is sent, we store the command
-  CHIP_DATA(pnd)->last_command = pbtTx[0];
+// Data exchange commands, bounded by the communication timeout
+static bool
+pn53x_cmd_uses_retry_timeout(const uint8_t ui8Command)
+{
+  return (ui8Command == InDataExchange) || (ui8Command == InCommunicateThru);
+}
 
-  // Handle power mode for PN532
-  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
-    CHIP_DATA(pnd)->power_mode = POWERDOWN;
+// Data exchanges which only read from the current target: the only ones whose answer time is learned
+static bool
+pn53x_adaptive_applies(const struct nfc_device *pnd, const nfc_target *pnt, const uint8_t *pbtTx, const size_t szTx)
+{
+  // InDataExchange, Tg, data: raw frames may be anything, chained ones are parts of a longer frame
+  if ((szTx < 3) || (pbtTx[0] != InDataExchange) || (pbtTx[1] & 0x40))
+    return false;
+  // MIFARE Classic READ, not repeated because of the authentication but as fast as any other read
+  if ((pnt->nm.nmt == NMT_ISO14443A) && (pnt->nti.nai.btSak & 0x08) && (pbtTx[2] == 0x30))
+    return true;
+  // Writes wait for the EEPROM, ISO-DEP and DEP targets may ask for more time: they keep NP_TIMEOUT_COM
+  return pn53x_initiator_cmd_is_idempotent(pnd, pnt, pbtTx + 2, szTx - 2);
+}
+
+// Timings sampled from the current target, restarted when it isn't the one they were learned from
+static struct pn53x_adaptive_timing *
+pn53x_adaptive_timing_get(struct pn53x_data *data)
+{
+  struct pn53x_adaptive_timing *timing = &(data->adaptive[data->current_target->nm.nmt]);
+  const uint8_t *pbtUid;
+  const size_t szUid = MIN(pn53x_target_uid(data->current_target, &pbtUid), sizeof(timing->abtUid));
+  if ((timing->szUid != szUid) || (memcmp(timing->abtUid, pbtUid, szUid) != 0)) {
+    // Another target: learn again, from the configured timeout
+    memcpy(timing->abtUid, pbtUid, szUid);
+    timing->szUid = szUid;
+    timing->peak_us = 0;
+    timing->samples = 0;
+  }
+  return timing;
+}
+
+/*
+ * Pick the communication timeout of the next data exchange: the learned one
+ * for reads once the current target has been sampled enough, NP_TIMEOUT_COM
+ * for anything else. Returns whether the exchange is to be sampled.
+ */
+static bool
+pn53x_adaptive_select(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx)
+{
+  struct pn53x_data *data = CHIP_DATA(pnd);
+  if (!data->adaptive_timeouts)
+    return false;
+  data->ui8RetryTimeoutWanted = pn53x_int_to_timeout(data->timeout_communication);
+  if ((!data->current_target) || (data->current_target->nm.nmt >= PN53X_ADAPTIVE_MODULATION_TYPES) ||
+      (data->timeout_communication <= 0) || (!pn53x_adaptive_applies(pnd, data->current_target, pbtTx, szTx)))
+    return false;
+
+  const struct pn53x_adaptive_timing *timing = pn53x_adaptive_timing_get(data);
+  if (timing->samples >= PN53X_ADAPTIVE_MIN_SAMPLES)
+    data->ui8RetryTimeoutWanted = timing->ui8Timeout;
+  return true;
+}
+
+/*
+ * Learn from a read from the current target how long it takes to answer.
+ * Answer times are measured from the host, bus included: they are an upper
+ * bound of the RF answer time the chip timeout applies to.
+ */
+static void
+pn53x_adaptive_record(struct nfc_device *pnd, const int res)
+{
+  struct pn53x_data *data = CHIP_DATA(pnd);
+  struct pn53x_adaptive_timing *timing = pn53x_adaptive_timing_get(data);
+
+  if ((res == NFC_ETIMEOUT) || ((res == NFC_ERFTRANS) &&
+                                ((data->last_status_byte == ETIMEOUT) || (data->last_status_byte == ERFTIMEOUT)))) {
+    // No answer in time: restore the configured timeout before anything else is tried
+    if (timing->samples >= PN53X_ADAPTIVE_MIN_SAMPLES)
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Adaptive timeout missed an answer, restoring NP_TIMEOUT_COM");
+    timing->peak_us = 0;
+    timing->samples = 0;
+    data->ui8RetryTimeoutWanted = pn53x_int_to_timeout(data->timeout_communication);
+    return;
+  }
+  if ((res < 0) && (res != NFC_ERFTRANS))
+    return;
+
+  // Even an error status is an answer from the target
+  const uint64_t us = data->last_rx_end - data->last_tx_end;
+  const uint32_t sample = (us > UINT32_MAX) ? UINT32_MAX : (uint32_t) us;
+  timing->peak_us = MAX(sample, timing->peak_us - timing->peak_us / 16);
+  if (timing->samples < PN53X_ADAPTIVE_MIN_SAMPLES) {
+    timing->samples++;
+    if (timing->samples < PN53X_ADAPTIVE_MIN_SAMPLES)
+      return;
+  }
+  uint64_t ms = ((uint64_t) timing->peak_us * PN53X_ADAPTIVE_MARGIN + 999) / 1000;
+  ms = MAX(ms, PN53X_ADAPTIVE_FLOOR_MS);
+  ms = MIN(ms, (uint64_t) data->timeout_communication);
+  timing->ui8Timeout = pn53x_int_to_timeout((int) ms);
+}
+
+// Whether deferred register writes can go to the driver in one pn53x_io.transceive_batch() call with this command
+static bool
+pn53x_writeback_can_share(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx)
+{
+  if ((!PN53X_IO(pnd)->transceive_batch) || (szTx > PN53x_NORMAL_FRAME__DATA_MAX_LEN))
+    return false;
+  // PN532 power mode follows TgInitAsTarget, see pn53x_transceive_frame()
+  return pbtTx[0] != TgInitAsTarget;
+}
+
+// Send what has to reach the chip before a command: deferred register writes (unless bWriteback is false), parameters, SAM switch, learned timeout
+static int
+pn53x_transceive_prepare(struct nfc_device *pnd, const uint8_t ui8Command, const bool bWriteback)
+{
+  int res = 0;
+  if (bWriteback && CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0) {
+      return res;
+    }
+  }
+  if (CHIP_DATA(pnd)->parameters_pending) {
+    if ((res = pn53x_flush_parameters(pnd)) < 0) {
+      return res;
+    }
+  }
+
+  if (!pn53x_cmd_keeps_target_armed(ui8Command))
+    CHIP_DATA(pnd)->target_armed = false;
+
+  if (CHIP_DATA(pnd)->sam_session && (CHIP_DATA(pnd)->sam_mode == PSM_WIRED_CARD) && (!CHIP_DATA(pnd)->sam_busy) &&
+      pn53x_cmd_uses_antenna(ui8Command)) {
+    // Looking for cards again after SAM exchanges
+    if ((res = pn532_sam_leave(pnd)) < 0)
+      return res;
+  }
+
+  if (pn53x_cmd_uses_retry_timeout(ui8Command) && (CHIP_DATA(pnd)->ui8RetryTimeoutWanted != CHIP_DATA(pnd)->ui8RetryTimeout)) {
+    // Communication timeout learned (or restored) since the previous data exchange
+    if ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), CHIP_DATA(pnd)->ui8RetryTimeoutWanted)) < 0) {
+      return res;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+// pn53x_transceive() body, run inside the bus transaction if any
+static int
+pn53x_transceive_flush(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const uint8_t **ppbtView, int timeout)
+{
+  int res;
+  const bool bAdaptive = pn53x_cmd_uses_retry_timeout(pbtTx[0]) && pn53x_adaptive_select(pnd, pbtTx, szTx);
+  // Deferred register writes share the bus turnaround of this command when the driver can batch them
+  const bool bShareWriteback = (!ppbtView) && pn53x_writeback_can_share(pnd, pbtTx, szTx);
+  if ((res = pn53x_transceive_prepare(pnd, pbtTx[0], !bShareWriteback)) < 0)
+    return res;
+
+  NFC_TRACE2(transceive__start, pbtTx[0], szTx);
+  if (bShareWriteback && CHIP_DATA(pnd)->wb_trigged) {
+    struct pn53x_cmd_queue cq;
+    pn53x_cmd_queue_init(&cq);
+    pn53x_cmd_queue_append(&cq, pbtTx, szTx, pbtRx, szRxLen);
+    if ((res = pn53x_cmd_queue_run(pnd, &cq, timeout)) >= 0)
+      res = cq.cmds[0].res;
+  } else {
+    PNCMD_TRACE(pbtTx[0]);
+    timeout = pn53x_resolve_timeout(pnd, timeout);
+    res = pn53x_transceive_frame(pnd, pbtTx, szTx, pbtRx, szRxLen, ppbtView, timeout);
   }
+  NFC_TRACE3(transceive__done, pbtTx[0], CHIP_DATA(pnd)->last_status_byte, res);
+  if (bAdaptive)
+    pn53x_adaptive_record(pnd, res);
+  return res;
+}
 
-  if ((res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, timeout)) < 0) {
+int
+pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  int res;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
     return res;
   }
+  res = pn53x_transceive_flush(pnd, pbtTx, szTx, pbtRx, szRxLen, NULL, timeout);
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  return res;
+}
 
-  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) { // PN532 automatically wakeup on external RF field
-    CHIP_DATA(pnd)->power_mode = NORMAL; // When TgInitAsTarget reply that means an external RF have waken up the chip
+/**
+ * @brief Like pn53x_transceive() but the answer is not copied to a caller buffer
+ * @return Returns the answer length, otherwise returns libnfc's error code (negative value)
+ *
+ * @param ppbtRx pointer set to the answer (status byte first for data exchange commands), either in the driver buffer (see pn53x_io.receive_view) or in the chip data. It stays valid until next command.
+ */
+int
+pn53x_transceive_view(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const uint8_t **ppbtRx, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  int res;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  res = pn53x_transceive_flush(pnd, pbtTx, szTx, NULL, 0, ppbtRx, timeout);
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  return res;
+}
+
+// Command buffer with room for drivers framing in place, commands built there are sent without copy
+static uint8_t *
+pn53x_tx_buffer(struct nfc_device *pnd)
+{
+  return CHIP_DATA(pnd)->abtTxBuffer + PN53X_IO_HEADROOM;
+}
+
+/*
+ * Index of a register in the shadow register file, -1 if it can't be shadowed:
+ * registers updated by the chip itself (status, IRQ, FIFO, counters, ...)
+ * must always be read from the chip.
+ */
+static int
+pn53x_shadow_index(const uint16_t ui16RegisterAddress)
+{
+  switch (ui16RegisterAddress) {
+    case PN53X_REG_CIU_CRCResultMSB:
+    case PN53X_REG_CIU_CRCResultLSB:
+    case PN53X_REG_CIU_TCounterVal_hi:
+    case PN53X_REG_CIU_TCounterVal_lo:
+    case PN53X_REG_CIU_TestPinValue:
+    case PN53X_REG_CIU_TestBus:
+    case PN53X_REG_CIU_TestADC:
+    case PN53X_REG_CIU_RFlevelDet:
+    case PN53X_REG_CIU_Command:
+    case PN53X_REG_CIU_CommIrq:
+    case PN53X_REG_CIU_DivIrq:
+    case PN53X_REG_CIU_Error:
+    case PN53X_REG_CIU_Status1:
+    case PN53X_REG_CIU_Status2:
+    case PN53X_REG_CIU_FIFOData:
+    case PN53X_REG_CIU_FIFOLevel:
+    case PN53X_REG_CIU_Control:
+    case PN53X_REG_CIU_BitFraming:
+    case PN53X_REG_CIU_Coll:
+      return -1;
+    case PN53X_REG_Control_switch_rng:
+      return PN53X_CACHE_REGISTER_SIZE;
+    case PN53X_SFR_P3:
+      return PN53X_CACHE_REGISTER_SIZE + 1;
+    case PN53X_SFR_P3CFGA:
+      return PN53X_CACHE_REGISTER_SIZE + 2;
+    case PN53X_SFR_P3CFGB:
+      return PN53X_CACHE_REGISTER_SIZE + 3;
+    case PN53X_SFR_P7CFGA:
+      return PN53X_CACHE_REGISTER_SIZE + 4;
+    case PN53X_SFR_P7CFGB:
+      return PN53X_CACHE_REGISTER_SIZE + 5;
+    case PN53X_SFR_P7:
+      return PN53X_CACHE_REGISTER_SIZE + 6;
+  }
+  if ((ui16RegisterAddress >= PN53X_CACHE_REGISTER_MIN_ADDRESS) && (ui16RegisterAddress <= PN53X_CACHE_REGISTER_MAX_ADDRESS))
+    return ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
+  return -1;
+}
+
+static bool
+pn53x_shadow_get(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, uint8_t *ui8Value)
+{
+  const int n = pn53x_shadow_index(ui16RegisterAddress);
+  if ((n < 0) || (!CHIP_DATA(pnd)->shadow_valid[n]))
+    return false;
+  *ui8Value = CHIP_DATA(pnd)->shadow_data[n];
+  return true;
+}
+
+static void
+pn53x_shadow_set(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, const uint8_t ui8Value)
+{
+  const int n = pn53x_shadow_index(ui16RegisterAddress);
+  if (n >= 0) {
+    CHIP_DATA(pnd)->shadow_data[n] = ui8Value;
+    CHIP_DATA(pnd)->shadow_valid[n] = true;
+  }
+}
+
+/**
+ * @brief Forget shadowed registers values, they will be read again from the chip
+ *
+ * Called before each command letting the firmware change registers, and
+ * after chip reset or release.
+ */
+void
+pn53x_shadow_invalidate(struct nfc_device *pnd)
+{
+  memset(CHIP_DATA(pnd)->shadow_valid, 0x00, sizeof(CHIP_DATA(pnd)->shadow_valid));
+}
+
+// Commands which keep CIU and SFR configuration as libnfc left it
+// Note: InCommunicateThru is not one of them, eg. SCL3711 resets timer settings
+static bool
+pn53x_cmd_preserves_registers(const uint8_t ui8Command)
+{
+  switch (ui8Command) {
+    case ReadRegister:
+    case WriteRegister:
+    case SetParameters:
+    case GetFirmwareVersion:
+    case GetGeneralStatus:
+      return true;
   }
+  return false;
+}
+
+static void
+pn53x_stats_latency(nfc_latency_histogram *histogram, const uint64_t start, const uint64_t end)
+{
+  const uint32_t us = ((end - start) > UINT32_MAX) ? UINT32_MAX : (uint32_t)(end - start);
+  int bucket = 0;
+  while ((bucket < NFC_LATENCY_BUCKETS - 1) && (us >> (bucket + 1)))
+    bucket++;
+  histogram->buckets[bucket]++;
+  if ((!histogram->count) || (us < histogram->min_us))
+    histogram->min_us = us;
+  if (us > histogram->max_us)
+    histogram->max_us = us;
+  histogram->count++;
+  histogram->total_us += us;
+}
+
+// Account the answer just sent to the initiator, first_tx_start being when its first command went to the chip
+static void
+pn53x_target_stats(struct nfc_device *pnd, const uint64_t first_tx_start)
+{
+  struct pn53x_data *data = CHIP_DATA(pnd);
+  if (!data->target_rx_time)
+    return;
+  pn53x_stats_latency(&(pnd->stats.target_turnaround), data->target_rx_time, first_tx_start);
+  pn53x_stats_latency(&(pnd->stats.target_bus_latency), data->last_tx_start, data->last_tx_end);
+  pn53x_stats_latency(&(pnd->stats.target_chip_latency), data->last_tx_end, data->last_rx_end);
+  data->target_rx_time = 0;
+}
 
+// Keep the status byte of an answer to pbtTx, returns true when the answer is chained (MI)
+static bool
+pn53x_answer_status(struct nfc_device *pnd, const uint8_t *pbtTx, const uint8_t *pbtRx)
+{
   switch (pbtTx[0]) {
     case PowerDown:
     case InDataExchange:
@@ -221,9 +658,8 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     case TgSetMetaData:
       if (pbtRx[0] & 0x80) { abort(); } // NAD detected
 //      if (pbtRx[0] & 0x40) { abort(); } // MI detected
-      mi = pbtRx[0] & 0x40;
       CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
-      break;
+      return pbtRx[0] & 0x40;
     case Diagnose:
       if (pbtTx[1] == 0x06) { // Diagnose: Card presence detection
         CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
@@ -253,33 +689,17 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     default:
       CHIP_DATA(pnd)->last_status_byte = 0;
   }
+  return false;
+}
 
-  while (mi) {
-    int res2;
-    uint8_t  abtRx2[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    // Send empty command to card
-    if ((res2 = CHIP_DATA(pnd)->io->send(pnd, pbtTx, 2, timeout)) < 0) {
-      return res2;
-    }
-    if ((res2 = CHIP_DATA(pnd)->io->receive(pnd, abtRx2, sizeof(abtRx2), timeout)) < 0) {
-      return res2;
-    }
-    mi = abtRx2[0] & 0x40;
-    if ((size_t)(res + res2 - 1) > szRx) {
-      CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
-      break;
-    }
-    memcpy(pbtRx + res, abtRx2 + 1, res2 - 1);
-    // Copy last status byte
-    pbtRx[0] = abtRx2[0];
-    res += res2 - 1;
-  }
-
-  szRx = (size_t) res;
-
+// Turn the status byte of the last answer into libnfc's error code, szRx when the chip reported no error
+static int
+pn53x_status_error(struct nfc_device *pnd, const int szRx)
+{
+  int res;
   switch (CHIP_DATA(pnd)->last_status_byte) {
     case 0:
-      res = (int)szRx;
+      res = szRx;
       break;
     case ETIMEOUT:
     case ECRC:
@@ -334,134 +754,547 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   return res;
 }
 
-int
-pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Parameter, const bool bEnable)
+/*
+ * Send one command frame and collect its answer (including MI chaining).
+ * Timeout must already be resolved and the writeback cache must already have
+ * been flushed by the caller. It is the budget of the whole exchange: every
+ * driver call gets the time left before the deadline it sets.
+ * When ppbtView is set, pbtRx is ignored and *ppbtView points to the answer.
+ */
+static int
+pn53x_transceive_frame(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, const uint8_t **ppbtView, int timeout)
 {
-  uint8_t ui8Value = (bEnable) ? (CHIP_DATA(pnd)->ui8Parameters | ui8Parameter) : (CHIP_DATA(pnd)->ui8Parameters & ~(ui8Parameter));
-  if (ui8Value != CHIP_DATA(pnd)->ui8Parameters) {
-    return pn53x_SetParameters(pnd, ui8Value);
-  }
-  return NFC_SUCCESS;
-}
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  bool mi = false;
+  int res = 0;
+  uint64_t t0, t1, t2;
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
 
-int
-pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits)
-{
-  // Test if we need to update the transmission bits register setting
-  if (CHIP_DATA(pnd)->ui8TxBits != ui8Bits) {
-    int res = 0;
-    // Set the amount of transmission bits in the PN53X chip register
-    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_TX_LAST_BITS, ui8Bits)) < 0)
-      return res;
+  SCRATCH_INIT(abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtFrameRx);
+  size_t  szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
 
-    // Store the new setting
-    CHIP_DATA(pnd)->ui8TxBits = ui8Bits;
+  // Check if receiving buffers are available, if not, replace them
+  if (ppbtView) {
+    pbtRx = CHIP_DATA(pnd)->abtRxBuffer;
+    szRx = sizeof(CHIP_DATA(pnd)->abtRxBuffer);
+  } else if (szRxLen == 0 || !pbtRx) {
+    pbtRx = abtRx;
+  } else {
+    szRx = szRxLen;
   }
-  return NFC_SUCCESS;
-}
-
-int
-pn53x_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar,
-                 uint8_t *pbtFrame)
-{
-  uint8_t  btFrame;
-  uint8_t  btData;
-  uint32_t uiBitPos;
-  uint32_t uiDataPos = 0;
-  size_t  szBitsLeft = szTxBits;
-  size_t szFrameBits = 0;
-
-  // Make sure we should frame at least something
-  if (szBitsLeft == 0)
-    return NFC_ECHIP;
 
-  // Handle a short response (1byte) as a special case
-  if (szBitsLeft < 9) {
-    *pbtFrame = *pbtTx;
-    szFrameBits = szTxBits;
-    return szFrameBits;
+  // Drivers framing in place need room around the command: stage it unless it was built in the chip buffer
+  SCRATCH_INIT(abtTxRoom, PN53X_IO_HEADROOM + PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53X_IO_TAILROOM, CHIP_DATA(pnd)->workspace.abtFrameTx);
+  const uint8_t *pbtSend = pbtTx;
+  if (io->send_in_place && (pbtTx != pn53x_tx_buffer(pnd))) {
+    if (szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN)
+      return NFC_EINVARG;
+    memcpy(abtTxRoom + PN53X_IO_HEADROOM, pbtTx, szTx);
+    pbtSend = abtTxRoom + PN53X_IO_HEADROOM;
   }
-  // We start by calculating the frame length in bits
-  szFrameBits = szTxBits + (szTxBits / 8);
-
-  // Parse the data bytes and add the parity bits
-  // This is really a sensitive process, mirror the frame bytes and append parity bits
-  // buffer = mirror(frame-byte) + parity + mirror(frame-byte) + parity + ...
-  // split "buffer" up in segments of 8 bits again and mirror them
-  // air-bytes = mirror(buffer-byte) + mirror(buffer-byte) + mirror(buffer-byte) + ..
-  while (true) {
-    // Reset the temporary frame byte;
-    btFrame = 0;
-
-    for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-      // Copy as much data that fits in the frame byte
-      btData = mirror(pbtTx[uiDataPos]);
-      btFrame |= (btData >> uiBitPos);
-      // Save this frame byte
-      *pbtFrame = mirror(btFrame);
-      // Set the remaining bits of the date in the new frame byte and append the parity bit
-      btFrame = (btData << (8 - uiBitPos));
-      btFrame |= ((pbtTxPar[uiDataPos] & 0x01) << (7 - uiBitPos));
-      // Backup the frame bits we have so far
-      pbtFrame++;
-      *pbtFrame = mirror(btFrame);
-      // Increase the data (without parity bit) position
-      uiDataPos++;
-      // Test if we are done
-      if (szBitsLeft < 9)
-        return szFrameBits;
-      szBitsLeft -= 8;
-    }
-    // Every 8 data bytes we lose one frame byte to the parities
-    pbtFrame++;
+
+  if (!pn53x_cmd_preserves_registers(pbtTx[0])) {
+    // Firmware reconfigures the CIU on its own while running this command
+    pn53x_shadow_invalidate(pnd);
   }
-}
 
+  // Call the send/receice callback functions of the current driver
+  t0 = nfc_clock_us();
+  if ((res = io->send(pnd, pbtSend, szTx, nfc_deadline_timeout(deadline))) < 0) {
+    if (res == NFC_ETIMEOUT)
+      pnd->stats.timeouts++;
+    return res;
+  }
+  t1 = nfc_clock_us();
+  pnd->stats.commands[pbtTx[0]]++;
+  pnd->stats.bytes_tx += szTx;
+  pn53x_stats_latency(&(pnd->stats.bus_latency), t0, t1);
+  CAPTURE_FRAME(pnd, NFC_CAPTURE_TX, pbtTx[0], 0, pbtTx, szTx);
+
+  // Command is sent, we store the command
+  CHIP_DATA(pnd)->last_command = pbtTx[0];
+
+  // Handle power mode for PN532
+  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
+    CHIP_DATA(pnd)->power_mode = POWERDOWN;
+  }
+
+  if ((timeout = nfc_deadline_timeout(deadline)) < 0) {
+    res = timeout;
+  } else if (ppbtView && io->receive_view) {
+    // Parse the answer where the driver received it
+    const uint8_t *pbtView;
+    res = io->receive_view(pnd, &pbtView, timeout);
+    pbtRx = (uint8_t *) pbtView;
+  } else {
+    res = io->receive(pnd, pbtRx, szRx, timeout);
+  }
+  if (res < 0) {
+    if (res == NFC_ETIMEOUT)
+      pnd->stats.timeouts++;
+    return res;
+  }
+  t2 = nfc_clock_us();
+  pnd->stats.bytes_rx += res;
+  pn53x_stats_latency(&(pnd->stats.chip_latency), t1, t2);
+  CHIP_DATA(pnd)->last_tx_start = t0;
+  CHIP_DATA(pnd)->last_tx_end = t1;
+
+  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) { // PN532 automatically wakeup on external RF field
+    CHIP_DATA(pnd)->power_mode = NORMAL; // When TgInitAsTarget reply that means an external RF have waken up the chip
+  }
+
+  mi = pn53x_answer_status(pnd, pbtTx, pbtRx);
+  CAPTURE_FRAME(pnd, NFC_CAPTURE_RX, pbtTx[0], CHIP_DATA(pnd)->last_status_byte, pbtRx, res);
+
+  if (mi && ppbtView && (pbtRx != CHIP_DATA(pnd)->abtRxBuffer)) {
+    // Chained answers are gathered in the chip buffer, the driver one is reused by next receive
+    memcpy(CHIP_DATA(pnd)->abtRxBuffer, pbtRx, res);
+    pbtRx = CHIP_DATA(pnd)->abtRxBuffer;
+  }
+
+  // Continuations are asked with the bare command: InDataExchange keeps its target number
+  const size_t szContinuation = (pbtTx[0] == InDataExchange) ? 2 : 1;
+  while (mi) {
+    int res2;
+    SCRATCH_INIT(abtRx2, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtFrameRx2);
+    // Send empty command to card
+    t0 = nfc_clock_us();
+    if (((res2 = nfc_deadline_timeout(deadline)) < 0) || ((res2 = io->send(pnd, pbtSend, szContinuation, res2)) < 0)) {
+      if (res2 == NFC_ETIMEOUT)
+        pnd->stats.timeouts++;
+      return res2;
+    }
+    t1 = nfc_clock_us();
+    pnd->stats.mi_continuations++;
+    pnd->stats.bytes_tx += szContinuation;
+    pn53x_stats_latency(&(pnd->stats.bus_latency), t0, t1);
+    CAPTURE_FRAME(pnd, NFC_CAPTURE_TX, pbtTx[0], 0, pbtTx, szContinuation);
+    if (szRx - res + 1 >= PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+      // Enough room left: receive the continuation straight after the data
+      // already chained, its status byte temporarily overwriting the last one
+      uint8_t *pbtChunk = pbtRx + res - 1;
+      const uint8_t btLast = *pbtChunk;
+      if (((res2 = nfc_deadline_timeout(deadline)) < 0) || ((res2 = io->receive(pnd, pbtChunk, szRx - res + 1, res2)) < 0)) {
+        *pbtChunk = btLast;
+        if (res2 == NFC_ETIMEOUT)
+          pnd->stats.timeouts++;
+        return res2;
+      }
+      t2 = nfc_clock_us();
+      pnd->stats.bytes_rx += res2;
+      pn53x_stats_latency(&(pnd->stats.chip_latency), t1, t2);
+      CAPTURE_FRAME(pnd, NFC_CAPTURE_RX, pbtTx[0], *pbtChunk & 0x3f, pbtChunk, res2);
+      NFC_TRACE3(mi__continuation, pbtTx[0], res2, res);
+      mi = *pbtChunk & 0x40;
+      // Copy last status byte
+      pbtRx[0] = *pbtChunk;
+      *pbtChunk = btLast;
+      res += res2 - 1;
+      continue;
+    }
+    if (((res2 = nfc_deadline_timeout(deadline)) < 0) || ((res2 = io->receive(pnd, abtRx2, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, res2)) < 0)) {
+      if (res2 == NFC_ETIMEOUT)
+        pnd->stats.timeouts++;
+      return res2;
+    }
+    t2 = nfc_clock_us();
+    pnd->stats.bytes_rx += res2;
+    pn53x_stats_latency(&(pnd->stats.chip_latency), t1, t2);
+    CAPTURE_FRAME(pnd, NFC_CAPTURE_RX, pbtTx[0], abtRx2[0] & 0x3f, abtRx2, res2);
+    NFC_TRACE3(mi__continuation, pbtTx[0], res2, res);
+    mi = abtRx2[0] & 0x40;
+    if ((size_t)(res + res2 - 1) > szRx) {
+      CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
+      break;
+    }
+    memcpy(pbtRx + res, abtRx2 + 1, res2 - 1);
+    // Copy last status byte
+    pbtRx[0] = abtRx2[0];
+    res += res2 - 1;
+  }
+
+  CHIP_DATA(pnd)->last_rx_end = t2;
+  szRx = (size_t) res;
+  if (ppbtView)
+    *ppbtView = pbtRx;
+
+  return pn53x_status_error(pnd, (int) szRx);
+}
+
+void
+pn53x_cmd_queue_init(struct pn53x_cmd_queue *pcq)
+{
+  pcq->szCmds = 0;
+}
+
+/**
+ * @brief Append a command to a PN53x command queue
+ * @return Returns index of the queued command on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pcq command queue
+ * @param pbtTx command frame (first byte is the command code), it have to remain valid until queue is flushed
+ * @param szTx length of \a pbtTx
+ * @param pbtRx optional buffer to receive the answer
+ * @param szRxLen size of \a pbtRx
+ */
 int
-pn53x_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar)
+pn53x_cmd_queue_append(struct pn53x_cmd_queue *pcq, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen)
 {
-  uint8_t  btFrame;
-  uint8_t  btData;
-  uint8_t uiBitPos;
-  uint32_t uiDataPos = 0;
-  uint8_t *pbtFramePos = (uint8_t *) pbtFrame;
-  size_t  szBitsLeft = szFrameBits;
-  size_t szRxBits = 0;
+  if ((!pbtTx) || (szTx == 0)) {
+    return NFC_EINVARG;
+  }
+  if (pcq->szCmds >= PN53X_CMD_QUEUE_MAX_LEN) {
+    return NFC_EOVFLOW;
+  }
+  struct pn53x_cmd *pc = &(pcq->cmds[pcq->szCmds]);
+  pc->pbtTx = pbtTx;
+  pc->szTx = szTx;
+  pc->pbtRx = pbtRx;
+  pc->szRxLen = szRxLen;
+  pc->res = NFC_EOPABORTED;
+  pc->bRepeatable = false;
+  return (int)(pcq->szCmds++);
+}
+
+/*
+ * A queued WriteRegister can be deferred (and merged with writeback cache and
+ * other queued register writes) when its caller does not want the answer.
+ */
+static bool
+pn53x_cmd_is_deferrable_write(const struct pn53x_cmd *pc)
+{
+  return (pc->pbtTx[0] == WriteRegister) && (pc->szTx > 1) && (((pc->szTx - 1) % 3) == 0) && ((!pc->pbtRx) || (pc->szRxLen == 0));
+}
+
+/**
+ * @brief Whether a command answered in a pn53x_io.transceive_batch() call stops the batch
+ * @return Returns \c true on error, or when a data exchange answer has no status byte or a failure one
+ *
+ * @param pc batched command, its \a res field filled by the driver
+ *
+ * @note Some commands (ie. WriteRegister on PN531/PN532) are answered without any data.
+ */
+bool
+pn53x_cmd_failed(const struct pn53x_cmd *pc)
+{
+  if (pc->res < 0)
+    return true;
+  return (pc->pbtTx[0] == InDataExchange) && ((pc->res == 0) || (pc->pbtRx[0] & 0x3f));
+}
+
+/*
+ * Send the writeback cache flush (with extra register writes) and the queued
+ * command pc in one pn53x_io.transceive_batch() call: the command only runs
+ * once the registers are written, without waiting here for that answer.
+ * Returns the writeback result, the command one is stored in pc->res.
+ */
+static int
+pn53x_writeback_transceive_batch(struct nfc_device *pnd, const uint8_t *pbtExtraWrites, const size_t szExtraWrites, struct pn53x_cmd *pc, int timeout)
+{
+  SCRATCH_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtRegisterCmd);
+  SCRATCH_INIT(abtWriteRegisterRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtRegisterRes);
+  SCRATCH_INIT(abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtFrameRx);
+  struct pn53x_cmd cmds[2];
+  int res;
+
+  if ((res = pn53x_writeback_build(pnd, pbtExtraWrites, szExtraWrites, abtWriteRegisterCmd)) < 0) {
+    return res;
+  }
+  PNCMD_TRACE(pc->pbtTx[0]);
+  if (res == 1) {
+    // Shadow registers showed there is nothing to write
+    pc->res = pn53x_transceive_frame(pnd, pc->pbtTx, pc->szTx, pc->pbtRx, pc->szRxLen, NULL, timeout);
+    return NFC_SUCCESS;
+  }
+  cmds[0].pbtTx = abtWriteRegisterCmd;
+  cmds[0].szTx = (size_t) res;
+  cmds[0].pbtRx = abtWriteRegisterRes;
+  cmds[0].szRxLen = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  cmds[0].res = NFC_EOPABORTED;
+  cmds[0].bRepeatable = false;
+  cmds[1] = *pc;
+  if ((!pc->pbtRx) || (pc->szRxLen == 0)) {
+    cmds[1].pbtRx = abtRx;
+    cmds[1].szRxLen = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  }
+  // It must not run when registers could not be written
+  cmds[1].bRepeatable = false;
+
+  const uint64_t t0 = nfc_clock_us();
+  if ((res = PN53X_IO(pnd)->transceive_batch(pnd, cmds, 2, timeout)) < 0) {
+    if (res == NFC_ETIMEOUT)
+      pnd->stats.timeouts++;
+    pnd->last_error = res;
+    return res;
+  }
+  const size_t szRun = (size_t) res;
+  const uint64_t t1 = nfc_clock_us();
+  CHIP_DATA(pnd)->last_command = pc->pbtTx[0];
+  CHIP_DATA(pnd)->last_tx_start = t0;
+  CHIP_DATA(pnd)->last_tx_end = t0;
+  CHIP_DATA(pnd)->last_rx_end = t1;
+  pn53x_stats_latency(&(pnd->stats.chip_latency), t0, t1);
+
+  for (size_t i = 0; i < 2; i++) {
+    if ((i == 1) && (!pn53x_cmd_preserves_registers(pc->pbtTx[0]))) {
+      // Firmware reconfigures the CIU on its own while running this command
+      pn53x_shadow_invalidate(pnd);
+    }
+    if (i >= szRun) {
+      // The link stopped without reporting a failure
+      res = NFC_EIO;
+    } else {
+      pnd->stats.commands[cmds[i].pbtTx[0]]++;
+      pnd->stats.bytes_tx += cmds[i].szTx;
+      CAPTURE_FRAME(pnd, NFC_CAPTURE_TX, cmds[i].pbtTx[0], 0, cmds[i].pbtTx, cmds[i].szTx);
+      if ((res = cmds[i].res) >= 0) {
+        pnd->stats.bytes_rx += res;
+        // Answers chained by the target were gathered on the other side of the link
+        pn53x_answer_status(pnd, cmds[i].pbtTx, cmds[i].pbtRx);
+        CAPTURE_FRAME(pnd, NFC_CAPTURE_RX, cmds[i].pbtTx[0], CHIP_DATA(pnd)->last_status_byte, cmds[i].pbtRx, res);
+        res = pn53x_status_error(pnd, res);
+      }
+    }
+    if (i == 1) {
+      pc->res = res;
+    } else if (res < 0) {
+      // Registers were not written, the command did not run
+      return res;
+    } else {
+      pn53x_writeback_applied(pnd, cmds[0].pbtTx, cmds[0].szTx);
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Execute all commands of a PN53x command queue, in order
+ * @return Returns count of successfully executed commands, otherwise returns libnfc's error code (negative value) of the first failing command
+ *
+ * @param pnd struct nfc_device struct pointer that represent currently used device
+ * @param pcq command queue, each command result is stored in its \a res field and queue is emptied
+ * @param timeout timeout applied to each command (-1 means default command timeout)
+ *
+ * @note PN53x chips process only one command at once so commands are still
+ * sent one after the other, but the timeout is resolved and writeback cache is
+ * handled once for the whole batch. In addition, queued WriteRegister commands
+ * (without requested answer) are merged with the writeback cache in a single
+ * WriteRegister frame, sent just before the next command which needs it. When
+ * the driver provides pn53x_io.transceive_batch, that frame and the command go
+ * to the driver together, sharing one bus turnaround.
+ */
+int
+pn53x_cmd_queue_flush(struct nfc_device *pnd, struct pn53x_cmd_queue *pcq, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  int res;
+  // The whole batch is one bus transaction
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  res = pn53x_cmd_queue_run(pnd, pcq, timeout);
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  return res;
+}
+
+static int
+pn53x_cmd_queue_run(struct nfc_device *pnd, struct pn53x_cmd_queue *pcq, int timeout)
+{
+  // WriteRegister triplets for registers that are not in the writeback cache
+  // window; bounded so that cache content + triplets still fit in a normal frame
+  BUFFER_INIT(abtWrites, PN53x_NORMAL_FRAME__DATA_MAX_LEN - 1 - (3 * PN53X_CACHE_REGISTER_SIZE));
+  // First queued write which is not flushed yet
+  size_t szPending = pcq->szCmds;
+  size_t i;
+  int res = 0;
+
+  timeout = pn53x_resolve_timeout(pnd, timeout);
+
+  for (i = 0; i < pcq->szCmds; i++) {
+    struct pn53x_cmd *pc = &(pcq->cmds[i]);
+    if (pn53x_cmd_is_deferrable_write(pc)) {
+      if (szPending == pcq->szCmds) {
+        szPending = i;
+      }
+      for (size_t n = 1; n < pc->szTx; n += 3) {
+        const uint16_t ui16RegisterAddress = (pc->pbtTx[n] << 8) | pc->pbtTx[n + 1];
+        if ((ui16RegisterAddress >= PN53X_CACHE_REGISTER_MIN_ADDRESS) && (ui16RegisterAddress <= PN53X_CACHE_REGISTER_MAX_ADDRESS)) {
+          pn53x_write_register(pnd, ui16RegisterAddress, 0xff, pc->pbtTx[n + 2]);
+          continue;
+        }
+        if (BUFFER_SIZE(abtWrites) + 3 > sizeof(abtWrites)) {
+          if ((res = pn53x_writeback_register_ext(pnd, abtWrites, BUFFER_SIZE(abtWrites))) < 0) {
+            break;
+          }
+          BUFFER_CLEAR(abtWrites);
+        }
+        PNREG_TRACE(ui16RegisterAddress);
+        BUFFER_APPEND_BYTES(abtWrites, pc->pbtTx + n, 3);
+      }
+      if (res < 0) {
+        i++;
+        break;
+      }
+      continue;
+    }
+    if (CHIP_DATA(pnd)->parameters_pending) {
+      if ((res = pn53x_flush_parameters(pnd)) < 0) {
+        break;
+      }
+    }
+    bool bSent = false;
+    if ((CHIP_DATA(pnd)->wb_trigged) || (BUFFER_SIZE(abtWrites))) {
+      if (pn53x_writeback_can_share(pnd, pc->pbtTx, pc->szTx)) {
+        res = pn53x_writeback_transceive_batch(pnd, abtWrites, BUFFER_SIZE(abtWrites), pc, timeout);
+        bSent = true;
+      } else {
+        res = pn53x_writeback_register_ext(pnd, abtWrites, BUFFER_SIZE(abtWrites));
+      }
+      if (res < 0) {
+        break;
+      }
+      BUFFER_CLEAR(abtWrites);
+    }
+    // Register writes queued before this command are now applied
+    for (; szPending < i; szPending++) {
+      pcq->cmds[szPending].res = NFC_SUCCESS;
+    }
+    szPending = pcq->szCmds;
+    if (!bSent) {
+      PNCMD_TRACE(pc->pbtTx[0]);
+      pc->res = pn53x_transceive_frame(pnd, pc->pbtTx, pc->szTx, pc->pbtRx, pc->szRxLen, NULL, timeout);
+    }
+    if ((res = pc->res) < 0) {
+      break;
+    }
+  }
+  if ((res >= 0) && ((CHIP_DATA(pnd)->wb_trigged) || (BUFFER_SIZE(abtWrites)))) {
+    // Trailing register writes, maybe only the writeback cache
+    res = pn53x_writeback_register_ext(pnd, BUFFER_SIZE(abtWrites) ? abtWrites : NULL, BUFFER_SIZE(abtWrites));
+  }
+  // Deferred writes share the result of the writeback which carried them
+  for (; szPending < i; szPending++) {
+    if (pn53x_cmd_is_deferrable_write(&(pcq->cmds[szPending]))) {
+      pcq->cmds[szPending].res = (res < 0) ? res : NFC_SUCCESS;
+    }
+  }
+  pcq->szCmds = 0;
+  return (res < 0) ? res : (int) i;
+}
+
+int
+pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Parameter, const bool bEnable)
+{
+  uint8_t ui8Value = (bEnable) ? (CHIP_DATA(pnd)->ui8Parameters | ui8Parameter) : (CHIP_DATA(pnd)->ui8Parameters & ~(ui8Parameter));
+  if (ui8Value != CHIP_DATA(pnd)->ui8Parameters) {
+    CHIP_DATA(pnd)->target_armed = false;
+    if (CHIP_DATA(pnd)->properties_transaction) {
+      // Sent along with register writes, just before next command
+      CHIP_DATA(pnd)->ui8Parameters = ui8Value;
+      CHIP_DATA(pnd)->parameters_pending = true;
+      return NFC_SUCCESS;
+    }
+    return pn53x_SetParameters(pnd, ui8Value);
+  }
+  return NFC_SUCCESS;
+}
+
+// Send SetParameters deferred by a properties transaction
+static int
+pn53x_flush_parameters(struct nfc_device *pnd)
+{
+  CHIP_DATA(pnd)->parameters_pending = false;
+  return pn53x_SetParameters(pnd, CHIP_DATA(pnd)->ui8Parameters);
+}
+
+int
+pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits)
+{
+  // Test if we need to update the transmission bits register setting
+  if (CHIP_DATA(pnd)->ui8TxBits != ui8Bits) {
+    int res = 0;
+    // Set the amount of transmission bits in the PN53X chip register
+    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_TX_LAST_BITS, ui8Bits)) < 0)
+      return res;
+
+    // Store the new setting
+    CHIP_DATA(pnd)->ui8TxBits = ui8Bits;
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * On air, ISO14443-A sends every byte least significant bit first followed by
+ * its parity bit: frame bit 9*n+k is bit k of byte n, frame bit 9*n+8 is its
+ * parity. Frames are packed LSB first too, so wrapping is nothing more than
+ * pushing 9 bits per byte into a 64-bit accumulator and flushing whole bytes.
+ */
+int
+pn53x_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar,
+                 uint8_t *pbtFrame)
+{
+  // Make sure we should frame at least something
+  if (szTxBits == 0)
+    return NFC_ECHIP;
+
+  // Handle a short response (1byte) as a special case
+  if (szTxBits < 9) {
+    *pbtFrame = *pbtTx;
+    return szTxBits;
+  }
+
+  // Every byte is sent whole with its parity, even the last partial one: the chip stops after szFrameBits
+  const size_t szBytes = (szTxBits + 7) / 8;
+  uint64_t ui64Bits = 0;
+  unsigned int uiBits = 0;
+  for (size_t szPos = 0; szPos < szBytes; szPos++) {
+    ui64Bits |= (uint64_t)(pbtTx[szPos] | ((pbtTxPar[szPos] & 0x01) << 8)) << uiBits;
+    uiBits += 9;
+    // At most 7 + 9 bits are pending, flush whole bytes
+    while (uiBits >= 8) {
+      *pbtFrame++ = (uint8_t) ui64Bits;
+      ui64Bits >>= 8;
+      uiBits -= 8;
+    }
+  }
+  if (uiBits)
+    *pbtFrame = (uint8_t) ui64Bits;
+  return szTxBits + (szTxBits / 8);
+}
 
+int
+pn53x_unwrap_frame(const uint8_t *pbtFrame, const size_t szFrameBits, uint8_t *pbtRx, uint8_t *pbtRxPar)
+{
   // Make sure we should frame at least something
-  if (szBitsLeft == 0)
+  if (szFrameBits == 0)
     return NFC_ECHIP;
 
   // Handle a short response (1byte) as a special case
-  if (szBitsLeft < 9) {
+  if (szFrameBits < 9) {
     *pbtRx = *pbtFrame;
-    szRxBits = szFrameBits;
-    return szRxBits;
+    return szFrameBits;
   }
-  // Calculate the data length in bits
-  szRxBits = szFrameBits - (szFrameBits / 9);
 
-  // Parse the frame bytes, remove the parity bits and store them in the parity array
-  // This process is the reverse of WrapFrame(), look there for more info
-  while (true) {
-    for (uiBitPos = 0; uiBitPos < 8; uiBitPos++) {
-      btFrame = mirror(pbtFramePos[uiDataPos]);
-      btData = (btFrame << uiBitPos);
-      btFrame = mirror(pbtFramePos[uiDataPos + 1]);
-      btData |= (btFrame >> (8 - uiBitPos));
-      pbtRx[uiDataPos] = mirror(btData);
-      if (pbtRxPar != NULL)
-        pbtRxPar[uiDataPos] = ((btFrame >> (7 - uiBitPos)) & 0x01);
-      // Increase the data (without parity bit) position
-      uiDataPos++;
-      // Test if we are done
-      if (szBitsLeft < 9)
-        return szRxBits;
-      szBitsLeft -= 9;
+  // This process is the reverse of pn53x_wrap_frame(), look there for more info
+  const size_t szBytes = (szFrameBits + 8) / 9;
+  uint64_t ui64Bits = 0;
+  unsigned int uiBits = 0;
+  for (size_t szPos = 0; szPos < szBytes; szPos++) {
+    // Only read the frame bytes holding this data byte and its parity
+    while (uiBits < 9) {
+      ui64Bits |= (uint64_t)(*pbtFrame++) << uiBits;
+      uiBits += 8;
     }
-    // Every 8 data bytes we lose one frame byte to the parities
-    pbtFramePos++;
+    pbtRx[szPos] = (uint8_t) ui64Bits;
+    if (pbtRxPar != NULL)
+      pbtRxPar[szPos] = (ui64Bits >> 8) & 0x01;
+    ui64Bits >>= 9;
+    uiBits -= 9;
   }
+  return szFrameBits - (szFrameBits / 9);
 }
 
 int
@@ -624,11 +1457,21 @@ pn53x_ReadRegister(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t
   } else {
     *ui8Value = abtRegValue[0];
   }
+  pn53x_shadow_set(pnd, ui16RegisterAddress, *ui8Value);
   return NFC_SUCCESS;
 }
 
 int pn53x_read_register(struct nfc_device *pnd, uint16_t ui16RegisterAddress, uint8_t *ui8Value)
 {
+  int res = 0;
+  // Pending writes must reach the chip (and the shadow) first
+  if (CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0) {
+      return res;
+    }
+  }
+  if (pn53x_shadow_get(pnd, ui16RegisterAddress, ui8Value))
+    return NFC_SUCCESS;
   return pn53x_ReadRegister(pnd, ui16RegisterAddress, ui8Value);
 }
 
@@ -636,25 +1479,31 @@ static int
 pn53x_WriteRegister(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, const uint8_t ui8Value)
 {
   uint8_t  abtCmd[] = { WriteRegister, ui16RegisterAddress >> 8, ui16RegisterAddress & 0xff, ui8Value };
+  int res = 0;
   PNREG_TRACE(ui16RegisterAddress);
-  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0) {
+    return res;
+  }
+  pn53x_shadow_set(pnd, ui16RegisterAddress, ui8Value);
+  return res;
 }
 
 int
 pn53x_write_register(struct nfc_device *pnd, const uint16_t ui16RegisterAddress, const uint8_t ui8SymbolMask, const uint8_t ui8Value)
 {
+  CHIP_DATA(pnd)->target_armed = false;
   if ((ui16RegisterAddress < PN53X_CACHE_REGISTER_MIN_ADDRESS) || (ui16RegisterAddress > PN53X_CACHE_REGISTER_MAX_ADDRESS)) {
     // Direct write
+    uint8_t ui8CurrentValue;
     if (ui8SymbolMask != 0xff) {
       int res = 0;
-      uint8_t ui8CurrentValue;
       if ((res = pn53x_read_register(pnd, ui16RegisterAddress, &ui8CurrentValue)) < 0)
         return res;
       uint8_t ui8NewValue = ((ui8Value & ui8SymbolMask) | (ui8CurrentValue & (~ui8SymbolMask)));
       if (ui8NewValue != ui8CurrentValue) {
         return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8NewValue);
       }
-    } else {
+    } else if ((!pn53x_shadow_get(pnd, ui16RegisterAddress, &ui8CurrentValue)) || (ui8CurrentValue != ui8Value)) {
       return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8Value);
     }
   } else {
@@ -669,27 +1518,50 @@ pn53x_write_register(struct nfc_device *pnd, const uint16_t ui16RegisterAddress,
 
 int
 pn53x_writeback_register(struct nfc_device *pnd)
+{
+  return pn53x_writeback_register_ext(pnd, NULL, 0);
+}
+
+/*
+ * Build in pbtWriteRegisterCmd (PN53x_EXTENDED_FRAME__DATA_MAX_LEN bytes) the
+ * WriteRegister frame flushing the writeback cache, reading first the
+ * registers whose new value is only partially known. Optional pbtExtraWrites
+ * holds additional (address hi, address lo, value) triplets for registers
+ * outside of the cache window. Returns the frame length, 1 when there is
+ * nothing to write.
+ */
+static int
+pn53x_writeback_build(struct nfc_device *pnd, const uint8_t *pbtExtraWrites, const size_t szExtraWrites, uint8_t *pbtWriteRegisterCmd)
 {
   int res = 0;
   // TODO Check at each step (ReadRegister, WriteRegister) if we didn't exceed max supported frame length
-  BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  BUFFER_INIT_SCRATCH(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtRegisterCmd);
   BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
 
   // First step, it looks for registers to be read before applying the requested mask
   CHIP_DATA(pnd)->wb_trigged = false;
   for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
-    if ((CHIP_DATA(pnd)->wb_mask[n]) && (CHIP_DATA(pnd)->wb_mask[n] != 0xff)) {
+    if (!CHIP_DATA(pnd)->wb_mask[n])
+      continue;
+    const uint16_t ui16RegisterAddress = PN53X_CACHE_REGISTER_MIN_ADDRESS + n;
+    uint8_t ui8CurrentValue;
+    if (pn53x_shadow_get(pnd, ui16RegisterAddress, &ui8CurrentValue)) {
+      // Current value is known, merge it locally and drop writes which change nothing
+      CHIP_DATA(pnd)->wb_data[n] = (CHIP_DATA(pnd)->wb_data[n] & CHIP_DATA(pnd)->wb_mask[n]) | (ui8CurrentValue & (~CHIP_DATA(pnd)->wb_mask[n]));
+      CHIP_DATA(pnd)->wb_mask[n] = (CHIP_DATA(pnd)->wb_data[n] != ui8CurrentValue) ? 0xff : 0x00;
+      continue;
+    }
+    if (CHIP_DATA(pnd)->wb_mask[n] != 0xff) {
       // This register needs to be read: mask is present but does not cover full data width (ie. mask != 0xff)
-      const uint16_t pn53x_register_address = PN53X_CACHE_REGISTER_MIN_ADDRESS + n;
-      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address  >> 8);
-      BUFFER_APPEND(abtReadRegisterCmd, pn53x_register_address & 0xff);
+      BUFFER_APPEND(abtReadRegisterCmd, ui16RegisterAddress  >> 8);
+      BUFFER_APPEND(abtReadRegisterCmd, ui16RegisterAddress & 0xff);
     }
   }
 
   if (BUFFER_SIZE(abtReadRegisterCmd) > 1) {
     // It needs to read some registers
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
+    SCRATCH_INIT(abtRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtRegisterRes);
+    size_t szRes = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
     // It transceives the previously constructed ReadRegister command
     if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
       return res;
@@ -701,6 +1573,7 @@ pn53x_writeback_register(struct nfc_device *pnd)
     }
     for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
       if ((CHIP_DATA(pnd)->wb_mask[n]) && (CHIP_DATA(pnd)->wb_mask[n] != 0xff)) {
+        pn53x_shadow_set(pnd, PN53X_CACHE_REGISTER_MIN_ADDRESS + n, abtRes[i]);
         CHIP_DATA(pnd)->wb_data[n] = ((CHIP_DATA(pnd)->wb_data[n] & CHIP_DATA(pnd)->wb_mask[n]) | (abtRes[i] & (~CHIP_DATA(pnd)->wb_mask[n])));
         if (CHIP_DATA(pnd)->wb_data[n] != abtRes[i]) {
           // Requested value is different from read one
@@ -713,7 +1586,7 @@ pn53x_writeback_register(struct nfc_device *pnd)
     }
   }
   // Now, the writeback-cache only has masks with 0xff, we can start to WriteRegister
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  BUFFER_ALIAS(abtWriteRegisterCmd, pbtWriteRegisterCmd);
   BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
   for (size_t n = 0; n < PN53X_CACHE_REGISTER_SIZE; n++) {
     if (CHIP_DATA(pnd)->wb_mask[n] == 0xff) {
@@ -726,12 +1599,44 @@ pn53x_writeback_register(struct nfc_device *pnd)
       CHIP_DATA(pnd)->wb_mask[n] = 0x00;
     }
   }
-
+  if (szExtraWrites) {
+    BUFFER_APPEND_BYTES(abtWriteRegisterCmd, pbtExtraWrites, szExtraWrites);
+  }
   if (BUFFER_SIZE(abtWriteRegisterCmd) > 1) {
+    NFC_TRACE2(register__flush, (BUFFER_SIZE(abtWriteRegisterCmd) - 1 - szExtraWrites) / 3, szExtraWrites);
+  }
+  return (int) BUFFER_SIZE(abtWriteRegisterCmd);
+}
+
+// Shadow follows what the chip holds once a WriteRegister frame went through
+static void
+pn53x_writeback_applied(struct nfc_device *pnd, const uint8_t *pbtWriteRegisterCmd, const size_t szWriteRegisterCmd)
+{
+  for (size_t n = 1; n + 2 < szWriteRegisterCmd; n += 3) {
+    pn53x_shadow_set(pnd, (pbtWriteRegisterCmd[n] << 8) | pbtWriteRegisterCmd[n + 1], pbtWriteRegisterCmd[n + 2]);
+  }
+}
+
+/*
+ * Flush the writeback cache. Optional pbtExtraWrites holds additional
+ * (address hi, address lo, value) triplets for registers outside of the cache
+ * window: they are sent within the same WriteRegister frame.
+ */
+static int
+pn53x_writeback_register_ext(struct nfc_device *pnd, const uint8_t *pbtExtraWrites, const size_t szExtraWrites)
+{
+  SCRATCH_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtRegisterCmd);
+  int res;
+  if ((res = pn53x_writeback_build(pnd, pbtExtraWrites, szExtraWrites, abtWriteRegisterCmd)) < 0) {
+    return res;
+  }
+  const size_t szWriteRegisterCmd = (size_t) res;
+  if (szWriteRegisterCmd > 1) {
     // We need to write some registers
-    if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
+    if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, szWriteRegisterCmd, NULL, 0, -1)) < 0) {
       return res;
     }
+    pn53x_writeback_applied(pnd, abtWriteRegisterCmd, szWriteRegisterCmd);
   }
   return NFC_SUCCESS;
 }
@@ -813,11 +1718,24 @@ pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, cons
       break;
     case NP_TIMEOUT_ATR:
       CHIP_DATA(pnd)->timeout_atr = value;
-      return pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication));
+      return pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), CHIP_DATA(pnd)->ui8RetryTimeout);
       break;
     case NP_TIMEOUT_COM:
       CHIP_DATA(pnd)->timeout_communication = value;
-      return pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication));
+      // Adaptive timeouts start learning again below this new ceiling
+      memset(CHIP_DATA(pnd)->adaptive, 0x00, sizeof(CHIP_DATA(pnd)->adaptive));
+      CHIP_DATA(pnd)->ui8RetryTimeoutWanted = pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication);
+      return pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), CHIP_DATA(pnd)->ui8RetryTimeoutWanted);
+      break;
+    case NP_RF_RETRIES:
+      if (value < 0)
+        return NFC_EINVARG;
+      CHIP_DATA(pnd)->rf_retries = value;
+      break;
+    case NP_LOW_POWER_POLL:
+      if (value < 0)
+        return NFC_EINVARG;
+      CHIP_DATA(pnd)->low_power_poll = value;
       break;
       // Following properties are invalid (not integer)
     case NP_HANDLE_CRC:
@@ -832,16 +1750,39 @@ pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, cons
     case NP_FORCE_ISO14443_A:
     case NP_FORCE_ISO14443_B:
     case NP_FORCE_SPEED_106:
+    case NP_AUTO_PPS:
+    case NP_ADAPTIVE_TIMEOUTS:
       return NFC_EINVARG;
   }
   return NFC_SUCCESS;
 }
 
+// Values set by nfc_target_init() before each pn53x_target_init(), they can't have changed while the target is armed
+static bool
+pn53x_is_target_init_property(const nfc_property property, const bool bEnable)
+{
+  switch (property) {
+    case NP_ACCEPT_INVALID_FRAMES:
+    case NP_ACCEPT_MULTIPLE_FRAMES:
+    case NP_ACTIVATE_CRYPTO1:
+    case NP_ACTIVATE_FIELD:
+      return !bEnable;
+    case NP_HANDLE_CRC:
+    case NP_HANDLE_PARITY:
+      return bEnable;
+    default:
+      return false;
+  }
+}
+
 int
 pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, const bool bEnable)
 {
   uint8_t  btValue;
   int res = 0;
+  if (CHIP_DATA(pnd)->target_armed && pn53x_is_target_init_property(property, bEnable))
+    // Nothing to do
+    return NFC_SUCCESS;
   switch (property) {
     case NP_HANDLE_CRC:
       // Enable or disable automatic receiving/sending of CRC bytes
@@ -951,12 +1892,31 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
       if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxMode, SYMBOL_TX_SPEED, 0x00)) < 0) {
         return res;
       }
-      return pn53x_write_register(pnd, PN53X_REG_CIU_RxMode, SYMBOL_RX_SPEED, 0x00);
+      if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_RxMode, SYMBOL_RX_SPEED, 0x00)) < 0) {
+        return res;
+      }
+      // Undo the modulation width a PPS may have set
+      return pn53x_write_register(pnd, PN53X_REG_CIU_ModWidth, 0xff, 0x26);
+      break;
+
+    case NP_AUTO_PPS:
+      pnd->bAutoPps = bEnable;
+      return NFC_SUCCESS;
+      break;
+
+    case NP_ADAPTIVE_TIMEOUTS:
+      CHIP_DATA(pnd)->adaptive_timeouts = bEnable;
+      memset(CHIP_DATA(pnd)->adaptive, 0x00, sizeof(CHIP_DATA(pnd)->adaptive));
+      // Applied with the next data exchange
+      CHIP_DATA(pnd)->ui8RetryTimeoutWanted = pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication);
+      return NFC_SUCCESS;
       break;
       // Following properties are invalid (not boolean)
     case NP_TIMEOUT_COMMAND:
     case NP_TIMEOUT_ATR:
     case NP_TIMEOUT_COM:
+    case NP_RF_RETRIES:
+    case NP_LOW_POWER_POLL:
       return NFC_EINVARG;
       break;
   }
@@ -964,7 +1924,49 @@ pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, con
   return NFC_EINVARG;
 }
 
-int
+/**
+ * @brief Start a properties transaction
+ *
+ * Until the matching pn53x_commit_properties(), register writes and
+ * SetParameters are only recorded: they are sent together just before the
+ * next command, the register writes in a single WriteRegister frame.
+ * Transactions can be nested.
+ */
+int
+pn53x_begin_properties(struct nfc_device *pnd)
+{
+  CHIP_DATA(pnd)->properties_transaction++;
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_commit_properties(struct nfc_device *pnd)
+{
+  if (!CHIP_DATA(pnd)->properties_transaction)
+    return NFC_EINVARG;
+  CHIP_DATA(pnd)->properties_transaction--;
+  return NFC_SUCCESS;
+}
+
+/*
+ * Analog settings are kept by the chip until it is powered off and used at
+ * the next activation of the matching modulation.
+ */
+int
+pn53x_set_rf_analog(struct nfc_device *pnd, const nfc_rf_analog nra, const uint8_t *pbtSettings, const size_t szSettings)
+{
+  // RFConfiguration item and settings count of each nfc_rf_analog
+  static const uint8_t abtCfgItems[] = { RFCI_ANALOG_TYPE_A_106, RFCI_ANALOG_TYPE_A_212_424, RFCI_ANALOG_TYPE_B, RFCI_ANALOG_TYPE_14443_4 };
+  static const uint8_t abtSizes[] = { 11, 8, 3, 9 };
+
+  if ((pbtSettings == NULL) || ((size_t) nra >= sizeof(abtCfgItems)) || (szSettings != abtSizes[nra])) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  return pn53x_RFConfiguration__Analog_settings(pnd, abtCfgItems[nra], pbtSettings, szSettings);
+}
+
+int
 pn53x_idle(struct nfc_device *pnd)
 {
   int res = 0;
@@ -975,9 +1977,9 @@ pn53x_idle(struct nfc_device *pnd)
       if ((res = pn53x_InRelease(pnd, 0)) < 0) {
         return res;
       }
-      if ((CHIP_DATA(pnd)->type == PN532) && (pnd->driver->powerdown)) {
-        // Use PowerDown to go in "Low VBat" power mode
-        if ((res = pnd->driver->powerdown(pnd)) < 0) {
+      if ((CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown)) {
+        // Use PowerDown to go in "Power Down" mode
+        if ((res = NFC_DRIVER(pnd)->powerdown(pnd)) < 0) {
           return res;
         }
       }
@@ -991,9 +1993,9 @@ pn53x_idle(struct nfc_device *pnd)
       if ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0) {
         return res;
       }
-      if ((CHIP_DATA(pnd)->type == PN532) && (pnd->driver->powerdown)) {
-        // Use PowerDown to go in "Low VBat" power mode
-        if ((res = pnd->driver->powerdown(pnd)) < 0) {
+      if ((CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown)) {
+        // Use PowerDown to go in "Power Down" mode
+        if ((res = NFC_DRIVER(pnd)->powerdown(pnd)) < 0) {
           return res;
         }
       }
@@ -1035,6 +2037,8 @@ pn53x_initiator_init(struct nfc_device *pnd)
       return res;
     }
   }
+  // The SAM UID is kept to select it quickly next time
+  CHIP_DATA(pnd)->sam_selected = false;
 
   // Configure the PN53X to be an Initiator or Reader/Writer
   if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_Control, SYMBOL_INITIATOR, 0x10)) < 0)
@@ -1050,6 +2054,152 @@ pn532_initiator_init_secure_element(struct nfc_device *pnd)
   return pn532_SAMConfiguration(pnd, PSM_WIRED_CARD, -1);
 }
 
+// Wired card mode with the SAM selected, from its cached UID when it answered before
+static int
+pn532_sam_enter(struct nfc_device *pnd, int timeout)
+{
+  int res;
+  if (CHIP_DATA(pnd)->sam_mode != PSM_WIRED_CARD) {
+    // The antenna is left aside in wired card mode, the card is gone
+    pn53x_current_target_free(pnd);
+    CHIP_DATA(pnd)->sam_selected = false;
+    if ((res = pn532_SAMConfiguration(pnd, PSM_WIRED_CARD, -1)) < 0)
+      return res;
+  }
+  CHIP_DATA(pnd)->sam_session = true;
+  if (CHIP_DATA(pnd)->sam_selected)
+    return NFC_SUCCESS;
+
+  const nfc_modulation nmSAM = { NMT_ISO14443A, NBR_106 };
+  const nfc_iso14443a_info *pnai = &(CHIP_DATA(pnd)->sam_target.nti.nai);
+  uint8_t abtInit[12];
+  size_t szInit = 0;
+  nfc_target nt;
+  if ((CHIP_DATA(pnd)->sam_target.nm.nmt == NMT_ISO14443A) && (pnai->szUidLen > 0))
+    iso14443_cascade_uid(pnai->abtUid, pnai->szUidLen, abtInit, &szInit);
+  res = pn53x_initiator_select_passive_target_ext(pnd, nmSAM, szInit ? abtInit : NULL, szInit, &nt, timeout);
+  if ((res == 0) && (szInit > 0)) {
+    // Another SAM was plugged in
+    res = pn53x_initiator_select_passive_target_ext(pnd, nmSAM, NULL, 0, &nt, timeout);
+  }
+  if (res <= 0)
+    return (res == 0) ? NFC_ETGRELEASED : res;
+  CHIP_DATA(pnd)->sam_target = nt;
+  CHIP_DATA(pnd)->sam_selected = true;
+  return NFC_SUCCESS;
+}
+
+// Back to normal mode before the chip looks for cards again
+static int
+pn532_sam_leave(struct nfc_device *pnd)
+{
+  CHIP_DATA(pnd)->sam_selected = false;
+  pn53x_current_target_free(pnd);
+  return pn532_SAMConfiguration(pnd, PSM_NORMAL, -1);
+}
+
+/*
+ * The chip reaches either the card (normal mode) or the SAM (wired card mode),
+ * never both at once. Switching to the SAM is only done when needed, in the
+ * same bus transaction as the APDU, and the SAM is kept selected until a card
+ * command needs the antenna back: a run of SAM APDUs costs a single switch,
+ * and the SAM is selected again straight by its UID on the next tap.
+ */
+int
+pn532_initiator_sam_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  if (CHIP_DATA(pnd)->type != PN532) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  int res;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  CHIP_DATA(pnd)->sam_busy = true;
+  if ((res = pn532_sam_enter(pnd, timeout)) >= 0)
+    res = pn53x_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+  CHIP_DATA(pnd)->sam_busy = false;
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  if ((res < 0) && (pnd->last_error == 0))
+    pnd->last_error = res;
+  return res;
+}
+
+// Highest ISO14443-4A bit rate (PN53x code, 0 for 106 kbps) both the chip and TA(1) of the target ATS allow, same in both directions
+static uint8_t
+pn53x_iso14443_4_pps_code(const struct nfc_device *pnd, const nfc_target *pnt)
+{
+  const nfc_iso14443a_info *pnai = &(pnt->nti.nai);
+  // DR (PCD to PICC) bits, DS (PICC to PCD) bits are 4 positions higher
+  uint8_t btDr = 0;
+
+  if ((pnai->szAtsLen < 2) || !(pnai->abtAts[0] & 0x10))
+    return 0;
+  switch (CHIP_DATA(pnd)->type) {
+    case PN533:
+      btDr = 0x04;
+      break;
+    case PN532:
+      btDr = 0x02;
+      break;
+    default:
+      return 0;
+  }
+  for (uint8_t btCode = (btDr == 0x04) ? 3 : 2; btDr; btDr >>= 1, btCode--) {
+    if ((pnai->abtAts[1] & btDr) && (pnai->abtAts[1] & (btDr << 4)))
+      return btCode;
+  }
+  return 0;
+}
+
+// Raise the bit rate of a target the chip activated itself: InPSL sends PPS and reconfigures the CIU
+static int
+pn53x_InPSL_iso14443_4(struct nfc_device *pnd, const nfc_target *pnt)
+{
+  const uint8_t btCode = pn53x_iso14443_4_pps_code(pnd, pnt);
+  int res;
+
+  if (btCode == 0)
+    return NFC_SUCCESS;
+  const uint8_t abtCmd[] = { InPSL, 0x01, btCode, btCode };
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "PPS refused, target stays at 106 kbps (%d)", res);
+    return res;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Target switched to %d kbps", 106 << btCode);
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_initiator_iso14443_4_pps(struct nfc_device *pnd, const nfc_target *pnt)
+{
+  // Modulation pulse width of each bit rate
+  static const uint8_t abtModWidth[] = { 0x26, 0x15, 0x0a, 0x05 };
+  const uint8_t btCode = pn53x_iso14443_4_pps_code(pnd, pnt);
+  uint8_t abtRx[1];
+  int res;
+
+  if (btCode == 0)
+    return NBR_106;
+  // PPSS (no CID), PPS0 telling PPS1 follows, PPS1 with DSI and DRI
+  const uint8_t abtPps[] = { 0xd0, 0x11, (btCode << 2) | btCode };
+  if ((res = pn53x_initiator_transceive_bytes(pnd, abtPps, sizeof(abtPps), abtRx, sizeof(abtRx), -1)) < 0)
+    return res;
+  if ((res != 1) || (abtRx[0] != abtPps[0]))
+    return NFC_ERFTRANS;
+  // The target answered at the old rate and now expects the new one
+  if (((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxMode, SYMBOL_TX_SPEED, btCode << 4)) < 0) ||
+      ((res = pn53x_write_register(pnd, PN53X_REG_CIU_RxMode, SYMBOL_RX_SPEED, btCode << 4)) < 0) ||
+      ((res = pn53x_write_register(pnd, PN53X_REG_CIU_ModWidth, 0xff, abtModWidth[btCode])) < 0))
+    return res;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Target switched to %d kbps", 106 << btCode);
+  return (btCode == 3) ? NBR_847 : (btCode == 2) ? NBR_424 : NBR_212;
+}
+
 static int
 pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
                                           const nfc_modulation nm,
@@ -1155,6 +2305,10 @@ pn53x_initiator_select_passive_target_ext(struct nfc_device *pnd,
       pnd->last_error = NFC_ESOFT;
       return pnd->last_error;
     }
+    if ((nm.nmt == NMT_ISO14443A) && pnd->bAutoPps && pnd->bAutoIso14443_4 && (pnt->nti.nai.szAtsLen > 0)) {
+      // A refused PPS leaves the target usable at 106 kbps
+      pn53x_InPSL_iso14443_4(pnd, pnt);
+    }
   }
   return abtTargetsData[0];
 }
@@ -1168,50 +2322,511 @@ pn53x_initiator_select_passive_target(struct nfc_device *pnd,
   return pn53x_initiator_select_passive_target_ext(pnd, nm, pbtInitData, szInitData, pnt, 0);
 }
 
+// Size of the first TargetData entry of an InListPassiveTarget reply, 0 if malformed
+static size_t
+pn53x_target_data_len(const struct nfc_device *pnd, const uint8_t *pbtRawData, const size_t szRawData, const nfc_modulation_type nmt)
+{
+  size_t szLen = 0;
+
+  switch (nmt) {
+    case NMT_ISO14443A:
+      // Tg, SENS_RES (2), SEL_RES, NFCIDLength, NFCID1, [ATS]
+      if (szRawData < 5)
+        return 0;
+      szLen = 5 + pbtRawData[4];
+      // ATS is only there if the chip sent RATS itself
+      if ((pbtRawData[3] & SAK_ISO14443_4_COMPLIANT) && (pnd->bAutoIso14443_4)) {
+        if (szRawData <= szLen)
+          return 0;
+        szLen += pbtRawData[szLen];
+      }
+      break;
+    case NMT_ISO14443B:
+      // Tg, ATQB (12), ATTRIB_RES Length, ATTRIB_RES
+      if (szRawData < 14)
+        return 0;
+      szLen = 14 + pbtRawData[13];
+      break;
+    case NMT_FELICA:
+      // Tg, POL_RES Length (counting itself), POL_RES
+      if (szRawData < 2)
+        return 0;
+      szLen = 1 + pbtRawData[1];
+      break;
+    default:
+      return 0;
+  }
+  return (szLen <= szRawData) ? szLen : 0;
+}
+
 int
-pn53x_initiator_poll_target(struct nfc_device *pnd,
-                            const nfc_modulation *pnmModulations, const size_t szModulations,
-                            const uint8_t uiPollNr, const uint8_t uiPeriod,
-                            nfc_target *pnt)
+pn53x_initiator_select_passive_targets(struct nfc_device *pnd,
+                                       const nfc_modulation nm,
+                                       const uint8_t *pbtInitData, const size_t szInitData,
+                                       nfc_target ant[], const size_t szTargets)
 {
+  uint8_t  abtTargetsData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t  szTargetsData = sizeof(abtTargetsData);
   int res = 0;
 
-  if (CHIP_DATA(pnd)->type == PN532) {
-    size_t szTargetTypes = 0;
-    pn53x_target_type apttTargetTypes[32];
-    for (size_t n = 0; n < szModulations; n++) {
-      const pn53x_target_type ptt = pn53x_nm_to_ptt(pnmModulations[n]);
-      if (PTT_UNDEFINED == ptt) {
-        pnd->last_error = NFC_EINVARG;
+  if ((szTargets < 2) || ((nm.nmt != NMT_ISO14443A) && (nm.nmt != NMT_ISO14443B) && (nm.nmt != NMT_FELICA))) {
+    // Chip can only return one target of this kind at once
+    if ((res = pn53x_initiator_select_passive_target_ext(pnd, nm, pbtInitData, szInitData, ant, 0)) <= 0)
+      return res;
+    return 1;
+  }
+
+  const pn53x_modulation pm = pn53x_nm_to_pm(nm);
+  if (PM_UNDEFINED == pm) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  if ((res = pn53x_InListPassiveTarget(pnd, pm, 2, pbtInitData, szInitData, abtTargetsData, &szTargetsData, 0)) <= 0)
+    return res;
+
+  const int nbTargets = (res > 2) ? 2 : res;
+  const uint8_t *pbtRawData = abtTargetsData + 1;
+  size_t szRawData = szTargetsData - 1;
+  for (int i = 0; i < nbTargets; i++) {
+    // Last entry takes what is left, the other ones have to be sized
+    const size_t szEntry = (i == nbTargets - 1) ? szRawData : pn53x_target_data_len(pnd, pbtRawData, szRawData, nm.nmt);
+    if (szEntry == 0) {
+      pnd->last_error = NFC_ECHIP;
+      return pnd->last_error;
+    }
+    ant[i].nm = nm;
+    if ((res = pn53x_decode_target_data(pbtRawData, szEntry, CHIP_DATA(pnd)->type, nm.nmt, &(ant[i].nti))) < 0) {
+      return res;
+    }
+    pbtRawData += szEntry;
+    szRawData -= szEntry;
+  }
+  // Tg 1 is the one further exchanges will talk to, until pn53x_initiator_set_current_target()
+  if (pn53x_current_target_new(pnd, &ant[0]) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  memcpy(CHIP_DATA(pnd)->logical_targets, ant, nbTargets * sizeof(nfc_target));
+  CHIP_DATA(pnd)->szLogicalTargets = nbTargets;
+  return nbTargets;
+}
+
+int
+pn53x_initiator_set_current_target(struct nfc_device *pnd, const nfc_target *pnt)
+{
+  const uint8_t *pbtUid, *pbtLogicalUid;
+
+  if (!pnt) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  const size_t szUid = pn53x_target_uid(pnt, &pbtUid);
+
+  for (size_t i = 0; i < CHIP_DATA(pnd)->szLogicalTargets; i++) {
+    const nfc_target *pntLogical = &(CHIP_DATA(pnd)->logical_targets[i]);
+    if ((pntLogical->nm.nmt != pnt->nm.nmt) || (pn53x_target_uid(pntLogical, &pbtLogicalUid) != szUid) ||
+        (memcmp(pbtUid, pbtLogicalUid, szUid) != 0))
+      continue;
+    // Both targets stay activated in the chip, only the Tg of further exchanges changes
+    memcpy(&(CHIP_DATA(pnd)->current_target_storage), pntLogical, sizeof(nfc_target));
+    CHIP_DATA(pnd)->current_target = &(CHIP_DATA(pnd)->current_target_storage);
+    CHIP_DATA(pnd)->current_tg = (uint8_t)(i + 1);
+    return NFC_SUCCESS;
+  }
+  // Only the current one, when a single target was selected
+  if (pn53x_current_target_is(pnd, pnt))
+    return NFC_SUCCESS;
+  pnd->last_error = NFC_ETGRELEASED;
+  return pnd->last_error;
+}
+
+// Bit oriented InCommunicateThru; RxAlign is only set for anticollision frames, whose answer starts on the last sent bit
+static int
+pn53x_inventory_exchange(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t ui8RxAlign, uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t  abtCmd[1 + 9] = { InCommunicateThru };
+  // Up to an extended ATQB
+  uint8_t  abtRx[1 + 13];
+  const uint8_t ui8Bits = szTxBits % 8;
+  const size_t szTxBytes = (szTxBits + 7) / 8;
+  int res = 0;
+
+  // TxLastBits and RxAlign both live in BitFraming, one cached write covers them
+  if ((res = pn53x_set_tx_bits(pnd, ui8Bits)) < 0)
+    return res;
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_RX_ALIGN, ui8RxAlign << 4)) < 0)
+    return res;
+  memcpy(abtCmd + 1, pbtTx, szTxBytes);
+  if ((res = pn53x_transceive(pnd, abtCmd, 1 + szTxBytes, abtRx, sizeof(abtRx), -1)) < 0)
+    return res;
+  // Skip the status byte
+  const size_t szData = ((size_t)res - 1 < szRx) ? (size_t)res - 1 : szRx;
+  if (pbtRx)
+    memcpy(pbtRx, abtRx + 1, szData);
+  return (int)szData;
+}
+
+// Anticollision answers: nobody, several (garbled) cards or an error
+#define PN53X_INVENTORY_NOBODY    0
+#define PN53X_INVENTORY_COLLISION 1
+static int
+pn53x_inventory_failure(struct nfc_device *pnd, const int res)
+{
+  if (res != NFC_ERFTRANS)
+    return res;
+  switch (CHIP_DATA(pnd)->last_status_byte) {
+    case ETIMEOUT:
+    case ERFTIMEOUT:
+      return PN53X_INVENTORY_NOBODY;
+    case EBITCOLL:
+    case EPARITY:
+    case EBITCOUNT:
+    case EFRAMING:
+    // ISO14443B collisions show up as corrupted frames
+    case ECRC:
+      return PN53X_INVENTORY_COLLISION;
+  }
+  return res;
+}
+
+// Walk one cascade level down to a single card, then SELECT it; returns SAK
+static int
+pn53x_inventory_cascade_level(struct nfc_device *pnd, const uint8_t btSel, uint8_t *pbtUid)
+{
+  uint8_t  abtSel[9];
+  uint8_t  abtRx[5];
+  size_t   szKnownBits = 0;
+  int res = 0;
+
+  memset(pbtUid, 0x00, 5);     // UID CLn + BCC
+  for (;;) {
+    abtSel[0] = btSel;
+    abtSel[1] = ((2 + szKnownBits / 8) << 4) | (szKnownBits % 8); // NVB
+    memcpy(abtSel + 2, pbtUid, (szKnownBits + 7) / 8);
+    if ((res = pn53x_inventory_exchange(pnd, abtSel, 16 + szKnownBits, szKnownBits % 8, abtRx, sizeof(abtRx))) >= 0) {
+      // Only one card matches what we know: it sent the remaining bits
+      const size_t szFirst = szKnownBits / 8;
+      if ((size_t)res < 5 - szFirst) {
+        pnd->last_error = NFC_ERFTRANS;
         return pnd->last_error;
       }
-      apttTargetTypes[szTargetTypes] = ptt;
-      if ((pnd->bAutoIso14443_4) && (ptt == PTT_MIFARE)) { // Hack to have ATS
-        apttTargetTypes[szTargetTypes] = PTT_ISO14443_4A_106;
-        szTargetTypes++;
-        apttTargetTypes[szTargetTypes] = PTT_MIFARE;
+      const uint8_t btMask = 0xff << (szKnownBits % 8);
+      pbtUid[szFirst] = (pbtUid[szFirst] & ~btMask) | (abtRx[0] & btMask);
+      memcpy(pbtUid + szFirst + 1, abtRx + 1, 4 - szFirst);
+      break;
+    }
+    if ((res = pn53x_inventory_failure(pnd, res)) < 0)
+      return res;
+    if (res == PN53X_INVENTORY_NOBODY) {
+      if (szKnownBits == 0)
+        return NFC_ETIMEOUT;
+      // Nobody has a 0 there, the cards that collided all have a 1: no need to ask
+      pbtUid[(szKnownBits - 1) / 8] |= 1 << ((szKnownBits - 1) % 8);
+    }
+    if (szKnownBits == 32) {
+      // Same UID answered several times
+      pnd->last_error = NFC_ERFTRANS;
+      return pnd->last_error;
+    }
+    // Several cards left: try the 0 branch of the next bit
+    pbtUid[szKnownBits / 8] &= ~(1 << (szKnownBits % 8));
+    szKnownBits++;
+  }
+
+  if ((pbtUid[0] ^ pbtUid[1] ^ pbtUid[2] ^ pbtUid[3]) != pbtUid[4]) {
+    pnd->last_error = NFC_ERFTRANS;
+    return pnd->last_error;
+  }
+
+  abtSel[0] = btSel;
+  abtSel[1] = 0x70;
+  memcpy(abtSel + 2, pbtUid, 5);
+  iso14443a_crc_append(abtSel, 7);
+  if ((res = pn53x_inventory_exchange(pnd, abtSel, 8 * sizeof(abtSel), 0, abtRx, sizeof(abtRx))) < 0)
+    return res;
+  if (res < 1) {
+    pnd->last_error = NFC_ERFTRANS;
+    return pnd->last_error;
+  }
+  return abtRx[0];
+}
+
+int
+pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  const bool bCrc = pnd->bCrc;
+  const bool bPar = pnd->bPar;
+  const bool bEasyFraming = pnd->bEasyFraming;
+  const bool bAutoIso14443_4 = pnd->bAutoIso14443_4;
+  const uint8_t abtReqa[] = { 0x26 };
+  uint8_t  abtHlta[4] = { 0x50, 0x00 };
+  size_t  szTargetFound = 0;
+  int res = 0;
+
+  pn53x_current_target_free(pnd);
+  iso14443a_crc_append(abtHlta, 2);
+
+  // Raw 106 kbps ISO14443A frames with parity done by the chip
+  pn53x_begin_properties(pnd);
+  if (((res = pn53x_set_property_bool(pnd, NP_FORCE_ISO14443_A, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_FORCE_SPEED_106, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_AUTO_ISO14443_4, false)) < 0)) {
+    pn53x_commit_properties(pnd);
+    return res;
+  }
+  pn53x_commit_properties(pnd);
+
+  while (szTargetFound < szTargets) {
+    nfc_target *pnt = &(ant[szTargetFound]);
+    uint8_t abtAtqa[2];
+    uint8_t abtUid[5];
+    uint8_t btSel = 0x93;
+    int sak;
+
+    // Halted cards stay quiet, different ATQA from several cards collide
+    if ((res = pn53x_inventory_exchange(pnd, abtReqa, 7, 0, abtAtqa, sizeof(abtAtqa))) < 0) {
+      if ((res = pn53x_inventory_failure(pnd, res)) < 0)
+        goto end;
+      if (res == PN53X_INVENTORY_NOBODY)
+        break;
+      memset(abtAtqa, 0x00, sizeof(abtAtqa));
+    } else if (res < 2) {
+      memset(abtAtqa, 0x00, sizeof(abtAtqa));
+    }
+
+    memset(pnt, 0x00, sizeof(nfc_target));
+    pnt->nm.nmt = NMT_ISO14443A;
+    pnt->nm.nbr = NBR_106;
+    // ATQA comes LSB first, abtAtqa is SENS_RES as the chip gives it
+    pnt->nti.nai.abtAtqa[0] = abtAtqa[1];
+    pnt->nti.nai.abtAtqa[1] = abtAtqa[0];
+    do {
+      if ((sak = pn53x_inventory_cascade_level(pnd, btSel, abtUid)) < 0) {
+        res = sak;
+        break;
       }
+      if (sak & 0x04) {
+        // Skip the Cascade Tag
+        memcpy(pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen, abtUid + 1, 3);
+        pnt->nti.nai.szUidLen += 3;
+        btSel += 2;
+      } else {
+        memcpy(pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen, abtUid, 4);
+        pnt->nti.nai.szUidLen += 4;
+        pnt->nti.nai.btSak = sak;
+      }
+    } while ((sak & 0x04) && (btSel <= 0x97));
+    if (res == NFC_ETIMEOUT) {
+      // The cards went away between REQA and anticollision
+      res = 0;
+      break;
+    }
+    if (res < 0)
+      goto end;
+    szTargetFound++;
+
+    // HLTA has no answer, its timeout is expected
+    pn53x_inventory_exchange(pnd, abtHlta, 8 * sizeof(abtHlta), 0, NULL, 0);
+  }
+  res = (int)szTargetFound;
+
+end:
+  // Give back the device as it was
+  pn53x_begin_properties(pnd);
+  pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_RX_ALIGN, 0x00);
+  pn53x_set_property_bool(pnd, NP_HANDLE_CRC, bCrc);
+  pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, bPar);
+  pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+  pn53x_set_property_bool(pnd, NP_AUTO_ISO14443_4, bAutoIso14443_4);
+  pn53x_commit_properties(pnd);
+  return res;
+}
+
+// ISO14443B slotted anticollision: REQB opens 16 slots, Slot-MARKER commands call the next ones
+#define ISO14443B_APF  0x05
+#define ISO14443B_PARAM_16_SLOTS  0x04
+#define ISO14443B_SLOTS  16
+// Rounds before giving up on cards which keep colliding, so that inventory time stays bounded
+#define ISO14443B_INVENTORY_ROUNDS  8
+
+int
+pn53x_initiator_inventory_iso14443b(struct nfc_device *pnd, const uint8_t ui8Afi, nfc_target ant[], const size_t szTargets)
+{
+  const bool bCrc = pnd->bCrc;
+  const bool bEasyFraming = pnd->bEasyFraming;
+  size_t  szTargetFound = 0;
+  int res = 0;
+
+  if (CHIP_DATA(pnd)->type == RCS360) {
+    // RC-S360 refuses to send raw frames without a first select
+    pnd->last_error = NFC_ENOTIMPL;
+    return pnd->last_error;
+  }
+  pn53x_current_target_free(pnd);
+
+  // Raw 106 kbps ISO14443B frames with CRC_B done by the chip
+  pn53x_begin_properties(pnd);
+  if (((res = pn53x_set_property_bool(pnd, NP_FORCE_ISO14443_B, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_FORCE_SPEED_106, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0)) {
+    pn53x_commit_properties(pnd);
+    return res;
+  }
+  pn53x_commit_properties(pnd);
+
+  for (int round = 0; (round < ISO14443B_INVENTORY_ROUNDS) && (szTargetFound < szTargets); round++) {
+    bool bCollision = false;
+    for (uint8_t ui8Slot = 0; (ui8Slot < ISO14443B_SLOTS) && (szTargetFound < szTargets); ui8Slot++) {
+      // Halted cards stay quiet, the other ones answer in the slot they picked
+      const uint8_t abtReqb[3] = { ISO14443B_APF, ui8Afi, ISO14443B_PARAM_16_SLOTS };
+      const uint8_t abtSlotMarker[1] = { (uint8_t)((ui8Slot << 4) | ISO14443B_APF) };
+      uint8_t abtAtqb[13];
+      if (ui8Slot == 0) {
+        res = pn53x_inventory_exchange(pnd, abtReqb, 8 * sizeof(abtReqb), 0, abtAtqb, sizeof(abtAtqb));
+      } else {
+        res = pn53x_inventory_exchange(pnd, abtSlotMarker, 8 * sizeof(abtSlotMarker), 0, abtAtqb, sizeof(abtAtqb));
+      }
+      if (res < 0) {
+        if ((res = pn53x_inventory_failure(pnd, res)) < 0)
+          goto end;
+        if (res == PN53X_INVENTORY_COLLISION)
+          bCollision = true;
+        continue;
+      }
+      if ((res < 12) || (abtAtqb[0] != 0x50)) {
+        bCollision = true;
+        continue;
+      }
+
+      // Laid out as an InListPassiveTarget entry: Tg, ATQB, no ATTRIB_RES
+      uint8_t abtTargetData[1 + 12 + 1] = { 0x01 };
+      memcpy(abtTargetData + 1, abtAtqb, 12);
+      nfc_target *pnt = &(ant[szTargetFound]);
+      memset(pnt, 0x00, sizeof(nfc_target));
+      pnt->nm.nmt = NMT_ISO14443B;
+      pnt->nm.nbr = NBR_106;
+      if ((res = pn53x_decode_target_data(abtTargetData, sizeof(abtTargetData), CHIP_DATA(pnd)->type, NMT_ISO14443B, &(pnt->nti))) < 0)
+        goto end;
+      szTargetFound++;
+
+      // HLTB keeps the card out of next rounds, its answer does not matter
+      uint8_t abtHltb[5] = { 0x50 };
+      memcpy(abtHltb + 1, pnt->nti.nbi.abtPupi, 4);
+      pn53x_inventory_exchange(pnd, abtHltb, 8 * sizeof(abtHltb), 0, NULL, 0);
+    }
+    // Every card in the field answered alone
+    if (!bCollision)
+      break;
+  }
+  res = (int)szTargetFound;
+
+end:
+  // Give back the device as it was
+  pn53x_begin_properties(pnd);
+  pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_RX_ALIGN, 0x00);
+  pn53x_set_property_bool(pnd, NP_HANDLE_CRC, bCrc);
+  pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+  pn53x_commit_properties(pnd);
+  return res;
+}
+
+// InAutoPoll target types of given modulations (15 at most, as many as the chip takes), returns types count
+static int
+pn53x_nm_to_autopoll_types(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, pn53x_target_type *ppttTargetTypes)
+{
+  size_t szTargetTypes = 0;
+  for (size_t n = 0; n < szModulations; n++) {
+    const pn53x_target_type ptt = pn53x_nm_to_ptt(pnmModulations[n]);
+    if (PTT_UNDEFINED == ptt) {
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
+    }
+    // ISO14443A gives two types when ATS is wanted
+    const bool bWithAts = (pnd->bAutoIso14443_4) && (ptt == PTT_MIFARE);
+    if (szTargetTypes + (bWithAts ? 2 : 1) > 15) {
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
+    }
+    if (bWithAts) { // Hack to have ATS
+      ppttTargetTypes[szTargetTypes] = PTT_ISO14443_4A_106;
       szTargetTypes++;
     }
+    ppttTargetTypes[szTargetTypes] = ptt;
+    szTargetTypes++;
+  }
+  return (int) szTargetTypes;
+}
+
+// Low-power polling needs PowerDown, on PN532 only
+static bool
+pn53x_low_power_poll_enabled(const struct nfc_device *pnd)
+{
+  return (CHIP_DATA(pnd)->low_power_poll > 0) && (CHIP_DATA(pnd)->type == PN532) && (NFC_DRIVER(pnd)->powerdown);
+}
+
+// Sleep between two low-power polling rounds: a phone or a reader field wakes the chip up early
+static int
+pn53x_low_power_sleep(struct nfc_device *pnd)
+{
+  int res;
+  if ((res = pn53x_PowerDown_wakeup(pnd, PN532_WAKEUP_HOST | PN532_WAKEUP_RF)) < 0)
+    return res;
+  nfc_sleep_ms(CHIP_DATA(pnd)->low_power_poll);
+  // Woken up by the next command sent
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_initiator_poll_target(struct nfc_device *pnd,
+                            const nfc_modulation *pnmModulations, const size_t szModulations,
+                            const uint8_t uiPollNr, const uint8_t uiPeriod,
+                            nfc_target *pnt)
+{
+  int res = 0;
+
+  if (CHIP_DATA(pnd)->type == PN532) {
+    pn53x_target_type apttTargetTypes[15];
+    const int szTargetTypes = pn53x_nm_to_autopoll_types(pnd, pnmModulations, szModulations, apttTargetTypes);
+    if (szTargetTypes < 0)
+      return szTargetTypes;
     nfc_target ntTargets[2];
-    if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, uiPollNr, uiPeriod, ntTargets, 0)) < 0)
+    if (pn53x_low_power_poll_enabled(pnd)) {
+      // One round at a time, the chip sleeps in between
+      for (uint8_t p = 0; (res == 0) && ((uiPollNr == 0xff) || (p < uiPollNr)); p++) {
+        if ((p > 0) && ((res = pn53x_low_power_sleep(pnd)) < 0))
+          return res;
+        if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, 1, uiPeriod, ntTargets, 0)) < 0)
+          return res;
+      }
+      if (res == 0)
+        return 0;
+    } else if ((res = pn53x_InAutoPoll(pnd, apttTargetTypes, szTargetTypes, uiPollNr, uiPeriod, ntTargets, 0)) < 0) {
       return res;
+    }
     switch (res) {
+      case 0:
+        // No target during these rounds
+        return 0;
       case 1:
         *pnt = ntTargets[0];
-        return res;
         break;
       case 2:
         *pnt = ntTargets[1]; // We keep the selected one
-        return res;
         break;
       default:
         return NFC_ECHIP;
         break;
     }
+    // Selected target is the current one, ie. for nfc_initiator_target_is_present()
     if (pn53x_current_target_new(pnd, pnt) == NULL) {
       return NFC_ESOFT;
     }
+    return res;
   } else {
     pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, true);
     // FIXME It does not support DEP targets
@@ -1221,7 +2836,7 @@ pn53x_initiator_poll_target(struct nfc_device *pnd,
           uint8_t *pbtInitiatorData;
           size_t szInitiatorData;
           prepare_initiator_data(pnmModulations[n], &pbtInitiatorData, &szInitiatorData);
-          const int timeout_ms = uiPeriod * 150;
+          const int timeout_ms = nfc_poll_dwell(pnd, pnmModulations[n].nmt, uiPeriod * 150);
 
           if ((res = pn53x_initiator_select_passive_target_ext(pnd, pnmModulations[n], pbtInitiatorData, szInitiatorData, pnt, timeout_ms)) < 0) {
             if (pnd->last_error != NFC_ETIMEOUT) {
@@ -1239,6 +2854,66 @@ pn53x_initiator_poll_target(struct nfc_device *pnd,
   return NFC_ECHIP;
 }
 
+int
+pn53x_initiator_poll_target_stream(struct nfc_device *pnd,
+                                   const nfc_modulation *pnmModulations, const size_t szModulations,
+                                   const uint8_t uiPeriod,
+                                   nfc_target_callback cb, void *user_data)
+{
+  int szDelivered = 0;
+  int res = 0;
+
+  if (CHIP_DATA(pnd)->type != PN532) {
+    // No hardware loop: poll again and again
+    nfc_target nt;
+    for (;;) {
+      if ((res = pn53x_initiator_poll_target(pnd, pnmModulations, szModulations, 0xff, uiPeriod, &nt)) < 0)
+        return res;
+      if (res == 0)
+        continue;
+      szDelivered++;
+      if (cb(pnd, &nt, user_data))
+        return szDelivered;
+    }
+  }
+
+  // InAutoPoll frame is built once and sent back as soon as an answer is handled
+  pn53x_target_type apttTargetTypes[15];
+  const int szTargetTypes = pn53x_nm_to_autopoll_types(pnd, pnmModulations, szModulations, apttTargetTypes);
+  if (szTargetTypes < 0)
+    return szTargetTypes;
+  // Endless polling, or a single round between two sleeps in low-power mode
+  const bool bLowPower = pn53x_low_power_poll_enabled(pnd);
+  uint8_t  abtCmd[3 + 15] = { InAutoPoll, bLowPower ? 1 : 0xff, uiPeriod };
+  for (int n = 0; n < szTargetTypes; n++) {
+    abtCmd[3 + n] = apttTargetTypes[n];
+  }
+
+  for (;;) {
+    uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    nfc_target ntTargets[2];
+    if ((res = pn53x_transceive(pnd, abtCmd, 3 + szTargetTypes, abtRx, sizeof(abtRx), 0)) < 0)
+      return res;
+    if ((res = pn53x_InAutoPoll_decode(pnd, abtRx, (size_t) res, ntTargets)) < 0)
+      return res;
+    if (res == 0) {
+      if (bLowPower && ((res = pn53x_low_power_sleep(pnd)) < 0))
+        return res;
+      continue;
+    }
+    // Last listed target is the selected one
+    if (pn53x_current_target_new(pnd, &ntTargets[(res > 1) ? 1 : 0]) == NULL) {
+      pnd->last_error = NFC_ESOFT;
+      return pnd->last_error;
+    }
+    for (int n = 0; (n < res) && (n < 2); n++) {
+      szDelivered++;
+      if (cb(pnd, &ntTargets[n], user_data))
+        return szDelivered;
+    }
+  }
+}
+
 int
 pn53x_initiator_select_dep_target(struct nfc_device *pnd,
                                   const nfc_dep_mode ndm, const nfc_baud_rate nbr,
@@ -1290,7 +2965,9 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
   size_t szRxBits = 0;
   uint8_t ui8rcc;
   uint8_t ui8Bits = 0;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN] = { InCommunicateThru };
+  // Built where drivers can frame it in place
+  uint8_t *abtCmd = pn53x_tx_buffer(pnd);
+  abtCmd[0] = InCommunicateThru;
 
   // Check if we should prepare the parity bits ourself
   if (!pnd->bPar) {
@@ -1318,15 +2995,20 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
 
   // Send the frame to the PN53X chip and get the answer
   // We have to give the amount of bytes + (the command byte 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  SCRATCH_INIT(abtRx, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandRx);
+  size_t  szRx = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
   if ((res = pn53x_transceive(pnd, abtCmd, szFrameBytes + 1, abtRx, szRx, -1)) < 0)
     return res;
   szRx = (size_t) res;
-  // Get the last bit-count that is stored in the received byte
-  if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_Control, &ui8rcc)) < 0)
-    return res;
-  ui8Bits = ui8rcc & SYMBOL_RX_LAST_BITS;
+  if (CHIP_DATA(pnd)->raw_session && (szRx > 2)) {
+    // Within a raw-bit session, answers longer than a byte end with a whole byte, or a whole parity slot
+    ui8Bits = (pnd->bPar) ? 0 : ((((szRx - 1) * 8 / 9) * 9) % 8);
+  } else {
+    // Get the last bit-count that is stored in the received byte
+    if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_Control, &ui8rcc)) < 0)
+      return res;
+    ui8Bits = ui8rcc & SYMBOL_RX_LAST_BITS;
+  }
 
   // Recover the real frame length in bits
   szFrameBits = ((szRx - 1 - ((ui8Bits == 0) ? 0 : 1)) * 8) + ui8Bits;
@@ -1350,12 +3032,60 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
   return szRxBits;
 }
 
+/**
+ * @brief Start a raw-bit session: framing is set up once for a run of pn53x_initiator_transceive_bits()
+ *
+ * CRC handling and easy framing are turned off in a single register write.
+ * Until pn53x_initiator_raw_session_end(), answers longer than one byte are
+ * taken as ending on a byte boundary (on a parity slot boundary when parity
+ * is handled by the host), which spares reading RxLastBits after each frame.
+ * One byte answers, such as 4-bit ACK/NAK, are still measured.
+ */
 int
-pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
-                                 const size_t szRx, int timeout)
+pn53x_initiator_raw_session_begin(struct nfc_device *pnd)
+{
+  int res = 0;
+  if (CHIP_DATA(pnd)->raw_session)
+    return NFC_SUCCESS;
+  const bool bCrc = pnd->bCrc;
+  const bool bEasyFraming = pnd->bEasyFraming;
+  pn53x_begin_properties(pnd);
+  if ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, false)) >= 0)
+    res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false);
+  pn53x_commit_properties(pnd);
+  if (res < 0)
+    return res;
+  CHIP_DATA(pnd)->raw_session_crc = bCrc;
+  CHIP_DATA(pnd)->raw_session_easy_framing = bEasyFraming;
+  CHIP_DATA(pnd)->raw_session = true;
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief End a raw-bit session, restoring the framing settings it changed
+ */
+int
+pn53x_initiator_raw_session_end(struct nfc_device *pnd)
+{
+  int res = 0;
+  if (!CHIP_DATA(pnd)->raw_session)
+    return NFC_SUCCESS;
+  CHIP_DATA(pnd)->raw_session = false;
+  pn53x_begin_properties(pnd);
+  if ((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, CHIP_DATA(pnd)->raw_session_crc)) >= 0)
+    res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, CHIP_DATA(pnd)->raw_session_easy_framing);
+  pn53x_commit_properties(pnd);
+  return (res < 0) ? res : NFC_SUCCESS;
+}
+
+// pn53x_initiator_transceive_bytes() body, a single attempt
+static int
+pn53x_initiator_transceive_bytes_once(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
 {
   size_t  szExtraTxLen;
-  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  // Built where drivers can frame it in place
+  uint8_t *abtCmd = pn53x_tx_buffer(pnd);
   int res = 0;
 
   // We can not just send bytes without parity if while the PN53X expects we handled them
@@ -1364,42 +3094,407 @@ pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, c
     return pnd->last_error;
   }
 
+  if ((!pnd->bEasyFraming) && (szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 1)) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+
+  // To transfer command frames bytes we can not have any leading bits, reset this to zero
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  const uint8_t *pbtData = pbtTx;
+  size_t szData = szTx;
+  const bool bChained = pnd->bEasyFraming && (szData > PN53x_IN_DATA_MAX_LEN);
+  if (bChained) {
+    // Longer messages go first in InDataExchange frames with MI set, the chip chains them to the target.
+    // The transaction spans the final frame too, so no other client can slip in before the chain ends
+    if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+      pnd->last_error = res;
+      return pnd->last_error;
+    }
+    abtCmd[0] = InDataExchange;
+    abtCmd[1] = 0x40 | CHIP_DATA(pnd)->current_tg;  /* MI, target number */
+    while ((res >= 0) && (szData > PN53x_IN_DATA_MAX_LEN)) {
+      SCRATCH_INIT(abtStatus, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandRx);
+      memcpy(abtCmd + 2, pbtData, PN53x_IN_DATA_MAX_LEN);
+      res = pn53x_transceive(pnd, abtCmd, PN53x_IN_DATA_MAX_LEN + 2, abtStatus, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, timeout);
+      pbtData += PN53x_IN_DATA_MAX_LEN;
+      szData -= PN53x_IN_DATA_MAX_LEN;
+    }
+    if (res < 0) {
+      if (io->end_transaction)
+        io->end_transaction(pnd);
+      pnd->last_error = res;
+      return pnd->last_error;
+    }
+  }
+
   // Copy the data into the command frame
   if (pnd->bEasyFraming) {
     abtCmd[0] = InDataExchange;
-    abtCmd[1] = 1;              /* target number */
-    memcpy(abtCmd + 2, pbtTx, szTx);
+    abtCmd[1] = CHIP_DATA(pnd)->current_tg;  /* target number */
+    memcpy(abtCmd + 2, pbtData, szData);
     szExtraTxLen = 2;
   } else {
     abtCmd[0] = InCommunicateThru;
-    memcpy(abtCmd + 1, pbtTx, szTx);
+    memcpy(abtCmd + 1, pbtData, szData);
     szExtraTxLen = 1;
   }
 
-  // To transfer command frames bytes we can not have any leading bits, reset this to zero
-  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0) {
+  if ((pbtRx != NULL) && (szRx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN)) {
+    // Answers chained by the target may not fit one PN53x frame, gather them in the caller buffer
+    res = pn53x_transceive(pnd, abtCmd, szData + szExtraTxLen, pbtRx, szRx, timeout);
+    if (bChained && io->end_transaction)
+      io->end_transaction(pnd);
+    if (res < 0) {
+      pnd->last_error = res;
+      return pnd->last_error;
+    }
+    // Status byte is expected first
+    if (res < 1) {
+      pnd->last_error = NFC_EIO;
+      return pnd->last_error;
+    }
+    memmove(pbtRx, pbtRx + 1, res - 1);
+    return res - 1;
+  }
+
+  // Send the frame to the PN53X chip and get the answer
+  // We have to give the amount of bytes + (the two command bytes 0xD4, 0x42)
+  const uint8_t *abtRx;
+  res = pn53x_transceive_view(pnd, abtCmd, szData + szExtraTxLen, &abtRx, timeout);
+  if (bChained && io->end_transaction)
+    io->end_transaction(pnd);
+  if (res < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
+  if (res < 1) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  const size_t szRxLen = (size_t)res - 1;
+  if (pbtRx != NULL) {
+    if (szRxLen >  szRx) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
+      return NFC_EOVFLOW;
+    }
+    // Copy the received bytes
+    memcpy(pbtRx, abtRx + 1, szRxLen);
+  }
+  // Everything went successful, we return received bytes count
+  return szRxLen;
+}
+
+// RF errors a repeat may get over: the frame or its answer was lost or damaged on the way
+static bool
+pn53x_rf_error_is_transient(const uint8_t ui8Status)
+{
+  switch (ui8Status) {
+    case ETIMEOUT:
+    case ECRC:
+    case EPARITY:
+    case EBITCOUNT:
+    case EFRAMING:
+    case EBITCOLL:
+    case ERFTIMEOUT:
+      return true;
+  }
+  return false;
+}
+
+// Commands which neither write nor move the target to another state, so the target may receive them twice
+static bool
+pn53x_initiator_cmd_is_idempotent(const struct nfc_device *pnd, const nfc_target *pnt, const uint8_t *pbtTx, const size_t szTx)
+{
+  if ((szTx == 0) || (szTx > PN53x_IN_DATA_MAX_LEN) || (!pnd->bEasyFraming))
+    return false;
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      // ISO-DEP blocks are numbered by the chip, MIFARE Classic loses its authentication on error
+      if (((pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) && pnd->bAutoIso14443_4) || (pnt->nti.nai.btSak & 0x08))
+        return false;
+      switch (pbtTx[0]) {
+        case 0x30:    // READ
+        case 0x39:    // READ_CNT
+        case 0x3A:    // FAST_READ
+        case 0x3C:    // READ_SIG
+        case 0x60:    // GET_VERSION
+          return true;
+      }
+      return false;
+    case NMT_FELICA:
+      // LEN, command code
+      if (szTx < 2)
+        return false;
+      switch (pbtTx[1]) {
+        case 0x00:    // Polling
+        case 0x02:    // Request Service
+        case 0x04:    // Request Response
+        case 0x06:    // Read Without Encryption
+        case 0x0A:    // Search Service Code
+        case 0x0C:    // Request System Code
+          return true;
+      }
+      return false;
+    case NMT_JEWEL:
+      switch (pbtTx[0]) {
+        case 0x00:    // RALL
+        case 0x01:    // READ
+        case 0x02:    // READ8
+        case 0x10:    // RSEG
+        case 0x78:    // RID
+          return true;
+      }
+      return false;
+    case NMT_ISO14443B:
+    case NMT_ISO14443BI:
+    case NMT_ISO14443B2SR:
+    case NMT_ISO14443B2CT:
+    case NMT_DEP:
+      break;
+  }
+  return false;
+}
+
+/*
+ * Wake the current target up again after an RF error sent it back to its
+ * idle state, selecting it straight by its UID. It must still be the target
+ * answering: commands which follow are sent to whichever target was selected.
+ */
+static int
+pn53x_initiator_rewake(struct nfc_device *pnd, int timeout)
+{
+  const nfc_target *pnt = CHIP_DATA(pnd)->current_target;
+  uint8_t abtInit[12];
+  size_t szInit = 0;
+  uint8_t abtTargetsData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szTargetsData = sizeof(abtTargetsData);
+  nfc_target nt = { .nm = pnt->nm };
+  int res;
+
+  if (pnt->nm.nmt == NMT_ISO14443A)
+    iso14443_cascade_uid(pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, abtInit, &szInit);
+  if ((timeout <= 0) || (timeout > PN53X_REWAKE_TIMEOUT))
+    timeout = PN53X_REWAKE_TIMEOUT;
+  if ((res = pn53x_InListPassiveTarget(pnd, pn53x_nm_to_pm(pnt->nm), 1, szInit ? abtInit : NULL, szInit, abtTargetsData, &szTargetsData, timeout)) < 0)
+    return res;
+  if ((res > 0) && (szTargetsData > 1) &&
+      (pn53x_decode_target_data(abtTargetsData + 1, szTargetsData - 1, CHIP_DATA(pnd)->type, pnt->nm.nmt, &(nt.nti)) >= 0)) {
+    const uint8_t *pbtUid, *pbtWokenUid;
+    const size_t szUid = pn53x_target_uid(pnt, &pbtUid);
+    if ((pn53x_target_uid(&nt, &pbtWokenUid) == szUid) && (memcmp(pbtUid, pbtWokenUid, szUid) == 0)) {
+      // Woken as Tg 1, a second target listed with it was released
+      pn53x_current_target_new(pnd, pnt);
+      return NFC_SUCCESS;
+    }
+  }
+  // Gone, or another target answered in its place
+  pn53x_current_target_free(pnd);
+  return NFC_ETGRELEASED;
+}
+
+int
+pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                 const size_t szRx, int timeout)
+{
+  int res = pn53x_initiator_transceive_bytes_once(pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+
+  // Repeat in place what a transient RF error prevented, instead of leaving the application to select again
+  for (int retry = 0; (res == NFC_ERFTRANS) && (retry < CHIP_DATA(pnd)->rf_retries); retry++) {
+    const nfc_target *pnt = CHIP_DATA(pnd)->current_target;
+    if ((!pnt) || (!pn53x_rf_error_is_transient(CHIP_DATA(pnd)->last_status_byte)) ||
+        (!pn53x_initiator_cmd_is_idempotent(pnd, pnt, pbtTx, szTx)))
+      break;
+    if ((pnt->nm.nmt == NMT_ISO14443A) || (pnt->nm.nmt == NMT_JEWEL)) {
+      // These targets go back to their idle state on any error
+      int rewake;
+      pnd->stats.rf_rewakes++;
+      if ((rewake = pn53x_initiator_rewake(pnd, timeout)) < 0) {
+        pnd->last_error = rewake;
+        return pnd->last_error;
+      }
+    }
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "RF error 0x%02x, repeating the command (%d/%d)", CHIP_DATA(pnd)->last_status_byte, retry + 1, CHIP_DATA(pnd)->rf_retries);
+    pnd->stats.rf_retries++;
+    res = pn53x_initiator_transceive_bytes_once(pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+  }
+  return res;
+}
+
+// Exchanges which can go to the target in a single pn53x_io.transceive_batch() call
+static size_t
+pn53x_initiator_batch_len(struct nfc_device *pnd, const nfc_exchange *pex, const size_t szExchanges)
+{
+  // Repeats after RF errors are decided between frames, so they need frames sent one by one
+  if ((!PN53X_IO(pnd)->transceive_batch) || (!pnd->bEasyFraming) || (!pnd->bPar) || (CHIP_DATA(pnd)->rf_retries > 0))
+    return 0;
+  size_t n;
+  for (n = 0; (n < szExchanges) && (n < PN53X_CMD_QUEUE_MAX_LEN); n++) {
+    if ((pex[n].szTx == 0) || (pex[n].szTx > PN53x_IN_DATA_MAX_LEN))
+      break;
+  }
+  return n;
+}
+
+// Send InDataExchange frames through pn53x_io.transceive_batch(), returns the count of successful exchanges
+static int
+pn53x_initiator_transceive_batch(struct nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout)
+{
+  const size_t szFrame = 2 + PN53x_IN_DATA_MAX_LEN;
+  const size_t szAnswer = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
+  SCRATCH_INIT(abtFrames, PN53X_CMD_QUEUE_MAX_LEN * (2 + PN53x_IN_DATA_MAX_LEN), CHIP_DATA(pnd)->workspace.abtBatchFrames);
+  SCRATCH_INIT(abtAnswers, PN53X_CMD_QUEUE_MAX_LEN * PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtBatchAnswers);
+  struct pn53x_cmd cmds[PN53X_CMD_QUEUE_MAX_LEN];
+  int res;
+
+  if (((res = pn53x_set_tx_bits(pnd, 0)) < 0) || ((res = pn53x_transceive_prepare(pnd, InDataExchange, true)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  for (size_t i = 0; i < szExchanges; i++) {
+    uint8_t *pbtFrame = abtFrames + (i * szFrame);
+    pbtFrame[0] = InDataExchange;
+    pbtFrame[1] = CHIP_DATA(pnd)->current_tg;  /* target number */
+    memcpy(pbtFrame + 2, pex[i].pbtTx, pex[i].szTx);
+    cmds[i].pbtTx = pbtFrame;
+    cmds[i].szTx = pex[i].szTx + 2;
+    cmds[i].pbtRx = abtAnswers + (i * szAnswer);
+    cmds[i].szRxLen = szAnswer;
+    cmds[i].res = NFC_EOPABORTED;
+    cmds[i].bRepeatable = CHIP_DATA(pnd)->current_target && pn53x_initiator_cmd_is_idempotent(pnd, CHIP_DATA(pnd)->current_target, pex[i].pbtTx, pex[i].szTx);
+  }
+  timeout = pn53x_resolve_timeout(pnd, timeout);
+
+  const uint64_t t0 = nfc_clock_us();
+  if ((res = PN53X_IO(pnd)->transceive_batch(pnd, cmds, szExchanges, timeout)) < 0) {
+    if (res == NFC_ETIMEOUT)
+      pnd->stats.timeouts++;
+    pnd->last_error = res;
+    return res;
+  }
+  const size_t szRun = (size_t) res;
+  const uint64_t t1 = nfc_clock_us();
+  CHIP_DATA(pnd)->last_command = InDataExchange;
+  CHIP_DATA(pnd)->last_tx_start = t0;
+  CHIP_DATA(pnd)->last_tx_end = t0;
+  CHIP_DATA(pnd)->last_rx_end = t1;
+  pn53x_stats_latency(&(pnd->stats.chip_latency), t0, t1);
+
+  size_t i;
+  for (i = 0; i < szExchanges; i++) {
+    if (i >= szRun) {
+      // The link stopped without reporting a failure
+      pex[i].res = res = NFC_EIO;
+      break;
+    }
+    pnd->stats.commands[InDataExchange]++;
+    pnd->stats.bytes_tx += cmds[i].szTx;
+    CAPTURE_FRAME(pnd, NFC_CAPTURE_TX, InDataExchange, 0, cmds[i].pbtTx, cmds[i].szTx);
+    if ((res = cmds[i].res) <= 0) {
+      pex[i].res = res = (res == 0) ? NFC_EIO : res;
+      break;
+    }
+    pnd->stats.bytes_rx += res;
+    // Answers chained by the target were gathered on the other side of the link
+    pn53x_answer_status(pnd, cmds[i].pbtTx, cmds[i].pbtRx);
+    CAPTURE_FRAME(pnd, NFC_CAPTURE_RX, InDataExchange, CHIP_DATA(pnd)->last_status_byte, cmds[i].pbtRx, res);
+    if ((res = pn53x_status_error(pnd, res)) < 0) {
+      pex[i].res = res;
+      break;
+    }
+    const size_t szRx = (size_t) res - 1;
+    if (pex[i].pbtRx) {
+      if (szRx > pex[i].szRx) {
+        pnd->last_error = pex[i].res = res = NFC_EOVFLOW;
+        break;
+      }
+      memcpy(pex[i].pbtRx, cmds[i].pbtRx + 1, szRx);
+    }
+    pex[i].res = (int) szRx;
+  }
+  pnd->last_error = (res < 0) ? res : 0;
+  return (int) i;
+}
+
+/**
+ * @brief Exchange several frames with the selected target, stopping at the first failure
+ * @return Returns the count of successful exchanges, otherwise returns libnfc's error code of the first failing one
+ *
+ * When the driver can ship frames together (see pn53x_io.transceive_batch),
+ * up to PN53X_CMD_QUEUE_MAX_LEN exchanges go in each call, otherwise frames
+ * are exchanged one by one within a single bus transaction.
+ */
+int
+pn53x_initiator_transceive_bytes_batch(struct nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  size_t done = 0;
+  int res = 0;
+
+  for (size_t i = 0; i < szExchanges; i++)
+    pex[i].res = NFC_EOPABORTED;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  while ((res >= 0) && (done < szExchanges)) {
+    const size_t n = pn53x_initiator_batch_len(pnd, pex + done, szExchanges - done);
+    if (n < 2) {
+      nfc_exchange *pe = pex + done;
+      if ((res = pe->res = pn53x_initiator_transceive_bytes(pnd, pe->pbtTx, pe->szTx, pe->pbtRx, pe->szRx, timeout)) >= 0)
+        done++;
+      continue;
+    }
+    if ((res = pn53x_initiator_transceive_batch(pnd, pex + done, n, timeout)) < 0)
+      break;
+    done += res;
+    res = (res < (int) n) ? pex[done].res : NFC_SUCCESS;
+  }
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  return (res < 0) ? res : (int) done;
+}
 
-  // Send the frame to the PN53X chip and get the answer
-  // We have to give the amount of bytes + (the two command bytes 0xD4, 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + szExtraTxLen, abtRx, sizeof(abtRx), timeout)) < 0) {
+/**
+ * @brief Exchange a command frame with the chip, without interpreting the answer
+ * @return Returns the answer length, otherwise returns libnfc's error code (negative value) when nothing was received
+ *
+ * The answer is returned as the bus delivered it, status byte first for data
+ * exchange commands. Chained (MI) answers are gathered, and an answer carrying
+ * a chip error is reduced to its status byte: the error is not reported here.
+ * This relays frames built by another host, see pn53x-remote-agent.
+ */
+int
+pn53x_transceive_raw(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  const uint8_t *pbtView = NULL;
+  int res;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
     pnd->last_error = res;
-    return pnd->last_error;
+    return res;
   }
-  const size_t szRxLen = (size_t)res - 1;
-  if (pbtRx != NULL) {
-    if (szRxLen >  szRx) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
-      return NFC_EOVFLOW;
-    }
-    // Copy the received bytes
-    memcpy(pbtRx, abtRx + 1, szRxLen);
+  CHIP_DATA(pnd)->last_status_byte = 0;
+  res = pn53x_transceive_flush(pnd, pbtTx, szTx, NULL, 0, &pbtView, timeout);
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  if ((res < 0) && (CHIP_DATA(pnd)->last_status_byte != 0) && pbtView) {
+    pbtRx[0] = pbtView[0] & 0x3f;
+    return 1;
   }
-  // Everything went successful, we return received bytes count
-  return szRxLen;
+  if (res < 0)
+    return res;
+  if ((size_t) res > szRxLen) {
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtRx, pbtView, res);
+  return res;
 }
 
 static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles)
@@ -1416,41 +3511,20 @@ static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles
     CHIP_DATA(pnd)->timer_prescaler = 0;
   }
   uint16_t reloadval = 0xFFFF;
-  // Initialize timer
+  // Initialize timer: these writes are deferred and dropped by the writeback
+  // cache when shadow registers show the timer is already configured this way
   pn53x_write_register(pnd, PN53X_REG_CIU_TMode, 0xFF, SYMBOL_TAUTO | ((CHIP_DATA(pnd)->timer_prescaler >> 8) & SYMBOL_TPRESCALERHI));
   pn53x_write_register(pnd, PN53X_REG_CIU_TPrescaler, 0xFF, (CHIP_DATA(pnd)->timer_prescaler & SYMBOL_TPRESCALERLO));
   pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_hi, 0xFF, (reloadval >> 8) & 0xFF);
   pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_lo, 0xFF, reloadval & 0xFF);
 }
 
-static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint8_t last_cmd_byte)
+// Compute elapsed cycles from TCounterVal registers, read along with the FIFO
+static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint8_t last_cmd_byte, const uint16_t counter)
 {
   uint8_t parity;
-  uint8_t counter_hi, counter_lo;
-  uint16_t counter, u16cycles;
+  uint16_t u16cycles;
   uint32_t u32cycles;
-  size_t off = 0;
-  if (CHIP_DATA(pnd)->type == PN533) {
-    // PN533 prepends its answer by a status byte
-    off = 1;
-  }
-  // Read timer
-  BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
-  uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t szRes = sizeof(abtRes);
-  // Let's send the previously constructed ReadRegister command
-  if (pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1) < 0) {
-    return false;
-  }
-  counter_hi = abtRes[off];
-  counter_lo = abtRes[off + 1];
-  counter = counter_hi;
-  counter = (counter << 8) + counter_lo;
   if (counter == 0) {
     // counter saturated
     u32cycles = 0xFFFFFFFF;
@@ -1492,6 +3566,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   (void) pbtRxPar;
   uint16_t i;
   uint8_t sz = 0;
+  uint16_t counter = 0;
   int res = 0;
   size_t szRxBits = 0;
 
@@ -1516,9 +3591,8 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   // Once timer is started, we cannot use Tama commands anymore.
   // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
   //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+  // Prepare FIFO, timer settings (if they changed) are sent within the same WriteRegister frame
+  BUFFER_INIT_SCRATCH(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 1 - (3 * PN53X_CACHE_REGISTER_SIZE), CHIP_DATA(pnd)->workspace.abtCommandTx);
 
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
@@ -1536,7 +3610,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming & 0xff);
   BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_START_SEND | ((szTxBits % 8) & SYMBOL_TX_LAST_BITS));
   // Let's send the previously constructed WriteRegister command
-  if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
+  if ((res = pn53x_writeback_register_ext(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd))) < 0) {
     return res;
   }
 
@@ -1556,7 +3630,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     off = 1;
   }
   while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_INIT_SCRATCH(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandTx);
     BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
     for (i = 0; i < sz; i++) {
       BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
@@ -1564,8 +3638,13 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     }
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
+    // Timer is stopped since data are received: read it now to save a round trip
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
+    SCRATCH_INIT(abtRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandRx);
+    size_t szRes = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
     // Let's send the previously constructed ReadRegister command
     if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
       return res;
@@ -1574,6 +3653,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
       pbtRx[i + szRxBits] = abtRes[i + off];
     }
     szRxBits += (size_t)(sz & SYMBOL_FIFO_LEVEL);
+    counter = (abtRes[sz + off + 1] << 8) | abtRes[sz + off + 2];
     sz = abtRes[sz + off];
     if (sz == 0)
       break;
@@ -1581,7 +3661,7 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
   szRxBits *= 8; // in bits, not bytes
 
   // Recv corrected timer value
-  *cycles = __pn53x_get_timer(pnd, pbtTx[szTxBits / 8]);
+  *cycles = __pn53x_get_timer(pnd, pbtTx[szTxBits / 8], counter);
 
   return szRxBits;
 }
@@ -1591,6 +3671,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
 {
   uint16_t i;
   uint8_t sz = 0;
+  uint16_t counter = 0;
   int res = 0;
 
   // We can not just send bytes without parity while the PN53X expects we handled them
@@ -1610,9 +3691,8 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
   // Once timer is started, we cannot use Tama commands anymore.
   // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
   //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+  // Prepare FIFO, timer settings (if they changed) are sent within the same WriteRegister frame
+  BUFFER_INIT_SCRATCH(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN - 1 - (3 * PN53X_CACHE_REGISTER_SIZE), CHIP_DATA(pnd)->workspace.abtCommandTx);
 
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
@@ -1630,7 +3710,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
   BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming & 0xff);
   BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_START_SEND);
   // Let's send the previously constructed WriteRegister command
-  if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
+  if ((res = pn53x_writeback_register_ext(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd))) < 0) {
     return res;
   }
 
@@ -1651,7 +3731,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     off = 1;
   }
   while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_INIT_SCRATCH(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandTx);
     BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
     for (i = 0; i < sz; i++) {
       BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
@@ -1659,8 +3739,13 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     }
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
     BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
+    // Timer is stopped since data are received: read it now to save a round trip
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
+    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
+    SCRATCH_INIT(abtRes, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, CHIP_DATA(pnd)->workspace.abtCommandRx);
+    size_t szRes = PN53x_EXTENDED_FRAME__DATA_MAX_LEN;
     // Let's send the previously constructed ReadRegister command
     if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
       return res;
@@ -1676,6 +3761,7 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
       }
     }
     szRxLen += (size_t)(sz & SYMBOL_FIFO_LEVEL);
+    counter = (abtRes[sz + off + 1] << 8) | abtRes[sz + off + 2];
     sz = abtRes[sz + off];
     if (sz == 0)
       break;
@@ -1683,17 +3769,11 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
 
   // Recv corrected timer value
   if (pnd->bCrc) {
-    // We've to compute CRC ourselves to know last byte actually sent
-    uint8_t *pbtTxRaw;
-    pbtTxRaw = (uint8_t *) malloc(szTx + 2);
-    if (!pbtTxRaw)
-      return NFC_ESOFT;
-    memcpy(pbtTxRaw, pbtTx, szTx);
-    iso14443a_crc_append(pbtTxRaw, szTx);
-    *cycles = __pn53x_get_timer(pnd, pbtTxRaw[szTx + 1]);
-    free(pbtTxRaw);
+    // We've to compute CRC ourselves to know last byte actually sent, its most significant byte
+    const uint16_t wCrc = iso14443_crc_update(ISO14443A_CRC_INIT, pbtTx, szTx) ^ ISO14443A_CRC_XOROUT;
+    *cycles = __pn53x_get_timer(pnd, (uint8_t)(wCrc >> 8), counter);
   } else {
-    *cycles = __pn53x_get_timer(pnd, pbtTx[szTx - 1]);
+    *cycles = __pn53x_get_timer(pnd, pbtTx[szTx - 1], counter);
   }
   return szRxLen;
 }
@@ -1705,14 +3785,10 @@ pn53x_initiator_deselect_target(struct nfc_device *pnd)
   return pn53x_InDeselect(pnd, 0);    // 0 mean deselect all selected targets
 }
 
-int
-pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt)
+// Card Presence test of the chip, for ISO-DEP and DEP targets
+static int
+pn53x_Diagnose06(struct nfc_device *pnd)
 {
-  // Check if the argument target nt is equals to current saved target
-  if (!pn53x_current_target_is(pnd, pnt)) {
-    return NFC_ETGRELEASED;
-  }
-
   // Send Card Presence command
   const uint8_t abtCmd[] = { Diagnose, 0x06 };
   uint8_t abtRx[1];
@@ -1732,15 +3808,81 @@ pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt)
   return NFC_ETGRELEASED;
 }
 
-#define SAK_ISO14443_4_COMPLIANT 0x20
-#define SAK_ISO18092_COMPLIANT   0x40
 int
-pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt)
 {
-  pn53x_reset_settings(pnd);
+  // Check if the argument target nt is equals to current saved target
+  if (!pn53x_current_target_is(pnd, pnt)) {
+    return NFC_ETGRELEASED;
+  }
+
+  uint8_t abtCmd[2 + 10] = { InDataExchange, CHIP_DATA(pnd)->current_tg };
+  size_t szCmd = 2;
+  uint8_t abtRx[1 + 32];
+  int res = 0;
+
+  // Pick the cheapest command which gets an answer from this kind of target
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      if ((pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) && (pnd->bAutoIso14443_4)) {
+        // ISO-DEP: the chip has its own presence check
+        return pn53x_Diagnose06(pnd);
+      }
+      if (pnt->nti.nai.btSak != 0x00) {
+        // MIFARE Classic NAKs an unauthenticated READ and halts: select it again by its UID instead,
+        // which loses the authentication as any other command would
+        return pn53x_initiator_rewake(pnd, -1);
+      }
+      // MIFARE Ultralight / NTAG: READ page 0, a NAK answer still means the card is there
+      abtCmd[szCmd++] = 0x30;
+      abtCmd[szCmd++] = 0x00;
+      break;
+    case NMT_FELICA:
+      // Request Response
+      abtCmd[szCmd++] = 10;
+      abtCmd[szCmd++] = 0x04;
+      memcpy(abtCmd + szCmd, pnt->nti.nfi.abtId, 8);
+      szCmd += 8;
+      break;
+    case NMT_JEWEL:
+      // RID
+      memcpy(abtCmd + szCmd, "\x78\x00\x00\x00\x00\x00\x00", 7);
+      szCmd += 7;
+      break;
+    case NMT_ISO14443B2SR:
+      // Get_UID, target is handled by hand
+      abtCmd[0] = InCommunicateThru;
+      abtCmd[1] = 0x0b;
+      break;
+    case NMT_ISO14443B2CT:
+      // Read UID_MSB, target is handled by hand
+      abtCmd[0] = InCommunicateThru;
+      abtCmd[1] = 0xc4;
+      break;
+    case NMT_ISO14443B:
+    case NMT_ISO14443BI:
+    case NMT_DEP:
+      // ISO-DEP or DEP: the chip has its own presence check
+      return pn53x_Diagnose06(pnd);
+  }
+
+  if ((abtCmd[0] == InCommunicateThru) && ((res = pn53x_set_tx_bits(pnd, 0)) < 0))
+    return res;
+  if ((res = pn53x_transceive(pnd, abtCmd, szCmd, abtRx, sizeof(abtRx), -1)) >= 0)
+    return NFC_SUCCESS;
+  if ((res == NFC_ERFTRANS) && (CHIP_DATA(pnd)->last_status_byte != ETIMEOUT) && (CHIP_DATA(pnd)->last_status_byte != ERFTIMEOUT))
+    return NFC_SUCCESS;
+  if ((res != NFC_ERFTRANS) && (res != NFC_ETIMEOUT))
+    return res;
 
-  CHIP_DATA(pnd)->operating_mode = TARGET;
+  // Target is not reachable anymore
+  pn53x_current_target_free(pnd);
+  return NFC_ETGRELEASED;
+}
 
+int
+pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
   pn53x_target_mode ptm = PTM_NORMAL;
   int res = 0;
 
@@ -1751,22 +3893,15 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
         pnd->last_error = NFC_EINVARG;
         return pnd->last_error;
       }
-      pn53x_set_parameters(pnd, PARAM_AUTO_ATR_RES, false);
-      if (CHIP_DATA(pnd)->type == PN532) { // We have a PN532
-        if ((pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) && (pnd->bAutoIso14443_4)) {
-          // We have a ISO14443-4 tag to emulate and NP_AUTO_14443_4A option is enabled
-          ptm |= PTM_ISO14443_4_PICC_ONLY; // We add ISO14443-4 restriction
-          pn53x_set_parameters(pnd, PARAM_14443_4_PICC, true);
-        } else {
-          pn53x_set_parameters(pnd, PARAM_14443_4_PICC, false);
-        }
+      if ((CHIP_DATA(pnd)->type == PN532) && (pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) && (pnd->bAutoIso14443_4)) {
+        // We have a ISO14443-4 tag to emulate and NP_AUTO_14443_4A option is enabled
+        ptm |= PTM_ISO14443_4_PICC_ONLY; // We add ISO14443-4 restriction
       }
       break;
     case NMT_FELICA:
       ptm = PTM_PASSIVE_ONLY;
       break;
     case NMT_DEP:
-      pn53x_set_parameters(pnd, PARAM_AUTO_ATR_RES, true);
       ptm = PTM_DEP_ONLY;
       if (pnt->nti.ndi.ndm == NDM_PASSIVE) {
         ptm |= PTM_PASSIVE_ONLY; // We add passive mode restriction
@@ -1782,10 +3917,6 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
       break;
   }
 
-  // Let the PN53X be activated by the RF level detector from power down mode
-  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxAuto, SYMBOL_INITIAL_RF_ON, 0x04)) < 0)
-    return res;
-
   uint8_t abtMifareParams[6];
   uint8_t *pbtMifareParams = NULL;
   uint8_t *pbtTkt = NULL;
@@ -1884,12 +4015,46 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
       break;
   }
 
+  uint8_t abtCmd[PN53X_TG_INIT_FRAME_MAX_LEN];
+  const size_t szCmd = pn53x_TgInitAsTarget_frame(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, abtCmd);
+
+  // Re-arming with the same frame while nothing changed since last activation
+  // (eg. after the field went off) only needs the TgInitAsTarget command
+  if ((!CHIP_DATA(pnd)->target_armed) || (CHIP_DATA(pnd)->operating_mode != TARGET) ||
+      (!pnd->bCrc) || (!pnd->bPar) || (!pnd->bEasyFraming) ||
+      (szCmd != CHIP_DATA(pnd)->szTgInitFrame) || (memcmp(abtCmd, CHIP_DATA(pnd)->abtTgInitFrame, szCmd) != 0)) {
+    pn53x_reset_settings(pnd);
+
+    CHIP_DATA(pnd)->operating_mode = TARGET;
+
+    switch (pnt->nm.nmt) {
+      case NMT_ISO14443A:
+        pn53x_set_parameters(pnd, PARAM_AUTO_ATR_RES, false);
+        if (CHIP_DATA(pnd)->type == PN532) { // We have a PN532
+          pn53x_set_parameters(pnd, PARAM_14443_4_PICC, (ptm & PTM_ISO14443_4_PICC_ONLY) ? true : false);
+        }
+        break;
+      case NMT_DEP:
+        pn53x_set_parameters(pnd, PARAM_AUTO_ATR_RES, true);
+        break;
+      default:
+        break;
+    }
+
+    // Let the PN53X be activated by the RF level detector from power down mode
+    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxAuto, SYMBOL_INITIAL_RF_ON, 0x04)) < 0)
+      return res;
+
+    memcpy(CHIP_DATA(pnd)->abtTgInitFrame, abtCmd, szCmd);
+    CHIP_DATA(pnd)->szTgInitFrame = szCmd;
+  }
+
   bool targetActivated = false;
   size_t szRx;
   while (!targetActivated) {
     uint8_t btActivatedMode;
 
-    if ((res = pn53x_TgInitAsTarget(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, pbtRx, szRxLen, &btActivatedMode, timeout)) < 0) {
+    if ((res = pn53x_TgInitAsTarget_send(pnd, abtCmd, szCmd, pbtRx, szRxLen, &btActivatedMode, timeout)) < 0) {
       if (res == NFC_ETIMEOUT) {
         return pn53x_idle(pnd);
       }
@@ -1938,6 +4103,8 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
     }
 
     if (targetActivated) {
+      // Pending register writes went with TgInitAsTarget, the chip is set up for this frame
+      CHIP_DATA(pnd)->target_armed = true;
       pnt->nm.nbr = nm.nbr; // Update baud rate
       if (pnt->nm.nmt == NMT_DEP) {
         pnt->nti.ndi.ndm = ndm; // Update DEP mode
@@ -1951,6 +4118,9 @@ pn53x_target_init(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const
         // When PN532 is in PICC target mode, it automatically reply to RATS so
         // we don't need to forward this command
         szRx = 0;
+      } else {
+        // The command returned by TgInitAsTarget is waiting for an answer
+        CHIP_DATA(pnd)->target_rx_time = CHIP_DATA(pnd)->last_rx_end;
       }
     }
   }
@@ -1971,6 +4141,7 @@ pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t s
   // Try to gather a received frame from the reader
   if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, szRx, -1)) < 0)
     return res;
+  const uint64_t rx_time = CHIP_DATA(pnd)->last_rx_end;
   szRx = (size_t) res;
   // Get the last bit-count that is stored in the received byte
   uint8_t ui8rcc;
@@ -1997,6 +4168,7 @@ pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t s
     // Copy the received bytes
     memcpy(pbtRx, abtRx + 1, szRx - 1);
   }
+  CHIP_DATA(pnd)->target_rx_time = rx_time;
   // Everyting seems ok, return received bits count
   return szRxBits;
 }
@@ -2042,9 +4214,15 @@ pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t
 
   // Try to gather a received frame from the reader
   uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t *pbtFrame = abtRx;
   size_t szRx = sizeof(abtRx);
   int res = 0;
-  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, szRx, timeout)) < 0)
+  if (szRxLen > sizeof(abtRx)) {
+    // Frames chained by the reader may not fit one PN53x frame, gather them in the caller buffer
+    pbtFrame = pbtRx;
+    szRx = szRxLen;
+  }
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), pbtFrame, szRx, timeout)) < 0)
     return pnd->last_error;
   szRx = (size_t) res;
   // Save the received bytes count
@@ -2054,7 +4232,8 @@ pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t
     return NFC_EOVFLOW;
 
   // Copy the received bytes
-  memcpy(pbtRx, abtRx + 1, szRx);
+  memmove(pbtRx, pbtFrame + 1, szRx);
+  CHIP_DATA(pnd)->target_rx_time = CHIP_DATA(pnd)->last_rx_end;
 
   // Everyting seems ok, return received bytes count
   return szRx;
@@ -2096,6 +4275,7 @@ pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_
   // Try to send the bits to the reader
   if ((res = pn53x_transceive(pnd, abtCmd, szFrameBytes + 1, NULL, 0, -1)) < 0)
     return res;
+  pn53x_target_stats(pnd, CHIP_DATA(pnd)->last_tx_start);
 
   // Everyting seems ok, return return sent bits count
   return szTxBits;
@@ -2138,6 +4318,7 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
       case NMT_ISO14443B2SR:
       case NMT_ISO14443B2CT:
       case NMT_FELICA:
+      default:
         abtCmd[0] = TgResponseToInitiator;
         break;
     }
@@ -2145,17 +4326,62 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
     abtCmd[0] = TgResponseToInitiator;
   }
 
+  const uint8_t *pbtData = pbtTx;
+  size_t szData = szTx;
+  uint64_t first_tx_start = 0;
+  if ((abtCmd[0] == TgSetData) && (szData > PN53x_TG_DATA_MAX_LEN)) {
+    // Longer answers go first in TgSetMetaData frames (MI set), the chip chains them to the reader
+    abtCmd[0] = TgSetMetaData;
+    while (szData > PN53x_TG_DATA_MAX_LEN) {
+      memcpy(abtCmd + 1, pbtData, PN53x_TG_DATA_MAX_LEN);
+      if ((res = pn53x_transceive(pnd, abtCmd, PN53x_TG_DATA_MAX_LEN + 1, NULL, 0, timeout)) < 0)
+        return res;
+      if (!first_tx_start)
+        first_tx_start = CHIP_DATA(pnd)->last_tx_start;
+      pbtData += PN53x_TG_DATA_MAX_LEN;
+      szData -= PN53x_TG_DATA_MAX_LEN;
+    }
+    abtCmd[0] = TgSetData;
+  } else if (szData >= sizeof(abtCmd)) {
+    return NFC_EOVFLOW;
+  }
+
   // Copy the data into the command frame
-  memcpy(abtCmd + 1, pbtTx, szTx);
+  memcpy(abtCmd + 1, pbtData, szData);
 
   // Try to send the bits to the reader
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + 1, NULL, 0, timeout)) < 0)
+  if ((res = pn53x_transceive(pnd, abtCmd, szData + 1, NULL, 0, timeout)) < 0)
     return res;
+  pn53x_target_stats(pnd, (first_tx_start) ? first_tx_start : CHIP_DATA(pnd)->last_tx_start);
 
   // Everyting seems ok, return sent byte count
   return szTx;
 }
 
+/**
+ * @brief Send an answer to the initiator then wait for its next command
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code
+ *
+ * Both commands are kept in a single bus transaction: the command fetching
+ * the next frame is queued as soon as the chip has acknowledged the answer,
+ * without giving the hand back to the application in between.
+ */
+int
+pn53x_target_send_receive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  const struct pn53x_io *io = PN53X_IO(pnd);
+  int res;
+  if (io->begin_transaction && ((res = io->begin_transaction(pnd)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  if ((res = pn53x_target_send_bytes(pnd, pbtTx, szTx, timeout)) >= 0)
+    res = pn53x_target_receive_bytes(pnd, pbtRx, szRx, timeout);
+  if (io->end_transaction)
+    io->end_transaction(pnd);
+  return res;
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -2227,7 +4453,11 @@ pn53x_RFConfiguration__Various_timings(struct nfc_device *pnd, const uint8_t fAT
     fATR_RES_Timeout,	 // ATR_RES timeout (default: 0x0B 102.4 ms)
     fRetryTimeout	 // TimeOut during non-DEP communications (default: 0x0A 51.2 ms)
   };
-  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
+  int res;
+  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0)
+    return res;
+  CHIP_DATA(pnd)->ui8RetryTimeout = fRetryTimeout;
+  return res;
 }
 
 int
@@ -2255,6 +4485,17 @@ pn53x_RFConfiguration__MaxRetries(struct nfc_device *pnd, const uint8_t MxRtyATR
   return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
 }
 
+int
+pn53x_RFConfiguration__Analog_settings(struct nfc_device *pnd, const uint8_t ui8CfgItem, const uint8_t *pbtSettings, const size_t szSettings)
+{
+  uint8_t  abtCmd[2 + NFC_RF_ANALOG_MAX_LEN] = { RFConfiguration, ui8CfgItem };
+
+  if (szSettings > NFC_RF_ANALOG_MAX_LEN)
+    return NFC_EINVARG;
+  memcpy(abtCmd + 2, pbtSettings, szSettings);
+  return pn53x_transceive(pnd, abtCmd, 2 + szSettings, NULL, 0, -1);
+}
+
 int
 pn53x_SetParameters(struct nfc_device *pnd, const uint8_t ui8Value)
 {
@@ -2302,11 +4543,23 @@ pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode sam_mode, in
 int
 pn53x_PowerDown(struct nfc_device *pnd)
 {
-  uint8_t  abtCmd[] = { PowerDown, 0xf0 };
+  return pn53x_PowerDown_wakeup(pnd, PN532_WAKEUP_HOST);
+}
+
+/*
+ * Unlike LowVbat, the state after power-up, PowerDown keeps the chip
+ * configured: waking it up only takes the host interface wake-up sequence,
+ * no SAMConfiguration. The chip may also wake up by itself (RF, INT0/1),
+ * the wake-up sequence is harmless then.
+ */
+int
+pn53x_PowerDown_wakeup(struct nfc_device *pnd, const uint8_t ui8WakeUpEnable)
+{
+  uint8_t  abtCmd[] = { PowerDown, ui8WakeUpEnable };
   int res;
   if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0)
     return res;
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  CHIP_DATA(pnd)->power_mode = POWERDOWN;
   return res;
 }
 
@@ -2431,36 +4684,17 @@ pn53x_InRelease(struct nfc_device *pnd, const uint8_t ui8Target)
   return (res >= 0) ? NFC_SUCCESS : res;
 }
 
-int
-pn53x_InAutoPoll(struct nfc_device *pnd,
-                 const pn53x_target_type *ppttTargetTypes, const size_t szTargetTypes,
-                 const uint8_t btPollNr, const uint8_t btPeriod, nfc_target *pntTargets, const int timeout)
+// Decode InAutoPoll answer into up to two targets, returns targets count
+static int
+pn53x_InAutoPoll_decode(struct nfc_device *pnd, const uint8_t *pbtRx, const size_t szRx, nfc_target *pntTargets)
 {
   size_t szTargetFound = 0;
-  if (CHIP_DATA(pnd)->type != PN532) {
-    // This function is not supported by pn531 neither pn533
-    pnd->last_error = NFC_EDEVNOTSUPP;
-    return pnd->last_error;
-  }
-
-  // InAutoPoll frame looks like this { 0xd4, 0x60, 0x0f, 0x01, 0x00 } => { direction, command, pollnr, period, types... }
-  size_t szTxInAutoPoll = 3 + szTargetTypes;
-  uint8_t abtCmd[3 + 15] = { InAutoPoll, btPollNr, btPeriod };
-  for (size_t n = 0; n < szTargetTypes; n++) {
-    abtCmd[3 + n] = ppttTargetTypes[n];
-  }
-
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
-  int res = pn53x_transceive(pnd, abtCmd, szTxInAutoPoll, abtRx, szRx, timeout);
-  szRx = (size_t) res;
-  if (res < 0) {
-    return res;
-  } else if (szRx > 0) {
-    szTargetFound = abtRx[0];
+  int res = 0;
+  if (szRx > 0) {
+    szTargetFound = pbtRx[0];
     if (szTargetFound > 0) {
       uint8_t ln;
-      uint8_t *pbt = abtRx + 1;
+      const uint8_t *pbt = pbtRx + 1;
       /* 1st target */
       // Target type
       pn53x_target_type ptt = *(pbt++);
@@ -2472,7 +4706,7 @@ pn53x_InAutoPoll(struct nfc_device *pnd,
       }
       pbt += ln;
 
-      if (abtRx[0] > 1) {
+      if (pbtRx[0] > 1) {
         /* 2nd target */
         // Target type
         ptt = *(pbt++);
@@ -2486,6 +4720,33 @@ pn53x_InAutoPoll(struct nfc_device *pnd,
   return szTargetFound;
 }
 
+int
+pn53x_InAutoPoll(struct nfc_device *pnd,
+                 const pn53x_target_type *ppttTargetTypes, const size_t szTargetTypes,
+                 const uint8_t btPollNr, const uint8_t btPeriod, nfc_target *pntTargets, const int timeout)
+{
+  if (CHIP_DATA(pnd)->type != PN532) {
+    // This function is not supported by pn531 neither pn533
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+
+  // InAutoPoll frame looks like this { 0xd4, 0x60, 0x0f, 0x01, 0x00 } => { direction, command, pollnr, period, types... }
+  size_t szTxInAutoPoll = 3 + szTargetTypes;
+  uint8_t abtCmd[3 + 15] = { InAutoPoll, btPollNr, btPeriod };
+  for (size_t n = 0; n < szTargetTypes; n++) {
+    abtCmd[3 + n] = ppttTargetTypes[n];
+  }
+
+  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t  szRx = sizeof(abtRx);
+  int res = pn53x_transceive(pnd, abtCmd, szTxInAutoPoll, abtRx, szRx, timeout);
+  if (res < 0) {
+    return res;
+  }
+  return pn53x_InAutoPoll_decode(pnd, abtRx, (size_t) res, pntTargets);
+}
+
 /**
  * @brief Wrapper for InJumpForDEP command
  * @param pmInitModulation desired initial modulation
@@ -2592,62 +4853,71 @@ pn53x_InJumpForDEP(struct nfc_device *pnd,
   return abtRx[1];
 }
 
-int
-pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
-                     const uint8_t *pbtMifareParams,
-                     const uint8_t *pbtTkt, size_t szTkt,
-                     const uint8_t *pbtFeliCaParams,
-                     const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
-                     uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+// Build a TgInitAsTarget command frame in pbtCmd, returns its length
+static size_t
+pn53x_TgInitAsTarget_frame(struct nfc_device *pnd, pn53x_target_mode ptm,
+                           const uint8_t *pbtMifareParams,
+                           const uint8_t *pbtTkt, size_t szTkt,
+                           const uint8_t *pbtFeliCaParams,
+                           const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
+                           uint8_t pbtCmd[PN53X_TG_INIT_FRAME_MAX_LEN])
 {
-  uint8_t  abtCmd[39 + 47 + 48] = { TgInitAsTarget }; // Worst case: 39-byte base, 47 bytes max. for General Bytes, 48 bytes max. for Historical Bytes
   size_t  szOptionalBytes = 0;
-  int res = 0;
 
   // Clear the target init struct, reset to all zeros
-  memset(abtCmd + 1, 0x00, sizeof(abtCmd) - 1);
+  memset(pbtCmd, 0x00, PN53X_TG_INIT_FRAME_MAX_LEN);
+  pbtCmd[0] = TgInitAsTarget;
 
   // Store the target mode in the initialization params
-  abtCmd[1] = ptm;
+  pbtCmd[1] = ptm;
 
   // MIFARE part
   if (pbtMifareParams) {
-    memcpy(abtCmd + 2, pbtMifareParams, 6);
+    memcpy(pbtCmd + 2, pbtMifareParams, 6);
   }
   // FeliCa part
   if (pbtFeliCaParams) {
-    memcpy(abtCmd + 8, pbtFeliCaParams, 18);
+    memcpy(pbtCmd + 8, pbtFeliCaParams, 18);
   }
   // DEP part
   if (pbtNFCID3t) {
-    memcpy(abtCmd + 26, pbtNFCID3t, 10);
+    memcpy(pbtCmd + 26, pbtNFCID3t, 10);
   }
   // General Bytes (ISO/IEC 18092)
   if ((CHIP_DATA(pnd)->type == PN531) || (CHIP_DATA(pnd)->type == RCS360)) {
     if (szGBt) {
-      memcpy(abtCmd + 36, pbtGBt, szGBt);
+      memcpy(pbtCmd + 36, pbtGBt, szGBt);
       szOptionalBytes = szGBt;
     }
   } else {
-    abtCmd[36] = (uint8_t)(szGBt);
+    pbtCmd[36] = (uint8_t)(szGBt);
     if (szGBt) {
-      memcpy(abtCmd + 37, pbtGBt, szGBt);
+      memcpy(pbtCmd + 37, pbtGBt, szGBt);
     }
     szOptionalBytes = szGBt + 1;
   }
   // Historical bytes (ISO/IEC 14443-4)
   if ((CHIP_DATA(pnd)->type != PN531) && (CHIP_DATA(pnd)->type != RCS360)) { // PN531 does not handle Historical Bytes
-    abtCmd[36 + szOptionalBytes] = (uint8_t)(szTkt);
+    pbtCmd[36 + szOptionalBytes] = (uint8_t)(szTkt);
     if (szTkt) {
-      memcpy(abtCmd + 37 + szOptionalBytes, pbtTkt, szTkt);
+      memcpy(pbtCmd + 37 + szOptionalBytes, pbtTkt, szTkt);
     }
     szOptionalBytes += szTkt + 1;
   }
+  return 36 + szOptionalBytes;
+}
+
+// Send a TgInitAsTarget frame built by pn53x_TgInitAsTarget_frame() and wait for the activation
+static int
+pn53x_TgInitAsTarget_send(struct nfc_device *pnd, const uint8_t *pbtCmd, const size_t szCmd,
+                          uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+{
+  int res = 0;
 
   // Request the initialization as a target
   uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   size_t szRx = sizeof(abtRx);
-  if ((res = pn53x_transceive(pnd, abtCmd, 36 + szOptionalBytes, abtRx, szRx, timeout)) < 0)
+  if ((res = pn53x_transceive(pnd, pbtCmd, szCmd, abtRx, szRx, timeout)) < 0)
     return res;
   szRx = (size_t) res;
 
@@ -2668,6 +4938,19 @@ pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
   return szRx;
 }
 
+int
+pn53x_TgInitAsTarget(struct nfc_device *pnd, pn53x_target_mode ptm,
+                     const uint8_t *pbtMifareParams,
+                     const uint8_t *pbtTkt, size_t szTkt,
+                     const uint8_t *pbtFeliCaParams,
+                     const uint8_t *pbtNFCID3t, const uint8_t *pbtGBt, const size_t szGBt,
+                     uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtModeByte, int timeout)
+{
+  uint8_t  abtCmd[PN53X_TG_INIT_FRAME_MAX_LEN];
+  const size_t szCmd = pn53x_TgInitAsTarget_frame(pnd, ptm, pbtMifareParams, pbtTkt, szTkt, pbtFeliCaParams, pbtNFCID3t, pbtGBt, szGBt, abtCmd);
+  return pn53x_TgInitAsTarget_send(pnd, abtCmd, szCmd, pbtRx, szRxLen, pbtModeByte, timeout);
+}
+
 int
 pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen)
 {
@@ -2678,6 +4961,7 @@ pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const s
     }
   }
   pnd->last_error = NFC_EIO;
+  pnd->stats.naks++;
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unexpected PN53x reply!");
   return pnd->last_error;
 }
@@ -2688,6 +4972,7 @@ pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const
   if (szRxFrameLen >= sizeof(pn53x_error_frame)) {
     if (0 == memcmp(pbtRxFrame, pn53x_error_frame, sizeof(pn53x_error_frame))) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PN53x sent an error frame");
+      pnd->stats.naks++;
       pnd->last_error = NFC_EIO;
       return pnd->last_error;
     }
@@ -2757,6 +5042,53 @@ pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, c
   }
   return NFC_SUCCESS;
 }
+
+/**
+ * @brief Build a PN53x frame around \a pbtData, without copying it
+ * @return Returns NFC_SUCCESS or NFC_ECHIP if \a szData is too large
+ *
+ * @param pbtData command given to pn53x_io.send() by a driver using pn53x_io.send_in_place
+ * @param ppbtFrame set to the frame start, which is (part of) PN53X_IO_HEADROOM before \a pbtData
+ * @note The frame ends PN53X_IO_TAILROOM bytes after \a pbtData
+ */
+int
+pn53x_build_frame_in_place(uint8_t *pbtData, const size_t szData, uint8_t **ppbtFrame, size_t *pszFrame)
+{
+  uint8_t *pbtFrame;
+  if (szData <= PN53x_NORMAL_FRAME__DATA_MAX_LEN) {
+    pbtFrame = pbtData - 6;
+    pbtFrame[3] = szData + 1;
+    pbtFrame[4] = 256 - (szData + 1);
+    *pszFrame = szData + PN53x_NORMAL_FRAME__OVERHEAD;
+  } else if (szData <= PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+    pbtFrame = pbtData - 9;
+    pbtFrame[3] = 0xff;
+    pbtFrame[4] = 0xff;
+    pbtFrame[5] = (szData + 1) >> 8;
+    pbtFrame[6] = (szData + 1) & 0xff;
+    pbtFrame[7] = 256 - ((pbtFrame[5] + pbtFrame[6]) & 0xff);
+    *pszFrame = szData + PN53x_EXTENDED_FRAME__OVERHEAD;
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "We can't send more than %d bytes in a raw (requested: %" PRIdPTR ")", PN53x_EXTENDED_FRAME__DATA_MAX_LEN, szData);
+    return NFC_ECHIP;
+  }
+  // Preamble, start code and TFI
+  pbtFrame[0] = 0x00;
+  pbtFrame[1] = 0x00;
+  pbtFrame[2] = 0xff;
+  pbtData[-1] = 0xD4;
+
+  uint8_t btDCS = (256 - 0xD4);
+  for (size_t szPos = 0; szPos < szData; szPos++) {
+    btDCS -= pbtData[szPos];
+  }
+  pbtData[szData] = btDCS;
+  pbtData[szData + 1] = 0x00;
+
+  *ppbtFrame = pbtFrame;
+  return NFC_SUCCESS;
+}
+
 pn53x_modulation
 pn53x_nm_to_pm(const nfc_modulation nm)
 {
@@ -3131,25 +5463,22 @@ pn53x_current_target_new(const struct nfc_device *pnd, const nfc_target *pnt)
   if (pnt == NULL) {
     return NULL;
   }
-  // Keep the current nfc_target for further commands
-  if (CHIP_DATA(pnd)->current_target) {
-    free(CHIP_DATA(pnd)->current_target);
-  }
-  CHIP_DATA(pnd)->current_target = malloc(sizeof(nfc_target));
-  if (!CHIP_DATA(pnd)->current_target) {
-    return NULL;
-  }
-  memcpy(CHIP_DATA(pnd)->current_target, pnt, sizeof(nfc_target));
+  // Keep the current nfc_target for further commands, stored inline: selecting never allocates
+  if (pnt != &(CHIP_DATA(pnd)->current_target_storage))
+    memcpy(&(CHIP_DATA(pnd)->current_target_storage), pnt, sizeof(nfc_target));
+  CHIP_DATA(pnd)->current_target = &(CHIP_DATA(pnd)->current_target_storage);
+  // A single selection leaves the chip with only Tg 1
+  CHIP_DATA(pnd)->szLogicalTargets = 0;
+  CHIP_DATA(pnd)->current_tg = 1;
   return CHIP_DATA(pnd)->current_target;
 }
 
 void
 pn53x_current_target_free(const struct nfc_device *pnd)
 {
-  if (CHIP_DATA(pnd)->current_target) {
-    free(CHIP_DATA(pnd)->current_target);
-    CHIP_DATA(pnd)->current_target = NULL;
-  }
+  CHIP_DATA(pnd)->current_target = NULL;
+  CHIP_DATA(pnd)->szLogicalTargets = 0;
+  CHIP_DATA(pnd)->current_tg = 1;
 }
 
 bool
@@ -3168,7 +5497,7 @@ pn53x_current_target_is(const struct nfc_device *pnd, const nfc_target *pnt)
 void *
 pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
 {
-  pnd->chip_data = malloc(sizeof(struct pn53x_data));
+  pnd->chip_data = nfc_device_alloc(pnd, sizeof(struct pn53x_data));
   if (!pnd->chip_data) {
     return NULL;
   }
@@ -3190,14 +5519,35 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
 
   // Set current target to NULL
   CHIP_DATA(pnd)->current_target = NULL;
+  CHIP_DATA(pnd)->szLogicalTargets = 0;
+  CHIP_DATA(pnd)->current_tg = 1;
 
   // Set current sam_mode to normal mode
   CHIP_DATA(pnd)->sam_mode = PSM_NORMAL;
+  CHIP_DATA(pnd)->sam_session = false;
+  CHIP_DATA(pnd)->sam_selected = false;
+  CHIP_DATA(pnd)->sam_busy = false;
+  memset(&(CHIP_DATA(pnd)->sam_target), 0x00, sizeof(CHIP_DATA(pnd)->sam_target));
+
+  // No properties transaction
+  CHIP_DATA(pnd)->parameters_pending = false;
+  CHIP_DATA(pnd)->properties_transaction = 0;
 
   // WriteBack cache is clean
   CHIP_DATA(pnd)->wb_trigged = false;
   memset(CHIP_DATA(pnd)->wb_mask, 0x00, PN53X_CACHE_REGISTER_SIZE);
 
+  // Nothing is known about chip registers yet
+  pn53x_shadow_invalidate(pnd);
+
+  // No target settings applied yet
+  CHIP_DATA(pnd)->target_armed = false;
+  CHIP_DATA(pnd)->szTgInitFrame = 0;
+  CHIP_DATA(pnd)->last_tx_start = 0;
+  CHIP_DATA(pnd)->last_tx_end = 0;
+  CHIP_DATA(pnd)->last_rx_end = 0;
+  CHIP_DATA(pnd)->target_rx_time = 0;
+
   // Set default command timeout (350 ms)
   CHIP_DATA(pnd)->timeout_command = 350;
 
@@ -3207,6 +5557,18 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   // Set default communication timeout (52 ms)
   CHIP_DATA(pnd)->timeout_communication = 52;
 
+  // RF errors are returned straight away
+  CHIP_DATA(pnd)->rf_retries = 0;
+
+  // Continuous polling
+  CHIP_DATA(pnd)->low_power_poll = 0;
+
+  // Chip default fRetryTimeout (51.2 ms), nothing learned yet
+  CHIP_DATA(pnd)->adaptive_timeouts = false;
+  memset(CHIP_DATA(pnd)->adaptive, 0x00, sizeof(CHIP_DATA(pnd)->adaptive));
+  CHIP_DATA(pnd)->ui8RetryTimeout = pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication);
+  CHIP_DATA(pnd)->ui8RetryTimeoutWanted = CHIP_DATA(pnd)->ui8RetryTimeout;
+
   CHIP_DATA(pnd)->supported_modulation_as_initiator = NULL;
 
   CHIP_DATA(pnd)->supported_modulation_as_target = NULL;
@@ -3222,7 +5584,7 @@ pn53x_data_free(struct nfc_device *pnd)
 
   // Free supported modulation(s)
   if (CHIP_DATA(pnd)->supported_modulation_as_initiator) {
-    free(CHIP_DATA(pnd)->supported_modulation_as_initiator);
+    nfc_device_release(pnd, CHIP_DATA(pnd)->supported_modulation_as_initiator);
   }
-  free(pnd->chip_data);
+  nfc_device_release(pnd, pnd->chip_data);
 }
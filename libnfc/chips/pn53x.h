@@ -129,6 +129,17 @@ typedef enum {
   LOWVBAT	// Only on PN532, need to be wake up to process commands with a long preamble and SAMConfiguration command
 } pn53x_power_mode;
 
+// PowerDown WakeUpEnable bits (PN532)
+#define PN532_WAKEUP_I2C  0x80
+#define PN532_WAKEUP_GPIO 0x40
+#define PN532_WAKEUP_SPI  0x20
+#define PN532_WAKEUP_HSU  0x10
+#define PN532_WAKEUP_RF   0x08	// RF level detector, ie. an external field
+#define PN532_WAKEUP_INT1 0x02
+#define PN532_WAKEUP_INT0 0x01
+// Any host interface
+#define PN532_WAKEUP_HOST (PN532_WAKEUP_I2C | PN532_WAKEUP_GPIO | PN532_WAKEUP_SPI | PN532_WAKEUP_HSU)
+
 /**
  * @enum pn53x_operating_mode
  * @brief PN53x operatin mode enumeration
@@ -150,6 +161,13 @@ typedef enum {
   PSM_DUAL_CARD = 0x04
 } pn532_sam_mode;
 
+// Room around the command given to pn53x_io.send() when pn53x_io.send_in_place is set:
+// enough for the largest driver header (CCID + pseudo-APDU + TFI) and a DCS + postamble
+#define PN53X_IO_HEADROOM 16
+#define PN53X_IO_TAILROOM 2
+
+struct pn53x_cmd;
+
 /**
  * @internal
  * @struct pn53x_io
@@ -158,12 +176,70 @@ typedef enum {
 struct pn53x_io {
   int (*send)(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout);
   int (*receive)(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
+  // Optional: receive() leaving the answer in the driver buffer, *ppbtData stays valid until the next send()
+  int (*receive_view)(struct nfc_device *pnd, const uint8_t **ppbtData, int timeout);
+  // send() frames the command in place: PN53X_IO_HEADROOM bytes before pbtData and PN53X_IO_TAILROOM bytes after it are writable
+  bool send_in_place;
+  // Optional: keep every frame of one pn53x_transceive() (writeback flush, command, MI chaining) together on a shared bus
+  int (*begin_transaction)(struct nfc_device *pnd);
+  int (*end_transaction)(struct nfc_device *pnd);
+  // Optional: send several commands in one go and collect their answers as receive() returns them, stopping after the first failing one (see pn53x_cmd_failed()); returns how many ran
+  int (*transceive_batch)(struct nfc_device *pnd, struct pn53x_cmd *cmds, const size_t szCmds, int timeout);
 };
 
 /* defines */
 #define PN53X_CACHE_REGISTER_MIN_ADDRESS 	PN53X_REG_CIU_Mode
 #define PN53X_CACHE_REGISTER_MAX_ADDRESS 	PN53X_REG_CIU_Coll
 #define PN53X_CACHE_REGISTER_SIZE 		((PN53X_CACHE_REGISTER_MAX_ADDRESS - PN53X_CACHE_REGISTER_MIN_ADDRESS) + 1)
+// Shadow registers: cache window followed by a few SFR/XRAM registers (see pn53x_shadow_index())
+#define PN53X_SHADOW_REGISTER_SIZE 		(PN53X_CACHE_REGISTER_SIZE + 7)
+// TgInitAsTarget worst case: 39-byte base, 47 bytes max. for General Bytes, 48 bytes max. for Historical Bytes
+#define PN53X_TG_INIT_FRAME_MAX_LEN 		(39 + 47 + 48)
+
+// Commands sent in one batch at most
+#define PN53X_CMD_QUEUE_MAX_LEN 16
+
+// Modulation types, indexes of pn53x_data.adaptive
+#define PN53X_ADAPTIVE_MODULATION_TYPES 	(NMT_DEP + 1)
+
+/**
+ * @internal
+ * @struct pn53x_adaptive_timing
+ * @brief Answer times learned from the last target of a modulation type (see NP_ADAPTIVE_TIMEOUTS)
+ */
+struct pn53x_adaptive_timing {
+  /** Identifier of the sampled target */
+  uint8_t abtUid[10];
+  size_t szUid;
+  /** Slowest recent answer (µs), decaying a little with every faster one */
+  uint32_t peak_us;
+  /** Answers sampled since the timeout was last restored */
+  unsigned int samples;
+  /** Timeout learned for reads, once enough answers are sampled */
+  uint8_t ui8Timeout;
+};
+
+#ifdef NFC_LOW_STACK
+/**
+ * @struct pn53x_workspace
+ * @brief Scratch buffers of the chip hot paths, one set per call level
+ */
+struct pn53x_workspace {
+  /** Commands running several exchanges: raw bits answer, chained frames status, timed exchange registers */
+  uint8_t abtCommandTx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtCommandRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  /** Writeback cache flush: ReadRegister then WriteRegister command, ReadRegister answer */
+  uint8_t abtRegisterCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtRegisterRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  /** pn53x_transceive_frame(): answer nobody asked for, chained answer, command staged for the driver */
+  uint8_t abtFrameRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtFrameRx2[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtFrameTx[PN53X_IO_HEADROOM + PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53X_IO_TAILROOM];
+  /** pn53x_initiator_transceive_bytes_batch(): InDataExchange frames and their answers, one after the other */
+  uint8_t abtBatchFrames[PN53X_CMD_QUEUE_MAX_LEN * (2 + PN53x_IN_DATA_MAX_LEN)];
+  uint8_t abtBatchAnswers[PN53X_CMD_QUEUE_MAX_LEN * PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+};
+#endif /* NFC_LOW_STACK */
 
 /**
  * @internal
@@ -181,8 +257,20 @@ struct pn53x_data {
   pn53x_operating_mode operating_mode;
   /** Current emulated target */
   nfc_target *current_target;
+  /** Storage of current_target, which points here when set */
+  nfc_target current_target_storage;
+  /** Targets kept activated by a dual InListPassiveTarget, by logical target number (Tg) minus one */
+  nfc_target logical_targets[2];
+  size_t szLogicalTargets;
+  /** Logical target number InDataExchange talks to */
+  uint8_t current_tg;
   /** Current sam mode (only applicable for PN532) */
   pn532_sam_mode sam_mode;
+  /** SAM used through pn532_initiator_sam_transceive_bytes(): selected as long as the chip stays in wired card mode, remembered across taps */
+  bool sam_session;
+  bool sam_selected;
+  bool sam_busy;
+  nfc_target sam_target;
   /** PN53x I/O functions stored in struct */
   const struct pn53x_io *io;
   /** Last status byte returned by PN53x */
@@ -191,6 +279,10 @@ struct pn53x_data {
   uint8_t ui8TxBits;
   /** Register cache for SetParameters function. */
   uint8_t ui8Parameters;
+  /** ui8Parameters is not sent yet (see pn53x_begin_properties()) */
+  bool parameters_pending;
+  /** Nesting level of properties transactions */
+  unsigned int properties_transaction;
   /** Last sent command */
   uint8_t last_command;
   /** Interframe timer correction */
@@ -201,12 +293,48 @@ struct pn53x_data {
   uint8_t wb_data[PN53X_CACHE_REGISTER_SIZE];
   uint8_t wb_mask[PN53X_CACHE_REGISTER_SIZE];
   bool wb_trigged;
+  /** Shadow copy of chip registers, only entries flagged valid are known */
+  uint8_t shadow_data[PN53X_SHADOW_REGISTER_SIZE];
+  bool shadow_valid[PN53X_SHADOW_REGISTER_SIZE];
+  /** Command frame built in place, with room for drivers framing it in place (see pn53x_io.send_in_place) */
+  uint8_t abtTxBuffer[PN53X_IO_HEADROOM + PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53X_IO_TAILROOM];
+  /** Answer of pn53x_transceive_view() when the driver can't lend its own buffer */
+  uint8_t abtRxBuffer[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+#ifdef NFC_LOW_STACK
+  /** Low-stack profile: scratch buffers of the hot paths (see SCRATCH_INIT) */
+  struct pn53x_workspace workspace;
+#endif /* NFC_LOW_STACK */
+  /** Last TgInitAsTarget frame sent by pn53x_target_init() */
+  uint8_t abtTgInitFrame[PN53X_TG_INIT_FRAME_MAX_LEN];
+  size_t szTgInitFrame;
+  /** Settings applied by pn53x_target_init() are still in place, re-arming with the same frame needs no other command */
+  bool target_armed;
+  /** Timestamps (µs) of the last command: sending started, sending done, answer received */
+  uint64_t last_tx_start;
+  uint64_t last_tx_end;
+  uint64_t last_rx_end;
+  /** When the initiator command waiting for an answer was received, 0 when none */
+  uint64_t target_rx_time;
+  /** Raw-bit session started by pn53x_initiator_raw_session_begin(), with the framing settings to restore */
+  bool raw_session;
+  bool raw_session_crc;
+  bool raw_session_easy_framing;
   /** Command timeout */
   int timeout_command;
   /** ATR timeout */
   int timeout_atr;
   /** Communication timeout */
   int timeout_communication;
+  /** Chip sleep between two polling rounds in ms, 0 for continuous polling (see NP_LOW_POWER_POLL) */
+  int low_power_poll;
+  /** Repeats allowed after a transient RF error (see NP_RF_RETRIES) */
+  int rf_retries;
+  /** Learn answer times to shorten the communication timeout (see NP_ADAPTIVE_TIMEOUTS) */
+  bool adaptive_timeouts;
+  struct pn53x_adaptive_timing adaptive[PN53X_ADAPTIVE_MODULATION_TYPES];
+  /** RFConfiguration fRetryTimeout set in the chip, and the one the next data exchange needs */
+  uint8_t ui8RetryTimeout;
+  uint8_t ui8RetryTimeoutWanted;
   /** Supported modulation type */
   nfc_modulation_type *supported_modulation_as_initiator;
   nfc_modulation_type *supported_modulation_as_target;
@@ -214,6 +342,42 @@ struct pn53x_data {
 
 #define CHIP_DATA(pnd) ((struct pn53x_data*)(pnd->chip_data))
 
+#ifdef NFC_SINGLE_PN53X_IO
+// Single-driver build: the I/O of every chip is the one of this driver, see NFC_SINGLE_DRIVER
+extern const struct pn53x_io NFC_SINGLE_PN53X_IO;
+#  define PN53X_IO(pnd) (&(NFC_SINGLE_PN53X_IO))
+#else
+#  define PN53X_IO(pnd) (CHIP_DATA(pnd)->io)
+#endif /* NFC_SINGLE_PN53X_IO */
+
+/**
+ * @internal
+ * @struct pn53x_cmd
+ * @brief PN53x queued command
+ */
+struct pn53x_cmd {
+  /** Command frame, first byte is the command code */
+  const uint8_t *pbtTx;
+  size_t szTx;
+  /** Optional buffer for the answer */
+  uint8_t *pbtRx;
+  size_t szRxLen;
+  /** Command result, filled when queue is flushed */
+  int res;
+  /** The target may run it even when the previous command failed, so it can be sent before that one is answered */
+  bool bRepeatable;
+};
+
+/**
+ * @internal
+ * @struct pn53x_cmd_queue
+ * @brief PN53x command queue, to send several commands in a batch
+ */
+struct pn53x_cmd_queue {
+  struct pn53x_cmd cmds[PN53X_CMD_QUEUE_MAX_LEN];
+  size_t szCmds;
+};
+
 /**
  * @enum pn53x_modulation
  * @brief NFC modulation enumeration
@@ -299,7 +463,15 @@ extern const uint8_t pn53x_ack_frame[PN53x_ACK_FRAME__LEN];
 extern const uint8_t pn53x_nack_frame[PN53x_ACK_FRAME__LEN];
 
 int    pn53x_init(struct nfc_device *pnd);
+int    pn53x_resume(struct nfc_device *pnd);
 int    pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+int    pn53x_transceive_raw(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+int    pn53x_transceive_view(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const uint8_t **ppbtRx, int timeout);
+
+void   pn53x_cmd_queue_init(struct pn53x_cmd_queue *pcq);
+int    pn53x_cmd_queue_append(struct pn53x_cmd_queue *pcq, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen);
+int    pn53x_cmd_queue_flush(struct nfc_device *pnd, struct pn53x_cmd_queue *pcq, int timeout);
+bool   pn53x_cmd_failed(const struct pn53x_cmd *pc);
 
 int    pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Value, const bool bEnable);
 int    pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits);
@@ -310,9 +482,13 @@ int    pn53x_decode_target_data(const uint8_t *pbtRawData, size_t szRawData,
                                 nfc_target_info *pnti);
 int    pn53x_read_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t *ui8Value);
 int    pn53x_write_register(struct nfc_device *pnd, uint16_t ui16Reg, uint8_t ui8SymbolMask, uint8_t ui8Value);
+void   pn53x_shadow_invalidate(struct nfc_device *pnd);
 int    pn53x_decode_firmware_version(struct nfc_device *pnd);
 int    pn53x_set_property_int(struct nfc_device *pnd, const nfc_property property, const int value);
 int    pn53x_set_property_bool(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
+int    pn53x_begin_properties(struct nfc_device *pnd);
+int    pn53x_commit_properties(struct nfc_device *pnd);
+int    pn53x_set_rf_analog(struct nfc_device *pnd, const nfc_rf_analog nra, const uint8_t *pbtSettings, const size_t szSettings);
 
 int    pn53x_check_communication(struct nfc_device *pnd);
 int    pn53x_idle(struct nfc_device *pnd);
@@ -320,14 +496,26 @@ int    pn53x_idle(struct nfc_device *pnd);
 // NFC device as Initiator functions
 int    pn53x_initiator_init(struct nfc_device *pnd);
 int    pn532_initiator_init_secure_element(struct nfc_device *pnd);
+int    pn532_initiator_sam_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 int    pn53x_initiator_select_passive_target(struct nfc_device *pnd,
                                              const nfc_modulation nm,
                                              const uint8_t *pbtInitData, const size_t szInitData,
                                              nfc_target *pnt);
+int    pn53x_initiator_set_current_target(struct nfc_device *pnd, const nfc_target *pnt);
+int    pn53x_initiator_select_passive_targets(struct nfc_device *pnd,
+                                              const nfc_modulation nm,
+                                              const uint8_t *pbtInitData, const size_t szInitData,
+                                              nfc_target ant[], const size_t szTargets);
+int    pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+int    pn53x_initiator_inventory_iso14443b(struct nfc_device *pnd, const uint8_t ui8Afi, nfc_target ant[], const size_t szTargets);
 int    pn53x_initiator_poll_target(struct nfc_device *pnd,
                                    const nfc_modulation *pnmModulations, const size_t szModulations,
                                    const uint8_t uiPollNr, const uint8_t uiPeriod,
                                    nfc_target *pnt);
+int    pn53x_initiator_poll_target_stream(struct nfc_device *pnd,
+                                          const nfc_modulation *pnmModulations, const size_t szModulations,
+                                          const uint8_t uiPeriod,
+                                          nfc_target_callback cb, void *user_data);
 int    pn53x_initiator_select_dep_target(struct nfc_device *pnd,
                                          const nfc_dep_mode ndm, const nfc_baud_rate nbr,
                                          const nfc_dep_info *pndiInitiator,
@@ -335,8 +523,12 @@ int    pn53x_initiator_select_dep_target(struct nfc_device *pnd,
                                          const int timeout);
 int    pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
                                        const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar);
+int    pn53x_initiator_iso14443_4_pps(struct nfc_device *pnd, const nfc_target *pnt);
+int    pn53x_initiator_raw_session_begin(struct nfc_device *pnd);
+int    pn53x_initiator_raw_session_end(struct nfc_device *pnd);
 int    pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
                                         uint8_t *pbtRx, const size_t szRx, int timeout);
+int    pn53x_initiator_transceive_bytes_batch(struct nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout);
 int    pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
                                              const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
 int    pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
@@ -350,6 +542,7 @@ int    pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const s
 int    pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout);
 int    pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 int    pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+int    pn53x_target_send_receive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 
 // Error handling functions
 const char *pn53x_strerror(const struct nfc_device *pnd);
@@ -358,6 +551,7 @@ const char *pn53x_strerror(const struct nfc_device *pnd);
 int    pn53x_SetParameters(struct nfc_device *pnd, const uint8_t ui8Value);
 int    pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode mode, int timeout);
 int    pn53x_PowerDown(struct nfc_device *pnd);
+int    pn53x_PowerDown_wakeup(struct nfc_device *pnd, const uint8_t ui8WakeUpEnable);
 int    pn53x_InListPassiveTarget(struct nfc_device *pnd, const pn53x_modulation pmInitModulation,
                                  const uint8_t szMaxTargets, const uint8_t *pbtInitiatorData,
                                  const size_t szInitiatorDataLen, uint8_t *pbtTargetsData, size_t *pszTargetsData,
@@ -386,15 +580,22 @@ int    pn53x_RFConfiguration__RF_field(struct nfc_device *pnd, bool bEnable);
 int    pn53x_RFConfiguration__Various_timings(struct nfc_device *pnd, const uint8_t fATR_RES_Timeout, const uint8_t fRetryTimeout);
 int    pn53x_RFConfiguration__MaxRtyCOM(struct nfc_device *pnd, const uint8_t MaxRtyCOM);
 int    pn53x_RFConfiguration__MaxRetries(struct nfc_device *pnd, const uint8_t MxRtyATR, const uint8_t MxRtyPSL, const uint8_t MxRtyPassiveActivation);
+int    pn53x_RFConfiguration__Analog_settings(struct nfc_device *pnd, const uint8_t ui8CfgItem, const uint8_t *pbtSettings, const size_t szSettings);
 
 // Misc
 int    pn53x_check_ack_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_check_error_frame(struct nfc_device *pnd, const uint8_t *pbtRxFrame, const size_t szRxFrameLen);
 int    pn53x_build_frame(uint8_t *pbtFrame, size_t *pszFrame, const uint8_t *pbtData, const size_t szData);
+int    pn53x_build_frame_in_place(uint8_t *pbtData, const size_t szData, uint8_t **ppbtFrame, size_t *pszFrame);
 int    pn53x_get_supported_modulation(nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
 int    pn53x_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
 int    pn53x_get_information_about(nfc_device *pnd, char **pbuf);
 
+// Longest list of supported modulations as initiator, terminated by 0
+#define PN53X_INITIATOR_MODULATIONS_LEN 9
+// Arena room pn53x_data_new() and pn53x_init() take from nfc_device_new()
+#define PN53X_ARENA_LEN (NFC_ARENA_ALIGN(sizeof(struct pn53x_data)) + NFC_ARENA_ALIGN(sizeof(nfc_modulation_type) * PN53X_INITIATOR_MODULATIONS_LEN))
+
 void   *pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io);
 void    pn53x_data_free(struct nfc_device *pnd);
 
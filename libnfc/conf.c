@@ -34,9 +34,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <inttypes.h>
 #include <string.h>
 #include <regex.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
@@ -56,6 +58,88 @@
 #define LIBNFC_CONFFILE        LIBNFC_SYSCONFDIR"/libnfc.conf"
 #define LIBNFC_DEVICECONFDIR   LIBNFC_SYSCONFDIR"/devices.d"
 
+/*
+ * Compiled configuration cache (LIBNFC_CONFIG_CACHE): the key/value pairs of
+ * a configuration section, stored with the modification time and size of
+ * every file and directory they were read from. When none of them changed,
+ * the pairs are applied straight away, without parsing any file.
+ * Layout, in host byte order: magic, validators count, validators
+ * { path, mtime, size }, pairs count, pairs { key, value }. Strings are
+ * stored as a 32 bits length followed by the bytes.
+ */
+#define CONF_CACHE_MAGIC       "NFCCONF1"
+// Suffix of the cache of LIBNFC_DEVICECONFDIR, loaded separately when configuration is lazy
+#define CONF_CACHE_DEVICES_SUFFIX ".devices"
+
+struct conf_blob {
+  uint8_t *data;
+  size_t len;
+  size_t size;
+  uint32_t count;
+  bool failed;
+};
+
+struct conf_load_state {
+  nfc_context *context;
+  // NULL when no cache is written
+  struct conf_blob *validators;
+  struct conf_blob *pairs;
+};
+
+static void
+conf_blob_append(struct conf_blob *pb, const void *p, const size_t len)
+{
+  if (pb->failed)
+    return;
+  if (pb->len + len > pb->size) {
+    const size_t size = (pb->size + len) * 2;
+    uint8_t *data = realloc(pb->data, size);
+    if (!data) {
+      pb->failed = true;
+      return;
+    }
+    pb->data = data;
+    pb->size = size;
+  }
+  memcpy(pb->data + pb->len, p, len);
+  pb->len += len;
+}
+
+static void
+conf_blob_append_string(struct conf_blob *pb, const char *s)
+{
+  const uint32_t len = strlen(s);
+  conf_blob_append(pb, &len, sizeof(len));
+  conf_blob_append(pb, s, len);
+}
+
+// Modification time and size of a file, -1 when it does not exist
+static void
+conf_file_stamp(const char *filename, int64_t *pi64Mtime, int64_t *pi64Size)
+{
+  struct stat st;
+  if (stat(filename, &st) == -1) {
+    *pi64Mtime = -1;
+    *pi64Size = -1;
+    return;
+  }
+  *pi64Mtime = st.st_mtime;
+  *pi64Size = S_ISDIR(st.st_mode) ? 0 : st.st_size;
+}
+
+// Remember a file the section depends on, the cache is stale once it changes
+static void
+conf_cache_depend(struct conf_load_state *state, const char *filename)
+{
+  int64_t stamp[2];
+  if (!state->validators)
+    return;
+  conf_file_stamp(filename, &stamp[0], &stamp[1]);
+  conf_blob_append_string(state->validators, filename);
+  conf_blob_append(state->validators, stamp, sizeof(stamp));
+  state->validators->count++;
+}
+
 static bool
 conf_parse_file(const char *filename, void (*conf_keyvalue)(void *data, const char *key, const char *value), void *data)
 {
@@ -116,9 +200,8 @@ conf_parse_file(const char *filename, void (*conf_keyvalue)(void *data, const ch
 }
 
 static void
-conf_keyvalue_context(void *data, const char *key, const char *value)
+conf_apply(nfc_context *context, const char *key, const char *value)
 {
-  nfc_context *context = (nfc_context *)data;
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "key: [%s], value: [%s]", key, value);
   if (strcmp(key, "allow_autoscan") == 0) {
     string_as_boolean(value, &(context->allow_autoscan));
@@ -126,6 +209,24 @@ conf_keyvalue_context(void *data, const char *key, const char *value)
     string_as_boolean(value, &(context->allow_intrusive_scan));
   } else if (strcmp(key, "log_level") == 0) {
     context->log_level = atoi(value);
+  } else if (strcmp(key, "device_list_ttl") == 0) {
+    context->device_list_ttl = atoi(value);
+  } else if (strcmp(key, "device_cache_size") == 0) {
+    context->device_cache_size = atoi(value);
+  } else if (strcmp(key, "capture_file") == 0) {
+    free(context->capture_file);
+    context->capture_file = strdup(value);
+  } else if (strcmp(key, "mifare_key_cache") == 0) {
+    free(context->mifare_key_cache_file);
+    context->mifare_key_cache_file = strdup(value);
+  } else if (strcmp(key, "rf_profiles") == 0) {
+    free(context->rf_profile_file);
+    context->rf_profile_file = strdup(value);
+  } else if (strcmp(key, "tap_dedupe_window") == 0) {
+    context->tap_dedupe_window = atoi(value);
+  } else if (strcmp(key, "uart_scan_filter") == 0) {
+    free(context->uart_scan_filter);
+    context->uart_scan_filter = strdup(value);
   } else if (strcmp(key, "device.name") == 0) {
     if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].name, "") != 0) {
       if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
@@ -159,6 +260,18 @@ conf_keyvalue_context(void *data, const char *key, const char *value)
   }
 }
 
+static void
+conf_keyvalue_context(void *data, const char *key, const char *value)
+{
+  struct conf_load_state *state = (struct conf_load_state *)data;
+  if (state->pairs) {
+    conf_blob_append_string(state->pairs, key);
+    conf_blob_append_string(state->pairs, value);
+    state->pairs->count++;
+  }
+  conf_apply(state->context, key, value);
+}
+
 static void
 conf_keyvalue_device(void *data, const char *key, const char *value)
 {
@@ -168,8 +281,10 @@ conf_keyvalue_device(void *data, const char *key, const char *value)
 }
 
 static void
-conf_devices_load(const char *dirname, nfc_context *context)
+conf_devices_load(const char *dirname, struct conf_load_state *state)
 {
+  // Adding or removing a file changes the directory modification time
+  conf_cache_depend(state, dirname);
   DIR *d = opendir(dirname);
   if (!d) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open directory: %s", dirname);
@@ -192,7 +307,8 @@ conf_devices_load(const char *dirname, nfc_context *context)
             continue;
           }
           if (S_ISREG(s.st_mode)) {
-            conf_parse_file(filename, conf_keyvalue_device, context);
+            conf_cache_depend(state, filename);
+            conf_parse_file(filename, conf_keyvalue_device, state);
           }
         }
       }
@@ -201,11 +317,173 @@ conf_devices_load(const char *dirname, nfc_context *context)
   }
 }
 
+// Read a string stored by conf_blob_append_string(), NULL when the blob is truncated
+static const char *
+conf_cache_string(const uint8_t *pbtData, const size_t szData, size_t *poffset, uint32_t *plen)
+{
+  if (*poffset + sizeof(*plen) > szData)
+    return NULL;
+  memcpy(plen, pbtData + *poffset, sizeof(*plen));
+  *poffset += sizeof(*plen);
+  if (*plen > szData - *poffset)
+    return NULL;
+  const char *s = (const char *)(pbtData + *poffset);
+  *poffset += *plen;
+  return s;
+}
+
+// Apply the pairs of a cache file if none of the files they were read from changed
+static bool
+conf_cache_replay(const char *cache_file, nfc_context *context)
+{
+  FILE *f = fopen(cache_file, "rb");
+  if (!f)
+    return false;
+  uint8_t *pbtData = NULL;
+  long len;
+  if ((fseek(f, 0, SEEK_END) == 0) && ((len = ftell(f)) > 0) && (fseek(f, 0, SEEK_SET) == 0) &&
+      (pbtData = malloc(len)) && (fread(pbtData, 1, len, f) != (size_t) len)) {
+    free(pbtData);
+    pbtData = NULL;
+  }
+  fclose(f);
+  if (!pbtData)
+    return false;
+
+  const size_t szData = len;
+  size_t offset = strlen(CONF_CACHE_MAGIC);
+  bool valid = (szData >= offset) && (0 == memcmp(pbtData, CONF_CACHE_MAGIC, offset));
+  uint32_t count = 0;
+  for (int section = 0; valid && (section < 2); section++) {
+    if (offset + sizeof(count) > szData) {
+      valid = false;
+      break;
+    }
+    memcpy(&count, pbtData + offset, sizeof(count));
+    offset += sizeof(count);
+    if (section == 1)
+      break;
+    // Validators
+    for (uint32_t i = 0; valid && (i < count); i++) {
+      uint32_t path_len;
+      const char *path = conf_cache_string(pbtData, szData, &offset, &path_len);
+      int64_t stamp[2], current[2];
+      if (!path || (path_len >= BUFSIZ) || (offset + sizeof(stamp) > szData)) {
+        valid = false;
+        break;
+      }
+      memcpy(stamp, pbtData + offset, sizeof(stamp));
+      offset += sizeof(stamp);
+      char filename[BUFSIZ];
+      memcpy(filename, path, path_len);
+      filename[path_len] = '\0';
+      conf_file_stamp(filename, &current[0], &current[1]);
+      valid = (stamp[0] == current[0]) && (stamp[1] == current[1]);
+    }
+  }
+  // Check the whole pairs list before applying any of them
+  const size_t pairs_offset = offset;
+  for (uint32_t i = 0; valid && (i < 2 * count); i++) {
+    uint32_t string_len;
+    valid = (conf_cache_string(pbtData, szData, &offset, &string_len) != NULL) && (string_len < BUFSIZ);
+  }
+  if (valid) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Configuration loaded from %s", cache_file);
+    offset = pairs_offset;
+    for (uint32_t i = 0; i < count; i++) {
+      char key[BUFSIZ], value[BUFSIZ];
+      uint32_t key_len = 0, value_len = 0;
+      const char *k = conf_cache_string(pbtData, szData, &offset, &key_len);
+      const char *v = conf_cache_string(pbtData, szData, &offset, &value_len);
+      memcpy(key, k, key_len);
+      key[key_len] = '\0';
+      memcpy(value, v, value_len);
+      value[value_len] = '\0';
+      conf_apply(context, key, value);
+    }
+  }
+  free(pbtData);
+  return valid;
+}
+
+// Write a cache file, through a temporary file so readers never see it partially written
+static void
+conf_cache_write(const char *cache_file, const struct conf_load_state *state)
+{
+  char tmp_file[BUFSIZ];
+  snprintf(tmp_file, sizeof(tmp_file), "%s.%ld", cache_file, (long) getpid());
+  FILE *f = fopen(tmp_file, "wb");
+  if (!f) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to write configuration cache: %s", tmp_file);
+    return;
+  }
+  bool ok = (fwrite(CONF_CACHE_MAGIC, strlen(CONF_CACHE_MAGIC), 1, f) == 1) &&
+            (fwrite(&(state->validators->count), sizeof(uint32_t), 1, f) == 1) &&
+            ((state->validators->len == 0) || (fwrite(state->validators->data, state->validators->len, 1, f) == 1)) &&
+            (fwrite(&(state->pairs->count), sizeof(uint32_t), 1, f) == 1) &&
+            ((state->pairs->len == 0) || (fwrite(state->pairs->data, state->pairs->len, 1, f) == 1));
+  ok = (fclose(f) == 0) && ok;
+  if (!ok || (rename(tmp_file, cache_file) != 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to write configuration cache: %s", cache_file);
+    remove(tmp_file);
+  }
+}
+
+static void
+conf_load_main(struct conf_load_state *state)
+{
+  conf_cache_depend(state, LIBNFC_CONFFILE);
+  conf_parse_file(LIBNFC_CONFFILE, conf_keyvalue_context, state);
+}
+
+static void
+conf_load_devices_dir(struct conf_load_state *state)
+{
+  conf_devices_load(LIBNFC_DEVICECONFDIR, state);
+}
+
+// Load a configuration section from its cache file when it is still valid, otherwise parse it and refresh the cache
+static void
+conf_load_section(nfc_context *context, const char *cache_file, void (*load)(struct conf_load_state *state))
+{
+  if (cache_file && conf_cache_replay(cache_file, context))
+    return;
+
+  struct conf_blob validators = { NULL, 0, 0, 0, false };
+  struct conf_blob pairs = { NULL, 0, 0, 0, false };
+  struct conf_load_state state = {
+    .context = context,
+    .validators = cache_file ? &validators : NULL,
+    .pairs = cache_file ? &pairs : NULL,
+  };
+  load(&state);
+  if (cache_file && !validators.failed && !pairs.failed)
+    conf_cache_write(cache_file, &state);
+  free(validators.data);
+  free(pairs.data);
+}
+
 void
 conf_load(nfc_context *context)
 {
-  conf_parse_file(LIBNFC_CONFFILE, conf_keyvalue_context, context);
-  conf_devices_load(LIBNFC_DEVICECONFDIR, context);
+  conf_load_section(context, context->config_cache_file, conf_load_main);
+  if (context->lazy_config) {
+    // Device definitions are only needed to list devices: see conf_load_devices()
+    context->config_devices_pending = true;
+    return;
+  }
+  conf_load_devices(context);
+}
+
+void
+conf_load_devices(nfc_context *context)
+{
+  char cache_file[BUFSIZ];
+
+  context->config_devices_pending = false;
+  if (context->config_cache_file)
+    snprintf(cache_file, sizeof(cache_file), "%s" CONF_CACHE_DEVICES_SUFFIX, context->config_cache_file);
+  conf_load_section(context, context->config_cache_file ? cache_file : NULL, conf_load_devices_dir);
 }
 
 #endif // CONFFILES
@@ -29,6 +29,8 @@
 #include <nfc/nfc-types.h>
 
 void conf_load(nfc_context *context);
+// Load device definitions deferred by a lazy conf_load()
+void conf_load_devices(nfc_context *context);
 
 #endif // __NFC_CONF_H__
 
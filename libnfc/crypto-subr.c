@@ -0,0 +1,515 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file crypto-subr.c
+ * @brief AES-128 (CBC, CMAC) and CRC32 used by card session protocols
+ *
+ * AES rounds run on AES-NI (checked at run time) or on ARMv8 crypto
+ * extensions (when the compiler targets them), otherwise in software.
+ * Round keys are laid out the same way for all implementations: decryption
+ * keys are those of the equivalent inverse cipher (FIPS-197 5.3.5).
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#ifdef WIN32
+#  define _CRT_RAND_S
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto-subr.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define AES_X86
+#  include <cpuid.h>
+#  include <wmmintrin.h>
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#  define AES_ARMV8
+#  include <arm_neon.h>
+#endif
+
+static const uint8_t aes_sbox[256] = {
+  0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe,
+  0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4,
+  0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7,
+  0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3,
+  0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09,
+  0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3,
+  0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe,
+  0x39, 0x4a, 0x4c, 0x58, 0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85,
+  0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3, 0x40, 0x8f, 0x92,
+  0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c,
+  0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19,
+  0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14,
+  0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2,
+  0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5,
+  0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08, 0xba, 0x78, 0x25,
+  0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+  0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86,
+  0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e,
+  0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+  0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint8_t aes_inv_sbox[256] = {
+  0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81,
+  0xf3, 0xd7, 0xfb, 0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e,
+  0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb, 0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23,
+  0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e, 0x08, 0x2e, 0xa1, 0x66,
+  0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25, 0x72,
+  0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65,
+  0xb6, 0x92, 0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46,
+  0x57, 0xa7, 0x8d, 0x9d, 0x84, 0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a,
+  0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06, 0xd0, 0x2c, 0x1e, 0x8f, 0xca,
+  0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b, 0x3a, 0x91,
+  0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6,
+  0x73, 0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8,
+  0x1c, 0x75, 0xdf, 0x6e, 0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f,
+  0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b, 0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2,
+  0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4, 0x1f, 0xdd, 0xa8,
+  0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+  0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93,
+  0xc9, 0x9c, 0xef, 0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb,
+  0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61, 0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6,
+  0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+static const uint32_t crc32_table[256] = {
+  0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+  0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+  0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+  0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+  0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+  0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+  0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+  0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+  0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+  0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+  0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+  0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+  0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+  0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+  0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+  0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+  0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+  0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+  0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+  0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+  0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+  0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+  0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+  0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+  0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+  0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+  0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+  0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+  0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+  0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+  0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+  0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+  0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+  0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+  0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+  0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+  0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+  0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+  0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+  0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+  0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+  0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+  0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+};
+
+static const uint8_t aes_rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+// Multiply by x in GF(2^8)
+static uint8_t
+aes_xtime(const uint8_t bt)
+{
+  return (uint8_t)((bt << 1) ^ ((bt & 0x80) ? 0x1b : 0x00));
+}
+
+static void
+aes_mix_columns(uint8_t *pbtState)
+{
+  for (size_t c = 0; c < 16; c += 4) {
+    const uint8_t a0 = pbtState[c], a1 = pbtState[c + 1], a2 = pbtState[c + 2], a3 = pbtState[c + 3];
+    const uint8_t t = a0 ^ a1 ^ a2 ^ a3;
+    pbtState[c]     = a0 ^ t ^ aes_xtime(a0 ^ a1);
+    pbtState[c + 1] = a1 ^ t ^ aes_xtime(a1 ^ a2);
+    pbtState[c + 2] = a2 ^ t ^ aes_xtime(a2 ^ a3);
+    pbtState[c + 3] = a3 ^ t ^ aes_xtime(a3 ^ a0);
+  }
+}
+
+// InvMixColumns is MixColumns applied after multiplying opposite bytes by 4
+static void
+aes_inv_mix_columns(uint8_t *pbtState)
+{
+  for (size_t c = 0; c < 16; c += 4) {
+    const uint8_t u = aes_xtime(aes_xtime(pbtState[c] ^ pbtState[c + 2]));
+    const uint8_t v = aes_xtime(aes_xtime(pbtState[c + 1] ^ pbtState[c + 3]));
+    pbtState[c] ^= u;
+    pbtState[c + 1] ^= v;
+    pbtState[c + 2] ^= u;
+    pbtState[c + 3] ^= v;
+  }
+  aes_mix_columns(pbtState);
+}
+
+static void
+aes_xor_block(uint8_t *pbtDst, const uint8_t *pbtSrc)
+{
+  for (size_t n = 0; n < AES128_BLOCK_LEN; n++)
+    pbtDst[n] ^= pbtSrc[n];
+}
+
+// Software AES-128 block encryption, in place
+static void
+aes_soft_encrypt(const uint8_t *pbtEncKeys, uint8_t *pbtState)
+{
+  uint8_t abtTmp[AES128_BLOCK_LEN];
+
+  aes_xor_block(pbtState, pbtEncKeys);
+  for (size_t r = 1; r <= 10; r++) {
+    // SubBytes and ShiftRows: row i is rotated left by i columns
+    for (size_t n = 0; n < AES128_BLOCK_LEN; n++)
+      abtTmp[n] = aes_sbox[pbtState[(n + 4 * (n & 3)) & 15]];
+    memcpy(pbtState, abtTmp, AES128_BLOCK_LEN);
+    if (r < 10)
+      aes_mix_columns(pbtState);
+    aes_xor_block(pbtState, pbtEncKeys + 16 * r);
+  }
+}
+
+// Software AES-128 block decryption (equivalent inverse cipher), in place
+static void
+aes_soft_decrypt(const uint8_t *pbtDecKeys, uint8_t *pbtState)
+{
+  uint8_t abtTmp[AES128_BLOCK_LEN];
+
+  aes_xor_block(pbtState, pbtDecKeys);
+  for (size_t r = 1; r <= 10; r++) {
+    // InvShiftRows and InvSubBytes: row i is rotated right by i columns
+    for (size_t n = 0; n < AES128_BLOCK_LEN; n++)
+      abtTmp[n] = aes_inv_sbox[pbtState[(n + 12 * (n & 3)) & 15]];
+    memcpy(pbtState, abtTmp, AES128_BLOCK_LEN);
+    if (r < 10)
+      aes_inv_mix_columns(pbtState);
+    aes_xor_block(pbtState, pbtDecKeys + 16 * r);
+  }
+}
+
+#if defined(AES_X86)
+// CPUID tells AES-NI (and SSE2 on 32 bits systems) is there
+static bool
+aes_hw_supported(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+    return false;
+  return (ecx & bit_AES) && (edx & bit_SSE2);
+}
+
+__attribute__((target("aes,sse2")))
+static void
+aes_hw_encrypt_cbc(const uint8_t *pbtEncKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+  __m128i k[11];
+  for (size_t r = 0; r < 11; r++)
+    k[r] = _mm_loadu_si128((const __m128i *)(pbtEncKeys + 16 * r));
+  __m128i s = _mm_loadu_si128((const __m128i *) pbtIv);
+  for (size_t b = 0; b < szBlocks; b++) {
+    s = _mm_xor_si128(s, _mm_loadu_si128((const __m128i *)(pbtIn + 16 * b)));
+    s = _mm_xor_si128(s, k[0]);
+    for (size_t r = 1; r < 10; r++)
+      s = _mm_aesenc_si128(s, k[r]);
+    s = _mm_aesenclast_si128(s, k[10]);
+    if (pbtOut)
+      _mm_storeu_si128((__m128i *)(pbtOut + 16 * b), s);
+  }
+  _mm_storeu_si128((__m128i *) pbtIv, s);
+}
+
+__attribute__((target("aes,sse2")))
+static void
+aes_hw_decrypt_cbc(const uint8_t *pbtDecKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+  __m128i k[11];
+  for (size_t r = 0; r < 11; r++)
+    k[r] = _mm_loadu_si128((const __m128i *)(pbtDecKeys + 16 * r));
+  __m128i iv = _mm_loadu_si128((const __m128i *) pbtIv);
+  for (size_t b = 0; b < szBlocks; b++) {
+    const __m128i c = _mm_loadu_si128((const __m128i *)(pbtIn + 16 * b));
+    __m128i s = _mm_xor_si128(c, k[0]);
+    for (size_t r = 1; r < 10; r++)
+      s = _mm_aesdec_si128(s, k[r]);
+    s = _mm_aesdeclast_si128(s, k[10]);
+    _mm_storeu_si128((__m128i *)(pbtOut + 16 * b), _mm_xor_si128(s, iv));
+    iv = c;
+  }
+  _mm_storeu_si128((__m128i *) pbtIv, iv);
+}
+#elif defined(AES_ARMV8)
+// The compiler targets the crypto extensions: every CPU running this code has them
+static bool
+aes_hw_supported(void)
+{
+  return true;
+}
+
+static void
+aes_hw_encrypt_cbc(const uint8_t *pbtEncKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+  uint8x16_t k[11];
+  for (size_t r = 0; r < 11; r++)
+    k[r] = vld1q_u8(pbtEncKeys + 16 * r);
+  uint8x16_t s = vld1q_u8(pbtIv);
+  for (size_t b = 0; b < szBlocks; b++) {
+    s = veorq_u8(s, vld1q_u8(pbtIn + 16 * b));
+    for (size_t r = 0; r < 9; r++)
+      s = vaesmcq_u8(vaeseq_u8(s, k[r]));
+    s = veorq_u8(vaeseq_u8(s, k[9]), k[10]);
+    if (pbtOut)
+      vst1q_u8(pbtOut + 16 * b, s);
+  }
+  vst1q_u8(pbtIv, s);
+}
+
+static void
+aes_hw_decrypt_cbc(const uint8_t *pbtDecKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+  uint8x16_t k[11];
+  for (size_t r = 0; r < 11; r++)
+    k[r] = vld1q_u8(pbtDecKeys + 16 * r);
+  uint8x16_t iv = vld1q_u8(pbtIv);
+  for (size_t b = 0; b < szBlocks; b++) {
+    const uint8x16_t c = vld1q_u8(pbtIn + 16 * b);
+    uint8x16_t s = c;
+    for (size_t r = 0; r < 9; r++)
+      s = vaesimcq_u8(vaesdq_u8(s, k[r]));
+    s = veorq_u8(vaesdq_u8(s, k[9]), k[10]);
+    vst1q_u8(pbtOut + 16 * b, veorq_u8(s, iv));
+    iv = c;
+  }
+  vst1q_u8(pbtIv, iv);
+}
+#endif
+
+/**
+ * @brief Tell whether AES rounds run on the CPU crypto instructions
+ */
+bool
+aes128_accelerated(void)
+{
+#if defined(AES_X86) || defined(AES_ARMV8)
+  // 0: not checked yet, 1: software, 2: hardware
+  static int iImpl = 0;
+  int impl = __atomic_load_n(&iImpl, __ATOMIC_RELAXED);
+  if (impl == 0) {
+    impl = aes_hw_supported() ? 2 : 1;
+    __atomic_store_n(&iImpl, impl, __ATOMIC_RELAXED);
+  }
+  return impl == 2;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Expand an AES-128 key into encryption and decryption round keys
+ *
+ * @param pbtKey AES128_KEY_LEN bytes
+ * @param[out] pbtEncKeys AES128_ROUND_KEYS_LEN bytes
+ * @param[out] pbtDecKeys AES128_ROUND_KEYS_LEN bytes
+ */
+void
+aes128_expand_key(const uint8_t *pbtKey, uint8_t *pbtEncKeys, uint8_t *pbtDecKeys)
+{
+  memcpy(pbtEncKeys, pbtKey, AES128_KEY_LEN);
+  for (size_t n = AES128_KEY_LEN; n < AES128_ROUND_KEYS_LEN; n += 4) {
+    uint8_t abtWord[4];
+    memcpy(abtWord, pbtEncKeys + n - 4, 4);
+    if ((n % AES128_KEY_LEN) == 0) {
+      // RotWord, SubWord and Rcon
+      const uint8_t bt = abtWord[0];
+      abtWord[0] = aes_sbox[abtWord[1]] ^ aes_rcon[n / AES128_KEY_LEN - 1];
+      abtWord[1] = aes_sbox[abtWord[2]];
+      abtWord[2] = aes_sbox[abtWord[3]];
+      abtWord[3] = aes_sbox[bt];
+    }
+    for (size_t i = 0; i < 4; i++)
+      pbtEncKeys[n + i] = pbtEncKeys[n + i - AES128_KEY_LEN] ^ abtWord[i];
+  }
+  // Equivalent inverse cipher: reversed order, InvMixColumns applied to inner keys
+  for (size_t r = 0; r < 11; r++) {
+    memcpy(pbtDecKeys + 16 * r, pbtEncKeys + 16 * (10 - r), AES128_BLOCK_LEN);
+    if ((r > 0) && (r < 10))
+      aes_inv_mix_columns(pbtDecKeys + 16 * r);
+  }
+}
+
+/**
+ * @brief AES-128 CBC encryption
+ *
+ * @param pbtIv initialization vector, updated to the last encrypted block
+ * @param pbtOut encrypted blocks, may be \a pbtIn; NULL to only compute a CBC-MAC in \a pbtIv
+ */
+void
+aes128_encrypt_cbc(const uint8_t *pbtEncKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+#if defined(AES_X86) || defined(AES_ARMV8)
+  if (aes128_accelerated()) {
+    aes_hw_encrypt_cbc(pbtEncKeys, pbtIv, pbtIn, pbtOut, szBlocks);
+    return;
+  }
+#endif
+  for (size_t b = 0; b < szBlocks; b++) {
+    aes_xor_block(pbtIv, pbtIn + 16 * b);
+    aes_soft_encrypt(pbtEncKeys, pbtIv);
+    if (pbtOut)
+      memcpy(pbtOut + 16 * b, pbtIv, AES128_BLOCK_LEN);
+  }
+}
+
+/**
+ * @brief AES-128 CBC decryption
+ *
+ * @param pbtIv initialization vector, updated to the last encrypted block
+ * @param pbtOut decrypted blocks, may be \a pbtIn
+ */
+void
+aes128_decrypt_cbc(const uint8_t *pbtDecKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks)
+{
+#if defined(AES_X86) || defined(AES_ARMV8)
+  if (aes128_accelerated()) {
+    aes_hw_decrypt_cbc(pbtDecKeys, pbtIv, pbtIn, pbtOut, szBlocks);
+    return;
+  }
+#endif
+  for (size_t b = 0; b < szBlocks; b++) {
+    uint8_t abtCipher[AES128_BLOCK_LEN];
+    memcpy(abtCipher, pbtIn + 16 * b, AES128_BLOCK_LEN);
+    memcpy(pbtOut + 16 * b, abtCipher, AES128_BLOCK_LEN);
+    aes_soft_decrypt(pbtDecKeys, pbtOut + 16 * b);
+    aes_xor_block(pbtOut + 16 * b, pbtIv);
+    memcpy(pbtIv, abtCipher, AES128_BLOCK_LEN);
+  }
+}
+
+// Shift a block left by one bit, adding the CMAC constant when a bit falls out
+static void
+aes_cmac_double(const uint8_t *pbtIn, uint8_t *pbtOut)
+{
+  const uint8_t btCarry = pbtIn[0] & 0x80;
+  for (size_t n = 0; n < AES128_BLOCK_LEN - 1; n++)
+    pbtOut[n] = (uint8_t)((pbtIn[n] << 1) | (pbtIn[n + 1] >> 7));
+  pbtOut[AES128_BLOCK_LEN - 1] = (uint8_t)(pbtIn[AES128_BLOCK_LEN - 1] << 1) ^ (btCarry ? 0x87 : 0x00);
+}
+
+/**
+ * @brief Compute CMAC subkeys (RFC 4493)
+ */
+void
+aes128_cmac_subkeys(const uint8_t *pbtEncKeys, uint8_t *pbtK1, uint8_t *pbtK2)
+{
+  uint8_t abtL[AES128_BLOCK_LEN] = { 0 };
+  const uint8_t abtZero[AES128_BLOCK_LEN] = { 0 };
+
+  aes128_encrypt_cbc(pbtEncKeys, abtL, abtZero, NULL, 1);
+  aes_cmac_double(abtL, pbtK1);
+  aes_cmac_double(pbtK1, pbtK2);
+}
+
+/**
+ * @brief Compute the CMAC (RFC 4493) of \a pbtData, chained from \a pbtIv
+ *
+ * @param pbtIv initialization vector (zero for plain CMAC), replaced by the CMAC
+ */
+void
+aes128_cmac(const uint8_t *pbtEncKeys, const uint8_t *pbtK1, const uint8_t *pbtK2, uint8_t *pbtIv, const uint8_t *pbtData, const size_t szData)
+{
+  uint8_t abtLast[AES128_BLOCK_LEN];
+  // The last block, even complete, gets a subkey
+  const size_t szFull = (szData == 0) ? 0 : (szData - 1) / AES128_BLOCK_LEN;
+  const size_t szRemain = szData - szFull * AES128_BLOCK_LEN;
+
+  aes128_encrypt_cbc(pbtEncKeys, pbtIv, pbtData, NULL, szFull);
+  memcpy(abtLast, pbtData + szFull * AES128_BLOCK_LEN, szRemain);
+  if (szRemain == AES128_BLOCK_LEN) {
+    aes_xor_block(abtLast, pbtK1);
+  } else {
+    abtLast[szRemain] = 0x80;
+    memset(abtLast + szRemain + 1, 0x00, AES128_BLOCK_LEN - szRemain - 1);
+    aes_xor_block(abtLast, pbtK2);
+  }
+  aes128_encrypt_cbc(pbtEncKeys, pbtIv, abtLast, NULL, 1);
+}
+
+/**
+ * @brief Update a CRC32 (IEEE 802.3, reflected) with \a pbtData
+ *
+ * Initial value and final complement are left to the caller, eg. DESFire
+ * starts from 0xffffffff and does not complement.
+ */
+uint32_t
+crc32_update(uint32_t ui32Crc, const uint8_t *pbtData, const size_t szData)
+{
+  for (size_t n = 0; n < szData; n++)
+    ui32Crc = crc32_table[(ui32Crc ^ pbtData[n]) & 0xff] ^ (ui32Crc >> 8);
+  return ui32Crc;
+}
+
+/**
+ * @brief Fill \a pbtData with random bytes usable as protocol challenges
+ * @return true on success
+ */
+bool
+crypto_random(uint8_t *pbtData, const size_t szData)
+{
+#ifndef WIN32
+  FILE *f = fopen("/dev/urandom", "rb");
+  if (!f)
+    return false;
+  const bool res = (fread(pbtData, 1, szData, f) == szData);
+  fclose(f);
+  return res;
+#else
+  for (size_t n = 0; n < szData; n++) {
+    unsigned int ui;
+    if (rand_s(&ui) != 0)
+      return false;
+    pbtData[n] = (uint8_t) ui;
+  }
+  return true;
+#endif
+}
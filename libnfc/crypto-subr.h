@@ -0,0 +1,52 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ *
+ * @file crypto-subr.h
+ * @brief AES-128 (CBC, CMAC) and CRC32 used by card session protocols
+ */
+
+#ifndef _LIBNFC_CRYPTO_SUBR_H_
+#  define _LIBNFC_CRYPTO_SUBR_H_
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+
+#  define AES128_BLOCK_LEN  16
+#  define AES128_KEY_LEN  16
+// Eleven round keys
+#  define AES128_ROUND_KEYS_LEN  176
+
+bool    aes128_accelerated(void);
+void    aes128_expand_key(const uint8_t *pbtKey, uint8_t *pbtEncKeys, uint8_t *pbtDecKeys);
+void    aes128_encrypt_cbc(const uint8_t *pbtEncKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks);
+void    aes128_decrypt_cbc(const uint8_t *pbtDecKeys, uint8_t *pbtIv, const uint8_t *pbtIn, uint8_t *pbtOut, const size_t szBlocks);
+void    aes128_cmac_subkeys(const uint8_t *pbtEncKeys, uint8_t *pbtK1, uint8_t *pbtK2);
+void    aes128_cmac(const uint8_t *pbtEncKeys, const uint8_t *pbtK1, const uint8_t *pbtK2, uint8_t *pbtIv, const uint8_t *pbtData, const size_t szData);
+uint32_t crc32_update(uint32_t ui32Crc, const uint8_t *pbtData, const size_t szData);
+bool    crypto_random(uint8_t *pbtData, const size_t szData);
+
+#endif // _LIBNFC_CRYPTO_SUBR_H_
@@ -105,6 +105,8 @@ const char *supported_devices[] = {
 struct acr122_pcsc_data {
   SCARDHANDLE hCard;
   SCARD_IO_REQUEST ioCard;
+  bool    bShared;            // Connected in SCARD_SHARE_DIRECT mode, other PC/SC clients may talk to the reader
+  int     iTransactionDepth;  // Nesting level of pn53x bus transactions
   uint8_t  abtRx[ACR122_PCSC_RESPONSE_LEN];
   size_t  szRx;
 };
@@ -113,45 +115,55 @@ struct acr122_pcsc_data {
 
 static SCARDCONTEXT _SCardContext;
 static int _iSCardContextRefCount = 0;
+#ifndef WIN32
+// Devices are opened and closed from any thread
+static pthread_mutex_t _SCardContextLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 static SCARDCONTEXT *
 acr122_pcsc_get_scardcontext(void)
 {
+  SCARDCONTEXT *pscc = &_SCardContext;
+#ifndef WIN32
+  pthread_mutex_lock(&_SCardContextLock);
+#endif
   if (_iSCardContextRefCount == 0) {
     if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &_SCardContext) != SCARD_S_SUCCESS)
-      return NULL;
+      pscc = NULL;
   }
-  _iSCardContextRefCount++;
+  if (pscc)
+    _iSCardContextRefCount++;
+#ifndef WIN32
+  pthread_mutex_unlock(&_SCardContextLock);
+#endif
 
-  return &_SCardContext;
+  return pscc;
 }
 
 static void
 acr122_pcsc_free_scardcontext(void)
 {
+#ifndef WIN32
+  pthread_mutex_lock(&_SCardContextLock);
+#endif
   if (_iSCardContextRefCount) {
     _iSCardContextRefCount--;
     if (!_iSCardContextRefCount) {
       SCardReleaseContext(_SCardContext);
     }
   }
+#ifndef WIN32
+  pthread_mutex_unlock(&_SCardContextLock);
+#endif
 }
 
 #define PCSC_MAX_DEVICES 16
-/**
- * @brief List opened devices
- *
- * Probe PCSC to find ACR122 devices (ACR122U and Touchatag/Tikitag).
- *
- * @param connstring array of nfc_connstring where found device's connection strings will be stored.
- * @param connstrings_len size of connstrings array.
- * @return number of devices found.
- */
+// List supported readers, skipping the first \a szSkip ones
 static size_t
-acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+acr122_pcsc_scan_from(const size_t szSkip, nfc_connstring connstrings[], const size_t connstrings_len)
 {
-  (void) context;
   size_t  szPos = 0;
+  size_t  szSkipped = 0;
   char    acDeviceNames[256 + 64 * PCSC_MAX_DEVICES];
   size_t  szDeviceNamesLen = sizeof(acDeviceNames);
   SCARDCONTEXT *pscc;
@@ -167,8 +179,10 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
   }
   // Retrieve the string array of all available pcsc readers
   DWORD dwDeviceNamesLen = szDeviceNamesLen;
-  if (SCardListReaders(*pscc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS)
+  if (SCardListReaders(*pscc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS) {
+    acr122_pcsc_free_scardcontext();
     return 0;
+  }
 
   size_t device_found = 0;
   while ((acDeviceNames[szPos] != '\0') && (device_found < connstrings_len)) {
@@ -178,7 +192,9 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
       bSupported = 0 == strncmp(supported_devices[i], acDeviceNames + szPos, l);
     }
 
-    if (bSupported) {
+    if (bSupported && (szSkipped < szSkip)) {
+      szSkipped++;
+    } else if (bSupported) {
       // Supported ACR122 device found
       snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s", ACR122_PCSC_DRIVER_NAME, acDeviceNames + szPos);
       device_found++;
@@ -194,70 +210,74 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
   return device_found;
 }
 
+/**
+ * @brief List opened devices
+ *
+ * Probe PCSC to find ACR122 devices (ACR122U and Touchatag/Tikitag).
+ *
+ * @param connstring array of nfc_connstring where found device's connection strings will be stored.
+ * @param connstrings_len size of connstrings array.
+ * @return number of devices found.
+ */
+static size_t
+acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  return acr122_pcsc_scan_from(0, connstrings, connstrings_len);
+}
+
 struct acr122_pcsc_descriptor {
-  char *pcsc_device_name;
+  const char *pcsc_device_name;
 };
 
 static nfc_device *
 acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
 {
   struct acr122_pcsc_descriptor ndd;
-  int connstring_decode_level = connstring_decode(connstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ndd.pcsc_device_name, NULL);
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ncf);
+  ndd.pcsc_device_name = ncf.params[0];
 
   if (connstring_decode_level < 1) {
     return NULL;
   }
 
+  // Hold the shared PC/SC context for the whole open: scans below reuse it
+  SCARDCONTEXT *pscc;
+  if (!(pscc = acr122_pcsc_get_scardcontext())) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s", "PCSC context not found (make sure PCSC daemon is running).");
+    return NULL;
+  }
+
   nfc_connstring fullconnstring;
-  if (connstring_decode_level == 1) {
-    // Device was not specified, take the first one we can find
-    size_t szDeviceFound = acr122_pcsc_scan(context, &fullconnstring, 1);
-    if (szDeviceFound < 1)
+  size_t index = 0;
+  if ((connstring_decode_level == 1) ||
+      ((strlen(ndd.pcsc_device_name) < 5) && (sscanf(ndd.pcsc_device_name, "%4" SCNuPTR, &index) == 1))) { // We can assume it's a reader ID as pcsc_name always ends with "NN NN"
+    // Device was not specified or only by its ID: retrieve it
+    if (acr122_pcsc_scan_from(index, &fullconnstring, 1) < 1) {
+      acr122_pcsc_free_scardcontext();
       return NULL;
-    connstring_decode_level = connstring_decode(fullconnstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ndd.pcsc_device_name, NULL);
+    }
+    connstring_decode_level = connstring_parse(fullconnstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ncf);
+    ndd.pcsc_device_name = ncf.params[0];
     if (connstring_decode_level < 2) {
+      acr122_pcsc_free_scardcontext();
       return NULL;
     }
+  } else if (strlen(ndd.pcsc_device_name) < 5) {
+    acr122_pcsc_free_scardcontext();
+    return NULL;
   } else {
     memcpy(fullconnstring, connstring, sizeof(nfc_connstring));
   }
-  if (strlen(ndd.pcsc_device_name) < 5) { // We can assume it's a reader ID as pcsc_name always ends with "NN NN"
-    // Device was not specified, only ID, retrieve it
-    size_t index;
-    if (sscanf(ndd.pcsc_device_name, "%4" SCNuPTR, &index) != 1) {
-      free(ndd.pcsc_device_name);
-      return NULL;
-    }
-    nfc_connstring *ncs = malloc(sizeof(nfc_connstring) * (index + 1));
-    if (!ncs) {
-      perror("malloc");
-      free(ndd.pcsc_device_name);
-      return NULL;
-    }
-    size_t szDeviceFound = acr122_pcsc_scan(context, ncs, index + 1);
-    if (szDeviceFound < index + 1) {
-      free(ncs);
-      free(ndd.pcsc_device_name);
-      return NULL;
-    }
-    strncpy(fullconnstring, ncs[index], sizeof(nfc_connstring));
-    fullconnstring[sizeof(nfc_connstring) - 1] = '\0';
-    free(ncs);
-    connstring_decode_level = connstring_decode(fullconnstring, ACR122_PCSC_DRIVER_NAME, "pcsc", &ndd.pcsc_device_name, NULL);
-
-    if (connstring_decode_level < 2) {
-      free(ndd.pcsc_device_name);
-      return NULL;
-    }
-  }
 
   char   *pcFirmware;
-  nfc_device *pnd = nfc_device_new(context, fullconnstring);
+  nfc_device *pnd = nfc_device_new(context, fullconnstring, NFC_ARENA_ALIGN(sizeof(struct acr122_pcsc_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
     goto error;
   }
-  pnd->driver_data = malloc(sizeof(struct acr122_pcsc_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct acr122_pcsc_data));
   if (!pnd->driver_data) {
     perror("malloc");
     goto error;
@@ -269,12 +289,9 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     goto error;
   }
 
-  SCARDCONTEXT *pscc;
-
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open %s", ndd.pcsc_device_name);
-  // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext()))
-    goto error;
+  DRIVER_DATA(pnd)->bShared = false;
+  DRIVER_DATA(pnd)->iTransactionDepth = 0;
   // Test if we were able to connect to the "emulator" card
   if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
     // Connect to ACR122 firmware version >2.0
@@ -283,6 +300,7 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC connect failed");
       goto error;
     }
+    DRIVER_DATA(pnd)->bShared = true;
   }
   // Configure I/O settings for card communication
   DRIVER_DATA(pnd)->ioCard.cbPciLength = sizeof(SCARD_IO_REQUEST);
@@ -302,13 +320,13 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
 
     pn53x_init(pnd);
 
-    free(ndd.pcsc_device_name);
     return pnd;
   }
+  SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
 
 error:
-  free(ndd.pcsc_device_name);
   nfc_device_free(pnd);
+  acr122_pcsc_free_scardcontext();
   return NULL;
 }
 
@@ -324,6 +342,31 @@ acr122_pcsc_close(nfc_device *pnd)
   nfc_device_free(pnd);
 }
 
+// Other PC/SC clients sharing the reader must not slip an APDU between our frames
+static int
+acr122_pcsc_begin_transaction(nfc_device *pnd)
+{
+  if (DRIVER_DATA(pnd)->bShared && (DRIVER_DATA(pnd)->iTransactionDepth == 0)) {
+    if (SCardBeginTransaction(DRIVER_DATA(pnd)->hCard) != SCARD_S_SUCCESS) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC transaction failed");
+      return NFC_EIO;
+    }
+  }
+  DRIVER_DATA(pnd)->iTransactionDepth++;
+  return NFC_SUCCESS;
+}
+
+static int
+acr122_pcsc_end_transaction(nfc_device *pnd)
+{
+  if (DRIVER_DATA(pnd)->iTransactionDepth == 0)
+    return NFC_SUCCESS;
+  DRIVER_DATA(pnd)->iTransactionDepth--;
+  if (DRIVER_DATA(pnd)->bShared && (DRIVER_DATA(pnd)->iTransactionDepth == 0))
+    SCardEndTransaction(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
+  return NFC_SUCCESS;
+}
+
 static int
 acr122_pcsc_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
@@ -475,6 +518,8 @@ acr122_pcsc_led_red(nfc_device *pnd, bool bOn)
 const struct pn53x_io acr122_pcsc_io = {
   .send    = acr122_pcsc_send,
   .receive = acr122_pcsc_receive,
+  .begin_transaction = acr122_pcsc_begin_transaction,
+  .end_transaction   = acr122_pcsc_end_transaction,
 };
 
 const struct nfc_driver acr122_pcsc_driver = {
@@ -487,7 +532,12 @@ const struct nfc_driver acr122_pcsc_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -504,6 +554,9 @@ const struct nfc_driver acr122_pcsc_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -512,5 +565,12 @@ const struct nfc_driver acr122_pcsc_driver = {
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
 
@@ -56,6 +56,7 @@ Thanks to d18c7db and Okko for example code
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <inttypes.h>
 #include <sys/select.h>
 #include <errno.h>
@@ -172,14 +173,18 @@ struct acr122_usb_apdu_frame {
 
 // Internal data struct
 struct acr122_usb_data {
-  usb_dev_handle *pudh;
+  libusb_device_handle *pudh;
   uint32_t uiEndPointIn;
   uint32_t uiEndPointOut;
   uint32_t uiMaxPacketSize;
+  // Transfer used to wait for replies, cancelled by acr122_usb_abort_command()
+  struct libusb_transfer *receive_transfer;
   volatile bool abort_flag;
   // Keep some buffers to reduce memcpy() usage
   struct acr122_usb_tama_frame tama_frame;
   struct acr122_usb_apdu_frame apdu_frame;
+  // Last reply, the chip layer parses answers in place (see acr122_usb_receive_view())
+  uint8_t  abtRxBuf[255 + sizeof(struct ccid_header)];
 };
 
 // CCID Bulk-Out messages type
@@ -218,13 +223,15 @@ static int acr122_usb_send_apdu(nfc_device *pnd,
 static int
 acr122_usb_bulk_read(struct acr122_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
 {
-  int res = usb_bulk_read(data->pudh, data->uiEndPointIn, (char *) abtRx, szRx, timeout);
-  if (res > 0) {
-    LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
-  } else if (res < 0) {
-    if (res != -USB_TIMEDOUT) {
+  int actual_length;
+  int res = libusb_bulk_transfer(data->pudh, data->uiEndPointIn, abtRx, szRx, &actual_length, timeout);
+  if (res == 0) {
+    LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, actual_length);
+    res = actual_length;
+  } else {
+    if (res != LIBUSB_ERROR_TIMEOUT) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", libusb_error_name(res));
       res = NFC_EIO;
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", _usb_strerror(res));
     } else {
       res = NFC_ETIMEOUT;
     }
@@ -232,19 +239,32 @@ acr122_usb_bulk_read(struct acr122_usb_data *data, uint8_t abtRx[], const size_t
   return res;
 }
 
+// Same as acr122_usb_bulk_read() but waits on the cancellable receive transfer
+static int
+acr122_usb_bulk_read_abortable(struct acr122_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
+{
+  int res = usb_bulk_read_abortable(data->receive_transfer, data->pudh, data->uiEndPointIn, abtRx, szRx, timeout, &data->abort_flag);
+  if (res > 0) {
+    LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
+  }
+  return res;
+}
+
 static int
 acr122_usb_bulk_write(struct acr122_usb_data *data, uint8_t abtTx[], const size_t szTx, const int timeout)
 {
   LOG_HEX(NFC_LOG_GROUP_COM, "TX", abtTx, szTx);
-  int res = usb_bulk_write(data->pudh, data->uiEndPointOut, (char *) abtTx, szTx, timeout);
-  if (res > 0) {
+  int actual_length;
+  int res = libusb_bulk_transfer(data->pudh, data->uiEndPointOut, abtTx, szTx, &actual_length, timeout);
+  if (res == 0) {
+    res = actual_length;
     // HACK This little hack is a well know problem of USB, see http://www.libusb.org/ticket/6 for more details
     if ((res % data->uiMaxPacketSize) == 0) {
-      usb_bulk_write(data->pudh, data->uiEndPointOut, "\0", 0, timeout);
+      libusb_bulk_transfer(data->pudh, data->uiEndPointOut, (unsigned char *) "\0", 0, &actual_length, timeout);
     }
-  } else if (res < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", _usb_strerror(res));
-    if (res == -USB_TIMEDOUT) {
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", libusb_error_name(res));
+    if (res == LIBUSB_ERROR_TIMEOUT) {
       res = NFC_ETIMEOUT;
     } else {
       res = NFC_EIO;
@@ -264,34 +284,65 @@ const struct acr122_usb_supported_device acr122_usb_supported_devices[] = {
   { 0x072F, 0x90CC, "Touchatag" },
 };
 
+bool
+acr122_usb_is_supported_device(uint16_t vendor_id, uint16_t product_id)
+{
+  for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
+    if ((vendor_id == acr122_usb_supported_devices[n].vendor_id) &&
+        (product_id == acr122_usb_supported_devices[n].product_id))
+      return true;
+  }
+  return false;
+}
+
 // Find transfer endpoints for bulk transfers
 static void
-acr122_usb_get_end_points(struct usb_device *dev, struct acr122_usb_data *data)
+acr122_usb_get_end_points(libusb_device *dev, struct acr122_usb_data *data)
 {
   uint32_t uiIndex;
   uint32_t uiEndPoint;
-  struct usb_interface_descriptor *puid = dev->config->interface->altsetting;
+  struct libusb_config_descriptor *config;
+
+  if (libusb_get_config_descriptor(dev, 0, &config) < 0)
+    return;
+  const struct libusb_interface_descriptor *puid = config->interface->altsetting;
 
   // 3 Endpoints maximum: Interrupt In, Bulk In, Bulk Out
   for (uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
     // Only accept bulk transfer endpoints (ignore interrupt endpoints)
-    if (puid->endpoint[uiIndex].bmAttributes != USB_ENDPOINT_TYPE_BULK)
+    if ((puid->endpoint[uiIndex].bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK)
       continue;
 
     // Copy the endpoint to a local var, makes it more readable code
     uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
 
     // Test if we dealing with a bulk IN endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_IN) {
+    if ((uiEndPoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN) {
       data->uiEndPointIn = uiEndPoint;
       data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
     }
     // Test if we dealing with a bulk OUT endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_OUT) {
+    if ((uiEndPoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
       data->uiEndPointOut = uiEndPoint;
       data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
     }
   }
+  libusb_free_config_descriptor(config);
+}
+
+// Check there is a configuration with at least 2 endpoints (bulk in & bulk out) on its first interface
+static bool
+acr122_usb_has_end_points(libusb_device *dev)
+{
+  struct libusb_config_descriptor *config;
+  bool res = false;
+
+  if (libusb_get_config_descriptor(dev, 0, &config) < 0)
+    return false;
+  if ((config->bNumInterfaces > 0) && (config->interface->num_altsetting > 0))
+    res = (config->interface->altsetting->bNumEndpoints >= 2);
+  libusb_free_config_descriptor(config);
+  return res;
 }
 
 static size_t
@@ -299,74 +350,83 @@ acr122_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const
 {
   (void)context;
 
-  usb_prepare();
+  if (usb_prepare() < 0)
+    return 0;
 
   size_t device_found = 0;
-  uint32_t uiBusIndex = 0;
-  struct usb_bus *bus;
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
-    struct usb_device *dev;
-
-    for (dev = bus->devices; dev; dev = dev->next, uiBusIndex++) {
-      for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
-        if ((acr122_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-            (acr122_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
-          // Make sure there are 2 endpoints available
-          // with libusb-win32 we got some null pointers so be robust before looking at endpoints:
-          if (dev->config == NULL || dev->config->interface == NULL || dev->config->interface->altsetting == NULL) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
-          if (dev->config->interface->altsetting->bNumEndpoints < 2) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
+  libusb_device **devices;
+  ssize_t szDevices = usb_get_device_list(&devices);
+  if (szDevices < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to list USB devices (%s)", libusb_error_name(szDevices));
+    return 0;
+  }
 
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
-            continue;
+  for (ssize_t i = 0; (i < szDevices) && (device_found < connstrings_len); i++) {
+    libusb_device *dev = devices[i];
+    struct libusb_device_descriptor descriptor;
+    if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+      continue;
+
+    for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
+      if ((acr122_usb_supported_devices[n].vendor_id == descriptor.idVendor) &&
+          (acr122_usb_supported_devices[n].product_id == descriptor.idProduct)) {
+        // Make sure there are 2 endpoints available
+        if (!acr122_usb_has_end_points(dev)) {
+          // Nope, we maybe want the next one, let's try to find another
+          continue;
+        }
 
-          // Set configuration
-          // acr122_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s Name %s", bus->dirname, dev->filename, acr122_usb_supported_devices[n].name);
-          usb_close(udev);
-          snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", ACR122_USB_DRIVER_NAME, bus->dirname, dev->filename);
-          device_found++;
-          // Test if we reach the maximum "wanted" devices
-          if (device_found == connstrings_len) {
-            return device_found;
-          }
+        // A device already probed successfully is not reopened on each scan
+        if (!usb_device_is_probed(dev)) {
+          libusb_device_handle *udev;
+          if (libusb_open(dev, &udev) < 0)
+            continue;
+          libusb_close(udev);
+          usb_device_set_probed(dev);
         }
+
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %03d Device %03d Name %s", libusb_get_bus_number(dev), libusb_get_device_address(dev), acr122_usb_supported_devices[n].name);
+        snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%03d:%03d", ACR122_USB_DRIVER_NAME, libusb_get_bus_number(dev), libusb_get_device_address(dev));
+        device_found++;
+        break;
       }
     }
   }
+  libusb_free_device_list(devices, 1);
 
   return device_found;
 }
 
 struct acr122_usb_descriptor {
-  char *dirname;
-  char *filename;
+  const char *dirname;
+  const char *filename;
 };
 
 static bool
-acr122_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len)
+acr122_usb_get_usb_device_name(libusb_device *dev, libusb_device_handle *udev, char *buffer, size_t len)
 {
+  struct libusb_device_descriptor descriptor;
   *buffer = '\0';
 
-  if (dev->descriptor.iManufacturer || dev->descriptor.iProduct) {
+  if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+    return false;
+
+  if (descriptor.iManufacturer || descriptor.iProduct) {
     if (udev) {
-      usb_get_string_simple(udev, dev->descriptor.iManufacturer, buffer, len);
+      if (libusb_get_string_descriptor_ascii(udev, descriptor.iManufacturer, (unsigned char *) buffer, len) < 0)
+        *buffer = '\0';
       if (strlen(buffer) > 0)
         strcpy(buffer + strlen(buffer), " / ");
-      usb_get_string_simple(udev, dev->descriptor.iProduct, buffer + strlen(buffer), len - strlen(buffer));
+      size_t szPrefix = strlen(buffer);
+      if (libusb_get_string_descriptor_ascii(udev, descriptor.iProduct, (unsigned char *) buffer + szPrefix, len - szPrefix) < 0)
+        buffer[szPrefix] = '\0';
     }
   }
 
   if (!*buffer) {
     for (size_t n = 0; n < sizeof(acr122_usb_supported_devices) / sizeof(struct acr122_usb_supported_device); n++) {
-      if ((acr122_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-          (acr122_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
+      if ((acr122_usb_supported_devices[n].vendor_id == descriptor.idVendor) &&
+          (acr122_usb_supported_devices[n].product_id == descriptor.idProduct)) {
         strncpy(buffer, acr122_usb_supported_devices[n].name, len);
         buffer[len - 1] = '\0';
         return true;
@@ -381,8 +441,10 @@ static nfc_device *
 acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
-  struct acr122_usb_descriptor desc = { NULL, NULL };
-  int connstring_decode_level = connstring_decode(connstring, ACR122_USB_DRIVER_NAME, "usb", &desc.dirname, &desc.filename);
+  libusb_device **devices = NULL;
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, ACR122_USB_DRIVER_NAME, "usb", &ncf);
+  struct acr122_usb_descriptor desc = { ncf.params[0], ncf.params[1] };
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d element(s) have been decoded from \"%s\"", connstring_decode_level, connstring);
   if (connstring_decode_level < 1) {
     goto free_mem;
@@ -392,92 +454,112 @@ acr122_usb_open(const nfc_context *context, const nfc_connstring connstring)
     .pudh = NULL,
     .uiEndPointIn = 0,
     .uiEndPointOut = 0,
+    .receive_transfer = NULL,
+    .abort_flag = false,
   };
-  struct usb_bus *bus;
-  struct usb_device *dev;
+  ssize_t szDevices;
 
-  usb_prepare();
+  if (usb_prepare() < 0)
+    goto free_mem;
+
+  if ((szDevices = usb_get_device_list(&devices)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to list USB devices (%s)", libusb_error_name(szDevices));
+    devices = NULL;
+    goto free_mem;
+  }
 
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
+  for (ssize_t i = 0; i < szDevices; i++) {
+    libusb_device *dev = devices[i];
+    char acBus[4], acDev[4];
+    snprintf(acBus, sizeof(acBus), "%03d", libusb_get_bus_number(dev));
+    snprintf(acDev, sizeof(acDev), "%03d", libusb_get_device_address(dev));
     if (connstring_decode_level > 1)  {
       // A specific bus have been specified
-      if (0 != strcmp(bus->dirname, desc.dirname))
+      if (0 != strcmp(acBus, desc.dirname))
         continue;
     }
-    for (dev = bus->devices; dev; dev = dev->next) {
-      if (connstring_decode_level > 2)  {
-        // A specific dev have been specified
-        if (0 != strcmp(dev->filename, desc.filename))
-          continue;
-      }
-      // Open the USB device
-      if ((data.pudh = usb_open(dev)) == NULL)
+    if (connstring_decode_level > 2)  {
+      // A specific dev have been specified
+      if (0 != strcmp(acDev, desc.filename))
         continue;
-      // Reset device
-      usb_reset(data.pudh);
-      // Retrieve end points
-      acr122_usb_get_end_points(dev, &data);
-      // Claim interface
-      int res = usb_claim_interface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
+    }
+    // Open the USB device
+    if (libusb_open(dev, &data.pudh) < 0)
+      continue;
+    // Reset device
+    libusb_reset_device(data.pudh);
+    // Retrieve end points
+    acr122_usb_get_end_points(dev, &data);
+    // Claim interface
+    int res = libusb_claim_interface(data.pudh, 0);
+    if (res < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", libusb_error_name(res));
+      libusb_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      res = usb_set_altinterface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set alternate setting on USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
+    res = libusb_set_interface_alt_setting(data.pudh, 0, 0);
+    if (res < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set alternate setting on USB interface (%s)", libusb_error_name(res));
+      libusb_release_interface(data.pudh, 0);
+      libusb_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      // Allocate memory for the device info and specification, fill it and return the info
-      pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        goto error;
-      }
-      acr122_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
+    if ((data.receive_transfer = libusb_alloc_transfer(0)) == NULL) {
+      perror("malloc");
+      libusb_release_interface(data.pudh, 0);
+      libusb_close(data.pudh);
+      goto free_mem;
+    }
 
-      pnd->driver_data = malloc(sizeof(struct acr122_usb_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        goto error;
-      }
-      *DRIVER_DATA(pnd) = data;
+    // Allocate memory for the device info and specification, fill it and return the info
+    pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct acr122_usb_data)) + PN53X_ARENA_LEN);
+    if (!pnd) {
+      perror("malloc");
+      goto error;
+    }
+    acr122_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
 
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &acr122_usb_io) == NULL) {
-        perror("malloc");
-        goto error;
-      }
+    pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct acr122_usb_data));
+    if (!pnd->driver_data) {
+      perror("malloc");
+      goto error;
+    }
+    *DRIVER_DATA(pnd) = data;
 
-      memcpy(&(DRIVER_DATA(pnd)->tama_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
-      memcpy(&(DRIVER_DATA(pnd)->apdu_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
-      CHIP_DATA(pnd)->timer_correction = 46; // empirical tuning
-      pnd->driver = &acr122_usb_driver;
+    // Alloc and init chip's data
+    if (pn53x_data_new(pnd, &acr122_usb_io) == NULL) {
+      perror("malloc");
+      goto error;
+    }
 
-      if (acr122_usb_init(pnd) < 0) {
-        usb_close(data.pudh);
-        goto error;
-      }
-      DRIVER_DATA(pnd)->abort_flag = false;
-      goto free_mem;
+    memcpy(&(DRIVER_DATA(pnd)->tama_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
+    memcpy(&(DRIVER_DATA(pnd)->apdu_frame), acr122_usb_frame_template, sizeof(acr122_usb_frame_template));
+    CHIP_DATA(pnd)->timer_correction = 46; // empirical tuning
+    pnd->driver = &acr122_usb_driver;
+
+    if (acr122_usb_init(pnd) < 0) {
+      goto error;
     }
+    DRIVER_DATA(pnd)->abort_flag = false;
+    goto free_mem;
   }
   // We ran out of devices before the index required
   goto free_mem;
 
 error:
   // Free allocated structure on error.
+  libusb_free_transfer(data.receive_transfer);
+  libusb_release_interface(data.pudh, 0);
+  libusb_close(data.pudh);
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
-  free(desc.dirname);
-  free(desc.filename);
+  if (devices)
+    libusb_free_device_list(devices, 1);
   return pnd;
 }
 
@@ -488,13 +570,12 @@ acr122_usb_close(nfc_device *pnd)
   pn53x_idle(pnd);
 
   int res;
-  if ((res = usb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", _usb_strerror(res));
+  if ((res = libusb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", libusb_error_name(res));
   }
 
-  if ((res = usb_close(DRIVER_DATA(pnd)->pudh)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to close USB connection (%s)", _usb_strerror(res));
-  }
+  libusb_free_transfer(DRIVER_DATA(pnd)->receive_transfer);
+  libusb_close(DRIVER_DATA(pnd)->pudh);
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
@@ -554,65 +635,64 @@ acr122_build_frame_from_tama(nfc_device *pnd, const uint8_t *tama, const size_t
   return (sizeof(struct ccid_header) + sizeof(struct apdu_header) + 1 + tama_len);
 }
 
+// Write CCID, APDU and TAMA headers in the headroom the chip layer left before tama (see pn53x_io.send_in_place)
+static int
+acr122_build_frame_in_place(nfc_device *pnd, const uint8_t *tama, const size_t tama_len, struct acr122_usb_tama_frame **ppFrame)
+{
+  if (tama_len > sizeof(DRIVER_DATA(pnd)->tama_frame.tama_payload))
+    return NFC_EINVARG;
+
+  struct acr122_usb_tama_frame *frame = (struct acr122_usb_tama_frame *)(tama - offsetof(struct acr122_usb_tama_frame, tama_payload));
+  memcpy(frame, &(DRIVER_DATA(pnd)->tama_frame), offsetof(struct acr122_usb_tama_frame, tama_payload));
+  frame->ccid_header.dwLength = htole32(tama_len + sizeof(struct apdu_header) + 1);
+  frame->apdu_header.bLen = tama_len + 1;
+  *ppFrame = frame;
+  return (sizeof(struct ccid_header) + sizeof(struct apdu_header) + 1 + tama_len);
+}
+
 static int
 acr122_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
 {
   int res;
-  if ((res = acr122_build_frame_from_tama(pnd, pbtData, szData)) < 0) {
+  struct acr122_usb_tama_frame *frame;
+  if ((res = acr122_build_frame_in_place(pnd, pbtData, szData, &frame)) < 0) {
     pnd->last_error = NFC_EINVARG;
     return pnd->last_error;
   }
 
-  if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), (unsigned char *) & (DRIVER_DATA(pnd)->tama_frame), res, timeout)) < 0) {
+  if ((res = acr122_usb_bulk_write(DRIVER_DATA(pnd), (unsigned char *) frame, res, timeout)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
   return NFC_SUCCESS;
 }
 
-#define USB_TIMEOUT_PER_PASS 200
 static int
-acr122_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+acr122_usb_receive_view(nfc_device *pnd, const uint8_t **ppbtData, const int timeout)
 {
   off_t offset = 0;
 
-  uint8_t  abtRxBuf[255 + sizeof(struct ccid_header)];
+  uint8_t *abtRxBuf = DRIVER_DATA(pnd)->abtRxBuf;
+  const size_t szRxBuf = sizeof(DRIVER_DATA(pnd)->abtRxBuf);
   int res;
 
   /*
-   * If no timeout is specified but the command is blocking, force a 200ms (USB_TIMEOUT_PER_PASS)
-   * timeout to allow breaking the loop if the user wants to stop it.
+   * The whole timeout (possibly infinite) is handed to libusb: the thread sleeps
+   * until the reply arrives, and nfc_abort_command() cancels the transfer.
    */
-  int usb_timeout;
-  int remaining_time = timeout;
-read:
-  if (timeout == USB_INFINITE_TIMEOUT) {
-    usb_timeout = USB_TIMEOUT_PER_PASS;
-  } else {
-    // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
-    if (remaining_time <= 0) {
-      pnd->last_error = NFC_ETIMEOUT;
-      return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
-    }
-  }
-
-  res = acr122_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
+  res = acr122_usb_bulk_read_abortable(DRIVER_DATA(pnd), abtRxBuf, szRxBuf, timeout);
 
   uint8_t attempted_response = RDR_to_PC_DataBlock;
   size_t len;
 
   if (res == NFC_ETIMEOUT) {
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
-      acr122_usb_ack(pnd);
-      pnd->last_error = NFC_EOPABORTED;
-      return pnd->last_error;
-    } else {
-      goto read;
-    }
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
+  if (res == NFC_EOPABORTED) {
+    acr122_usb_ack(pnd);
+    pnd->last_error = res;
+    return pnd->last_error;
   }
   if (res < 12) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid RDR_to_PC_DataBlock frame");
@@ -644,19 +724,9 @@ read:
       pnd->last_error = NFC_EIO;
       return pnd->last_error;
     }
-    acr122_usb_send_apdu(pnd, APDU_GetAdditionnalData, 0x00, 0x00, NULL, 0, abtRxBuf[11], abtRxBuf, sizeof(abtRxBuf));
+    acr122_usb_send_apdu(pnd, APDU_GetAdditionnalData, 0x00, 0x00, NULL, 0, abtRxBuf[11], abtRxBuf, szRxBuf);
   }
   offset = 0;
-  if (res == NFC_ETIMEOUT) {
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
-      acr122_usb_ack(pnd);
-      pnd->last_error = NFC_EOPABORTED;
-      return pnd->last_error;
-    } else {
-      goto read; // FIXME May cause some trouble on Touchatag, right ?
-    }
-  }
 
   if (res < 0) {
     // try to interrupt current device state
@@ -688,12 +758,6 @@ read:
   }
   len -= 4; // We skip 2 bytes for PN532 direction byte (D5) and command byte (CMD+1), then 2 bytes for APDU status (90 00).
 
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EOVFLOW;
-    return pnd->last_error;
-  }
-
   // Skip CCID remaining bytes
   offset += 2; // bSlot and bSeq are not used
   offset += 2; // XXX bStatus and bError should maybe checked ?
@@ -714,7 +778,26 @@ read:
   }
   offset += 1;
 
-  memcpy(pbtData, abtRxBuf + offset, len);
+  *ppbtData = abtRxBuf + offset;
+
+  return len;
+}
+
+static int
+acr122_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+{
+  const uint8_t *pbtView;
+  int res;
+  if ((res = acr122_usb_receive_view(pnd, &pbtView, timeout)) < 0)
+    return res;
+
+  const size_t len = (size_t) res;
+  if (len > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pbtView, len);
 
   return len;
 }
@@ -812,13 +895,15 @@ acr122_usb_init(nfc_device *pnd)
 static int
 acr122_usb_abort_command(nfc_device *pnd)
 {
-  DRIVER_DATA(pnd)->abort_flag = true;
+  usb_abort_transfer(DRIVER_DATA(pnd)->receive_transfer, &DRIVER_DATA(pnd)->abort_flag);
   return NFC_SUCCESS;
 }
 
 const struct pn53x_io acr122_usb_io = {
-  .send       = acr122_usb_send,
-  .receive    = acr122_usb_receive,
+  .send          = acr122_usb_send,
+  .receive       = acr122_usb_receive,
+  .receive_view  = acr122_usb_receive_view,
+  .send_in_place = true,
 };
 
 const struct nfc_driver acr122_usb_driver = {
@@ -832,7 +917,12 @@ const struct nfc_driver acr122_usb_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -849,6 +939,9 @@ const struct nfc_driver acr122_usb_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -857,4 +950,11 @@ const struct nfc_driver acr122_usb_driver = {
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
@@ -36,4 +36,6 @@
 
 extern const struct nfc_driver acr122_usb_driver;
 
+bool acr122_usb_is_supported_device(uint16_t vendor_id, uint16_t product_id);
+
 #endif // ! __NFC_DRIVER_ACR122_USB_H__
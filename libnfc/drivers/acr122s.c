@@ -56,6 +56,21 @@
 #define LOG_CATEGORY "libnfc.driver.acr122s"
 #define LOG_GROUP     NFC_LOG_GROUP_DRIVER
 
+#define STX 2
+#define ETX 3
+
+#define APDU_SIZE(p) ((uint32_t) (p[2] | p[3] << 8 | p[4] << 16 | p[5] << 24))
+#define FRAME_OVERHEAD 13
+#define FRAME_SIZE(p) (APDU_SIZE(p) + FRAME_OVERHEAD)
+#define MAX_FRAME_SIZE (FRAME_OVERHEAD + 5 + 255)
+
+// Frames of a batch sent ahead of the answer being waited for, told apart by their sequence number
+#define ACR122S_PIPELINE_DEPTH 3
+// CCID bmCommandStatus (bits 7-6 of bStatus) and bError of a slot still running another command
+#define CCID_COMMAND_FAILED         1
+#define CCID_COMMAND_TIME_EXTENSION 2
+#define CCID_ERROR_CMD_SLOT_BUSY    0xE0
+
 // Internal data structs
 struct acr122s_data {
   serial_port port;
@@ -65,18 +80,15 @@ struct acr122s_data {
 #else
   volatile bool abort_flag;
 #endif
+  // TAMA command frames with their constant headers written once (see acr122s_frame_pool_init())
+  uint8_t frames[ACR122S_PIPELINE_DEPTH][MAX_FRAME_SIZE];
+  // Checksum of the constant header bytes
+  uint8_t header_csum;
+  uint8_t response[MAX_FRAME_SIZE];
 };
 
 const struct pn53x_io acr122s_io;
 
-#define STX 2
-#define ETX 3
-
-#define APDU_SIZE(p) ((uint32_t) (p[2] | p[3] << 8 | p[4] << 16 | p[5] << 24))
-#define FRAME_OVERHEAD 13
-#define FRAME_SIZE(p) (APDU_SIZE(p) + FRAME_OVERHEAD)
-#define MAX_FRAME_SIZE (FRAME_OVERHEAD + 5 + 255)
-
 enum {
   ICC_POWER_ON_REQ_MSG  = 0x62,
   ICC_POWER_OFF_REQ_MSG = 0x63,
@@ -188,11 +200,11 @@ acr122s_fix_frame(uint8_t *frame)
  *
  * @param: pnd is target nfc device
  * @param: cmd is command frame to send
- * @param: timeout
+ * @param: deadline shared by all the reads of the frame
  * @return 0 if success
  */
 static int
-acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
+acr122s_send_frame(nfc_device *pnd, uint8_t *frame, const nfc_deadline deadline)
 {
   size_t frame_size = FRAME_SIZE(frame);
   uint8_t ack[4];
@@ -207,10 +219,10 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
   abort_p = &(DRIVER_DATA(pnd)->abort_flag);
 #endif
 
-  if ((ret = uart_send(port, frame, frame_size, timeout)) < 0)
+  if ((ret = uart_send(port, frame, frame_size, deadline)) < 0)
     return ret;
 
-  if ((ret = uart_receive(port, ack, 4, abort_p, timeout)) < 0)
+  if ((ret = uart_receive(port, ack, 4, abort_p, deadline)) < 0)
     return ret;
 
   if (memcmp(ack, positive_ack, 4) != 0) {
@@ -231,13 +243,13 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
  * @param: frame is buffer where received response frame will be stored
  * @param: frame_size is frame size
  * @param: abort_p
- * @param: timeout
+ * @param: deadline shared by all the reads of the frame
  * @note returned frame size can be fetched using FRAME_SIZE macro
  *
  * @return 0 if success
  */
 static int
-acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abort_p, int timeout)
+acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abort_p, const nfc_deadline deadline)
 {
   if (frame_size < 13) {
     pnd->last_error = NFC_EINVARG;
@@ -246,7 +258,7 @@ acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abo
   int ret;
   serial_port port = DRIVER_DATA(pnd)->port;
 
-  if ((ret = uart_receive(port, frame, 11, abort_p, timeout)) != 0)
+  if ((ret = uart_receive(port, frame, 11, abort_p, deadline)) != 0)
     return ret;
 
   // Is buffer sufficient to store response?
@@ -256,7 +268,7 @@ acr122s_recv_frame(nfc_device *pnd, uint8_t *frame, size_t frame_size, void *abo
   }
 
   size_t remaining = FRAME_SIZE(frame) - 11;
-  if ((ret = uart_receive(port, frame + 11, remaining, abort_p, timeout)) != 0)
+  if ((ret = uart_receive(port, frame + 11, remaining, abort_p, deadline)) != 0)
     return ret;
 
   struct xfr_block_res *res = (struct xfr_block_res *) &frame[1];
@@ -309,7 +321,7 @@ acr122s_build_frame(nfc_device *pnd,
     return false;
   if (data_size + should_prefix > 255)
     return false;
-  if (data == NULL)
+  if ((data == NULL) && (data_size > 0))
     return false;
 
   struct xfr_block_req *req = (struct xfr_block_req *) &frame[1];
@@ -331,12 +343,67 @@ acr122s_build_frame(nfc_device *pnd,
   uint8_t *buf = (uint8_t *) &frame[16];
   if (should_prefix)
     *buf++ = 0xD4;
-  memcpy(buf, data, data_size);
+  if (data_size > 0)
+    memcpy(buf, data, data_size);
   acr122s_fix_frame(frame);
 
   return true;
 }
 
+// Write the parts of the TAMA command frames which never change
+static void
+acr122s_frame_pool_init(nfc_device *pnd)
+{
+  struct acr122s_data *data = DRIVER_DATA(pnd);
+  const uint8_t abtNoData[1] = { 0 };
+
+  memset(data->frames, 0, sizeof(data->frames));
+  for (size_t i = 0; i < ACR122S_PIPELINE_DEPTH; i++)
+    acr122s_build_frame(pnd, data->frames[i], MAX_FRAME_SIZE, 0, 0, abtNoData, 0, 1);
+
+  // Headers without length, sequence number and Lc
+  uint8_t header[17];
+  memcpy(header, data->frames[0], sizeof(header));
+  struct xfr_block_req *req = (struct xfr_block_req *) &header[1];
+  req->length = 0;
+  req->seq = 0;
+  ((struct apdu_header *) &header[11])->length = 0;
+  data->header_csum = 0;
+  for (size_t i = 1; i < sizeof(header); i++)
+    data->header_csum ^= header[i];
+}
+
+/**
+ * Fill a TAMA command frame of the pool with a PN532 command.
+ *
+ * Only the length, sequence number, Lc, command and checksum are written.
+ *
+ * @return false if the command does not fit in a frame
+ */
+static bool
+acr122s_frame_pool_fill(nfc_device *pnd, uint8_t *frame, const uint8_t *cmd, size_t cmd_size)
+{
+  struct acr122s_data *data = DRIVER_DATA(pnd);
+
+  if (cmd_size + 1 > 255)
+    return false;
+  struct xfr_block_req *req = (struct xfr_block_req *) &frame[1];
+  req->length = le32(5 + 1 + cmd_size);
+  req->seq = data->seq;
+  ((struct apdu_header *) &frame[11])->length = 1 + cmd_size;
+  memcpy(frame + 17, cmd, cmd_size);
+
+  uint8_t csum = data->header_csum;
+  for (const uint8_t *p = frame + 2; p < frame + 6; p++)
+    csum ^= *p;
+  csum ^= req->seq ^ (uint8_t)(1 + cmd_size);
+  for (size_t i = 0; i < cmd_size; i++)
+    csum ^= cmd[i];
+  frame[17 + cmd_size] = csum;
+  frame[17 + cmd_size + 1] = ETX;
+  return true;
+}
+
 static int
 acr122s_activate_sam(nfc_device *pnd)
 {
@@ -348,10 +415,10 @@ acr122s_activate_sam(nfc_device *pnd)
   uint8_t resp[MAX_FRAME_SIZE];
   int ret;
 
-  if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
+  if ((ret = acr122s_send_frame(pnd, cmd, NFC_DEADLINE_NONE)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, NFC_DEADLINE_NONE)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = NORMAL;
@@ -370,10 +437,10 @@ acr122s_deactivate_sam(nfc_device *pnd)
   uint8_t resp[MAX_FRAME_SIZE];
   int ret;
 
-  if ((ret = acr122s_send_frame(pnd, cmd, 0)) != 0)
+  if ((ret = acr122s_send_frame(pnd, cmd, NFC_DEADLINE_NONE)) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, NFC_DEADLINE_NONE)) != 0)
     return ret;
 
   CHIP_DATA(pnd)->power_mode = LOWVBAT;
@@ -391,10 +458,10 @@ acr122s_get_firmware_version(nfc_device *pnd, char *version, size_t length)
     return NFC_EINVARG;
   }
 
-  if ((ret = acr122s_send_frame(pnd, cmd, 1000)) != 0)
+  if ((ret = acr122s_send_frame(pnd, cmd, nfc_deadline_from_timeout(1000))) != 0)
     return ret;
 
-  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), 0, 0)) != 0)
+  if ((ret = acr122s_recv_frame(pnd, cmd, sizeof(cmd), 0, NFC_DEADLINE_NONE)) != 0)
     return ret;
 
   size_t len = APDU_SIZE(cmd);
@@ -407,95 +474,87 @@ acr122s_get_firmware_version(nfc_device *pnd, char *version, size_t length)
 }
 
 struct acr122s_descriptor {
-  char *port;
+  const char *port;
   uint32_t speed;
 };
 
-static size_t
-acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+// Check whether an ACR122S answers on a serial port
+static bool
+acr122s_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d bauds.", acPort, ACR122S_DEFAULT_SPEED);
 
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ACR122S device on serial port: %s at %d bauds.", acPort, ACR122S_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp);
-      uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        return -1;
-      }
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp);
+  uart_set_speed(sp, ACR122S_DEFAULT_SPEED);
 
-      pnd->driver = &acr122s_driver;
-      pnd->driver_data = malloc(sizeof(struct acr122s_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        return -1;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-      DRIVER_DATA(pnd)->seq = 0;
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ACR122S_DRIVER_NAME, acPort, ACR122S_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct acr122s_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
+  }
+
+  pnd->driver = &acr122s_driver;
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct acr122s_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->seq = 0;
 
 #ifndef WIN32
-      if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        return 0;
-      }
+  if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
 #else
-      DRIVER_DATA(pnd)->abort_flag = false;
+  DRIVER_DATA(pnd)->abort_flag = false;
 #endif
 
-      if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      CHIP_DATA(pnd)->type = PN532;
-      CHIP_DATA(pnd)->power_mode = NORMAL;
-
-      char version[32];
-      int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
-      if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
-        ret = -1;
-      }
+  if (pn53x_data_new(pnd, &acr122s_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  CHIP_DATA(pnd)->power_mode = NORMAL;
 
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
+  char version[32];
+  int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
+  if (ret == 0 && strncmp("ACR122S", version, 7) != 0) {
+    ret = -1;
+  }
 
-      if (ret != 0)
-        continue;
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (ret == 0);
+}
 
-      // ACR122S reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
+static size_t
+acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  char **acPorts = uart_list_ports();
+  const char *acPort;
+  int     iDevice = 0;
 
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
+  uart_filter_ports(acPorts, context->uart_scan_filter);
+  const int res = nfc_scan_ports(context, acPorts, acr122s_probe, connstrings, connstrings_len);
   while ((acPort = acPorts[iDevice++])) {
     free((void *)acPort);
   }
   free(acPorts);
-  return device_found;
+  return (res < 0) ? 0 : (size_t) res;
 }
 
 static void
@@ -522,17 +581,16 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   serial_port sp;
   nfc_device *pnd;
   struct acr122s_descriptor ndd;
-  char *speed_s;
-  int connstring_decode_level = connstring_decode(connstring, ACR122S_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, ACR122S_DRIVER_NAME, NULL, &ncf);
+  const char *speed_s = ncf.params[1];
+  ndd.port = ncf.params[0];
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
     if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
       return NULL;
     }
-    free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -548,31 +606,27 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == INVALID_SERIAL_PORT) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR,
             "Invalid serial port: %s", ndd.port);
-    free(ndd.port);
     return NULL;
   }
   if (sp == CLAIMED_SERIAL_PORT) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR,
             "Serial port already claimed: %s", ndd.port);
-    free(ndd.port);
     return NULL;
   }
 
   uart_flush_input(sp);
   uart_set_speed(sp, ndd.speed);
 
-  pnd = nfc_device_new(context, connstring);
+  pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct acr122s_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   pnd->driver = &acr122s_driver;
   strcpy(pnd->name, ACR122S_DRIVER_NAME);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct acr122s_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct acr122s_data));
   if (!pnd->driver_data) {
     perror("malloc");
     uart_close(sp);
@@ -582,6 +636,7 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
 
   DRIVER_DATA(pnd)->port = sp;
   DRIVER_DATA(pnd)->seq = 0;
+  acr122s_frame_pool_init(pnd);
 
 #ifndef WIN32
   if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
@@ -641,13 +696,13 @@ acr122s_send(nfc_device *pnd, const uint8_t *buf, const size_t buf_len, int time
 {
   uart_flush_input(DRIVER_DATA(pnd)->port);
 
-  uint8_t cmd[MAX_FRAME_SIZE];
-  if (! acr122s_build_frame(pnd, cmd, sizeof(cmd), 0, 0, buf, buf_len, 1)) {
+  uint8_t *cmd = DRIVER_DATA(pnd)->frames[0];
+  if (! acr122s_frame_pool_fill(pnd, cmd, buf, buf_len)) {
     return NFC_EINVARG;
   }
 
   int ret;
-  if ((ret = acr122s_send_frame(pnd, cmd, timeout)) != 0) {
+  if ((ret = acr122s_send_frame(pnd, cmd, nfc_deadline_from_timeout(timeout))) != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = ret;
     return pnd->last_error;
@@ -668,7 +723,7 @@ acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
 #endif
 
   uint8_t tmp[MAX_FRAME_SIZE];
-  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), abort_p, timeout);
+  pnd->last_error = acr122s_recv_frame(pnd, tmp, sizeof(tmp), abort_p, nfc_deadline_from_timeout(timeout));
 
   if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
     pnd->last_error = NFC_EOPABORTED;
@@ -691,6 +746,133 @@ acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
   return data_len;
 }
 
+/**
+ * Read the next frame coming from ACR122S: an ACK or a response frame.
+ *
+ * @return 0 for a positive ACK, 1 for a response stored in \a frame, otherwise an error code
+ */
+static int
+acr122s_read_frame(nfc_device *pnd, uint8_t *frame, void *abort_p, const nfc_deadline deadline)
+{
+  const uint8_t positive_ack[4] = { STX, 0, 0, ETX };
+  serial_port port = DRIVER_DATA(pnd)->port;
+  int ret;
+
+  if ((ret = uart_receive(port, frame, 4, abort_p, deadline)) != 0)
+    return ret;
+  if (memcmp(frame, positive_ack, 4) == 0)
+    return 0;
+  if ((frame[0] != STX) || (frame[1] != XFR_BLOCK_RES_MSG))
+    return NFC_EIO;
+  if ((ret = uart_receive(port, frame + 4, 11 - 4, abort_p, deadline)) != 0)
+    return ret;
+  // Time extension and failure blocks come without data
+  if (FRAME_SIZE(frame) > MAX_FRAME_SIZE)
+    return NFC_EIO;
+  if ((ret = uart_receive(port, frame + 11, FRAME_SIZE(frame) - 11, abort_p, deadline)) != 0)
+    return ret;
+  return 1;
+}
+
+/*
+ * Up to ACR122S_PIPELINE_DEPTH frames are sent before the answer to the first
+ * one is read, the reader queues them and answers in order: responses are
+ * matched to frames with their sequence number. As frames already sent behind
+ * a failing one still run, only repeatable ones (see pn53x_cmd) are sent ahead:
+ * any other waits for the previous answers. Nothing is sent after a failure,
+ * answers of the frames in flight are read and dropped.
+ */
+static int
+acr122s_transceive_batch(nfc_device *pnd, struct pn53x_cmd *cmds, const size_t szCmds, int timeout)
+{
+  struct acr122s_data *data = DRIVER_DATA(pnd);
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
+  size_t sent = 0, acked = 0, answered = 0, run = 0;
+  bool failed = false;
+  void *abort_p;
+  int res;
+
+#ifndef WIN32
+  abort_p = &(data->abort_fds[1]);
+#else
+  abort_p = &(data->abort_flag);
+#endif
+
+  for (size_t i = 0; i < szCmds; i++) {
+    if (cmds[i].szTx + 1 > 255) {
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
+    }
+  }
+  uart_flush_input(data->port);
+
+  while (answered < szCmds) {
+    // Keep the pipeline full until a frame fails
+    while ((!failed) && (sent < szCmds) && (sent - answered < ACR122S_PIPELINE_DEPTH) && ((sent == answered) || cmds[sent].bRepeatable)) {
+      uint8_t *frame = data->frames[sent % ACR122S_PIPELINE_DEPTH];
+      acr122s_frame_pool_fill(pnd, frame, cmds[sent].pbtTx, cmds[sent].szTx);
+      if ((res = uart_send(data->port, frame, FRAME_SIZE(frame), deadline)) < 0)
+        goto error;
+      data->seq++;
+      sent++;
+    }
+    if (answered == sent)
+      break;
+
+    if ((res = acr122s_read_frame(pnd, data->response, abort_p, deadline)) < 0)
+      goto error;
+    if (res == 0) {
+      if (++acked > sent) {
+        res = NFC_EIO;
+        goto error;
+      }
+      continue;
+    }
+    const uint8_t *frame = data->frames[answered % ACR122S_PIPELINE_DEPTH];
+    const struct xfr_block_res *resp = (struct xfr_block_res *) &data->response[1];
+    if ((acked <= answered) || (resp->seq != ((struct xfr_block_req *) &frame[1])->seq)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid response sequence number.");
+      res = NFC_EIO;
+      goto error;
+    }
+    if ((resp->status >> 6) == CCID_COMMAND_TIME_EXTENSION) {
+      // The reader needs more time, the answer follows
+      continue;
+    }
+    answered++;
+    if (failed)
+      continue;
+
+    if ((resp->status >> 6) == CCID_COMMAND_FAILED) {
+      // Not run: the batch stops right before this frame
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Frame %" PRIuPTR " refused by the reader (error 0x%02x%s)", answered - 1, resp->error,
+              (resp->error == CCID_ERROR_CMD_SLOT_BUSY) ? ", slot busy" : "");
+      failed = true;
+      continue;
+    }
+    struct pn53x_cmd *pc = &cmds[answered - 1];
+    if (FRAME_SIZE(data->response) < 17) {
+      res = NFC_EIO;
+      goto error;
+    }
+    const size_t data_len = FRAME_SIZE(data->response) - 17;
+    if (data_len > pc->szRxLen) {
+      pc->res = NFC_EOVFLOW;
+    } else {
+      memcpy(pc->pbtRx, data->response + 13, data_len);
+      pc->res = (int) data_len;
+    }
+    run++;
+    failed = pn53x_cmd_failed(pc);
+  }
+  return (int) run;
+
+error:
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Batch stopped after %" PRIuPTR " frame(s) out of %" PRIuPTR, run, szCmds);
+  pnd->last_error = res;
+  return res;
+}
+
 static int
 acr122s_abort_command(nfc_device *pnd)
 {
@@ -703,6 +885,7 @@ acr122s_abort_command(nfc_device *pnd)
     }
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
+    uart_abort(DRIVER_DATA(pnd)->port);
 #endif
   }
   return NFC_SUCCESS;
@@ -711,8 +894,21 @@ acr122s_abort_command(nfc_device *pnd)
 const struct pn53x_io acr122s_io = {
   .send    = acr122s_send,
   .receive = acr122s_receive,
+  .transceive_batch = acr122s_transceive_batch,
 };
 
+static int
+acr122s_get_fd(nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static int
+acr122s_get_pending(nfc_device *pnd)
+{
+  return (int) uart_pending(DRIVER_DATA(pnd)->port);
+}
+
 const struct nfc_driver acr122s_driver = {
   .name       = ACR122S_DRIVER_NAME,
   .scan_type  = INTRUSIVE,
@@ -724,7 +920,12 @@ const struct nfc_driver acr122s_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -741,6 +942,9 @@ const struct nfc_driver acr122s_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -749,4 +953,13 @@ const struct nfc_driver acr122s_driver = {
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_fd         = acr122s_get_fd,
+  .get_pending    = acr122s_get_pending,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
@@ -87,6 +87,8 @@ struct arygon_data {
 #else
   volatile bool abort_flag;
 #endif
+  // The last exchange stopped mid-frame or before the answer came: input is flushed before the next command
+  bool resync;
 };
 
 // ARYGON frames
@@ -98,90 +100,83 @@ static const uint8_t arygon_error_unknown_mode[] = "FF060000\x0d\x0a";
 int     arygon_reset_tama(nfc_device *pnd);
 void    arygon_firmware(nfc_device *pnd, char *str);
 
-static size_t
-arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+// Check whether an ARYGON reader answers on a serial port
+static bool
+arygon_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d bauds.", acPort, ARYGON_DEFAULT_SPEED);
 
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find ARYGON device on serial port: %s at %d bauds.", acPort, ARYGON_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp);
-      uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        return 0;
-      }
-
-      pnd->driver = &arygon_driver;
-      pnd->driver_data = malloc(sizeof(struct arygon_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        return 0;
-      }
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp);
+  uart_set_speed(sp, ARYGON_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, ARYGON_DRIVER_NAME, acPort, ARYGON_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct arygon_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
+  }
+
+  pnd->driver = &arygon_driver;
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct arygon_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->resync = false;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
 
 #ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        return 0;
-      }
+  // pipe-based abort mecanism
+  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+    uart_close(DRIVER_DATA(pnd)->port);
+    pn53x_data_free(pnd);
+    nfc_device_free(pnd);
+    return false;
+  }
 #else
-      DRIVER_DATA(pnd)->abort_flag = false;
+  DRIVER_DATA(pnd)->abort_flag = false;
 #endif
 
-      int res = arygon_reset_tama(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      // ARYGON reader is found
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
+  int res = arygon_reset_tama(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (res >= 0);
+}
+
+static size_t
+arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  char **acPorts = uart_list_ports();
+  const char *acPort;
+  int     iDevice = 0;
+
+  uart_filter_ports(acPorts, context->uart_scan_filter);
+  const int res = nfc_scan_ports(context, acPorts, arygon_probe, connstrings, connstrings_len);
   while ((acPort = acPorts[iDevice++])) {
     free((void *)acPort);
   }
   free(acPorts);
-  return device_found;
+  return (res < 0) ? 0 : (size_t) res;
 }
 
 struct arygon_descriptor {
-  char *port;
+  const char *port;
   uint32_t speed;
 };
 
@@ -207,17 +202,16 @@ static nfc_device *
 arygon_open(const nfc_context *context, const nfc_connstring connstring)
 {
   struct arygon_descriptor ndd;
-  char *speed_s;
-  int connstring_decode_level = connstring_decode(connstring, ARYGON_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, ARYGON_DRIVER_NAME, NULL, &ncf);
+  const char *speed_s = ncf.params[1];
+  ndd.port = ncf.params[0];
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
     if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
       return NULL;
     }
-    free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -236,7 +230,6 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SERIAL_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Serial port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SERIAL_PORT) || (sp == INVALID_SERIAL_PORT)) {
-    free(ndd.port);
     return NULL;
   }
 
@@ -245,17 +238,15 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   uart_set_speed(sp, ndd.speed);
 
   // We have a connection
-  pnd = nfc_device_new(context, connstring);
+  pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct arygon_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", ARYGON_DRIVER_NAME, ndd.port);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct arygon_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct arygon_data));
   if (!pnd->driver_data) {
     perror("malloc");
     uart_close(sp);
@@ -263,6 +254,7 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
   DRIVER_DATA(pnd)->port = sp;
+  DRIVER_DATA(pnd)->resync = false;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &arygon_tama_io) == NULL) {
@@ -308,17 +300,26 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   return pnd;
 }
 
-#define ARYGON_TX_BUFFER_LEN (PN53x_NORMAL_FRAME__DATA_MAX_LEN + PN53x_NORMAL_FRAME__OVERHEAD + 1)
 #define ARYGON_RX_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
+
+/*
+ * The reader stays in TAMA pass-through between frames: each one only needs
+ * its protocol selector byte, written in the headroom left by the chip layer.
+ * Input is flushed only after an exchange went wrong (see arygon_data.resync),
+ * in sync the UART read-ahead buffer is kept from one frame to the next.
+ */
 static int
 arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   int res = 0;
-  // Before sending anything, we need to discard from any junk bytes
-  uart_flush_input(DRIVER_DATA(pnd)->port);
-
-  uint8_t abtFrame[ARYGON_TX_BUFFER_LEN] = { DEV_ARYGON_PROTOCOL_TAMA, 0x00, 0x00, 0xff };     // Every packet must start with "0x32 0x00 0x00 0xff"
+  // Discard the answer to an interrupted command, if any
+  if (DRIVER_DATA(pnd)->resync) {
+    uart_flush_input(DRIVER_DATA(pnd)->port);
+    DRIVER_DATA(pnd)->resync = false;
+  }
 
+  uint8_t *pbtFrame;
   size_t szFrame = 0;
   if (szData > PN53x_NORMAL_FRAME__DATA_MAX_LEN) {
     // ARYGON Reader with PN532 equipped does not support extended frame (bug in ARYGON firmware?)
@@ -327,20 +328,25 @@ arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
     return pnd->last_error;
   }
 
-  if ((res = pn53x_build_frame(abtFrame + 1, &szFrame, pbtData, szData)) < 0) {
+  // The chip layer left room around pbtData (see pn53x_io.send_in_place)
+  if ((res = pn53x_build_frame_in_place((uint8_t *) pbtData, szData, &pbtFrame, &szFrame)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
+  // Every packet must start with "0x32 0x00 0x00 0xff"
+  *(--pbtFrame) = DEV_ARYGON_PROTOCOL_TAMA;
 
-  if ((res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame + 1, timeout)) != 0) {
+  if ((res = uart_send(DRIVER_DATA(pnd)->port, pbtFrame, szFrame + 1, deadline)) != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
+    DRIVER_DATA(pnd)->resync = true;
     pnd->last_error = res;
     return pnd->last_error;
   }
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
-  if ((res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, timeout)) != 0) {
+  if ((res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, deadline)) != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to read ACK");
+    DRIVER_DATA(pnd)->resync = true;
     pnd->last_error = res;
     return pnd->last_error;
   }
@@ -351,9 +357,12 @@ arygon_tama_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, i
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Bad frame format.");
     // We have already read 6 bytes and arygon_error_unknown_mode is 10 bytes long
     // so we have to read 4 remaining bytes to be synchronized at the next receiving pass.
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 4, 0, timeout);
+    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 4, 0, deadline);
+    if (pnd->last_error != 0)
+      DRIVER_DATA(pnd)->resync = true;
     return pnd->last_error;
   } else {
+    DRIVER_DATA(pnd)->resync = true;
     return pnd->last_error;
   }
   return NFC_SUCCESS;
@@ -365,17 +374,77 @@ arygon_abort(nfc_device *pnd)
   // Send a valid TAMA packet to wakup the PN53x (we will not have an answer, according to Arygon manual)
   uint8_t dummy[] = { 0x32, 0x00, 0x00, 0xff, 0x09, 0xf7, 0xd4, 0x00, 0x00, 0x6c, 0x69, 0x62, 0x6e, 0x66, 0x63, 0xbe, 0x00 };
 
-  uart_send(DRIVER_DATA(pnd)->port, dummy, sizeof(dummy), 0);
+  uart_send(DRIVER_DATA(pnd)->port, dummy, sizeof(dummy), NFC_DEADLINE_NONE);
 
   // Using Arygon device we can't send ACK frame to abort the running command
+  DRIVER_DATA(pnd)->resync = true;
   return pn53x_check_communication(pnd);
 }
 
+// Read the rest of a normal information frame, returns its data length
+static int
+arygon_tama_receive_frame(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const uint8_t *pbtHeader, void *abort_p, const nfc_deadline deadline)
+{
+  uint8_t abtFrame[2 + PN53x_NORMAL_FRAME__DATA_MAX_LEN + 2];
+  int res;
+
+  if ((0x01 == pbtHeader[3]) && (0xff == pbtHeader[4])) {
+    // Error frame
+    uart_receive(DRIVER_DATA(pnd)->port, abtFrame, 3, abort_p, deadline);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
+    return NFC_EIO;
+  }
+  if ((0xff == pbtHeader[3]) && (0xff == pbtHeader[4])) {
+    // ARYGON devices does not support extended frame sending
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unexpected extended frame");
+    return NFC_EIO;
+  }
+  if ((256 != (pbtHeader[3] + pbtHeader[4])) || (pbtHeader[3] < 2)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
+    return NFC_EIO;
+  }
+  // pbtHeader[3] (LEN) include TFI + (CC+1)
+  const size_t len = pbtHeader[3] - 2;
+  if (len > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
+    return NFC_EIO;
+  }
+
+  // TFI + PD0 (CC+1) + data + DCS + postamble, in one read
+  if ((res = uart_receive(DRIVER_DATA(pnd)->port, abtFrame, len + 4, abort_p, deadline)) != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+    return res;
+  }
+  if (abtFrame[0] != 0xD5) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
+    return NFC_EIO;
+  }
+  if (abtFrame[1] != CHIP_DATA(pnd)->last_command + 1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
+    return NFC_EIO;
+  }
+
+  uint8_t btDCS = 0;
+  for (size_t szPos = 0; szPos < len + 3; szPos++) {
+    btDCS += abtFrame[szPos];
+  }
+  if (btDCS != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
+    return NFC_EIO;
+  }
+  if (0x00 != abtFrame[len + 3]) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
+    return NFC_EIO;
+  }
+  memcpy(pbtData, abtFrame + 2, len);
+  return (int) len;
+}
+
 static int
 arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   uint8_t  abtRxBuf[5];
-  size_t len;
   void *abort_p = NULL;
 
 #ifndef WIN32
@@ -384,7 +453,7 @@ arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, i
   abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
 #endif
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
+  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, deadline);
 
   if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
     arygon_abort(pnd);
@@ -396,97 +465,30 @@ arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, i
 
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+    // The answer may still come: only the next send has to drop it, no mode reset is needed
+    DRIVER_DATA(pnd)->resync = true;
     return pnd->last_error;
   }
 
   const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
   if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
+    DRIVER_DATA(pnd)->resync = true;
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
 
-  if ((0x01 == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Error frame
-    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  } else if ((0xff == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
-    // Extended frame
-    // ARYGON devices does not support extended frame sending
-    abort();
-  } else {
-    // Normal frame
-    if (256 != (abtRxBuf[3] + abtRxBuf[4])) {
-      // TODO: Retry
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      return pnd->last_error;
-    }
-
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[3] - 2;
-  }
-
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  // TFI + PD0 (CC+1)
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    return pnd->last_error;
-  }
-
-  if (abtRxBuf[0] != 0xD5) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if (abtRxBuf[1] != CHIP_DATA(pnd)->last_command + 1) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if (len) {
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, timeout);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      return pnd->last_error;
-    }
-  }
-
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-    return pnd->last_error;
-  }
-
-  uint8_t btDCS = (256 - 0xD5);
-  btDCS -= CHIP_DATA(pnd)->last_command + 1;
-  for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
-  }
-
-  if (btDCS != abtRxBuf[0]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
-  if (0x00 != abtRxBuf[1]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
-    pnd->last_error = NFC_EIO;
+  const int res = arygon_tama_receive_frame(pnd, pbtData, szDataLen, abtRxBuf, abort_p, deadline);
+  if (res < 0) {
+    DRIVER_DATA(pnd)->resync = true;
+    if (res == NFC_EOPABORTED)
+      arygon_abort(pnd);
+    pnd->last_error = res;
     return pnd->last_error;
   }
   // The PN53x command is done and we successfully received the reply
-  return len;
+  pnd->last_error = 0;
+  return res;
 }
 
 void
@@ -497,12 +499,12 @@ arygon_firmware(nfc_device *pnd, char *str)
   size_t szRx = sizeof(abtRx);
 
 
-  int res = uart_send(DRIVER_DATA(pnd)->port, arygon_firmware_version_cmd, sizeof(arygon_firmware_version_cmd), 0);
+  int res = uart_send(DRIVER_DATA(pnd)->port, arygon_firmware_version_cmd, sizeof(arygon_firmware_version_cmd), NFC_DEADLINE_NONE);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to send ARYGON firmware command.");
     return;
   }
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, 0);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, NFC_DEADLINE_NONE);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to retrieve ARYGON firmware version.");
     return;
@@ -527,11 +529,11 @@ arygon_reset_tama(nfc_device *pnd)
   size_t szRx = sizeof(abtRx);
   int res;
 
-  uart_send(DRIVER_DATA(pnd)->port, arygon_reset_tama_cmd, sizeof(arygon_reset_tama_cmd), 500);
+  uart_send(DRIVER_DATA(pnd)->port, arygon_reset_tama_cmd, sizeof(arygon_reset_tama_cmd), nfc_deadline_from_timeout(500));
 
   // Two reply are possible from ARYGON device: arygon_error_none (ie. in case the byte is well-sent)
   // or arygon_error_unknown_mode (ie. in case of the first byte was bad-transmitted)
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, 1000);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRx, szRx, 0, nfc_deadline_from_timeout(1000));
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No reply to 'reset TAMA' command.");
     pnd->last_error = res;
@@ -557,6 +559,7 @@ arygon_abort_command(nfc_device *pnd)
     }
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
+    uart_abort(DRIVER_DATA(pnd)->port);
 #endif
   }
   return NFC_SUCCESS;
@@ -564,10 +567,23 @@ arygon_abort_command(nfc_device *pnd)
 
 
 const struct pn53x_io arygon_tama_io = {
-  .send       = arygon_tama_send,
-  .receive    = arygon_tama_receive,
+  .send          = arygon_tama_send,
+  .receive       = arygon_tama_receive,
+  .send_in_place = true,
 };
 
+static int
+arygon_get_fd(nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static int
+arygon_get_pending(nfc_device *pnd)
+{
+  return (int) uart_pending(DRIVER_DATA(pnd)->port);
+}
+
 const struct nfc_driver arygon_driver = {
   .name                             = ARYGON_DRIVER_NAME,
   .scan_type                        = INTRUSIVE,
@@ -579,7 +595,12 @@ const struct nfc_driver arygon_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -596,6 +617,9 @@ const struct nfc_driver arygon_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -604,5 +628,14 @@ const struct nfc_driver arygon_driver = {
   .idle           = pn53x_idle,
   /* Even if PN532, PowerDown is not recommended on those devices */
   .powerdown      = NULL,
+  .get_fd         = arygon_get_fd,
+  .get_pending    = arygon_get_pending,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
 
@@ -0,0 +1,536 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file mux.c
+ * @brief Driver sharing a PN53x device between processes, see pn53x-mux-daemon
+ *
+ * Connection string: mux[:path[:priority]], path being MUX_DEFAULT_PATH and
+ * priority "normal" by default, otherwise "high" or "low".
+ *
+ * Frames go through a ring in a segment shared with the daemon (see mux.h),
+ * holding the device: ACK frames and chained answers are handled there.
+ */
+
+// O_NOFOLLOW is POSIX.1-2008, which _XOPEN_SOURCE 600 hides on glibc
+#define _DEFAULT_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "mux.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define MUX_DRIVER_NAME "mux"
+
+#define LOG_CATEGORY "libnfc.driver.mux"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+// Internal data structs
+const struct pn53x_io mux_io;
+struct mux_data {
+  int fd;
+  struct mux_header *pHeader;
+  struct mux_slot *pSlot;
+  int iTransactionDepth;
+  // Spinning budget, none on a single CPU where it would only delay the daemon
+  uint64_t ui64SpinUs;
+  // Entry of the last frame given to mux_send()
+  uint32_t ui32Pending;
+};
+
+#define DRIVER_DATA(pnd) ((struct mux_data*)(pnd->driver_data))
+
+// Map the segment of a running daemon, NULL otherwise
+static struct mux_header *
+mux_map(const char *pcPath, int *pfd)
+{
+  struct stat st;
+  struct mux_header *pHeader;
+
+  if ((*pfd = open(pcPath, O_RDWR | O_NOFOLLOW)) < 0)
+    return NULL;
+  // The daemon creates a regular file nobody else can write to
+  if ((fstat(*pfd, &st) < 0) || (!S_ISREG(st.st_mode)) || (st.st_mode & S_IWOTH) || ((size_t) st.st_size != sizeof(struct mux_header)) ||
+      ((pHeader = mmap(NULL, sizeof(struct mux_header), PROT_READ | PROT_WRITE, MAP_SHARED, *pfd, 0)) == MAP_FAILED)) {
+    close(*pfd);
+    return NULL;
+  }
+  if ((memcmp(pHeader->abtMagic, MUX_MAGIC, sizeof(pHeader->abtMagic)) != 0) || (pHeader->ui32Version != MUX_VERSION) ||
+      (kill(pHeader->daemon, 0) < 0 && errno == ESRCH)) {
+    munmap(pHeader, sizeof(struct mux_header));
+    close(*pfd);
+    return NULL;
+  }
+  return pHeader;
+}
+
+static size_t
+mux_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  int fd;
+  struct mux_header *pHeader;
+
+  // Only the default daemon can be found
+  if ((connstrings_len == 0) || !(pHeader = mux_map(MUX_DEFAULT_PATH, &fd)))
+    return 0;
+  munmap(pHeader, sizeof(struct mux_header));
+  close(fd);
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:%s", MUX_DRIVER_NAME, MUX_DEFAULT_PATH);
+  return 1;
+}
+
+// Lock a process-shared mutex, false when it stays held (by a process which died holding it)
+static bool
+mux_lock(pthread_mutex_t *pMutex)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec++;
+  return pthread_mutex_timedlock(pMutex, &ts) == 0;
+}
+
+// Wake the daemon up when it sleeps
+static void
+mux_ring(struct mux_header *pHeader)
+{
+  __atomic_add_fetch(&pHeader->ui32Doorbell, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pHeader->ui32Sleeping, __ATOMIC_SEQ_CST)) {
+    const bool bLocked = mux_lock(&pHeader->mutex);
+    pthread_cond_broadcast(&pHeader->cond);
+    if (bLocked)
+      pthread_mutex_unlock(&pHeader->mutex);
+  }
+}
+
+// Whether entry ui32Index was run by the daemon
+static bool
+mux_is_done(const struct mux_slot *pSlot, const uint32_t ui32Index)
+{
+  return (int32_t)(__atomic_load_n(&pSlot->ui32Done, __ATOMIC_ACQUIRE) - ui32Index) > 0;
+}
+
+// Wait until entry ui32Index was run, spinning a little first
+static int
+mux_wait(nfc_device *pnd, const uint32_t ui32Index, const nfc_deadline deadline)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  struct mux_slot *pSlot = pmd->pSlot;
+  const uint64_t ui64SpinEnd = nfc_clock_us() + pmd->ui64SpinUs;
+  int res = NFC_SUCCESS;
+
+  while (!mux_is_done(pSlot, ui32Index)) {
+    if (nfc_clock_us() >= ui64SpinEnd)
+      break;
+  }
+  if (mux_is_done(pSlot, ui32Index))
+    return NFC_SUCCESS;
+
+  while (!mux_is_done(pSlot, ui32Index)) {
+    int timeout = nfc_deadline_timeout(deadline);
+    if (timeout < 0) {
+      res = timeout;
+      break;
+    }
+    // Checks once a second that the daemon still runs
+    if ((timeout == 0) || (timeout > 1000))
+      timeout = 1000;
+    if (mux_lock(&pSlot->mutex)) {
+      __atomic_store_n(&pSlot->ui32Sleeping, 1, __ATOMIC_SEQ_CST);
+      if (!mux_is_done(pSlot, ui32Index)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += timeout / 1000;
+        ts.tv_nsec += (timeout % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&pSlot->cond, &pSlot->mutex, &ts);
+      }
+      __atomic_store_n(&pSlot->ui32Sleeping, 0, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&pSlot->mutex);
+    }
+    if ((kill(pmd->pHeader->daemon, 0) < 0) && (errno == ESRCH)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Daemon is gone");
+      res = NFC_EIO;
+      break;
+    }
+  }
+  return res;
+}
+
+// Take the next ring entry, waiting for room; it is handed to the daemon by mux_post()
+static struct mux_entry *
+mux_next_entry(nfc_device *pnd, const nfc_deadline deadline, int *pres)
+{
+  struct mux_slot *pSlot = DRIVER_DATA(pnd)->pSlot;
+  const uint32_t ui32Head = pSlot->ui32Head;
+  if (!mux_is_done(pSlot, ui32Head - MUX_RING_LEN) && ((*pres = mux_wait(pnd, ui32Head - MUX_RING_LEN, deadline)) < 0))
+    return NULL;
+  *pres = NFC_SUCCESS;
+  return &pSlot->ring[ui32Head % MUX_RING_LEN];
+}
+
+// Hand the entry taken by mux_next_entry() to the daemon, returns its index
+static uint32_t
+mux_post(nfc_device *pnd)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  const uint32_t ui32Index = pmd->pSlot->ui32Head;
+  __atomic_store_n(&pmd->pSlot->ui32Head, ui32Index + 1, __ATOMIC_RELEASE);
+  mux_ring(pmd->pHeader);
+  return ui32Index;
+}
+
+// Fill the next entry with a frame
+static int
+mux_post_frame(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const uint8_t ui8Flags, const int timeout, const nfc_deadline deadline, uint32_t *pui32Index)
+{
+  struct mux_entry *pEntry;
+  int res;
+  if (szData > MUX_FRAME_MAX_LEN)
+    return NFC_EINVARG;
+  if (!(pEntry = mux_next_entry(pnd, deadline, &res)))
+    return res;
+  pEntry->ui8Type = MUX_ENTRY_FRAME;
+  pEntry->ui8Flags = ui8Flags;
+  pEntry->ui16Tx = szData;
+  pEntry->i32Timeout = timeout;
+  memcpy(pEntry->abtTx, pbtData, szData);
+  *pui32Index = mux_post(pnd);
+  return NFC_SUCCESS;
+}
+
+static int
+mux_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  int res;
+  if ((res = mux_post_frame(pnd, pbtData, szData, 0, timeout, nfc_deadline_from_timeout(timeout), &DRIVER_DATA(pnd)->ui32Pending)) < 0)
+    pnd->last_error = res;
+  return res;
+}
+
+static int
+mux_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  int res;
+  // A late answer is simply left in the ring
+  if ((res = mux_wait(pnd, pmd->ui32Pending, nfc_deadline_from_timeout(timeout))) < 0) {
+    pnd->last_error = res;
+    return res;
+  }
+  const struct mux_entry *pEntry = &pmd->pSlot->ring[pmd->ui32Pending % MUX_RING_LEN];
+  if ((res = pEntry->i32Res) < 0) {
+    pnd->last_error = res;
+    return res;
+  }
+  if ((size_t) res > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %d)", szDataLen, res);
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pEntry->abtRx, res);
+  return res;
+}
+
+// Frames are queued as fast as the ring takes them, the daemon skips those after a failure
+static int
+mux_transceive_batch(nfc_device *pnd, struct pn53x_cmd *cmds, const size_t szCmds, int timeout)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
+  uint32_t ui32First = 0;
+  int res;
+
+  for (size_t i = 0; i < szCmds; i++) {
+    uint32_t ui32Index = 0;
+    if ((res = mux_post_frame(pnd, cmds[i].pbtTx, cmds[i].szTx, i ? MUX_FLAG_IF_PREVIOUS_OK : 0, timeout, deadline, &ui32Index)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+    if (i == 0)
+      ui32First = ui32Index;
+  }
+  size_t i;
+  for (i = 0; i < szCmds; i++) {
+    if ((res = mux_wait(pnd, ui32First + i, deadline)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+    const struct mux_entry *pEntry = &pmd->pSlot->ring[(ui32First + i) % MUX_RING_LEN];
+    if ((res = pEntry->i32Res) > 0) {
+      if ((size_t) res > cmds[i].szRxLen) {
+        res = NFC_EOVFLOW;
+      } else {
+        memcpy(cmds[i].pbtRx, pEntry->abtRx, res);
+      }
+    }
+    cmds[i].res = res;
+    if (pn53x_cmd_failed(&cmds[i])) {
+      i++;
+      break;
+    }
+  }
+  return (int) i;
+}
+
+// The daemon grants the chip to one client at a time, for a whole transaction
+static int
+mux_begin_transaction(nfc_device *pnd)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  struct mux_entry *pEntry;
+  int res;
+
+  if (pmd->iTransactionDepth++ > 0)
+    return NFC_SUCCESS;
+  if (!(pEntry = mux_next_entry(pnd, NFC_DEADLINE_NONE, &res)))
+    goto error;
+  pEntry->ui8Type = MUX_ENTRY_BEGIN;
+  const uint32_t ui32Index = mux_post(pnd);
+  if ((res = mux_wait(pnd, ui32Index, NFC_DEADLINE_NONE)) < 0)
+    goto error;
+  if (pEntry->i32Res > 0) {
+    // Another client ran: registers may not hold what we remember
+    pn53x_shadow_invalidate(pnd);
+  }
+  return NFC_SUCCESS;
+
+error:
+  pmd->iTransactionDepth--;
+  pnd->last_error = res;
+  return res;
+}
+
+static int
+mux_end_transaction(nfc_device *pnd)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  struct mux_entry *pEntry;
+  int res;
+
+  if (pmd->iTransactionDepth == 0)
+    return NFC_SUCCESS;
+  if (--pmd->iTransactionDepth > 0)
+    return NFC_SUCCESS;
+  if (!(pEntry = mux_next_entry(pnd, NFC_DEADLINE_NONE, &res)))
+    return res;
+  pEntry->ui8Type = MUX_ENTRY_END;
+  mux_post(pnd);
+  return NFC_SUCCESS;
+}
+
+static void
+mux_release(nfc_device *pnd)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  if (pmd->pSlot)
+    __atomic_store_n(&pmd->pSlot->ui32State, MUX_SLOT_FREE, __ATOMIC_RELEASE);
+  munmap(pmd->pHeader, sizeof(struct mux_header));
+  close(pmd->fd);
+}
+
+static void
+mux_close(nfc_device *pnd)
+{
+  pn53x_idle(pnd);
+  pn53x_data_free(pnd);
+  mux_release(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+mux_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  struct nfc_connstring_fields ncf;
+  uint32_t ui32Priority = MUX_PRIORITY_NORMAL;
+
+  const int connstring_decode_level = connstring_parse(connstring, MUX_DRIVER_NAME, NULL, &ncf);
+  if (connstring_decode_level < 1)
+    return NULL;
+  const char *pcPath = (connstring_decode_level >= 2) ? ncf.params[0] : MUX_DEFAULT_PATH;
+  if (connstring_decode_level == 3) {
+    if (0 == strcmp(ncf.params[1], "high")) {
+      ui32Priority = MUX_PRIORITY_HIGH;
+    } else if (0 == strcmp(ncf.params[1], "low")) {
+      ui32Priority = MUX_PRIORITY_LOW;
+    } else if (0 != strcmp(ncf.params[1], "normal")) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unknown priority class: %s", ncf.params[1]);
+      return NULL;
+    }
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct mux_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    return NULL;
+  }
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct mux_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  pmd->iTransactionDepth = 0;
+  pmd->ui64SpinUs = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? MUX_SPIN_US : 0;
+  pmd->pSlot = NULL;
+  if (!(pmd->pHeader = mux_map(pcPath, &pmd->fd))) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "No daemon sharing a device at %s", pcPath);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+
+  // Claim a free slot, its counters are left as the previous client left them
+  for (size_t i = 0; (i < MUX_SLOTS) && !pmd->pSlot; i++) {
+    uint32_t ui32State = MUX_SLOT_FREE;
+    struct mux_slot *pSlot = &pmd->pHeader->slots[i];
+    if (__atomic_compare_exchange_n(&pSlot->ui32State, &ui32State, MUX_SLOT_CLAIMED, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      pmd->pSlot = pSlot;
+  }
+  if (!pmd->pSlot) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "All %d slots of %s are used", MUX_SLOTS, pcPath);
+    mux_release(pnd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  pmd->pSlot->pid = getpid();
+  pmd->pSlot->ui32Priority = ui32Priority;
+  pmd->ui32Pending = pmd->pSlot->ui32Head;
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%.*s", MUX_DRIVER_NAME, (int)(sizeof(pnd->name) - sizeof(MUX_DRIVER_NAME) - 1), pmd->pHeader->acName);
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &mux_io) == NULL) {
+    perror("malloc");
+    mux_release(pnd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &mux_driver;
+
+  if (pn53x_init(pnd) < 0) {
+    nfc_perror(pnd, "pn53x_init");
+    mux_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+mux_abort_command(nfc_device *pnd)
+{
+  struct mux_data *pmd = DRIVER_DATA(pnd);
+  // The daemon aborts the command only if it runs a frame of ours
+  __atomic_add_fetch(&pmd->pSlot->ui32Aborts, 1, __ATOMIC_SEQ_CST);
+  const bool bLocked = mux_lock(&pmd->pHeader->mutex);
+  pthread_cond_broadcast(&pmd->pHeader->cond);
+  if (bLocked)
+    pthread_mutex_unlock(&pmd->pHeader->mutex);
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io mux_io = {
+  .send              = mux_send,
+  .receive           = mux_receive,
+  .begin_transaction = mux_begin_transaction,
+  .end_transaction   = mux_end_transaction,
+  .transceive_batch  = mux_transceive_batch,
+};
+
+const struct nfc_driver mux_driver = {
+  .name                             = MUX_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = mux_scan,
+  .open                             = mux_open,
+  .close                            = mux_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = mux_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+};
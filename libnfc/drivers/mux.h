@@ -0,0 +1,137 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file mux.h
+ * @brief Driver sharing a PN53x device between processes, see pn53x-mux-daemon
+ *
+ * Layout of the segment shared with pn53x-mux-daemon: a file created by the
+ * daemon and mapped by every client, made of a header and MUX_SLOTS client
+ * slots. Each slot holds a ring of MUX_RING_LEN entries: the client fills
+ * entries and moves ui32Head, the daemon runs them in order, writes their
+ * answer in place and moves ui32Done. Both sides spin a little before
+ * sleeping on the process-shared condition variables, woken only when the
+ * other side announced it sleeps: a frame which finds the daemon spinning
+ * costs no system call at all.
+ *
+ * The chip is granted for a whole transaction (see pn53x_io.begin_transaction),
+ * so frames of different clients never interleave within a command. Between
+ * transactions the daemon serves the highest priority class first: a
+ * production client waits at most for the end of the transaction running.
+ * Clients share the chip configuration: register writes are not lost, as the
+ * register cache of a client is dropped whenever another one ran in between,
+ * but a client selecting a target deselects the target of the others.
+ */
+
+#ifndef __NFC_DRIVER_MUX_H__
+#define __NFC_DRIVER_MUX_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <nfc/nfc-types.h>
+
+#define MUX_MAGIC                 "NFCM"
+#define MUX_VERSION               1
+#define MUX_DEFAULT_PATH          "/tmp/libnfc-mux"
+
+#define MUX_SLOTS                 8
+// Frames queued by a client, enough for a full pn53x_io.transceive_batch()
+#define MUX_RING_LEN              16
+#define MUX_FRAME_MAX_LEN         264
+
+// Priority classes, from the client connection string
+#define MUX_PRIORITY_HIGH         0
+#define MUX_PRIORITY_NORMAL       1
+#define MUX_PRIORITY_LOW          2
+#define MUX_PRIORITY_CLASSES      3
+
+// Spinning budget before sleeping, in microseconds, when there is more than one CPU to spin on
+#define MUX_SPIN_US               50
+// A transaction with no frame for that long is given up, in milliseconds
+#define MUX_STALL_TIMEOUT         1000
+
+enum mux_entry_type {
+  // Asks for the chip, answers 1 when another client used it since
+  MUX_ENTRY_BEGIN,
+  MUX_ENTRY_FRAME,
+  // Releases the chip, no answer
+  MUX_ENTRY_END,
+};
+
+// Only run the frame when the previous one of the slot succeeded
+#define MUX_FLAG_IF_PREVIOUS_OK   0x01
+
+struct mux_entry {
+  uint8_t  ui8Type;
+  uint8_t  ui8Flags;
+  uint16_t ui16Tx;
+  int32_t  i32Timeout;
+  // Answer length, otherwise libnfc's error code
+  int32_t  i32Res;
+  uint8_t  abtTx[MUX_FRAME_MAX_LEN];
+  uint8_t  abtRx[MUX_FRAME_MAX_LEN];
+};
+
+enum mux_slot_state {
+  MUX_SLOT_FREE,
+  MUX_SLOT_CLAIMED,
+};
+
+struct mux_slot {
+  uint32_t ui32State;
+  pid_t    pid;
+  uint32_t ui32Priority;
+  // Entries filled by the client and run by the daemon, free running counters
+  uint32_t ui32Head;
+  uint32_t ui32Done;
+  // Aborts asked by the client, see nfc_abort_command()
+  uint32_t ui32Aborts;
+  // The client sleeps, waiting for ui32Done to move
+  uint32_t ui32Sleeping;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct mux_entry ring[MUX_RING_LEN];
+};
+
+struct mux_header {
+  uint8_t  abtMagic[4];
+  uint32_t ui32Version;
+  pid_t    daemon;
+  char     acName[256];
+  // Bumped by clients after filling entries or asking for an abort
+  uint32_t ui32Doorbell;
+  // The daemon sleeps, waiting for ui32Doorbell to move
+  uint32_t ui32Sleeping;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  struct mux_slot slots[MUX_SLOTS];
+};
+
+extern const struct nfc_driver mux_driver;
+
+#endif // ! __NFC_DRIVER_MUX_H__
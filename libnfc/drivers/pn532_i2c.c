@@ -50,6 +50,7 @@
 #include "chips/pn53x.h"
 #include "chips/pn53x-internal.h"
 #include "buses/i2c.h"
+#include "buses/gpio.h"
 
 #define PN532_I2C_DRIVER_NAME "pn532_i2c"
 
@@ -64,7 +65,12 @@ const struct pn53x_io pn532_i2c_io;
 
 struct pn532_i2c_data {
   i2c_device dev;
+  gpio_irq irq; // PN532 P70_IRQ line, NULL to poll the I2C status byte instead
   volatile bool abort_flag;
+#ifdef NFC_LOW_STACK
+  // Frame built by pn532_i2c_send(), then frame read by pn532_i2c_receive() (see SCRATCH_INIT)
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+#endif /* NFC_LOW_STACK */
 };
 
 /* Delay for the loop waiting for READY frame (in ms) */
@@ -75,6 +81,9 @@ const struct timespec rdyDelay = {
   .tv_nsec = PN532_RDY_LOOP_DELAY * 1000 * 1000
 };
 
+/* Bytes polled while waiting for READY: enough for any frame header, up to the LCS of an extended frame */
+#define PN532_I2C_FRAME_HEADER_LEN 8
+
 /* Private Functions Prototypes */
 
 static nfc_device *pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring);
@@ -89,13 +98,71 @@ static int pn532_i2c_abort_command(nfc_device *pnd);
 
 static int pn532_i2c_wakeup(nfc_device *pnd);
 
-static int pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
+static int pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const nfc_deadline deadline);
 
 static size_t pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len);
 
 
 #define DRIVER_DATA(pnd) ((struct pn532_i2c_data*)(pnd->driver_data))
 
+/**
+ * @brief Check whether a PN532 answers on an I2C bus.
+ *
+ * @param context NFC context.
+ * @param i2cPort I2C bus name.
+ * @param connstring buffer receiving the connection string of the device.
+ * @return true if a PN532 answered on that bus.
+ */
+static bool
+pn532_i2c_probe(const nfc_context *context, const char *i2cPort, nfc_connstring connstring)
+{
+  i2c_device id = i2c_open(i2cPort, PN532_I2C_ADDR);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on I2C bus %s.", i2cPort);
+
+  if ((id == INVALID_I2C_ADDRESS) || (id == INVALID_I2C_BUS))
+    return false;
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s", PN532_I2C_DRIVER_NAME, i2cPort);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_i2c_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    i2c_close(id);
+    return false;
+  }
+  pnd->driver = &pn532_i2c_driver;
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_i2c_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    i2c_close(id);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->dev = id;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
+    perror("malloc");
+    i2c_close(DRIVER_DATA(pnd)->dev);
+    nfc_device_free(pnd);
+    return false;
+  }
+
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  DRIVER_DATA(pnd)->irq = NULL;
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  i2c_close(DRIVER_DATA(pnd)->dev);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (res >= 0);
+}
+
 /**
  * @brief Scan all available I2C buses to find PN532 devices.
  *
@@ -108,73 +175,16 @@ static size_t pn532_i2c_scan(const nfc_context *context, nfc_connstring connstri
 static size_t
 pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
 {
-  size_t device_found = 0;
-  i2c_device id;
   char **i2cPorts = i2c_list_ports();
   const char *i2cPort;
   int iDevice = 0;
 
-  while ((i2cPort = i2cPorts[iDevice++])) {
-    id = i2c_open(i2cPort, PN532_I2C_ADDR);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on I2C bus %s.", i2cPort);
-
-    if ((id != INVALID_I2C_ADDRESS) && (id != INVALID_I2C_BUS)) {
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s", PN532_I2C_DRIVER_NAME, i2cPort);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        i2c_close(id);
-        return 0;
-      }
-      pnd->driver = &pn532_i2c_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_i2c_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        i2c_close(id);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->dev = id;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_i2c_io) == NULL) {
-        perror("malloc");
-        i2c_close(DRIVER_DATA(pnd)->dev);
-        nfc_device_free(pnd);
-        return 0;
-      }
-
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
-
-      DRIVER_DATA(pnd)->abort_flag = false;
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      i2c_close(DRIVER_DATA(pnd)->dev);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
+  const int res = nfc_scan_ports(context, i2cPorts, pn532_i2c_probe, connstrings, connstrings_len);
   while ((i2cPort = i2cPorts[iDevice++])) {
     free((void *)i2cPort);
   }
   free(i2cPorts);
-  return device_found;
+  return (res < 0) ? 0 : (size_t) res;
 }
 
 /**
@@ -187,6 +197,8 @@ pn532_i2c_close(nfc_device *pnd)
 {
   pn53x_idle(pnd);
   i2c_close(DRIVER_DATA(pnd)->dev);
+  if (DRIVER_DATA(pnd)->irq)
+    gpio_irq_close(DRIVER_DATA(pnd)->irq);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -202,11 +214,12 @@ pn532_i2c_close(nfc_device *pnd)
 static nfc_device *
 pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
 {
-  char *i2c_devname;
+  struct nfc_connstring_fields ncf;
   i2c_device i2c_dev;
   nfc_device *pnd;
 
-  int connstring_decode_level = connstring_decode(connstring, PN532_I2C_DRIVER_NAME, NULL, &i2c_devname, NULL);
+  int connstring_decode_level = connstring_parse(connstring, PN532_I2C_DRIVER_NAME, NULL, &ncf);
+  const char *i2c_devname = ncf.params[0];
 
   switch (connstring_decode_level) {
     case 2:
@@ -223,7 +236,7 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
 
-  pnd = nfc_device_new(context, connstring);
+  pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_i2c_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
     i2c_close(i2c_dev);
@@ -231,7 +244,7 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_I2C_DRIVER_NAME, i2c_devname);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_i2c_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_i2c_data));
   if (!pnd->driver_data) {
     perror("malloc");
     i2c_close(i2c_dev);
@@ -259,6 +272,12 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
 
   DRIVER_DATA(pnd)->abort_flag = false;
 
+  if ((DRIVER_DATA(pnd)->irq = gpio_irq_open_connstring(connstring)) == INVALID_GPIO_IRQ) {
+    DRIVER_DATA(pnd)->irq = NULL;
+    pn532_i2c_close(pnd);
+    return NULL;
+  }
+
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
     nfc_perror(pnd, "pn53x_check_communication");
@@ -292,6 +311,7 @@ pn532_i2c_wakeup(nfc_device *pnd)
 static int
 pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   int res = 0;
 
   // Discard any existing data ?
@@ -319,9 +339,14 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
       break;
   };
 
-  uint8_t abtFrame[PN532_BUFFER_LEN] = { 0x00, 0x00, 0xff };       // Every packet must start with "00 00 ff"
+  SCRATCH_INIT(abtFrame, PN532_BUFFER_LEN, DRIVER_DATA(pnd)->abtFrame);
   size_t szFrame = 0;
 
+  // Every packet must start with "00 00 ff"
+  abtFrame[0] = 0x00;
+  abtFrame[1] = 0x00;
+  abtFrame[2] = 0xff;
+
   if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
@@ -338,7 +363,7 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
 
   // Wait for the ACK frame
-  res = pn532_i2c_wait_rdyframe(pnd, abtRxBuf, sizeof(abtRxBuf), timeout);
+  res = pn532_i2c_wait_rdyframe(pnd, abtRxBuf, sizeof(abtRxBuf), deadline);
   if (res < 0) {
     if (res == NFC_EOPABORTED) {
       // Send an ACK frame from host to abort the command.
@@ -356,39 +381,66 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
   return NFC_SUCCESS;
 }
 
+// Length of the frame starting with \a pbtHeader, 0 if it can't be told from the \a szHeader bytes read
+static size_t
+pn532_i2c_frame_len(const uint8_t *pbtHeader, const size_t szHeader)
+{
+  const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
+  if ((szHeader < 5) || (0 != memcmp(pbtHeader, pn53x_preamble, 3)))
+    return 0;
+  if (((pbtHeader[3] == 0x00) && (pbtHeader[4] == 0xff)) || ((pbtHeader[3] == 0xff) && (pbtHeader[4] == 0x00))) {
+    // ACK or NACK frame
+    return PN53x_ACK_FRAME__LEN;
+  }
+  if ((pbtHeader[3] == 0xff) && (pbtHeader[4] == 0xff)) {
+    // Extended frame
+    if (szHeader < 8)
+      return 0;
+    return 8 + ((pbtHeader[5] << 8) | pbtHeader[6]) + 2;
+  }
+  // Normal frame: header, LEN bytes (TFI + PD), DCS and postamble
+  return 5 + pbtHeader[3] + 2;
+}
+
 /**
  * @brief Read data from the PN532 device until getting a frame with RDY bit set
  *
  * @param pnd pointer on the NFC device.
  * @param pbtData buffer used to store the received frame data.
  * @param szDataLen allocated size of buffer.
- * @param timeout timeout delay before aborting the operation (in ms). Use 0 for no timeout.
+ * @param deadline time by which the frame must be ready, NFC_DEADLINE_NONE for no timeout.
  * @return length (in bytes) of the received frame, or NFC_ETIMEOUT if timeout delay has expired,
  *         NFC_EOPABORTED if operation has been aborted, NFC_EIO in case of IO failure
  */
 static int
-pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const nfc_deadline deadline)
 {
   bool done = false;
   int res;
 
-  struct timeval start_tv, cur_tv;
-  long long duration;
-
   // Actual I2C response frame includes an additional status byte,
   // so we use a temporary buffer to read the I2C frame
   uint8_t i2cRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + 1];
 
-  if (timeout > 0) {
-    // If a timeout is specified, get current timestamp
-    gettimeofday(&start_tv, NULL);
-  }
-
   do {
-    // Wait a little bit before reading
-    nanosleep(&rdyDelay, (struct timespec *) NULL);
+    if (DRIVER_DATA(pnd)->irq) {
+      // Sleep until PN532 asserts its IRQ line, then read the frame once
+      res = gpio_irq_wait(DRIVER_DATA(pnd)->irq, deadline, &DRIVER_DATA(pnd)->abort_flag);
+      if (res == NFC_EOPABORTED) {
+        DRIVER_DATA(pnd)->abort_flag = false;
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
+                "Wait for a READY frame has been aborted.");
+        return res;
+      }
+      if (res < 0)
+        return res;
+    } else {
+      // Wait a little bit before reading
+      nanosleep(&rdyDelay, (struct timespec *) NULL);
+    }
 
-    int recCount = i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, szDataLen + 1);
+    // Poll the status byte and the frame header only, the whole frame is read once its length is known
+    int recCount = i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, MIN(szDataLen, PN532_I2C_FRAME_HEADER_LEN) + 1);
 
     if (DRIVER_DATA(pnd)->abort_flag) {
       // Reset abort flag
@@ -408,18 +460,30 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
         int copyLength;
 
         done = true;
-        res = recCount - 1;
+        size_t szFrame = pn532_i2c_frame_len(i2cRx + 1, recCount - 1);
+        if ((szFrame == 0) || (szFrame > szDataLen)) {
+          // Unknown header: read as much as the caller can take
+          szFrame = szDataLen;
+        }
+        if (szFrame > (size_t)(recCount - 1)) {
+          // Each read restarts with the status byte and the frame from its beginning
+          recCount = i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, szFrame + 1);
+          if (recCount <= 0) {
+            return NFC_EIO;
+          }
+          if (!(i2cRx[0] & 1)) {
+            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "READY frame vanished while reading it");
+            return NFC_EIO;
+          }
+        }
+        res = MIN(recCount - 1, (int)szFrame);
         copyLength = MIN(res, (int)szDataLen);
         memcpy(pbtData, &(i2cRx[1]), copyLength);
       } else {
         /* Not ready yet. Check for elapsed timeout. */
 
-        if (timeout > 0) {
-          gettimeofday(&cur_tv, NULL);
-          duration = (cur_tv.tv_sec - start_tv.tv_sec) * 1000000L
-                     + (cur_tv.tv_usec - start_tv.tv_usec);
-
-          if (duration / 1000 > timeout) {
+        if (deadline != NFC_DEADLINE_NONE) {
+          if (nfc_deadline_timeout(deadline) < 0) {
             res = NFC_ETIMEOUT;
             done = true;
 
@@ -447,12 +511,12 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
 static int
 pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t frameBuf[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  SCRATCH_INIT(frameBuf, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, DRIVER_DATA(pnd)->abtFrame);
   int frameLength;
   int TFI_idx;
   size_t len;
 
-  frameLength = pn532_i2c_wait_rdyframe(pnd, frameBuf, sizeof(frameBuf), timeout);
+  frameLength = pn532_i2c_wait_rdyframe(pnd, frameBuf, PN53x_EXTENDED_FRAME__DATA_MAX_LEN, nfc_deadline_from_timeout(timeout));
 
   if (NFC_EOPABORTED == pnd->last_error) {
     return pn532_i2c_ack(pnd);
@@ -591,7 +655,12 @@ const struct nfc_driver pn532_i2c_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -608,6 +677,9 @@ const struct nfc_driver pn532_i2c_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -615,5 +687,12 @@ const struct nfc_driver pn532_i2c_driver = {
   .abort_command  = pn532_i2c_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = pn532_initiator_sam_transceive_bytes,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
 
@@ -46,6 +46,7 @@
 #include "chips/pn53x.h"
 #include "chips/pn53x-internal.h"
 #include "spi.h"
+#include "gpio.h"
 
 #define PN532_SPI_DEFAULT_SPEED 1000000 // 1 MHz
 #define PN532_SPI_DRIVER_NAME "pn532_spi"
@@ -74,7 +75,12 @@
 const struct pn53x_io pn532_spi_io;
 struct pn532_spi_data {
   spi_port port;
+  gpio_irq irq; // PN532 P70_IRQ line, NULL to poll the SPI status instead
   volatile bool abort_flag;
+#ifdef NFC_LOW_STACK
+  // Frame built by pn532_spi_send() (see SCRATCH_INIT)
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD + 1];
+#endif /* NFC_LOW_STACK */
 };
 
 static const uint8_t pn532_spi_cmd_dataread = 0x03;
@@ -87,83 +93,76 @@ int     pn532_spi_wakeup(nfc_device *pnd);
 
 #define DRIVER_DATA(pnd) ((struct pn532_spi_data*)(pnd->driver_data))
 
+// Check whether a PN532 answers on a SPI port
+static bool
+pn532_spi_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
+{
+  spi_port sp = spi_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on SPI port: %s at %d Hz.", acPort, PN532_SPI_DEFAULT_SPEED);
+
+  if ((sp == INVALID_SPI_PORT) || (sp == CLAIMED_SPI_PORT))
+    return false;
+  // Serial port claimed but we need to check if a PN532_SPI is opened.
+  spi_set_speed(sp, PN532_SPI_DEFAULT_SPEED);
+  spi_set_mode(sp, PN532_SPI_MODE);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_SPI_DRIVER_NAME, acPort, PN532_SPI_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_spi_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    spi_close(sp);
+    return false;
+  }
+  pnd->driver = &pn532_spi_driver;
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_spi_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    spi_close(sp);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_spi_io) == NULL) {
+    perror("malloc");
+    spi_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+
+  DRIVER_DATA(pnd)->irq = NULL;
+  DRIVER_DATA(pnd)->abort_flag = false;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  spi_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (res >= 0);
+}
+
 static size_t
 pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
 {
-  size_t device_found = 0;
-  spi_port sp;
   char **acPorts = spi_list_ports();
   const char *acPort;
   int     iDevice = 0;
 
-  while ((acPort = acPorts[iDevice++])) {
-    sp = spi_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on SPI port: %s at %d Hz.", acPort, PN532_SPI_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SPI_PORT) && (sp != CLAIMED_SPI_PORT)) {
-      // Serial port claimed but we need to check if a PN532_SPI is opened.
-      spi_set_speed(sp, PN532_SPI_DEFAULT_SPEED);
-      spi_set_mode(sp, PN532_SPI_MODE);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_SPI_DRIVER_NAME, acPort, PN532_SPI_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        spi_close(sp);
-        return 0;
-      }
-      pnd->driver = &pn532_spi_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_spi_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        spi_close(sp);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_spi_io) == NULL) {
-        perror("malloc");
-        spi_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
-
-      DRIVER_DATA(pnd)->abort_flag = false;
-
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      spi_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
-
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
-
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
+  const int res = nfc_scan_ports(context, acPorts, pn532_spi_probe, connstrings, connstrings_len);
   while ((acPort = acPorts[iDevice++])) {
     free((void *)acPort);
   }
   free(acPorts);
-  return device_found;
+  return (res < 0) ? 0 : (size_t) res;
 }
 
 struct pn532_spi_descriptor {
-  char *port;
+  const char *port;
   uint32_t speed;
 };
 
@@ -174,6 +173,8 @@ pn532_spi_close(nfc_device *pnd)
 
   // Release SPI port
   spi_close(DRIVER_DATA(pnd)->port);
+  if (DRIVER_DATA(pnd)->irq)
+    gpio_irq_close(DRIVER_DATA(pnd)->irq);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -183,17 +184,20 @@ static nfc_device *
 pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
 {
   struct pn532_spi_descriptor ndd;
-  char *speed_s;
-  int connstring_decode_level = connstring_decode(connstring, PN532_SPI_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, PN532_SPI_DRIVER_NAME, NULL, &ncf);
+  const char *speed_s = ncf.params[1];
+  ndd.port = ncf.params[0];
+  if ((connstring_decode_level == 3) && (0 == strncmp(speed_s, GPIO_IRQ_CONNSTRING_PREFIX + 1, strlen(GPIO_IRQ_CONNSTRING_PREFIX) - 1))) {
+    // No speed given, only the IRQ line
+    connstring_decode_level = 2;
+  }
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
     if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
       return NULL;
     }
-    free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -212,24 +216,21 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SPI_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "SPI port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SPI_PORT) || (sp == INVALID_SPI_PORT)) {
-    free(ndd.port);
     return NULL;
   }
   spi_set_speed(sp, ndd.speed);
   spi_set_mode(sp, PN532_SPI_MODE);
 
   // We have a connection
-  pnd = nfc_device_new(context, connstring);
+  pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_spi_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
     spi_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_SPI_DRIVER_NAME, ndd.port);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_spi_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_spi_data));
   if (!pnd->driver_data) {
     perror("malloc");
     spi_close(sp);
@@ -256,6 +257,12 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
 
   DRIVER_DATA(pnd)->abort_flag = false;
 
+  if ((DRIVER_DATA(pnd)->irq = gpio_irq_open_connstring(connstring)) == INVALID_GPIO_IRQ) {
+    DRIVER_DATA(pnd)->irq = NULL;
+    pn532_spi_close(pnd);
+    return NULL;
+  }
+
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
     nfc_perror(pnd, "pn53x_check_communication");
@@ -324,16 +331,21 @@ pn532_spi_wakeup(nfc_device *pnd)
 #define PN532_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
 
 
+// Wait for the PN532 to have a frame ready, until deadline
 static int
-pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
+pn532_spi_wait_for_data(nfc_device *pnd, const nfc_deadline deadline)
 {
   static const uint8_t pn532_spi_ready = 0x01;
   static const int pn532_spi_poll_interval = 10; //ms
 
-
-  int timer = 0;
-
   int ret;
+  if (DRIVER_DATA(pnd)->irq) {
+    // PN532 asserts its IRQ line once a frame is ready, no need to poll the SPI status
+    if ((ret = gpio_irq_wait(DRIVER_DATA(pnd)->irq, deadline, &DRIVER_DATA(pnd)->abort_flag)) == NFC_EOPABORTED)
+      DRIVER_DATA(pnd)->abort_flag = false;
+    return ret;
+  }
+
   while ((ret = pn532_spi_read_spi_status(pnd)) != pn532_spi_ready) {
     if (ret < 0) {
       return ret;
@@ -344,9 +356,9 @@ pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
       return NFC_EOPABORTED;
     }
 
-    if (timeout > 0) {
-      timer += pn532_spi_poll_interval;
-      if (timer > timeout) {
+    if (deadline != NFC_DEADLINE_NONE) {
+      // Time spent reading the status counts too, not only the sleeps
+      if (nfc_deadline_timeout(deadline) < 0) {
         return NFC_ETIMEOUT;
       }
 
@@ -407,7 +419,7 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
   uint8_t  abtRxBuf[5];
   size_t len;
 
-  pnd->last_error = pn532_spi_wait_for_data(pnd, timeout);
+  pnd->last_error = pn532_spi_wait_for_data(pnd, nfc_deadline_from_timeout(timeout));
 
   if (NFC_EOPABORTED == pnd->last_error) {
     return pn532_spi_ack(pnd);
@@ -553,6 +565,7 @@ error:
 static int
 pn532_spi_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   int res = 0;
 
   switch (CHIP_DATA(pnd)->power_mode) {
@@ -578,9 +591,15 @@ pn532_spi_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
       break;
   };
 
-  uint8_t  abtFrame[PN532_BUFFER_LEN + 1] = { pn532_spi_cmd_datawrite, 0x00, 0x00, 0xff };       // SPI data transfer starts with DATAWRITE (0x01) byte,  Every packet must start with "00 00 ff"
+  SCRATCH_INIT(abtFrame, PN532_BUFFER_LEN + 1, DRIVER_DATA(pnd)->abtFrame);
   size_t szFrame = 0;
 
+  // SPI data transfer starts with DATAWRITE (0x01) byte,  Every packet must start with "00 00 ff"
+  abtFrame[0] = pn532_spi_cmd_datawrite;
+  abtFrame[1] = 0x00;
+  abtFrame[2] = 0x00;
+  abtFrame[3] = 0xff;
+
   if ((res = pn53x_build_frame(abtFrame + 1, &szFrame, pbtData, szData)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
@@ -593,7 +612,7 @@ pn532_spi_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
     return pnd->last_error;
   }
 
-  res = pn532_spi_wait_for_data(pnd, timeout);
+  res = pn532_spi_wait_for_data(pnd, deadline);
   if (res != NFC_SUCCESS) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to wait for SPI data. (RX)");
     pnd->last_error = res;
@@ -660,7 +679,12 @@ const struct nfc_driver pn532_spi_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -677,6 +701,9 @@ const struct nfc_driver pn532_spi_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -684,5 +711,12 @@ const struct nfc_driver pn532_spi_driver = {
   .abort_command  = pn532_spi_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = pn532_initiator_sam_transceive_bytes,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
 
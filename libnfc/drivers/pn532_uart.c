@@ -54,6 +54,29 @@
 #define LOG_CATEGORY "libnfc.driver.pn532_uart"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
+#ifndef WIN32
+#  include <time.h>
+#  define msleep(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = x / 1000; \
+    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define msleep Sleep
+#endif
+
+// HSU speeds tried by speed negotiation, fastest first, with their SetSerialBaudRate code
+static const struct {
+  uint32_t speed;
+  uint8_t  code;
+} pn532_uart_speeds[] = {
+  { 921600, 0x07 },
+  { 460800, 0x06 },
+  { 230400, 0x05 },
+};
+
 // Internal data structs
 const struct pn53x_io pn532_uart_io;
 struct pn532_uart_data {
@@ -63,6 +86,10 @@ struct pn532_uart_data {
 #else
   volatile bool abort_flag;
 #endif
+#ifdef NFC_LOW_STACK
+  // Frame built by pn532_uart_send() (see SCRATCH_INIT)
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+#endif /* NFC_LOW_STACK */
 };
 
 // Prototypes
@@ -71,95 +98,89 @@ int     pn532_uart_wakeup(nfc_device *pnd);
 
 #define DRIVER_DATA(pnd) ((struct pn532_uart_data*)(pnd->driver_data))
 
-static size_t
-pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+// Check whether a PN532 answers on a serial port
+static bool
+pn532_uart_probe(const nfc_context *context, const char *acPort, nfc_connstring connstring)
 {
-  size_t device_found = 0;
-  serial_port sp;
-  char **acPorts = uart_list_ports();
-  const char *acPort;
-  int     iDevice = 0;
+  serial_port sp = uart_open(acPort);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d bauds.", acPort, PN532_UART_DEFAULT_SPEED);
 
-  while ((acPort = acPorts[iDevice++])) {
-    sp = uart_open(acPort);
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Trying to find PN532 device on serial port: %s at %d bauds.", acPort, PN532_UART_DEFAULT_SPEED);
-
-    if ((sp != INVALID_SERIAL_PORT) && (sp != CLAIMED_SERIAL_PORT)) {
-      // We need to flush input to be sure first reply does not comes from older byte transceive
-      uart_flush_input(sp);
-      // Serial port claimed but we need to check if a PN532_UART is opened.
-      uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
-
-      nfc_connstring connstring;
-      snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
-      nfc_device *pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        uart_close(sp);
-        return 0;
-      }
-      pnd->driver = &pn532_uart_driver;
-      pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        uart_close(sp);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      DRIVER_DATA(pnd)->port = sp;
-
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
-        perror("malloc");
-        uart_close(DRIVER_DATA(pnd)->port);
-        nfc_device_free(pnd);
-        return 0;
-      }
-      // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
-      CHIP_DATA(pnd)->type = PN532;
-      // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT))
+    return false;
+  // We need to flush input to be sure first reply does not comes from older byte transceive
+  uart_flush_input(sp);
+  // Serial port claimed but we need to check if a PN532_UART is opened.
+  uart_set_speed(sp, PN532_UART_DEFAULT_SPEED);
+
+  snprintf(connstring, sizeof(nfc_connstring), "%s:%s:%"PRIu32, PN532_UART_DRIVER_NAME, acPort, PN532_UART_DEFAULT_SPEED);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_uart_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    uart_close(sp);
+    return false;
+  }
+  pnd->driver = &pn532_uart_driver;
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_uart_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    uart_close(sp);
+    nfc_device_free(pnd);
+    return false;
+  }
+  DRIVER_DATA(pnd)->port = sp;
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &pn532_uart_io) == NULL) {
+    perror("malloc");
+    uart_close(DRIVER_DATA(pnd)->port);
+    nfc_device_free(pnd);
+    return false;
+  }
+  // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
+  CHIP_DATA(pnd)->type = PN532;
+  // This device starts in LowVBat power mode
+  CHIP_DATA(pnd)->power_mode = LOWVBAT;
 
 #ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-        uart_close(DRIVER_DATA(pnd)->port);
-        pn53x_data_free(pnd);
-        nfc_device_free(pnd);
-        return 0;
-      }
+  // pipe-based abort mecanism
+  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+    uart_close(DRIVER_DATA(pnd)->port);
+    pn53x_data_free(pnd);
+    nfc_device_free(pnd);
+    return false;
+  }
 #else
-      DRIVER_DATA(pnd)->abort_flag = false;
+  DRIVER_DATA(pnd)->abort_flag = false;
 #endif
 
-      // Check communication using "Diagnose" command, with "Communication test" (0x00)
-      int res = pn53x_check_communication(pnd);
-      uart_close(DRIVER_DATA(pnd)->port);
-      pn53x_data_free(pnd);
-      nfc_device_free(pnd);
-      if (res < 0) {
-        continue;
-      }
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  int res = pn53x_check_communication(pnd);
+  uart_close(DRIVER_DATA(pnd)->port);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+  return (res >= 0);
+}
 
-      memcpy(connstrings[device_found], connstring, sizeof(nfc_connstring));
-      device_found++;
+static size_t
+pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  char **acPorts = uart_list_ports();
+  const char *acPort;
+  int     iDevice = 0;
 
-      // Test if we reach the maximum "wanted" devices
-      if (device_found >= connstrings_len)
-        break;
-    }
-  }
-  iDevice = 0;
+  uart_filter_ports(acPorts, context->uart_scan_filter);
+  const int res = nfc_scan_ports(context, acPorts, pn532_uart_probe, connstrings, connstrings_len);
   while ((acPort = acPorts[iDevice++])) {
     free((void *)acPort);
   }
   free(acPorts);
-  return device_found;
+  return (res < 0) ? 0 : (size_t) res;
 }
 
 struct pn532_uart_descriptor {
-  char *port;
+  const char *port;
   uint32_t speed;
+  bool auto_speed;
 };
 
 static void
@@ -180,21 +201,62 @@ pn532_uart_close(nfc_device *pnd)
   nfc_device_free(pnd);
 }
 
+// Raise the HSU speed to the fastest rate both the PN532 and the host port can run at
+static int
+pn532_uart_negotiate_speed(nfc_device *pnd)
+{
+  const serial_port sp = DRIVER_DATA(pnd)->port;
+  const uint32_t uiCurrentSpeed = uart_get_speed(sp);
+  int res;
+
+  for (size_t n = 0; n < sizeof(pn532_uart_speeds) / sizeof(pn532_uart_speeds[0]); n++) {
+    if (pn532_uart_speeds[n].speed <= uiCurrentSpeed)
+      break;
+    // Don't ask the chip for a speed the host port can't follow
+    if (uart_set_speed(sp, pn532_uart_speeds[n].speed) < 0)
+      continue;
+    uart_set_speed(sp, uiCurrentSpeed);
+
+    const uint8_t abtCmd[] = { SetSerialBaudRate, pn532_uart_speeds[n].code };
+    if (pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1) < 0)
+      continue;
+    // PN532 switches once it gets the host ACK for the SetSerialBaudRate answer
+    if ((res = pn532_uart_ack(pnd)) < 0)
+      return res;
+    msleep(1);
+    uart_set_speed(sp, pn532_uart_speeds[n].speed);
+    if (pn53x_check_communication(pnd) >= 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "HSU speed raised to %" PRIu32 " bauds.", pn532_uart_speeds[n].speed);
+      return NFC_SUCCESS;
+    }
+    // No answer at the new speed: the chip may have missed our ACK, check it still talks at the previous one
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "No answer at %" PRIu32 " bauds, falling back to %" PRIu32 " bauds.", pn532_uart_speeds[n].speed, uiCurrentSpeed);
+    uart_set_speed(sp, uiCurrentSpeed);
+    if ((res = pn53x_check_communication(pnd)) < 0)
+      return res;
+  }
+  return NFC_SUCCESS;
+}
+
 static nfc_device *
 pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
 {
   struct pn532_uart_descriptor ndd;
-  char *speed_s;
-  int connstring_decode_level = connstring_decode(connstring, PN532_UART_DRIVER_NAME, NULL, &ndd.port, &speed_s);
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, PN532_UART_DRIVER_NAME, NULL, &ncf);
+  const char *speed_s = ncf.params[1];
+  ndd.port = ncf.params[0];
+  ndd.auto_speed = false;
   if (connstring_decode_level == 3) {
     ndd.speed = 0;
-    if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
+    if (0 == strcmp(speed_s, "auto")) {
+      // Open at the default speed, switch to the fastest common one once the chip answers
+      ndd.auto_speed = true;
+      ndd.speed = PN532_UART_DEFAULT_SPEED;
+    } else if (sscanf(speed_s, "%10"PRIu32, &ndd.speed) != 1) {
       // speed_s is not a number
-      free(ndd.port);
-      free(speed_s);
       return NULL;
     }
-    free(speed_s);
   }
   if (connstring_decode_level < 2) {
     return NULL;
@@ -213,7 +275,6 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   if (sp == CLAIMED_SERIAL_PORT)
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Serial port already claimed: %s", ndd.port);
   if ((sp == CLAIMED_SERIAL_PORT) || (sp == INVALID_SERIAL_PORT)) {
-    free(ndd.port);
     return NULL;
   }
   // We need to flush input to be sure first reply does not comes from older byte transceive
@@ -221,17 +282,15 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   uart_set_speed(sp, ndd.speed);
 
   // We have a connection
-  pnd = nfc_device_new(context, connstring);
+  pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn532_uart_data)) + PN53X_ARENA_LEN);
   if (!pnd) {
     perror("malloc");
-    free(ndd.port);
     uart_close(sp);
     return NULL;
   }
   snprintf(pnd->name, sizeof(pnd->name), "%s:%s", PN532_UART_DRIVER_NAME, ndd.port);
-  free(ndd.port);
 
-  pnd->driver_data = malloc(sizeof(struct pn532_uart_data));
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn532_uart_data));
   if (!pnd->driver_data) {
     perror("malloc");
     uart_close(sp);
@@ -275,6 +334,12 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
     return NULL;
   }
 
+  if (ndd.auto_speed && (pn532_uart_negotiate_speed(pnd) < 0)) {
+    nfc_perror(pnd, "pn532_uart_negotiate_speed");
+    pn532_uart_close(pnd);
+    return NULL;
+  }
+
   pn53x_init(pnd);
   return pnd;
 }
@@ -284,7 +349,7 @@ pn532_uart_wakeup(nfc_device *pnd)
 {
   /* High Speed Unit (HSU) wake up consist to send 0x55 and wait a "long" delay for PN532 being wakeup. */
   const uint8_t pn532_wakeup_preamble[] = { 0x55, 0x55, 0x00, 0x00, 0x00 };
-  int res = uart_send(DRIVER_DATA(pnd)->port, pn532_wakeup_preamble, sizeof(pn532_wakeup_preamble), 0);
+  int res = uart_send(DRIVER_DATA(pnd)->port, pn532_wakeup_preamble, sizeof(pn532_wakeup_preamble), NFC_DEADLINE_NONE);
   CHIP_DATA(pnd)->power_mode = NORMAL; // PN532 should now be awake
   return res;
 }
@@ -293,6 +358,7 @@ pn532_uart_wakeup(nfc_device *pnd)
 static int
 pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   int res = 0;
   // Before sending anything, we need to discard from any junk bytes
   uart_flush_input(DRIVER_DATA(pnd)->port);
@@ -320,15 +386,20 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
       break;
   };
 
-  uint8_t  abtFrame[PN532_BUFFER_LEN] = { 0x00, 0x00, 0xff };       // Every packet must start with "00 00 ff"
+  SCRATCH_INIT(abtFrame, PN532_BUFFER_LEN, DRIVER_DATA(pnd)->abtFrame);
   size_t szFrame = 0;
 
+  // Every packet must start with "00 00 ff"
+  abtFrame[0] = 0x00;
+  abtFrame[1] = 0x00;
+  abtFrame[2] = 0xff;
+
   if ((res = pn53x_build_frame(abtFrame, &szFrame, pbtData, szData)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
 
-  res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame, timeout);
+  res = uart_send(DRIVER_DATA(pnd)->port, abtFrame, szFrame, deadline);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to transmit data. (TX)");
     pnd->last_error = res;
@@ -336,7 +407,7 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
   }
 
   uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
-  res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, timeout);
+  res = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, sizeof(abtRxBuf), 0, deadline);
   if (res != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Unable to read ACK");
     pnd->last_error = res;
@@ -354,6 +425,7 @@ pn532_uart_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, in
 static int
 pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
   uint8_t  abtRxBuf[5];
   size_t len;
   void *abort_p = NULL;
@@ -364,7 +436,7 @@ pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, in
   abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
 #endif
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, timeout);
+  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 5, abort_p, deadline);
 
   if (abort_p && (NFC_EOPABORTED == pnd->last_error)) {
     pn532_uart_ack(pnd);
@@ -384,13 +456,13 @@ pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, in
 
   if ((0x01 == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
     // Error frame
-    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
+    uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, deadline);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
     pnd->last_error = NFC_EIO;
     goto error;
   } else if ((0xff == abtRxBuf[3]) && (0xff == abtRxBuf[4])) {
     // Extended frame
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, timeout);
+    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 3, 0, deadline);
     if (pnd->last_error != 0) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
       goto error;
@@ -422,7 +494,7 @@ pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, in
   }
 
   // TFI + PD0 (CC+1)
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
+  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, deadline);
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
     goto error;
@@ -441,14 +513,14 @@ pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, in
   }
 
   if (len) {
-    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, timeout);
+    pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, pbtData, len, 0, deadline);
     if (pnd->last_error != 0) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
       goto error;
     }
   }
 
-  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, timeout);
+  pnd->last_error = uart_receive(DRIVER_DATA(pnd)->port, abtRxBuf, 2, 0, deadline);
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
     goto error;
@@ -487,7 +559,7 @@ pn532_uart_ack(nfc_device *pnd)
       return res;
     }
   }
-  return (uart_send(DRIVER_DATA(pnd)->port, pn53x_ack_frame, sizeof(pn53x_ack_frame),  0));
+  return (uart_send(DRIVER_DATA(pnd)->port, pn53x_ack_frame, sizeof(pn53x_ack_frame), NFC_DEADLINE_NONE));
 }
 
 static int
@@ -501,6 +573,7 @@ pn532_uart_abort_command(nfc_device *pnd)
     }
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
+    uart_abort(DRIVER_DATA(pnd)->port);
 #endif
   }
   return NFC_SUCCESS;
@@ -511,6 +584,18 @@ const struct pn53x_io pn532_uart_io = {
   .receive    = pn532_uart_receive,
 };
 
+static int
+pn532_uart_get_fd(nfc_device *pnd)
+{
+  return uart_get_fd(DRIVER_DATA(pnd)->port);
+}
+
+static int
+pn532_uart_get_pending(nfc_device *pnd)
+{
+  return (int) uart_pending(DRIVER_DATA(pnd)->port);
+}
+
 const struct nfc_driver pn532_uart_driver = {
   .name                             = PN532_UART_DRIVER_NAME,
   .scan_type                        = INTRUSIVE,
@@ -522,7 +607,12 @@ const struct nfc_driver pn532_uart_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -539,6 +629,9 @@ const struct nfc_driver pn532_uart_driver = {
 
   .device_set_property_bool     = pn53x_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -546,5 +639,14 @@ const struct nfc_driver pn532_uart_driver = {
   .abort_command  = pn532_uart_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .get_fd         = pn532_uart_get_fd,
+  .get_pending    = pn532_uart_get_pending,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = pn532_initiator_sam_transceive_bytes,
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
 
@@ -70,32 +70,59 @@ typedef enum {
   SONY_RCS360
 } pn53x_usb_model;
 
+#define PN53X_USB_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
+
 // Internal data struct
 struct pn53x_usb_data {
-  usb_dev_handle *pudh;
+  libusb_device_handle *pudh;
   pn53x_usb_model model;
   uint32_t uiEndPointIn;
   uint32_t uiEndPointOut;
   uint32_t uiMaxPacketSize;
+  // Transfer used to wait for replies, cancelled by pn53x_usb_abort_command()
+  struct libusb_transfer *receive_transfer;
   volatile bool abort_flag;
+  // Last reply, the chip layer parses answers in place (see pn53x_usb_receive_view())
+  uint8_t  abtRxBuf[PN53X_USB_BUFFER_LEN];
+#ifdef NFC_LOW_STACK
+  // ACK frame read by pn53x_usb_send() (see SCRATCH_INIT)
+  uint8_t  abtAckBuf[PN53X_USB_BUFFER_LEN];
+#endif /* NFC_LOW_STACK */
 };
 
 // Internal io struct
 const struct pn53x_io pn53x_usb_io;
 
 // Prototypes
-bool pn53x_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len);
+bool pn53x_usb_get_usb_device_name(libusb_device *dev, libusb_device_handle *udev, char *buffer, size_t len);
 int pn53x_usb_init(nfc_device *pnd);
 
 static int
 pn53x_usb_bulk_read(struct pn53x_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
 {
-  int res = usb_bulk_read(data->pudh, data->uiEndPointIn, (char *) abtRx, szRx, timeout);
+  int actual_length;
+  int res = libusb_bulk_transfer(data->pudh, data->uiEndPointIn, abtRx, szRx, &actual_length, timeout);
+  if (res == 0) {
+    LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, actual_length);
+    res = actual_length;
+  } else {
+    if (res != LIBUSB_ERROR_TIMEOUT) {
+      log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", libusb_error_name(res));
+      res = NFC_EIO;
+    } else {
+      res = NFC_ETIMEOUT;
+    }
+  }
+  return res;
+}
+
+// Same as pn53x_usb_bulk_read() but waits on the cancellable receive transfer
+static int
+pn53x_usb_bulk_read_abortable(struct pn53x_usb_data *data, uint8_t abtRx[], const size_t szRx, const int timeout)
+{
+  int res = usb_bulk_read_abortable(data->receive_transfer, data->pudh, data->uiEndPointIn, abtRx, szRx, timeout, &data->abort_flag);
   if (res > 0) {
     LOG_HEX(NFC_LOG_GROUP_COM, "RX", abtRx, res);
-  } else if (res < 0) {
-    if (res != -USB_TIMEDOUT)
-      log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read from USB (%s)", _usb_strerror(res));
   }
   return res;
 }
@@ -104,14 +131,21 @@ static int
 pn53x_usb_bulk_write(struct pn53x_usb_data *data, uint8_t abtTx[], const size_t szTx, const int timeout)
 {
   LOG_HEX(NFC_LOG_GROUP_COM, "TX", abtTx, szTx);
-  int res = usb_bulk_write(data->pudh, data->uiEndPointOut, (char *) abtTx, szTx, timeout);
-  if (res > 0) {
+  int actual_length;
+  int res = libusb_bulk_transfer(data->pudh, data->uiEndPointOut, abtTx, szTx, &actual_length, timeout);
+  if (res == 0) {
+    res = actual_length;
     // HACK This little hack is a well know problem of USB, see http://www.libusb.org/ticket/6 for more details
     if ((res % data->uiMaxPacketSize) == 0) {
-      usb_bulk_write(data->pudh, data->uiEndPointOut, "\0", 0, timeout);
+      libusb_bulk_transfer(data->pudh, data->uiEndPointOut, (unsigned char *) "\0", 0, &actual_length, timeout);
     }
   } else {
-    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", _usb_strerror(res));
+    log_put(NFC_LOG_GROUP_COM, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to USB (%s)", libusb_error_name(res));
+    if (res == LIBUSB_ERROR_TIMEOUT) {
+      res = NFC_ETIMEOUT;
+    } else {
+      res = NFC_EIO;
+    }
   }
   return res;
 }
@@ -144,36 +178,62 @@ pn53x_usb_get_device_model(uint16_t vendor_id, uint16_t product_id)
   return UNKNOWN;
 }
 
+bool
+pn53x_usb_is_supported_device(uint16_t vendor_id, uint16_t product_id)
+{
+  return pn53x_usb_get_device_model(vendor_id, product_id) != UNKNOWN;
+}
+
 int  pn53x_usb_ack(nfc_device *pnd);
 
 // Find transfer endpoints for bulk transfers
 static void
-pn53x_usb_get_end_points(struct usb_device *dev, struct pn53x_usb_data *data)
+pn53x_usb_get_end_points(libusb_device *dev, struct pn53x_usb_data *data)
 {
   uint32_t uiIndex;
   uint32_t uiEndPoint;
-  struct usb_interface_descriptor *puid = dev->config->interface->altsetting;
+  struct libusb_config_descriptor *config;
+
+  if (libusb_get_config_descriptor(dev, 0, &config) < 0)
+    return;
+  const struct libusb_interface_descriptor *puid = config->interface->altsetting;
 
   // 3 Endpoints maximum: Interrupt In, Bulk In, Bulk Out
   for (uiIndex = 0; uiIndex < puid->bNumEndpoints; uiIndex++) {
     // Only accept bulk transfer endpoints (ignore interrupt endpoints)
-    if (puid->endpoint[uiIndex].bmAttributes != USB_ENDPOINT_TYPE_BULK)
+    if ((puid->endpoint[uiIndex].bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) != LIBUSB_TRANSFER_TYPE_BULK)
       continue;
 
     // Copy the endpoint to a local var, makes it more readable code
     uiEndPoint = puid->endpoint[uiIndex].bEndpointAddress;
 
     // Test if we dealing with a bulk IN endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_IN) {
+    if ((uiEndPoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN) {
       data->uiEndPointIn = uiEndPoint;
       data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
     }
     // Test if we dealing with a bulk OUT endpoint
-    if ((uiEndPoint & USB_ENDPOINT_DIR_MASK) == USB_ENDPOINT_OUT) {
+    if ((uiEndPoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_OUT) {
       data->uiEndPointOut = uiEndPoint;
       data->uiMaxPacketSize = puid->endpoint[uiIndex].wMaxPacketSize;
     }
   }
+  libusb_free_config_descriptor(config);
+}
+
+// Check there is a configuration with at least 2 endpoints (bulk in & bulk out) on its first interface
+static bool
+pn53x_usb_has_end_points(libusb_device *dev)
+{
+  struct libusb_config_descriptor *config;
+  bool res = false;
+
+  if (libusb_get_config_descriptor(dev, 0, &config) < 0)
+    return false;
+  if ((config->bNumInterfaces > 0) && (config->interface->num_altsetting > 0))
+    res = (config->interface->altsetting->bNumEndpoints >= 2);
+  libusb_free_config_descriptor(config);
+  return res;
 }
 
 static size_t
@@ -181,82 +241,92 @@ pn53x_usb_scan(const nfc_context *context, nfc_connstring connstrings[], const s
 {
   (void)context;
 
-  usb_prepare();
+  if (usb_prepare() < 0)
+    return 0;
 
   size_t device_found = 0;
-  uint32_t uiBusIndex = 0;
-  struct usb_bus *bus;
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
-    struct usb_device *dev;
-
-    for (dev = bus->devices; dev; dev = dev->next, uiBusIndex++) {
-      for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
-        if ((pn53x_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-            (pn53x_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
-          // Make sure there are 2 endpoints available
-          // with libusb-win32 we got some null pointers so be robust before looking at endpoints:
-          if (dev->config == NULL || dev->config->interface == NULL || dev->config->interface->altsetting == NULL) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
-          if (dev->config->interface->altsetting->bNumEndpoints < 2) {
-            // Nope, we maybe want the next one, let's try to find another
-            continue;
-          }
+  libusb_device **devices;
+  ssize_t szDevices = usb_get_device_list(&devices);
+  if (szDevices < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to list USB devices (%s)", libusb_error_name(szDevices));
+    return 0;
+  }
+
+  for (ssize_t i = 0; (i < szDevices) && (device_found < connstrings_len); i++) {
+    libusb_device *dev = devices[i];
+    struct libusb_device_descriptor descriptor;
+    if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+      continue;
 
-          usb_dev_handle *udev = usb_open(dev);
-          if (udev == NULL)
+    for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
+      if ((pn53x_usb_supported_devices[n].vendor_id == descriptor.idVendor) &&
+          (pn53x_usb_supported_devices[n].product_id == descriptor.idProduct)) {
+        // Make sure there are 2 endpoints available
+        if (!pn53x_usb_has_end_points(dev)) {
+          // Nope, we maybe want the next one, let's try to find another
+          continue;
+        }
+
+        // A device already probed successfully is not reopened on each scan
+        if (!usb_device_is_probed(dev)) {
+          libusb_device_handle *udev;
+          if (libusb_open(dev, &udev) < 0)
             continue;
 
           // Set configuration
-          int res = usb_set_configuration(udev, 1);
+          int res = libusb_set_configuration(udev, 1);
           if (res < 0) {
-            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
-            usb_close(udev);
+            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", libusb_error_name(res));
+            libusb_close(udev);
             // we failed to use the device
             continue;
           }
-
-          // pn53x_usb_get_usb_device_name (dev, udev, pnddDevices[device_found].acDevice, sizeof (pnddDevices[device_found].acDevice));
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %s Device %s", bus->dirname, dev->filename);
-          usb_close(udev);
-          snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%s:%s", PN53X_USB_DRIVER_NAME, bus->dirname, dev->filename);
-          device_found++;
-          // Test if we reach the maximum "wanted" devices
-          if (device_found == connstrings_len) {
-            return device_found;
-          }
+          libusb_close(udev);
+          usb_device_set_probed(dev);
         }
+
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device found: Bus %03d Device %03d", libusb_get_bus_number(dev), libusb_get_device_address(dev));
+        snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%03d:%03d", PN53X_USB_DRIVER_NAME, libusb_get_bus_number(dev), libusb_get_device_address(dev));
+        device_found++;
+        break;
       }
     }
   }
+  libusb_free_device_list(devices, 1);
 
   return device_found;
 }
 
 struct pn53x_usb_descriptor {
-  char *dirname;
-  char *filename;
+  const char *dirname;
+  const char *filename;
 };
 
 bool
-pn53x_usb_get_usb_device_name(struct usb_device *dev, usb_dev_handle *udev, char *buffer, size_t len)
+pn53x_usb_get_usb_device_name(libusb_device *dev, libusb_device_handle *udev, char *buffer, size_t len)
 {
+  struct libusb_device_descriptor descriptor;
   *buffer = '\0';
 
-  if (dev->descriptor.iManufacturer || dev->descriptor.iProduct) {
+  if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+    return false;
+
+  if (descriptor.iManufacturer || descriptor.iProduct) {
     if (udev) {
-      usb_get_string_simple(udev, dev->descriptor.iManufacturer, buffer, len);
+      if (libusb_get_string_descriptor_ascii(udev, descriptor.iManufacturer, (unsigned char *) buffer, len) < 0)
+        *buffer = '\0';
       if (strlen(buffer) > 0)
         strcpy(buffer + strlen(buffer), " / ");
-      usb_get_string_simple(udev, dev->descriptor.iProduct, buffer + strlen(buffer), len - strlen(buffer));
+      size_t szPrefix = strlen(buffer);
+      if (libusb_get_string_descriptor_ascii(udev, descriptor.iProduct, (unsigned char *) buffer + szPrefix, len - szPrefix) < 0)
+        buffer[szPrefix] = '\0';
     }
   }
 
   if (!*buffer) {
     for (size_t n = 0; n < sizeof(pn53x_usb_supported_devices) / sizeof(struct pn53x_usb_supported_device); n++) {
-      if ((pn53x_usb_supported_devices[n].vendor_id == dev->descriptor.idVendor) &&
-          (pn53x_usb_supported_devices[n].product_id == dev->descriptor.idProduct)) {
+      if ((pn53x_usb_supported_devices[n].vendor_id == descriptor.idVendor) &&
+          (pn53x_usb_supported_devices[n].product_id == descriptor.idProduct)) {
         strncpy(buffer, pn53x_usb_supported_devices[n].name, len);
         buffer[len - 1] = '\0';
         return true;
@@ -271,8 +341,10 @@ static nfc_device *
 pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
-  struct pn53x_usb_descriptor desc = { NULL, NULL };
-  int connstring_decode_level = connstring_decode(connstring, PN53X_USB_DRIVER_NAME, "usb", &desc.dirname, &desc.filename);
+  libusb_device **devices = NULL;
+  struct nfc_connstring_fields ncf;
+  int connstring_decode_level = connstring_parse(connstring, PN53X_USB_DRIVER_NAME, "usb", &ncf);
+  struct pn53x_usb_descriptor desc = { ncf.params[0], ncf.params[1] };
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d element(s) have been decoded from \"%s\"", connstring_decode_level, connstring);
   if (connstring_decode_level < 1) {
     goto free_mem;
@@ -282,115 +354,136 @@ pn53x_usb_open(const nfc_context *context, const nfc_connstring connstring)
     .pudh = NULL,
     .uiEndPointIn = 0,
     .uiEndPointOut = 0,
+    .receive_transfer = NULL,
+    .abort_flag = false,
   };
-  struct usb_bus *bus;
-  struct usb_device *dev;
+  ssize_t szDevices;
 
-  usb_prepare();
+  if (usb_prepare() < 0)
+    goto free_mem;
+
+  if ((szDevices = usb_get_device_list(&devices)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to list USB devices (%s)", libusb_error_name(szDevices));
+    devices = NULL;
+    goto free_mem;
+  }
 
-  for (bus = usb_get_busses(); bus; bus = bus->next) {
+  for (ssize_t i = 0; i < szDevices; i++) {
+    libusb_device *dev = devices[i];
+    char acBus[4], acDev[4];
+    snprintf(acBus, sizeof(acBus), "%03d", libusb_get_bus_number(dev));
+    snprintf(acDev, sizeof(acDev), "%03d", libusb_get_device_address(dev));
     if (connstring_decode_level > 1)  {
       // A specific bus have been specified
-      if (0 != strcmp(bus->dirname, desc.dirname))
+      if (0 != strcmp(acBus, desc.dirname))
         continue;
     }
-    for (dev = bus->devices; dev; dev = dev->next) {
-      if (connstring_decode_level > 2)  {
-        // A specific dev have been specified
-        if (0 != strcmp(dev->filename, desc.filename))
-          continue;
-      }
-      // Open the USB device
-      if ((data.pudh = usb_open(dev)) == NULL)
+    if (connstring_decode_level > 2)  {
+      // A specific dev have been specified
+      if (0 != strcmp(acDev, desc.filename))
         continue;
-      // Retrieve end points
-      pn53x_usb_get_end_points(dev, &data);
-      // Set configuration
-      int res = usb_set_configuration(data.pudh, 1);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", _usb_strerror(res));
-        if (EPERM == -res) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: Please double check USB permissions for device %04x:%04x", dev->descriptor.idVendor, dev->descriptor.idProduct);
-        }
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
+    }
+    struct libusb_device_descriptor descriptor;
+    if (libusb_get_device_descriptor(dev, &descriptor) < 0)
+      continue;
+    // Open the USB device
+    if (libusb_open(dev, &data.pudh) < 0)
+      continue;
+    // Retrieve end points
+    pn53x_usb_get_end_points(dev, &data);
+    // Set configuration
+    int res = libusb_set_configuration(data.pudh, 1);
+    if (res < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set USB configuration (%s)", libusb_error_name(res));
+      if (LIBUSB_ERROR_ACCESS == res) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: Please double check USB permissions for device %04x:%04x", descriptor.idVendor, descriptor.idProduct);
       }
+      libusb_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
 
-      res = usb_claim_interface(data.pudh, 0);
-      if (res < 0) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", _usb_strerror(res));
-        usb_close(data.pudh);
-        // we failed to use the specified device
-        goto free_mem;
-      }
-      data.model = pn53x_usb_get_device_model(dev->descriptor.idVendor, dev->descriptor.idProduct);
-      // Allocate memory for the device info and specification, fill it and return the info
-      pnd = nfc_device_new(context, connstring);
-      if (!pnd) {
-        perror("malloc");
-        goto error;
-      }
-      pn53x_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
+    res = libusb_claim_interface(data.pudh, 0);
+    if (res < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to claim USB interface (%s)", libusb_error_name(res));
+      libusb_close(data.pudh);
+      // we failed to use the specified device
+      goto free_mem;
+    }
+    if ((data.receive_transfer = libusb_alloc_transfer(0)) == NULL) {
+      perror("malloc");
+      libusb_release_interface(data.pudh, 0);
+      libusb_close(data.pudh);
+      goto free_mem;
+    }
+    data.model = pn53x_usb_get_device_model(descriptor.idVendor, descriptor.idProduct);
+    // Allocate memory for the device info and specification, fill it and return the info
+    pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct pn53x_usb_data)) + PN53X_ARENA_LEN);
+    if (!pnd) {
+      perror("malloc");
+      goto error;
+    }
+    pn53x_usb_get_usb_device_name(dev, data.pudh, pnd->name, sizeof(pnd->name));
 
-      pnd->driver_data = malloc(sizeof(struct pn53x_usb_data));
-      if (!pnd->driver_data) {
-        perror("malloc");
-        goto error;
-      }
-      *DRIVER_DATA(pnd) = data;
+    pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct pn53x_usb_data));
+    if (!pnd->driver_data) {
+      perror("malloc");
+      goto error;
+    }
+    *DRIVER_DATA(pnd) = data;
 
-      // Alloc and init chip's data
-      if (pn53x_data_new(pnd, &pn53x_usb_io) == NULL) {
-        perror("malloc");
-        goto error;
-      }
+    // Alloc and init chip's data
+    if (pn53x_data_new(pnd, &pn53x_usb_io) == NULL) {
+      perror("malloc");
+      goto error;
+    }
 
-      switch (DRIVER_DATA(pnd)->model) {
-          // empirical tuning
-        case ASK_LOGO:
-          CHIP_DATA(pnd)->timer_correction = 50;
-          break;
-        case SCM_SCL3711:
-        case NXP_PN533:
-          CHIP_DATA(pnd)->timer_correction = 46;
-          break;
-        case NXP_PN531:
-          CHIP_DATA(pnd)->timer_correction = 50;
-          break;
-        case SONY_PN531:
-          CHIP_DATA(pnd)->timer_correction = 54;
-          break;
-        case SONY_RCS360:
-        case UNKNOWN:
-          CHIP_DATA(pnd)->timer_correction = 0;   // TODO: allow user to know if timed functions are available
-          break;
-      }
-      pnd->driver = &pn53x_usb_driver;
+    switch (DRIVER_DATA(pnd)->model) {
+        // empirical tuning
+      case ASK_LOGO:
+        CHIP_DATA(pnd)->timer_correction = 50;
+        break;
+      case SCM_SCL3711:
+      case NXP_PN533:
+        CHIP_DATA(pnd)->timer_correction = 46;
+        break;
+      case NXP_PN531:
+        CHIP_DATA(pnd)->timer_correction = 50;
+        break;
+      case SONY_PN531:
+        CHIP_DATA(pnd)->timer_correction = 54;
+        break;
+      case SONY_RCS360:
+      case UNKNOWN:
+        CHIP_DATA(pnd)->timer_correction = 0;   // TODO: allow user to know if timed functions are available
+        break;
+    }
+    pnd->driver = &pn53x_usb_driver;
 
-      // HACK1: Send first an ACK as Abort command, to reset chip before talking to it:
-      pn53x_usb_ack(pnd);
+    // HACK1: Send first an ACK as Abort command, to reset chip before talking to it:
+    pn53x_usb_ack(pnd);
 
-      // HACK2: Then send a GetFirmware command to resync USB toggle bit between host & device
-      // in case host used set_configuration and expects the device to have reset its toggle bit, which PN53x doesn't do
-      if (pn53x_usb_init(pnd) < 0) {
-        usb_close(data.pudh);
-        goto error;
-      }
-      DRIVER_DATA(pnd)->abort_flag = false;
-      goto free_mem;
+    // HACK2: Then send a GetFirmware command to resync USB toggle bit between host & device
+    // in case host used set_configuration and expects the device to have reset its toggle bit, which PN53x doesn't do
+    if (pn53x_usb_init(pnd) < 0) {
+      goto error;
     }
+    DRIVER_DATA(pnd)->abort_flag = false;
+    goto free_mem;
   }
   // We ran out of devices before the index required
   goto free_mem;
 
 error:
   // Free allocated structure on error.
+  libusb_free_transfer(data.receive_transfer);
+  libusb_release_interface(data.pudh, 0);
+  libusb_close(data.pudh);
   nfc_device_free(pnd);
   pnd = NULL;
 free_mem:
-  free(desc.dirname);
-  free(desc.filename);
+  if (devices)
+    libusb_free_device_list(devices, 1);
   return pnd;
 }
 
@@ -408,35 +501,36 @@ pn53x_usb_close(nfc_device *pnd)
   pn53x_idle(pnd);
 
   int res;
-  if ((res = usb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", _usb_strerror(res));
+  if ((res = libusb_release_interface(DRIVER_DATA(pnd)->pudh, 0)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to release USB interface (%s)", libusb_error_name(res));
   }
 
-  if ((res = usb_close(DRIVER_DATA(pnd)->pudh)) < 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to close USB connection (%s)", _usb_strerror(res));
-  }
+  libusb_free_transfer(DRIVER_DATA(pnd)->receive_transfer);
+  libusb_close(DRIVER_DATA(pnd)->pudh);
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
 }
 
-#define PN53X_USB_BUFFER_LEN (PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD)
-
 static int
 pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, const int timeout)
 {
-  uint8_t  abtFrame[PN53X_USB_BUFFER_LEN] = { 0x00, 0x00, 0xff };  // Every packet must start with "00 00 ff"
+  uint8_t *pbtFrame;
   size_t szFrame = 0;
   int res = 0;
 
-  pn53x_build_frame(abtFrame, &szFrame, pbtData, szData);
+  // The chip layer left room around pbtData (see pn53x_io.send_in_place)
+  if ((res = pn53x_build_frame_in_place((uint8_t *) pbtData, szData, &pbtFrame, &szFrame)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
 
-  if ((res = pn53x_usb_bulk_write(DRIVER_DATA(pnd), abtFrame, szFrame, timeout)) < 0) {
+  if ((res = pn53x_usb_bulk_write(DRIVER_DATA(pnd), pbtFrame, szFrame, timeout)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
 
-  uint8_t abtRxBuf[PN53X_USB_BUFFER_LEN];
-  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), timeout)) < 0) {
+  SCRATCH_INIT(abtRxBuf, PN53X_USB_BUFFER_LEN, DRIVER_DATA(pnd)->abtAckBuf);
+  if ((res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, PN53X_USB_BUFFER_LEN, timeout)) < 0) {
     // try to interrupt current device state
     pn53x_usb_ack(pnd);
     pnd->last_error = res;
@@ -453,6 +547,7 @@ pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, con
     // pn53x_usb_receive()) will be able to retreive the correct response
     // packet.
     // FIXME Sony reader is also affected by this bug but NACK is not supported
+    pnd->stats.retries++;
     if ((res = pn53x_usb_bulk_write(DRIVER_DATA(pnd), (uint8_t *)pn53x_nack_frame, sizeof(pn53x_nack_frame), timeout)) < 0) {
       pnd->last_error = res;
       // try to interrupt current device state
@@ -464,47 +559,29 @@ pn53x_usb_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, con
   return NFC_SUCCESS;
 }
 
-#define USB_TIMEOUT_PER_PASS 200
+// Read a frame of up to PN53X_USB_BUFFER_LEN bytes in pbtFrame, *ppbtData is set to its payload
 static int
-pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+pn53x_usb_receive_frame(nfc_device *pnd, uint8_t *pbtFrame, const uint8_t **ppbtData, const int timeout)
 {
   size_t len;
   off_t offset = 0;
-
-  uint8_t  abtRxBuf[PN53X_USB_BUFFER_LEN];
   int res;
 
   /*
-   * If no timeout is specified but the command is blocking, force a 200ms (USB_TIMEOUT_PER_PASS)
-   * timeout to allow breaking the loop if the user wants to stop it.
+   * The whole timeout (possibly infinite) is handed to libusb: the thread sleeps
+   * until the reply arrives, and nfc_abort_command() cancels the transfer.
    */
-  int usb_timeout;
-  int remaining_time = timeout;
-read:
-  if (timeout == USB_INFINITE_TIMEOUT) {
-    usb_timeout = USB_TIMEOUT_PER_PASS;
-  } else {
-    // A user-provided timeout is set, we have to cut it in multiple chunk to be able to keep an nfc_abort_command() mecanism
-    remaining_time -= USB_TIMEOUT_PER_PASS;
-    if (remaining_time <= 0) {
-      pnd->last_error = NFC_ETIMEOUT;
-      return pnd->last_error;
-    } else {
-      usb_timeout = MIN(remaining_time, USB_TIMEOUT_PER_PASS);
-    }
-  }
+  res = pn53x_usb_bulk_read_abortable(DRIVER_DATA(pnd), pbtFrame, PN53X_USB_BUFFER_LEN, timeout);
 
-  res = pn53x_usb_bulk_read(DRIVER_DATA(pnd), abtRxBuf, sizeof(abtRxBuf), usb_timeout);
+  if (res == NFC_ETIMEOUT) {
+    pnd->last_error = res;
+    return pnd->last_error;
+  }
 
-  if (res == -USB_TIMEDOUT) {
-    if (DRIVER_DATA(pnd)->abort_flag) {
-      DRIVER_DATA(pnd)->abort_flag = false;
-      pn53x_usb_ack(pnd);
-      pnd->last_error = NFC_EOPABORTED;
-      return pnd->last_error;
-    } else {
-      goto read;
-    }
+  if (res == NFC_EOPABORTED) {
+    pn53x_usb_ack(pnd);
+    pnd->last_error = res;
+    return pnd->last_error;
   }
 
   if (res < 0) {
@@ -515,25 +592,25 @@ read:
   }
 
   const uint8_t pn53x_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 3))) {
+  if (0 != (memcmp(pbtFrame, pn53x_preamble, 3))) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame preamble+start code mismatch");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
   offset += 3;
 
-  if ((0x01 == abtRxBuf[offset]) && (0xff == abtRxBuf[offset + 1])) {
+  if ((0x01 == pbtFrame[offset]) && (0xff == pbtFrame[offset + 1])) {
     // Error frame
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
-  } else if ((0xff == abtRxBuf[offset]) && (0xff == abtRxBuf[offset + 1])) {
+  } else if ((0xff == pbtFrame[offset]) && (0xff == pbtFrame[offset + 1])) {
     // Extended frame
     offset += 2;
 
-    // (abtRxBuf[offset] << 8) + abtRxBuf[offset + 1] (LEN) include TFI + (CC+1)
-    len = (abtRxBuf[offset] << 8) + abtRxBuf[offset + 1] - 2;
-    if (((abtRxBuf[offset] + abtRxBuf[offset + 1] + abtRxBuf[offset + 2]) % 256) != 0) {
+    // (pbtFrame[offset] << 8) + pbtFrame[offset + 1] (LEN) include TFI + (CC+1)
+    len = (pbtFrame[offset] << 8) + pbtFrame[offset + 1] - 2;
+    if (((pbtFrame[offset] + pbtFrame[offset + 1] + pbtFrame[offset + 2]) % 256) != 0) {
       // TODO: Retry
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
       pnd->last_error = NFC_EIO;
@@ -542,56 +619,50 @@ read:
     offset += 3;
   } else {
     // Normal frame
-    if (256 != (abtRxBuf[offset] + abtRxBuf[offset + 1])) {
+    if (256 != (pbtFrame[offset] + pbtFrame[offset + 1])) {
       // TODO: Retry
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
       pnd->last_error = NFC_EIO;
       return pnd->last_error;
     }
 
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[offset] - 2;
+    // pbtFrame[3] (LEN) include TFI + (CC+1)
+    len = pbtFrame[offset] - 2;
     offset += 2;
   }
 
-  if (len > szDataLen) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
-    pnd->last_error = NFC_EIO;
-    return pnd->last_error;
-  }
-
   // TFI + PD0 (CC+1)
-  if (abtRxBuf[offset] != 0xD5) {
+  if (pbtFrame[offset] != 0xD5) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
   offset += 1;
 
-  if (abtRxBuf[offset] != CHIP_DATA(pnd)->last_command + 1) {
+  if (pbtFrame[offset] != CHIP_DATA(pnd)->last_command + 1) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
   offset += 1;
 
-  memcpy(pbtData, abtRxBuf + offset, len);
-  offset += len;
+  *ppbtData = pbtFrame + offset;
 
   uint8_t btDCS = (256 - 0xD5);
   btDCS -= CHIP_DATA(pnd)->last_command + 1;
   for (size_t szPos = 0; szPos < len; szPos++) {
-    btDCS -= pbtData[szPos];
+    btDCS -= pbtFrame[offset + szPos];
   }
+  offset += len;
 
-  if (btDCS != abtRxBuf[offset]) {
+  if (btDCS != pbtFrame[offset]) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
   }
   offset += 1;
 
-  if (0x00 != abtRxBuf[offset]) {
+  if (0x00 != pbtFrame[offset]) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
     pnd->last_error = NFC_EIO;
     return pnd->last_error;
@@ -601,6 +672,35 @@ read:
   return len;
 }
 
+static int
+pn53x_usb_receive_view(nfc_device *pnd, const uint8_t **ppbtData, const int timeout)
+{
+  return pn53x_usb_receive_frame(pnd, DRIVER_DATA(pnd)->abtRxBuf, ppbtData, timeout);
+}
+
+static int
+pn53x_usb_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, const int timeout)
+{
+  // When the caller buffer can hold a whole frame, read it there and strip the
+  // framing in place rather than bouncing through the driver buffer
+  uint8_t *pbtFrame = (szDataLen >= PN53X_USB_BUFFER_LEN) ? pbtData : DRIVER_DATA(pnd)->abtRxBuf;
+  const uint8_t *pbtView;
+  int res;
+
+  if ((res = pn53x_usb_receive_frame(pnd, pbtFrame, &pbtView, timeout)) < 0)
+    return res;
+
+  const size_t len = (size_t) res;
+  if (len > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  memmove(pbtData, pbtView, len);
+
+  return len;
+}
+
 int
 pn53x_usb_ack(nfc_device *pnd)
 {
@@ -702,13 +802,15 @@ pn53x_usb_set_property_bool(nfc_device *pnd, const nfc_property property, const
 static int
 pn53x_usb_abort_command(nfc_device *pnd)
 {
-  DRIVER_DATA(pnd)->abort_flag = true;
+  usb_abort_transfer(DRIVER_DATA(pnd)->receive_transfer, &DRIVER_DATA(pnd)->abort_flag);
   return NFC_SUCCESS;
 }
 
 const struct pn53x_io pn53x_usb_io = {
-  .send       = pn53x_usb_send,
-  .receive    = pn53x_usb_receive,
+  .send          = pn53x_usb_send,
+  .receive       = pn53x_usb_receive,
+  .receive_view  = pn53x_usb_receive_view,
+  .send_in_place = true,
 };
 
 const struct nfc_driver pn53x_usb_driver = {
@@ -722,7 +824,12 @@ const struct nfc_driver pn53x_usb_driver = {
   .initiator_init                   = pn53x_initiator_init,
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
@@ -739,6 +846,9 @@ const struct nfc_driver pn53x_usb_driver = {
 
   .device_set_property_bool     = pn53x_usb_set_property_bool,
   .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
   .get_supported_modulation     = pn53x_get_supported_modulation,
   .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
   .device_get_information_about = pn53x_get_information_about,
@@ -746,4 +856,11 @@ const struct nfc_driver pn53x_usb_driver = {
   .abort_command  = pn53x_usb_abort_command,
   .idle           = pn53x_idle,
   .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
 };
@@ -36,4 +36,6 @@
 
 extern const struct nfc_driver pn53x_usb_driver;
 
+bool pn53x_usb_is_supported_device(uint16_t vendor_id, uint16_t product_id);
+
 #endif // ! __NFC_DRIVER_PN53X_USB_H__
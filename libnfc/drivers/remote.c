@@ -0,0 +1,589 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file remote.c
+ * @brief Driver reaching a PN53x device through a TCP link, see pn53x-remote-agent
+ *
+ * Connection string: remote:host[:port], port being REMOTE_DEFAULT_PORT by
+ * default.
+ *
+ * The agent runs next to the reader and relays TAMA frames to it (see
+ * remote.h for the protocol): everything above the frames, chip handling
+ * included, stays on this side. A single frame costs one round trip, ACK
+ * included. Batches of exchanges (see nfc_initiator_transceive_bytes_batch())
+ * go in a single packet through pn53x_io.transceive_batch, so an
+ * authentication followed by the reads of a sector pays the link latency
+ * once. A frame whose answer was not received in time is not lost: its late
+ * answer is skipped when it eventually comes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "remote.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define REMOTE_DRIVER_NAME "remote"
+
+#define LOG_CATEGORY "libnfc.driver.remote"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+// Time given to the agent to introduce itself
+#define REMOTE_HELLO_TIMEOUT 3000
+
+// Internal data structs
+const struct pn53x_io remote_io;
+struct remote_data {
+  int fd;
+  // Answer of the last frame given to remote_send() still to be read
+  bool awaiting;
+  // Answers to skip: they come for frames which already timed out
+  unsigned int stale;
+  uint8_t abtPacket[REMOTE_HEADER_LEN + REMOTE_PAYLOAD_MAX_LEN];
+};
+
+#define DRIVER_DATA(pnd) ((struct remote_data*)(pnd->driver_data))
+
+static size_t
+remote_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  // Agents are only reached by connection string, there is nothing to look for
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  return 0;
+}
+
+// Wait until the link can be read (or written), NFC_ETIMEOUT once the deadline is passed
+static int
+remote_wait(const int fd, const short events, const nfc_deadline deadline)
+{
+  struct pollfd pfd = { .fd = fd, .events = events, .revents = 0 };
+  int timeout;
+  int res;
+  do {
+    if ((timeout = nfc_deadline_timeout(deadline)) < 0)
+      return timeout;
+    res = poll(&pfd, 1, (timeout == 0) ? -1 : timeout);
+  } while ((res < 0) && (errno == EINTR));
+  if (res < 0)
+    return NFC_EIO;
+  return (res == 0) ? NFC_ETIMEOUT : NFC_SUCCESS;
+}
+
+// Link failures leave the stream out of step, it is closed for good
+static int
+remote_broken(nfc_device *pnd, const char *reason)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  if (prd->fd >= 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Link to %s lost: %s", pnd->connstring, reason);
+    close(prd->fd);
+    prd->fd = -1;
+  }
+  pnd->last_error = NFC_EIO;
+  return pnd->last_error;
+}
+
+static int
+remote_write(nfc_device *pnd, const uint8_t *pbtData, size_t szData, const nfc_deadline deadline)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  int res;
+  if (prd->fd < 0)
+    return NFC_EIO;
+  while (szData > 0) {
+    if ((res = remote_wait(prd->fd, POLLOUT, deadline)) < 0)
+      return (res == NFC_ETIMEOUT) ? remote_broken(pnd, "write timeout") : remote_broken(pnd, strerror(errno));
+    const ssize_t n = send(prd->fd, pbtData, szData, MSG_NOSIGNAL);
+    if (n < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+      return remote_broken(pnd, strerror(errno));
+    }
+    pbtData += n;
+    szData -= n;
+  }
+  return NFC_SUCCESS;
+}
+
+// Read exactly szData bytes; a timeout is only harmless before the first one
+static int
+remote_read(nfc_device *pnd, uint8_t *pbtData, size_t szData, const nfc_deadline deadline, const bool bStarted)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  bool started = bStarted;
+  int res;
+  if (prd->fd < 0)
+    return NFC_EIO;
+  while (szData > 0) {
+    if ((res = remote_wait(prd->fd, POLLIN, deadline)) < 0) {
+      if ((res == NFC_ETIMEOUT) && (!started))
+        return res;
+      return remote_broken(pnd, (res == NFC_ETIMEOUT) ? "read timeout" : strerror(errno));
+    }
+    const ssize_t n = recv(prd->fd, pbtData, szData, 0);
+    if (n == 0)
+      return remote_broken(pnd, "closed by the agent");
+    if (n < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+      return remote_broken(pnd, strerror(errno));
+    }
+    started = true;
+    pbtData += n;
+    szData -= n;
+  }
+  return NFC_SUCCESS;
+}
+
+// Send a packet whose payload is already in place, after the header room of abtPacket
+static int
+remote_write_packet(nfc_device *pnd, const uint8_t ui8Type, const uint8_t ui8Flags, const size_t szPayload, const nfc_deadline deadline)
+{
+  uint8_t *pbtPacket = DRIVER_DATA(pnd)->abtPacket;
+  pbtPacket[0] = ui8Type;
+  pbtPacket[1] = ui8Flags;
+  pbtPacket[2] = szPayload >> 8;
+  pbtPacket[3] = szPayload & 0xff;
+  return remote_write(pnd, pbtPacket, REMOTE_HEADER_LEN + szPayload, deadline);
+}
+
+// Read the next packet in abtPacket, returns its payload length
+static int
+remote_read_packet(nfc_device *pnd, const uint8_t ui8Type, const nfc_deadline deadline)
+{
+  uint8_t *pbtPacket = DRIVER_DATA(pnd)->abtPacket;
+  int res;
+  if ((res = remote_read(pnd, pbtPacket, REMOTE_HEADER_LEN, deadline, false)) < 0)
+    return res;
+  const size_t szPayload = (pbtPacket[2] << 8) | pbtPacket[3];
+  if ((res = remote_read(pnd, pbtPacket + REMOTE_HEADER_LEN, szPayload, deadline, true)) < 0)
+    return res;
+  if (pbtPacket[0] != ui8Type)
+    return remote_broken(pnd, "unexpected packet");
+  return (int) szPayload;
+}
+
+// Read the answer of the next exchange packet, skipping late answers first
+static int
+remote_read_exchange(nfc_device *pnd, const nfc_deadline deadline)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  int res;
+  while (prd->stale > 0) {
+    if ((res = remote_read_packet(pnd, REMOTE_PACKET_EXCHANGE, deadline)) < 0)
+      return res;
+    prd->stale--;
+  }
+  return remote_read_packet(pnd, REMOTE_PACKET_EXCHANGE, deadline);
+}
+
+// Append a frame to the exchange payload being built at offset *pszPayload
+static void
+remote_append_frame(nfc_device *pnd, size_t *pszPayload, const uint8_t *pbtData, const size_t szData)
+{
+  uint8_t *pbtPayload = DRIVER_DATA(pnd)->abtPacket + REMOTE_HEADER_LEN;
+  pbtPayload[*pszPayload] = szData >> 8;
+  pbtPayload[*pszPayload + 1] = szData & 0xff;
+  memcpy(pbtPayload + *pszPayload + 2, pbtData, szData);
+  *pszPayload += 2 + szData;
+}
+
+// Start the payload of an exchange packet with the time the agent has for it
+static size_t
+remote_exchange_header(nfc_device *pnd, const int timeout)
+{
+  uint8_t *pbtPayload = DRIVER_DATA(pnd)->abtPacket + REMOTE_HEADER_LEN;
+  const uint32_t ui32Timeout = (timeout > 0) ? (uint32_t) timeout : 0;
+  pbtPayload[0] = ui32Timeout >> 24;
+  pbtPayload[1] = (ui32Timeout >> 16) & 0xff;
+  pbtPayload[2] = (ui32Timeout >> 8) & 0xff;
+  pbtPayload[3] = ui32Timeout & 0xff;
+  return 4;
+}
+
+// Take the next answer out of an exchange answer payload, returns its result
+static int
+remote_next_answer(const uint8_t *pbtPayload, const size_t szPayload, size_t *pszOffset, const uint8_t **ppbtAnswer)
+{
+  if (*pszOffset + 2 > szPayload)
+    return NFC_EIO;
+  const int res = (int16_t)((pbtPayload[*pszOffset] << 8) | pbtPayload[*pszOffset + 1]);
+  *pszOffset += 2;
+  *ppbtAnswer = pbtPayload + *pszOffset;
+  if (res > 0) {
+    if (*pszOffset + res > szPayload)
+      return NFC_EIO;
+    *pszOffset += res;
+  }
+  return res;
+}
+
+static int
+remote_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  if (szData > PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (prd->awaiting)
+    prd->stale++;
+  size_t szPayload = remote_exchange_header(pnd, timeout);
+  remote_append_frame(pnd, &szPayload, pbtData, szData);
+  int res;
+  if ((res = remote_write_packet(pnd, REMOTE_PACKET_EXCHANGE, 0, szPayload, nfc_deadline_from_timeout(timeout))) < 0) {
+    pnd->last_error = res;
+    return res;
+  }
+  prd->awaiting = true;
+  return NFC_SUCCESS;
+}
+
+static int
+remote_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  int res;
+  if (!prd->awaiting) {
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  if ((res = remote_read_exchange(pnd, nfc_deadline_from_timeout(timeout))) < 0) {
+    // A late answer will come for this frame
+    if (res == NFC_ETIMEOUT)
+      prd->stale++;
+    prd->awaiting = false;
+    pnd->last_error = res;
+    return res;
+  }
+  prd->awaiting = false;
+
+  const uint8_t *pbtAnswer;
+  size_t szOffset = 0;
+  if ((res = remote_next_answer(prd->abtPacket + REMOTE_HEADER_LEN, res, &szOffset, &pbtAnswer)) < 0) {
+    pnd->last_error = res;
+    return res;
+  }
+  if ((size_t) res > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %d)", szDataLen, res);
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pbtAnswer, res);
+  return res;
+}
+
+// Collect the answers of one exchange packet into its commands, returns how many of them ran
+static int
+remote_batch_answers(nfc_device *pnd, struct pn53x_cmd *cmds, const size_t szCmds, const nfc_deadline deadline)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  int res;
+  if ((res = remote_read_exchange(pnd, deadline)) < 0)
+    return res;
+  const uint8_t *pbtPayload = prd->abtPacket + REMOTE_HEADER_LEN;
+  const size_t szPayload = (size_t) res;
+  size_t szOffset = 0;
+  size_t i;
+  for (i = 0; (i < szCmds) && (szOffset < szPayload); i++) {
+    const uint8_t *pbtAnswer;
+    if ((res = remote_next_answer(pbtPayload, szPayload, &szOffset, &pbtAnswer)) > 0) {
+      if ((size_t) res > cmds[i].szRxLen) {
+        res = NFC_EOVFLOW;
+      } else {
+        memcpy(cmds[i].pbtRx, pbtAnswer, res);
+      }
+    }
+    cmds[i].res = res;
+  }
+  return (int) i;
+}
+
+/*
+ * Every packet of the batch is sent before the first answer is read: later
+ * packets only run if the previous ones went through, so that the agent never
+ * waits for this side between frames.
+ */
+static int
+remote_transceive_batch(nfc_device *pnd, struct pn53x_cmd *cmds, const size_t szCmds, int timeout)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
+  size_t szPackets = 0;
+  int res;
+
+  if (prd->awaiting) {
+    prd->stale++;
+    prd->awaiting = false;
+  }
+  for (size_t first = 0; first < szCmds; first += REMOTE_BATCH_MAX_FRAMES) {
+    const size_t last = MIN(first + REMOTE_BATCH_MAX_FRAMES, szCmds);
+    size_t szPayload = remote_exchange_header(pnd, timeout);
+    for (size_t i = first; i < last; i++) {
+      if (cmds[i].szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+        res = NFC_EINVARG;
+        goto lost;
+      }
+      remote_append_frame(pnd, &szPayload, cmds[i].pbtTx, cmds[i].szTx);
+    }
+    if ((res = remote_write_packet(pnd, REMOTE_PACKET_EXCHANGE, first ? REMOTE_FLAG_IF_PREVIOUS_OK : 0, szPayload, deadline)) < 0)
+      goto lost;
+    szPackets++;
+  }
+
+  size_t szRun = 0;
+  bool complete = true;
+  for (size_t p = 0; p < szPackets; p++) {
+    const size_t first = p * REMOTE_BATCH_MAX_FRAMES;
+    const size_t szFrames = MIN(REMOTE_BATCH_MAX_FRAMES, szCmds - first);
+    if ((res = remote_batch_answers(pnd, cmds + first, szFrames, deadline)) < 0) {
+      szPackets -= p;
+      goto lost;
+    }
+    if (complete)
+      szRun += res;
+    complete = complete && ((size_t) res == szFrames) && (!pn53x_cmd_failed(&cmds[first + szFrames - 1]));
+  }
+  return (int) szRun;
+
+lost:
+  // Answers of the packets sent are skipped when they come
+  if (res == NFC_ETIMEOUT)
+    prd->stale += szPackets;
+  pnd->last_error = res;
+  return res;
+}
+
+static void
+remote_close(nfc_device *pnd)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+
+  pn53x_idle(pnd);
+  pn53x_data_free(pnd);
+  if (prd->fd >= 0)
+    close(prd->fd);
+  nfc_device_free(pnd);
+}
+
+// Connect to the agent, trying every address of host
+static int
+remote_connect(const char *host, const char *port)
+{
+  const struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+  struct addrinfo *res, *ai;
+  int fd = -1;
+
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to resolve %s", host);
+    return -1;
+  }
+  for (ai = res; ai; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    // Frames are small and latency bound
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to connect to %s:%s", host, port);
+  }
+  return fd;
+}
+
+static nfc_device *
+remote_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  struct nfc_connstring_fields ncf;
+  char port[8];
+
+  const int connstring_decode_level = connstring_parse(connstring, REMOTE_DRIVER_NAME, NULL, &ncf);
+  if (connstring_decode_level < 2)
+    return NULL;
+  snprintf(port, sizeof(port), "%d", REMOTE_DEFAULT_PORT);
+  if (connstring_decode_level == 3)
+    snprintf(port, sizeof(port), "%s", ncf.params[1]);
+
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(sizeof(struct remote_data)) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    return NULL;
+  }
+  pnd->driver_data = nfc_device_alloc(pnd, sizeof(struct remote_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  prd->awaiting = false;
+  prd->stale = 0;
+  if ((prd->fd = remote_connect(ncf.params[0], port)) < 0) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+
+  // The agent tells which device it serves
+  const nfc_deadline deadline = nfc_deadline_from_timeout(REMOTE_HELLO_TIMEOUT);
+  int res;
+  prd->abtPacket[REMOTE_HEADER_LEN] = REMOTE_PROTOCOL_VERSION;
+  if (((res = remote_write_packet(pnd, REMOTE_PACKET_HELLO, 0, 1, deadline)) < 0) ||
+      ((res = remote_read_packet(pnd, REMOTE_PACKET_HELLO, deadline)) < 1) ||
+      (prd->abtPacket[REMOTE_HEADER_LEN] != REMOTE_PROTOCOL_VERSION)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "No agent with protocol version %d at %s", REMOTE_PROTOCOL_VERSION, connstring);
+    if (prd->fd >= 0)
+      close(prd->fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%.*s", REMOTE_DRIVER_NAME, res - 1, (const char *) prd->abtPacket + REMOTE_HEADER_LEN + 1);
+
+  // Alloc and init chip's data, GetFirmwareVersion tells the chip type
+  if (pn53x_data_new(pnd, &remote_io) == NULL) {
+    perror("malloc");
+    close(prd->fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &remote_driver;
+
+  if (pn53x_init(pnd) < 0) {
+    nfc_perror(pnd, "pn53x_init");
+    remote_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+remote_abort_command(nfc_device *pnd)
+{
+  struct remote_data *prd = DRIVER_DATA(pnd);
+  // Sent from another thread while the command waits for its answer: a single write
+  const uint8_t abtAbort[REMOTE_HEADER_LEN] = { REMOTE_PACKET_ABORT, 0, 0, 0 };
+  if ((prd->fd < 0) || (send(prd->fd, abtAbort, sizeof(abtAbort), MSG_NOSIGNAL) != sizeof(abtAbort)))
+    return NFC_EIO;
+  return NFC_SUCCESS;
+}
+
+static int
+remote_get_fd(nfc_device *pnd)
+{
+  return DRIVER_DATA(pnd)->fd;
+}
+
+const struct pn53x_io remote_io = {
+  .send             = remote_send,
+  .receive          = remote_receive,
+  .transceive_batch = remote_transceive_batch,
+};
+
+const struct nfc_driver remote_driver = {
+  .name                             = REMOTE_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = remote_scan,
+  .open                             = remote_open,
+  .close                            = remote_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = remote_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .get_fd         = remote_get_fd,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+};
@@ -0,0 +1,74 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file remote.h
+ * @brief Driver reaching a PN53x device through a TCP link, see pn53x-remote-agent
+ *
+ * Wire protocol, shared with pn53x-remote-agent. Each packet starts with a 4
+ * bytes header: type, flags and payload length (16 bits, big endian). All
+ * integers are big endian.
+ *  - REMOTE_PACKET_HELLO, from the driver: protocol version (1 byte). The agent
+ *    answers with its protocol version and the name of its device.
+ *  - REMOTE_PACKET_EXCHANGE, from the driver: timeout in ms (32 bits, 0 for
+ *    none), then TAMA frames, each one as its length (16 bits) and its bytes.
+ *    The agent runs them in order and stops after the first failing one,
+ *    without waiting for the driver between frames. With
+ *    REMOTE_FLAG_IF_PREVIOUS_OK, no frame is run if the previous exchange
+ *    packet stopped early, so several packets can be sent without waiting.
+ *    The answer has the same type: for each frame run, its result (16 bits,
+ *    signed) then, when positive, that many bytes of answer, status byte first
+ *    when the command has one. A negative result is libnfc's error code.
+ *  - REMOTE_PACKET_ABORT, from the driver: the running command is aborted and
+ *    answers NFC_EOPABORTED. There is no other answer.
+ * ACK frames, checksums and chained answers are handled by the agent, close to
+ * the chip: a frame costs no more than its share of one round trip.
+ */
+
+#ifndef __NFC_DRIVER_REMOTE_H__
+#define __NFC_DRIVER_REMOTE_H__
+
+#include <nfc/nfc-types.h>
+
+#define REMOTE_PROTOCOL_VERSION    1
+#define REMOTE_DEFAULT_PORT        4411
+
+#define REMOTE_PACKET_HELLO        'H'
+#define REMOTE_PACKET_EXCHANGE     'X'
+#define REMOTE_PACKET_ABORT        'A'
+
+#define REMOTE_FLAG_IF_PREVIOUS_OK 0x01
+
+#define REMOTE_HEADER_LEN          4
+// Frames of one exchange packet
+#define REMOTE_BATCH_MAX_FRAMES    16
+// Longest answer (chained answers included), a full batch of answers still fits a packet
+#define REMOTE_ANSWER_MAX_LEN      4000
+#define REMOTE_PAYLOAD_MAX_LEN     65535
+
+extern const struct nfc_driver remote_driver;
+
+#endif // ! __NFC_DRIVER_REMOTE_H__
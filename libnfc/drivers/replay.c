@@ -0,0 +1,425 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file replay.c
+ * @brief Driver answering PN53x commands from a frame capture of a real session
+ *
+ * The capture is a pcapng file written by nfc_capture_start() or the
+ * \e capture_file option (see nfc-capture.c). Each command sent by the PN53x
+ * layer is matched against the TX frames of one captured device and answered
+ * with the RX frame recorded after it, so a field workload runs again at full
+ * CPU speed without any hardware.
+ *
+ * Connection string: replay:file[:interface[,realtime]]
+ *  - file: pcapng capture, which must include the opening of the device
+ *  - interface: index of the captured device in the file, 0 by default
+ *  - realtime: wait as long as the recorded chip did before each answer
+ *
+ * Commands are matched in capture order. Recorded frames the library does not
+ * send anymore are skipped, a command missing from the capture fails with
+ * NFC_EIO: both are counted and reported when the device is closed. Once the
+ * end of the capture is reached, matching starts again from its beginning so
+ * a workload can be replayed in a loop. A command captured without answer
+ * times out.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "replay.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "nfc-capture.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define REPLAY_DRIVER_NAME "replay"
+
+#define LOG_CATEGORY "libnfc.driver.replay"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+#ifndef WIN32
+#  include <time.h>
+#  define usleep_replay(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = (x) / 1000000; \
+    xsleep.tv_nsec = ((x) % 1000000) * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define usleep_replay(x) Sleep(((x) + 999) / 1000)
+#endif
+
+#define PCAPNG_SHB_TYPE       0x0A0D0D0A
+#define PCAPNG_IDB_TYPE       0x00000001
+#define PCAPNG_EPB_TYPE       0x00000006
+#define PCAPNG_BYTE_ORDER     0x1A2B3C4D
+#define PCAPNG_LINKTYPE_USER0 147
+
+// Captured frame, pointing into the loaded file
+struct replay_frame {
+  uint64_t timestamp;           // ns
+  uint8_t direction;            // NFC_CAPTURE_TX or NFC_CAPTURE_RX
+  const uint8_t *pbtData;
+  size_t szData;
+};
+
+// Internal data structs
+const struct pn53x_io replay_io;
+struct replay_data {
+  uint8_t *pbtFile;
+  struct replay_frame *frames;
+  size_t szFrames;
+  size_t cursor;                // next frame to match
+  bool realtime;
+  const struct replay_frame *answer;  // NULL: the command times out
+  uint64_t answer_delay;        // ns
+  // Divergence from the capture
+  unsigned long matched;
+  unsigned long skipped;
+  unsigned long unknown;
+};
+
+#define DRIVER_DATA(pnd) ((struct replay_data*)(pnd->driver_data))
+
+static size_t
+replay_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  // Replays are only opened by connection string, there is no capture to look for
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  return 0;
+}
+
+// Load the whole capture file, *pszFile receives its length
+static uint8_t *
+replay_load_file(const char *filename, size_t *pszFile)
+{
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open capture file %s", filename);
+    return NULL;
+  }
+  uint8_t *pbtFile = NULL;
+  long len;
+  if ((fseek(f, 0, SEEK_END) == 0) && ((len = ftell(f)) > 0) && (fseek(f, 0, SEEK_SET) == 0) &&
+      (pbtFile = malloc(len))) {
+    if (fread(pbtFile, 1, len, f) == (size_t) len) {
+      *pszFile = len;
+    } else {
+      free(pbtFile);
+      pbtFile = NULL;
+    }
+  }
+  fclose(f);
+  if (!pbtFile)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read capture file %s", filename);
+  return pbtFile;
+}
+
+// Collect the frames of one capture interface, in file order
+static int
+replay_parse_capture(struct replay_data *prd, const size_t szFile, const uint32_t ui32Interface)
+{
+  const uint8_t *pbtFile = prd->pbtFile;
+  size_t offset = 0;
+  uint32_t ui32Interfaces = 0;
+  bool interface_found = false;
+
+  while (offset + 12 <= szFile) {
+    uint32_t header[3];
+    memcpy(header, pbtFile + offset, sizeof(header));
+    const uint32_t type = header[0];
+    const uint32_t len = header[1];
+    if ((len < 12) || (len % 4) || (len > szFile - offset))
+      return NFC_EINVARG;
+    if (type == PCAPNG_SHB_TYPE) {
+      // Captures are written in host byte order
+      if (header[2] != PCAPNG_BYTE_ORDER)
+        return NFC_EINVARG;
+      // A new section numbers its interfaces from 0 again, only the first one is replayed
+      if (offset != 0)
+        break;
+    } else if (type == PCAPNG_IDB_TYPE) {
+      uint16_t link_type;
+      memcpy(&link_type, pbtFile + offset + 8, sizeof(link_type));
+      if (ui32Interfaces == ui32Interface) {
+        if (link_type != PCAPNG_LINKTYPE_USER0)
+          return NFC_EINVARG;
+        interface_found = true;
+      }
+      ui32Interfaces++;
+    } else if (type == PCAPNG_EPB_TYPE) {
+      uint32_t epb[5];
+      if (len < 32)
+        return NFC_EINVARG;
+      memcpy(epb, pbtFile + offset + 8, sizeof(epb));
+      // Frames start with a 4 bytes pseudo header: direction, command, status, 0
+      if ((epb[0] == ui32Interface) && (epb[3] >= 4) && (epb[3] <= len - 32)) {
+        if ((prd->szFrames % 256) == 0) {
+          struct replay_frame *frames = realloc(prd->frames, (prd->szFrames + 256) * sizeof(struct replay_frame));
+          if (!frames)
+            return NFC_ESOFT;
+          prd->frames = frames;
+        }
+        struct replay_frame *pf = prd->frames + prd->szFrames++;
+        pf->timestamp = ((uint64_t) epb[1] << 32) | epb[2];
+        pf->direction = pbtFile[offset + 28];
+        pf->pbtData = pbtFile + offset + 32;
+        pf->szData = epb[3] - 4;
+      }
+    }
+    offset += len;
+  }
+  if (!interface_found) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Capture has no device #%" PRIu32 " (%" PRIu32 " found)", ui32Interface, ui32Interfaces);
+    return NFC_EINVARG;
+  }
+  return NFC_SUCCESS;
+}
+
+// Look for the TX frame matching a command, from the cursor then from the beginning of the capture
+static const struct replay_frame *
+replay_match(struct replay_data *prd, const uint8_t *pbtData, const size_t szData)
+{
+  for (size_t pass = 0; pass < 2; pass++) {
+    const size_t start = pass ? 0 : prd->cursor;
+    const size_t end = pass ? prd->cursor : prd->szFrames;
+    for (size_t i = start; i < end; i++) {
+      const struct replay_frame *pf = prd->frames + i;
+      if ((pf->direction == NFC_CAPTURE_TX) && (pf->szData == szData) && (0 == memcmp(pf->pbtData, pbtData, szData))) {
+        if ((i != prd->cursor) && (prd->cursor != prd->szFrames))
+          prd->skipped++;
+        prd->cursor = i + 1;
+        return pf;
+      }
+    }
+  }
+  return NULL;
+}
+
+static int
+replay_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct replay_data *prd = DRIVER_DATA(pnd);
+
+  const struct replay_frame *pf = replay_match(prd, pbtData, szData);
+  if (!pf) {
+    prd->unknown++;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Command %02x (%" PRIuPTR " bytes) is not in the capture", pbtData[0], szData);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  prd->matched++;
+  prd->answer = NULL;
+  if ((prd->cursor < prd->szFrames) && (prd->frames[prd->cursor].direction == NFC_CAPTURE_RX)) {
+    prd->answer = prd->frames + prd->cursor++;
+    prd->answer_delay = (prd->answer->timestamp > pf->timestamp) ? prd->answer->timestamp - pf->timestamp : 0;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+replay_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct replay_data *prd = DRIVER_DATA(pnd);
+
+  const struct replay_frame *pf = prd->answer;
+  if (!pf) {
+    // The recorded chip did not answer
+    pnd->last_error = NFC_ETIMEOUT;
+    return pnd->last_error;
+  }
+  prd->answer = NULL;
+  if (prd->realtime)
+    usleep_replay(prd->answer_delay / 1000);
+  if (pf->szData > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, pf->szData);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pf->pbtData, pf->szData);
+  return pf->szData;
+}
+
+static void
+replay_data_free(struct replay_data *prd)
+{
+  free(prd->frames);
+  free(prd->pbtFile);
+  free(prd);
+}
+
+static void
+replay_close(nfc_device *pnd)
+{
+  struct replay_data *prd = DRIVER_DATA(pnd);
+
+  pn53x_idle(pnd);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "%s: %lu commands replayed, %lu out of order, %lu not in the capture", pnd->connstring, prd->matched, prd->skipped, prd->unknown);
+  pn53x_data_free(pnd);
+  free(prd->frames);
+  free(prd->pbtFile);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+replay_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  struct nfc_connstring_fields ncf;
+  unsigned int interface = 0;
+  char realtime_s[9] = "";
+
+  const int connstring_decode_level = connstring_parse(connstring, REPLAY_DRIVER_NAME, NULL, &ncf);
+  const char *filename = ncf.params[0];
+  if (connstring_decode_level < 2)
+    return NULL;
+  if (connstring_decode_level == 3) {
+    const int n = sscanf(ncf.params[1], "%10u,%8s", &interface, realtime_s);
+    if ((n < 1) || ((n == 2) && strcmp(realtime_s, "realtime")))
+      return NULL;
+  }
+
+  struct replay_data *prd = calloc(1, sizeof(struct replay_data));
+  if (!prd) {
+    perror("malloc");
+    return NULL;
+  }
+  size_t szFile = 0;
+  prd->realtime = (0 == strcmp(realtime_s, "realtime"));
+  prd->pbtFile = replay_load_file(filename, &szFile);
+  if (!prd->pbtFile || (replay_parse_capture(prd, szFile, interface) < 0)) {
+    if (prd->pbtFile)
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to replay capture file %s", filename);
+    replay_data_free(prd);
+    return NULL;
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring, PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    replay_data_free(prd);
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s", REPLAY_DRIVER_NAME);
+  pnd->driver_data = prd;
+
+  // Alloc and init chip's data, the captured GetFirmwareVersion answer tells the chip type
+  if (pn53x_data_new(pnd, &replay_io) == NULL) {
+    perror("malloc");
+    free(prd->frames);
+    free(prd->pbtFile);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &replay_driver;
+
+  if (pn53x_init(pnd) < 0) {
+    nfc_perror(pnd, "pn53x_init");
+    replay_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+replay_abort_command(nfc_device *pnd)
+{
+  // Answers never block
+  (void) pnd;
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io replay_io = {
+  .send       = replay_send,
+  .receive    = replay_receive,
+};
+
+const struct nfc_driver replay_driver = {
+  .name                             = REPLAY_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = replay_scan,
+  .open                             = replay_open,
+  .close                            = replay_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = replay_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+};
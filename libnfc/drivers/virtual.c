@@ -0,0 +1,1032 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file virtual.c
+ * @brief Driver for a software model of a PN532, with a simulated tag in its field
+ *
+ * The model answers PN53x commands the way a PN532 does, so everything above
+ * pn53x_io runs unchanged without any hardware. It is meant for benchmarks and
+ * load tests: each nfc_open() creates an independent chip, thousands of them
+ * can run in one process.
+ *
+ * Connection string: virtual[:tag[+tag...][:bus_us[,rf_us]]]
+ *  - tag: none, mifare1k (default), mifare4k, ultralight or isodep; up to 4
+ *    tags in the same field, InListPassiveTarget finds the first one
+ *  - bus_us: delay added to each frame sent to the chip
+ *  - rf_us: delay added to each command which talks to the tag
+ *
+ * Initiator mode only, target mode commands are refused. Raw frames
+ * (InCommunicateThru) are limited to ISO/IEC 14443-3 type A activation:
+ * REQA/WUPA, bitwise anticollision with collisions, SELECT and HLTA; other
+ * raw frames time out. The ISO-DEP tag echoes every APDU back followed by
+ * 90 00.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "virtual.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define VIRTUAL_DRIVER_NAME "virtual"
+
+#define LOG_CATEGORY "libnfc.driver.virtual"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+#ifndef WIN32
+#  include <time.h>
+#  define usleep_virtual(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = (x) / 1000000; \
+    xsleep.tv_nsec = ((x) % 1000000) * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define usleep_virtual(x) Sleep(((x) + 999) / 1000)
+#endif
+
+// Largest APDU the ISO-DEP tag takes, chained in by the initiator
+#define VIRTUAL_APDU_MAX_LEN 4096
+
+typedef enum {
+  VIRTUAL_TAG_NONE,
+  VIRTUAL_TAG_MIFARE_1K,
+  VIRTUAL_TAG_MIFARE_4K,
+  VIRTUAL_TAG_ULTRALIGHT,
+  VIRTUAL_TAG_ISODEP,
+} virtual_tag_type;
+
+static const struct {
+  const char *name;
+  virtual_tag_type type;
+  uint8_t abtAtqa[2];
+  uint8_t btSak;
+  size_t szUid;
+} virtual_tags[] = {
+  { "none",       VIRTUAL_TAG_NONE,       { 0x00, 0x00 }, 0x00, 0 },
+  { "mifare1k",   VIRTUAL_TAG_MIFARE_1K,  { 0x00, 0x04 }, 0x08, 4 },
+  { "mifare4k",   VIRTUAL_TAG_MIFARE_4K,  { 0x00, 0x02 }, 0x18, 4 },
+  { "ultralight", VIRTUAL_TAG_ULTRALIGHT, { 0x00, 0x44 }, 0x00, 7 },
+  { "isodep",     VIRTUAL_TAG_ISODEP,     { 0x03, 0x44 }, 0x20, 7 },
+};
+
+static const uint8_t virtual_ats[] = { 0x05, 0x78, 0x80, 0x70, 0x02 };
+
+#define VIRTUAL_MIFARE_MEMORY_LEN (256 * 16)
+#define VIRTUAL_ULTRALIGHT_PAGES  16
+
+// Most tags in the field of one device
+#define VIRTUAL_MAX_TAGS 4
+
+// Internal data structs
+const struct pn53x_io virtual_io;
+struct virtual_tag {
+  size_t tag;                   // index in virtual_tags
+  uint8_t abtUid[7];
+  bool    active;
+  bool    halted;
+  // Raw anticollision: REQA/WUPA answered, cascade level to select
+  bool    ready;
+  uint8_t ui8CascadeLevel;
+  int     authenticated_sector;
+  int32_t i32Transfer;
+  uint8_t abtMemory[VIRTUAL_MIFARE_MEMORY_LEN];
+};
+
+struct virtual_data {
+  uint32_t bus_latency;
+  uint32_t rf_latency;
+
+  // Chip
+  uint8_t abtCiu[0x100];        // 0x63xx
+  uint8_t abtSfr[0x100];        // 0xFFxx
+  bool    field;
+  uint8_t abtAnswer[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t  szAnswer;
+  bool    answer_ready;
+  // Last tag listed, for InSelect
+  struct virtual_tag *pvtListed;
+  // ISO-DEP chaining, in both directions
+  uint8_t abtApdu[VIRTUAL_APDU_MAX_LEN + 2];
+  size_t  szApdu;
+  size_t  szApduSent;
+  bool    apdu_out;
+
+  // Tags in the field
+  size_t  szTags;
+  struct virtual_tag atTags[];
+};
+
+#define DRIVER_DATA(pnd) ((struct virtual_data*)(pnd->driver_data))
+
+static size_t
+virtual_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  // Virtual devices are only opened by name
+  (void) context;
+  (void) connstrings;
+  (void) connstrings_len;
+  return 0;
+}
+
+static uint8_t
+virtual_mifare_block_sector(const uint8_t ui8Block)
+{
+  return (ui8Block < 128) ? ui8Block / 4 : 32 + (ui8Block - 128) / 16;
+}
+
+static uint8_t
+virtual_mifare_sector_trailer(const uint8_t ui8Sector)
+{
+  return (ui8Sector < 32) ? ui8Sector * 4 + 3 : 128 + (ui8Sector - 32) * 16 + 15;
+}
+
+static uint8_t
+virtual_mifare_sectors(const struct virtual_tag *pvt)
+{
+  return (virtual_tags[pvt->tag].type == VIRTUAL_TAG_MIFARE_4K) ? 40 : 16;
+}
+
+// Factory content: UID in block 0 and transport keys everywhere
+static void
+virtual_tag_init(struct virtual_tag *pvt, const uint32_t ui32Serial)
+{
+  const size_t szUid = virtual_tags[pvt->tag].szUid;
+
+  memset(pvt->abtMemory, 0x00, sizeof(pvt->abtMemory));
+  pvt->authenticated_sector = -1;
+  // Every tag gets its own UID, 7 bytes ones start with NXP manufacturer code
+  uint8_t *pbtSerial = pvt->abtUid;
+  if (szUid == 7) {
+    pvt->abtUid[0] = 0x04;
+    pvt->abtUid[1] = 0x00;
+    pvt->abtUid[2] = 0x00;
+    pbtSerial += 3;
+  }
+  for (int n = 0; n < 4; n++)
+    pbtSerial[n] = (uint8_t)(ui32Serial >> (8 * (3 - n)));
+  if (pvt->abtUid[0] == 0x88) {
+    // Cascade tag is not a valid first byte
+    pvt->abtUid[0] = 0x89;
+  }
+
+  switch (virtual_tags[pvt->tag].type) {
+    case VIRTUAL_TAG_MIFARE_1K:
+    case VIRTUAL_TAG_MIFARE_4K: {
+      memcpy(pvt->abtMemory, pvt->abtUid, 4);
+      pvt->abtMemory[4] = pvt->abtUid[0] ^ pvt->abtUid[1] ^ pvt->abtUid[2] ^ pvt->abtUid[3];
+      pvt->abtMemory[5] = virtual_tags[pvt->tag].btSak;
+      pvt->abtMemory[6] = virtual_tags[pvt->tag].abtAtqa[1];
+      pvt->abtMemory[7] = virtual_tags[pvt->tag].abtAtqa[0];
+      const uint8_t abtTrailer[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x80, 0x69, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+      for (uint8_t ui8Sector = 0; ui8Sector < virtual_mifare_sectors(pvt); ui8Sector++)
+        memcpy(pvt->abtMemory + virtual_mifare_sector_trailer(ui8Sector) * 16, abtTrailer, sizeof(abtTrailer));
+    }
+    break;
+    case VIRTUAL_TAG_ULTRALIGHT:
+      // Pages 0 to 2: UID with its two check bytes, internal byte and lock bytes
+      memcpy(pvt->abtMemory, pvt->abtUid, 3);
+      pvt->abtMemory[3] = 0x88 ^ pvt->abtUid[0] ^ pvt->abtUid[1] ^ pvt->abtUid[2];
+      memcpy(pvt->abtMemory + 4, pvt->abtUid + 3, 4);
+      pvt->abtMemory[8] = pvt->abtUid[3] ^ pvt->abtUid[4] ^ pvt->abtUid[5] ^ pvt->abtUid[6];
+      pvt->abtMemory[9] = 0x48;
+      break;
+    case VIRTUAL_TAG_NONE:
+    case VIRTUAL_TAG_ISODEP:
+      break;
+  }
+}
+
+// Tags leave the field or are released by the chip
+static void
+virtual_tag_idle(struct virtual_data *pvd)
+{
+  for (size_t n = 0; n < pvd->szTags; n++) {
+    pvd->atTags[n].active = false;
+    pvd->atTags[n].ready = false;
+    pvd->atTags[n].authenticated_sector = -1;
+  }
+  pvd->szApdu = 0;
+  pvd->apdu_out = false;
+}
+
+// Tag selected by the chip, NULL when none
+static struct virtual_tag *
+virtual_active_tag(struct virtual_data *pvd)
+{
+  for (size_t n = 0; n < pvd->szTags; n++) {
+    if (pvd->atTags[n].active)
+      return &(pvd->atTags[n]);
+  }
+  return NULL;
+}
+
+// Target data as InListPassiveTarget gives it: Tg, SENS_RES, SEL_RES, NFCID1 and ATS
+static size_t
+virtual_tag_target_data(const struct virtual_tag *pvt, uint8_t *pbtData)
+{
+  size_t sz = 0;
+  pbtData[sz++] = 0x01;
+  pbtData[sz++] = virtual_tags[pvt->tag].abtAtqa[0];
+  pbtData[sz++] = virtual_tags[pvt->tag].abtAtqa[1];
+  pbtData[sz++] = virtual_tags[pvt->tag].btSak;
+  pbtData[sz++] = virtual_tags[pvt->tag].szUid;
+  memcpy(pbtData + sz, pvt->abtUid, virtual_tags[pvt->tag].szUid);
+  sz += virtual_tags[pvt->tag].szUid;
+  if (virtual_tags[pvt->tag].type == VIRTUAL_TAG_ISODEP) {
+    memcpy(pbtData + sz, virtual_ats, sizeof(virtual_ats));
+    sz += sizeof(virtual_ats);
+  }
+  return sz;
+}
+
+// Whether a tag answers REQA, and matches the optional UID to select
+static bool
+virtual_tag_in_field(const struct virtual_data *pvd, const struct virtual_tag *pvt, const uint8_t *pbtUid, const size_t szUid)
+{
+  if ((virtual_tags[pvt->tag].type == VIRTUAL_TAG_NONE) || (!pvd->field) || pvt->halted)
+    return false;
+  if (szUid == 0)
+    return true;
+  // The UID to select comes with its cascade tags, like on the air
+  const size_t szOwnUid = virtual_tags[pvt->tag].szUid;
+  if (szOwnUid == 7)
+    return (szUid == 8) && (pbtUid[0] == 0x88) && (0 == memcmp(pbtUid + 1, pvt->abtUid, 7));
+  return (szUid == szOwnUid) && (0 == memcmp(pbtUid, pvt->abtUid, szUid));
+}
+
+// First tag of the field InListPassiveTarget would find, NULL when none
+static struct virtual_tag *
+virtual_tag_find(struct virtual_data *pvd, const uint8_t *pbtUid, const size_t szUid)
+{
+  for (size_t n = 0; n < pvd->szTags; n++) {
+    if (virtual_tag_in_field(pvd, &(pvd->atTags[n]), pbtUid, szUid))
+      return &(pvd->atTags[n]);
+  }
+  return NULL;
+}
+
+// The tag NAKs and goes back to idle, the chip reports it like a MIFARE authentication error
+static uint8_t
+virtual_tag_nak(struct virtual_tag *pvt)
+{
+  pvt->active = false;
+  pvt->authenticated_sector = -1;
+  return EMFAUTH;
+}
+
+// HALT: no answer
+static uint8_t
+virtual_tag_halt(struct virtual_tag *pvt)
+{
+  pvt->active = false;
+  pvt->authenticated_sector = -1;
+  pvt->halted = true;
+  return ETIMEOUT;
+}
+
+// UID CLn and its BCC, as sent at cascade level ui8Level; true on the last level
+static bool
+virtual_tag_cascade_uid(const struct virtual_tag *pvt, const uint8_t ui8Level, uint8_t *pbtCl)
+{
+  const bool bDouble = (virtual_tags[pvt->tag].szUid == 7);
+  if (bDouble && (ui8Level == 0)) {
+    pbtCl[0] = 0x88;
+    memcpy(pbtCl + 1, pvt->abtUid, 3);
+  } else {
+    memcpy(pbtCl, pvt->abtUid + (bDouble ? 3 : 0), 4);
+  }
+  pbtCl[4] = pbtCl[0] ^ pbtCl[1] ^ pbtCl[2] ^ pbtCl[3];
+  return !bDouble || (ui8Level == 1);
+}
+
+static void
+virtual_mifare_value_decode(const uint8_t *pbtBlock, int32_t *pi32Value)
+{
+  *pi32Value = (int32_t)((uint32_t) pbtBlock[0] | ((uint32_t) pbtBlock[1] << 8) | ((uint32_t) pbtBlock[2] << 16) | ((uint32_t) pbtBlock[3] << 24));
+}
+
+static void
+virtual_mifare_value_encode(const int32_t i32Value, uint8_t *pbtBlock)
+{
+  const uint8_t btAddress = pbtBlock[12];
+  for (int n = 0; n < 4; n++) {
+    pbtBlock[n] = pbtBlock[8 + n] = (uint8_t)((uint32_t) i32Value >> (8 * n));
+    pbtBlock[4 + n] = ~pbtBlock[n];
+  }
+  pbtBlock[12] = pbtBlock[14] = btAddress;
+  pbtBlock[13] = pbtBlock[15] = ~btAddress;
+}
+
+// MIFARE Classic command, answer is written after the status byte
+static uint8_t
+virtual_mifare_classic_exchange(struct virtual_tag *pvt, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, size_t *pszRx)
+{
+  if (szTx < 2)
+    return ETIMEOUT;
+  const uint8_t ui8Block = pbtTx[1];
+  if (virtual_mifare_block_sector(ui8Block) >= virtual_mifare_sectors(pvt))
+    return virtual_tag_nak(pvt);
+  const uint8_t ui8Sector = virtual_mifare_block_sector(ui8Block);
+  uint8_t *pbtBlock = pvt->abtMemory + ui8Block * 16;
+  uint8_t *pbtTrailer = pvt->abtMemory + virtual_mifare_sector_trailer(ui8Sector) * 16;
+
+  switch (pbtTx[0]) {
+    case 0x60:
+    case 0x61:
+      // Key, then the 4 last bytes of the UID
+      if (szTx < 12)
+        return virtual_tag_nak(pvt);
+      if (memcmp(pbtTx + 2, pbtTrailer + ((pbtTx[0] == 0x60) ? 0 : 10), 6))
+        return virtual_tag_nak(pvt);
+      pvt->authenticated_sector = ui8Sector;
+      return 0x00;
+  }
+  if (pvt->authenticated_sector != ui8Sector)
+    return virtual_tag_nak(pvt);
+  switch (pbtTx[0]) {
+    case 0x30:
+      memcpy(pbtRx, pbtBlock, 16);
+      if (pbtBlock == pbtTrailer)
+        memset(pbtRx, 0x00, 6);  // Key A is never readable
+      *pszRx = 16;
+      return 0x00;
+    case 0xA0:
+      if (szTx < 18)
+        return virtual_tag_nak(pvt);
+      memcpy(pbtBlock, pbtTx + 2, 16);
+      return 0x00;
+    case 0xC0:
+    case 0xC1: {
+      if (szTx < 6)
+        return virtual_tag_nak(pvt);
+      int32_t i32Value, i32Operand;
+      virtual_mifare_value_decode(pbtBlock, &i32Value);
+      virtual_mifare_value_decode(pbtTx + 2, &i32Operand);
+      pvt->i32Transfer = (pbtTx[0] == 0xC1) ? i32Value + i32Operand : i32Value - i32Operand;
+    }
+    return 0x00;
+    case 0xC2:
+      virtual_mifare_value_decode(pbtBlock, &pvt->i32Transfer);
+      return 0x00;
+    case 0xB0:
+      virtual_mifare_value_encode(pvt->i32Transfer, pbtBlock);
+      return 0x00;
+    case 0x50:
+      return virtual_tag_halt(pvt);
+  }
+  return virtual_tag_nak(pvt);
+}
+
+// MIFARE Ultralight command
+static uint8_t
+virtual_ultralight_exchange(struct virtual_tag *pvt, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, size_t *pszRx)
+{
+  if (szTx < 2)
+    return ETIMEOUT;
+  const uint8_t ui8Page = pbtTx[1];
+  if ((pbtTx[0] != 0x50) && (ui8Page >= VIRTUAL_ULTRALIGHT_PAGES))
+    return virtual_tag_nak(pvt);
+
+  switch (pbtTx[0]) {
+    case 0x30:
+      // Four pages, rolling over to page 0
+      for (uint8_t n = 0; n < 4; n++)
+        memcpy(pbtRx + 4 * n, pvt->abtMemory + ((ui8Page + n) % VIRTUAL_ULTRALIGHT_PAGES) * 4, 4);
+      *pszRx = 16;
+      return 0x00;
+    case 0xA0:
+    case 0xA2:
+      if ((ui8Page < 2) || (szTx < 6))
+        return virtual_tag_nak(pvt);
+      if (ui8Page == 2) {
+        // Only lock bytes are writable, bits can only be set
+        pvt->abtMemory[10] |= pbtTx[4];
+        pvt->abtMemory[11] |= pbtTx[5];
+      } else if (ui8Page == 3) {
+        // OTP bits
+        for (int n = 0; n < 4; n++)
+          pvt->abtMemory[12 + n] |= pbtTx[2 + n];
+      } else {
+        memcpy(pvt->abtMemory + ui8Page * 4, pbtTx + 2, 4);
+      }
+      return 0x00;
+    case 0x50:
+      return virtual_tag_halt(pvt);
+  }
+  return virtual_tag_nak(pvt);
+}
+
+// InDataExchange payload once the target is active, answer is written after the status byte
+static uint8_t
+virtual_data_exchange(struct virtual_data *pvd, const uint8_t btTg, const uint8_t *pbtTx, const size_t szTx)
+{
+  struct virtual_tag *pvt = virtual_active_tag(pvd);
+  uint8_t *pbtRx = pvd->abtAnswer + 1;
+  size_t szRx = 0;
+  uint8_t btStatus;
+
+  if (!pvt)
+    return ETIMEOUT;
+  usleep_virtual(pvd->rf_latency);
+
+  switch (virtual_tags[pvt->tag].type) {
+    case VIRTUAL_TAG_MIFARE_1K:
+    case VIRTUAL_TAG_MIFARE_4K:
+      btStatus = virtual_mifare_classic_exchange(pvt, pbtTx, szTx, pbtRx, &szRx);
+      break;
+    case VIRTUAL_TAG_ULTRALIGHT:
+      btStatus = virtual_ultralight_exchange(pvt, pbtTx, szTx, pbtRx, &szRx);
+      break;
+    case VIRTUAL_TAG_ISODEP:
+      if (pvd->apdu_out) {
+        if (szTx == 0) {
+          // Continuation of a chained answer
+          btStatus = 0x00;
+          break;
+        }
+        // New APDU, what was left of the previous answer is dropped
+        pvd->szApdu = 0;
+        pvd->apdu_out = false;
+      }
+      if (pvd->szApdu + szTx > VIRTUAL_APDU_MAX_LEN) {
+        pvd->szApdu = 0;
+        return EINVPARAM;
+      }
+      memcpy(pvd->abtApdu + pvd->szApdu, pbtTx, szTx);
+      pvd->szApdu += szTx;
+      if (btTg & 0x40) {
+        // More information: wait for the rest of the APDU
+        pvd->szAnswer = 1;
+        return 0x00;
+      }
+      // Echo the APDU, followed by 90 00
+      pvd->abtApdu[pvd->szApdu++] = 0x90;
+      pvd->abtApdu[pvd->szApdu++] = 0x00;
+      pvd->szApduSent = 0;
+      pvd->apdu_out = true;
+      btStatus = 0x00;
+      break;
+    case VIRTUAL_TAG_NONE:
+    default:
+      return ETIMEOUT;
+  }
+  if (pvd->apdu_out) {
+    // Answers longer than a frame are chained with MI set
+    const size_t szLeft = pvd->szApdu - pvd->szApduSent;
+    const size_t szChunk = (szLeft > PN53x_IN_DATA_MAX_LEN) ? PN53x_IN_DATA_MAX_LEN : szLeft;
+    memcpy(pbtRx, pvd->abtApdu + pvd->szApduSent, szChunk);
+    pvd->szApduSent += szChunk;
+    szRx = szChunk;
+    if (pvd->szApduSent < pvd->szApdu) {
+      btStatus |= 0x40;
+    } else {
+      pvd->szApdu = 0;
+      pvd->apdu_out = false;
+    }
+  }
+  pvd->szAnswer = 1 + szRx;
+  return btStatus;
+}
+
+// ISO/IEC 14443-3 type A frame sent by InCommunicateThru: REQA/WUPA, anticollision, SELECT and HLTA
+// are answered by the tags of the field, bit by bit like on the air, answer is written after the status byte
+static uint8_t
+virtual_raw_exchange(struct virtual_data *pvd, const uint8_t *pbtTx, size_t szTx)
+{
+  const uint8_t btBitFraming = pvd->abtCiu[PN53X_REG_CIU_BitFraming & 0xff];
+  const uint8_t ui8TxLastBits = btBitFraming & SYMBOL_TX_LAST_BITS;
+  const uint8_t ui8RxAlign = (btBitFraming & SYMBOL_RX_ALIGN) >> 4;
+  const bool bTxCrc = pvd->abtCiu[PN53X_REG_CIU_TxMode & 0xff] & SYMBOL_TX_CRC_ENABLE;
+  const bool bRxCrc = pvd->abtCiu[PN53X_REG_CIU_RxMode & 0xff] & SYMBOL_RX_CRC_ENABLE;
+  // Answer of each tag, and the bits of it the reader already knows
+  uint8_t abtTagRx[VIRTUAL_MAX_TAGS][5 + 2];
+  size_t szTagRx = 0;
+  size_t szKnownBits = 0;
+  size_t szAnswering = 0;
+  bool bSak = false;
+
+  usleep_virtual(pvd->rf_latency);
+  if (!pvd->field || (szTx == 0))
+    return ETIMEOUT;
+  // Frames made of whole bytes end with their CRC, the chip adds it or the reader did
+  if ((ui8TxLastBits == 0) && !bTxCrc && (szTx >= 4) && ((pbtTx[0] == 0x50) || (pbtTx[1] == 0x70))) {
+    if (!iso14443a_crc_check(pbtTx, szTx))
+      return ETIMEOUT;
+    szTx -= 2;
+  }
+
+  if ((szTx == 1) && (ui8TxLastBits == 7) && ((pbtTx[0] == 0x26) || (pbtTx[0] == 0x52))) {
+    // REQA wakes idle tags up, WUPA halted ones too: ATQA, LSB first
+    for (size_t n = 0; n < pvd->szTags; n++) {
+      struct virtual_tag *pvt = &(pvd->atTags[n]);
+      if ((virtual_tags[pvt->tag].type == VIRTUAL_TAG_NONE) || pvt->active || (pvt->halted && (pbtTx[0] == 0x26)))
+        continue;
+      pvt->halted = false;
+      pvt->ready = true;
+      pvt->ui8CascadeLevel = 0;
+      abtTagRx[szAnswering][0] = virtual_tags[pvt->tag].abtAtqa[1];
+      abtTagRx[szAnswering][1] = virtual_tags[pvt->tag].abtAtqa[0];
+      szAnswering++;
+    }
+    szTagRx = 2;
+  } else if ((szTx >= 2) && ((pbtTx[0] == 0x93) || (pbtTx[0] == 0x95) || (pbtTx[0] == 0x97))) {
+    const uint8_t ui8Level = (pbtTx[0] - 0x93) / 2;
+    const uint8_t btNvb = pbtTx[1];
+    if ((btNvb == 0x70) && (szTx == 7)) {
+      // SELECT: the tag with this UID CLn answers SAK, the other ones go back to idle
+      for (size_t n = 0; n < pvd->szTags; n++) {
+        struct virtual_tag *pvt = &(pvd->atTags[n]);
+        uint8_t abtCl[5];
+        if (!pvt->ready || (pvt->ui8CascadeLevel != ui8Level))
+          continue;
+        const bool bComplete = virtual_tag_cascade_uid(pvt, ui8Level, abtCl);
+        if (memcmp(abtCl, pbtTx + 2, 5)) {
+          pvt->ready = false;
+          continue;
+        }
+        if (bComplete) {
+          pvt->ready = false;
+          pvt->active = true;
+          pvd->pvtListed = pvt;
+          abtTagRx[szAnswering][0] = virtual_tags[pvt->tag].btSak;
+        } else {
+          pvt->ui8CascadeLevel++;
+          abtTagRx[szAnswering][0] = 0x04;
+        }
+        szAnswering++;
+      }
+      szTagRx = 1;
+      bSak = true;
+    } else {
+      // ANTICOLLISION: tags whose UID CLn starts with the known bits send the rest of it
+      szKnownBits = 8 * ((btNvb >> 4) - 2) + (btNvb & 0x0f);
+      if (((btNvb >> 4) < 2) || (szKnownBits > 39) || ((btNvb & 0x0f) != ui8TxLastBits) || (szTx < 2 + (szKnownBits + 7) / 8))
+        return ETIMEOUT;
+      for (size_t n = 0; n < pvd->szTags; n++) {
+        struct virtual_tag *pvt = &(pvd->atTags[n]);
+        uint8_t abtCl[5];
+        if (!pvt->ready || (pvt->ui8CascadeLevel != ui8Level))
+          continue;
+        virtual_tag_cascade_uid(pvt, ui8Level, abtCl);
+        bool bMatch = true;
+        for (size_t i = 0; bMatch && (i < szKnownBits); i++)
+          bMatch = ((abtCl[i / 8] ^ pbtTx[2 + i / 8]) & (1 << (i % 8))) == 0;
+        if (!bMatch)
+          continue;
+        memcpy(abtTagRx[szAnswering], abtCl + szKnownBits / 8, 5 - szKnownBits / 8);
+        szAnswering++;
+      }
+      szTagRx = 5 - szKnownBits / 8;
+      szKnownBits %= 8;
+    }
+  } else if ((szTx == 2) && (pbtTx[0] == 0x50) && (pbtTx[1] == 0x00)) {
+    struct virtual_tag *pvt = virtual_active_tag(pvd);
+    if (pvt)
+      virtual_tag_halt(pvt);
+    return ETIMEOUT;
+  } else {
+    // Other raw frames are not simulated
+    return ETIMEOUT;
+  }
+
+  if (szAnswering == 0)
+    return ETIMEOUT;
+  // Tags answering different bits collide
+  for (size_t n = 1; n < szAnswering; n++) {
+    for (size_t i = szKnownBits; i < 8 * szTagRx; i++) {
+      if ((abtTagRx[0][i / 8] ^ abtTagRx[n][i / 8]) & (1 << (i % 8)))
+        return EBITCOLL;
+    }
+  }
+  if (bSak && !bRxCrc) {
+    iso14443a_crc_append(abtTagRx[0], 1);
+    szTagRx += 2;
+  }
+  // The first bit received lands at RxAlign in the FIFO
+  uint8_t *pbtRx = pvd->abtAnswer + 1;
+  const size_t szBits = 8 * szTagRx - szKnownBits;
+  memset(pbtRx, 0x00, sizeof(abtTagRx[0]) + 1);
+  for (size_t i = 0; i < szBits; i++) {
+    const size_t szIn = szKnownBits + i;
+    const size_t szOut = ui8RxAlign + i;
+    if (abtTagRx[0][szIn / 8] & (1 << (szIn % 8)))
+      pbtRx[szOut / 8] |= 1 << (szOut % 8);
+  }
+  pvd->szAnswer = 1 + (ui8RxAlign + szBits + 7) / 8;
+  return 0x00;
+}
+
+static void
+virtual_register_access(struct virtual_data *pvd, const uint16_t ui16Address, uint8_t **ppbtValue)
+{
+  static uint8_t btDummy;
+  switch (ui16Address >> 8) {
+    case 0x63:
+      *ppbtValue = pvd->abtCiu + (ui16Address & 0xff);
+      break;
+    case 0xFF:
+      *ppbtValue = pvd->abtSfr + (ui16Address & 0xff);
+      break;
+    default:
+      // Other memory reads as 0, writes are ignored
+      btDummy = 0x00;
+      *ppbtValue = &btDummy;
+  }
+}
+
+// Run a command on the chip model, its answer waits for receive()
+static int
+virtual_chip_command(struct virtual_data *pvd, const uint8_t *pbtCmd, const size_t szCmd)
+{
+  uint8_t *pbtAnswer = pvd->abtAnswer;
+  uint8_t *pbtValue;
+
+  pvd->szAnswer = 0;
+  switch (pbtCmd[0]) {
+    case Diagnose:
+      if (szCmd < 2)
+        return NFC_EIO;
+      switch (pbtCmd[1]) {
+        case 0x00:
+          // Communication line test: echo
+          memcpy(pbtAnswer, pbtCmd + 1, szCmd - 1);
+          pvd->szAnswer = szCmd - 1;
+          break;
+        case 0x06:
+          // Card presence
+          usleep_virtual(pvd->rf_latency);
+          pbtAnswer[0] = virtual_active_tag(pvd) ? 0x00 : ETIMEOUT;
+          pvd->szAnswer = 1;
+          break;
+        default:
+          pbtAnswer[0] = 0x00;
+          pvd->szAnswer = 1;
+      }
+      break;
+    case GetFirmwareVersion:
+      // PN532 v1.6, ISO/IEC 14443 type A and B, ISO/IEC 18092
+      pbtAnswer[0] = 0x32;
+      pbtAnswer[1] = 0x01;
+      pbtAnswer[2] = 0x06;
+      pbtAnswer[3] = 0x07;
+      pvd->szAnswer = 4;
+      break;
+    case GetGeneralStatus:
+      pbtAnswer[pvd->szAnswer++] = 0x00;
+      pbtAnswer[pvd->szAnswer++] = pvd->field ? 0x01 : 0x00;
+      pbtAnswer[pvd->szAnswer++] = virtual_active_tag(pvd) ? 0x01 : 0x00;
+      if (virtual_active_tag(pvd)) {
+        pbtAnswer[pvd->szAnswer++] = 0x01;
+        pbtAnswer[pvd->szAnswer++] = 0x00;
+        pbtAnswer[pvd->szAnswer++] = 0x00;
+        pbtAnswer[pvd->szAnswer++] = PTT_MIFARE;
+      }
+      pbtAnswer[pvd->szAnswer++] = 0x00;
+      break;
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szCmd; n += 2) {
+        virtual_register_access(pvd, (pbtCmd[n] << 8) | pbtCmd[n + 1], &pbtValue);
+        pbtAnswer[pvd->szAnswer++] = *pbtValue;
+      }
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szCmd; n += 3) {
+        const uint16_t ui16Address = (pbtCmd[n] << 8) | pbtCmd[n + 1];
+        virtual_register_access(pvd, ui16Address, &pbtValue);
+        // Raw frames are not simulated: the FIFO stays empty, so timed exchanges time out
+        *pbtValue = (ui16Address == PN53X_REG_CIU_FIFOLevel) ? 0x00 : pbtCmd[n + 2];
+      }
+      break;
+    case ReadGPIO:
+      pbtAnswer[0] = pvd->abtSfr[PN53X_SFR_P3 & 0xff];
+      pbtAnswer[1] = pvd->abtSfr[PN53X_SFR_P7 & 0xff];
+      pbtAnswer[2] = 0x00;
+      pvd->szAnswer = 3;
+      break;
+    case WriteGPIO:
+    case SetParameters:
+    case SAMConfiguration:
+    case SetSerialBaudRate:
+      break;
+    case RFConfiguration:
+      if ((szCmd >= 3) && (pbtCmd[1] == RFCI_FIELD)) {
+        pvd->field = pbtCmd[2] & 0x01;
+        if (!pvd->field) {
+          // Tags lose power
+          virtual_tag_idle(pvd);
+          for (size_t n = 0; n < pvd->szTags; n++)
+            pvd->atTags[n].halted = false;
+        }
+      }
+      break;
+    case PowerDown:
+      virtual_tag_idle(pvd);
+      pbtAnswer[pvd->szAnswer++] = 0x00;
+      break;
+    case InListPassiveTarget: {
+      if (szCmd < 3)
+        return NFC_EIO;
+      usleep_virtual(pvd->rf_latency);
+      // The chip switches the field on by itself
+      pvd->field = true;
+      virtual_tag_idle(pvd);
+      // Only ISO/IEC 14443 type A tags are simulated, the first one of the field wins
+      struct virtual_tag *pvt = (pbtCmd[2] == PM_ISO14443A_106) ? virtual_tag_find(pvd, pbtCmd + 3, szCmd - 3) : NULL;
+      if (pvt) {
+        pbtAnswer[pvd->szAnswer++] = 0x01;
+        pvd->szAnswer += virtual_tag_target_data(pvt, pbtAnswer + pvd->szAnswer);
+        pvt->active = true;
+        pvd->pvtListed = pvt;
+      } else {
+        pbtAnswer[pvd->szAnswer++] = 0x00;
+      }
+    }
+    break;
+    case InAutoPoll: {
+      if (szCmd < 3)
+        return NFC_EIO;
+      usleep_virtual(pvd->rf_latency);
+      pvd->field = true;
+      virtual_tag_idle(pvd);
+      pbtAnswer[pvd->szAnswer++] = 0x00;
+      struct virtual_tag *pvt = virtual_tag_find(pvd, NULL, 0);
+      if (!pvt)
+        break;
+      for (size_t n = 3; n < szCmd; n++) {
+        const bool bIsoDep = (virtual_tags[pvt->tag].type == VIRTUAL_TAG_ISODEP);
+        if ((pbtCmd[n] == PTT_GENERIC_PASSIVE_106) || ((pbtCmd[n] == PTT_MIFARE) && !bIsoDep) || ((pbtCmd[n] == PTT_ISO14443_4A_106) && bIsoDep)) {
+          pbtAnswer[0] = 0x01;
+          pbtAnswer[pvd->szAnswer++] = pbtCmd[n];
+          const size_t szData = virtual_tag_target_data(pvt, pbtAnswer + pvd->szAnswer + 1);
+          pbtAnswer[pvd->szAnswer++] = szData;
+          pvd->szAnswer += szData;
+          pvt->active = true;
+          pvd->pvtListed = pvt;
+          break;
+        }
+      }
+    }
+    break;
+    case InDataExchange:
+      if (szCmd < 2)
+        return NFC_EIO;
+      pbtAnswer[0] = virtual_data_exchange(pvd, pbtCmd[1], pbtCmd + 2, szCmd - 2);
+      if (pvd->szAnswer == 0)
+        pvd->szAnswer = 1;
+      break;
+    case InCommunicateThru:
+      pbtAnswer[0] = virtual_raw_exchange(pvd, pbtCmd + 1, szCmd - 1);
+      if (pvd->szAnswer == 0)
+        pvd->szAnswer = 1;
+      break;
+    case InJumpForDEP:
+    case InJumpForPSL:
+    case InATR:
+      // No D.E.P. target around
+      usleep_virtual(pvd->rf_latency);
+      pbtAnswer[pvd->szAnswer++] = ETIMEOUT;
+      break;
+    case InPSL:
+      pbtAnswer[pvd->szAnswer++] = virtual_active_tag(pvd) ? 0x00 : ECID;
+      break;
+    case InDeselect:
+    case InRelease:
+      virtual_tag_idle(pvd);
+      pbtAnswer[pvd->szAnswer++] = 0x00;
+      break;
+    case InSelect:
+      if (pvd->pvtListed && virtual_tag_in_field(pvd, pvd->pvtListed, NULL, 0))
+        pvd->pvtListed->active = true;
+      pbtAnswer[pvd->szAnswer++] = virtual_active_tag(pvd) ? 0x00 : ECID;
+      break;
+    default:
+      // Target mode and PN532 specific commands are not simulated: syntax error frame
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Command 0x%02x is not simulated", pbtCmd[0]);
+      return NFC_EIO;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+virtual_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct virtual_data *pvd = DRIVER_DATA(pnd);
+
+  usleep_virtual(pvd->bus_latency);
+  // Like a chip sending an error frame, a refused command is reported on receive
+  pvd->answer_ready = (virtual_chip_command(pvd, pbtData, szData) == NFC_SUCCESS);
+  return NFC_SUCCESS;
+}
+
+static int
+virtual_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct virtual_data *pvd = DRIVER_DATA(pnd);
+
+  if (!pvd->answer_ready) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  pvd->answer_ready = false;
+  if (pvd->szAnswer > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, pvd->szAnswer);
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+  memcpy(pbtData, pvd->abtAnswer, pvd->szAnswer);
+  return pvd->szAnswer;
+}
+
+static void
+virtual_close(nfc_device *pnd)
+{
+  pn53x_idle(pnd);
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+virtual_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  struct nfc_connstring_fields ncf;
+  size_t atag[VIRTUAL_MAX_TAGS] = { 1 };
+  size_t szTags = 1;
+  unsigned int bus_latency = 0, rf_latency = 0;
+
+  const int connstring_decode_level = connstring_parse(connstring, VIRTUAL_DRIVER_NAME, NULL, &ncf);
+  const char *tag_s = ncf.params[0];
+  const char *latency_s = ncf.params[1];
+  if (connstring_decode_level < 1)
+    return NULL;
+  if (connstring_decode_level >= 2) {
+    // Several tags are separated by '+'
+    szTags = 0;
+    for (const char *pcTag = tag_s; pcTag; ) {
+      const char *pcNext = strchr(pcTag, '+');
+      const size_t szName = pcNext ? (size_t)(pcNext - pcTag) : strlen(pcTag);
+      size_t tag;
+      for (tag = 0; tag < sizeof(virtual_tags) / sizeof(virtual_tags[0]); tag++) {
+        if ((strlen(virtual_tags[tag].name) == szName) && (0 == strncmp(pcTag, virtual_tags[tag].name, szName)))
+          break;
+      }
+      if ((tag == sizeof(virtual_tags) / sizeof(virtual_tags[0])) || (szTags == VIRTUAL_MAX_TAGS)) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unknown simulated tag or too many tags: %s", tag_s);
+        return NULL;
+      }
+      atag[szTags++] = tag;
+      pcTag = pcNext ? pcNext + 1 : NULL;
+    }
+  }
+  if (connstring_decode_level == 3) {
+    if (sscanf(latency_s, "%10u,%10u", &bus_latency, &rf_latency) < 1)
+      return NULL;
+  }
+
+  const size_t szData = sizeof(struct virtual_data) + szTags * sizeof(struct virtual_tag);
+  nfc_device *pnd = nfc_device_new(context, connstring, NFC_ARENA_ALIGN(szData) + PN53X_ARENA_LEN);
+  if (!pnd) {
+    perror("malloc");
+    return NULL;
+  }
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%s", VIRTUAL_DRIVER_NAME, (connstring_decode_level >= 2) ? tag_s : virtual_tags[atag[0]].name);
+
+  pnd->driver_data = nfc_device_alloc(pnd, szData);
+  if (!pnd->driver_data) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  struct virtual_data *pvd = DRIVER_DATA(pnd);
+  memset(pvd, 0x00, szData);
+  pvd->bus_latency = bus_latency;
+  pvd->rf_latency = rf_latency;
+  pvd->szTags = szTags;
+  for (size_t n = 0; n < szTags; n++) {
+    pvd->atTags[n].tag = atag[n];
+    // The model address makes UIDs unique among open devices, the index among tags of a field
+    virtual_tag_init(&(pvd->atTags[n]), (uint32_t)((uintptr_t) pvd >> 4) + (uint32_t)(n << 24));
+  }
+  virtual_tag_idle(pvd);
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &virtual_io) == NULL) {
+    perror("malloc");
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pnd->driver = &virtual_driver;
+
+  if (pn53x_init(pnd) < 0) {
+    nfc_perror(pnd, "pn53x_init");
+    virtual_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+static int
+virtual_abort_command(nfc_device *pnd)
+{
+  // Commands never block
+  (void) pnd;
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io virtual_io = {
+  .send       = virtual_send,
+  .receive    = virtual_receive,
+};
+
+const struct nfc_driver virtual_driver = {
+  .name                             = VIRTUAL_DRIVER_NAME,
+  .scan_type                        = NOT_AVAILABLE,
+  .scan                             = virtual_scan,
+  .open                             = virtual_open,
+  .close                            = virtual_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = NULL, // No secure-element support
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_select_passive_targets = pn53x_initiator_select_passive_targets,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_iso14443b    = pn53x_initiator_inventory_iso14443b,
+  .initiator_set_current_target     = pn53x_initiator_set_current_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_stream     = pn53x_initiator_poll_target_stream,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = NULL, // Target mode is not simulated
+  .target_send_bytes     = NULL,
+  .target_receive_bytes  = NULL,
+  .target_send_bits      = NULL,
+  .target_receive_bits   = NULL,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .device_begin_properties      = pn53x_begin_properties,
+  .device_commit_properties     = pn53x_commit_properties,
+  .device_set_rf_analog         = pn53x_set_rf_analog,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = virtual_abort_command,
+  .idle           = pn53x_idle,
+  .powerdown      = pn53x_PowerDown,
+  .resume         = pn53x_resume,
+  .initiator_iso14443_4_pps = pn53x_initiator_iso14443_4_pps,
+  .initiator_raw_session_begin = pn53x_initiator_raw_session_begin,
+  .initiator_raw_session_end = pn53x_initiator_raw_session_end,
+  .initiator_sam_transceive_bytes = NULL, // No secure-element support
+  .initiator_transceive_bytes_batch = pn53x_initiator_transceive_bytes_batch,
+};
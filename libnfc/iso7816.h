@@ -40,4 +40,11 @@
 #define ISO7816_SHORT_C_APDU_MAX_LEN (ISO7816_C_APDU_COMMAND_HEADER_LEN + ISO7816_SHORT_APDU_MAX_DATA_LEN + ISO7816_SHORT_C_APDU_MAX_OVERHEAD)
 #define ISO7816_SHORT_R_APDU_MAX_LEN (ISO7816_SHORT_APDU_MAX_DATA_LEN + ISO7816_SHORT_R_APDU_RESPONSE_TRAILER_LEN)
 
+#define ISO7816_EXTENDED_C_APDU_MAX_DATA_LEN 65535
+#define ISO7816_EXTENDED_R_APDU_MAX_DATA_LEN 65536
+#define ISO7816_EXTENDED_C_APDU_MAX_OVERHEAD 5
+
+#define ISO7816_EXTENDED_C_APDU_MAX_LEN (ISO7816_C_APDU_COMMAND_HEADER_LEN + ISO7816_EXTENDED_C_APDU_MAX_DATA_LEN + ISO7816_EXTENDED_C_APDU_MAX_OVERHEAD)
+#define ISO7816_EXTENDED_R_APDU_MAX_LEN (ISO7816_EXTENDED_R_APDU_MAX_DATA_LEN + ISO7816_SHORT_R_APDU_RESPONSE_TRAILER_LEN)
+
 #endif /* !__LIBNFC_ISO7816_H__ */
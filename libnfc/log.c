@@ -54,16 +54,20 @@ log_priority_to_str(const int priority)
 
 #include "log-internal.h"
 
+// Log level of the last initialized context, read by LOG_ENABLED()
+#ifdef DEBUG
+uint32_t log_cached_level = 3;
+#else
+uint32_t log_cached_level = 1;
+#endif
+
+// Nesting counter of log_mute() calls of this thread: its messages are dropped while it is not zero
+LOG_THREAD_LOCAL int log_muted = 0;
+
 void
 log_init(const nfc_context *context)
 {
-#ifdef ENVVARS
-  char str[32];
-  sprintf(str, "%"PRIu32, context->log_level);
-  setenv("LIBNFC_LOG_LEVEL", str, 1);
-#else
-  (void)context;
-#endif
+  log_cached_level = context->log_level;
 }
 
 void
@@ -72,36 +76,309 @@ log_exit(void)
 }
 
 void
-log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+log_mute(void)
+{
+  log_muted++;
+}
+
+void
+log_unmute(void)
 {
-  char *env_log_level = NULL;
-#ifdef ENVVARS
-  env_log_level = getenv("LIBNFC_LOG_LEVEL");
+  if (log_muted > 0)
+    log_muted--;
+}
+
+// Sink receiving formatted messages, stderr (or platform equivalent) when not set
+static nfc_log_sink log_sink = NULL;
+static void *log_sink_user_data = NULL;
+#ifndef WIN32
+#include <pthread.h>
+// Keeps sink and its user data consistent while another thread changes them
+static pthread_mutex_t log_sink_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
-  uint32_t log_level;
-  if (NULL == env_log_level) {
-    // LIBNFC_LOG_LEVEL is not set
-#ifdef DEBUG
-    log_level = 3;
-#else
-    log_level = 1;
+
+void
+log_set_sink(nfc_log_sink sink, void *user_data)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&log_sink_lock);
+#endif
+  log_sink_user_data = user_data;
+  log_sink = sink;
+#ifndef WIN32
+  pthread_mutex_unlock(&log_sink_lock);
+#endif
+}
+
+static void
+log_emit(const uint8_t priority, const char *category, const char *message)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&log_sink_lock);
+#endif
+  nfc_log_sink sink = log_sink;
+  void *user_data = log_sink_user_data;
+#ifndef WIN32
+  pthread_mutex_unlock(&log_sink_lock);
 #endif
-  } else {
-    log_level = atoi(env_log_level);
+  if (sink)
+    sink(priority, category, message, user_data);
+  else
+    log_put_internal("%s\t%s\t%s\n", log_priority_to_str(priority), category, message);
+}
+
+// Format a byte-array as LOG_HEX always did: "tag: xx xx ..."
+static void
+log_format_hex(char *buf, size_t buf_len, const char *tag, const uint8_t *data, size_t len)
+{
+  size_t pos = snprintf(buf, buf_len, "%s: ", tag);
+  for (size_t i = 0; (i < len) && (pos + 3 < buf_len); i++) {
+    snprintf(buf + pos, buf_len - pos, "%02x ", data[i]);
+    pos += 3;
   }
+}
 
-  //  printf("log_level = %"PRIu32" group = %"PRIu8" priority = %"PRIu8"\n", log_level, group, priority);
-  if (log_level) { // If log is not disabled by log_level=none
-    if (((log_level & 0x00000003) >= priority) ||   // Global log level
-        (((log_level >> (group * 2)) & 0x00000003) >= priority)) { // Group log level
+#ifndef WIN32
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
 
-      va_list va;
-      va_start(va, format);
-      log_put_internal("%s\t%s\t", log_priority_to_str(priority), category);
-      log_vput_internal(format, va);
-      log_put_internal("\n");
+#define LOG_RING_DEFAULT_CAPACITY 256
+#define LOG_RECORD_DATA_LEN 512
+
+enum log_record_kind {
+  LOG_RECORD_TEXT,   // data holds an already formatted message
+  LOG_RECORD_STATIC, // text points to a message with static storage
+  LOG_RECORD_HEX,    // data holds raw bytes, text points to the tag
+};
+
+// One slot of the ring: sequence implements the bounded MPMC queue described by D. Vyukov
+struct log_record {
+  size_t sequence;
+  struct timeval timestamp;
+  uint8_t kind;
+  uint8_t priority;
+  const char *category;
+  const char *text;
+  size_t len;
+  uint8_t data[LOG_RECORD_DATA_LEN];
+};
+
+static struct log_record *log_ring = NULL;
+static size_t log_ring_mask;
+static size_t log_ring_enqueue_pos;
+static size_t log_ring_dequeue_pos;
+static size_t log_ring_dropped_count;
+static volatile bool log_ring_active = false;
+static volatile bool log_ring_stopping = false;
+static pthread_t log_ring_thread;
+
+// Reserve a slot, or return NULL and account a dropped record when the ring is full
+static struct log_record *
+log_ring_acquire(size_t *ppos)
+{
+  size_t pos = __atomic_load_n(&log_ring_enqueue_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    struct log_record *record = &log_ring[pos & log_ring_mask];
+    size_t seq = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&log_ring_enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *ppos = pos;
+        return record;
+      }
+    } else if (dif < 0) {
+      __atomic_fetch_add(&log_ring_dropped_count, 1, __ATOMIC_RELAXED);
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&log_ring_enqueue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void
+log_ring_publish(struct log_record *record, size_t pos)
+{
+  __atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+}
+
+static struct log_record *
+log_ring_record(const uint8_t kind, const uint8_t priority, const char *category, const char *text, size_t *ppos)
+{
+  struct log_record *record = log_ring_acquire(ppos);
+  if (record) {
+    gettimeofday(&record->timestamp, NULL);
+    record->kind = kind;
+    record->priority = priority;
+    record->category = category;
+    record->text = text;
+    record->len = 0;
+  }
+  return record;
+}
+
+// Format a record and hand it to the sink, from the drain thread only
+static void
+log_ring_emit(const struct log_record *record)
+{
+  char message[LOG_RECORD_DATA_LEN * 3 + 128];
+  int pos = snprintf(message, sizeof(message), "%ld.%06ld\t", (long)record->timestamp.tv_sec, (long)record->timestamp.tv_usec);
+  switch (record->kind) {
+    case LOG_RECORD_TEXT:
+      snprintf(message + pos, sizeof(message) - pos, "%.*s", (int)record->len, (const char *)record->data);
+      break;
+    case LOG_RECORD_STATIC:
+      snprintf(message + pos, sizeof(message) - pos, "%s", record->text);
+      break;
+    case LOG_RECORD_HEX:
+      log_format_hex(message + pos, sizeof(message) - pos, record->text, record->data, record->len);
+      break;
+  }
+  log_emit(record->priority, record->category, message);
+}
+
+// Consume every published record, return how many were emitted
+static size_t
+log_ring_drain(void)
+{
+  size_t count = 0;
+  for (;;) {
+    struct log_record *record = &log_ring[log_ring_dequeue_pos & log_ring_mask];
+    size_t seq = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+    if (seq != log_ring_dequeue_pos + 1)
+      return count;
+    log_ring_emit(record);
+    __atomic_store_n(&record->sequence, log_ring_dequeue_pos + log_ring_mask + 1, __ATOMIC_RELEASE);
+    log_ring_dequeue_pos++;
+    count++;
+  }
+}
+
+static void *
+log_ring_thread_func(void *arg)
+{
+  (void) arg;
+  const struct timespec idle = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+  while (!log_ring_stopping) {
+    if (!log_ring_drain())
+      nanosleep(&idle, NULL);
+  }
+  log_ring_drain();
+  return NULL;
+}
+
+int
+log_ring_start(size_t capacity)
+{
+  if (log_ring_active)
+    return NFC_SUCCESS;
+  if (!capacity)
+    capacity = LOG_RING_DEFAULT_CAPACITY;
+  size_t size = 1;
+  while (size < capacity)
+    size <<= 1;
+
+  if (!(log_ring = malloc(size * sizeof(struct log_record))))
+    return NFC_ESOFT;
+  for (size_t i = 0; i < size; i++)
+    log_ring[i].sequence = i;
+  log_ring_mask = size - 1;
+  log_ring_enqueue_pos = 0;
+  log_ring_dequeue_pos = 0;
+  log_ring_dropped_count = 0;
+  log_ring_stopping = false;
+
+  if (pthread_create(&log_ring_thread, NULL, log_ring_thread_func, NULL)) {
+    free(log_ring);
+    log_ring = NULL;
+    return NFC_ESOFT;
+  }
+  __atomic_store_n(&log_ring_active, true, __ATOMIC_RELEASE);
+  return NFC_SUCCESS;
+}
+
+void
+log_ring_stop(void)
+{
+  if (!log_ring_active)
+    return;
+  // Caller ensures no other thread is logging anymore, ie. all devices are closed
+  __atomic_store_n(&log_ring_active, false, __ATOMIC_RELEASE);
+  log_ring_stopping = true;
+  pthread_join(log_ring_thread, NULL);
+  free(log_ring);
+  log_ring = NULL;
+}
+
+size_t
+log_ring_dropped(void)
+{
+  return __atomic_load_n(&log_ring_dropped_count, __ATOMIC_RELAXED);
+}
+#endif // !WIN32
+
+void
+log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+{
+  if (LOG_ENABLED(group, priority)) {
+    va_list va;
+    va_start(va, format);
+#ifndef WIN32
+    if (log_ring_active) {
+      size_t pos;
+      struct log_record *record = log_ring_record(LOG_RECORD_TEXT, priority, category, NULL, &pos);
+      if (record) {
+        int res = vsnprintf((char *)record->data, sizeof(record->data), format, va);
+        record->len = (res < 0) ? 0 : ((size_t)res < sizeof(record->data) ? (size_t)res : sizeof(record->data) - 1);
+        log_ring_publish(record, pos);
+      }
       va_end(va);
+      return;
+    }
+#endif
+    char message[1024];
+    vsnprintf(message, sizeof(message), format, va);
+    log_emit(priority, category, message);
+    va_end(va);
+  }
+}
+
+void
+log_put_static(const uint8_t group, const char *category, const uint8_t priority, const char *message)
+{
+  if (LOG_ENABLED(group, priority)) {
+#ifndef WIN32
+    if (log_ring_active) {
+      size_t pos;
+      struct log_record *record = log_ring_record(LOG_RECORD_STATIC, priority, category, message, &pos);
+      if (record)
+        log_ring_publish(record, pos);
+      return;
     }
+#endif
+    log_emit(priority, category, message);
+  }
+}
+
+void
+log_put_hex(const uint8_t group, const char *category, const char *tag, const uint8_t *data, size_t len)
+{
+  if (LOG_ENABLED(group, NFC_LOG_PRIORITY_DEBUG)) {
+#ifndef WIN32
+    if (log_ring_active) {
+      size_t pos;
+      struct log_record *record = log_ring_record(LOG_RECORD_HEX, NFC_LOG_PRIORITY_DEBUG, category, tag, &pos);
+      if (record) {
+        record->len = (len < sizeof(record->data)) ? len : sizeof(record->data);
+        memcpy(record->data, data, record->len);
+        log_ring_publish(record, pos);
+      }
+      return;
+    }
+#endif
+    char message[1024];
+    log_format_hex(message, sizeof(message), tag, data, len);
+    log_emit(NFC_LOG_PRIORITY_DEBUG, category, message);
   }
 }
 
@@ -71,44 +71,74 @@ const char *log_priority_to_str(const int priority);
 #    define __has_attribute_format 1
 #  endif
 
+#  if defined(_MSC_VER)
+#    define LOG_THREAD_LOCAL __declspec(thread)
+#  else
+#    define LOG_THREAD_LOCAL __thread
+#  endif
+
+extern uint32_t log_cached_level;
+// Per thread so muting a scan does not hide messages of other threads
+extern LOG_THREAD_LOCAL int log_muted;
+
+/**
+ * @macro LOG_ENABLED
+ * @brief Tell if a message of given group and priority would be logged
+ * Cheap enough to guard formatting of messages on hot paths.
+ */
+#  define LOG_ENABLED(group, priority) \
+  ((!log_muted) && (log_cached_level) && \
+   (((log_cached_level & 0x00000003) >= (priority)) || /* Global log level */ \
+    (((log_cached_level >> ((group) * 2)) & 0x00000003) >= (priority)))) /* Group log level */
+
 void log_init(const nfc_context *context);
 void log_exit(void);
+void log_mute(void);
+void log_unmute(void);
 void log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
 #  if __has_attribute_format
 __attribute__((format(printf, 4, 5)))
 #  endif
 ;
+// Log a message with static storage: formatting is deferred when ring sink is active
+void log_put_static(const uint8_t group, const char *category, const uint8_t priority, const char *message);
+// Log a byte-array at debug priority: bytes are copied raw when ring sink is active
+void log_put_hex(const uint8_t group, const char *category, const char *tag, const uint8_t *data, size_t len);
+void log_set_sink(nfc_log_sink sink, void *user_data);
+#  ifndef WIN32
+int log_ring_start(size_t capacity);
+void log_ring_stop(void);
+size_t log_ring_dropped(void);
+#  endif
 #else
 // No logging
+#define LOG_ENABLED(group, priority) (0)
 #define log_init(nfc_context) ((void) 0)
 #define log_exit() ((void) 0)
+#define log_mute() ((void) 0)
+#define log_unmute() ((void) 0)
 #define log_put(group, category, priority, format, ...) do {} while (0)
+#define log_put_static(group, category, priority, message) do {} while (0)
+#define log_set_sink(sink, user_data) ((void) 0)
 
 #endif // LOG
 
 /**
  * @macro LOG_HEX
  * @brief Log a byte-array in hexadecimal format
- * Max values:  pcTag of 121 bytes + ": " + 300 bytes of data+ "\0" => acBuf of 1024 bytes
+ * Max values:  pcTag of 121 bytes + ": " + 300 bytes of data+ "\0" => message of 1024 bytes
  */
 #  ifdef LOG
 #    define LOG_HEX(group, pcTag, pbtData, szBytes) do { \
-    size_t	 __szPos; \
-    char	 __acBuf[1024]; \
-    size_t	 __szBuf = 0; \
     if ((int)szBytes < 0) { \
       fprintf (stderr, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
       log_put (group, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s:%d: Attempt to print %d bytes!\n", __FILE__, __LINE__, (int)szBytes); \
       abort(); \
       break; \
     } \
-    snprintf (__acBuf + __szBuf, sizeof(__acBuf) - __szBuf, "%s: ", pcTag); \
-    __szBuf += strlen (pcTag) + 2; \
-    for (__szPos=0; (__szPos < (size_t)(szBytes)) && (__szBuf < sizeof(__acBuf)); __szPos++) { \
-      snprintf (__acBuf + __szBuf, sizeof(__acBuf) - __szBuf, "%02x ",((uint8_t *)(pbtData))[__szPos]); \
-      __szBuf += 3; \
-    } \
-    log_put (group, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", __acBuf); \
+    if (!LOG_ENABLED(group, NFC_LOG_PRIORITY_DEBUG)) \
+      break; \
+    log_put_hex (group, LOG_CATEGORY, pcTag, (const uint8_t *)(pbtData), (size_t)(szBytes)); \
   } while (0);
 #  else
 #    define LOG_HEX(group, pcTag, pbtData, szBytes) do { \
@@ -34,6 +34,7 @@
 #endif // HAVE_CONFIG_H
 
 #include <stdio.h>
+#include <string.h>
 
 #include "mirror-subr.h"
 
@@ -66,12 +67,27 @@ mirror(uint8_t bt)
   return ByteMirror[bt];
 }
 
-static void
-mirror_bytes(uint8_t *pbts, size_t szLen)
+// Reverse the bits of every byte of a 64-bit word at once: swap nibbles, then bit pairs, then bits
+static uint64_t
+mirror_word(uint64_t ui64Bits)
 {
-  size_t  szByteNr;
+  ui64Bits = ((ui64Bits >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((ui64Bits & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  ui64Bits = ((ui64Bits >> 2) & 0x3333333333333333ULL) | ((ui64Bits & 0x3333333333333333ULL) << 2);
+  ui64Bits = ((ui64Bits >> 1) & 0x5555555555555555ULL) | ((ui64Bits & 0x5555555555555555ULL) << 1);
+  return ui64Bits;
+}
 
-  for (szByteNr = 0; szByteNr < szLen; szByteNr++) {
+void
+mirror_uint8_ts(uint8_t *pbts, size_t szLen)
+{
+  // Bytes are mirrored in place, so the word byte order does not matter
+  for (; szLen >= 8; szLen -= 8, pbts += 8) {
+    uint64_t ui64Bits;
+    memcpy(&ui64Bits, pbts, 8);
+    ui64Bits = mirror_word(ui64Bits);
+    memcpy(pbts, &ui64Bits, 8);
+  }
+  while (szLen--) {
     *pbts = ByteMirror[*pbts];
     pbts++;
   }
@@ -80,13 +96,11 @@ mirror_bytes(uint8_t *pbts, size_t szLen)
 uint32_t
 mirror32(uint32_t ui32Bits)
 {
-  mirror_bytes((uint8_t *) & ui32Bits, 4);
-  return ui32Bits;
+  return (uint32_t) mirror_word(ui32Bits);
 }
 
 uint64_t
 mirror64(uint64_t ui64Bits)
 {
-  mirror_bytes((uint8_t *) & ui64Bits, 8);
-  return ui64Bits;
+  return mirror_word(ui64Bits);
 }
@@ -0,0 +1,1572 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-async.c
+ * @brief Provide a non-blocking API on top of libnfc
+ *
+ * Requests are queued per device and executed in submission order by a
+ * per-device worker. Once a request is completed, the device event file
+ * descriptor (see nfc_async_get_fd()) becomes readable and the completion
+ * callback is called from nfc_async_dispatch(), ie. in caller's thread: a
+ * single event loop can then drive many devices.
+ *
+ * A reader pool (see nfc_pool_new()) runs the same requests for a set of
+ * devices from a fixed count of workers instead of one thread per device.
+ *
+ * A tap stream (see nfc_tap_stream_start()) keeps polling a device from its
+ * own thread and queues target arrival and removal events for the application.
+ * When antennas overlap, nfc_tap_claim() tells which device owns a tap seen
+ * by several of them.
+ */
+/**
+ * @defgroup async  Asynchronous requests
+ * This page details how to submit requests without blocking the calling thread.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-async.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.async"
+
+typedef enum {
+  NAO_INITIATOR_SELECT_PASSIVE_TARGET,
+  NAO_INITIATOR_POLL_TARGET,
+  NAO_INITIATOR_TRANSCEIVE_BYTES,
+  NAO_TARGET_INIT,
+  NAO_TARGET_SEND_BYTES,
+  NAO_TARGET_RECEIVE_BYTES,
+  NAO_INITIATOR_TARGET_MONITOR,
+} nfc_async_operation;
+
+struct nfc_async_request {
+  nfc_async_operation op;
+  nfc_modulation nm;
+  const nfc_modulation *pnmModulations;
+  size_t szModulations;
+  uint8_t uiPollNr;
+  uint8_t uiPeriod;
+  nfc_target *pnt;
+  const uint8_t *pbtTx;
+  size_t szTx;
+  uint8_t *pbtRx;
+  size_t szRx;
+  int timeout;
+  nfc_async_callback cb;
+  void *user_data;
+  int res;
+  struct nfc_async_request *next;
+};
+
+struct nfc_async {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool stop;
+  /** Request the worker is executing, NULL when idle */
+  struct nfc_async_request *running;
+  /** Worker is waiting for the device on behalf of running request */
+  bool in_flight;
+  /** Running request has been cancelled */
+  bool cancel;
+  /** Requests waiting to be executed */
+  struct nfc_async_request *pending_head;
+  struct nfc_async_request *pending_tail;
+  /** Requests completed, waiting to be dispatched */
+  struct nfc_async_request *done_head;
+  struct nfc_async_request *done_tail;
+  /** Read end is readable when completed requests are waiting */
+  int event_fds[2];
+};
+
+#define ASYNC_DATA(pnd) ((struct nfc_async *)(pnd->async_data))
+
+static void
+nfc_async_complete(struct nfc_async *pna, struct nfc_async_request *pnar)
+{
+  // Called with mutex held
+  const uint8_t btEvent = 0x01;
+  pnar->next = NULL;
+  if (pna->done_tail) {
+    pna->done_tail->next = pnar;
+  } else {
+    pna->done_head = pnar;
+  }
+  pna->done_tail = pnar;
+  if (write(pna->event_fds[1], &btEvent, sizeof(btEvent)) < 0) {
+    // Pipe is already full: it is readable anyway
+  }
+}
+
+// Probe the target every interval until it goes away or request is cancelled
+static int
+nfc_async_monitor(nfc_device *pnd, struct nfc_async *pna, const struct nfc_async_request *pnar)
+{
+  for (;;) {
+    // Only the probe itself can be aborted, not the wait between probes
+    pthread_mutex_lock(&pna->mutex);
+    const bool bCancelled = pna->stop || pna->cancel;
+    pna->in_flight = !bCancelled;
+    pthread_mutex_unlock(&pna->mutex);
+    if (bCancelled) {
+      return NFC_EOPABORTED;
+    }
+    const int res = nfc_initiator_target_is_present(pnd, pnar->pnt);
+    pthread_mutex_lock(&pna->mutex);
+    pna->in_flight = false;
+    pthread_mutex_unlock(&pna->mutex);
+    if (res != NFC_SUCCESS) {
+      return res;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += pnar->timeout / 1000;
+    ts.tv_nsec += (pnar->timeout % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&pna->mutex);
+    while ((!pna->stop) && (!pna->cancel)) {
+      if (pthread_cond_timedwait(&pna->cond, &pna->mutex, &ts) == ETIMEDOUT)
+        break;
+    }
+    pthread_mutex_unlock(&pna->mutex);
+  }
+}
+
+static int
+nfc_async_run(nfc_device *pnd, struct nfc_async *pna, const struct nfc_async_request *pnar)
+{
+  switch (pnar->op) {
+    case NAO_INITIATOR_SELECT_PASSIVE_TARGET:
+      return nfc_initiator_select_passive_target(pnd, pnar->nm, pnar->pbtTx, pnar->szTx, pnar->pnt);
+    case NAO_INITIATOR_POLL_TARGET:
+      return nfc_initiator_poll_target(pnd, pnar->pnmModulations, pnar->szModulations, pnar->uiPollNr, pnar->uiPeriod, pnar->pnt);
+    case NAO_INITIATOR_TRANSCEIVE_BYTES:
+      return nfc_initiator_transceive_bytes(pnd, pnar->pbtTx, pnar->szTx, pnar->pbtRx, pnar->szRx, pnar->timeout);
+    case NAO_TARGET_INIT:
+      return nfc_target_init(pnd, pnar->pnt, pnar->pbtRx, pnar->szRx, pnar->timeout);
+    case NAO_TARGET_SEND_BYTES:
+      return nfc_target_send_bytes(pnd, pnar->pbtTx, pnar->szTx, pnar->timeout);
+    case NAO_TARGET_RECEIVE_BYTES:
+      return nfc_target_receive_bytes(pnd, pnar->pbtRx, pnar->szRx, pnar->timeout);
+    case NAO_INITIATOR_TARGET_MONITOR:
+      return nfc_async_monitor(pnd, pna, pnar);
+  }
+  return NFC_EINVARG;
+}
+
+static void *
+nfc_async_worker(void *arg)
+{
+  nfc_device *pnd = arg;
+  struct nfc_async *pna = ASYNC_DATA(pnd);
+
+  pthread_mutex_lock(&pna->mutex);
+  while (!pna->stop) {
+    struct nfc_async_request *pnar = pna->pending_head;
+    if (!pnar) {
+      pthread_cond_wait(&pna->cond, &pna->mutex);
+      continue;
+    }
+    pna->pending_head = pnar->next;
+    if (!pna->pending_head) {
+      pna->pending_tail = NULL;
+    }
+    pna->running = pnar;
+    pna->in_flight = (pnar->op != NAO_INITIATOR_TARGET_MONITOR);
+    pna->cancel = false;
+    pthread_mutex_unlock(&pna->mutex);
+
+    pnar->res = nfc_async_run(pnd, pna, pnar);
+
+    pthread_mutex_lock(&pna->mutex);
+    pna->running = NULL;
+    pna->in_flight = false;
+    nfc_async_complete(pna, pnar);
+  }
+  pthread_mutex_unlock(&pna->mutex);
+  return NULL;
+}
+
+static struct nfc_async *
+nfc_async_get(nfc_device *pnd)
+{
+  if (pnd->async_data) {
+    return ASYNC_DATA(pnd);
+  }
+  struct nfc_async *pna = calloc(1, sizeof(struct nfc_async));
+  if (!pna) {
+    return NULL;
+  }
+  if (pipe(pna->event_fds) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to create event pipe: %s", strerror(errno));
+    free(pna);
+    return NULL;
+  }
+  fcntl(pna->event_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(pna->event_fds[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&pna->mutex, NULL);
+  pthread_cond_init(&pna->cond, NULL);
+  pnd->async_data = pna;
+  if (pthread_create(&pna->thread, NULL, nfc_async_worker, pnd) != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to create worker thread");
+    pnd->async_data = NULL;
+    pthread_cond_destroy(&pna->cond);
+    pthread_mutex_destroy(&pna->mutex);
+    close(pna->event_fds[0]);
+    close(pna->event_fds[1]);
+    free(pna);
+    return NULL;
+  }
+  return pna;
+}
+
+static int
+nfc_async_submit(nfc_device *pnd, const struct nfc_async_request *pnarTemplate)
+{
+  struct nfc_async *pna = nfc_async_get(pnd);
+  if (!pna) {
+    return NFC_ESOFT;
+  }
+  struct nfc_async_request *pnar = malloc(sizeof(struct nfc_async_request));
+  if (!pnar) {
+    return NFC_ESOFT;
+  }
+  memcpy(pnar, pnarTemplate, sizeof(struct nfc_async_request));
+  pnar->res = NFC_SUCCESS;
+  pnar->next = NULL;
+
+  pthread_mutex_lock(&pna->mutex);
+  if (pna->stop) {
+    // Device is being closed, i.e. from a completion callback called by nfc_async_free()
+    pthread_mutex_unlock(&pna->mutex);
+    free(pnar);
+    return NFC_EOPABORTED;
+  }
+  if (pna->pending_tail) {
+    pna->pending_tail->next = pnar;
+  } else {
+    pna->pending_head = pnar;
+  }
+  pna->pending_tail = pnar;
+  pthread_cond_signal(&pna->cond);
+  pthread_mutex_unlock(&pna->mutex);
+  return NFC_SUCCESS;
+}
+
+// Call completion callbacks of detached requests and release them, mutex must not be held
+static int
+nfc_async_request_list_dispatch(nfc_device *pnd, struct nfc_async_request *pnar)
+{
+  int res = 0;
+  while (pnar) {
+    struct nfc_async_request *next = pnar->next;
+    if (pnar->cb) {
+      pnar->cb(pnd, pnar->res, pnar->user_data);
+    }
+    free(pnar);
+    pnar = next;
+    res++;
+  }
+  return res;
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_select_passive_target() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nm desired modulation
+ * @param pbtInitData optional initiator data, have to remain valid until completion
+ * @param szInitData length of initiator data \a pbtInitData.
+ * @param[out] pnt optional \a nfc_target, filled before completion
+ * @param cb completion callback, it receives nfc_initiator_select_passive_target() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_SELECT_PASSIVE_TARGET, .nm = nm, .pbtTx = pbtInitData, .szTx = szInitData, .pnt = pnt, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_poll_target() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnmModulations desired modulations, have to remain valid until completion
+ * @param szModulations size of \a pnmModulations
+ * @param uiPollNr specifies the number of polling (0x01 – 0xFE: 1 up to 254 polling, 0xFF: Endless polling)
+ * @param uiPeriod indicates the polling period in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s)
+ * @param[out] pnt pointer on \a nfc_target (over)writable struct, filled before completion
+ * @param cb completion callback, it receives nfc_initiator_poll_target() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_POLL_TARGET, .pnmModulations = pnmModulations, .szModulations = szModulations, .uiPollNr = uiPollNr, .uiPeriod = uiPeriod, .pnt = pnt, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_transceive_bytes() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted, have to remain valid until completion
+ * @param szTx contains the length in bytes.
+ * @param[out] pbtRx response from the target, filled before completion
+ * @param szRx size of \a pbtRx (Will return NFC_EOVFLOW if RX exceeds this size)
+ * @param timeout in milliseconds
+ * @param cb completion callback, it receives nfc_initiator_transceive_bytes() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_TRANSCEIVE_BYTES, .pbtTx = pbtTx, .szTx = szTx, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_init() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt pointer to \a nfc_target struct that represents the wanted emulated target, have to remain valid until completion
+ * @param[out] pbtRx Rx buffer pointer, filled before completion
+ * @param szRx received bytes count
+ * @param timeout in milliseconds
+ * @param cb completion callback, it receives nfc_target_init() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_INIT, .pnt = pnt, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_send_bytes() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx pointer to Tx buffer, have to remain valid until completion
+ * @param szTx size of Tx buffer
+ * @param timeout in milliseconds
+ * @param cb completion callback, it receives nfc_target_send_bytes() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_SEND_BYTES, .pbtTx = pbtTx, .szTx = szTx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_receive_bytes() request
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pbtRx pointer to Rx buffer, filled before completion
+ * @param szRx size of Rx buffer
+ * @param timeout in milliseconds
+ * @param cb completion callback, it receives nfc_target_receive_bytes() result
+ * @param user_data pointer given back to \a cb
+ */
+int
+nfc_async_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_RECEIVE_BYTES, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a presence monitor of a selected target
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt \a nfc_target struct pointer of the selected target to watch, have to remain valid until completion
+ * @param interval delay between two probes, in milliseconds
+ * @param cb completion callback, it receives NFC_ETGRELEASED when the target is removed
+ * @param user_data pointer given back to \a cb
+ *
+ * The target is probed with nfc_initiator_target_is_present(), which sends
+ * the cheapest command answered by this kind of target. The request lasts
+ * until the target is removed, an error occurs or nfc_async_cancel() is
+ * called (NFC_EOPABORTED); requests submitted meanwhile wait for it.
+ */
+int
+nfc_async_initiator_target_monitor(nfc_device *pnd, const nfc_target *pnt, int interval, nfc_async_callback cb, void *user_data)
+{
+  if (interval < 0) {
+    return NFC_EINVARG;
+  }
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_TARGET_MONITOR, .pnt = (nfc_target *) pnt, .timeout = interval, .cb = cb, .user_data = user_data };
+  return nfc_async_submit(pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Get a file descriptor which becomes readable when requests are completed
+ * @return Returns a file descriptor suitable for select(), poll() or epoll(), otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * @note This file descriptor must only be waited for, use nfc_async_dispatch() to process completions. It is closed by nfc_close().
+ */
+int
+nfc_async_get_fd(nfc_device *pnd)
+{
+  struct nfc_async *pna = nfc_async_get(pnd);
+  if (!pna) {
+    return NFC_ESOFT;
+  }
+  return pna->event_fds[0];
+}
+
+/** @ingroup async
+ * @brief Call completion callbacks of completed requests
+ * @return Returns count of dispatched completions, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Callbacks are called from calling thread, in submission order. Callbacks are
+ * allowed to submit new requests.
+ */
+int
+nfc_async_dispatch(nfc_device *pnd)
+{
+  struct nfc_async *pna = ASYNC_DATA(pnd);
+  if (!pna) {
+    return 0;
+  }
+  uint8_t abtEvents[32];
+  pthread_mutex_lock(&pna->mutex);
+  // Worker signals with mutex held so events and done list stay consistent
+  while (read(pna->event_fds[0], abtEvents, sizeof(abtEvents)) > 0);
+  struct nfc_async_request *pnar = pna->done_head;
+  pna->done_head = NULL;
+  pna->done_tail = NULL;
+  pthread_mutex_unlock(&pna->mutex);
+
+  return nfc_async_request_list_dispatch(pnd, pnar);
+}
+
+/** @ingroup async
+ * @brief Cancel all submitted requests
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Queued requests are completed with NFC_EOPABORTED error. The running
+ * request, if any, is aborted using nfc_abort_command() when device supports it,
+ * unless it already got its answer: it is then completed with its own result.
+ */
+int
+nfc_async_cancel(nfc_device *pnd)
+{
+  struct nfc_async *pna = ASYNC_DATA(pnd);
+  if (!pna) {
+    return NFC_SUCCESS;
+  }
+  int res = NFC_SUCCESS;
+  pthread_mutex_lock(&pna->mutex);
+  struct nfc_async_request *pnar = pna->pending_head;
+  pna->pending_head = NULL;
+  pna->pending_tail = NULL;
+  while (pnar) {
+    struct nfc_async_request *next = pnar->next;
+    pnar->res = NFC_EOPABORTED;
+    nfc_async_complete(pna, pnar);
+    pnar = next;
+  }
+  if (pna->running && !pna->cancel) {
+    pna->cancel = true;
+    pthread_cond_signal(&pna->cond);
+    // Worker can't retire the request while mutex is held: an abort sent
+    // once it returned would hit the next command instead
+    if (pna->in_flight) {
+      res = nfc_abort_command(pnd);
+    }
+  }
+  pthread_mutex_unlock(&pna->mutex);
+  return res;
+}
+
+void
+nfc_async_free(nfc_device *pnd)
+{
+  struct nfc_async *pna = ASYNC_DATA(pnd);
+  if (!pna) {
+    return;
+  }
+  pthread_mutex_lock(&pna->mutex);
+  pna->stop = true;
+  if (pna->in_flight) {
+    nfc_abort_command(pnd);
+  }
+  pthread_cond_signal(&pna->cond);
+  pthread_mutex_unlock(&pna->mutex);
+  pthread_join(pna->thread, NULL);
+
+  // Deliver completions not dispatched yet, then abort requests which never ran
+  struct nfc_async_request *pnarDone = pna->done_head;
+  struct nfc_async_request *pnarPending = pna->pending_head;
+  pna->done_head = pna->done_tail = NULL;
+  pna->pending_head = pna->pending_tail = NULL;
+  nfc_async_request_list_dispatch(pnd, pnarDone);
+  for (struct nfc_async_request *pnar = pnarPending; pnar; pnar = pnar->next) {
+    pnar->res = NFC_EOPABORTED;
+  }
+  nfc_async_request_list_dispatch(pnd, pnarPending);
+  pthread_cond_destroy(&pna->cond);
+  pthread_mutex_destroy(&pna->mutex);
+  close(pna->event_fds[0]);
+  close(pna->event_fds[1]);
+  free(pna);
+  pnd->async_data = NULL;
+}
+
+/*
+ * Reader pool
+ *
+ * Each device of the pool has its own FIFO of requests, run one at a time.
+ * A device having pending requests is queued on the deque of the worker which
+ * last served it, so readers stay on the same core; idle workers steal from
+ * the back of other deques. The pool mutex only protects queues: requests run
+ * and callbacks are called without it.
+ */
+struct nfc_pool_member {
+  nfc_device *pnd;
+  struct nfc_async_request *pending_head;
+  struct nfc_async_request *pending_tail;
+  /** A worker is executing one of its requests */
+  bool running;
+  /** Being removed by nfc_pool_remove_device(), new requests are refused */
+  bool removed;
+  /** Deque the member is waiting on, -1 when none */
+  int queued_on;
+  /** Worker which last ran one of its requests */
+  size_t home;
+  /** Deque links */
+  struct nfc_pool_member *prev;
+  struct nfc_pool_member *next;
+  struct nfc_pool_member *next_member;
+};
+
+struct nfc_pool_worker {
+  nfc_pool *pool;
+  size_t index;
+  pthread_t thread;
+  struct nfc_pool_member *head;
+  struct nfc_pool_member *tail;
+};
+
+struct nfc_pool {
+  pthread_mutex_t mutex;
+  /** Signaled when a device is queued */
+  pthread_cond_t cond;
+  /** Signaled when a request is done, for nfc_pool_remove_device() */
+  pthread_cond_t done;
+  bool stop;
+  struct nfc_pool_worker *workers;
+  size_t szWorkers;
+  size_t szStarted;
+  struct nfc_pool_member *members;
+  /** Home of next added device, devices are spread round robin */
+  size_t next_home;
+};
+
+static void
+nfc_pool_push_back(nfc_pool *pool, size_t worker, struct nfc_pool_member *pm)
+{
+  struct nfc_pool_worker *pw = &(pool->workers[worker]);
+  pm->next = NULL;
+  pm->prev = pw->tail;
+  if (pw->tail) {
+    pw->tail->next = pm;
+  } else {
+    pw->head = pm;
+  }
+  pw->tail = pm;
+  pm->queued_on = (int) worker;
+}
+
+static void
+nfc_pool_unlink(nfc_pool *pool, struct nfc_pool_member *pm)
+{
+  struct nfc_pool_worker *pw = &(pool->workers[pm->queued_on]);
+  if (pm->prev) {
+    pm->prev->next = pm->next;
+  } else {
+    pw->head = pm->next;
+  }
+  if (pm->next) {
+    pm->next->prev = pm->prev;
+  } else {
+    pw->tail = pm->prev;
+  }
+  pm->prev = pm->next = NULL;
+  pm->queued_on = -1;
+}
+
+// Next device to serve: front of own deque, otherwise back of another one
+static struct nfc_pool_member *
+nfc_pool_take(nfc_pool *pool, size_t worker)
+{
+  struct nfc_pool_member *pm = pool->workers[worker].head;
+  for (size_t i = 1; (!pm) && (i < pool->szWorkers); i++) {
+    pm = pool->workers[(worker + i) % pool->szWorkers].tail;
+  }
+  if (pm)
+    nfc_pool_unlink(pool, pm);
+  return pm;
+}
+
+static struct nfc_pool_member *
+nfc_pool_find(nfc_pool *pool, const nfc_device *pnd)
+{
+  struct nfc_pool_member *pm = pool->members;
+  while (pm && (pm->pnd != pnd))
+    pm = pm->next_member;
+  return pm;
+}
+
+static void *
+nfc_pool_worker_run(void *arg)
+{
+  struct nfc_pool_worker *pw = arg;
+  nfc_pool *pool = pw->pool;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (!pool->stop) {
+    struct nfc_pool_member *pm = nfc_pool_take(pool, pw->index);
+    if (!pm) {
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+      continue;
+    }
+    struct nfc_async_request *pnar = pm->pending_head;
+    pm->pending_head = pnar->next;
+    if (!pm->pending_head) {
+      pm->pending_tail = NULL;
+    }
+    pm->running = true;
+    pm->home = pw->index;
+    pthread_mutex_unlock(&pool->mutex);
+
+    pnar->res = nfc_async_run(pm->pnd, NULL, pnar);
+    if (pnar->cb) {
+      pnar->cb(pm->pnd, pnar->res, pnar->user_data);
+    }
+    free(pnar);
+
+    pthread_mutex_lock(&pool->mutex);
+    pm->running = false;
+    if (pm->removed) {
+      pthread_cond_broadcast(&pool->done);
+    } else if (pm->pending_head) {
+      nfc_pool_push_back(pool, pw->index, pm);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+// Detach queued requests of a member, pool mutex must be held
+static struct nfc_async_request *
+nfc_pool_member_detach(nfc_pool *pool, struct nfc_pool_member *pm)
+{
+  struct nfc_async_request *pnar = pm->pending_head;
+  pm->pending_head = NULL;
+  pm->pending_tail = NULL;
+  if (pm->queued_on >= 0)
+    nfc_pool_unlink(pool, pm);
+  return pnar;
+}
+
+// Complete detached requests with NFC_EOPABORTED, pool mutex must not be held
+static void
+nfc_pool_abort_requests(nfc_device *pnd, struct nfc_async_request *pnar)
+{
+  while (pnar) {
+    struct nfc_async_request *next = pnar->next;
+    if (pnar->cb) {
+      pnar->cb(pnd, NFC_EOPABORTED, pnar->user_data);
+    }
+    free(pnar);
+    pnar = next;
+  }
+}
+
+/** @ingroup async
+ * @brief Create a reader pool
+ * @return Returns a pool on success, otherwise returns \c NULL
+ *
+ * @param szThreads count of workers, 0 for one per online processor
+ *
+ * Devices added to the pool (see nfc_pool_add_device()) run requests submitted
+ * with nfc_pool_*() functions: requests of a device are run in submission
+ * order, requests of different devices run in parallel on the workers. A
+ * request keeps its worker busy until it completes, so long blocking requests
+ * (ie. endless polling) should be avoided when there are more devices than
+ * workers.
+ */
+nfc_pool *
+nfc_pool_new(size_t szThreads)
+{
+  if (szThreads == 0) {
+    long lCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    szThreads = (lCpus > 0) ? (size_t) lCpus : 1;
+  }
+  nfc_pool *pool = calloc(1, sizeof(nfc_pool));
+  if (!pool) {
+    return NULL;
+  }
+  pool->workers = calloc(szThreads, sizeof(struct nfc_pool_worker));
+  if (!pool->workers) {
+    free(pool);
+    return NULL;
+  }
+  pool->szWorkers = szThreads;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (size_t i = 0; i < szThreads; i++) {
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+    if (pthread_create(&(pool->workers[i].thread), NULL, nfc_pool_worker_run, &(pool->workers[i])) != 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to create worker thread");
+      nfc_pool_free(pool);
+      return NULL;
+    }
+    pool->szStarted++;
+  }
+  return pool;
+}
+
+/** @ingroup async
+ * @brief Stop workers and release a reader pool
+ *
+ * @param pool pool created by nfc_pool_new()
+ *
+ * Queued requests are completed with NFC_EOPABORTED error, running ones are
+ * aborted using nfc_abort_command(). Devices are removed from the pool but
+ * not closed.
+ */
+void
+nfc_pool_free(nfc_pool *pool)
+{
+  if (!pool) {
+    return;
+  }
+  pthread_mutex_lock(&pool->mutex);
+  pool->stop = true;
+  for (struct nfc_pool_member *pm = pool->members; pm; pm = pm->next_member) {
+    if (pm->running)
+      nfc_abort_command(pm->pnd);
+  }
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+  for (size_t i = 0; i < pool->szStarted; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+
+  while (pool->members) {
+    struct nfc_pool_member *pm = pool->members;
+    pool->members = pm->next_member;
+    nfc_pool_abort_requests(pm->pnd, nfc_pool_member_detach(pool, pm));
+    free(pm);
+  }
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->cond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->workers);
+  free(pool);
+}
+
+/** @ingroup async
+ * @brief Add a device to a reader pool
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pool pool created by nfc_pool_new()
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * A device belongs to one pool at most and should not be used with nfc_async_*() functions meanwhile.
+ */
+int
+nfc_pool_add_device(nfc_pool *pool, nfc_device *pnd)
+{
+  struct nfc_pool_member *pm = calloc(1, sizeof(struct nfc_pool_member));
+  if (!pm) {
+    return NFC_ESOFT;
+  }
+  pm->pnd = pnd;
+  pm->queued_on = -1;
+
+  pthread_mutex_lock(&pool->mutex);
+  if (nfc_pool_find(pool, pnd)) {
+    pthread_mutex_unlock(&pool->mutex);
+    free(pm);
+    return NFC_EINVARG;
+  }
+  pm->home = pool->next_home++ % pool->szWorkers;
+  pm->next_member = pool->members;
+  pool->members = pm;
+  pthread_mutex_unlock(&pool->mutex);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup async
+ * @brief Remove a device from a reader pool
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pool pool created by nfc_pool_new()
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Queued requests are completed with NFC_EOPABORTED error, the running one is
+ * aborted and waited for. The device can then be closed.
+ * @note It must not be called from a request callback of the same device.
+ */
+int
+nfc_pool_remove_device(nfc_pool *pool, nfc_device *pnd)
+{
+  pthread_mutex_lock(&pool->mutex);
+  struct nfc_pool_member *pm = nfc_pool_find(pool, pnd);
+  if ((!pm) || (pm->removed)) {
+    pthread_mutex_unlock(&pool->mutex);
+    return NFC_EINVARG;
+  }
+  pm->removed = true;
+  struct nfc_async_request *pnar = nfc_pool_member_detach(pool, pm);
+  if (pm->running)
+    nfc_abort_command(pnd);
+  while (pm->running)
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  // Members list may have changed while waiting
+  struct nfc_pool_member **ppm = &(pool->members);
+  while (*ppm != pm)
+    ppm = &((*ppm)->next_member);
+  *ppm = pm->next_member;
+  pthread_mutex_unlock(&pool->mutex);
+
+  nfc_pool_abort_requests(pnd, pnar);
+  free(pm);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup async
+ * @brief Cancel requests of a device of a reader pool
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pool pool created by nfc_pool_new()
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Queued requests are completed with NFC_EOPABORTED error, from calling
+ * thread. The running request, if any, is aborted using nfc_abort_command()
+ * when device supports it.
+ */
+int
+nfc_pool_cancel(nfc_pool *pool, nfc_device *pnd)
+{
+  int res = NFC_SUCCESS;
+  pthread_mutex_lock(&pool->mutex);
+  struct nfc_pool_member *pm = nfc_pool_find(pool, pnd);
+  if (!pm) {
+    pthread_mutex_unlock(&pool->mutex);
+    return NFC_EINVARG;
+  }
+  struct nfc_async_request *pnar = nfc_pool_member_detach(pool, pm);
+  if (pm->running)
+    res = nfc_abort_command(pnd);
+  pthread_mutex_unlock(&pool->mutex);
+
+  nfc_pool_abort_requests(pnd, pnar);
+  return res;
+}
+
+static int
+nfc_pool_submit(nfc_pool *pool, nfc_device *pnd, const struct nfc_async_request *pnarTemplate)
+{
+  struct nfc_async_request *pnar = malloc(sizeof(struct nfc_async_request));
+  if (!pnar) {
+    return NFC_ESOFT;
+  }
+  memcpy(pnar, pnarTemplate, sizeof(struct nfc_async_request));
+  pnar->res = NFC_SUCCESS;
+  pnar->next = NULL;
+
+  pthread_mutex_lock(&pool->mutex);
+  struct nfc_pool_member *pm = nfc_pool_find(pool, pnd);
+  if ((!pm) || (pm->removed) || (pool->stop)) {
+    pthread_mutex_unlock(&pool->mutex);
+    free(pnar);
+    return NFC_EINVARG;
+  }
+  if (pm->pending_tail) {
+    pm->pending_tail->next = pnar;
+  } else {
+    pm->pending_head = pnar;
+  }
+  pm->pending_tail = pnar;
+  if ((!pm->running) && (pm->queued_on < 0)) {
+    nfc_pool_push_back(pool, pm->home, pm);
+    pthread_cond_signal(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_select_passive_target() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_initiator_select_passive_target(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_initiator_select_passive_target(nfc_pool *pool, nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_SELECT_PASSIVE_TARGET, .nm = nm, .pbtTx = pbtInitData, .szTx = szInitData, .pnt = pnt, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_poll_target() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_initiator_poll_target(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_initiator_poll_target(nfc_pool *pool, nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_POLL_TARGET, .pnmModulations = pnmModulations, .szModulations = szModulations, .uiPollNr = uiPollNr, .uiPeriod = uiPeriod, .pnt = pnt, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_initiator_transceive_bytes() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_initiator_transceive_bytes(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_initiator_transceive_bytes(nfc_pool *pool, nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_INITIATOR_TRANSCEIVE_BYTES, .pbtTx = pbtTx, .szTx = szTx, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_init() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_target_init(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_target_init(nfc_pool *pool, nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_INIT, .pnt = pnt, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_send_bytes() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_target_send_bytes(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_target_send_bytes(nfc_pool *pool, nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_SEND_BYTES, .pbtTx = pbtTx, .szTx = szTx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/** @ingroup async
+ * @brief Submit a nfc_target_receive_bytes() request to a reader pool
+ * @return Returns 0 if request is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * Same as nfc_async_target_receive_bytes(), except \a cb is called from a worker of \a pool.
+ */
+int
+nfc_pool_target_receive_bytes(nfc_pool *pool, nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout, nfc_async_callback cb, void *user_data)
+{
+  struct nfc_async_request nar = { .op = NAO_TARGET_RECEIVE_BYTES, .pbtRx = pbtRx, .szRx = szRx, .timeout = timeout, .cb = cb, .user_data = user_data };
+  return nfc_pool_submit(pool, pnd, &nar);
+}
+
+/*
+ * Tap event stream
+ *
+ * A per-device thread polls for targets, waits for each of them to leave the
+ * field, and pushes arrival and removal events in a bounded ring (the MPMC
+ * queue of D. Vyukov, as the log ring). The application pops events without
+ * any lock, so detection never waits for application work; the stream mutex
+ * only paces the polling thread and wakes it up on stop.
+ */
+
+/** Polling pause of NFC_TAP_BACKPRESSURE, before checking the queue again */
+#define NFC_TAP_BACKPRESSURE_MS 10
+
+struct nfc_tap_cell {
+  size_t sequence;
+  nfc_tap_event event;
+};
+
+struct nfc_tap_stream {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  bool stop;
+  /** Polling thread is running a device command */
+  bool busy;
+  nfc_modulation *pnmModulations;
+  size_t szModulations;
+  uint8_t uiPeriod;
+  nfc_tap_overflow overflow;
+  struct nfc_tap_cell *ring;
+  size_t mask;
+  size_t enqueue_pos;
+  size_t dequeue_pos;
+  nfc_tap_stats stats;
+  /** Read end is readable when events may be waiting */
+  int event_fds[2];
+};
+
+#define TAP_DATA(pnd) ((struct nfc_tap_stream *)(pnd->tap_data))
+
+// Only called by the polling thread
+static bool
+nfc_tap_enqueue(struct nfc_tap_stream *pnts, const nfc_tap_event *pnte)
+{
+  const size_t pos = pnts->enqueue_pos;
+  struct nfc_tap_cell *cell = &pnts->ring[pos & pnts->mask];
+  if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != pos)
+    return false;
+  cell->event = *pnte;
+  __atomic_store_n(&pnts->enqueue_pos, pos + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Take the oldest event, from any thread; false when none is ready
+static bool
+nfc_tap_dequeue(struct nfc_tap_stream *pnts, nfc_tap_event *pnte)
+{
+  size_t pos = __atomic_load_n(&pnts->dequeue_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    struct nfc_tap_cell *cell = &pnts->ring[pos & pnts->mask];
+    const size_t seq = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    const intptr_t dif = (intptr_t) seq - (intptr_t)(pos + 1);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&pnts->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        if (pnte)
+          *pnte = cell->event;
+        __atomic_store_n(&cell->sequence, pos + pnts->mask + 1, __ATOMIC_RELEASE);
+        return true;
+      }
+    } else if (dif < 0) {
+      return false;
+    } else {
+      pos = __atomic_load_n(&pnts->dequeue_pos, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Wait up to ms milliseconds on the stream cond, returns true when stream is stopping
+static bool
+nfc_tap_pause(struct nfc_tap_stream *pnts, const int ms)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_lock(&pnts->mutex);
+  while (!pnts->stop) {
+    if (pthread_cond_timedwait(&pnts->cond, &pnts->mutex, &ts) == ETIMEDOUT)
+      break;
+  }
+  const bool bStop = pnts->stop;
+  pthread_mutex_unlock(&pnts->mutex);
+  return bStop;
+}
+
+// Queue an event according to the overflow policy, returns true when stream is stopping
+static bool
+nfc_tap_push(struct nfc_tap_stream *pnts, const nfc_tap_event_type type, const nfc_target *pnt)
+{
+  const nfc_tap_event nte = { .type = type, .timestamp_us = nfc_clock_us(), .nt = *pnt };
+  bool bStalled = false;
+  while (!nfc_tap_enqueue(pnts, &nte)) {
+    if ((pnts->overflow == NFC_TAP_DROP_OLDEST) && nfc_tap_dequeue(pnts, NULL)) {
+      __atomic_fetch_add(&pnts->stats.dropped, 1, __ATOMIC_RELAXED);
+    } else if (pnts->overflow == NFC_TAP_BACKPRESSURE) {
+      if (!bStalled) {
+        __atomic_fetch_add(&pnts->stats.stalls, 1, __ATOMIC_RELAXED);
+        bStalled = true;
+      }
+      if (nfc_tap_pause(pnts, NFC_TAP_BACKPRESSURE_MS))
+        return true;
+    } else {
+      // Oldest cell may still be read by a consumer: drop this one rather than wait
+      __atomic_fetch_add(&pnts->stats.dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+  }
+  __atomic_fetch_add(&pnts->stats.pushed, 1, __ATOMIC_RELAXED);
+  const size_t depth = pnts->enqueue_pos - __atomic_load_n(&pnts->dequeue_pos, __ATOMIC_RELAXED);
+  if (depth > __atomic_load_n(&pnts->stats.max_depth, __ATOMIC_RELAXED))
+    __atomic_store_n(&pnts->stats.max_depth, depth, __ATOMIC_RELAXED);
+  const uint8_t btEvent = 0x01;
+  if (write(pnts->event_fds[1], &btEvent, sizeof(btEvent)) < 0) {
+    // Pipe is already full: it is readable anyway
+  }
+  return false;
+}
+
+// Mark a device command as running, returns false when stream is stopping
+static bool
+nfc_tap_begin(struct nfc_tap_stream *pnts)
+{
+  pthread_mutex_lock(&pnts->mutex);
+  pnts->busy = !pnts->stop;
+  const bool bBusy = pnts->busy;
+  pthread_mutex_unlock(&pnts->mutex);
+  return bBusy;
+}
+
+static void
+nfc_tap_end(struct nfc_tap_stream *pnts)
+{
+  pthread_mutex_lock(&pnts->mutex);
+  pnts->busy = false;
+  pthread_mutex_unlock(&pnts->mutex);
+}
+
+// Whether the target is still in the field
+static bool
+nfc_tap_present(nfc_device *pnd, nfc_target *pnt)
+{
+  if (nfc_initiator_target_is_present(pnd, pnt) == NFC_SUCCESS)
+    return true;
+  // MIFARE Classic goes idle after an error answer: wake it up by its UID
+  nfc_target nt;
+  if ((pnt->nm.nmt == NMT_ISO14443A) && (nfc_initiator_reselect_target(pnd, pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, &nt) > 0)) {
+    *pnt = nt;
+    return true;
+  }
+  return false;
+}
+
+static void *
+nfc_tap_worker(void *arg)
+{
+  nfc_device *pnd = arg;
+  struct nfc_tap_stream *pnts = TAP_DATA(pnd);
+  const int period = pnts->uiPeriod * 150;
+
+  while (nfc_tap_begin(pnts)) {
+    nfc_target nt;
+    const int res = nfc_initiator_poll_target(pnd, pnts->pnmModulations, pnts->szModulations, 1, pnts->uiPeriod, &nt);
+    nfc_tap_end(pnts);
+    if (res == 0)
+      continue;
+    if (res < 0) {
+      if (res != NFC_EOPABORTED)
+        __atomic_fetch_add(&pnts->stats.errors, 1, __ATOMIC_RELAXED);
+      if (nfc_tap_pause(pnts, period))
+        break;
+      continue;
+    }
+    if (nfc_tap_push(pnts, NFC_TAP_ARRIVED, &nt))
+      break;
+    bool bPresent;
+    do {
+      if (nfc_tap_pause(pnts, period) || (!nfc_tap_begin(pnts)))
+        return NULL;
+      bPresent = nfc_tap_present(pnd, &nt);
+      nfc_tap_end(pnts);
+    } while (bPresent);
+    if (nfc_tap_push(pnts, NFC_TAP_REMOVED, &nt))
+      break;
+  }
+  return NULL;
+}
+
+/** @ingroup async
+ * @brief Start a polling thread pushing tap events of the device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnmModulations desired modulations, copied
+ * @param szModulations size of \a pnmModulations
+ * @param uiPeriod polling period in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s), also the presence check interval
+ * @param szQueue count of events the queue can hold, rounded up to a power of two
+ * @param overflow what to do with an event when the queue is full
+ *
+ * The thread polls with nfc_initiator_poll_target(), pushes a NFC_TAP_ARRIVED
+ * event for each target found, then checks its presence every period and
+ * pushes a NFC_TAP_REMOVED event once it left the field. Events are taken
+ * with nfc_tap_stream_pop() or nfc_tap_stream_wait(), from any thread and
+ * without lock: the polling thread never waits for the application, unless
+ * \a overflow is NFC_TAP_BACKPRESSURE.
+ *
+ * @note The device must have been initialized as initiator. Other requests
+ * still can be issued meanwhile, they are serialized with polling.
+ */
+int
+nfc_tap_stream_start(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPeriod, const size_t szQueue, const nfc_tap_overflow overflow)
+{
+  if ((!pnmModulations) || (szModulations == 0) || (uiPeriod < 0x01) || (uiPeriod > 0x0F) || (szQueue == 0) || (szQueue > (SIZE_MAX >> 2))) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (pnd->tap_data) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  size_t size = 1;
+  while (size < szQueue)
+    size <<= 1;
+  struct nfc_tap_stream *pnts = calloc(1, sizeof(struct nfc_tap_stream));
+  if (!pnts) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  pnts->ring = malloc(size * sizeof(struct nfc_tap_cell));
+  pnts->pnmModulations = malloc(szModulations * sizeof(nfc_modulation));
+  if ((!pnts->ring) || (!pnts->pnmModulations) || (pipe(pnts->event_fds) < 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to allocate tap stream");
+    free(pnts->pnmModulations);
+    free(pnts->ring);
+    free(pnts);
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  for (size_t i = 0; i < size; i++)
+    pnts->ring[i].sequence = i;
+  pnts->mask = size - 1;
+  memcpy(pnts->pnmModulations, pnmModulations, szModulations * sizeof(nfc_modulation));
+  pnts->szModulations = szModulations;
+  pnts->uiPeriod = uiPeriod;
+  pnts->overflow = overflow;
+  fcntl(pnts->event_fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(pnts->event_fds[1], F_SETFL, O_NONBLOCK);
+  pthread_mutex_init(&pnts->mutex, NULL);
+  pthread_cond_init(&pnts->cond, NULL);
+  pnd->tap_data = pnts;
+  if (pthread_create(&pnts->thread, NULL, nfc_tap_worker, pnd) != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to create polling thread");
+    pnd->tap_data = NULL;
+    pthread_cond_destroy(&pnts->cond);
+    pthread_mutex_destroy(&pnts->mutex);
+    close(pnts->event_fds[0]);
+    close(pnts->event_fds[1]);
+    free(pnts->pnmModulations);
+    free(pnts->ring);
+    free(pnts);
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  pnd->last_error = 0;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup async
+ * @brief Take the oldest tap event, without waiting
+ * @return Returns 1 when \a pnte is filled, 0 when no event is queued, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pnte event
+ */
+int
+nfc_tap_stream_pop(nfc_device *pnd, nfc_tap_event *pnte)
+{
+  struct nfc_tap_stream *pnts = TAP_DATA(pnd);
+  if (!pnts)
+    return NFC_EINVARG;
+  if (nfc_tap_dequeue(pnts, pnte))
+    return 1;
+  // Consume wake-ups before checking again, an event pushed later makes the fd readable
+  uint8_t abtEvents[32];
+  while (read(pnts->event_fds[0], abtEvents, sizeof(abtEvents)) > 0);
+  return nfc_tap_dequeue(pnts, pnte) ? 1 : 0;
+}
+
+/** @ingroup async
+ * @brief Take the oldest tap event, waiting for one if needed
+ * @return Returns 1 when \a pnte is filled, otherwise returns libnfc's error code (negative value), NFC_ETIMEOUT when none came in time
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pnte event
+ * @param timeout in milliseconds, 0 to wait forever
+ */
+int
+nfc_tap_stream_wait(nfc_device *pnd, nfc_tap_event *pnte, int timeout)
+{
+  const nfc_deadline deadline = nfc_deadline_from_timeout(timeout);
+  int res;
+  while ((res = nfc_tap_stream_pop(pnd, pnte)) == 0) {
+    const int left = nfc_deadline_timeout(deadline);
+    if (left < 0)
+      return left;
+    struct pollfd pfd = { .fd = TAP_DATA(pnd)->event_fds[0], .events = POLLIN };
+    if ((poll(&pfd, 1, (left == 0) ? -1 : left) < 0) && (errno != EINTR))
+      return NFC_ESOFT;
+  }
+  return res;
+}
+
+/** @ingroup async
+ * @brief Get a file descriptor becoming readable when tap events are queued
+ * @return Returns the file descriptor, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * @note This file descriptor must only be waited for, use nfc_tap_stream_pop() to take events. It is closed by nfc_tap_stream_stop().
+ */
+int
+nfc_tap_stream_get_fd(nfc_device *pnd)
+{
+  struct nfc_tap_stream *pnts = TAP_DATA(pnd);
+  if (!pnts)
+    return NFC_EINVARG;
+  return pnts->event_fds[0];
+}
+
+/** @ingroup async
+ * @brief Get counters of the tap stream
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pnts counters since nfc_tap_stream_start()
+ */
+int
+nfc_tap_stream_get_stats(nfc_device *pnd, nfc_tap_stats *pnts)
+{
+  struct nfc_tap_stream *stream = TAP_DATA(pnd);
+  if ((!stream) || (!pnts))
+    return NFC_EINVARG;
+  pnts->pushed = __atomic_load_n(&stream->stats.pushed, __ATOMIC_RELAXED);
+  pnts->dropped = __atomic_load_n(&stream->stats.dropped, __ATOMIC_RELAXED);
+  pnts->stalls = __atomic_load_n(&stream->stats.stalls, __ATOMIC_RELAXED);
+  pnts->errors = __atomic_load_n(&stream->stats.errors, __ATOMIC_RELAXED);
+  pnts->max_depth = __atomic_load_n(&stream->stats.max_depth, __ATOMIC_RELAXED);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup async
+ * @brief Stop the polling thread and drop queued tap events
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * A running poll is aborted using nfc_abort_command() when device supports it.
+ */
+int
+nfc_tap_stream_stop(nfc_device *pnd)
+{
+  if (!pnd->tap_data)
+    return NFC_EINVARG;
+  nfc_tap_stream_free(pnd);
+  return NFC_SUCCESS;
+}
+
+void
+nfc_tap_stream_free(nfc_device *pnd)
+{
+  struct nfc_tap_stream *pnts = TAP_DATA(pnd);
+  if (!pnts) {
+    return;
+  }
+  pthread_mutex_lock(&pnts->mutex);
+  pnts->stop = true;
+  if (pnts->busy) {
+    nfc_abort_command(pnd);
+  }
+  pthread_cond_signal(&pnts->cond);
+  pthread_mutex_unlock(&pnts->mutex);
+  pthread_join(pnts->thread, NULL);
+
+  pthread_cond_destroy(&pnts->cond);
+  pthread_mutex_destroy(&pnts->mutex);
+  close(pnts->event_fds[0]);
+  close(pnts->event_fds[1]);
+  free(pnts->pnmModulations);
+  free(pnts->ring);
+  free(pnts);
+  pnd->tap_data = NULL;
+}
+
+/*
+ * Tap correlation
+ *
+ * Overlapping antennas report the same card from several devices within a few
+ * milliseconds. Devices of a context claim the taps they see in a small table
+ * keyed by UID: the first one owns the tap, the others are told to skip their
+ * follow-up transactions while the card keeps being seen.
+ */
+
+/** Taps remembered at once, the least recently seen one is forgotten first */
+#define NFC_TAP_REGISTRY_LEN 64
+
+struct nfc_tap_claim_entry {
+  nfc_target nt;
+  const nfc_device *owner;
+  /** Last claim of the card by any device, 0 for a free entry */
+  uint64_t last_seen_us;
+  /** Last claim of the card by its owner */
+  uint64_t owner_seen_us;
+};
+
+struct nfc_tap_registry {
+  pthread_mutex_t mutex;
+  struct nfc_tap_claim_entry entries[NFC_TAP_REGISTRY_LEN];
+};
+
+// Registry of the context, allocated on first use
+static struct nfc_tap_registry *
+nfc_tap_registry_get(nfc_context *context)
+{
+  struct nfc_tap_registry *pntr = __atomic_load_n(&context->tap_registry, __ATOMIC_ACQUIRE);
+  if (pntr)
+    return pntr;
+  if (!(pntr = calloc(1, sizeof(struct nfc_tap_registry))))
+    return NULL;
+  pthread_mutex_init(&pntr->mutex, NULL);
+  struct nfc_tap_registry *expected = NULL;
+  if (!__atomic_compare_exchange_n(&context->tap_registry, &expected, pntr, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    // Another thread was first
+    nfc_tap_registry_free(pntr);
+    return expected;
+  }
+  return pntr;
+}
+
+/** @ingroup async
+ * @brief Claim the tap of a target found by a device, among all devices of its context
+ * @return Returns 1 when \a pnd owns the tap, 0 when another device owns it and
+ * \a pnd should skip its follow-up transaction, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represents the device which found the target
+ * @param pnt target found, e.g. by nfc_initiator_poll_target() or in a NFC_TAP_ARRIVED event
+ *
+ * The first device claiming a card owns its tap. The tap lasts as long as any
+ * device claims the card again within \e tap_dedupe_window ms (option, or
+ * LIBNFC_TAP_DEDUPE_WINDOW environment variable, 500 by default): claims by
+ * the owner return 1, claims by the other devices return 0. When the owner
+ * didn't claim the card during the window while another device did, the tap
+ * goes to the next device claiming it. A card no device claimed during the
+ * window makes a new tap.
+ * When the window is 0, every claim returns 1.
+ */
+int
+nfc_tap_claim(nfc_device *pnd, const nfc_target *pnt)
+{
+  if ((!pnd) || (!pnt))
+    return NFC_EINVARG;
+  nfc_context *context = (nfc_context *) pnd->context;
+  const uint64_t window_us = (uint64_t) context->tap_dedupe_window * 1000;
+  if (window_us == 0)
+    return 1;
+  struct nfc_tap_registry *pntr = nfc_tap_registry_get(context);
+  if (!pntr)
+    return NFC_ESOFT;
+
+  struct nfc_tap_claim_entry *pEntry = NULL;
+  struct nfc_tap_claim_entry *pOldest = &pntr->entries[0];
+  int res = 1;
+
+  pthread_mutex_lock(&pntr->mutex);
+  // Read under the lock so that entries are never seen in the future
+  const uint64_t now = nfc_clock_us();
+  for (size_t i = 0; i < NFC_TAP_REGISTRY_LEN; i++) {
+    struct nfc_tap_claim_entry *pe = &pntr->entries[i];
+    const bool bLive = (pe->last_seen_us != 0) && (now - pe->last_seen_us < window_us);
+    if (bLive && nfc_target_same_uid(&pe->nt, pnt)) {
+      pEntry = pe;
+      break;
+    }
+    if (pe->last_seen_us < pOldest->last_seen_us)
+      pOldest = pe;
+  }
+  if (pEntry && (pEntry->owner != pnd) && (now - pEntry->owner_seen_us >= window_us)) {
+    // The owner lost the card while another device kept seeing it: the tap moves over
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Tap handed over to %s", pnd->name);
+    pEntry->owner = pnd;
+  } else if (pEntry) {
+    res = (pEntry->owner == pnd) ? 1 : 0;
+  } else {
+    // Free and expired entries are the oldest ones
+    pEntry = pOldest;
+    pEntry->nt = *pnt;
+    pEntry->owner = pnd;
+  }
+  pEntry->last_seen_us = now;
+  if (res == 1)
+    pEntry->owner_seen_us = now;
+  pthread_mutex_unlock(&pntr->mutex);
+
+  if (res == 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Tap seen by %s is owned by another device", pnd->name);
+  return res;
+}
+
+void
+nfc_tap_registry_free(struct nfc_tap_registry *pntr)
+{
+  if (!pntr)
+    return;
+  pthread_mutex_destroy(&pntr->mutex);
+  free(pntr);
+}
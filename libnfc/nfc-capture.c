@@ -0,0 +1,205 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-capture.c
+ * @brief Binary capture of PN53x frames (pcapng)
+ *
+ * Every frame sent to or received from the chip is appended to a pcapng file
+ * as an Enhanced Packet Block with nanosecond timestamp. Each device gets its
+ * own Interface Description Block named after its connstring. Link type is
+ * LINKTYPE_USER0 (147): packet data starts with a 4 bytes header
+ * { direction (0: TX, 1: RX), TAMA command, status byte, 0 } followed by the
+ * TAMA frame payload (without preamble, length and checksum).
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+#include "nfc-capture.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.capture"
+
+volatile bool capture_active = false;
+
+#ifndef WIN32
+#include <pthread.h>
+
+#define PCAPNG_SHB_TYPE       0x0A0D0D0A
+#define PCAPNG_IDB_TYPE       0x00000001
+#define PCAPNG_EPB_TYPE       0x00000006
+#define PCAPNG_BYTE_ORDER     0x1A2B3C4D
+#define PCAPNG_LINKTYPE_USER0 147
+
+#define PCAPNG_OPT_ENDOFOPT   0
+#define PCAPNG_OPT_IF_NAME    2
+#define PCAPNG_OPT_IF_TSRESOL 9
+
+#define PCAPNG_PAD(len) (((len) + 3) & ~3)
+
+static FILE *capture_file = NULL;
+// Incremented each time a file is opened, so devices know their interface must be described again
+static unsigned int capture_generation = 0;
+static uint32_t capture_interface_count = 0;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+capture_write_shb(void)
+{
+  const uint32_t shb[7] = { PCAPNG_SHB_TYPE, 28, PCAPNG_BYTE_ORDER, 0x00000001, 0xFFFFFFFF, 0xFFFFFFFF, 28 };
+  fwrite(shb, sizeof(shb), 1, capture_file);
+}
+
+static void
+capture_write_idb(const nfc_connstring connstring)
+{
+  const size_t name_len = strlen(connstring);
+  const uint32_t len = 16 + 4 + PCAPNG_PAD(name_len) + 8 + 4 + 4;
+  const uint32_t header[2] = { PCAPNG_IDB_TYPE, len };
+  const uint16_t link_type[2] = { PCAPNG_LINKTYPE_USER0, 0 }; // LinkType, Reserved
+  const uint32_t snap_len = 0;
+  const uint16_t name_opt[2] = { PCAPNG_OPT_IF_NAME, (uint16_t) name_len };
+  const uint16_t tsresol_opt[2] = { PCAPNG_OPT_IF_TSRESOL, 1 };
+  const uint8_t tsresol[4] = { 9, 0, 0, 0 }; // 10^-9 s, then padding
+  const uint32_t trailer[2] = { PCAPNG_OPT_ENDOFOPT, len };
+  const uint8_t pad[3] = { 0, 0, 0 };
+
+  fwrite(header, sizeof(header), 1, capture_file);
+  fwrite(link_type, sizeof(link_type), 1, capture_file);
+  fwrite(&snap_len, sizeof(snap_len), 1, capture_file);
+  fwrite(name_opt, sizeof(name_opt), 1, capture_file);
+  fwrite(connstring, name_len, 1, capture_file);
+  fwrite(pad, PCAPNG_PAD(name_len) - name_len, 1, capture_file);
+  fwrite(tsresol_opt, sizeof(tsresol_opt), 1, capture_file);
+  fwrite(tsresol, sizeof(tsresol), 1, capture_file);
+  fwrite(trailer, sizeof(trailer), 1, capture_file);
+}
+
+int
+capture_start(const char *filename)
+{
+  pthread_mutex_lock(&capture_mutex);
+  if (capture_file) {
+    pthread_mutex_unlock(&capture_mutex);
+    return NFC_ESOFT;
+  }
+  if (!(capture_file = fopen(filename, "wb"))) {
+    pthread_mutex_unlock(&capture_mutex);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open capture file %s", filename);
+    return NFC_ESOFT;
+  }
+  capture_write_shb();
+  capture_generation++;
+  capture_interface_count = 0;
+  capture_active = true;
+  pthread_mutex_unlock(&capture_mutex);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Capturing frames to %s", filename);
+  return NFC_SUCCESS;
+}
+
+void
+capture_stop(void)
+{
+  pthread_mutex_lock(&capture_mutex);
+  capture_active = false;
+  if (capture_file) {
+    fclose(capture_file);
+    capture_file = NULL;
+  }
+  pthread_mutex_unlock(&capture_mutex);
+}
+
+void
+capture_frame(nfc_device *pnd, uint8_t direction, uint8_t command, uint8_t status, const uint8_t *frame, size_t len)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  const uint64_t timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+  const uint32_t captured_len = 4 + len;
+  const uint32_t block_len = 28 + PCAPNG_PAD(captured_len) + 4;
+
+  pthread_mutex_lock(&capture_mutex);
+  if (!capture_file) {
+    pthread_mutex_unlock(&capture_mutex);
+    return;
+  }
+  if (pnd->capture_generation != capture_generation) {
+    capture_write_idb(pnd->connstring);
+    pnd->capture_interface = capture_interface_count++;
+    pnd->capture_generation = capture_generation;
+  }
+  const uint32_t header[7] = {
+    PCAPNG_EPB_TYPE, block_len, pnd->capture_interface,
+    (uint32_t)(timestamp >> 32), (uint32_t) timestamp,
+    captured_len, captured_len
+  };
+  const uint8_t pseudo_header[4] = { direction, command, status, 0 };
+  const uint8_t pad[3] = { 0, 0, 0 };
+  fwrite(header, sizeof(header), 1, capture_file);
+  fwrite(pseudo_header, sizeof(pseudo_header), 1, capture_file);
+  fwrite(frame, len, 1, capture_file);
+  fwrite(pad, PCAPNG_PAD(captured_len) - captured_len, 1, capture_file);
+  fwrite(&block_len, sizeof(block_len), 1, capture_file);
+  pthread_mutex_unlock(&capture_mutex);
+}
+
+#else
+
+int
+capture_start(const char *filename)
+{
+  (void) filename;
+  return NFC_EDEVNOTSUPP;
+}
+
+void
+capture_stop(void)
+{
+}
+
+void
+capture_frame(nfc_device *pnd, uint8_t direction, uint8_t command, uint8_t status, const uint8_t *frame, size_t len)
+{
+  (void) pnd;
+  (void) direction;
+  (void) command;
+  (void) status;
+  (void) frame;
+  (void) len;
+}
+
+#endif // !WIN32
@@ -0,0 +1,56 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-capture.h
+ * @brief Binary capture of PN53x frames (pcapng)
+ */
+
+#ifndef __NFC_CAPTURE_H__
+#define __NFC_CAPTURE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <nfc/nfc-types.h>
+
+#define NFC_CAPTURE_TX 0x00
+#define NFC_CAPTURE_RX 0x01
+
+extern volatile bool capture_active;
+
+int   capture_start(const char *filename);
+void  capture_stop(void);
+void  capture_frame(nfc_device *pnd, uint8_t direction, uint8_t command, uint8_t status, const uint8_t *frame, size_t len);
+
+// Record a frame exchanged with the chip when a capture file is open
+#define CAPTURE_FRAME(pnd, direction, command, status, frame, len) do { \
+    if (capture_active) \
+      capture_frame(pnd, direction, command, status, frame, len); \
+  } while (0)
+
+#endif // __NFC_CAPTURE_H__
@@ -0,0 +1,451 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-desfire.c
+ * @brief Provide MIFARE DESFire EV1/EV2 commands on top of libnfc ISO14443-4 sessions
+ */
+
+/**
+ * @defgroup desfire  DESFire
+ * This page details how to talk to MIFARE DESFire EV1/EV2 cards.
+ *
+ * Commands are framed natively or wrapped in ISO7816-4 APDUs, answers split
+ * by the card in additional frames (0xAF) are gathered in the caller buffer, so
+ * a whole file is read with a single ReadData command.
+ * Once authenticated with an AES key (AuthenticateAES, EV1 secure messaging),
+ * answers are checked against their CMAC or deciphered and checked against
+ * their CRC32; AES runs on AES-NI or ARMv8 crypto extensions when available.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-desfire.h>
+
+#include "nfc-internal.h"
+#include "crypto-subr.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.desfire"
+
+// ISO7816-4 wrapping: CLA, INS, P1, P2, Lc and Le around the native command
+#define DESFIRE_ISO_CLA  0x90
+#define DESFIRE_ISO_OVERHEAD  6
+// Longest data field of a command frame
+#define DESFIRE_COMMAND_MAX_DATA  255
+// Trailer of an answer under secure messaging: CMAC, or CRC32 and padding
+#define DESFIRE_SM_OVERHEAD  (4 + AES128_BLOCK_LEN)
+#define DESFIRE_CMAC_LEN  8
+
+// Map a status code other than OK and additional frame to libnfc's error code
+static int
+desfire_status_error(nfc_desfire_session *pds)
+{
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Card status %02x", pds->ui8Status);
+  // The card drops its authentication on errors
+  pds->iKeyNo = -1;
+  return (pds->ui8Status == DESFIRE_AUTHENTICATION_ERROR) ? NFC_EMFCAUTHFAIL : NFC_ERFTRANS;
+}
+
+// Send one command frame and get one answer frame, its status in ui8Status and its data in pbtRx
+static int
+desfire_frame(nfc_desfire_session *pds, const uint8_t ui8Cmd, const uint8_t *pbtData, const size_t szData, uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t abtFrame[DESFIRE_ISO_OVERHEAD + DESFIRE_COMMAND_MAX_DATA];
+  uint8_t abtAnswer[ISO14443_4_FRAME_MAX_LEN + 2];
+  const uint8_t *pbtAnswerData;
+  size_t szFrame = 0;
+  int res;
+
+  if (szData > DESFIRE_COMMAND_MAX_DATA)
+    return NFC_EINVARG;
+  if (pds->bIsoWrapping) {
+    abtFrame[szFrame++] = DESFIRE_ISO_CLA;
+    abtFrame[szFrame++] = ui8Cmd;
+    abtFrame[szFrame++] = 0x00;
+    abtFrame[szFrame++] = 0x00;
+    if (szData) {
+      abtFrame[szFrame++] = (uint8_t) szData;
+      memcpy(abtFrame + szFrame, pbtData, szData);
+      szFrame += szData;
+    }
+    abtFrame[szFrame++] = 0x00;
+  } else {
+    abtFrame[szFrame++] = ui8Cmd;
+    if (szData)
+      memcpy(abtFrame + szFrame, pbtData, szData);
+    szFrame += szData;
+  }
+
+  if ((res = nfc_iso14443_4_transceive(&pds->iso, abtFrame, szFrame, abtAnswer, sizeof(abtAnswer))) < 0)
+    return res;
+  if (pds->bIsoWrapping) {
+    if (res < 2)
+      return NFC_ERFTRANS;
+    const uint8_t btSw1 = abtAnswer[res - 2];
+    const uint8_t btSw2 = abtAnswer[res - 1];
+    if (btSw1 == 0x91) {
+      pds->ui8Status = btSw2;
+    } else if ((btSw1 == 0x90) && (btSw2 == 0x00)) {
+      pds->ui8Status = DESFIRE_OPERATION_OK;
+    } else {
+      // ISO7816-4 error, eg. wrong length: keep SW2
+      pds->ui8Status = btSw2;
+      return desfire_status_error(pds);
+    }
+    pbtAnswerData = abtAnswer;
+    res -= 2;
+  } else {
+    if (res < 1)
+      return NFC_ERFTRANS;
+    pds->ui8Status = abtAnswer[0];
+    pbtAnswerData = abtAnswer + 1;
+    res -= 1;
+  }
+  if ((size_t) res > szRx)
+    return NFC_EOVFLOW;
+  memcpy(pbtRx, pbtAnswerData, res);
+  return res;
+}
+
+// Send a command and gather the answer frames the card announces with 0xAF
+static int
+desfire_exchange(nfc_desfire_session *pds, const uint8_t *pbtCmd, const size_t szCmd, uint8_t *pbtRx, const size_t szRx)
+{
+  size_t szReceived = 0;
+  uint8_t ui8Cmd = pbtCmd[0];
+  const uint8_t *pbtData = pbtCmd + 1;
+  size_t szData = szCmd - 1;
+  int res;
+
+  for (;;) {
+    if ((res = desfire_frame(pds, ui8Cmd, pbtData, szData, pbtRx + szReceived, szRx - szReceived)) < 0)
+      return res;
+    szReceived += res;
+    if (pds->ui8Status != DESFIRE_ADDITIONAL_FRAME)
+      break;
+    ui8Cmd = DESFIRE_ADDITIONAL_FRAME;
+    pbtData = NULL;
+    szData = 0;
+  }
+  if (pds->ui8Status != DESFIRE_OPERATION_OK)
+    return desfire_status_error(pds);
+  return szReceived;
+}
+
+// Decipher an answer in place and return the length of the data covered by its CRC32, szExpected being 0 when unknown
+static int
+desfire_decipher(nfc_desfire_session *pds, uint8_t *pbtRx, const size_t szRx, const size_t szExpected)
+{
+  const uint8_t btStatus = DESFIRE_OPERATION_OK;
+
+  if ((szRx == 0) || (szRx % AES128_BLOCK_LEN))
+    return NFC_ERFTRANS;
+  aes128_decrypt_cbc(pds->abtDecKeys, pds->abtIv, pbtRx, pbtRx, szRx / AES128_BLOCK_LEN);
+  // Data, CRC32 of data and status, then up to a block of zero padding
+  for (size_t szPad = 0; (szPad < AES128_BLOCK_LEN) && (szPad + 4 <= szRx); szPad++) {
+    const size_t szLen = szRx - 4 - szPad;
+    if ((szPad > 0) && (pbtRx[szRx - szPad] != 0x00))
+      break;
+    if ((szExpected != 0) && (szLen != szExpected))
+      continue;
+    const uint8_t *pbtCrc = pbtRx + szLen;
+    const uint32_t ui32Crc = crc32_update(crc32_update(0xffffffff, pbtRx, szLen), &btStatus, 1);
+    if (ui32Crc == (pbtCrc[0] | (pbtCrc[1] << 8) | (pbtCrc[2] << 16) | ((uint32_t) pbtCrc[3] << 24)))
+      return szLen;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Answer CRC32 mismatch");
+  pds->iKeyNo = -1;
+  return NFC_ERFTRANS;
+}
+
+// Run a command under secure messaging when authenticated, szExpected being the data length of an enciphered answer (0 when unknown)
+static int
+desfire_command(nfc_desfire_session *pds, const uint8_t *pbtCmd, const size_t szCmd, const nfc_desfire_comm_mode mode, const size_t szExpected, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+
+  if ((szCmd == 0) || (szCmd > 1 + DESFIRE_COMMAND_MAX_DATA))
+    return NFC_EINVARG;
+  if (pds->iKeyNo < 0)
+    return desfire_exchange(pds, pbtCmd, szCmd, pbtRx, szRx);
+
+  // Commands are not MACed but keep the IV of both sides in step
+  aes128_cmac(pds->abtEncKeys, pds->abtK1, pds->abtK2, pds->abtIv, pbtCmd, szCmd);
+
+  const size_t szBuf = szRx + DESFIRE_SM_OVERHEAD;
+  uint8_t *pbtBuf = malloc(szBuf);
+  if (!pbtBuf)
+    return NFC_ESOFT;
+  if ((res = desfire_exchange(pds, pbtCmd, szCmd, pbtBuf, szBuf)) >= 0) {
+    if (mode == DESFIRE_COMM_ENCIPHERED) {
+      res = desfire_decipher(pds, pbtBuf, res, szExpected);
+    } else if (res < DESFIRE_CMAC_LEN) {
+      res = NFC_ERFTRANS;
+    } else {
+      // CMAC covers data and status, the latter written over the received CMAC while computing
+      uint8_t abtCmac[DESFIRE_CMAC_LEN];
+      res -= DESFIRE_CMAC_LEN;
+      memcpy(abtCmac, pbtBuf + res, DESFIRE_CMAC_LEN);
+      pbtBuf[res] = DESFIRE_OPERATION_OK;
+      aes128_cmac(pds->abtEncKeys, pds->abtK1, pds->abtK2, pds->abtIv, pbtBuf, res + 1);
+      if (memcmp(abtCmac, pds->abtIv, DESFIRE_CMAC_LEN) != 0) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Answer CMAC mismatch");
+        pds->iKeyNo = -1;
+        res = NFC_ERFTRANS;
+      }
+    }
+  }
+  if ((res >= 0) && ((size_t) res > szRx))
+    res = NFC_EOVFLOW;
+  if (res >= 0)
+    memcpy(pbtRx, pbtBuf, res);
+  free(pbtBuf);
+  return res;
+}
+
+/** @ingroup desfire
+ * @brief Start a DESFire session with a selected target
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param pnt \a nfc_target selected ISO14443-4A target
+ * @param pds \a nfc_desfire_session struct pointer initialized by this function
+ * @param bIsoWrapping wrap native commands in ISO7816-4 APDUs (CLA 0x90)
+ *
+ * @see nfc_iso14443_4_open() for the device settings changed until nfc_desfire_close()
+ */
+int
+nfc_desfire_open(nfc_device *pnd, nfc_target *pnt, nfc_desfire_session *pds, const bool bIsoWrapping)
+{
+  int res;
+
+  if ((res = nfc_iso14443_4_open(pnd, pnt, &pds->iso)) < 0)
+    return res;
+  pds->bIsoWrapping = bIsoWrapping;
+  pds->ui8Status = DESFIRE_OPERATION_OK;
+  pds->iKeyNo = -1;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "AES %s", aes128_accelerated() ? "accelerated" : "in software");
+  return NFC_SUCCESS;
+}
+
+/** @ingroup desfire
+ * @brief Send a DESFire command and receive the whole answer
+ * @return Returns answer data length on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pds \a nfc_desfire_session struct pointer opened by nfc_desfire_open()
+ * @param pbtCmd native command: command code followed by its parameters
+ * @param szCmd length of \a pbtCmd
+ * @param mode communication mode of the answer, when authenticated
+ * @param[out] pbtRx answer data, without status, CMAC nor CRC32
+ * @param szRx size of \a pbtRx
+ *
+ * Additional frames are fetched until the card is done. When authenticated,
+ * the CMAC of plain and MACed answers is checked, enciphered answers are
+ * deciphered and their CRC32 checked.
+ * When the card answers an error status, it is kept in \a ui8Status and
+ * NFC_EMFCAUTHFAIL (authentication error) or NFC_ERFTRANS is returned.
+ */
+int
+nfc_desfire_transceive(nfc_desfire_session *pds, const uint8_t *pbtCmd, const size_t szCmd, const nfc_desfire_comm_mode mode, uint8_t *pbtRx, const size_t szRx)
+{
+  return desfire_command(pds, pbtCmd, szCmd, mode, 0, pbtRx, szRx);
+}
+
+/** @ingroup desfire
+ * @brief Select an application, 0 for the card level
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * The authentication is lost.
+ */
+int
+nfc_desfire_select_application(nfc_desfire_session *pds, const uint32_t ui32Aid)
+{
+  const uint8_t abtCmd[1 + DESFIRE_AID_LEN] = { DESFIRE_SELECT_APPLICATION, ui32Aid & 0xff, (ui32Aid >> 8) & 0xff, (ui32Aid >> 16) & 0xff };
+  uint8_t abtRx[1];
+  int res;
+
+  pds->iKeyNo = -1;
+  if ((res = desfire_exchange(pds, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx))) < 0)
+    return res;
+  return NFC_SUCCESS;
+}
+
+// Rotate a block left by one byte
+static void
+desfire_rotate_left(uint8_t *pbtDst, const uint8_t *pbtSrc)
+{
+  memcpy(pbtDst, pbtSrc + 1, AES128_BLOCK_LEN - 1);
+  pbtDst[AES128_BLOCK_LEN - 1] = pbtSrc[0];
+}
+
+/** @ingroup desfire
+ * @brief Authenticate with an AES key of the selected application (AuthenticateAES)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pds \a nfc_desfire_session struct pointer opened by nfc_desfire_open()
+ * @param ui8KeyNo key number
+ * @param pbtKey DESFIRE_AES_KEY_LEN bytes
+ *
+ * The session key is derived from both random numbers, following answers are
+ * checked with it until another application is selected or the card reports an error.
+ */
+int
+nfc_desfire_authenticate_aes(nfc_desfire_session *pds, const uint8_t ui8KeyNo, const uint8_t *pbtKey)
+{
+  uint8_t abtEncKeys[AES128_ROUND_KEYS_LEN], abtDecKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtRndA[AES128_BLOCK_LEN], abtRndB[AES128_BLOCK_LEN];
+  uint8_t abtToken[2 * AES128_BLOCK_LEN];
+  uint8_t abtAnswer[2 * AES128_BLOCK_LEN];
+  uint8_t abtSessionKey[AES128_KEY_LEN];
+  int res;
+
+  pds->iKeyNo = -1;
+  memset(pds->abtIv, 0x00, sizeof(pds->abtIv));
+  aes128_expand_key(pbtKey, abtEncKeys, abtDecKeys);
+  if (!crypto_random(abtRndA, sizeof(abtRndA))) {
+    res = NFC_ESOFT;
+    goto out;
+  }
+
+  // The card challenges us with its enciphered RndB
+  if ((res = desfire_frame(pds, DESFIRE_AUTHENTICATE_AES, &ui8KeyNo, 1, abtAnswer, sizeof(abtAnswer))) < 0)
+    goto out;
+  if (pds->ui8Status != DESFIRE_ADDITIONAL_FRAME) {
+    res = desfire_status_error(pds);
+    goto out;
+  }
+  if (res != AES128_BLOCK_LEN) {
+    res = NFC_ERFTRANS;
+    goto out;
+  }
+  aes128_decrypt_cbc(abtDecKeys, pds->abtIv, abtAnswer, abtRndB, 1);
+
+  // RndA followed by RndB rotated, the card answers RndA rotated
+  memcpy(abtToken, abtRndA, AES128_BLOCK_LEN);
+  desfire_rotate_left(abtToken + AES128_BLOCK_LEN, abtRndB);
+  aes128_encrypt_cbc(abtEncKeys, pds->abtIv, abtToken, abtToken, 2);
+  if ((res = desfire_frame(pds, DESFIRE_ADDITIONAL_FRAME, abtToken, sizeof(abtToken), abtAnswer, sizeof(abtAnswer))) < 0)
+    goto out;
+  if (pds->ui8Status != DESFIRE_OPERATION_OK) {
+    res = desfire_status_error(pds);
+    goto out;
+  }
+  if (res != AES128_BLOCK_LEN) {
+    res = NFC_ERFTRANS;
+    goto out;
+  }
+  aes128_decrypt_cbc(abtDecKeys, pds->abtIv, abtAnswer, abtAnswer, 1);
+  desfire_rotate_left(abtToken, abtRndA);
+  if (memcmp(abtAnswer, abtToken, AES128_BLOCK_LEN) != 0) {
+    res = NFC_EMFCAUTHFAIL;
+    goto out;
+  }
+
+  // Session key: RndA 0..3, RndB 0..3, RndA 12..15, RndB 12..15
+  memcpy(abtSessionKey, abtRndA, 4);
+  memcpy(abtSessionKey + 4, abtRndB, 4);
+  memcpy(abtSessionKey + 8, abtRndA + 12, 4);
+  memcpy(abtSessionKey + 12, abtRndB + 12, 4);
+  aes128_expand_key(abtSessionKey, pds->abtEncKeys, pds->abtDecKeys);
+  aes128_cmac_subkeys(pds->abtEncKeys, pds->abtK1, pds->abtK2);
+  memset(abtSessionKey, 0x00, sizeof(abtSessionKey));
+  memset(pds->abtIv, 0x00, sizeof(pds->abtIv));
+  pds->iKeyNo = ui8KeyNo;
+  res = NFC_SUCCESS;
+
+out:
+  memset(abtEncKeys, 0x00, sizeof(abtEncKeys));
+  memset(abtDecKeys, 0x00, sizeof(abtDecKeys));
+  memset(abtRndA, 0x00, sizeof(abtRndA));
+  memset(abtRndB, 0x00, sizeof(abtRndB));
+  return res;
+}
+
+/** @ingroup desfire
+ * @brief Get the hardware and software versions, UID and production data of the card
+ * @return Returns answer length (DESFIRE_VERSION_LEN) on success, otherwise returns libnfc's error code (negative value)
+ */
+int
+nfc_desfire_get_version(nfc_desfire_session *pds, uint8_t *pbtVersion, const size_t szVersion)
+{
+  const uint8_t abtCmd[1] = { DESFIRE_GET_VERSION };
+  return desfire_command(pds, abtCmd, sizeof(abtCmd), DESFIRE_COMM_PLAIN, 0, pbtVersion, szVersion);
+}
+
+/** @ingroup desfire
+ * @brief Read a standard or backup data file
+ * @return Returns read bytes count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pds \a nfc_desfire_session struct pointer opened by nfc_desfire_open()
+ * @param ui8FileNo file number
+ * @param ui32Offset first byte to read
+ * @param ui32Length bytes to read, 0 to read up to the end of the file
+ * @param mode communication mode of the file
+ * @param[out] pbtData data read
+ * @param szData size of \a pbtData
+ *
+ * The whole range is read with a single ReadData command, the card answer
+ * frames being gathered in \a pbtData.
+ */
+int
+nfc_desfire_read_data(nfc_desfire_session *pds, const uint8_t ui8FileNo, const uint32_t ui32Offset, const uint32_t ui32Length,
+                      const nfc_desfire_comm_mode mode, uint8_t *pbtData, const size_t szData)
+{
+  const uint8_t abtCmd[8] = {
+    DESFIRE_READ_DATA, ui8FileNo,
+    ui32Offset & 0xff, (ui32Offset >> 8) & 0xff, (ui32Offset >> 16) & 0xff,
+    ui32Length & 0xff, (ui32Length >> 8) & 0xff, (ui32Length >> 16) & 0xff
+  };
+
+  if ((ui32Offset > 0xffffff) || (ui32Length > 0xffffff) || (szData < ui32Length))
+    return NFC_EINVARG;
+  return desfire_command(pds, abtCmd, sizeof(abtCmd), mode, ui32Length, pbtData, szData);
+}
+
+/** @ingroup desfire
+ * @brief End a DESFire session
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pds \a nfc_desfire_session struct pointer opened by nfc_desfire_open()
+ * @param bDeselect send S(DESELECT) to put the target in HALT state
+ */
+int
+nfc_desfire_close(nfc_desfire_session *pds, const bool bDeselect)
+{
+  pds->iKeyNo = -1;
+  memset(pds->abtEncKeys, 0x00, sizeof(pds->abtEncKeys));
+  memset(pds->abtDecKeys, 0x00, sizeof(pds->abtDecKeys));
+  memset(pds->abtK1, 0x00, sizeof(pds->abtK1));
+  memset(pds->abtK2, 0x00, sizeof(pds->abtK2));
+  return nfc_iso14443_4_close(&pds->iso, bDeselect);
+}
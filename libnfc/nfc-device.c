@@ -39,13 +39,23 @@
 #include "nfc-internal.h"
 
 nfc_device *
-nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
+nfc_device_new(const nfc_context *context, const nfc_connstring connstring, const size_t szArena)
 {
-  nfc_device *res = malloc(sizeof(*res));
+  // Device and its arena in a single allocation
+  nfc_device *res = malloc(NFC_ARENA_ALIGN(sizeof(*res)) + szArena);
 
   if (!res) {
     return NULL;
   }
+  res->pbtArena = (uint8_t *) res + NFC_ARENA_ALIGN(sizeof(*res));
+  res->szArena = szArena;
+  res->szArenaUsed = 0;
+#ifndef WIN32
+  if (nfc_mutex_init_recursive(&(res->lock)) != 0) {
+    free(res);
+    return NULL;
+  }
+#endif
 
   // Store associated context
   res->context = context;
@@ -58,10 +68,19 @@ nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
   res->bPar = false;
   res->bEasyFraming    = false;
   res->bAutoIso14443_4 = false;
+  res->bAutoPps        = false;
   res->last_error  = 0;
   memcpy(res->connstring, connstring, sizeof(res->connstring));
   res->driver_data = NULL;
   res->chip_data   = NULL;
+  res->async_data  = NULL;
+  res->tap_data    = NULL;
+  res->capture_interface  = 0;
+  res->capture_generation = 0;
+  memset(&(res->stats), 0, sizeof(res->stats));
+  memset(&(res->poll_schedule), 0, sizeof(res->poll_schedule));
+  memset(&(res->target_cache), 0, sizeof(res->target_cache));
+  res->next_parked = NULL;
 
   return res;
 }
@@ -70,7 +89,63 @@ void
 nfc_device_free(nfc_device *dev)
 {
   if (dev) {
-    free(dev->driver_data);
+    nfc_device_release(dev, dev->driver_data);
+#ifndef WIN32
+    pthread_mutex_destroy(&(dev->lock));
+#endif
     free(dev);
   }
 }
+
+/*
+ * Per-device state (driver data, chip data, ...) comes from the arena
+ * reserved by nfc_device_new(): opening a device costs one allocation and
+ * closing it one free. Arena memory is only given back with the device. When
+ * the arena is too small the heap is used instead, nfc_device_release() tells
+ * them apart.
+ */
+void *
+nfc_device_alloc(nfc_device *pnd, const size_t szSize)
+{
+  const size_t szAligned = NFC_ARENA_ALIGN(szSize);
+  if (szAligned <= pnd->szArena - pnd->szArenaUsed) {
+    void *p = pnd->pbtArena + pnd->szArenaUsed;
+    pnd->szArenaUsed += szAligned;
+    return p;
+  }
+  return malloc(szSize);
+}
+
+void
+nfc_device_release(nfc_device *pnd, void *p)
+{
+  if (((uint8_t *) p >= pnd->pbtArena) && ((uint8_t *) p < pnd->pbtArena + pnd->szArena))
+    return;
+  free(p);
+}
+
+/*
+ * Every command of a device runs with its lock held (see HAL macro), so a
+ * device can be shared by threads. Lock is recursive: API functions built on
+ * other ones, and callbacks called while a command runs, can take it again.
+ * nfc_abort_command() does not take it.
+ */
+void
+nfc_device_lock(nfc_device *pnd)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&(pnd->lock));
+#else
+  (void) pnd;
+#endif
+}
+
+void
+nfc_device_unlock(nfc_device *pnd)
+{
+#ifndef WIN32
+  pthread_mutex_unlock(&(pnd->lock));
+#else
+  (void) pnd;
+#endif
+}
@@ -29,9 +29,17 @@
  * @brief Provide a small API to ease emulation in libnfc
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+
 #include <nfc/nfc.h>
 #include <nfc/nfc-emulation.h>
 
+#include "nfc-internal.h"
 #include "iso7816.h"
 
 /** @ingroup emulation
@@ -47,30 +55,496 @@
 int
 nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int timeout)
 {
-  uint8_t abtRx[ISO7816_SHORT_R_APDU_MAX_LEN];
-  uint8_t abtTx[ISO7816_SHORT_C_APDU_MAX_LEN];
+  // Extended-length APDUs come chained by the chip, they are too large for the stack
+  uint8_t *abtRx = malloc(ISO7816_EXTENDED_C_APDU_MAX_LEN + ISO7816_EXTENDED_R_APDU_MAX_LEN);
+  uint8_t *abtTx = abtRx + ISO7816_EXTENDED_C_APDU_MAX_LEN;
+  const size_t szRxLen = ISO7816_EXTENDED_C_APDU_MAX_LEN;
+  const size_t szTxLen = ISO7816_EXTENDED_R_APDU_MAX_LEN;
+
+  if (abtRx == NULL)
+    return NFC_ESOFT;
 
   int res;
-  if ((res = nfc_target_init(pnd, emulator->target, abtRx, sizeof(abtRx), timeout)) < 0) {
+  if ((res = nfc_target_init(pnd, emulator->target, abtRx, szRxLen, timeout)) < 0) {
+    free(abtRx);
     return res;
   }
 
   size_t szRx = res;
   int io_res = res;
   while (io_res >= 0) {
-    io_res = emulator->state_machine->io(emulator, abtRx, szRx, abtTx, sizeof(abtTx));
-    if (io_res > 0) {
-      if ((res = nfc_target_send_bytes(pnd, abtTx, io_res, timeout)) < 0) {
-        return res;
-      }
-    }
+    io_res = emulator->state_machine->io(emulator, abtRx, szRx, abtTx, szTxLen);
     if (io_res >= 0) {
-      if ((res = nfc_target_receive_bytes(pnd, abtRx, sizeof(abtRx), timeout)) < 0) {
+      // The answer and the wait for the next frame go to the device in one call
+      if (io_res > 0)
+        res = nfc_target_send_receive_bytes(pnd, abtTx, io_res, abtRx, szRxLen, timeout);
+      else
+        res = nfc_target_receive_bytes(pnd, abtRx, szRxLen, timeout);
+      if (res < 0) {
+        free(abtRx);
         return res;
       }
       szRx = res;
     }
   }
+  free(abtRx);
   return (io_res < 0) ? io_res : 0;
 }
 
+
+// Returned by the tag engines for commands the tag type does not define
+#define TAG_UNHANDLED -1
+
+#define TAG2_READ 0x30
+#define TAG2_HALT 0x50
+#define TAG2_READ_LEN 16
+
+#define TAG4_SELECT 0xA4
+#define TAG4_READ_BINARY 0xB0
+#define TAG4_UPDATE_BINARY 0xD6
+
+enum {
+  TAG4_NO_FILE = 0,
+  TAG4_CC_FILE,
+  TAG4_NDEF_FILE,
+};
+
+static const uint8_t tag4_ndef_application_name[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 };
+static const uint8_t tag4_cc_file_id[] = { 0xE1, 0x03 };
+static const uint8_t tag4_ndef_file_id[] = { 0xE1, 0x04 };
+static const uint8_t tag4_sw_ok[] = { 0x90, 0x00 };
+static const uint8_t tag4_sw_security[] = { 0x69, 0x82 };
+static const uint8_t tag4_sw_not_found[] = { 0x6A, 0x82 };
+static const uint8_t tag4_sw_wrong_p1p2[] = { 0x6B, 0x00 };
+static const uint8_t tag4_sw_ins_unsupported[] = { 0x6D, 0x00 };
+static const uint8_t tag4_sw_cla_unsupported[] = { 0x6E, 0x00 };
+
+// Precomputed answer: status word only
+static int
+tag4_sw(const uint8_t *pbtSw, const uint8_t **ppbtAnswer)
+{
+  *ppbtAnswer = pbtSw;
+  return 2;
+}
+
+// Type 2 READ: 16 bytes from the page, taken in place unless they roll over to page 0
+static int
+tag2_answer(struct nfc_emulation_tag *tag, const uint8_t *pbtRx, const size_t szRx, uint8_t *pbtTx, const uint8_t **ppbtAnswer)
+{
+  if ((szRx < 2) || (pbtRx[0] != TAG2_READ))
+    return TAG_UNHANDLED;
+  const size_t szOffset = (size_t) pbtRx[1] * 4;
+  if (szOffset >= tag->memory_len)
+    return 0;
+  if (szOffset + TAG2_READ_LEN <= tag->memory_len) {
+    *ppbtAnswer = tag->memory + szOffset;
+    return TAG2_READ_LEN;
+  }
+  size_t szCopied = 0;
+  while (szCopied < TAG2_READ_LEN) {
+    const size_t szFrom = (szOffset + szCopied) % tag->memory_len;
+    const size_t szChunk = MIN(TAG2_READ_LEN - szCopied, tag->memory_len - szFrom);
+    memcpy(pbtTx + szCopied, tag->memory + szFrom, szChunk);
+    szCopied += szChunk;
+  }
+  *ppbtAnswer = pbtTx;
+  return TAG2_READ_LEN;
+}
+
+// Type 4 file currently selected
+static const uint8_t *
+tag4_file(const struct nfc_emulation_tag *tag, size_t *pszFile)
+{
+  switch (tag->current_file) {
+    case TAG4_CC_FILE:
+      *pszFile = tag->cc_len;
+      return tag->cc;
+    case TAG4_NDEF_FILE:
+      *pszFile = tag->memory_len;
+      return tag->memory;
+  }
+  *pszFile = 0;
+  return NULL;
+}
+
+// Type 4 SELECT, READ BINARY and UPDATE BINARY on the image
+static int
+tag4_answer(struct nfc_emulation_tag *tag, const uint8_t *pbtRx, const size_t szRx, uint8_t *pbtTx, const size_t szTx, const uint8_t **ppbtAnswer)
+{
+  if (szRx < 4)
+    return TAG_UNHANDLED;
+  if (pbtRx[0] != 0x00)
+    return tag4_sw(tag4_sw_cla_unsupported, ppbtAnswer);
+
+  // Lc (or Le) field, short or extended
+  size_t szField = 0;
+  size_t szData = 5;
+  if (szRx > 4) {
+    szField = pbtRx[4];
+    if ((szField == 0) && (szRx >= 7)) {
+      szField = (pbtRx[5] << 8) | pbtRx[6];
+      szData = 7;
+    }
+  }
+
+  const size_t szOffset = (pbtRx[2] << 8) | pbtRx[3];
+  switch (pbtRx[1]) {
+    case TAG4_SELECT: {
+      if (szData + szField > szRx)
+        return tag4_sw(tag4_sw_wrong_p1p2, ppbtAnswer);
+      const uint8_t *pbtName = pbtRx + szData;
+      if (pbtRx[2] == 0x04) { // Select by name
+        const uint8_t *pbtAid = tag->aid ? tag->aid : tag4_ndef_application_name;
+        const size_t szAid = tag->aid ? tag->aid_len : sizeof(tag4_ndef_application_name);
+        tag->current_file = TAG4_NO_FILE;
+        if ((szField == szAid) && (0 == memcmp(pbtName, pbtAid, szAid)))
+          return tag4_sw(tag4_sw_ok, ppbtAnswer);
+        return tag4_sw(tag4_sw_not_found, ppbtAnswer);
+      }
+      if ((pbtRx[2] != 0x00) || (szField != 2))
+        return tag4_sw(tag4_sw_not_found, ppbtAnswer);
+      // Select by file identifier, the NDEF one is given by the NDEF File Control TLV of the CC
+      const uint8_t *pbtNdefId = (tag->cc_len >= 11) ? tag->cc + 9 : tag4_ndef_file_id;
+      if (0 == memcmp(pbtName, tag4_cc_file_id, 2)) {
+        tag->current_file = TAG4_CC_FILE;
+      } else if (0 == memcmp(pbtName, pbtNdefId, 2)) {
+        tag->current_file = TAG4_NDEF_FILE;
+      } else {
+        tag->current_file = TAG4_NO_FILE;
+        return tag4_sw(tag4_sw_not_found, ppbtAnswer);
+      }
+      return tag4_sw(tag4_sw_ok, ppbtAnswer);
+    }
+    case TAG4_READ_BINARY: {
+      size_t szFile;
+      const uint8_t *pbtFile = tag4_file(tag, &szFile);
+      if (pbtFile == NULL)
+        return tag4_sw(tag4_sw_not_found, ppbtAnswer);
+      if (szOffset >= szFile)
+        return tag4_sw(tag4_sw_wrong_p1p2, ppbtAnswer);
+      size_t szLe = szField;
+      if (szLe == 0)
+        szLe = (szData == 7) ? 65536 : 256;
+      szLe = MIN(MIN(szLe, szFile - szOffset), szTx - 2);
+      memcpy(pbtTx, pbtFile + szOffset, szLe);
+      memcpy(pbtTx + szLe, tag4_sw_ok, 2);
+      *ppbtAnswer = pbtTx;
+      return szLe + 2;
+    }
+    case TAG4_UPDATE_BINARY:
+      if (tag->current_file != TAG4_NDEF_FILE)
+        return tag4_sw((tag->current_file == TAG4_NO_FILE) ? tag4_sw_not_found : tag4_sw_security, ppbtAnswer);
+      if (tag->read_only)
+        return tag4_sw(tag4_sw_security, ppbtAnswer);
+      if ((szData + szField > szRx) || (szOffset + szField > tag->memory_len))
+        return tag4_sw(tag4_sw_wrong_p1p2, ppbtAnswer);
+      memcpy(tag->memory + szOffset, pbtRx + szData, szField);
+      return tag4_sw(tag4_sw_ok, ppbtAnswer);
+  }
+  return TAG_UNHANDLED;
+}
+
+/** @ingroup emulation
+ * @brief Emulate a NFC Forum tag from its memory image
+ * @return Returns 0 on success (Type 2 HALT or end of state machine), otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param pnt \a nfc_target to emulate (ISO14443-A, with SAK 0x20 for a Type 4 tag)
+ * @param tag \a nfc_emulation_tag image to answer from
+ * @param timeout in milliseconds
+ *
+ * Commands of the tag type are answered from the image without calling back
+ * the application. Other commands go to the optional \a tag->state_machine
+ * io(), as with nfc_emulate_target(); without one a Type 4 tag answers 6D00
+ * and a Type 2 tag stays mute.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_emulate_tag(nfc_device *pnd, nfc_target *pnt, struct nfc_emulation_tag *tag, const int timeout)
+{
+  if ((tag->memory == NULL) || (tag->memory_len == 0) ||
+      ((tag->type != NFC_EMULATION_TAG_TYPE_2) && (tag->type != NFC_EMULATION_TAG_TYPE_4)) ||
+      ((tag->type == NFC_EMULATION_TAG_TYPE_4) && (tag->cc == NULL)))
+    return NFC_EINVARG;
+
+  uint8_t *abtRx = malloc(ISO7816_EXTENDED_C_APDU_MAX_LEN + ISO7816_EXTENDED_R_APDU_MAX_LEN);
+  uint8_t *abtTx = abtRx + ISO7816_EXTENDED_C_APDU_MAX_LEN;
+  const size_t szRxLen = ISO7816_EXTENDED_C_APDU_MAX_LEN;
+  const size_t szTxLen = ISO7816_EXTENDED_R_APDU_MAX_LEN;
+
+  if (abtRx == NULL)
+    return NFC_ESOFT;
+
+  struct nfc_emulator emulator = {
+    .target = pnt,
+    .state_machine = tag->state_machine,
+    .user_data = tag->user_data,
+  };
+  tag->current_file = TAG4_NO_FILE;
+
+  int res;
+  if ((res = nfc_target_init(pnd, pnt, abtRx, szRxLen, timeout)) < 0) {
+    free(abtRx);
+    return res;
+  }
+
+  size_t szRx = res;
+  while (true) {
+    const uint8_t *pbtAnswer = abtTx;
+    int answer_res = 0;
+    if (szRx > 0) {
+      if ((tag->type == NFC_EMULATION_TAG_TYPE_2) && (abtRx[0] == TAG2_HALT))
+        break;
+      if (tag->type == NFC_EMULATION_TAG_TYPE_2)
+        answer_res = tag2_answer(tag, abtRx, szRx, abtTx, &pbtAnswer);
+      else
+        answer_res = tag4_answer(tag, abtRx, szRx, abtTx, szTxLen, &pbtAnswer);
+      if (answer_res == TAG_UNHANDLED) {
+        // Not a command of the tag type
+        pbtAnswer = abtTx;
+        if (tag->state_machine) {
+          answer_res = tag->state_machine->io(&emulator, abtRx, szRx, abtTx, szTxLen);
+          if (answer_res < 0) {
+            free(abtRx);
+            return answer_res;
+          }
+        } else if (tag->type == NFC_EMULATION_TAG_TYPE_4) {
+          answer_res = tag4_sw(tag4_sw_ins_unsupported, &pbtAnswer);
+        } else {
+          answer_res = 0;
+        }
+      }
+    }
+    if (answer_res > 0)
+      res = nfc_target_send_receive_bytes(pnd, pbtAnswer, answer_res, abtRx, szRxLen, timeout);
+    else
+      res = nfc_target_receive_bytes(pnd, abtRx, szRxLen, timeout);
+    if (res < 0) {
+      free(abtRx);
+      return res;
+    }
+    szRx = res;
+  }
+  free(abtRx);
+  return NFC_SUCCESS;
+}
+
+// Anticollision frames answered by nfc_emulate_uid() in host mode
+#define ISO14443A_REQA  0x26
+#define ISO14443A_WUPA  0x52
+#define ISO14443A_HLTA  0x50
+#define ISO14443A_SEL_CL1  0x93
+#define ISO14443A_NVB_ANTICOLL  0x20
+#define ISO14443A_NVB_SELECT  0x70
+#define ISO14443A_CT  0x88
+#define ISO14443A_SAK_CASCADE  0x04
+// First UID byte of the targets emulated by the PN53x anticollision
+#define PN53X_NFCID1T_FIRST  0x08
+// Raw frames received during the host anticollision
+#define EMULATE_UID_FRAME_MAX_LEN  264
+
+/** @ingroup emulation
+ * @brief Emulate an ISO14443-A target with any UID until the reader selects it
+ * @return Returns received bytes count of the first command after selection, otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param pnt \a nfc_target to emulate: ATQA, SAK and a 4 or 7 bytes UID
+ * @param[out] pbtRx first command of the reader once the target is selected, without CRC
+ * @param szRx size of \a pbtRx
+ * @param timeout in milliseconds, for the activation by the reader
+ *
+ * When the chip anticollision can answer for the UID (4 bytes starting with
+ * 0x08) it does so, and the target is selected on the first REQA. Other UIDs
+ * are answered by the host: the chip must first be activated once with its
+ * own UID, then REQA/WUPA, ANTICOLLISION and SELECT of each cascade level are
+ * answered from raw frames, which strict readers may find too slow.
+ *
+ * Either way the chip handles CRC again on return: the target goes on with
+ * nfc_target_receive_bytes() and nfc_target_send_bytes().
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_emulate_uid(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, const int timeout)
+{
+  const size_t szUid = pnt->nti.nai.szUidLen;
+  const uint8_t *pbtUid = pnt->nti.nai.abtUid;
+  nfc_target nt = *pnt;
+  uint8_t abtAtqa[2] = { pnt->nti.nai.abtAtqa[1], pnt->nti.nai.abtAtqa[0] };
+  uint8_t abtCl[2][5];
+  uint8_t abtSak[2][3];
+  uint8_t abtRx[EMULATE_UID_FRAME_MAX_LEN];
+  size_t szLevels = 1;
+  size_t szLevel = 0;
+  int res;
+
+  if ((pnt->nm.nmt != NMT_ISO14443A) || ((szUid != 4) && (szUid != 7)))
+    return NFC_EINVARG;
+  if ((szUid == 4) && (pbtUid[0] == PN53X_NFCID1T_FIRST))
+    return nfc_target_init(pnd, &nt, pbtRx, szRx, timeout);
+
+  // Cascade levels: 4 bytes UID, or cascade tag and 3 bytes then 4 bytes
+  if (szUid == 4) {
+    memcpy(abtCl[0], pbtUid, 4);
+  } else {
+    abtCl[0][0] = ISO14443A_CT;
+    memcpy(abtCl[0] + 1, pbtUid, 3);
+    memcpy(abtCl[1], pbtUid + 3, 4);
+    szLevels = 2;
+  }
+  for (size_t n = 0; n < szLevels; n++) {
+    abtCl[n][4] = abtCl[n][0] ^ abtCl[n][1] ^ abtCl[n][2] ^ abtCl[n][3];
+    abtSak[n][0] = (n + 1 < szLevels) ? ISO14443A_SAK_CASCADE : pnt->nti.nai.btSak;
+    iso14443a_crc_append(abtSak[n], 1);
+  }
+
+  // The chip anticollision runs once with its own UID before the host takes over
+  if ((res = nfc_target_init(pnd, &nt, abtRx, sizeof(abtRx), timeout)) < 0)
+    return res;
+  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0)
+    return res;
+
+  for (;;) {
+    const uint8_t *pbtTx = NULL;
+    size_t szTxBits = 0;
+    int iBits;
+
+    if ((iBits = nfc_target_receive_bits(pnd, abtRx, sizeof(abtRx), NULL)) < 0) {
+      res = iBits;
+      break;
+    }
+    if ((iBits == 7) && ((abtRx[0] == ISO14443A_REQA) || (abtRx[0] == ISO14443A_WUPA))) {
+      pbtTx = abtAtqa;
+      szTxBits = 16;
+      szLevel = 0;
+    } else if ((szLevel < szLevels) && (abtRx[0] == ISO14443A_SEL_CL1 + 2 * szLevel) && (iBits == 16) && (abtRx[1] == ISO14443A_NVB_ANTICOLL)) {
+      pbtTx = abtCl[szLevel];
+      szTxBits = 40;
+    } else if ((szLevel < szLevels) && (abtRx[0] == ISO14443A_SEL_CL1 + 2 * szLevel) && (iBits == 72) && (abtRx[1] == ISO14443A_NVB_SELECT) &&
+               (memcmp(abtRx + 2, abtCl[szLevel], 5) == 0)) {
+      pbtTx = abtSak[szLevel++];
+      szTxBits = 24;
+    } else if ((szLevel == szLevels) && (iBits >= 24) && !(iBits % 8)) {
+      const size_t szFrame = iBits / 8 - 2;
+      if (!iso14443a_crc_check(abtRx, szFrame + 2))
+        continue;
+      if (abtRx[0] == ISO14443A_HLTA) {
+        szLevel = 0;
+        continue;
+      }
+      if (szFrame > szRx) {
+        res = NFC_EOVFLOW;
+        break;
+      }
+      memcpy(pbtRx, abtRx, szFrame);
+      res = szFrame;
+      break;
+    }
+    if (pbtTx && ((res = nfc_target_send_bits(pnd, pbtTx, szTxBits, NULL)) < 0))
+      break;
+  }
+  nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true);
+  return res;
+}
+
+// FNV-1a hash of an AID
+static size_t
+dispatcher_hash(const uint8_t *pbtAid, const size_t szAid)
+{
+  uint32_t h = 2166136261u;
+  for (size_t n = 0; n < szAid; n++) {
+    h ^= pbtAid[n];
+    h *= 16777619u;
+  }
+  return h % NFC_EMULATION_DISPATCHER_SLOTS;
+}
+
+// Slot of the application registered with this AID, or the free slot where it would go
+static size_t
+dispatcher_slot(const struct nfc_emulation_dispatcher *ped, const uint8_t *pbtAid, const size_t szAid)
+{
+  size_t n = dispatcher_hash(pbtAid, szAid);
+  while (ped->slots[n]) {
+    if ((ped->slots[n]->aid_len == szAid) && (0 == memcmp(ped->slots[n]->aid, pbtAid, szAid)))
+      break;
+    n = (n + 1) % NFC_EMULATION_DISPATCHER_SLOTS;
+  }
+  return n;
+}
+
+static int
+dispatcher_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  struct nfc_emulation_dispatcher *ped = (struct nfc_emulation_dispatcher *)(emulator->state_machine->data);
+
+  if (data_in_len == 0)
+    return 0;
+
+  // SELECT by name switches to the application owning the AID, if any
+  if ((data_in_len >= 5) && (data_in[0] == 0x00) && (data_in[1] == TAG4_SELECT) && (data_in[2] == 0x04)) {
+    const size_t szAid = data_in[4];
+    ped->selected = NULL;
+    if ((szAid > 0) && (szAid <= NFC_EMULATION_AID_MAX_LEN) && (5 + szAid <= data_in_len))
+      ped->selected = ped->slots[dispatcher_slot(ped, data_in + 5, szAid)];
+    if (ped->selected == NULL) {
+      if (data_out_len < 2)
+        return NFC_EOVFLOW;
+      memcpy(data_out, tag4_sw_not_found, 2);
+      return 2;
+    }
+  }
+
+  if (ped->selected == NULL) {
+    if (data_out_len < 2)
+      return NFC_EOVFLOW;
+    memcpy(data_out, tag4_sw_ins_unsupported, 2);
+    return 2;
+  }
+
+  struct nfc_emulator application = {
+    .target = emulator->target,
+    .state_machine = ped->selected->state_machine,
+    .user_data = ped->selected->user_data,
+  };
+  return ped->selected->state_machine->io(&application, data_in, data_in_len, data_out, data_out_len);
+}
+
+/** @ingroup emulation
+ * @brief Initialize an empty ISO7816 application dispatcher
+ *
+ * @param ped \a nfc_emulation_dispatcher struct pointer
+ */
+void
+nfc_emulation_dispatcher_init(struct nfc_emulation_dispatcher *ped)
+{
+  memset(ped, 0x00, sizeof(*ped));
+  ped->state_machine.io = dispatcher_io;
+  ped->state_machine.data = ped;
+}
+
+/** @ingroup emulation
+ * @brief Register an application in a dispatcher
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param ped \a nfc_emulation_dispatcher struct pointer
+ * @param pea \a nfc_emulation_application to register, it must stay valid while the dispatcher is used
+ *
+ * The dispatcher is filled up to half of its slots so that lookups stay short.
+ */
+int
+nfc_emulation_dispatcher_add(struct nfc_emulation_dispatcher *ped, struct nfc_emulation_application *pea)
+{
+  if ((pea->aid_len == 0) || (pea->aid_len > NFC_EMULATION_AID_MAX_LEN) || (pea->state_machine == NULL))
+    return NFC_EINVARG;
+  if (ped->applications >= NFC_EMULATION_DISPATCHER_SLOTS / 2)
+    return NFC_EOVFLOW;
+  const size_t n = dispatcher_slot(ped, pea->aid, pea->aid_len);
+  if (ped->slots[n])
+    return NFC_EINVARG;
+  ped->slots[n] = pea;
+  ped->applications++;
+  return NFC_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-felica.c
+ * @brief Provide FeliCa commands on top of libnfc
+ */
+
+/**
+ * @defgroup felica  FeliCa
+ * This page details how to read FeliCa tags, eg. NFC Forum Type 3 Tags.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-felica.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.felica"
+
+#define FELICA_CHECK  0x06
+// LEN, response code, IDm, status flags 1 and 2, number of blocks
+#define FELICA_CHECK_RES_OVERHEAD  (1 + 1 + 8 + 2 + 1)
+
+// Poll the target again at 424 kbps, falling back to its current speed if it doesn't answer
+static int
+felica_upgrade_speed(nfc_device *pnd, nfc_target *pnt)
+{
+  const nfc_baud_rate *pnbr;
+  int res;
+
+  if ((pnt->nm.nbr != NBR_212) || (nfc_device_get_supported_baud_rate(pnd, NMT_FELICA, &pnbr) < 0))
+    return NFC_SUCCESS;
+  while ((*pnbr) && (*pnbr != NBR_424))
+    pnbr++;
+  if (!*pnbr)
+    return NFC_SUCCESS;
+
+  // SENSF_REQ restricted to the system code of the target
+  const uint8_t abtSensfReq[] = { 0x00, pnt->nti.nfi.abtSysCode[0], pnt->nti.nfi.abtSysCode[1], 0x01, 0x00 };
+  nfc_modulation nm = { .nmt = NMT_FELICA, .nbr = NBR_424 };
+  nfc_target nt;
+  if (((res = nfc_initiator_select_passive_target(pnd, nm, abtSensfReq, sizeof(abtSensfReq), &nt)) > 0) &&
+      (memcmp(nt.nti.nfi.abtId, pnt->nti.nfi.abtId, sizeof(nt.nti.nfi.abtId)) == 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Target switched to 424 kbps");
+    *pnt = nt;
+    return NFC_SUCCESS;
+  }
+  nm.nbr = NBR_212;
+  if ((res = nfc_initiator_select_passive_target(pnd, nm, abtSensfReq, sizeof(abtSensfReq), &nt)) <= 0)
+    return (res < 0) ? res : NFC_ETGRELEASED;
+  *pnt = nt;
+  return NFC_SUCCESS;
+}
+
+// One Check command of szBlocks blocks, answer copied to pbtData
+static int
+felica_check(nfc_device *pnd, const nfc_target *pnt, const uint16_t ui16ServiceCode, const uint16_t ui16Block, const size_t szBlocks, uint8_t *pbtData)
+{
+  // LEN, command, IDm, services count, service code, blocks count, up to 3 bytes per block
+  uint8_t abtCmd[1 + 1 + 8 + 1 + 2 + 1 + (3 * FELICA_CHECK_MAX_BLOCKS)];
+  uint8_t abtRx[FELICA_CHECK_RES_OVERHEAD + (FELICA_BLOCK_LEN * FELICA_CHECK_MAX_BLOCKS)];
+  size_t szCmd = 1;
+  int res;
+
+  abtCmd[szCmd++] = FELICA_CHECK;
+  memcpy(abtCmd + szCmd, pnt->nti.nfi.abtId, 8);
+  szCmd += 8;
+  abtCmd[szCmd++] = 1;
+  abtCmd[szCmd++] = ui16ServiceCode & 0xff;
+  abtCmd[szCmd++] = ui16ServiceCode >> 8;
+  abtCmd[szCmd++] = szBlocks;
+  for (size_t i = 0; i < szBlocks; i++) {
+    const uint16_t ui16 = ui16Block + i;
+    // Block list elements are 2 bytes long up to block 255
+    if (ui16 < 0x100) {
+      abtCmd[szCmd++] = 0x80;
+      abtCmd[szCmd++] = ui16;
+    } else {
+      abtCmd[szCmd++] = 0x00;
+      abtCmd[szCmd++] = ui16 & 0xff;
+      abtCmd[szCmd++] = ui16 >> 8;
+    }
+  }
+  abtCmd[0] = szCmd;
+
+  if ((res = nfc_initiator_transceive_bytes(pnd, abtCmd, szCmd, abtRx, sizeof(abtRx), -1)) < 0)
+    return res;
+  if ((res < FELICA_CHECK_RES_OVERHEAD - 1) || (abtRx[0] != res) || (abtRx[1] != FELICA_CHECK + 1) ||
+      (memcmp(abtRx + 2, pnt->nti.nfi.abtId, 8) != 0))
+    return NFC_EIO;
+  if (abtRx[10] || abtRx[11]) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Check status flags: %02x, %02x", abtRx[10], abtRx[11]);
+    return NFC_EIO;
+  }
+  if ((res != (int)(FELICA_CHECK_RES_OVERHEAD + (szBlocks * FELICA_BLOCK_LEN))) || (abtRx[12] != szBlocks))
+    return NFC_EIO;
+  memcpy(pbtData, abtRx + FELICA_CHECK_RES_OVERHEAD, szBlocks * FELICA_BLOCK_LEN);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup felica
+ * @brief Read consecutive blocks of a FeliCa service (Check)
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected FeliCa target, updated when it is polled again at a higher speed
+ * @param ui16ServiceCode service code, eg. \c FELICA_SERVICE_NDEF_READ
+ * @param ui16Block first block
+ * @param szBlocks number of blocks
+ * @param ui8MaxBlocks blocks the target accepts in one Check (eg. Nbr of Type 3 Tags attribute information block), 0 if unknown
+ * @param pbtData buffer receiving the blocks
+ * @param szData size of \a pbtData, at least \c FELICA_BLOCK_LEN * \a szBlocks
+ *
+ * Blocks are read with as few Check commands as \a ui8MaxBlocks and PN53x frames allow.
+ * When more than one Check is needed and the target was polled at 212 kbps, it is polled
+ * again at 424 kbps first: it keeps 424 kbps if it answers, and goes back to 212 kbps otherwise.
+ *
+ * @note Easy framing is disabled when it is enabled.
+ */
+int
+nfc_felica_check(nfc_device *pnd, nfc_target *pnt, const uint16_t ui16ServiceCode, const uint16_t ui16Block, const size_t szBlocks,
+                 const uint8_t ui8MaxBlocks, uint8_t *pbtData, const size_t szData)
+{
+  const size_t szMaxBlocks = ((ui8MaxBlocks == 0) || (ui8MaxBlocks > FELICA_CHECK_MAX_BLOCKS)) ? FELICA_CHECK_MAX_BLOCKS : ui8MaxBlocks;
+  int res = NFC_SUCCESS;
+
+  if ((pnt->nm.nmt != NMT_FELICA) || (szBlocks == 0) || (szData < szBlocks * FELICA_BLOCK_LEN) || (ui16Block + szBlocks > 0x10000))
+    return NFC_EINVARG;
+
+  nfc_device_lock(pnd);
+  if (pnd->bEasyFraming)
+    res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false);
+  if ((res == 0) && (szBlocks > szMaxBlocks))
+    res = felica_upgrade_speed(pnd, pnt);
+  for (size_t szDone = 0; (res == 0) && (szDone < szBlocks); szDone += szMaxBlocks) {
+    res = felica_check(pnd, pnt, ui16ServiceCode, ui16Block + szDone, MIN(szMaxBlocks, szBlocks - szDone), pbtData + (szDone * FELICA_BLOCK_LEN));
+  }
+  nfc_device_unlock(pnd);
+  return (res < 0) ? res : (int)(szBlocks * FELICA_BLOCK_LEN);
+}
@@ -29,13 +29,14 @@
 * @brief Provide some useful internal functions
 */
 
-#include <nfc/nfc.h>
-#include "nfc-internal.h"
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
+#include <nfc/nfc.h>
+#include <nfc/nfc-mifare.h>
+#include "nfc-internal.h"
+
 #ifdef CONFFILES
 #include "conf.h"
 #endif
@@ -43,6 +44,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#ifdef WIN32
+#  include <windows.h>
+#endif
 
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
 #define LOG_CATEGORY "libnfc.general"
@@ -69,6 +76,22 @@ string_as_boolean(const char *s, bool *value)
   }
 }
 
+#ifndef WIN32
+// Mutexes of devices and contexts can be taken again by the thread holding them, ie. from callbacks
+int
+nfc_mutex_init_recursive(pthread_mutex_t *mutex)
+{
+  pthread_mutexattr_t attr;
+  int res;
+  if ((res = pthread_mutexattr_init(&attr)) != 0)
+    return res;
+  if ((res = pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) == 0)
+    res = pthread_mutex_init(mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+  return res;
+}
+#endif
+
 nfc_context *
 nfc_context_new(void)
 {
@@ -77,10 +100,32 @@ nfc_context_new(void)
   if (!res) {
     return NULL;
   }
+#ifndef WIN32
+  if (nfc_mutex_init_recursive(&(res->lock)) != 0) {
+    free(res);
+    return NULL;
+  }
+#endif
 
   // Set default context values
   res->allow_autoscan = true;
   res->allow_intrusive_scan = false;
+  res->device_list_ttl = 0;
+  res->device_cache_size = 0;
+  res->parked_devices = NULL;
+  res->device_event_listeners = NULL;
+  res->capture_file = NULL;
+  res->capture_started = false;
+  res->mifare_key_cache_file = NULL;
+  res->mifare_key_cache = NULL;
+  res->rf_profile_file = NULL;
+  res->uart_scan_filter = NULL;
+  res->lazy_config = false;
+  res->config_devices_pending = false;
+  res->config_cache_file = NULL;
+  res->tap_dedupe_window = 500;
+  res->tap_registry = NULL;
+  memset(&(res->device_list_cache), 0, sizeof(res->device_list_cache));
 #ifdef DEBUG
   res->log_level = 3;
 #else
@@ -107,6 +152,21 @@ nfc_context_new(void)
 #endif // ENVVARS
 
 #ifdef CONFFILES
+#ifdef ENVVARS
+  // Honour LIBNFC_LOG_LEVEL while parsing configuration file too
+  envvar = getenv("LIBNFC_LOG_LEVEL");
+  if (envvar) {
+    res->log_level = atoi(envvar);
+    log_init(res);
+  }
+  // Configuration loading options are needed before configuration is loaded
+  envvar = getenv("LIBNFC_LAZY_CONFIG");
+  string_as_boolean(envvar, &(res->lazy_config));
+  envvar = getenv("LIBNFC_CONFIG_CACHE");
+  if (envvar && envvar[0]) {
+    res->config_cache_file = strdup(envvar);
+  }
+#endif // ENVVARS
   // Load options from configuration file (ie. /etc/nfc/libnfc.conf)
   conf_load(res);
 #endif // CONFFILES
@@ -117,11 +177,57 @@ nfc_context_new(void)
   envvar = getenv("LIBNFC_INTRUSIVE_SCAN");
   string_as_boolean(envvar, &(res->allow_intrusive_scan));
 
+  // Load "device list TTL" option
+  envvar = getenv("LIBNFC_DEVICE_LIST_TTL");
+  if (envvar) {
+    res->device_list_ttl = atoi(envvar);
+  }
+
+  // Load "device cache size" option
+  envvar = getenv("LIBNFC_DEVICE_CACHE_SIZE");
+  if (envvar) {
+    res->device_cache_size = atoi(envvar);
+  }
+
   // log level
   envvar = getenv("LIBNFC_LOG_LEVEL");
   if (envvar) {
     res->log_level = atoi(envvar);
   }
+
+  // Load "capture file" option
+  envvar = getenv("LIBNFC_CAPTURE_FILE");
+  if (envvar) {
+    free(res->capture_file);
+    res->capture_file = strdup(envvar);
+  }
+
+  // Load "MIFARE key cache" option
+  envvar = getenv("LIBNFC_MIFARE_KEY_CACHE");
+  if (envvar) {
+    free(res->mifare_key_cache_file);
+    res->mifare_key_cache_file = strdup(envvar);
+  }
+
+  // Load "RF profiles" option
+  envvar = getenv("LIBNFC_RF_PROFILES");
+  if (envvar) {
+    free(res->rf_profile_file);
+    res->rf_profile_file = strdup(envvar);
+  }
+
+  // Load "tap dedupe window" option
+  envvar = getenv("LIBNFC_TAP_DEDUPE_WINDOW");
+  if (envvar) {
+    res->tap_dedupe_window = atoi(envvar);
+  }
+
+  // Load "UART scan filter" option
+  envvar = getenv("LIBNFC_UART_SCAN_FILTER");
+  if (envvar) {
+    free(res->uart_scan_filter);
+    res->uart_scan_filter = strdup(envvar);
+  }
 #endif // ENVVARS
 
   // Initialize log before use it...
@@ -135,8 +241,18 @@ nfc_context_new(void)
 #endif
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "allow_autoscan is set to %s", (res->allow_autoscan) ? "true" : "false");
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "allow_intrusive_scan is set to %s", (res->allow_intrusive_scan) ? "true" : "false");
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device_list_ttl is set to %"PRIu32" ms", res->device_list_ttl);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device_cache_size is set to %"PRIu32, res->device_cache_size);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "capture_file is set to %s", (res->capture_file) ? res->capture_file : "none");
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "mifare_key_cache is set to %s", (res->mifare_key_cache_file) ? res->mifare_key_cache_file : "none");
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "rf_profiles is set to %s", (res->rf_profile_file) ? res->rf_profile_file : "none");
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "tap_dedupe_window is set to %"PRIu32" ms", res->tap_dedupe_window);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "uart_scan_filter is set to %s", (res->uart_scan_filter) ? res->uart_scan_filter : "none");
 
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%d device(s) defined by user", res->user_defined_device_count);
+  if (res->config_devices_pending) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "device definitions will be loaded when listing devices");
+  }
   for (uint32_t i = 0; i < res->user_defined_device_count; i++) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "  #%d name: \"%s\", connstring: \"%s\"", i, res->user_defined_devices[i].name, res->user_defined_devices[i].connstring);
   }
@@ -147,9 +263,102 @@ void
 nfc_context_free(nfc_context *context)
 {
   log_exit();
+  free(context->device_list_cache.connstrings);
+  free(context->capture_file);
+  free(context->mifare_key_cache_file);
+  free(context->rf_profile_file);
+  free(context->uart_scan_filter);
+  free(context->config_cache_file);
+  nfc_mifare_key_cache_close(context->mifare_key_cache);
+#ifndef WIN32
+  nfc_tap_registry_free(context->tap_registry);
+  pthread_mutex_destroy(&(context->lock));
+#endif
   free(context);
 }
 
+/** Monotonic time in µs */
+uint64_t
+nfc_clock_us(void)
+{
+#ifndef WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/** Wait \a ms milliseconds */
+void
+nfc_sleep_ms(const int ms)
+{
+  if (ms <= 0)
+    return;
+#ifndef WIN32
+  struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+  while ((nanosleep(&ts, &ts) != 0) && (errno == EINTR))
+    ;
+#else
+  Sleep(ms);
+#endif
+}
+
+/** Deadline of an operation starting now and lasting \a timeout ms, none when \a timeout is 0 or less */
+nfc_deadline
+nfc_deadline_from_timeout(const int timeout)
+{
+  if (timeout <= 0)
+    return NFC_DEADLINE_NONE;
+  return nfc_clock_us() + (uint64_t) timeout * 1000;
+}
+
+/**
+ * Time left before \a deadline, as a timeout for APIs still counting in ms:
+ * rounded up, 0 without deadline, NFC_ETIMEOUT once the deadline is passed.
+ */
+int
+nfc_deadline_timeout(const nfc_deadline deadline)
+{
+  if (deadline == NFC_DEADLINE_NONE)
+    return 0;
+  const uint64_t now = nfc_clock_us();
+  if (now >= deadline)
+    return NFC_ETIMEOUT;
+  const uint64_t left_ms = (deadline - now + 999) / 1000;
+  return (left_ms > INT_MAX) ? INT_MAX : (int) left_ms;
+}
+
+/*
+ * Time to spend polling a modulation type, out of \a period (ms): seldom hit
+ * types get a share of it down to a quarter when scheduling is adaptive.
+ */
+int
+nfc_poll_dwell(const nfc_device *pnd, const nfc_modulation_type nmt, const int period)
+{
+  const struct nfc_poll_schedule *pnps = &(pnd->poll_schedule);
+  if (!pnps->bAdaptive) {
+    return period;
+  }
+  for (size_t i = 0; i < pnps->szPriorities; i++) {
+    if (pnps->anmtPriorities[i] == nmt)
+      return period;
+  }
+  uint16_t uiMax = 0;
+  for (size_t i = 0; i < NFC_POLL_MODULATION_TYPES; i++) {
+    if (pnps->auiHits[i] > uiMax)
+      uiMax = pnps->auiHits[i];
+  }
+  if (uiMax == 0) {
+    return period;
+  }
+  const int dwell = (int)(((long) period * pnps->auiHits[nmt]) / uiMax);
+  return (dwell < period / 4) ? period / 4 : dwell;
+}
+
 void
 prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, size_t *pszInitiatorData)
 {
@@ -193,66 +402,160 @@ prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, siz
   }
 }
 
-int
-connstring_decode(const nfc_connstring connstring, const char *driver_name, const char *bus_name, char **pparam1, char **pparam2)
+// Ports probed at the same time during intrusive scans, each probe mostly waits for a timeout
+#define SCAN_WORKERS 8
+
+struct port_scan {
+  const nfc_context *context;
+  char **ports;
+  size_t szPorts;
+  nfc_port_probe probe;
+  nfc_connstring *results;
+  bool *found;
+  size_t szNext;
+  size_t szFound;
+  size_t szWanted;
+#ifndef WIN32
+  pthread_mutex_t lock;
+#endif
+};
+
+// Probe ports until none is left or enough devices were found
+static void *
+port_scan_worker(void *arg)
 {
-  if (driver_name == NULL) {
-    driver_name = "";
-  }
-  if (bus_name == NULL) {
-    bus_name = "";
+  struct port_scan *ps = arg;
+
+  for (;;) {
+    size_t i;
+#ifndef WIN32
+    pthread_mutex_lock(&(ps->lock));
+#endif
+    const bool done = (ps->szNext >= ps->szPorts) || (ps->szFound >= ps->szWanted);
+    i = ps->szNext++;
+#ifndef WIN32
+    pthread_mutex_unlock(&(ps->lock));
+#endif
+    if (done)
+      break;
+    const bool found = ps->probe(ps->context, ps->ports[i], ps->results[i]);
+#ifndef WIN32
+    pthread_mutex_lock(&(ps->lock));
+#endif
+    ps->found[i] = found;
+    if (found)
+      ps->szFound++;
+#ifndef WIN32
+    pthread_mutex_unlock(&(ps->lock));
+#endif
   }
-  int n = strlen(connstring) + 1;
-  char *param0 = malloc(n);
-  if (param0 == NULL) {
-    perror("malloc");
+  return NULL;
+}
+
+/*
+ * Probe the NULL terminated ports list with a few workers and keep the
+ * connstrings of the devices found, in ports order as a sequential scan would.
+ * Returns the number of devices found, NFC_ESOFT when the scan can't be set up.
+ */
+int
+nfc_scan_ports(const nfc_context *context, char **ports, nfc_port_probe probe, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  struct port_scan ps = {
+    .context = context,
+    .ports = ports,
+    .probe = probe,
+    .szWanted = connstrings_len,
+  };
+  size_t device_found = 0;
+
+  while (ports[ps.szPorts])
+    ps.szPorts++;
+  if ((ps.szPorts == 0) || (connstrings_len == 0))
     return 0;
-  }
-  char *param1 = malloc(n);
-  if (param1 == NULL) {
+  ps.results = malloc(ps.szPorts * sizeof(nfc_connstring));
+  ps.found = calloc(ps.szPorts, sizeof(bool));
+  if (!ps.results || !ps.found) {
     perror("malloc");
-    free(param0);
-    return 0;
+    free(ps.results);
+    free(ps.found);
+    return NFC_ESOFT;
   }
-  char *param2    = malloc(n);
-  if (param2 == NULL) {
-    perror("malloc");
-    free(param0);
-    free(param1);
-    return 0;
+
+#ifndef WIN32
+  pthread_t workers[SCAN_WORKERS];
+  size_t szWorkers = 0;
+  const int iErr = pthread_mutex_init(&(ps.lock), NULL);
+  if (iErr != 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to set up the ports scan: %s", strerror(iErr));
+    free(ps.results);
+    free(ps.found);
+    return NFC_ESOFT;
   }
+  // The calling thread is a worker too
+  while ((szWorkers < SCAN_WORKERS - 1) && (szWorkers + 1 < ps.szPorts) &&
+         (pthread_create(&workers[szWorkers], NULL, port_scan_worker, &ps) == 0))
+    szWorkers++;
+  port_scan_worker(&ps);
+  for (size_t n = 0; n < szWorkers; n++)
+    pthread_join(workers[n], NULL);
+  pthread_mutex_destroy(&(ps.lock));
+#else
+  port_scan_worker(&ps);
+#endif
 
-  char format[32];
-  snprintf(format, sizeof(format), "%%%i[^:]:%%%i[^:]:%%%i[^:]", n - 1, n - 1, n - 1);
-  int res = sscanf(connstring, format, param0, param1, param2);
+  for (size_t i = 0; (i < ps.szPorts) && (device_found < connstrings_len); i++) {
+    if (ps.found[i])
+      memcpy(connstrings[device_found++], ps.results[i], sizeof(nfc_connstring));
+  }
+  free(ps.results);
+  free(ps.found);
+  return (int) device_found;
+}
 
-  if (res < 1 || ((0 != strcmp(param0, driver_name)) &&
-                  (bus_name != NULL) &&
-                  (0 != strcmp(param0, bus_name)))) {
+/**
+ * @brief Split a connection string in place, without heap allocation
+ * @return Returns the number of fields found (driver or bus name, then up to two parameters), 0 if the name matches neither \a driver_name nor \a bus_name
+ *
+ * @param driver_name expected driver name, \c NULL accepts any name
+ * @param bus_name alternative name also accepted (e.g. "usb"), may be \c NULL
+ * @param pncf receives the fields, they point into its own buffer
+ */
+int
+connstring_parse(const nfc_connstring connstring, const char *driver_name, const char *bus_name, struct nfc_connstring_fields *pncf)
+{
+  char *field = pncf->buffer;
+  int res = 0;
+
+  strncpy(pncf->buffer, connstring, sizeof(pncf->buffer));
+  pncf->buffer[sizeof(pncf->buffer) - 1] = '\0';
+  pncf->name = NULL;
+  pncf->params[0] = NULL;
+  pncf->params[1] = NULL;
+
+  // Like sscanf("%[^:]:%[^:]:%[^:]"): an empty field ends the string, a fourth one is ignored
+  while ((res < 3) && (*field != '\0') && (*field != ':')) {
+    char *end = strchr(field, ':');
+    if (res == 0)
+      pncf->name = field;
+    else
+      pncf->params[res - 1] = field;
+    res++;
+    if (!end)
+      break;
+    *end = '\0';
+    field = end + 1;
+  }
+
+  if ((res >= 1) && (driver_name != NULL) && (0 != strcmp(pncf->name, driver_name)) &&
+      ((bus_name == NULL) || (0 != strcmp(pncf->name, bus_name)))) {
     // Driver name does not match.
     res = 0;
   }
-  if (pparam1 != NULL) {
-    if (res < 2) {
-      free(param1);
-      *pparam1 = NULL;
-    } else {
-      *pparam1 = param1;
-    }
-  } else {
-    free(param1);
-  }
-  if (pparam2 != NULL) {
-    if (res < 3) {
-      free(param2);
-      *pparam2 = NULL;
-    } else {
-      *pparam2 = param2;
-    }
-  } else {
-    free(param2);
-  }
-  free(param0);
+  if (res < 3)
+    pncf->params[1] = NULL;
+  if (res < 2)
+    pncf->params[0] = NULL;
+  pncf->count = res;
   return res;
 }
 
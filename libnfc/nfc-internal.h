@@ -35,6 +35,9 @@
 #include <stdbool.h>
 #include <err.h>
 #  include <sys/time.h>
+#ifndef WIN32
+#  include <pthread.h>
+#endif
 
 #include "nfc/nfc.h"
 
@@ -42,11 +45,14 @@
 
 /**
  * @macro HAL
- * @brief Execute corresponding driver function if exists.
+ * @brief Execute corresponding driver function if exists, holding the device lock.
  */
 #define HAL( FUNCTION, ... ) pnd->last_error = 0; \
-  if (pnd->driver->FUNCTION) { \
-    return pnd->driver->FUNCTION( __VA_ARGS__ ); \
+  if (NFC_DRIVER(pnd)->FUNCTION) { \
+    nfc_device_lock(pnd); \
+    const int hal_res = NFC_DRIVER(pnd)->FUNCTION( __VA_ARGS__ ); \
+    nfc_device_unlock(pnd); \
+    return hal_res; \
   } else { \
     pnd->last_error = NFC_EDEVNOTSUPP; \
     return false; \
@@ -83,6 +89,27 @@
   uint8_t buffer_name[size]; \
   size_t __##buffer_name##_n = 0
 
+/*
+ * Scratch buffer of a hot path: a stack array of size bytes, or with the
+ * low-stack profile (NFC_LOW_STACK) the workspace array it names, allocated
+ * along with the device. Calls nested on a device must name different
+ * workspace arrays. Use the size, not sizeof(buffer_name).
+ */
+#ifdef NFC_LOW_STACK
+#  define SCRATCH_INIT(buffer_name, size, workspace) \
+  uint8_t *const buffer_name = (workspace)
+#else
+#  define SCRATCH_INIT(buffer_name, size, workspace) \
+  uint8_t buffer_name[size]
+#endif /* NFC_LOW_STACK */
+
+/*
+ * Initialise a buffer named buffer_name of size bytes in a scratch buffer.
+ */
+#define BUFFER_INIT_SCRATCH(buffer_name, size, workspace) \
+  SCRATCH_INIT(buffer_name, size, workspace); \
+  size_t __##buffer_name##_n = 0
+
 /*
  * Create a wrapper for an existing buffer.
  * BEWARE!  It eats children!
@@ -130,7 +157,12 @@ struct nfc_driver {
   int (*initiator_init)(struct nfc_device *pnd);
   int (*initiator_init_secure_element)(struct nfc_device *pnd);
   int (*initiator_select_passive_target)(struct nfc_device *pnd,  const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
+  int (*initiator_select_passive_targets)(struct nfc_device *pnd,  const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target ant[], const size_t szTargets);
+  int (*initiator_inventory_iso14443a)(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+  int (*initiator_inventory_iso14443b)(struct nfc_device *pnd, const uint8_t ui8Afi, nfc_target ant[], const size_t szTargets);
+  int (*initiator_set_current_target)(struct nfc_device *pnd, const nfc_target *pnt);
   int (*initiator_poll_target)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t btPeriod, nfc_target *pnt);
+  int (*initiator_poll_target_stream)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPeriod, nfc_target_callback cb, void *user_data);
   int (*initiator_select_dep_target)(struct nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
   int (*initiator_deselect_target)(struct nfc_device *pnd);
   int (*initiator_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
@@ -147,6 +179,9 @@ struct nfc_driver {
 
   int (*device_set_property_bool)(struct nfc_device *pnd, const nfc_property property, const bool bEnable);
   int (*device_set_property_int)(struct nfc_device *pnd, const nfc_property property, const int value);
+  int (*device_begin_properties)(struct nfc_device *pnd);
+  int (*device_commit_properties)(struct nfc_device *pnd);
+  int (*device_set_rf_analog)(struct nfc_device *pnd, const nfc_rf_analog nra, const uint8_t *pbtSettings, const size_t szSettings);
   int (*get_supported_modulation)(struct nfc_device *pnd, const nfc_mode mode, const nfc_modulation_type **const supported_mt);
   int (*get_supported_baud_rate)(struct nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
   int (*device_get_information_about)(struct nfc_device *pnd, char **buf);
@@ -154,8 +189,32 @@ struct nfc_driver {
   int (*abort_command)(struct nfc_device *pnd);
   int (*idle)(struct nfc_device *pnd);
   int (*powerdown)(struct nfc_device *pnd);
+  int (*get_fd)(struct nfc_device *pnd);
+  /** Count bytes received from the device but not handed out yet, which get_fd doesn't tell about */
+  int (*get_pending)(struct nfc_device *pnd);
+  /** Check a device kept open by nfc_close() still answers and restore its default settings */
+  int (*resume)(struct nfc_device *pnd);
+  /** Send PPS to an ISO14443-4A target activated by the host, returns the new \a nfc_baud_rate */
+  int (*initiator_iso14443_4_pps)(struct nfc_device *pnd, const nfc_target *pnt);
+  /** Send an answer then wait for the next initiator frame, without returning to the caller in between */
+  int (*target_send_receive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+  /** Set raw framing up once for a run of initiator_transceive_bits(), see nfc_initiator_raw_session_begin() */
+  int (*initiator_raw_session_begin)(struct nfc_device *pnd);
+  int (*initiator_raw_session_end)(struct nfc_device *pnd);
+  /** Exchange an APDU with the secure element, switching to it only when needed, see nfc_initiator_sam_transceive_bytes() */
+  int (*initiator_sam_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
+  /** Optional, see nfc_initiator_transceive_bytes_batch(): frames are sent one by one when it is NULL */
+  int (*initiator_transceive_bytes_batch)(struct nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout);
 };
 
+#ifdef NFC_SINGLE_DRIVER
+// Single-driver build: every device belongs to this driver, calls to its hooks can be resolved at link time
+extern const struct nfc_driver NFC_SINGLE_DRIVER;
+#  define NFC_DRIVER(pnd) (&(NFC_SINGLE_DRIVER))
+#else
+#  define NFC_DRIVER(pnd) ((pnd)->driver)
+#endif /* NFC_SINGLE_DRIVER */
+
 #  define DEVICE_NAME_LENGTH  256
 #  define DEVICE_PORT_LENGTH  64
 
@@ -172,12 +231,92 @@ struct nfc_user_defined_device {
  * @brief NFC library context
  * Struct which contains internal options, references, pointers, etc. used by library
  */
+struct nfc_device_event_listener;
+
+#define NFC_POLL_MODULATION_TYPES (NMT_DEP + 1)
+
+#define NFC_TARGET_CACHE_LEN 8
+
+/**
+ * @struct nfc_target_cache
+ * @brief Recently activated ISO14443A targets, keyed by UID (see nfc_initiator_reselect_target())
+ */
+struct nfc_target_cache {
+  bool    bEnabled;
+  nfc_target ant[NFC_TARGET_CACHE_LEN];
+  /** Last activation "time" of each entry, 0 means empty */
+  uint32_t auiLastUse[NFC_TARGET_CACHE_LEN];
+  uint32_t uiClock;
+};
+
+/**
+ * @struct nfc_poll_schedule
+ * @brief Poll scheduling settings and statistics (see nfc_initiator_set_poll_schedule())
+ */
+struct nfc_poll_schedule {
+  /** Reorder modulations from recent hits and shorten dwell time of seldom ones */
+  bool    bAdaptive;
+  /** Modulation types always polled first */
+  nfc_modulation_type anmtPriorities[NFC_POLL_MODULATION_TYPES];
+  size_t  szPriorities;
+  /** Recent hits per modulation type, decaying at each hit */
+  uint16_t auiHits[NFC_POLL_MODULATION_TYPES];
+};
+
+/**
+ * @struct nfc_device_list_cache
+ * @brief Last nfc_list_devices() result, reused until it expires
+ */
+struct nfc_device_list_cache {
+  nfc_connstring *connstrings;
+  size_t count;
+  /** false when enumeration stopped because the caller's array was full */
+  bool complete;
+  struct timeval timestamp;
+  volatile bool valid;
+  /** true once an USB hotplug listener invalidates this cache */
+  bool usb_listening;
+};
+
 struct nfc_context {
   bool allow_autoscan;
   bool allow_intrusive_scan;
   uint32_t  log_level;
+  /** Lifetime (in ms) of the device list cache, 0 disables it */
+  uint32_t device_list_ttl;
+  /** Number of closed devices kept open for a fast nfc_open(), 0 disables it */
+  uint32_t device_cache_size;
+  /** Devices kept open by nfc_close(), most recently closed first */
+  struct nfc_device *parked_devices;
   struct nfc_user_defined_device user_defined_devices[MAX_USER_DEFINED_DEVICES];
   unsigned int user_defined_device_count;
+  struct nfc_device_event_listener *device_event_listeners;
+  struct nfc_device_list_cache device_list_cache;
+  /** pcapng file receiving every frame, NULL when capture is disabled */
+  char *capture_file;
+  bool capture_started;
+  /** MIFARE Classic key cache file, NULL when disabled */
+  char *mifare_key_cache_file;
+  /** Opened by nfc_context_mifare_key_cache() on first use */
+  struct nfc_mifare_key_cache *mifare_key_cache;
+  /** RF analog profiles file, written by nfc_initiator_calibrate_rf(), NULL when disabled */
+  char *rf_profile_file;
+  /** USB VID:PID list of the serial adapters probed by intrusive scans, NULL probes every port */
+  char *uart_scan_filter;
+  /** Defer loading device definitions until devices are listed */
+  bool lazy_config;
+  /** true while device definitions of a lazy configuration are not loaded yet */
+  bool config_devices_pending;
+  /** Compiled configuration cache file, NULL when disabled */
+  char *config_cache_file;
+  /** Time (in ms) during which a card seen again belongs to the same tap, see nfc_tap_claim(); 0 disables it */
+  uint32_t tap_dedupe_window;
+  /** Taps claimed by devices of this context, allocated by the first nfc_tap_claim() */
+  struct nfc_tap_registry *tap_registry;
+#ifndef WIN32
+  /** Serializes device scans, the device list cache and event listeners */
+  pthread_mutex_t lock;
+#endif
 };
 
 nfc_context *nfc_context_new(void);
@@ -206,21 +345,103 @@ struct nfc_device {
   /** Should the chip switch automatically activate ISO14443-4 when
       selecting tags supporting it? */
   bool    bAutoIso14443_4;
+  /** Should ISO14443-4A targets be switched to their highest bit rate with PPS? */
+  bool    bAutoPps;
   /** Supported modulation encoded in a byte */
   uint8_t  btSupportByte;
   /** Last reported error */
   int     last_error;
+  /** Asynchronous requests handling (see nfc-async.c) */
+  void   *async_data;
+  /** Tap event stream (see nfc_tap_stream_start()) */
+  void   *tap_data;
+  /** pcapng interface of this device in the current capture file (see nfc-capture.c) */
+  uint32_t capture_interface;
+  unsigned int capture_generation;
+  /** Activity counters (see nfc_device_get_stats()) */
+  nfc_device_stats stats;
+  /** nfc_initiator_poll_target() scheduling */
+  struct nfc_poll_schedule poll_schedule;
+  /** Recently activated targets */
+  struct nfc_target_cache target_cache;
+  /** Next device in nfc_context parked_devices list */
+  struct nfc_device *next_parked;
+#ifndef WIN32
+  /** Held while a command runs on this device (see nfc_device_lock()) */
+  pthread_mutex_t lock;
+#endif
+  /** Per-device state allocated along with the device (see nfc_device_alloc()) */
+  uint8_t *pbtArena;
+  size_t   szArena;
+  size_t   szArenaUsed;
 };
 
-nfc_device *nfc_device_new(const nfc_context *context, const nfc_connstring connstring);
+/** Size of an allocation from a device arena, rounded up so the next one stays aligned for any type */
+#define NFC_ARENA_ALIGN(sz) (((sz) + 15) & ~((size_t) 15))
+
+nfc_device *nfc_device_new(const nfc_context *context, const nfc_connstring connstring, const size_t szArena);
 void        nfc_device_free(nfc_device *dev);
+void       *nfc_device_alloc(nfc_device *pnd, const size_t szSize);
+void        nfc_device_release(nfc_device *pnd, void *p);
+void        nfc_device_lock(nfc_device *pnd);
+void        nfc_device_unlock(nfc_device *pnd);
+
+#ifndef WIN32
+int         nfc_mutex_init_recursive(pthread_mutex_t *mutex);
+#endif
+
+void        nfc_async_free(nfc_device *pnd);
+void        nfc_tap_stream_free(nfc_device *pnd);
+void        nfc_tap_registry_free(struct nfc_tap_registry *pntr);
+
+bool        nfc_target_same_uid(const nfc_target *pnt1, const nfc_target *pnt2);
+
+struct nfc_mifare_key_cache *nfc_context_mifare_key_cache(nfc_context *context);
+
+void        nfc_rf_profile_apply(nfc_device *pnd);
 
 void string_as_boolean(const char *s, bool *value);
 
 void iso14443_cascade_uid(const uint8_t abtUID[], const size_t szUID, uint8_t *pbtCascadedUID, size_t *pszCascadedUID);
 
+// Time slot number of a FeliCa Polling request letting cards answer in one of 16 slots
+#define FELICA_POLLING_TSN_16_SLOTS  0x0f
+
 void prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData, size_t *pszInitiatorData);
+int  nfc_poll_dwell(const nfc_device *pnd, const nfc_modulation_type nmt, const int period);
+
+uint64_t nfc_clock_us(void);
+void     nfc_sleep_ms(const int ms);
+
+/**
+ * Absolute monotonic time (see nfc_clock_us()) by which an operation must be
+ * completed. Layers hand deadlines down instead of timeouts, so an operation
+ * made of several reads or exchanges keeps a single time budget.
+ */
+typedef uint64_t nfc_deadline;
+/** Waits forever, like a 0 ms timeout */
+#define NFC_DEADLINE_NONE 0
+
+nfc_deadline nfc_deadline_from_timeout(const int timeout);
+int  nfc_deadline_timeout(const nfc_deadline deadline);
+
+/** Probes one port for a driver: returns true and fills \a connstring when a device answers */
+typedef bool (*nfc_port_probe)(const nfc_context *context, const char *port, nfc_connstring connstring);
+int  nfc_scan_ports(const nfc_context *context, char **ports, nfc_port_probe probe, nfc_connstring connstrings[], const size_t connstrings_len);
+
+/**
+ * @struct nfc_connstring_fields
+ * @brief Connection string split by connstring_parse(): driver (or bus) name, then up to two parameters
+ */
+struct nfc_connstring_fields {
+  char buffer[NFC_BUFSIZE_CONNSTRING];
+  const char *name;
+  /** Parameters, NULL when missing */
+  const char *params[2];
+  /** Number of fields found, as returned by connstring_parse() */
+  int count;
+};
 
-int connstring_decode(const nfc_connstring connstring, const char *driver_name, const char *bus_name, char **pparam1, char **pparam2);
+int connstring_parse(const nfc_connstring connstring, const char *driver_name, const char *bus_name, struct nfc_connstring_fields *pncf);
 
 #endif // __NFC_INTERNAL_H__
@@ -0,0 +1,340 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-iso14443-4.c
+ * @brief Provide an ISO14443-4 (ISO-DEP) block engine on top of libnfc
+ */
+
+/**
+ * @defgroup iso14443_4  ISO14443-4
+ * This page details how to exchange APDUs of any length with ISO14443-4A cards,
+ * eg. extended-length APDUs used by eMRTD or large DESFire file reads.
+ *
+ * The blocks are built by libnfc and sent raw (NP_EASY_FRAMING off), whether
+ * the card was activated by the chip (NP_AUTO_ISO14443_4 on) or not: libnfc
+ * then sends RATS itself. Frames use the largest size both sides accept,
+ * commands and answers are chained and waiting time extensions are answered.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-iso14443-4.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.iso14443-4"
+
+#ifndef WIN32
+#  include <time.h>
+#  define msleep(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = x / 1000; \
+    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <winbase.h>
+#  define msleep Sleep
+#endif
+
+#define ISO14443_4_RATS  0xe0
+// FSDI of ISO14443_4_FRAME_MAX_LEN
+#define ISO14443_4_FSDI  0x08
+// SAK bit telling the target is ISO14443-4 compliant
+#define ISO14443_4_SAK_COMPLIANT  0x20
+
+// Protocol control bytes, without CID nor NAD
+#define PCB_I  0x02
+#define PCB_I_CHAINING  0x10
+#define PCB_R_ACK  0xa2
+#define PCB_R_NAK  0xb2
+#define PCB_S_DESELECT  0xc2
+#define PCB_S_WTX  0xf2
+
+#define PCB_IS_I(pcb)  (((pcb) & 0xee) == PCB_I)
+#define PCB_IS_R_ACK(pcb)  (((pcb) & 0xf6) == PCB_R_ACK)
+#define PCB_IS_S_WTX(pcb)  (((pcb) & 0xf7) == PCB_S_WTX)
+
+// Retransmissions of a block before giving up
+#define ISO14443_4_RETRIES  2
+// Host wait on top of the card frame waiting time, in ms
+#define ISO14443_4_TIMEOUT_MARGIN  100
+
+static const uint16_t iso14443_4_fsc[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+// Frame waiting time in ms: 256 * 16 / fc * 2^FWI
+static int
+iso14443_4_fwt(const uint8_t ui8Fwi)
+{
+  return ((302 << ui8Fwi) + 999) / 1000;
+}
+
+// Read FSC, FWI and SFGI from the ATS (T0 onwards)
+static void
+iso14443_4_parse_ats(nfc_iso14443_4_session *pis, const uint8_t *pbtAts, const size_t szAts, uint8_t *pui8Sfgi)
+{
+  uint8_t ui8Fsci = 2;
+  uint8_t ui8Fwi = 4;
+
+  *pui8Sfgi = 0;
+  if (szAts > 0) {
+    size_t szPos = (pbtAts[0] & 0x10) ? 2 : 1;
+    ui8Fsci = pbtAts[0] & 0x0f;
+    if ((pbtAts[0] & 0x20) && (szPos < szAts)) {
+      ui8Fwi = pbtAts[szPos] >> 4;
+      *pui8Sfgi = pbtAts[szPos] & 0x0f;
+    }
+  }
+  // RFU values mean defaults
+  if (ui8Fwi == 0x0f)
+    ui8Fwi = 4;
+  if (*pui8Sfgi == 0x0f)
+    *pui8Sfgi = 0;
+  // Frames larger than 256 bytes don't fit a PN53x frame anyway
+  pis->szFsc = (ui8Fsci < sizeof(iso14443_4_fsc) / sizeof(iso14443_4_fsc[0])) ? iso14443_4_fsc[ui8Fsci] : ISO14443_4_FRAME_MAX_LEN;
+  pis->iFwt = iso14443_4_fwt(ui8Fwi);
+}
+
+// Send one block and get the answer, answering S(WTX) and recovering from transmission errors
+static int
+iso14443_4_exchange(nfc_iso14443_4_session *pis, const uint8_t *pbtBlock, const size_t szBlock, uint8_t *pbtFrame)
+{
+  uint8_t abtCtrl[2];
+  const uint8_t *pbtSend = pbtBlock;
+  size_t szSend = szBlock;
+  int iWait = pis->iFwt;
+  int iRetries = 0;
+  int res;
+
+  for (;;) {
+    res = nfc_initiator_transceive_bytes(pis->pnd, pbtSend, szSend, pbtFrame, ISO14443_4_FRAME_MAX_LEN, iWait + ISO14443_4_TIMEOUT_MARGIN);
+    if (iWait != pis->iFwt) {
+      // A waiting time extension only lasts for one answer
+      iWait = pis->iFwt;
+      nfc_device_set_property_int(pis->pnd, NP_TIMEOUT_COM, iWait);
+    }
+    if ((res == NFC_ERFTRANS) || (res == NFC_ETIMEOUT) || (res == 0)) {
+      if (++iRetries > ISO14443_4_RETRIES)
+        return (res == 0) ? NFC_ERFTRANS : res;
+      // A lost I-block is claimed with R(NAK), a lost R(ACK) is just sent again
+      if (PCB_IS_I(pbtBlock[0])) {
+        abtCtrl[0] = PCB_R_NAK | pis->btBlockNumber;
+        pbtSend = abtCtrl;
+        szSend = 1;
+      } else {
+        pbtSend = pbtBlock;
+        szSend = szBlock;
+      }
+      continue;
+    }
+    if (res < 0)
+      return res;
+    if (PCB_IS_S_WTX(pbtFrame[0]) && (res >= 2)) {
+      const uint8_t ui8Wtxm = pbtFrame[1] & 0x3f;
+      if ((ui8Wtxm == 0) || (ui8Wtxm > 59))
+        return NFC_ERFTRANS;
+      iWait = pis->iFwt * ui8Wtxm;
+      if ((res = nfc_device_set_property_int(pis->pnd, NP_TIMEOUT_COM, iWait)) < 0)
+        return res;
+      abtCtrl[0] = PCB_S_WTX;
+      abtCtrl[1] = ui8Wtxm;
+      pbtSend = abtCtrl;
+      szSend = 2;
+      continue;
+    }
+    if (PCB_IS_I(pbtBlock[0]) && PCB_IS_R_ACK(pbtFrame[0]) && ((pbtFrame[0] & 0x01) != pis->btBlockNumber)) {
+      // The card acknowledges the previous block: it missed this one
+      if (++iRetries > ISO14443_4_RETRIES)
+        return NFC_ERFTRANS;
+      pbtSend = pbtBlock;
+      szSend = szBlock;
+      continue;
+    }
+    return res;
+  }
+}
+
+// Give the device its framing back
+static int
+iso14443_4_restore(nfc_iso14443_4_session *pis, const int res)
+{
+  nfc_device_set_property_bool(pis->pnd, NP_EASY_FRAMING, pis->bEasyFraming);
+  return res;
+}
+
+/** @ingroup iso14443_4
+ * @brief Start an ISO14443-4 session with a selected ISO14443-4A target
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param pnt \a nfc_target selected target, its ATS is filled when libnfc sends RATS
+ * @param pis \a nfc_iso14443_4_session struct pointer initialized by this function
+ *
+ * When the target was activated by the chip (NP_AUTO_ISO14443_4 on) its ATS is
+ * reused, otherwise RATS is sent asking for frames up to ISO14443_4_FRAME_MAX_LEN,
+ * followed by PPS when NP_AUTO_PPS is set.
+ * This must be called before any other exchange with the target.
+ *
+ * @note The session turns NP_EASY_FRAMING off until nfc_iso14443_4_close() and
+ * sets NP_TIMEOUT_COM to the frame waiting time of the target.
+ */
+int
+nfc_iso14443_4_open(nfc_device *pnd, nfc_target *pnt, nfc_iso14443_4_session *pis)
+{
+  uint8_t ui8Sfgi;
+  int res;
+
+  if ((pnt->nm.nmt != NMT_ISO14443A) || !(pnt->nti.nai.btSak & ISO14443_4_SAK_COMPLIANT))
+    return NFC_EINVARG;
+
+  pis->pnd = pnd;
+  pis->btBlockNumber = 0;
+  pis->szFsd = ISO14443_4_FRAME_MAX_LEN;
+  pis->bEasyFraming = pnd->bEasyFraming;
+  if ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0)
+    return res;
+  if ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0)
+    return iso14443_4_restore(pis, res);
+
+  if (pnt->nti.nai.szAtsLen == 0) {
+    const uint8_t abtRats[2] = { ISO14443_4_RATS, ISO14443_4_FSDI << 4 };
+    uint8_t abtAts[ISO14443_4_FRAME_MAX_LEN];
+
+    if ((res = nfc_initiator_transceive_bytes(pnd, abtRats, sizeof(abtRats), abtAts, sizeof(abtAts), -1)) < 0)
+      return iso14443_4_restore(pis, res);
+    // TL counts itself
+    if ((res < 1) || (abtAts[0] != res) || ((size_t)(res - 1) > sizeof(pnt->nti.nai.abtAts)))
+      return iso14443_4_restore(pis, NFC_ERFTRANS);
+    pnt->nti.nai.szAtsLen = res - 1;
+    memcpy(pnt->nti.nai.abtAts, abtAts + 1, pnt->nti.nai.szAtsLen);
+    iso14443_4_parse_ats(pis, pnt->nti.nai.abtAts, pnt->nti.nai.szAtsLen, &ui8Sfgi);
+    // Start-up frame guard time the card needs after its ATS
+    if (ui8Sfgi)
+      msleep(iso14443_4_fwt(ui8Sfgi));
+    if (pnd->bAutoPps && NFC_DRIVER(pnd)->initiator_iso14443_4_pps) {
+      // PPS can only come first, a target refusing it stays at 106 kbps
+      nfc_device_lock(pnd);
+      res = NFC_DRIVER(pnd)->initiator_iso14443_4_pps(pnd, pnt);
+      nfc_device_unlock(pnd);
+      if (res < 0)
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "PPS failed (%d), staying at 106 kbps", res);
+    }
+  } else {
+    iso14443_4_parse_ats(pis, pnt->nti.nai.abtAts, pnt->nti.nai.szAtsLen, &ui8Sfgi);
+  }
+
+  if ((res = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, pis->iFwt)) < 0)
+    return iso14443_4_restore(pis, res);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "FSC %" PRIuPTR " bytes, FWT %d ms", pis->szFsc, pis->iFwt);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup iso14443_4
+ * @brief Send an APDU of any length and receive the whole answer
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pis \a nfc_iso14443_4_session struct pointer opened by nfc_iso14443_4_open()
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted
+ * @param szTx contains the length in bytes, up to extended-length APDUs
+ * @param[out] pbtRx response from the target, up to ISO14443_4_EXTENDED_R_APDU_MAX_LEN bytes
+ * @param szRx size of \a pbtRx
+ *
+ * The command is cut in I-blocks of the target FSC, and the answer gathered
+ * from the I-blocks chained by the target. Frame waiting time extensions
+ * requested by the target are granted, lost blocks sent again.
+ */
+int
+nfc_iso14443_4_transceive(nfc_iso14443_4_session *pis, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t abtBlock[ISO14443_4_FRAME_MAX_LEN];
+  uint8_t abtFrame[ISO14443_4_FRAME_MAX_LEN];
+  // PCB and CRC_A share the frame with the information field
+  const size_t szInf = pis->szFsc - 3;
+  size_t szSent = 0;
+  size_t szReceived = 0;
+  bool bChaining;
+  int res;
+
+  do {
+    const size_t szPart = ((szTx - szSent) < szInf) ? (szTx - szSent) : szInf;
+    bChaining = (szSent + szPart) < szTx;
+    abtBlock[0] = PCB_I | pis->btBlockNumber | ((bChaining) ? PCB_I_CHAINING : 0);
+    memcpy(abtBlock + 1, pbtTx + szSent, szPart);
+    if ((res = iso14443_4_exchange(pis, abtBlock, szPart + 1, abtFrame)) < 0)
+      return res;
+    szSent += szPart;
+    if (bChaining) {
+      if (!PCB_IS_R_ACK(abtFrame[0]))
+        return NFC_ERFTRANS;
+      pis->btBlockNumber ^= 0x01;
+    }
+  } while (bChaining);
+
+  for (;;) {
+    if (!PCB_IS_I(abtFrame[0]))
+      return NFC_ERFTRANS;
+    pis->btBlockNumber = (abtFrame[0] & 0x01) ^ 0x01;
+    if (szReceived + res - 1 > szRx)
+      return NFC_EOVFLOW;
+    memcpy(pbtRx + szReceived, abtFrame + 1, res - 1);
+    szReceived += res - 1;
+    if (!(abtFrame[0] & PCB_I_CHAINING))
+      break;
+    abtBlock[0] = PCB_R_ACK | pis->btBlockNumber;
+    if ((res = iso14443_4_exchange(pis, abtBlock, 1, abtFrame)) < 0)
+      return res;
+  }
+  return szReceived;
+}
+
+/** @ingroup iso14443_4
+ * @brief End an ISO14443-4 session
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pis \a nfc_iso14443_4_session struct pointer opened by nfc_iso14443_4_open()
+ * @param bDeselect send S(DESELECT) to put the target in HALT state
+ */
+int
+nfc_iso14443_4_close(nfc_iso14443_4_session *pis, const bool bDeselect)
+{
+  int res = NFC_SUCCESS;
+
+  if (bDeselect) {
+    const uint8_t abtDeselect[1] = { PCB_S_DESELECT };
+    uint8_t abtFrame[ISO14443_4_FRAME_MAX_LEN];
+    if ((res = nfc_initiator_transceive_bytes(pis->pnd, abtDeselect, sizeof(abtDeselect), abtFrame, sizeof(abtFrame), pis->iFwt + ISO14443_4_TIMEOUT_MARGIN)) > 0)
+      res = NFC_SUCCESS;
+  }
+  return iso14443_4_restore(pis, res);
+}
@@ -0,0 +1,1107 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-llcp.c
+ * @brief Provide an LLCP link layer and a SNEP client/server on top of D.E.P.
+ */
+
+/**
+ * @defgroup llcp  LLCP and SNEP
+ * This page details how to run NFC Forum peer-to-peer services over a D.E.P. link.
+ *
+ * The LLCP parameters travel in the D.E.P. general bytes: nfc_llcp_general_bytes()
+ * fills the ones given to nfc_initiator_select_dep_target() or nfc_target_init(),
+ * nfc_llcp_link_activate() reads the peer ones. The link then runs one symmetric
+ * exchange per nfc_llcp_link_service() call.
+ *
+ * Outgoing PDUs come from a fixed pool inside the link, nothing is allocated
+ * per packet. All the PDUs ready to go share one D.E.P. frame (AGF), a lone PDU
+ * is sent right from its pool buffer and received SDUs are handed to callbacks
+ * straight from the receive frame.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-llcp.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.llcp"
+
+static const uint8_t llcp_magic[3] = { 0x46, 0x66, 0x6d };
+
+#define LLCP_VERSION  0x11
+#define LLCP_MIU_DEFAULT  128
+// Link timeout offered to the peer, in units of 10 ms
+#define LLCP_LTO  100
+// Receive window offered to the peer, SDUs are delivered as they come
+#define LLCP_RW  15
+// Link management and service discovery
+#define LLCP_WKS  0x0003
+// Connectionless and connection-oriented transports
+#define LLCP_LSC  0x03
+// First SAP handed to outgoing connections
+#define LLCP_SAP_CLIENT  32
+
+// PDU types
+#define PTYPE_SYMM  0x00
+#define PTYPE_PAX  0x01
+#define PTYPE_AGF  0x02
+#define PTYPE_UI  0x03
+#define PTYPE_CONNECT  0x04
+#define PTYPE_DISC  0x05
+#define PTYPE_CC  0x06
+#define PTYPE_DM  0x07
+#define PTYPE_FRMR  0x08
+#define PTYPE_I  0x0c
+#define PTYPE_RR  0x0d
+#define PTYPE_RNR  0x0e
+
+// Parameter types
+#define TLV_VERSION  0x01
+#define TLV_MIUX  0x02
+#define TLV_WKS  0x03
+#define TLV_LTO  0x04
+#define TLV_RW  0x05
+#define TLV_SN  0x06
+#define TLV_OPT  0x07
+
+// DM reasons
+#define DM_DISCONNECTED  0x00
+#define DM_NO_CONNECTION  0x01
+#define DM_NO_SERVICE  0x02
+#define DM_REJECTED  0x03
+
+#define LLCP_DSAP(pbt)  ((pbt)[0] >> 2)
+#define LLCP_PTYPE(pbt)  ((((pbt)[0] & 0x03) << 2) | ((pbt)[1] >> 6))
+#define LLCP_SSAP(pbt)  ((pbt)[1] & 0x3f)
+
+#define SNEP_VERSION  0x10
+#define SNEP_HEADER_LEN  6
+#define SNEP_REQUEST_GET  0x01
+#define SNEP_REQUEST_PUT  0x02
+#define SNEP_RESPONSE_CONTINUE  0x80
+#define SNEP_RESPONSE_SUCCESS  0x81
+#define SNEP_RESPONSE_BAD_REQUEST  0xc2
+#define SNEP_RESPONSE_NOT_IMPLEMENTED  0xe0
+#define SNEP_RESPONSE_UNSUPPORTED_VERSION  0xe1
+#define SNEP_RESPONSE_REJECT  0xff
+// Link exchanges without any PDU from the peer before a SNEP client gives up
+#define SNEP_IDLE_TURNS  500
+
+typedef struct {
+  uint8_t  ui8Version;
+  uint16_t ui16Miux;
+  uint16_t ui16Wks;
+  uint8_t  ui8Lto;
+  uint8_t  ui8Rw;
+  const uint8_t *pbtSn;
+  size_t   szSn;
+} llcp_params;
+
+// Read parameter TLVs, unknown ones are skipped, a truncated one is an error
+static int
+llcp_parse_params(const uint8_t *pbt, size_t sz, llcp_params *pp)
+{
+  pp->ui8Version = 0;
+  pp->ui16Miux = 0;
+  pp->ui16Wks = 0x0001;
+  pp->ui8Lto = 0;
+  pp->ui8Rw = 1;
+  pp->pbtSn = NULL;
+  pp->szSn = 0;
+
+  while (sz > 0) {
+    if (sz < 2)
+      return NFC_ERFTRANS;
+    const uint8_t *pbtValue = pbt + 2;
+    const size_t szValue = pbt[1];
+    if (szValue + 2 > sz)
+      return NFC_ERFTRANS;
+    switch (pbt[0]) {
+      case TLV_VERSION:
+        if (szValue == 1)
+          pp->ui8Version = pbtValue[0];
+        break;
+      case TLV_MIUX:
+        if (szValue == 2)
+          pp->ui16Miux = ((pbtValue[0] << 8) | pbtValue[1]) & 0x07ff;
+        break;
+      case TLV_WKS:
+        if (szValue == 2)
+          pp->ui16Wks = (pbtValue[0] << 8) | pbtValue[1];
+        break;
+      case TLV_LTO:
+        if (szValue == 1)
+          pp->ui8Lto = pbtValue[0];
+        break;
+      case TLV_RW:
+        if (szValue == 1)
+          pp->ui8Rw = pbtValue[0] & 0x0f;
+        break;
+      case TLV_SN:
+        pp->pbtSn = pbtValue;
+        pp->szSn = szValue;
+        break;
+      default:
+        break;
+    }
+    pbt += szValue + 2;
+    sz -= szValue + 2;
+  }
+  return NFC_SUCCESS;
+}
+
+// MIUX and RW parameters of CONNECT and CC
+static size_t
+llcp_connection_params(uint8_t *pbt)
+{
+  const uint16_t ui16Miux = NFC_LLCP_MIU_MAX - LLCP_MIU_DEFAULT;
+  pbt[0] = TLV_MIUX;
+  pbt[1] = 2;
+  pbt[2] = ui16Miux >> 8;
+  pbt[3] = ui16Miux & 0xff;
+  pbt[4] = TLV_RW;
+  pbt[5] = 1;
+  pbt[6] = LLCP_RW;
+  return 7;
+}
+
+static size_t
+llcp_miu(const uint16_t ui16Miux)
+{
+  const size_t szMiu = LLCP_MIU_DEFAULT + ui16Miux;
+  return (szMiu < NFC_LLCP_MIU_MAX) ? szMiu : NFC_LLCP_MIU_MAX;
+}
+
+// Queue a PDU built from its header and up to two information parts
+static int
+llcp_queue(nfc_llcp_link *pll, const int iConnection, const uint8_t ui8Dsap, const uint8_t ui8Ptype, const uint8_t ui8Ssap,
+           const uint8_t *pbtPart1, const size_t szPart1, const uint8_t *pbtPart2, const size_t szPart2)
+{
+  // I PDUs get their sequence when sent
+  const size_t szHeader = (ui8Ptype == PTYPE_I) ? 3 : 2;
+  nfc_llcp_pdu *pdu;
+  int i;
+
+  if (szHeader + szPart1 + szPart2 > NFC_LLCP_FRAME_MAX_LEN)
+    return NFC_EOVFLOW;
+  if ((i = pll->iFree) < 0)
+    return NFC_EOVFLOW;
+  pdu = &pll->aPool[i];
+  pll->iFree = pdu->iNext;
+
+  pdu->abtPdu[0] = (ui8Dsap << 2) | (ui8Ptype >> 2);
+  pdu->abtPdu[1] = ((ui8Ptype & 0x03) << 6) | (ui8Ssap & 0x3f);
+  if (szPart1)
+    memcpy(pdu->abtPdu + szHeader, pbtPart1, szPart1);
+  if (szPart2)
+    memcpy(pdu->abtPdu + szHeader + szPart1, pbtPart2, szPart2);
+  pdu->szPdu = szHeader + szPart1 + szPart2;
+  pdu->iConnection = iConnection;
+  pdu->iNext = -1;
+
+  if (pll->iQueueTail < 0)
+    pll->iQueueHead = i;
+  else
+    pll->aPool[pll->iQueueTail].iNext = i;
+  pll->iQueueTail = i;
+  return NFC_SUCCESS;
+}
+
+static void
+llcp_release(nfc_llcp_link *pll, const int i)
+{
+  pll->aPool[i].iNext = pll->iFree;
+  pll->iFree = i;
+}
+
+// Unlink a queued PDU, iPrev being the PDU queued before it or -1
+static void
+llcp_unqueue(nfc_llcp_link *pll, const int iPrev, const int i)
+{
+  const int iNext = pll->aPool[i].iNext;
+  if (iPrev < 0)
+    pll->iQueueHead = iNext;
+  else
+    pll->aPool[iPrev].iNext = iNext;
+  if (pll->iQueueTail == i)
+    pll->iQueueTail = iPrev;
+}
+
+static int
+llcp_find_connection(const nfc_llcp_link *pll, const uint8_t ui8LocalSap, const uint8_t ui8RemoteSap)
+{
+  for (int i = 0; i < NFC_LLCP_CONNECTIONS; i++) {
+    const nfc_llcp_connection *conn = &pll->aConnections[i];
+    if ((conn->state != NFC_LLCP_CLOSED) && (conn->ui8LocalSap == ui8LocalSap) &&
+        ((conn->ui8RemoteSap == ui8RemoteSap) || (conn->state == NFC_LLCP_CONNECTING)))
+      return i;
+  }
+  return -1;
+}
+
+// Close a connection and drop what it still had to send
+static void
+llcp_close(nfc_llcp_link *pll, const int iConnection, const uint8_t ui8Reason)
+{
+  nfc_llcp_connection *conn = &pll->aConnections[iConnection];
+  int iPrev = -1;
+  int i = pll->iQueueHead;
+
+  while (i >= 0) {
+    const int iNext = pll->aPool[i].iNext;
+    if (pll->aPool[i].iConnection == iConnection) {
+      llcp_unqueue(pll, iPrev, i);
+      llcp_release(pll, i);
+    } else {
+      iPrev = i;
+    }
+    i = iNext;
+  }
+  conn->state = NFC_LLCP_CLOSED;
+  conn->ui8Reason = ui8Reason;
+  if (conn->cb)
+    conn->cb(pll, iConnection, NULL, 0, conn->user_data);
+}
+
+// Answer a CONNECT with CC when a service is bound to its SAP or name, DM otherwise
+static int
+llcp_accept(nfc_llcp_link *pll, const uint8_t ui8Dsap, const uint8_t ui8Ssap, const uint8_t *pbtParams, const size_t szParams)
+{
+  uint8_t abtParams[7];
+  nfc_llcp_service *pls = NULL;
+  nfc_llcp_connection *conn;
+  llcp_params params;
+  uint8_t ui8Reason;
+  int iConnection = -1;
+  int res;
+
+  if ((res = llcp_parse_params(pbtParams, szParams, &params)) < 0)
+    return res;
+  for (int i = 0; (i < NFC_LLCP_SERVICES) && !pls; i++) {
+    nfc_llcp_service *p = pll->apServices[i];
+    if (!p)
+      continue;
+    if ((ui8Dsap == NFC_LLCP_SAP_SDP) && params.pbtSn) {
+      if (p->pcServiceName && (strlen(p->pcServiceName) == params.szSn) && (memcmp(p->pcServiceName, params.pbtSn, params.szSn) == 0))
+        pls = p;
+    } else if (p->ui8Sap == ui8Dsap) {
+      pls = p;
+    }
+  }
+  for (int i = 0; (i < NFC_LLCP_CONNECTIONS) && (iConnection < 0); i++) {
+    if (pll->aConnections[i].state == NFC_LLCP_CLOSED)
+      iConnection = i;
+  }
+  if (!pls || (iConnection < 0)) {
+    ui8Reason = (pls) ? DM_REJECTED : DM_NO_SERVICE;
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "CONNECT to SAP %d refused (%d)", ui8Dsap, ui8Reason);
+    return llcp_queue(pll, -1, ui8Ssap, PTYPE_DM, ui8Dsap, &ui8Reason, 1, NULL, 0);
+  }
+
+  conn = &pll->aConnections[iConnection];
+  memset(conn, 0, sizeof(*conn));
+  conn->state = NFC_LLCP_CONNECTED;
+  conn->ui8LocalSap = pls->ui8Sap;
+  conn->ui8RemoteSap = ui8Ssap;
+  conn->ui8RemoteRw = params.ui8Rw;
+  conn->szRemoteMiu = llcp_miu(params.ui16Miux);
+  conn->cb = pls->cb;
+  conn->user_data = pls->user_data;
+  if ((res = llcp_queue(pll, iConnection, ui8Ssap, PTYPE_CC, pls->ui8Sap, abtParams, llcp_connection_params(abtParams), NULL, 0)) < 0) {
+    conn->state = NFC_LLCP_CLOSED;
+    return res;
+  }
+  if (conn->cb)
+    conn->cb(pll, iConnection, NULL, 0, conn->user_data);
+  return NFC_SUCCESS;
+}
+
+// Handle one received PDU, returns the count of PDUs other than SYMM
+static int
+llcp_handle_pdu(nfc_llcp_link *pll, const uint8_t *pbtPdu, const size_t szPdu)
+{
+  nfc_llcp_connection *conn;
+  uint8_t ui8Dsap, ui8Ssap, ui8Reason;
+  llcp_params params;
+  int iConnection;
+  int res;
+
+  if (szPdu < 2)
+    return NFC_ERFTRANS;
+  ui8Dsap = LLCP_DSAP(pbtPdu);
+  ui8Ssap = LLCP_SSAP(pbtPdu);
+
+  switch (LLCP_PTYPE(pbtPdu)) {
+    case PTYPE_SYMM:
+      return 0;
+    case PTYPE_AGF: {
+      size_t szPos = 2;
+      int iCount = 0;
+      while (szPos < szPdu) {
+        if (szPos + 2 > szPdu)
+          return NFC_ERFTRANS;
+        const size_t szPart = (pbtPdu[szPos] << 8) | pbtPdu[szPos + 1];
+        szPos += 2;
+        if (szPos + szPart > szPdu)
+          return NFC_ERFTRANS;
+        // Aggregated frames can't be nested
+        if ((szPart >= 2) && (LLCP_PTYPE(pbtPdu + szPos) != PTYPE_AGF)) {
+          if ((res = llcp_handle_pdu(pll, pbtPdu + szPos, szPart)) < 0)
+            return res;
+          iCount += res;
+        }
+        szPos += szPart;
+      }
+      return iCount;
+    }
+    case PTYPE_UI:
+      for (int i = 0; i < NFC_LLCP_SERVICES; i++) {
+        nfc_llcp_service *pls = pll->apServices[i];
+        if (pls && (pls->ui8Sap == ui8Dsap) && pls->cb)
+          pls->cb(pll, -1, pbtPdu + 2, szPdu - 2, pls->user_data);
+      }
+      return 1;
+    case PTYPE_CONNECT:
+      if ((res = llcp_accept(pll, ui8Dsap, ui8Ssap, pbtPdu + 2, szPdu - 2)) < 0)
+        return res;
+      return 1;
+    case PTYPE_DISC:
+      if ((ui8Dsap == 0) && (ui8Ssap == 0)) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Link deactivated by the peer");
+        pll->bActive = false;
+        return NFC_ETGRELEASED;
+      }
+      if ((iConnection = llcp_find_connection(pll, ui8Dsap, ui8Ssap)) < 0) {
+        ui8Reason = DM_NO_CONNECTION;
+      } else {
+        ui8Reason = DM_DISCONNECTED;
+        llcp_close(pll, iConnection, DM_DISCONNECTED);
+      }
+      if ((res = llcp_queue(pll, -1, ui8Ssap, PTYPE_DM, ui8Dsap, &ui8Reason, 1, NULL, 0)) < 0)
+        return res;
+      return 1;
+    case PTYPE_CC:
+      if (((iConnection = llcp_find_connection(pll, ui8Dsap, ui8Ssap)) < 0) || (pll->aConnections[iConnection].state != NFC_LLCP_CONNECTING))
+        return 1;
+      if ((res = llcp_parse_params(pbtPdu + 2, szPdu - 2, &params)) < 0)
+        return res;
+      conn = &pll->aConnections[iConnection];
+      // A connection by name is answered from the SAP of the service
+      conn->ui8RemoteSap = ui8Ssap;
+      conn->ui8RemoteRw = params.ui8Rw;
+      conn->szRemoteMiu = llcp_miu(params.ui16Miux);
+      conn->state = NFC_LLCP_CONNECTED;
+      if (conn->cb)
+        conn->cb(pll, iConnection, NULL, 0, conn->user_data);
+      return 1;
+    case PTYPE_DM:
+      if ((iConnection = llcp_find_connection(pll, ui8Dsap, ui8Ssap)) >= 0)
+        llcp_close(pll, iConnection, (szPdu > 2) ? pbtPdu[2] : DM_DISCONNECTED);
+      return 1;
+    case PTYPE_I:
+    case PTYPE_RR:
+    case PTYPE_RNR:
+      if (szPdu < 3)
+        return NFC_ERFTRANS;
+      if (((iConnection = llcp_find_connection(pll, ui8Dsap, ui8Ssap)) < 0) || (pll->aConnections[iConnection].state == NFC_LLCP_CONNECTING)) {
+        ui8Reason = DM_NO_CONNECTION;
+        if ((res = llcp_queue(pll, -1, ui8Ssap, PTYPE_DM, ui8Dsap, &ui8Reason, 1, NULL, 0)) < 0)
+          return res;
+        return 1;
+      }
+      conn = &pll->aConnections[iConnection];
+      conn->ui8Vsa = pbtPdu[2] & 0x0f;
+      if (LLCP_PTYPE(pbtPdu) != PTYPE_I) {
+        conn->bRemoteBusy = (LLCP_PTYPE(pbtPdu) == PTYPE_RNR);
+        return 1;
+      }
+      if ((pbtPdu[2] >> 4) != conn->ui8Vr)
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "I PDU N(S) %d while expecting %d", pbtPdu[2] >> 4, conn->ui8Vr);
+      conn->ui8Vr = ((pbtPdu[2] >> 4) + 1) & 0x0f;
+      if (conn->cb)
+        conn->cb(pll, iConnection, pbtPdu + 3, szPdu - 3, conn->user_data);
+      return 1;
+    default:
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Ignoring PDU type %d", LLCP_PTYPE(pbtPdu));
+      return 1;
+  }
+}
+
+// Whether a queued PDU may go now: I PDUs wait for room in the peer receive window
+static bool
+llcp_sendable(const nfc_llcp_link *pll, const nfc_llcp_pdu *pdu)
+{
+  const nfc_llcp_connection *conn;
+
+  if ((pdu->iConnection < 0) || (LLCP_PTYPE(pdu->abtPdu) != PTYPE_I))
+    return true;
+  conn = &pll->aConnections[pdu->iConnection];
+  return (!conn->bRemoteBusy) && (((conn->ui8Vs - conn->ui8Vsa) & 0x0f) < conn->ui8RemoteRw);
+}
+
+// Build the next frame: a lone PDU goes straight from its pool buffer (*piLone),
+// several PDUs and pending acknowledgements are aggregated, SYMM when idle
+static void
+llcp_build_frame(nfc_llcp_link *pll, const uint8_t **ppbtFrame, size_t *pszFrame, int *piLone)
+{
+  const uint8_t *apbtItems[NFC_LLCP_POOL_SIZE + NFC_LLCP_CONNECTIONS];
+  size_t aszItems[NFC_LLCP_POOL_SIZE + NFC_LLCP_CONNECTIONS];
+  int aiItems[NFC_LLCP_POOL_SIZE];
+  uint8_t abtRr[NFC_LLCP_CONNECTIONS][3];
+  unsigned int uiBlocked = 0;
+  unsigned int uiAcked = 0;
+  size_t szAgf = 0;
+  size_t szCount = 0;
+  size_t szPool = 0;
+  int iPrev = -1;
+  int i = pll->iQueueHead;
+
+  while (i >= 0) {
+    nfc_llcp_pdu *pdu = &pll->aPool[i];
+    const int iNext = pdu->iNext;
+    const int c = pdu->iConnection;
+    // The information field of an AGF is bound by the peer link MIU
+    if (((c >= 0) && (uiBlocked & (1u << c))) || !llcp_sendable(pll, pdu) ||
+        ((szCount > 0) && (szAgf + 2 + pdu->szPdu > pll->szRemoteMiu))) {
+      // PDUs of a connection keep their order
+      if (c >= 0)
+        uiBlocked |= 1u << c;
+      iPrev = i;
+      i = iNext;
+      continue;
+    }
+    if ((c >= 0) && (LLCP_PTYPE(pdu->abtPdu) == PTYPE_I)) {
+      nfc_llcp_connection *conn = &pll->aConnections[c];
+      pdu->abtPdu[2] = (conn->ui8Vs << 4) | conn->ui8Vr;
+      conn->ui8Vs = (conn->ui8Vs + 1) & 0x0f;
+      conn->ui8Vra = conn->ui8Vr;
+      uiAcked |= 1u << c;
+    }
+    llcp_unqueue(pll, iPrev, i);
+    apbtItems[szCount] = pdu->abtPdu;
+    aszItems[szCount] = pdu->szPdu;
+    aiItems[szPool++] = i;
+    szAgf += 2 + pdu->szPdu;
+    szCount++;
+    i = iNext;
+  }
+
+  // Acknowledge what no I PDU acknowledges
+  for (int c = 0; c < NFC_LLCP_CONNECTIONS; c++) {
+    nfc_llcp_connection *conn = &pll->aConnections[c];
+    if ((conn->state != NFC_LLCP_CONNECTED) || (conn->ui8Vr == conn->ui8Vra) || (uiAcked & (1u << c)))
+      continue;
+    if ((szCount > 0) && (szAgf + 2 + 3 > pll->szRemoteMiu))
+      break;
+    abtRr[c][0] = (conn->ui8RemoteSap << 2) | (PTYPE_RR >> 2);
+    abtRr[c][1] = ((PTYPE_RR & 0x03) << 6) | conn->ui8LocalSap;
+    abtRr[c][2] = conn->ui8Vr;
+    conn->ui8Vra = conn->ui8Vr;
+    apbtItems[szCount] = abtRr[c];
+    aszItems[szCount] = 3;
+    szAgf += 2 + 3;
+    szCount++;
+  }
+
+  *piLone = -1;
+  if (szCount == 0) {
+    pll->abtTx[0] = 0x00;
+    pll->abtTx[1] = 0x00;
+    *ppbtFrame = pll->abtTx;
+    *pszFrame = 2;
+  } else if ((szCount == 1) && (szPool == 1)) {
+    *piLone = aiItems[0];
+    *ppbtFrame = apbtItems[0];
+    *pszFrame = aszItems[0];
+  } else if (szCount == 1) {
+    memcpy(pll->abtTx, apbtItems[0], aszItems[0]);
+    *ppbtFrame = pll->abtTx;
+    *pszFrame = aszItems[0];
+  } else {
+    size_t szFrame = 2;
+    pll->abtTx[0] = PTYPE_AGF >> 2;
+    pll->abtTx[1] = (PTYPE_AGF & 0x03) << 6;
+    for (size_t n = 0; n < szCount; n++) {
+      pll->abtTx[szFrame++] = aszItems[n] >> 8;
+      pll->abtTx[szFrame++] = aszItems[n] & 0xff;
+      memcpy(pll->abtTx + szFrame, apbtItems[n], aszItems[n]);
+      szFrame += aszItems[n];
+    }
+    for (size_t n = 0; n < szPool; n++)
+      llcp_release(pll, aiItems[n]);
+    *ppbtFrame = pll->abtTx;
+    *pszFrame = szFrame;
+  }
+}
+
+/** @ingroup llcp
+ * @brief Build the LLCP general bytes of a D.E.P. ATR_REQ or ATR_RES
+ * @return Returns general bytes count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param[out] pbtGB general bytes, eg. \a abtGB of the \a nfc_dep_info given to
+ * nfc_initiator_select_dep_target() or of the target given to nfc_target_init()
+ * @param szGB size of \a pbtGB, at least NFC_LLCP_GENERAL_BYTES_LEN
+ */
+int
+nfc_llcp_general_bytes(uint8_t *pbtGB, const size_t szGB)
+{
+  const uint16_t ui16Miux = NFC_LLCP_MIU_MAX - LLCP_MIU_DEFAULT;
+  const uint8_t abtGB[NFC_LLCP_GENERAL_BYTES_LEN] = {
+    llcp_magic[0], llcp_magic[1], llcp_magic[2],
+    TLV_VERSION, 1, LLCP_VERSION,
+    TLV_MIUX, 2, ui16Miux >> 8, ui16Miux & 0xff,
+    TLV_WKS, 2, LLCP_WKS >> 8, LLCP_WKS & 0xff,
+    TLV_LTO, 1, LLCP_LTO,
+    TLV_OPT, 1, LLCP_LSC,
+  };
+
+  if (szGB < sizeof(abtGB))
+    return NFC_EOVFLOW;
+  memcpy(pbtGB, abtGB, sizeof(abtGB));
+  return sizeof(abtGB);
+}
+
+/** @ingroup llcp
+ * @brief Locate the general bytes of the initiator in the ATR_REQ received by a target
+ * @return Returns general bytes count (0 when there are none) on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pbtAtrReq initiator command returned by nfc_target_init()
+ * @param szAtrReq length of \a pbtAtrReq
+ * @param[out] ppbtGB points to the general bytes in \a pbtAtrReq
+ */
+int
+nfc_llcp_atr_req_general_bytes(const uint8_t *pbtAtrReq, const size_t szAtrReq, const uint8_t **ppbtGB)
+{
+  // Skip the length byte and the start byte of passive 106 kbps frames
+  for (size_t szPos = 0; (szPos < 3) && (szPos + 2 <= szAtrReq); szPos++) {
+    if ((pbtAtrReq[szPos] == 0xd4) && (pbtAtrReq[szPos + 1] == 0x00)) {
+      // CMD, NFCID3i, DIDi, BSi, BRi and PPi
+      const size_t szGB = szPos + 16;
+      if ((szGB > szAtrReq) || !(pbtAtrReq[szGB - 1] & 0x02))
+        return 0;
+      *ppbtGB = pbtAtrReq + szGB;
+      return szAtrReq - szGB;
+    }
+  }
+  return NFC_EINVARG;
+}
+
+/** @ingroup llcp
+ * @brief Activate an LLCP link over a D.E.P. target or initiator
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer initialized by this function
+ * @param pnd \a nfc_device struct pointer that represents currently used device
+ * @param bInitiator whether \a pnd selected the peer or was activated by it
+ * @param pbtRemoteGB general bytes of the peer: \a abtGB of the target selected by
+ * nfc_initiator_select_dep_target(), or found by nfc_llcp_atr_req_general_bytes()
+ * @param szRemoteGB count of general bytes
+ *
+ * Returns NFC_EINVARG when the peer doesn't speak LLCP 1.x.
+ */
+int
+nfc_llcp_link_activate(nfc_llcp_link *pll, nfc_device *pnd, const bool bInitiator, const uint8_t *pbtRemoteGB, const size_t szRemoteGB)
+{
+  llcp_params params;
+  int res;
+
+  if ((szRemoteGB < sizeof(llcp_magic)) || (memcmp(pbtRemoteGB, llcp_magic, sizeof(llcp_magic)) != 0))
+    return NFC_EINVARG;
+  if ((res = llcp_parse_params(pbtRemoteGB + sizeof(llcp_magic), szRemoteGB - sizeof(llcp_magic), &params)) < 0)
+    return res;
+  if ((params.ui8Version >> 4) != (LLCP_VERSION >> 4)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unsupported LLCP version %d.%d", params.ui8Version >> 4, params.ui8Version & 0x0f);
+    return NFC_EINVARG;
+  }
+
+  memset(pll->apServices, 0, sizeof(pll->apServices));
+  memset(pll->aConnections, 0, sizeof(pll->aConnections));
+  for (int i = 0; i < NFC_LLCP_POOL_SIZE; i++)
+    pll->aPool[i].iNext = (i + 1 < NFC_LLCP_POOL_SIZE) ? i + 1 : -1;
+  pll->iFree = 0;
+  pll->iQueueHead = -1;
+  pll->iQueueTail = -1;
+  pll->pnd = pnd;
+  pll->bInitiator = bInitiator;
+  pll->bRxPending = false;
+  pll->bActive = true;
+  pll->szRx = 0;
+  pll->ui8RemoteVersion = params.ui8Version;
+  pll->ui16RemoteWks = params.ui16Wks;
+  pll->szRemoteMiu = llcp_miu(params.ui16Miux);
+  // Default link timeout is 100 ms
+  pll->iRemoteLto = ((params.ui8Lto) ? params.ui8Lto : 10) * 10;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "LLCP %d.%d link, MIU %" PRIuPTR " bytes, LTO %d ms",
+          params.ui8Version >> 4, params.ui8Version & 0x0f, pll->szRemoteMiu, pll->iRemoteLto);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup llcp
+ * @brief Run one symmetric exchange of the link
+ * @return Returns the count of PDUs received from the peer (SYMM excluded) on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param timeout in milliseconds, for the D.E.P. exchange
+ *
+ * An initiator sends the queued PDUs (or SYMM) and handles the answer, a target
+ * handles the last frame received, answers it with the queued PDUs and waits for
+ * the next frame. Received SDUs are handed to the connection callbacks.
+ *
+ * The peer link timeout must not expire between two calls, it tells
+ * NFC_ETGRELEASED once the peer deactivated the link.
+ */
+int
+nfc_llcp_link_service(nfc_llcp_link *pll, int timeout)
+{
+  const uint8_t *pbtFrame;
+  size_t szFrame;
+  int iHandled = 0;
+  int iLone;
+  int res;
+
+  if (!pll->bActive)
+    return NFC_ETGRELEASED;
+
+  if (!pll->bInitiator) {
+    if (!pll->bRxPending) {
+      if ((res = nfc_target_receive_bytes(pll->pnd, pll->abtRx, sizeof(pll->abtRx), timeout)) < 0)
+        return res;
+      pll->szRx = res;
+      pll->bRxPending = true;
+    }
+    if ((iHandled = llcp_handle_pdu(pll, pll->abtRx, pll->szRx)) < 0)
+      return iHandled;
+  }
+
+  llcp_build_frame(pll, &pbtFrame, &szFrame, &iLone);
+  if (pll->bInitiator)
+    res = nfc_initiator_transceive_bytes(pll->pnd, pbtFrame, szFrame, pll->abtRx, sizeof(pll->abtRx), timeout);
+  else
+    res = nfc_target_send_receive_bytes(pll->pnd, pbtFrame, szFrame, pll->abtRx, sizeof(pll->abtRx), timeout);
+  if (iLone >= 0)
+    llcp_release(pll, iLone);
+  if (res < 0) {
+    pll->bRxPending = false;
+    return res;
+  }
+  pll->szRx = res;
+
+  if (pll->bInitiator)
+    iHandled = llcp_handle_pdu(pll, pll->abtRx, pll->szRx);
+  return iHandled;
+}
+
+/** @ingroup llcp
+ * @brief Deactivate the link, closing all its connections
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param timeout in milliseconds
+ *
+ * The D.E.P. link is left as is: an initiator may release the target afterwards.
+ */
+int
+nfc_llcp_link_deactivate(nfc_llcp_link *pll, int timeout)
+{
+  const uint8_t abtDisc[2] = { PTYPE_DISC >> 2, (PTYPE_DISC & 0x03) << 6 };
+  int res = NFC_SUCCESS;
+
+  if (!pll->bActive)
+    return NFC_SUCCESS;
+  if (pll->bInitiator) {
+    // The peer isn't expected to answer
+    if (((res = nfc_initiator_transceive_bytes(pll->pnd, abtDisc, sizeof(abtDisc), pll->abtRx, sizeof(pll->abtRx), timeout)) >= 0) || (res == NFC_ETIMEOUT))
+      res = NFC_SUCCESS;
+  } else {
+    if (!pll->bRxPending)
+      res = nfc_target_receive_bytes(pll->pnd, pll->abtRx, sizeof(pll->abtRx), timeout);
+    if ((res >= 0) && ((res = nfc_target_send_bytes(pll->pnd, abtDisc, sizeof(abtDisc), timeout)) >= 0))
+      res = NFC_SUCCESS;
+  }
+  for (int i = 0; i < NFC_LLCP_CONNECTIONS; i++) {
+    if (pll->aConnections[i].state != NFC_LLCP_CLOSED)
+      llcp_close(pll, i, DM_DISCONNECTED);
+  }
+  pll->bActive = false;
+  pll->bRxPending = false;
+  return res;
+}
+
+/** @ingroup llcp
+ * @brief Bind a service to the link, it accepts connections to its SAP or name
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param pls \a nfc_llcp_service struct pointer, kept by the link until deactivation
+ *
+ * Connectionless (UI) SDUs sent to the SAP are handed to the service callback
+ * with connection -1.
+ */
+int
+nfc_llcp_bind(nfc_llcp_link *pll, nfc_llcp_service *pls)
+{
+  int iFree = -1;
+
+  if ((pls->ui8Sap <= NFC_LLCP_SAP_SDP) || (pls->ui8Sap >= LLCP_SAP_CLIENT))
+    return NFC_EINVARG;
+  for (int i = 0; i < NFC_LLCP_SERVICES; i++) {
+    if (!pll->apServices[i]) {
+      if (iFree < 0)
+        iFree = i;
+    } else if (pll->apServices[i]->ui8Sap == pls->ui8Sap) {
+      return NFC_EINVARG;
+    }
+  }
+  if (iFree < 0)
+    return NFC_EOVFLOW;
+  pll->apServices[iFree] = pls;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup llcp
+ * @brief Open a data link connection to a service of the peer
+ * @return Returns the connection on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param ui8Dsap SAP of the peer service, ignored when \a pcServiceName is given
+ * @param pcServiceName name of the peer service or NULL
+ * @param cb called with the SDUs received on the connection
+ * @param user_data handed to \a cb
+ *
+ * The CONNECT PDU goes with the next nfc_llcp_link_service() exchanges, the
+ * connection is usable once nfc_llcp_connection_get_state() tells NFC_LLCP_CONNECTED.
+ */
+int
+nfc_llcp_connect(nfc_llcp_link *pll, const uint8_t ui8Dsap, const char *pcServiceName, nfc_llcp_receive_callback cb, void *user_data)
+{
+  uint8_t abtParams[7 + 2 + 255];
+  size_t szParams = llcp_connection_params(abtParams);
+  nfc_llcp_connection *conn;
+  int res;
+
+  for (int i = 0; i < NFC_LLCP_CONNECTIONS; i++) {
+    conn = &pll->aConnections[i];
+    if (conn->state != NFC_LLCP_CLOSED)
+      continue;
+    if (pcServiceName) {
+      const size_t szName = strlen(pcServiceName);
+      if (szName > 255)
+        return NFC_EINVARG;
+      abtParams[szParams++] = TLV_SN;
+      abtParams[szParams++] = szName;
+      memcpy(abtParams + szParams, pcServiceName, szName);
+      szParams += szName;
+    }
+    memset(conn, 0, sizeof(*conn));
+    conn->ui8LocalSap = LLCP_SAP_CLIENT + i;
+    conn->ui8RemoteSap = (pcServiceName) ? NFC_LLCP_SAP_SDP : ui8Dsap;
+    conn->cb = cb;
+    conn->user_data = user_data;
+    if ((res = llcp_queue(pll, i, conn->ui8RemoteSap, PTYPE_CONNECT, conn->ui8LocalSap, abtParams, szParams, NULL, 0)) < 0)
+      return res;
+    conn->state = NFC_LLCP_CONNECTING;
+    return i;
+  }
+  return NFC_EOVFLOW;
+}
+
+/** @ingroup llcp
+ * @brief Get the state of a data link connection
+ * @return Returns the connection state
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param iConnection connection returned by nfc_llcp_connect() or handed to a service callback
+ */
+nfc_llcp_connection_state
+nfc_llcp_connection_get_state(const nfc_llcp_link *pll, const int iConnection)
+{
+  if ((iConnection < 0) || (iConnection >= NFC_LLCP_CONNECTIONS))
+    return NFC_LLCP_CLOSED;
+  return pll->aConnections[iConnection].state;
+}
+
+/** @ingroup llcp
+ * @brief Queue an SDU on a data link connection
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param iConnection connection returned by nfc_llcp_connect() or handed to a service callback
+ * @param pbtData SDU to send
+ * @param szData length of \a pbtData, up to the MIU of the peer
+ *
+ * The SDU is copied to a PDU of the link pool and goes with the next
+ * nfc_llcp_link_service() exchanges, within the receive window of the peer.
+ * Returns NFC_EOVFLOW when the pool is empty: exchanges free it.
+ */
+int
+nfc_llcp_send(nfc_llcp_link *pll, const int iConnection, const uint8_t *pbtData, const size_t szData)
+{
+  nfc_llcp_connection *conn;
+
+  if ((iConnection < 0) || (iConnection >= NFC_LLCP_CONNECTIONS))
+    return NFC_EINVARG;
+  conn = &pll->aConnections[iConnection];
+  if (conn->state != NFC_LLCP_CONNECTED)
+    return NFC_EINVARG;
+  if (szData > conn->szRemoteMiu)
+    return NFC_EOVFLOW;
+  return llcp_queue(pll, iConnection, conn->ui8RemoteSap, PTYPE_I, conn->ui8LocalSap, pbtData, szData, NULL, 0);
+}
+
+/** @ingroup llcp
+ * @brief Close a data link connection
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param iConnection connection returned by nfc_llcp_connect() or handed to a service callback
+ *
+ * SDUs already queued go first, then DISC: the connection is closed once the
+ * peer answers it.
+ */
+int
+nfc_llcp_disconnect(nfc_llcp_link *pll, const int iConnection)
+{
+  nfc_llcp_connection *conn;
+  int res;
+
+  if ((iConnection < 0) || (iConnection >= NFC_LLCP_CONNECTIONS))
+    return NFC_EINVARG;
+  conn = &pll->aConnections[iConnection];
+  if (conn->state != NFC_LLCP_CONNECTED)
+    return NFC_EINVARG;
+  if ((res = llcp_queue(pll, iConnection, conn->ui8RemoteSap, PTYPE_DISC, conn->ui8LocalSap, NULL, 0, NULL, 0)) < 0)
+    return res;
+  conn->state = NFC_LLCP_DISCONNECTING;
+  return NFC_SUCCESS;
+}
+
+typedef struct {
+  bool     bAnswered;
+  uint8_t  ui8Response;
+} snep_client;
+
+static void
+snep_client_receive(nfc_llcp_link *pll, int iConnection, const uint8_t *pbtData, size_t szData, void *user_data)
+{
+  snep_client *psc = user_data;
+  (void) pll;
+  (void) iConnection;
+
+  if (pbtData && (szData >= SNEP_HEADER_LEN)) {
+    psc->ui8Response = pbtData[1];
+    psc->bAnswered = true;
+  }
+}
+
+// Run the link until the client connection leaves eState, or the answer comes when eState is NFC_LLCP_CONNECTED
+static int
+snep_client_wait(nfc_llcp_link *pll, const int iConnection, snep_client *psc, const nfc_llcp_connection_state eState, int timeout)
+{
+  int iIdle = 0;
+  int res;
+
+  while ((nfc_llcp_connection_get_state(pll, iConnection) == eState) && !((eState == NFC_LLCP_CONNECTED) && psc->bAnswered)) {
+    if ((res = nfc_llcp_link_service(pll, timeout)) < 0)
+      return res;
+    if (res > 0)
+      iIdle = 0;
+    else if (++iIdle > SNEP_IDLE_TURNS)
+      return NFC_ETIMEOUT;
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup llcp
+ * @brief PUT an NDEF message to the SNEP default server of the peer
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param pbtNdef NDEF message
+ * @param szNdef length of \a pbtNdef
+ * @param timeout in milliseconds, for each D.E.P. exchange
+ *
+ * The link is run until the server acknowledged the message, messages larger
+ * than the MIU are fragmented once the server asked to continue.
+ */
+int
+nfc_snep_put(nfc_llcp_link *pll, const uint8_t *pbtNdef, const size_t szNdef, int timeout)
+{
+  const uint8_t abtHeader[SNEP_HEADER_LEN] = {
+    SNEP_VERSION, SNEP_REQUEST_PUT,
+    (szNdef >> 24) & 0xff, (szNdef >> 16) & 0xff, (szNdef >> 8) & 0xff, szNdef & 0xff,
+  };
+  snep_client sc = { false, 0 };
+  nfc_llcp_connection *conn;
+  size_t szSent;
+  int iConnection;
+  int res;
+
+  if ((iConnection = nfc_llcp_connect(pll, 0, NFC_SNEP_SERVICE_NAME, snep_client_receive, &sc)) < 0)
+    return iConnection;
+  conn = &pll->aConnections[iConnection];
+  if ((res = snep_client_wait(pll, iConnection, &sc, NFC_LLCP_CONNECTING, timeout)) < 0)
+    return res;
+  if (conn->state != NFC_LLCP_CONNECTED) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "SNEP server refused the connection (%d)", conn->ui8Reason);
+    return NFC_ERFTRANS;
+  }
+
+  // Header and as much message as one I PDU takes, the server then asks for the rest
+  szSent = conn->szRemoteMiu - SNEP_HEADER_LEN;
+  if (szSent > szNdef)
+    szSent = szNdef;
+  if ((res = llcp_queue(pll, iConnection, conn->ui8RemoteSap, PTYPE_I, conn->ui8LocalSap, abtHeader, sizeof(abtHeader), pbtNdef, szSent)) < 0)
+    return res;
+  if (szSent < szNdef) {
+    if ((res = snep_client_wait(pll, iConnection, &sc, NFC_LLCP_CONNECTED, timeout)) < 0)
+      return res;
+    if (!sc.bAnswered || (sc.ui8Response != SNEP_RESPONSE_CONTINUE))
+      goto refused;
+    sc.bAnswered = false;
+    while (szSent < szNdef) {
+      const size_t szPart = ((szNdef - szSent) < conn->szRemoteMiu) ? (szNdef - szSent) : conn->szRemoteMiu;
+      if ((res = nfc_llcp_send(pll, iConnection, pbtNdef + szSent, szPart)) == NFC_EOVFLOW) {
+        // Pool is full, let some PDUs go
+        if ((res = nfc_llcp_link_service(pll, timeout)) < 0)
+          return res;
+        continue;
+      }
+      if (res < 0)
+        return res;
+      szSent += szPart;
+    }
+  }
+  if ((res = snep_client_wait(pll, iConnection, &sc, NFC_LLCP_CONNECTED, timeout)) < 0)
+    return res;
+  if (!sc.bAnswered || (sc.ui8Response != SNEP_RESPONSE_SUCCESS))
+    goto refused;
+
+  if ((res = nfc_llcp_disconnect(pll, iConnection)) < 0)
+    return res;
+  return snep_client_wait(pll, iConnection, &sc, NFC_LLCP_DISCONNECTING, timeout);
+
+refused:
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "SNEP PUT refused (0x%02x)", sc.ui8Response);
+  if (nfc_llcp_disconnect(pll, iConnection) == NFC_SUCCESS)
+    snep_client_wait(pll, iConnection, &sc, NFC_LLCP_DISCONNECTING, timeout);
+  return NFC_ERFTRANS;
+}
+
+// Reassemble PUT requests and answer each request or fragment that needs it
+static void
+snep_server_receive(nfc_llcp_link *pll, int iConnection, const uint8_t *pbtData, size_t szData, void *user_data)
+{
+  nfc_snep_server *pss = user_data;
+  uint8_t abtResponse[SNEP_HEADER_LEN] = { SNEP_VERSION, SNEP_RESPONSE_SUCCESS, 0x00, 0x00, 0x00, 0x00 };
+
+  if (!pbtData) {
+    // Connection opened or closed
+    pss->szMessage = 0;
+    pss->szReceived = 0;
+    return;
+  }
+
+  if (pss->szReceived < pss->szMessage) {
+    // Next fragment of a PUT
+    if (pss->szReceived + szData > pss->szMessage) {
+      abtResponse[1] = SNEP_RESPONSE_BAD_REQUEST;
+    } else {
+      memcpy(pss->pbtBuffer + pss->szReceived, pbtData, szData);
+      pss->szReceived += szData;
+      if (pss->szReceived < pss->szMessage)
+        return;
+      pss->cb(pss->pbtBuffer, pss->szMessage, pss->user_data);
+    }
+  } else if (szData < SNEP_HEADER_LEN) {
+    abtResponse[1] = SNEP_RESPONSE_BAD_REQUEST;
+  } else if ((pbtData[0] >> 4) != (SNEP_VERSION >> 4)) {
+    abtResponse[1] = SNEP_RESPONSE_UNSUPPORTED_VERSION;
+  } else if (pbtData[1] != SNEP_REQUEST_PUT) {
+    abtResponse[1] = SNEP_RESPONSE_NOT_IMPLEMENTED;
+  } else {
+    const size_t szMessage = ((size_t) pbtData[2] << 24) | (pbtData[3] << 16) | (pbtData[4] << 8) | pbtData[5];
+    const size_t szPart = szData - SNEP_HEADER_LEN;
+    if (szMessage > pss->szBuffer) {
+      abtResponse[1] = SNEP_RESPONSE_REJECT;
+    } else if (szPart > szMessage) {
+      abtResponse[1] = SNEP_RESPONSE_BAD_REQUEST;
+    } else {
+      memcpy(pss->pbtBuffer, pbtData + SNEP_HEADER_LEN, szPart);
+      pss->szMessage = szMessage;
+      pss->szReceived = szPart;
+      if (szPart < szMessage) {
+        abtResponse[1] = SNEP_RESPONSE_CONTINUE;
+        nfc_llcp_send(pll, iConnection, abtResponse, sizeof(abtResponse));
+        return;
+      }
+      pss->cb(pss->pbtBuffer, pss->szMessage, pss->user_data);
+    }
+  }
+  pss->szMessage = 0;
+  pss->szReceived = 0;
+  if (nfc_llcp_send(pll, iConnection, abtResponse, sizeof(abtResponse)) < 0)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "SNEP response dropped, PDU pool is full");
+}
+
+/** @ingroup llcp
+ * @brief Bind a SNEP default server to the link
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pll \a nfc_llcp_link struct pointer activated by nfc_llcp_link_activate()
+ * @param pss \a nfc_snep_server struct pointer, kept by the link until deactivation
+ * @param pbtBuffer where PUT messages are reassembled
+ * @param szBuffer size of \a pbtBuffer, larger messages are rejected
+ * @param cb called with each complete NDEF message
+ * @param user_data handed to \a cb
+ *
+ * The server listens on NFC_LLCP_SAP_SNEP and NFC_SNEP_SERVICE_NAME while the
+ * link is run by nfc_llcp_link_service(). GET requests are not implemented.
+ */
+int
+nfc_snep_server_bind(nfc_llcp_link *pll, nfc_snep_server *pss, uint8_t *pbtBuffer, const size_t szBuffer, nfc_snep_put_callback cb, void *user_data)
+{
+  pss->service.ui8Sap = NFC_LLCP_SAP_SNEP;
+  pss->service.pcServiceName = NFC_SNEP_SERVICE_NAME;
+  pss->service.cb = snep_server_receive;
+  pss->service.user_data = pss;
+  pss->pbtBuffer = pbtBuffer;
+  pss->szBuffer = szBuffer;
+  pss->szMessage = 0;
+  pss->szReceived = 0;
+  pss->cb = cb;
+  pss->user_data = user_data;
+  return nfc_llcp_bind(pll, &pss->service);
+}
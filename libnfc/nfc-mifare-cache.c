@@ -0,0 +1,409 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-mifare-cache.c
+ * @brief Persistent per-UID cache of MIFARE Classic keys and access conditions
+ *
+ * The cache is a file mapped in memory: a header followed by a fixed hash
+ * table of records, one per card UID, with linear probing. Each record is
+ * guarded by a sequence counter which is odd while the record is written, so
+ * lookups never lock: they copy the record and retry when the counter moved.
+ * Writers are serialized by a mutex in the process and flock() between
+ * processes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <sys/file.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-mifare.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.mifare"
+
+#define MIFARE_KEY_CACHE_MAGIC          "NFCK"
+#define MIFARE_KEY_CACHE_VERSION        1
+#define MIFARE_KEY_CACHE_DEFAULT_CARDS  4096
+// A record still odd after that many copies belongs to a crashed writer
+#define MIFARE_KEY_CACHE_READ_RETRIES   1024
+
+struct mifare_key_cache_header {
+  uint8_t  abtMagic[4];
+  uint32_t ui32Version;
+  uint32_t ui32Records;
+  uint32_t ui32Reserved;
+};
+
+struct mifare_key_cache_sector {
+  uint8_t  abtKeyA[MIFARE_CLASSIC_KEY_LEN];
+  uint8_t  abtKeyB[MIFARE_CLASSIC_KEY_LEN];
+  uint8_t  abtAccessBits[4];
+};
+
+struct mifare_key_cache_record {
+  /** Odd while the record is written */
+  uint32_t ui32Sequence;
+  /** 0 while the record is free */
+  uint8_t  szUidLen;
+  uint8_t  abtUid[10];
+  uint8_t  btReserved;
+  /** One bit per sector for each known field */
+  uint64_t ui64KnownKeyA;
+  uint64_t ui64KnownKeyB;
+  uint64_t ui64KnownAccessBits;
+  struct mifare_key_cache_sector asSectors[MIFARE_CLASSIC_4K_SECTORS];
+};
+
+struct nfc_mifare_key_cache {
+#ifndef WIN32
+  int fd;
+  void *pMap;
+  size_t szMap;
+  struct mifare_key_cache_record *prRecords;
+  uint32_t ui32Records;
+  pthread_mutex_t writer_lock;
+#endif
+};
+
+#ifndef WIN32
+
+// Home slot of an UID (FNV-1a)
+static uint32_t
+mifare_key_cache_hash(const nfc_mifare_key_cache *pmkc, const uint8_t *pbtUid, const size_t szUid)
+{
+  uint32_t ui32Hash = 2166136261u;
+  for (size_t i = 0; i < szUid; i++) {
+    ui32Hash ^= pbtUid[i];
+    ui32Hash *= 16777619u;
+  }
+  return ui32Hash % pmkc->ui32Records;
+}
+
+// Consistent copy of a record, false if a writer keeps it busy
+static bool
+mifare_key_cache_read(const struct mifare_key_cache_record *pr, struct mifare_key_cache_record *prCopy)
+{
+  for (int i = 0; i < MIFARE_KEY_CACHE_READ_RETRIES; i++) {
+    const uint32_t ui32Sequence = __atomic_load_n(&(pr->ui32Sequence), __ATOMIC_ACQUIRE);
+    if (ui32Sequence & 1)
+      continue;
+    memcpy(prCopy, pr, sizeof(*prCopy));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&(pr->ui32Sequence), __ATOMIC_RELAXED) == ui32Sequence)
+      return true;
+  }
+  return false;
+}
+
+static bool
+mifare_key_cache_uid_equals(const struct mifare_key_cache_record *pr, const uint8_t *pbtUid, const size_t szUid)
+{
+  return (pr->szUidLen == szUid) && (memcmp(pr->abtUid, pbtUid, szUid) == 0);
+}
+
+#endif // WIN32
+
+/** @ingroup mifare
+ * @brief Open (or create) a MIFARE Classic key cache file
+ * @return Returns the cache, or \c NULL on error
+ * @param pcPath cache file
+ * @param szCards number of cards a new cache file can hold (0 means 4096), ignored for an existing file
+ *
+ * The file holds, for each card UID, the keys A and B which opened its sectors
+ * and their access bits. It can be shared by concurrent threads and processes.
+ *
+ * @note The cache file contains keys: it is created readable by its owner only.
+ * @warning Not available on Windows.
+ */
+nfc_mifare_key_cache *
+nfc_mifare_key_cache_open(const char *pcPath, const size_t szCards)
+{
+#ifndef WIN32
+  nfc_mifare_key_cache *pmkc = malloc(sizeof(*pmkc));
+  if (!pmkc)
+    return NULL;
+
+  if ((pmkc->fd = open(pcPath, O_RDWR | O_CREAT, 0600)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open key cache %s: %s", pcPath, strerror(errno));
+    free(pmkc);
+    return NULL;
+  }
+  // Only one process creates the file
+  flock(pmkc->fd, LOCK_EX);
+
+  struct mifare_key_cache_header header;
+  struct stat st;
+  bool bNew = false;
+  if (fstat(pmkc->fd, &st) < 0)
+    goto error;
+  if (st.st_size == 0) {
+    memcpy(header.abtMagic, MIFARE_KEY_CACHE_MAGIC, sizeof(header.abtMagic));
+    header.ui32Version = MIFARE_KEY_CACHE_VERSION;
+    header.ui32Records = szCards ? (uint32_t) szCards : MIFARE_KEY_CACHE_DEFAULT_CARDS;
+    header.ui32Reserved = 0;
+    pmkc->szMap = sizeof(header) + ((size_t) header.ui32Records * sizeof(struct mifare_key_cache_record));
+    if (ftruncate(pmkc->fd, pmkc->szMap) < 0)
+      goto error;
+    bNew = true;
+  } else {
+    if (pread(pmkc->fd, &header, sizeof(header), 0) != sizeof(header))
+      goto error;
+    pmkc->szMap = sizeof(header) + ((size_t) header.ui32Records * sizeof(struct mifare_key_cache_record));
+    if ((memcmp(header.abtMagic, MIFARE_KEY_CACHE_MAGIC, sizeof(header.abtMagic)) != 0) || (header.ui32Version != MIFARE_KEY_CACHE_VERSION) ||
+        (header.ui32Records == 0) || ((size_t) st.st_size != pmkc->szMap)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s is not a key cache", pcPath);
+      goto error;
+    }
+  }
+
+  if ((pmkc->pMap = mmap(NULL, pmkc->szMap, PROT_READ | PROT_WRITE, MAP_SHARED, pmkc->fd, 0)) == MAP_FAILED)
+    goto error;
+  // Records are zeroed by ftruncate(), ie. free
+  if (bNew)
+    memcpy(pmkc->pMap, &header, sizeof(header));
+  flock(pmkc->fd, LOCK_UN);
+
+  pmkc->prRecords = (struct mifare_key_cache_record *)((uint8_t *) pmkc->pMap + sizeof(header));
+  pmkc->ui32Records = header.ui32Records;
+  pthread_mutex_init(&(pmkc->writer_lock), NULL);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Key cache %s holds %"PRIu32" cards", pcPath, pmkc->ui32Records);
+  return pmkc;
+
+error:
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to map key cache %s", pcPath);
+  close(pmkc->fd);
+  free(pmkc);
+  return NULL;
+#else
+  (void) pcPath;
+  (void) szCards;
+  return NULL;
+#endif
+}
+
+/** @ingroup mifare
+ * @brief Close a MIFARE Classic key cache
+ * @param pmkc cache returned by nfc_mifare_key_cache_open(), may be \c NULL
+ */
+void
+nfc_mifare_key_cache_close(nfc_mifare_key_cache *pmkc)
+{
+  if (!pmkc)
+    return;
+#ifndef WIN32
+  munmap(pmkc->pMap, pmkc->szMap);
+  close(pmkc->fd);
+  pthread_mutex_destroy(&(pmkc->writer_lock));
+#endif
+  free(pmkc);
+}
+
+/** @ingroup mifare
+ * @brief Look a sector of a card up in a MIFARE Classic key cache
+ * @return Returns a combination of \c MIFARE_KEY_CACHE_KEY and \c MIFARE_KEY_CACHE_ACCESS_BITS telling what is known, otherwise returns libnfc's error code (negative value)
+ * @param pmkc cache returned by nfc_mifare_key_cache_open()
+ * @param pbtUid card UID
+ * @param szUid length of \a pbtUid (4, 7 or 10)
+ * @param ui8Sector sector number (0..39)
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B, selects the key
+ * @param[out] pbtKey receives the 6 bytes key when known
+ * @param[out] pbtAccessBits receives the 4 bytes of access bits (including general purpose byte) when known, may be \c NULL
+ *
+ * Lookups take no lock and can run along with writers in any thread or process.
+ */
+int
+nfc_mifare_key_cache_lookup(const nfc_mifare_key_cache *pmkc, const uint8_t *pbtUid, const size_t szUid, const uint8_t ui8Sector, const mifare_cmd mcAuth,
+                            uint8_t *pbtKey, uint8_t *pbtAccessBits)
+{
+#ifndef WIN32
+  if ((szUid == 0) || (szUid > 10) || (ui8Sector >= MIFARE_CLASSIC_4K_SECTORS) || ((mcAuth != MC_AUTH_A) && (mcAuth != MC_AUTH_B)))
+    return NFC_EINVARG;
+
+  const uint32_t ui32Home = mifare_key_cache_hash(pmkc, pbtUid, szUid);
+  const uint64_t ui64Sector = (uint64_t) 1 << ui8Sector;
+  struct mifare_key_cache_record r;
+  for (uint32_t i = 0; i < pmkc->ui32Records; i++) {
+    if (!mifare_key_cache_read(&(pmkc->prRecords[(ui32Home + i) % pmkc->ui32Records]), &r))
+      return 0;
+    if (r.szUidLen == 0)
+      return 0;
+    if (!mifare_key_cache_uid_equals(&r, pbtUid, szUid))
+      continue;
+
+    int res = 0;
+    const struct mifare_key_cache_sector *ps = &(r.asSectors[ui8Sector]);
+    if ((mcAuth == MC_AUTH_A) && (r.ui64KnownKeyA & ui64Sector)) {
+      memcpy(pbtKey, ps->abtKeyA, MIFARE_CLASSIC_KEY_LEN);
+      res |= MIFARE_KEY_CACHE_KEY;
+    } else if ((mcAuth == MC_AUTH_B) && (r.ui64KnownKeyB & ui64Sector)) {
+      memcpy(pbtKey, ps->abtKeyB, MIFARE_CLASSIC_KEY_LEN);
+      res |= MIFARE_KEY_CACHE_KEY;
+    }
+    if ((pbtAccessBits) && (r.ui64KnownAccessBits & ui64Sector)) {
+      memcpy(pbtAccessBits, ps->abtAccessBits, sizeof(ps->abtAccessBits));
+      res |= MIFARE_KEY_CACHE_ACCESS_BITS;
+    }
+    return res;
+  }
+  return 0;
+#else
+  (void) pmkc;
+  (void) pbtUid;
+  (void) szUid;
+  (void) ui8Sector;
+  (void) mcAuth;
+  (void) pbtKey;
+  (void) pbtAccessBits;
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/** @ingroup mifare
+ * @brief Record the key or the access bits of a sector in a MIFARE Classic key cache
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pmkc cache returned by nfc_mifare_key_cache_open()
+ * @param pbtUid card UID
+ * @param szUid length of \a pbtUid (4, 7 or 10)
+ * @param ui8Sector sector number (0..39)
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B, selects the key
+ * @param pbtKey 6 bytes key which opened the sector, may be \c NULL
+ * @param pbtAccessBits 4 bytes of access bits read from the sector trailer, may be \c NULL
+ *
+ * When the cache is full, the card which shares the home slot of \a pbtUid is forgotten.
+ */
+int
+nfc_mifare_key_cache_store(nfc_mifare_key_cache *pmkc, const uint8_t *pbtUid, const size_t szUid, const uint8_t ui8Sector, const mifare_cmd mcAuth,
+                           const uint8_t *pbtKey, const uint8_t *pbtAccessBits)
+{
+#ifndef WIN32
+  if ((szUid == 0) || (szUid > 10) || (ui8Sector >= MIFARE_CLASSIC_4K_SECTORS) || ((mcAuth != MC_AUTH_A) && (mcAuth != MC_AUTH_B)))
+    return NFC_EINVARG;
+
+  pthread_mutex_lock(&(pmkc->writer_lock));
+  flock(pmkc->fd, LOCK_EX);
+
+  // Only writers change records and they are serialized: no need to copy them
+  const uint32_t ui32Home = mifare_key_cache_hash(pmkc, pbtUid, szUid);
+  struct mifare_key_cache_record *pr = NULL;
+  for (uint32_t i = 0; i < pmkc->ui32Records; i++) {
+    struct mifare_key_cache_record *p = &(pmkc->prRecords[(ui32Home + i) % pmkc->ui32Records]);
+    if ((p->szUidLen == 0) || mifare_key_cache_uid_equals(p, pbtUid, szUid)) {
+      pr = p;
+      break;
+    }
+  }
+  const bool bEvict = (pr == NULL);
+  if (bEvict)
+    pr = &(pmkc->prRecords[ui32Home]);
+
+  // Even base: a writer which crashed mid-update left the record odd
+  const uint32_t ui32Sequence = (pr->ui32Sequence + 1) & ~1u;
+  __atomic_store_n(&(pr->ui32Sequence), ui32Sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  if ((bEvict) || (pr->szUidLen == 0)) {
+    memset((uint8_t *) pr + sizeof(pr->ui32Sequence), 0, sizeof(*pr) - sizeof(pr->ui32Sequence));
+    memcpy(pr->abtUid, pbtUid, szUid);
+    pr->szUidLen = szUid;
+  }
+  const uint64_t ui64Sector = (uint64_t) 1 << ui8Sector;
+  struct mifare_key_cache_sector *ps = &(pr->asSectors[ui8Sector]);
+  if (pbtKey) {
+    if (mcAuth == MC_AUTH_A) {
+      memcpy(ps->abtKeyA, pbtKey, MIFARE_CLASSIC_KEY_LEN);
+      pr->ui64KnownKeyA |= ui64Sector;
+    } else {
+      memcpy(ps->abtKeyB, pbtKey, MIFARE_CLASSIC_KEY_LEN);
+      pr->ui64KnownKeyB |= ui64Sector;
+    }
+  }
+  if (pbtAccessBits) {
+    memcpy(ps->abtAccessBits, pbtAccessBits, sizeof(ps->abtAccessBits));
+    pr->ui64KnownAccessBits |= ui64Sector;
+  }
+  __atomic_store_n(&(pr->ui32Sequence), ui32Sequence + 2, __ATOMIC_RELEASE);
+
+  flock(pmkc->fd, LOCK_UN);
+  pthread_mutex_unlock(&(pmkc->writer_lock));
+  return NFC_SUCCESS;
+#else
+  (void) pmkc;
+  (void) pbtUid;
+  (void) szUid;
+  (void) ui8Sector;
+  (void) mcAuth;
+  (void) pbtKey;
+  (void) pbtAccessBits;
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/*
+ * Key cache set by mifare_key_cache option, opened on first use; NULL when
+ * the option is not set or the file can't be used.
+ */
+nfc_mifare_key_cache *
+nfc_context_mifare_key_cache(nfc_context *context)
+{
+#ifndef WIN32
+  nfc_mifare_key_cache *pmkc = __atomic_load_n(&(context->mifare_key_cache), __ATOMIC_ACQUIRE);
+  if ((pmkc) || (!context->mifare_key_cache_file))
+    return pmkc;
+
+  pthread_mutex_lock(&(context->lock));
+  if ((!(pmkc = context->mifare_key_cache)) && (context->mifare_key_cache_file)) {
+    if ((pmkc = nfc_mifare_key_cache_open(context->mifare_key_cache_file, 0)))
+      __atomic_store_n(&(context->mifare_key_cache), pmkc, __ATOMIC_RELEASE);
+    else {
+      // Don't try again on every card
+      free(context->mifare_key_cache_file);
+      context->mifare_key_cache_file = NULL;
+    }
+  }
+  pthread_mutex_unlock(&(context->lock));
+  return pmkc;
+#else
+  (void) context;
+  return NULL;
+#endif
+}
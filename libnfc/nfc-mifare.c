@@ -0,0 +1,661 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-mifare.c
+ * @brief Provide MIFARE Classic commands and sector-level operations on top of libnfc
+ */
+
+/**
+ * @defgroup mifare  MIFARE Classic
+ * This page details how to read and write MIFARE Classic tags a sector at once.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-mifare.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.mifare"
+
+// Blocks of the last sectors of MIFARE Classic 4K
+#define MIFARE_CLASSIC_SECTOR_MAX_BLOCKS 16
+
+// MIFARE commands rely on the chip framing, only switch it on when it is not already
+static int
+mifare_classic_framing(nfc_device *pnd)
+{
+  if (pnd->bEasyFraming)
+    return NFC_SUCCESS;
+  return nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true);
+}
+
+// Send a MIFARE command frame, the answer goes straight to pbtRx
+static int
+mifare_transceive(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+  if ((res = mifare_classic_framing(pnd)) < 0)
+    return res;
+  return nfc_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, szRx, -1);
+}
+
+// Send a MIFARE command with its parameter, the answer goes straight to pbtRx
+static int
+mifare_classic_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, const void *pParam, const size_t szParam, uint8_t *pbtRx, const size_t szRx)
+{
+  uint8_t abtCmd[2 + sizeof(mifare_param)];
+
+  abtCmd[0] = mc;               // The MIFARE Classic command
+  abtCmd[1] = ui8Block;         // The block address (1K=0x00..0x39, 4K=0x00..0xff)
+  if (szParam)
+    memcpy(abtCmd + 2, pParam, szParam);
+  return mifare_transceive(pnd, abtCmd, 2 + szParam, pbtRx, szRx);
+}
+
+/** @ingroup mifare
+ * @brief Execute a MIFARE Classic Command
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param mc MIFARE command
+ * @param ui8Block destination block number
+ * @param pmp Some commands need additional information. This information should be supplied in the mifare_param union.
+ *
+ * The specified MIFARE command will be executed on the tag. There are different commands possible, they all require the destination block number.
+ * @note There are three different types of information (Authenticate, Data and Value).
+ *
+ * First an authentication must take place using Key A or B. It requires a 48 bit Key (6 bytes) and the UID.
+ * They are both used to initialize the internal cipher-state of the PN53X chip.
+ * After a successful authentication it will be possible to execute other commands (e.g. Read/Write).
+ * The MIFARE Classic Specification (http://www.nxp.com/acrobat/other/identification/M001053_MF1ICS50_rev5_3.pdf) explains more about this process.
+ *
+ * Easy framing is enabled when it is not already, and left enabled.
+ */
+bool
+nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp)
+{
+  uint8_t  abtRx[MIFARE_CLASSIC_BLOCK_LEN];
+  size_t  szParamLen;
+
+  switch (mc) {
+      // Read and store command have no parameter
+    case MC_READ:
+    case MC_STORE:
+      szParamLen = 0;
+      break;
+
+      // Authenticate command
+    case MC_AUTH_A:
+    case MC_AUTH_B:
+      szParamLen = sizeof(struct mifare_param_auth);
+      break;
+
+      // Data command
+    case MC_WRITE:
+      szParamLen = sizeof(struct mifare_param_data);
+      break;
+
+      // Value command
+    case MC_DECREMENT:
+    case MC_INCREMENT:
+    case MC_TRANSFER:
+      szParamLen = sizeof(struct mifare_param_value);
+      break;
+
+      // Please fix your code, you never should reach this statement
+    default:
+      return false;
+      break;
+  }
+
+  // Fire the mifare command
+  int res;
+  if ((res = mifare_classic_cmd(pnd, mc, ui8Block, pmp, szParamLen, abtRx, sizeof(abtRx))) < 0) {
+    // NFC_ERFTRANS usually means we are authenticated on a sector but the
+    // requested MIFARE cmd (read, write) is not permitted by current access bytes
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "MIFARE command %02x on block %u failed: %s", mc, ui8Block, nfc_strerror(pnd));
+    return false;
+  }
+
+  // When we have executed a read command, copy the received bytes into the param
+  if (mc == MC_READ) {
+    if (res == MIFARE_CLASSIC_BLOCK_LEN) {
+      memcpy(pmp->mpd.abtData, abtRx, MIFARE_CLASSIC_BLOCK_LEN);
+    } else {
+      return false;
+    }
+  }
+  // Command succesfully executed
+  return true;
+}
+
+/** @ingroup mifare
+ * @brief Number of blocks of a MIFARE Classic sector
+ * @return Returns 4 for the 32 first sectors, 16 for the next ones (MIFARE Classic 4K)
+ * @param ui8Sector sector number
+ */
+uint8_t
+nfc_mifare_classic_sector_blocks(const uint8_t ui8Sector)
+{
+  return (ui8Sector < 32) ? 4 : 16;
+}
+
+/** @ingroup mifare
+ * @brief First block of a MIFARE Classic sector
+ * @return Returns the block number, the sector trailer is its last block
+ * @param ui8Sector sector number
+ */
+uint8_t
+nfc_mifare_classic_sector_first_block(const uint8_t ui8Sector)
+{
+  return (ui8Sector < 32) ? (ui8Sector * 4) : (128 + ((ui8Sector - 32) * 16));
+}
+
+/** @ingroup mifare
+ * @brief Sector of a MIFARE Classic block
+ * @return Returns the sector number
+ * @param ui8Block block number
+ */
+uint8_t
+nfc_mifare_classic_block_sector(const uint8_t ui8Block)
+{
+  return (ui8Block < 128) ? (ui8Block / 4) : (32 + ((ui8Block - 128) / 16));
+}
+
+/** @ingroup mifare
+ * @brief Authenticate on the sector of a block
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target, the 4 last bytes of its UID feed the cipher
+ * @param ui8Block any block of the sector to authenticate on
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKey 6 bytes key
+ *
+ * @note A failed authentication halts the tag: it has to be selected again before next attempt.
+ */
+int
+nfc_mifare_classic_authenticate(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey)
+{
+  struct mifare_param_auth mpa;
+  int res;
+
+  if (((mcAuth != MC_AUTH_A) && (mcAuth != MC_AUTH_B)) || (pnt->nm.nmt != NMT_ISO14443A) || (pnt->nti.nai.szUidLen < 4))
+    return NFC_EINVARG;
+
+  memcpy(mpa.abtKey, pbtKey, sizeof(mpa.abtKey));
+  memcpy(mpa.abtAuthUid, pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen - 4, sizeof(mpa.abtAuthUid));
+  if ((res = mifare_classic_cmd(pnd, mcAuth, ui8Block, &mpa, sizeof(mpa), NULL, 0)) < 0)
+    return res;
+  return NFC_SUCCESS;
+}
+
+// Wake up a target halted by a failed authentication, selecting it straight by its UID
+static int
+mifare_classic_rewake(nfc_device *pnd, const nfc_target *pnt)
+{
+  uint8_t abtInit[12];
+  size_t szInit;
+  int res;
+
+  iso14443_cascade_uid(pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, abtInit, &szInit);
+  if ((res = NFC_DRIVER(pnd)->initiator_select_passive_target(pnd, pnt->nm, abtInit, szInit, NULL)) < 0)
+    return res;
+  return (res == 0) ? NFC_ETGRELEASED : NFC_SUCCESS;
+}
+
+/** @ingroup mifare
+ * @brief Search the key of a sector in a dictionary
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value), \c NFC_EMFCAUTHFAIL when no key matches
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Block any block of the sector to authenticate on
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKeys dictionary, \a szKeys keys of 6 bytes each
+ * @param szKeys number of keys in \a pbtKeys
+ *
+ * Keys are tried in order. After a miss, the halted target is woken up by a
+ * single selection with its known UID, without anticollision nor any other
+ * request. The key found is moved to the front of \a pbtKeys, so keeping the
+ * same dictionary across sectors and cards tries most recently successful keys
+ * first. On success the sector stays authenticated.
+ *
+ * When \e mifare_key_cache option (or LIBNFC_MIFARE_KEY_CACHE environment variable) is set, the key which
+ * opened this sector of this card last time is tried first, provided it is still in \a pbtKeys, and the key
+ * found is remembered.
+ */
+int
+nfc_mifare_classic_find_key(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, uint8_t *pbtKeys, const size_t szKeys)
+{
+  nfc_mifare_key_cache *pmkc = nfc_context_mifare_key_cache((nfc_context *) pnd->context);
+  const uint8_t ui8Sector = nfc_mifare_classic_block_sector(ui8Block);
+  const nfc_iso14443a_info *pnai = &(pnt->nti.nai);
+  // Index of the key the cache remembers for this sector, szKeys if none
+  size_t szCached = szKeys;
+  int res = NFC_EMFCAUTHFAIL;
+
+  if (!NFC_DRIVER(pnd)->initiator_select_passive_target)
+    return NFC_EDEVNOTSUPP;
+
+  uint8_t abtCached[MIFARE_CLASSIC_KEY_LEN];
+  if ((pmkc) && (pnt->nm.nmt == NMT_ISO14443A) &&
+      (nfc_mifare_key_cache_lookup(pmkc, pnai->abtUid, pnai->szUidLen, ui8Sector, mcAuth, abtCached, NULL) > 0)) {
+    for (szCached = 0; szCached < szKeys; szCached++) {
+      if (memcmp(pbtKeys + (szCached * MIFARE_CLASSIC_KEY_LEN), abtCached, sizeof(abtCached)) == 0)
+        break;
+    }
+  }
+
+  nfc_device_lock(pnd);
+  for (size_t n = 0; n < szKeys; n++) {
+    // The remembered key goes first, then dictionary order
+    const size_t i = (szCached == szKeys) ? n : ((n == 0) ? szCached : ((n <= szCached) ? n - 1 : n));
+    uint8_t *pbtKey = pbtKeys + (i * MIFARE_CLASSIC_KEY_LEN);
+    if ((res = nfc_mifare_classic_authenticate(pnd, pnt, ui8Block, mcAuth, pbtKey)) == 0) {
+      uint8_t abtKey[MIFARE_CLASSIC_KEY_LEN];
+      memcpy(abtKey, pbtKey, sizeof(abtKey));
+      memmove(pbtKeys + MIFARE_CLASSIC_KEY_LEN, pbtKeys, i * MIFARE_CLASSIC_KEY_LEN);
+      memcpy(pbtKeys, abtKey, sizeof(abtKey));
+      if ((pmkc) && (i != szCached))
+        nfc_mifare_key_cache_store(pmkc, pnai->abtUid, pnai->szUidLen, ui8Sector, mcAuth, abtKey, NULL);
+      break;
+    }
+    if (res == NFC_EINVARG)
+      break;
+    if ((res = mifare_classic_rewake(pnd, pnt)) < 0)
+      break;
+    res = NFC_EMFCAUTHFAIL;
+  }
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup mifare
+ * @brief Read all blocks of a MIFARE Classic sector
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Sector sector number (0..39)
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKey 6 bytes key
+ * @param pbtData buffer receiving the blocks, sector trailer included
+ * @param szData size of \a pbtData, at least nfc_mifare_classic_sector_blocks() * \c MIFARE_CLASSIC_BLOCK_LEN
+ *
+ * The sector is authenticated once, then its blocks are read back to back while the device is held,
+ * as one batch (see nfc_initiator_transceive_bytes_batch()).
+ * Keys which access conditions hide are read as zeros. The key and the access bits are remembered
+ * by the key cache, when \e mifare_key_cache option is set.
+ */
+int
+nfc_mifare_classic_read_sector(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Sector, const mifare_cmd mcAuth, const uint8_t *pbtKey, uint8_t *pbtData, const size_t szData)
+{
+  const uint8_t ui8FirstBlock = nfc_mifare_classic_sector_first_block(ui8Sector);
+  const uint8_t ui8Blocks = nfc_mifare_classic_sector_blocks(ui8Sector);
+  uint8_t abtAuth[2 + sizeof(struct mifare_param_auth)];
+  uint8_t abtReads[MIFARE_CLASSIC_SECTOR_MAX_BLOCKS][2];
+  nfc_exchange aex[1 + MIFARE_CLASSIC_SECTOR_MAX_BLOCKS];
+  int res;
+
+  if ((ui8Sector >= MIFARE_CLASSIC_4K_SECTORS) || (szData < (size_t) ui8Blocks * MIFARE_CLASSIC_BLOCK_LEN))
+    return NFC_EINVARG;
+  if (((mcAuth != MC_AUTH_A) && (mcAuth != MC_AUTH_B)) || (pnt->nm.nmt != NMT_ISO14443A) || (pnt->nti.nai.szUidLen < 4))
+    return NFC_EINVARG;
+
+  // Authentication and reads go as one batch
+  abtAuth[0] = mcAuth;
+  abtAuth[1] = ui8FirstBlock;
+  memcpy(abtAuth + 2, pbtKey, MIFARE_CLASSIC_KEY_LEN);
+  memcpy(abtAuth + 2 + MIFARE_CLASSIC_KEY_LEN, pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen - 4, 4);
+  aex[0] = (nfc_exchange) { abtAuth, sizeof(abtAuth), NULL, 0, 0 };
+  for (uint8_t i = 0; i < ui8Blocks; i++) {
+    abtReads[i][0] = MC_READ;
+    abtReads[i][1] = ui8FirstBlock + i;
+    aex[1 + i] = (nfc_exchange) { abtReads[i], 2, pbtData + (i * MIFARE_CLASSIC_BLOCK_LEN), MIFARE_CLASSIC_BLOCK_LEN, 0 };
+  }
+  nfc_device_lock(pnd);
+  if ((res = mifare_classic_framing(pnd)) >= 0)
+    res = nfc_initiator_transceive_bytes_batch(pnd, aex, 1 + ui8Blocks, -1);
+  nfc_device_unlock(pnd);
+  if (res < 0)
+    return res;
+  for (uint8_t i = 0; i < ui8Blocks; i++) {
+    if (aex[1 + i].res != MIFARE_CLASSIC_BLOCK_LEN)
+      return NFC_EIO;
+  }
+
+  nfc_mifare_key_cache *pmkc = nfc_context_mifare_key_cache((nfc_context *) pnd->context);
+  if (pmkc) {
+    // Access bits are bytes 6 to 9 of the sector trailer
+    const uint8_t *pbtTrailer = pbtData + ((ui8Blocks - 1) * MIFARE_CLASSIC_BLOCK_LEN);
+    nfc_mifare_key_cache_store(pmkc, pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, ui8Sector, mcAuth, pbtKey, pbtTrailer + MIFARE_CLASSIC_KEY_LEN);
+  }
+  return ui8Blocks * MIFARE_CLASSIC_BLOCK_LEN;
+}
+
+/** @ingroup mifare
+ * @brief Write the blocks of a MIFARE Classic sector
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Sector sector number (0..39)
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKey 6 bytes key
+ * @param pbtData content of the whole sector, as returned by nfc_mifare_classic_read_sector()
+ * @param szData size of \a pbtData, at least nfc_mifare_classic_sector_blocks() * \c MIFARE_CLASSIC_BLOCK_LEN
+ * @param bWriteTrailer also write the sector trailer (keys and access conditions), which is written last
+ *
+ * The manufacturer block (block 0) is never written.
+ */
+int
+nfc_mifare_classic_write_sector(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Sector, const mifare_cmd mcAuth, const uint8_t *pbtKey, const uint8_t *pbtData, const size_t szData, const bool bWriteTrailer)
+{
+  const uint8_t ui8FirstBlock = nfc_mifare_classic_sector_first_block(ui8Sector);
+  const uint8_t ui8Blocks = nfc_mifare_classic_sector_blocks(ui8Sector) - (bWriteTrailer ? 0 : 1);
+  int res;
+
+  if ((ui8Sector >= MIFARE_CLASSIC_4K_SECTORS) || (szData < (size_t) nfc_mifare_classic_sector_blocks(ui8Sector) * MIFARE_CLASSIC_BLOCK_LEN))
+    return NFC_EINVARG;
+
+  nfc_device_lock(pnd);
+  if ((res = nfc_mifare_classic_authenticate(pnd, pnt, ui8FirstBlock, mcAuth, pbtKey)) == 0) {
+    for (uint8_t i = (ui8Sector == 0) ? 1 : 0; i < ui8Blocks; i++) {
+      if ((res = mifare_classic_cmd(pnd, MC_WRITE, ui8FirstBlock + i, pbtData + (i * MIFARE_CLASSIC_BLOCK_LEN), MIFARE_CLASSIC_BLOCK_LEN, NULL, 0)) < 0)
+        break;
+    }
+  }
+  nfc_device_unlock(pnd);
+  return (res < 0) ? res : NFC_SUCCESS;
+}
+
+/** @ingroup mifare
+ * @brief Decode a MIFARE Classic value block
+ * @return Returns 0 on success, \c NFC_EIO when the block is not a valid value block
+ * @param pbtBlock 16 bytes block
+ * @param[out] pi32Value value stored in the block
+ * @param[out] pui8Address address byte stored in the block, may be NULL
+ *
+ * A value block holds the value, its complement and the value again, then the address byte, its complement,
+ * the address and its complement.
+ */
+int
+nfc_mifare_classic_value_decode(const uint8_t *pbtBlock, int32_t *pi32Value, uint8_t *pui8Address)
+{
+  for (size_t i = 0; i < 4; i++) {
+    if ((pbtBlock[i] != pbtBlock[8 + i]) || ((pbtBlock[i] ^ pbtBlock[4 + i]) != 0xff))
+      return NFC_EIO;
+  }
+  if ((pbtBlock[12] != pbtBlock[14]) || (pbtBlock[13] != pbtBlock[15]) || ((pbtBlock[12] ^ pbtBlock[13]) != 0xff))
+    return NFC_EIO;
+
+  *pi32Value = (int32_t)((uint32_t) pbtBlock[0] | ((uint32_t) pbtBlock[1] << 8) | ((uint32_t) pbtBlock[2] << 16) | ((uint32_t) pbtBlock[3] << 24));
+  if (pui8Address)
+    *pui8Address = pbtBlock[12];
+  return NFC_SUCCESS;
+}
+
+/** @ingroup mifare
+ * @brief Encode a MIFARE Classic value block, eg. to write it with \c MC_WRITE
+ * @param i32Value value to store
+ * @param ui8Address address byte to store, usually the block number
+ * @param[out] pbtBlock 16 bytes block
+ */
+void
+nfc_mifare_classic_value_encode(const int32_t i32Value, const uint8_t ui8Address, uint8_t *pbtBlock)
+{
+  const uint32_t ui32Value = (uint32_t) i32Value;
+
+  for (size_t i = 0; i < 4; i++) {
+    pbtBlock[i] = pbtBlock[8 + i] = (ui32Value >> (8 * i)) & 0xff;
+    pbtBlock[4 + i] = ~pbtBlock[i];
+  }
+  pbtBlock[12] = pbtBlock[14] = ui8Address;
+  pbtBlock[13] = pbtBlock[15] = ~ui8Address;
+}
+
+// Authenticate, read and check the value, then change it in the card and store the result back in the same block
+static int
+mifare_classic_value_update(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey,
+                            const mifare_cmd mc, const uint32_t ui32Amount, int32_t *pi32Balance)
+{
+  uint8_t abtBlock[MIFARE_CLASSIC_BLOCK_LEN];
+  int32_t i32Value;
+  int res;
+
+  if ((ui32Amount > INT32_MAX) || ((ui8Block < 128) ? ((ui8Block % 4) == 3) : ((ui8Block % 16) == 15)))
+    return NFC_EINVARG;
+
+  nfc_device_lock(pnd);
+  if (((res = nfc_mifare_classic_authenticate(pnd, pnt, ui8Block, mcAuth, pbtKey)) < 0) ||
+      ((res = mifare_classic_cmd(pnd, MC_READ, ui8Block, NULL, 0, abtBlock, sizeof(abtBlock))) < 0)) {
+    nfc_device_unlock(pnd);
+    return res;
+  }
+  if ((res != MIFARE_CLASSIC_BLOCK_LEN) || ((res = nfc_mifare_classic_value_decode(abtBlock, &i32Value, NULL)) < 0)) {
+    nfc_device_unlock(pnd);
+    return NFC_EIO;
+  }
+  *pi32Balance = i32Value;
+  // The card wraps around silently, refuse what doesn't fit
+  if ((mc == MC_DECREMENT) ? (i32Value < (int32_t) ui32Amount) : (i32Value > (int32_t)(INT32_MAX - ui32Amount))) {
+    nfc_device_unlock(pnd);
+    return NFC_EINVARG;
+  }
+
+  // DECREMENT/INCREMENT only change the card internal register, TRANSFER writes it
+  const uint8_t abtAmount[4] = { ui32Amount & 0xff, (ui32Amount >> 8) & 0xff, (ui32Amount >> 16) & 0xff, (ui32Amount >> 24) & 0xff };
+  if (((res = mifare_classic_cmd(pnd, mc, ui8Block, abtAmount, sizeof(abtAmount), NULL, 0)) >= 0) &&
+      ((res = mifare_classic_cmd(pnd, MC_TRANSFER, ui8Block, NULL, 0, NULL, 0)) >= 0)) {
+    // TRANSFER is acknowledged, the new value is known without reading it back
+    *pi32Balance = (mc == MC_DECREMENT) ? (i32Value - (int32_t) ui32Amount) : (i32Value + (int32_t) ui32Amount);
+    res = NFC_SUCCESS;
+  }
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup mifare
+ * @brief Debit a MIFARE Classic value block
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Block value block
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKey 6 bytes key
+ * @param ui32Amount amount to take off the balance
+ * @param[out] pi32Balance balance after the debit, or the current balance when nothing was debited
+ *
+ * The whole debit runs while the device is held, in four commands: authentication, READ checking the
+ * value block format and the balance, DECREMENT and TRANSFER; the new balance is deduced, not read back.
+ * \c NFC_EIO is returned when the block is not a valid value block, \c NFC_EINVARG when the balance is
+ * lower than \a ui32Amount.
+ */
+int
+nfc_mifare_classic_value_debit(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey,
+                               const uint32_t ui32Amount, int32_t *pi32Balance)
+{
+  return mifare_classic_value_update(pnd, pnt, ui8Block, mcAuth, pbtKey, MC_DECREMENT, ui32Amount, pi32Balance);
+}
+
+/** @ingroup mifare
+ * @brief Credit a MIFARE Classic value block
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Block value block
+ * @param mcAuth \c MC_AUTH_A or \c MC_AUTH_B
+ * @param pbtKey 6 bytes key
+ * @param ui32Amount amount to add to the balance
+ * @param[out] pi32Balance balance after the credit, or the current balance when nothing was credited
+ *
+ * Same sequence as nfc_mifare_classic_value_debit() with INCREMENT, \c NFC_EINVARG is returned when the
+ * balance would overflow.
+ */
+int
+nfc_mifare_classic_value_credit(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Block, const mifare_cmd mcAuth, const uint8_t *pbtKey,
+                                const uint32_t ui32Amount, int32_t *pi32Balance)
+{
+  return mifare_classic_value_update(pnd, pnt, ui8Block, mcAuth, pbtKey, MC_INCREMENT, ui32Amount, pi32Balance);
+}
+
+/** @ingroup mifare
+ * @brief Read the version of a MIFARE Ultralight EV1 or NTAG tag (GET_VERSION)
+ * @return Returns received bytes count (8) on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target, woken up again when it doesn't know the command
+ * @param pbtVersion buffer receiving vendor, product type, subtype, major and minor versions, storage size and protocol type
+ * @param szVersion size of \a pbtVersion
+ *
+ * Original MIFARE Ultralight and Ultralight C tags don't support GET_VERSION.
+ */
+int
+nfc_mifare_ultralight_get_version(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtVersion, const size_t szVersion)
+{
+  const uint8_t abtCmd[] = { MIFARE_ULTRALIGHT_GET_VERSION };
+  int res;
+
+  if (szVersion < MIFARE_ULTRALIGHT_VERSION_LEN)
+    return NFC_EINVARG;
+
+  nfc_device_lock(pnd);
+  if (((res = mifare_transceive(pnd, abtCmd, sizeof(abtCmd), pbtVersion, szVersion)) >= 0) && (res != MIFARE_ULTRALIGHT_VERSION_LEN))
+    res = NFC_EIO;
+  if ((res < 0) && (NFC_DRIVER(pnd)->initiator_select_passive_target))
+    mifare_classic_rewake(pnd, pnt);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup mifare
+ * @brief Number of pages of a MIFARE Ultralight EV1 or NTAG tag
+ * @return Returns pages count, 0 when the storage size is unknown
+ * @param pbtVersion version returned by nfc_mifare_ultralight_get_version()
+ */
+size_t
+nfc_mifare_ultralight_pages(const uint8_t *pbtVersion)
+{
+  // Storage size byte
+  switch (pbtVersion[6]) {
+    case 0x0b: // MF0UL11
+      return 20;
+    case 0x0e: // MF0UL21
+      return 41;
+    case 0x0f: // NTAG213
+      return 45;
+    case 0x11: // NTAG215
+      return 135;
+    case 0x13: // NTAG216
+      return 231;
+  }
+  return 0;
+}
+
+/** @ingroup mifare
+ * @brief Read a one-way counter of a MIFARE Ultralight EV1 or NTAG tag (READ_CNT)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param ui8Counter counter number (0..2, NTAG only have counter 2)
+ * @param[out] pui32Value counter value (24 bits)
+ */
+int
+nfc_mifare_ultralight_read_cnt(nfc_device *pnd, const uint8_t ui8Counter, uint32_t *pui32Value)
+{
+  const uint8_t abtCmd[] = { MIFARE_ULTRALIGHT_READ_CNT, ui8Counter };
+  uint8_t abtRx[3];
+  int res;
+
+  if ((res = mifare_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx))) < 0)
+    return res;
+  if (res != sizeof(abtRx))
+    return NFC_EIO;
+  // Least significant byte first
+  *pui32Value = abtRx[0] | (abtRx[1] << 8) | ((uint32_t) abtRx[2] << 16);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup mifare
+ * @brief Read consecutive pages of a MIFARE Ultralight or NTAG tag
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target
+ * @param ui8Page first page
+ * @param szPages number of pages to read
+ * @param pbtData buffer receiving the pages
+ * @param szData size of \a pbtData, at least 4 * \a szPages
+ *
+ * Pages are fetched with FAST_READ, \c MIFARE_ULTRALIGHT_FAST_READ_MAX_PAGES at
+ * once so that the answer fits a PN53x frame. When the tag doesn't know
+ * FAST_READ, it is woken up again and READ is used, 4 pages at once.
+ */
+int
+nfc_mifare_ultralight_read_pages(nfc_device *pnd, const nfc_target *pnt, const uint8_t ui8Page, const size_t szPages, uint8_t *pbtData, const size_t szData)
+{
+  bool bFastRead = true;
+  size_t szDone = 0;
+  int res = 0;
+
+  if ((szPages == 0) || (szData < szPages * MIFARE_ULTRALIGHT_PAGE_LEN) || (ui8Page + szPages > 256))
+    return NFC_EINVARG;
+
+  nfc_device_lock(pnd);
+  while (szDone < szPages) {
+    const uint8_t ui8First = ui8Page + szDone;
+    uint8_t *pbtRx = pbtData + (szDone * MIFARE_ULTRALIGHT_PAGE_LEN);
+    if (bFastRead) {
+      const size_t szChunk = MIN(szPages - szDone, MIFARE_ULTRALIGHT_FAST_READ_MAX_PAGES);
+      const uint8_t abtCmd[] = { MIFARE_ULTRALIGHT_FAST_READ, ui8First, ui8First + szChunk - 1 };
+      if ((res = mifare_transceive(pnd, abtCmd, sizeof(abtCmd), pbtRx, szChunk * MIFARE_ULTRALIGHT_PAGE_LEN)) == (int)(szChunk * MIFARE_ULTRALIGHT_PAGE_LEN)) {
+        szDone += szChunk;
+        continue;
+      }
+      // A tag which doesn't know FAST_READ NAKs it and halts
+      if ((szDone > 0) || (!NFC_DRIVER(pnd)->initiator_select_passive_target) || ((res = mifare_classic_rewake(pnd, pnt)) < 0))
+        break;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "FAST_READ not supported, using READ");
+      bFastRead = false;
+    }
+    // READ answers 4 pages, rolling over at the end of memory
+    uint8_t abtRx[MIFARE_CLASSIC_BLOCK_LEN];
+    const size_t szChunk = MIN(szPages - szDone, sizeof(abtRx) / MIFARE_ULTRALIGHT_PAGE_LEN);
+    if ((res = mifare_classic_cmd(pnd, MC_READ, ui8First, NULL, 0, abtRx, sizeof(abtRx))) < 0)
+      break;
+    if (res != sizeof(abtRx)) {
+      res = NFC_EIO;
+      break;
+    }
+    memcpy(pbtRx, abtRx, szChunk * MIFARE_ULTRALIGHT_PAGE_LEN);
+    szDone += szChunk;
+  }
+  nfc_device_unlock(pnd);
+  if ((res < 0) || (szDone < szPages))
+    return (res < 0) ? res : NFC_EIO;
+  return szPages * MIFARE_ULTRALIGHT_PAGE_LEN;
+}
@@ -0,0 +1,529 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+
+/**
+ * @file nfc-ndef.c
+ * @brief Provide NDEF messages parsing and reading from NFC Forum tags on top of libnfc
+ *
+ * Records and TLV blocks are parsed in place: nothing is copied, parsed
+ * structures point into the given buffer. nfc_ndef_read() only fetches the
+ * bytes the NDEF message needs, following the tag mapping from its
+ * capability container down to the message.
+ */
+
+/**
+ * @defgroup ndef  NDEF
+ * This page details how to read and parse NDEF messages of NFC Forum Type 2, 3 and 4 Tags.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-felica.h>
+#include <nfc/nfc-mifare.h>
+#include <nfc/nfc-ndef.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.ndef"
+
+#define SAK_ISO14443_4_COMPLIANT 0x20
+#define SAK_MIFARE_CLASSIC 0x08
+
+// Type 2 Tag: capability container page, its magic number and the data area behind it
+#define NDEF_T2_CC_PAGE  3
+#define NDEF_T2_MAGIC  0xe1
+#define NDEF_T2_DATA_PAGE  4
+// READ answers 4 pages: the capability container and the first 12 bytes of the data area
+#define NDEF_T2_READ_LEN  16
+// Data area size is given by the capability container in units of 8 bytes
+#define NDEF_T2_DATA_MAX_LEN  (0xff * 8)
+// Longest TLV header: type and 3-byte length
+#define NDEF_TLV_HEADER_MAX_LEN  4
+
+// Type 3 Tag attribute information block: checksum covers the first 14 bytes
+#define NDEF_T3_CHECKSUM_LEN  14
+
+// Type 4 Tag: capability container file and its NDEF file control TLV
+#define NDEF_T4_CC_FILE  0xe103
+#define NDEF_T4_CC_LEN  15
+#define NDEF_T4_NDEF_FILE_CONTROL_TLV  0x04
+// NLEN field ahead of the message in the NDEF file
+#define NDEF_T4_NLEN_LEN  2
+// READ BINARY data, within a short Le
+#define NDEF_T4_READ_MAX_LEN  0xff
+
+/* URI identifier codes of the URI record type definition */
+static const char *ndef_uri_prefixes[] = {
+  "", "http://www.", "https://www.", "http://", "https://", "tel:", "mailto:", "ftp://anonymous:anonymous@",
+  "ftp://ftp.", "ftps://", "sftp://", "smb://", "nfs://", "ftp://", "dav://", "news:",
+  "telnet://", "imap:", "rtsp://", "urn:", "pop:", "sip:", "sips:", "tftp:",
+  "btspp://", "btl2cap://", "btgoep://", "tcpobex://", "irdaobex://", "file://", "urn:epc:id:", "urn:epc:tag:",
+  "urn:epc:pat:", "urn:epc:raw:", "urn:epc:", "urn:nfc:",
+};
+
+/** @ingroup ndef
+ * @brief Start iterating over the records of a NDEF message
+ * @param pni iterator to initialize
+ * @param pbtMessage NDEF message, it must remain valid while records are used
+ * @param szMessage length of \a pbtMessage
+ */
+void
+nfc_ndef_iterator_init(nfc_ndef_iterator *pni, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  pni->pbtMessage = pbtMessage;
+  pni->szMessage = szMessage;
+  pni->szOffset = 0;
+}
+
+/** @ingroup ndef
+ * @brief Get the next record of a NDEF message
+ * @return Returns 1 when \a pnr is filled, 0 after the last record, otherwise returns libnfc's error code (negative value)
+ * @param pni iterator
+ * @param[out] pnr record, its fields point into the message
+ *
+ * Iteration ends after a record with the ME flag or at the end of the message.
+ * Chunked records (CF flag) are given one chunk at a time. A record which
+ * doesn't fit the rest of the message gives NFC_EIO.
+ */
+int
+nfc_ndef_iterator_next(nfc_ndef_iterator *pni, nfc_ndef_record *pnr)
+{
+  const uint8_t *pbt = pni->pbtMessage + pni->szOffset;
+  const size_t szLeft = pni->szMessage - pni->szOffset;
+  size_t sz = 0;
+
+  if (szLeft == 0)
+    return 0;
+  const uint8_t btHeader = pbt[sz++];
+  // Type length, payload length and optional ID length
+  const size_t szLengths = 1 + ((btHeader & NDEF_RECORD_SR) ? 1 : 4) + ((btHeader & NDEF_RECORD_IL) ? 1 : 0);
+  if (szLeft < 1 + szLengths)
+    return NFC_EIO;
+  pnr->btHeader = btHeader;
+  pnr->szType = pbt[sz++];
+  if (btHeader & NDEF_RECORD_SR) {
+    pnr->szPayload = pbt[sz++];
+  } else {
+    pnr->szPayload = ((uint32_t) pbt[sz] << 24) | ((uint32_t) pbt[sz + 1] << 16) | ((uint32_t) pbt[sz + 2] << 8) | pbt[sz + 3];
+    sz += 4;
+  }
+  pnr->szId = (btHeader & NDEF_RECORD_IL) ? pbt[sz++] : 0;
+  // Fields are checked one at a time so that lengths can't overflow
+  if (pnr->szType > szLeft - sz)
+    return NFC_EIO;
+  pnr->pbtType = pbt + sz;
+  sz += pnr->szType;
+  if (pnr->szId > szLeft - sz)
+    return NFC_EIO;
+  pnr->pbtId = pbt + sz;
+  sz += pnr->szId;
+  if (pnr->szPayload > szLeft - sz)
+    return NFC_EIO;
+  pnr->pbtPayload = pbt + sz;
+  sz += pnr->szPayload;
+  pni->szOffset = (btHeader & NDEF_RECORD_ME) ? pni->szMessage : pni->szOffset + sz;
+  return 1;
+}
+
+/** @ingroup ndef
+ * @brief Get the next TLV block of a Type 1 or Type 2 Tag data area
+ * @return Returns 1 when \a pntlv is filled, 0 on the Terminator TLV, otherwise returns libnfc's error code (negative value)
+ * @param pbtArea data area, or its first bytes
+ * @param szArea length of \a pbtArea
+ * @param[in,out] pszOffset offset of the next TLV, 0 to start, moved past the returned TLV
+ * @param[out] pntlv TLV block
+ *
+ * NULL TLVs are skipped and \a *pszOffset stays on the Terminator TLV.
+ * NFC_EOVFLOW is returned when \a pbtArea ends before the header of the next
+ * TLV: \a *pszOffset then tells how far the area must go, it is at least
+ * \a szArea when the area just ended. The value of a returned TLV may end
+ * beyond \a szArea.
+ */
+int
+nfc_ndef_tlv_next(const uint8_t *pbtArea, const size_t szArea, size_t *pszOffset, nfc_ndef_tlv *pntlv)
+{
+  size_t szOffset = *pszOffset;
+
+  while ((szOffset < szArea) && (pbtArea[szOffset] == NDEF_TLV_NULL))
+    szOffset++;
+  *pszOffset = szOffset;
+  if (szOffset >= szArea)
+    return NFC_EOVFLOW;
+  if (pbtArea[szOffset] == NDEF_TLV_TERMINATOR)
+    return 0;
+  if (szOffset + 2 > szArea)
+    return NFC_EOVFLOW;
+  pntlv->btType = pbtArea[szOffset];
+  if (pbtArea[szOffset + 1] == 0xff) {
+    // 3-byte length format
+    if (szOffset + NDEF_TLV_HEADER_MAX_LEN > szArea)
+      return NFC_EOVFLOW;
+    pntlv->szLength = (pbtArea[szOffset + 2] << 8) | pbtArea[szOffset + 3];
+    pntlv->szValueOffset = szOffset + NDEF_TLV_HEADER_MAX_LEN;
+  } else {
+    pntlv->szLength = pbtArea[szOffset + 1];
+    pntlv->szValueOffset = szOffset + 2;
+  }
+  *pszOffset = pntlv->szValueOffset + pntlv->szLength;
+  return 1;
+}
+
+/** @ingroup ndef
+ * @brief Get the URI of a URI record (well-known type "U") or an absolute URI record
+ * @return Returns the URI length on success, otherwise returns libnfc's error code (negative value)
+ * @param pnr record
+ * @param[out] pcUri buffer receiving the URI, nul-terminated
+ * @param szUri size of \a pcUri
+ *
+ * The URI identifier code of a URI record is expanded to its prefix. NFC_EINVARG
+ * is returned when the record has no URI, NFC_EOVFLOW when \a pcUri is too small.
+ */
+int
+nfc_ndef_record_uri(const nfc_ndef_record *pnr, char *pcUri, const size_t szUri)
+{
+  const char *pcPrefix = "";
+  const uint8_t *pbtUri;
+  size_t szRest;
+
+  switch (pnr->btHeader & NDEF_RECORD_TNF_MASK) {
+    case NDEF_TNF_WELL_KNOWN:
+      if ((pnr->szType != 1) || (pnr->pbtType[0] != 'U') || (pnr->szPayload < 1))
+        return NFC_EINVARG;
+      // Reserved identifier codes mean no prefix
+      if (pnr->pbtPayload[0] < sizeof(ndef_uri_prefixes) / sizeof(ndef_uri_prefixes[0]))
+        pcPrefix = ndef_uri_prefixes[pnr->pbtPayload[0]];
+      pbtUri = pnr->pbtPayload + 1;
+      szRest = pnr->szPayload - 1;
+      break;
+    case NDEF_TNF_ABSOLUTE_URI:
+      pbtUri = pnr->pbtType;
+      szRest = pnr->szType;
+      break;
+    default:
+      return NFC_EINVARG;
+  }
+  const size_t szPrefix = strlen(pcPrefix);
+  if ((szPrefix + szRest >= szUri) || (szPrefix + szRest > INT_MAX))
+    return NFC_EOVFLOW;
+  memcpy(pcUri, pcPrefix, szPrefix);
+  memcpy(pcUri + szPrefix, pbtUri, szRest);
+  pcUri[szPrefix + szRest] = '\0';
+  return (int)(szPrefix + szRest);
+}
+
+// Tag commands below rely on the chip framing, only switch it on when it is not already
+static int
+ndef_easy_framing(nfc_device *pnd)
+{
+  if (pnd->bEasyFraming)
+    return NFC_SUCCESS;
+  return nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true);
+}
+
+// Read Type 2 data area pages until *pszHave covers szNeeded bytes
+static int
+ndef_type2_fetch(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtArea, size_t *pszHave, const size_t szNeeded)
+{
+  if (szNeeded <= *pszHave)
+    return NFC_SUCCESS;
+  const size_t szPages = (szNeeded - *pszHave + MIFARE_ULTRALIGHT_PAGE_LEN - 1) / MIFARE_ULTRALIGHT_PAGE_LEN;
+  const int res = nfc_mifare_ultralight_read_pages(pnd, pnt, NDEF_T2_DATA_PAGE + (*pszHave / MIFARE_ULTRALIGHT_PAGE_LEN), szPages,
+                                                   pbtArea + *pszHave, szPages * MIFARE_ULTRALIGHT_PAGE_LEN);
+  if (res < 0)
+    return res;
+  *pszHave += szPages * MIFARE_ULTRALIGHT_PAGE_LEN;
+  return NFC_SUCCESS;
+}
+
+// Type 2: a READ of the capability container brings the first TLVs, the rest is fetched on demand
+static int
+ndef_type2_read(nfc_device *pnd, const nfc_target *pnt, uint8_t *pbtMessage, const size_t szMessage, nfc_ndef_info *pnni)
+{
+  // Capability container, then the data area
+  uint8_t abtMemory[MIFARE_ULTRALIGHT_PAGE_LEN + NDEF_T2_DATA_MAX_LEN];
+  uint8_t *pbtArea = abtMemory + MIFARE_ULTRALIGHT_PAGE_LEN;
+  const uint8_t abtRead[] = { MC_READ, NDEF_T2_CC_PAGE };
+  int res;
+
+  if ((res = ndef_easy_framing(pnd)) < 0)
+    return res;
+  if ((res = nfc_initiator_transceive_bytes(pnd, abtRead, sizeof(abtRead), abtMemory, NDEF_T2_READ_LEN, -1)) < 0)
+    return res;
+  if (res != NDEF_T2_READ_LEN)
+    return NFC_EIO;
+  if (abtMemory[0] != NDEF_T2_MAGIC) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Type 2 Tag is not NDEF formatted");
+    return NFC_EDEVNOTSUPP;
+  }
+  const size_t szArea = abtMemory[2] * 8;
+  pnni->btVersion = abtMemory[1];
+  pnni->bReadOnly = ((abtMemory[3] & 0x0f) != 0x00);
+  // NDEF TLV header included, other TLVs are not accounted
+  pnni->szCapacity = (szArea > 0xff + NDEF_TLV_HEADER_MAX_LEN) ? szArea - NDEF_TLV_HEADER_MAX_LEN : ((szArea > 2) ? szArea - 2 : 0);
+
+  size_t szHave = MIN(NDEF_T2_READ_LEN - MIFARE_ULTRALIGHT_PAGE_LEN, szArea);
+  size_t szOffset = 0;
+  nfc_ndef_tlv tlv;
+  for (;;) {
+    if ((res = nfc_ndef_tlv_next(pbtArea, szHave, &szOffset, &tlv)) == NFC_EOVFLOW) {
+      // Next TLV header is not read yet
+      const size_t szNeeded = MIN(szOffset + NDEF_TLV_HEADER_MAX_LEN, szArea);
+      if (szNeeded <= szHave)
+        return NFC_EDEVNOTSUPP;
+      if ((res = ndef_type2_fetch(pnd, pnt, pbtArea, &szHave, szNeeded)) < 0)
+        return res;
+      szHave = MIN(szHave, szArea);
+      continue;
+    }
+    if (res < 0)
+      return res;
+    if (res == 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "No NDEF Message TLV");
+      return NFC_EDEVNOTSUPP;
+    }
+    if (tlv.btType == NDEF_TLV_NDEF_MESSAGE)
+      break;
+  }
+  if (tlv.szValueOffset + tlv.szLength > szArea)
+    return NFC_EIO;
+  pnni->szLength = tlv.szLength;
+  if (tlv.szLength > szMessage)
+    return NFC_EOVFLOW;
+  if ((res = ndef_type2_fetch(pnd, pnt, pbtArea, &szHave, tlv.szValueOffset + tlv.szLength)) < 0)
+    return res;
+  memcpy(pbtMessage, pbtArea + tlv.szValueOffset, tlv.szLength);
+  return (int) tlv.szLength;
+}
+
+// Type 3: one Check for the attribute information block, then Checks of as many blocks as the tag allows
+static int
+ndef_type3_read(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtMessage, const size_t szMessage, nfc_ndef_info *pnni)
+{
+  uint8_t abtAttr[FELICA_BLOCK_LEN];
+  int res;
+
+  if ((res = nfc_felica_check(pnd, pnt, FELICA_SERVICE_NDEF_READ, 0, 1, 1, abtAttr, sizeof(abtAttr))) < 0)
+    return res;
+  uint16_t ui16Checksum = 0;
+  for (size_t n = 0; n < NDEF_T3_CHECKSUM_LEN; n++)
+    ui16Checksum += abtAttr[n];
+  if (ui16Checksum != ((abtAttr[14] << 8) | abtAttr[15])) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Attribute information block checksum mismatch");
+    return NFC_EIO;
+  }
+  const uint8_t ui8MaxBlocks = abtAttr[1];
+  const size_t szBlocks = (abtAttr[3] << 8) | abtAttr[4];
+  const size_t szLength = ((size_t) abtAttr[11] << 16) | (abtAttr[12] << 8) | abtAttr[13];
+  pnni->btVersion = abtAttr[0];
+  pnni->bReadOnly = (abtAttr[10] != 0x01);
+  pnni->szCapacity = szBlocks * FELICA_BLOCK_LEN;
+  pnni->szLength = szLength;
+  if (szLength > pnni->szCapacity)
+    return NFC_EIO;
+  if (szLength > szMessage)
+    return NFC_EOVFLOW;
+  if (szLength == 0)
+    return 0;
+
+  // Message blocks follow the attribute information block, they go straight to pbtMessage when it is large enough
+  const size_t szCheck = (szLength + FELICA_BLOCK_LEN - 1) / FELICA_BLOCK_LEN;
+  uint8_t *pbtBlocks = (szMessage >= szCheck * FELICA_BLOCK_LEN) ? pbtMessage : malloc(szCheck * FELICA_BLOCK_LEN);
+  if (!pbtBlocks)
+    return NFC_ESOFT;
+  res = nfc_felica_check(pnd, pnt, FELICA_SERVICE_NDEF_READ, 1, szCheck, ui8MaxBlocks, pbtBlocks, szCheck * FELICA_BLOCK_LEN);
+  if (pbtBlocks != pbtMessage) {
+    if (res >= 0)
+      memcpy(pbtMessage, pbtBlocks, szLength);
+    free(pbtBlocks);
+  }
+  return (res < 0) ? res : (int) szLength;
+}
+
+// Send an APDU, returns the answer data length once SW1-SW2 is 90 00
+static int
+ndef_type4_apdu(nfc_device *pnd, const uint8_t *pbtCapdu, const size_t szCapdu, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+  if ((res = nfc_initiator_transceive_bytes(pnd, pbtCapdu, szCapdu, pbtRx, szRx, -1)) < 0)
+    return res;
+  if (res < 2)
+    return NFC_EIO;
+  if ((pbtRx[res - 2] != 0x90) || (pbtRx[res - 1] != 0x00)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "APDU %02x failed: SW %02x %02x", pbtCapdu[1], pbtRx[res - 2], pbtRx[res - 1]);
+    return NFC_EIO;
+  }
+  return res - 2;
+}
+
+// SELECT of an elementary file by its identifier
+static int
+ndef_type4_select_file(nfc_device *pnd, const uint16_t ui16File)
+{
+  const uint8_t abtSelect[] = { 0x00, 0xa4, 0x00, 0x0c, 0x02, ui16File >> 8, ui16File & 0xff };
+  uint8_t abtRx[2];
+  return ndef_type4_apdu(pnd, abtSelect, sizeof(abtSelect), abtRx, sizeof(abtRx));
+}
+
+// READ BINARY of szLe bytes (NDEF_T4_READ_MAX_LEN at most) at ui16Offset of the selected file
+static int
+ndef_type4_read_binary(nfc_device *pnd, const uint16_t ui16Offset, const size_t szLe, uint8_t *pbtRx)
+{
+  const uint8_t abtRead[] = { 0x00, 0xb0, ui16Offset >> 8, ui16Offset & 0xff, szLe };
+  return ndef_type4_apdu(pnd, abtRead, sizeof(abtRead), pbtRx, szLe + 2);
+}
+
+// Type 4: application and capability container, then the NDEF file whose first READ BINARY brings NLEN and the message start
+static int
+ndef_type4_read(nfc_device *pnd, uint8_t *pbtMessage, const size_t szMessage, nfc_ndef_info *pnni)
+{
+  const uint8_t abtSelectApp[] = { 0x00, 0xa4, 0x04, 0x00, 0x07, 0xd2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00 };
+  uint8_t abtRx[NDEF_T4_READ_MAX_LEN + 2];
+  int res;
+
+  if ((res = ndef_easy_framing(pnd)) < 0)
+    return res;
+  if ((res = ndef_type4_apdu(pnd, abtSelectApp, sizeof(abtSelectApp), abtRx, sizeof(abtRx))) < 0)
+    return res;
+  if ((res = ndef_type4_select_file(pnd, NDEF_T4_CC_FILE)) < 0)
+    return res;
+  if ((res = ndef_type4_read_binary(pnd, 0, NDEF_T4_CC_LEN, abtRx)) < 0)
+    return res;
+  if (res < NDEF_T4_CC_LEN)
+    return NFC_EIO;
+  if ((abtRx[7] != NDEF_T4_NDEF_FILE_CONTROL_TLV) || (abtRx[8] < 6)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unsupported capability container, mapping version %02x", abtRx[2]);
+    return NFC_EDEVNOTSUPP;
+  }
+  const size_t szMaxLe = (abtRx[3] << 8) | abtRx[4];
+  const uint16_t ui16File = (abtRx[9] << 8) | abtRx[10];
+  const size_t szFile = (abtRx[11] << 8) | abtRx[12];
+  pnni->btVersion = abtRx[2];
+  pnni->bReadOnly = (abtRx[14] != 0x00);
+  pnni->szCapacity = (szFile > NDEF_T4_NLEN_LEN) ? szFile - NDEF_T4_NLEN_LEN : 0;
+  if ((szMaxLe == 0) || (szFile < NDEF_T4_NLEN_LEN) || (abtRx[13] != 0x00))
+    return NFC_EDEVNOTSUPP;
+  const size_t szChunk = MIN(szMaxLe, NDEF_T4_READ_MAX_LEN);
+
+  if ((res = ndef_type4_select_file(pnd, ui16File)) < 0)
+    return res;
+  if ((res = ndef_type4_read_binary(pnd, 0, MIN(szChunk, szFile), abtRx)) < 0)
+    return res;
+  if (res < NDEF_T4_NLEN_LEN)
+    return NFC_EIO;
+  const size_t szLength = (abtRx[0] << 8) | abtRx[1];
+  pnni->szLength = szLength;
+  if (szLength > pnni->szCapacity)
+    return NFC_EIO;
+  if (szLength > szMessage)
+    return NFC_EOVFLOW;
+  size_t szDone = MIN((size_t) res - NDEF_T4_NLEN_LEN, szLength);
+  memcpy(pbtMessage, abtRx + NDEF_T4_NLEN_LEN, szDone);
+  while (szDone < szLength) {
+    const size_t szLe = MIN(szChunk, szLength - szDone);
+    if ((res = ndef_type4_read_binary(pnd, NDEF_T4_NLEN_LEN + szDone, szLe, pbtMessage + szDone)) < 0)
+      return res;
+    if (res == 0)
+      return NFC_EIO;
+    szDone += MIN((size_t) res, szLe);
+  }
+  return (int) szLength;
+}
+
+/** @ingroup ndef
+ * @brief Read the NDEF message of a NFC Forum Type 2, 3 or 4 Tag
+ * @return Returns the message length on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected target, updated when it is polled again at a higher speed (see nfc_felica_check())
+ * @param[out] pbtMessage buffer receiving the NDEF message
+ * @param szMessage size of \a pbtMessage
+ * @param[out] pnni optional NDEF mapping of the tag, filled as far as it was read
+ *
+ * Only the bytes covered by the NDEF message are fetched:
+ * - Type 2 Tags (ISO14443A without ISO14443-4, eg. MIFARE Ultralight or NTAG):
+ *   one READ brings the capability container with the first TLVs, remaining
+ *   pages are read with nfc_mifare_ultralight_read_pages() once the NDEF
+ *   Message TLV length is known;
+ * - Type 3 Tags (FeliCa): a Check of the attribute information block, then
+ *   Checks of as many blocks as the tag accepts at once;
+ * - Type 4 Tags (ISO14443-4A or B): the NDEF application and its capability
+ *   container are selected, then the first READ BINARY of the NDEF file gets
+ *   its length along with the beginning of the message.
+ *
+ * A short URI message is thus read in two commands on Type 2 and Type 3 Tags.
+ * NFC_EOVFLOW is returned before reading the message when \a pbtMessage is too
+ * small, \a pnni then gives its length. Tags without NDEF mapping give
+ * NFC_EDEVNOTSUPP.
+ *
+ * @note Type 2 Tags reserved memory areas (lock and memory control TLVs) are
+ * expected after the NDEF message, and only the first 256 pages are read.
+ * @note The Type 3 Tag must have been selected with the NDEF system code (12 FC).
+ */
+int
+nfc_ndef_read(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtMessage, const size_t szMessage, nfc_ndef_info *pnni)
+{
+  nfc_ndef_info nni;
+  int res;
+
+  memset(&nni, 0, sizeof(nni));
+  nfc_device_lock(pnd);
+  switch (pnt->nm.nmt) {
+    case NMT_FELICA:
+      res = ndef_type3_read(pnd, pnt, pbtMessage, szMessage, &nni);
+      break;
+    case NMT_ISO14443A:
+      if (pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) {
+        res = ndef_type4_read(pnd, pbtMessage, szMessage, &nni);
+      } else if (pnt->nti.nai.btSak & SAK_MIFARE_CLASSIC) {
+        // MIFARE Classic NDEF mapping relies on the MAD, not handled
+        res = NFC_EDEVNOTSUPP;
+      } else {
+        res = ndef_type2_read(pnd, pnt, pbtMessage, szMessage, &nni);
+      }
+      break;
+    case NMT_ISO14443B:
+      res = ndef_type4_read(pnd, pbtMessage, szMessage, &nni);
+      break;
+    default:
+      res = NFC_EDEVNOTSUPP;
+      break;
+  }
+  nfc_device_unlock(pnd);
+  if (pnni)
+    *pnni = nni;
+  // Errors of the mapping itself are reported by nfc_perror() too
+  if (res < 0)
+    pnd->last_error = res;
+  return res;
+}
@@ -0,0 +1,288 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-rf-profile.c
+ * @brief RF analog calibration against a reference card and per-device RF profiles
+ *
+ * nfc_initiator_calibrate_rf() sweeps the receiver gain and driver
+ * conductances of ISO/IEC 14443 type A at 106 kbps and keeps the settings
+ * giving the most reliable exchanges. With the rf_profiles option, these
+ * settings are stored in a text file, one "<connstring> <hex settings>" line
+ * per device, and given back to the device each time it is opened.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#  include <unistd.h>
+#endif
+
+#include <nfc/nfc.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.rf-profile"
+
+// Large enough for any frame the chip can receive
+#define RF_CALIBRATION_RX_LEN 264
+
+// Chip defaults of NRA_TYPE_A_106, the base of every settings tried
+static const uint8_t rf_analog_a106_defaults[NFC_RF_ANALOG_MAX_LEN] = { 0x59, 0xf4, 0x3f, 0x11, 0x4d, 0x85, 0x61, 0x6f, 0x26, 0x62, 0x87 };
+
+// Swept values: RxGain of CIU_RFCfg, CWGsN of CIU_GsNOn and CIU_CWGsP
+static const uint8_t rf_sweep_rx_gains[] = { 0x4, 0x5, 0x6, 0x7 };
+static const uint8_t rf_sweep_cwgsn[] = { 0xf, 0xa, 0x6 };
+static const uint8_t rf_sweep_cwgsp[] = { 0x3f, 0x2a, 0x15 };
+
+// Parse a "<connstring> <hex settings>" line, false for comments and malformed lines
+static bool
+rf_profile_parse(const char *line, char *connstring, uint8_t *pbtSettings)
+{
+  const char *sep = strrchr(line, ' ');
+
+  if ((line[0] == '#') || (sep == NULL) || ((size_t)(sep - line) >= sizeof(nfc_connstring)) || (strlen(sep + 1) < 2 * NFC_RF_ANALOG_MAX_LEN))
+    return false;
+  memcpy(connstring, line, sep - line);
+  connstring[sep - line] = '\0';
+  for (size_t n = 0; n < NFC_RF_ANALOG_MAX_LEN; n++) {
+    unsigned int ui;
+    if (sscanf(sep + 1 + (2 * n), "%2x", &ui) != 1)
+      return false;
+    pbtSettings[n] = ui;
+  }
+  return true;
+}
+
+// Store the settings of a device, through a temporary file so readers never see it partially written
+static int
+rf_profile_store(const char *filename, const char *connstring, const uint8_t *pbtSettings)
+{
+  char tmp_file[BUFSIZ];
+#ifndef WIN32
+  snprintf(tmp_file, sizeof(tmp_file), "%s.%ld", filename, (long) getpid());
+#else
+  snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", filename);
+#endif
+  FILE *fout = fopen(tmp_file, "w");
+  if (!fout) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write RF profiles: %s", tmp_file);
+    return NFC_ESOFT;
+  }
+
+  bool ok = true;
+  FILE *fin = fopen(filename, "r");
+  if (fin) {
+    // Keep profiles of other devices
+    char line[BUFSIZ];
+    while (fgets(line, sizeof(line), fin) != NULL) {
+      nfc_connstring ncs;
+      uint8_t abtSettings[NFC_RF_ANALOG_MAX_LEN];
+      if (rf_profile_parse(line, ncs, abtSettings) && (strcmp(ncs, connstring) == 0))
+        continue;
+      ok = ok && (fputs(line, fout) >= 0);
+      if (line[strlen(line) - 1] != '\n')
+        ok = ok && (fputc('\n', fout) != EOF);
+    }
+    fclose(fin);
+  } else {
+    ok = (fputs("# RF analog settings (NRA_TYPE_A_106) of each device, written by nfc_initiator_calibrate_rf()\n", fout) >= 0);
+  }
+  ok = ok && (fprintf(fout, "%s ", connstring) > 0);
+  for (size_t n = 0; n < NFC_RF_ANALOG_MAX_LEN; n++) {
+    ok = ok && (fprintf(fout, "%02x", pbtSettings[n]) > 0);
+  }
+  ok = ok && (fputc('\n', fout) != EOF);
+  ok = (fclose(fout) == 0) && ok;
+  if (!ok || (rename(tmp_file, filename) != 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write RF profiles: %s", filename);
+    remove(tmp_file);
+    return NFC_ESOFT;
+  }
+  return NFC_SUCCESS;
+}
+
+// Give a freshly opened device the settings stored for its connstring, if any
+void
+nfc_rf_profile_apply(nfc_device *pnd)
+{
+  const char *filename = pnd->context->rf_profile_file;
+  if (filename == NULL)
+    return;
+  FILE *f = fopen(filename, "r");
+  if (!f)
+    return;
+
+  char line[BUFSIZ];
+  nfc_connstring ncs;
+  uint8_t abtSettings[NFC_RF_ANALOG_MAX_LEN];
+  bool found = false;
+  while (!found && (fgets(line, sizeof(line), f) != NULL)) {
+    found = rf_profile_parse(line, ncs, abtSettings) && (strcmp(ncs, pnd->connstring) == 0);
+  }
+  fclose(f);
+  if (!found)
+    return;
+
+  if (nfc_device_set_rf_analog(pnd, NRA_TYPE_A_106, abtSettings, sizeof(abtSettings)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to apply RF profile of %s: %s", pnd->connstring, nfc_strerror(pnd));
+    pnd->last_error = 0;
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "RF profile of %s applied", pnd->connstring);
+  }
+}
+
+// Run the trials of the settings of pnrc against the reference card
+static int
+rf_calibration_trials(nfc_device *pnd, const nfc_target *pntReference, const uint8_t *pbtTx, const size_t szTx, nfc_rf_calibration *pnrc)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  const nfc_iso14443a_info *pnai = &pntReference->nti.nai;
+  uint64_t ui64Cycles = 0;
+  int res;
+
+  if ((res = nfc_device_set_rf_analog(pnd, NRA_TYPE_A_106, pnrc->abtSettings, sizeof(pnrc->abtSettings))) < 0)
+    return res;
+  pnrc->uiSuccesses = 0;
+  for (unsigned int n = 0; n < pnrc->uiTrials; n++) {
+    // Switching the field off resets the card, so each trial is a first try
+    if (((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0) ||
+        ((res = nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, true)) < 0))
+      return res;
+    nfc_target nt;
+    if (nfc_initiator_select_passive_target(pnd, nm, pnai->abtUid, pnai->szUidLen, &nt) <= 0)
+      continue;
+    uint8_t abtRx[RF_CALIBRATION_RX_LEN];
+    uint32_t cycles = 0;
+    res = nfc_initiator_transceive_bytes_timed(pnd, pbtTx, szTx, abtRx, sizeof(abtRx), &cycles);
+    if ((res == NFC_EIO) || (res == NFC_EINVARG) || (res == NFC_ENOTIMPL) || (res == NFC_EDEVNOTSUPP))
+      return res;
+    // No answer within the timer range is not an error for timed exchanges
+    if (res <= 0)
+      continue;
+    pnrc->uiSuccesses++;
+    ui64Cycles += cycles;
+  }
+  pnrc->ui32MeanCycles = (pnrc->uiSuccesses) ? (uint32_t)(ui64Cycles / pnrc->uiSuccesses) : 0;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Find the RF analog settings giving the most reliable exchanges with a reference card
+ * @return Returns successful trials count of the best settings, 0 if no reference card answered, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx frame sent to the card at each trial, without CRC (e.g. 30 00 to read a MIFARE Ultralight)
+ * @param szTx size of \a pbtTx
+ * @param uiTrials trials made with each settings
+ * @param[out] pnrc best settings and their results, may be \c NULL
+ *
+ * An ISO/IEC 14443 type A card must lie still on the antenna during the calibration. The receiver gain
+ * (CIU_RFCfg) and the driver conductances (CIU_GsNOn, CIU_CWGsP) are swept around the chip defaults of
+ * \a NRA_TYPE_A_106. A trial switches the field off and on, selects the card found first then sends \a pbtTx
+ * with nfc_initiator_transceive_bytes_timed() at ISO/IEC 14443-3 level: settings are ranked by successful
+ * trials first, then by mean answer latency.
+ *
+ * The best settings are applied to the device and, when \e rf_profiles option (or LIBNFC_RF_PROFILES
+ * environment variable) is set, stored for its connstring so nfc_open() applies them again. If no
+ * reference card answered, chip defaults are applied instead.
+ *
+ * @note This takes 36 x \a uiTrials trials, ie. a few seconds with 10 trials.
+ * @note Device is initialized again as initiator, see nfc_initiator_init().
+ */
+int
+nfc_initiator_calibrate_rf(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const unsigned int uiTrials, nfc_rf_calibration *pnrc)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_rf_calibration nrcBest;
+  nfc_target ntReference;
+  int res;
+
+  if ((pbtTx == NULL) || (szTx == 0) || (uiTrials == 0)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  memset(&nrcBest, 0, sizeof(nrcBest));
+  memcpy(nrcBest.abtSettings, rf_analog_a106_defaults, sizeof(nrcBest.abtSettings));
+  nrcBest.uiTrials = uiTrials;
+
+  // Find the reference card with chip defaults, trials only select this one
+  if (((res = nfc_device_set_rf_analog(pnd, NRA_TYPE_A_106, rf_analog_a106_defaults, sizeof(rf_analog_a106_defaults))) < 0) ||
+      ((res = nfc_initiator_init(pnd)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, false)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) ||
+      ((res = nfc_initiator_select_passive_target(pnd, nm, NULL, 0, &ntReference)) <= 0)) {
+    nfc_initiator_init(pnd);
+    return res;
+  }
+
+  for (size_t g = 0; g < sizeof(rf_sweep_rx_gains); g++) {
+    for (size_t n = 0; n < sizeof(rf_sweep_cwgsn); n++) {
+      for (size_t p = 0; p < sizeof(rf_sweep_cwgsp); p++) {
+        nfc_rf_calibration nrc = nrcBest;
+        nrc.abtSettings[0] = (rf_analog_a106_defaults[0] & 0x8f) | (rf_sweep_rx_gains[g] << 4);
+        nrc.abtSettings[1] = (rf_analog_a106_defaults[1] & 0x0f) | (rf_sweep_cwgsn[n] << 4);
+        nrc.abtSettings[2] = rf_sweep_cwgsp[p];
+        if ((res = rf_calibration_trials(pnd, &ntReference, pbtTx, szTx, &nrc)) < 0) {
+          nfc_initiator_init(pnd);
+          return res;
+        }
+        nrcBest.uiProfiles++;
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "RF settings %02x %02x %02x: %u/%u, %"PRIu32" cycles",
+                nrc.abtSettings[0], nrc.abtSettings[1], nrc.abtSettings[2], nrc.uiSuccesses, uiTrials, nrc.ui32MeanCycles);
+        if ((nrc.uiSuccesses > nrcBest.uiSuccesses) ||
+            ((nrc.uiSuccesses > 0) && (nrc.uiSuccesses == nrcBest.uiSuccesses) && (nrc.ui32MeanCycles < nrcBest.ui32MeanCycles))) {
+          nrc.uiProfiles = nrcBest.uiProfiles;
+          nrcBest = nrc;
+        }
+      }
+    }
+  }
+  if (nrcBest.uiSuccesses == 0) {
+    memcpy(nrcBest.abtSettings, rf_analog_a106_defaults, sizeof(nrcBest.abtSettings));
+  }
+
+  if (((res = nfc_device_set_rf_analog(pnd, NRA_TYPE_A_106, nrcBest.abtSettings, sizeof(nrcBest.abtSettings))) < 0) ||
+      ((res = nfc_initiator_init(pnd)) < 0))
+    return res;
+  if ((nrcBest.uiSuccesses > 0) && pnd->context->rf_profile_file &&
+      ((res = rf_profile_store(pnd->context->rf_profile_file, pnd->connstring, nrcBest.abtSettings)) < 0)) {
+    pnd->last_error = res;
+    return res;
+  }
+  if (pnrc)
+    *pnrc = nrcBest;
+  return nrcBest.uiSuccesses;
+}
@@ -0,0 +1,61 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-trace.h
+ * @brief Static tracepoints (USDT) in chip and bus hot paths
+ *
+ * Probes are compiled in with --enable-usdt (or LIBNFC_USDT with CMake) and
+ * cost a single nop while no tracer is attached; otherwise they expand to
+ * nothing. They live in the "libnfc" provider, eg.:
+ *
+ *   bpftrace -e 'usdt:/usr/lib/libnfc.so:libnfc:transceive__done { printf("%x %x %d\n", arg0, arg1, arg2); }'
+ *
+ * Probes and arguments:
+ *  - transceive__start(command, tx length)
+ *  - transceive__done(command, status byte, result)
+ *  - mi__continuation(command, chunk length, chained length)
+ *  - register__flush(registers written, extra bytes)
+ *  - uart__send, uart__receive, i2c__write, i2c__read(length, result)
+ *  - spi__transfer(tx length, rx length, result)
+ *  - usb__bulk__read(length, libusb transfer status, received length)
+ */
+
+#ifndef __NFC_TRACE_H__
+#define __NFC_TRACE_H__
+
+#ifdef USDT
+#  include <sys/sdt.h>
+#  define NFC_TRACE1(name, a1) DTRACE_PROBE1(libnfc, name, a1)
+#  define NFC_TRACE2(name, a1, a2) DTRACE_PROBE2(libnfc, name, a1, a2)
+#  define NFC_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(libnfc, name, a1, a2, a3)
+#else
+#  define NFC_TRACE1(name, a1) do {} while (0)
+#  define NFC_TRACE2(name, a1, a2) do {} while (0)
+#  define NFC_TRACE3(name, a1, a2, a3) do {} while (0)
+#endif
+
+#endif // __NFC_TRACE_H__
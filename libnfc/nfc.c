@@ -83,6 +83,8 @@
 #include <nfc/nfc.h>
 
 #include "nfc-internal.h"
+#include "conf.h"
+#include "nfc-capture.h"
 #include "target-subr.h"
 #include "drivers.h"
 
@@ -118,6 +120,26 @@
 #  include "drivers/pn532_i2c.h"
 #endif /* DRIVER_PN532_I2C_ENABLED */
 
+#if defined (DRIVER_VIRTUAL_ENABLED)
+#  include "drivers/virtual.h"
+#endif /* DRIVER_VIRTUAL_ENABLED */
+
+#if defined (DRIVER_REPLAY_ENABLED)
+#  include "drivers/replay.h"
+#endif /* DRIVER_REPLAY_ENABLED */
+
+#if defined (DRIVER_REMOTE_ENABLED)
+#  include "drivers/remote.h"
+#endif /* DRIVER_REMOTE_ENABLED */
+
+#if defined (DRIVER_MUX_ENABLED)
+#  include "drivers/mux.h"
+#endif /* DRIVER_MUX_ENABLED */
+
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+#  include "buses/usbbus.h"
+#endif
+
 
 #define LOG_CATEGORY "libnfc.general"
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
@@ -127,35 +149,199 @@ struct nfc_driver_list {
   const struct nfc_driver *driver;
 };
 
+// Drivers registered with nfc_register_driver(), tried before the built-in ones
 const struct nfc_driver_list *nfc_drivers = NULL;
 
+// Built-in drivers, in scan order
+static const struct nfc_driver *const nfc_builtin_drivers[] = {
+#if defined (DRIVER_REPLAY_ENABLED)
+  &replay_driver,
+#endif /* DRIVER_REPLAY_ENABLED */
+#if defined (DRIVER_VIRTUAL_ENABLED)
+  &virtual_driver,
+#endif /* DRIVER_VIRTUAL_ENABLED */
+#if defined (DRIVER_REMOTE_ENABLED)
+  &remote_driver,
+#endif /* DRIVER_REMOTE_ENABLED */
+#if defined (DRIVER_MUX_ENABLED)
+  &mux_driver,
+#endif /* DRIVER_MUX_ENABLED */
+#if defined (DRIVER_ARYGON_ENABLED)
+  &arygon_driver,
+#endif /* DRIVER_ARYGON_ENABLED */
+#if defined (DRIVER_PN532_I2C_ENABLED)
+  &pn532_i2c_driver,
+#endif /* DRIVER_PN532_I2C_ENABLED */
+#if defined (DRIVER_PN532_SPI_ENABLED)
+  &pn532_spi_driver,
+#endif /* DRIVER_PN532_SPI_ENABLED */
+#if defined (DRIVER_PN532_UART_ENABLED)
+  &pn532_uart_driver,
+#endif /* DRIVER_PN532_UART_ENABLED */
+#if defined (DRIVER_ACR122S_ENABLED)
+  &acr122s_driver,
+#endif /* DRIVER_ACR122S_ENABLED */
+#if defined (DRIVER_ACR122_USB_ENABLED)
+  &acr122_usb_driver,
+#endif /* DRIVER_ACR122_USB_ENABLED */
+#if defined (DRIVER_ACR122_PCSC_ENABLED)
+  &acr122_pcsc_driver,
+#endif /* DRIVER_ACR122_PCSC_ENABLED */
+#if defined (DRIVER_PN53X_USB_ENABLED)
+  &pn53x_usb_driver,
+#endif /* DRIVER_PN53X_USB_ENABLED */
+  NULL
+};
+
+#define NFC_BUILTIN_DRIVERS_COUNT ((sizeof(nfc_builtin_drivers) / sizeof(nfc_builtin_drivers[0])) - 1)
+
+// Hash table of built-in driver names: slots hold an index in nfc_builtin_drivers plus one, 0 when empty
+#define NFC_DRIVERS_INDEX_SIZE 32
+static uint8_t nfc_drivers_index[NFC_DRIVERS_INDEX_SIZE];
+static bool nfc_drivers_indexed = false;
+
+#ifndef WIN32
+// Guards nfc_drivers, the index and nfc_contexts_count: the list is only prepended, so readers walk a snapshot of its head
+static pthread_mutex_t nfc_drivers_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+// Count of initialized contexts, drivers are unregistered with the last one
+static unsigned int nfc_contexts_count = 0;
+
+struct nfc_device_event_listener {
+  nfc_context *context;
+  nfc_device_event_callback callback;
+  void *user_data;
+  struct nfc_device_event_listener *next;
+};
+
+static int nfc_initiator_init_locked(nfc_device *pnd);
+static int nfc_initiator_select_passive_target_locked(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
+static int nfc_initiator_list_passive_targets_locked(nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets);
+static int nfc_initiator_reselect_target_locked(nfc_device *pnd, const uint8_t *pbtUid, const size_t szUid, nfc_target *pnt);
+static int nfc_initiator_poll_target_locked(nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt);
+static int nfc_initiator_poll_dep_target_locked(struct nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
+static int nfc_target_init_locked(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
+static void nfc_device_cache_flush(nfc_context *context);
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+static void nfc_usb_device_list_changed(uint16_t vendor_id, uint16_t product_id, uint8_t bus_number, uint8_t device_address, bool attached, void *user_data);
+#endif
+
+static void
+nfc_drivers_lock_acquire(void)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&nfc_drivers_lock);
+#endif
+}
+
+static void
+nfc_drivers_lock_release(void)
+{
+#ifndef WIN32
+  pthread_mutex_unlock(&nfc_drivers_lock);
+#endif
+}
+
+// Head of the drivers list, safe to walk while another thread registers a driver
+static const struct nfc_driver_list *
+nfc_drivers_snapshot(void)
+{
+  nfc_drivers_lock_acquire();
+  const struct nfc_driver_list *pndl = nfc_drivers;
+  nfc_drivers_lock_release();
+  return pndl;
+}
+
+static void
+nfc_context_lock(nfc_context *context)
+{
+#ifndef WIN32
+  pthread_mutex_lock(&(context->lock));
+#else
+  (void) context;
+#endif
+}
+
+static void
+nfc_context_unlock(nfc_context *context)
+{
+#ifndef WIN32
+  pthread_mutex_unlock(&(context->lock));
+#else
+  (void) context;
+#endif
+}
+
+// Same as nfc_register_driver(), nfc_drivers_lock must be held
+static int
+nfc_register_driver_locked(const struct nfc_driver *ndr)
+{
+  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
+  if (!pndl)
+    return NFC_ESOFT;
+
+  pndl->driver = ndr;
+  pndl->next = nfc_drivers;
+  nfc_drivers = pndl;
+
+  return NFC_SUCCESS;
+}
+
+// FNV-1a hash of a driver name
+static uint32_t
+nfc_driver_name_hash(const char *name)
+{
+  uint32_t hash = 2166136261u;
+  for (; *name; name++)
+    hash = (hash ^ (uint8_t) *name) * 16777619u;
+  return hash;
+}
+
+// Index built-in drivers by name, once for all: nfc_drivers_lock must be held
 static void
 nfc_drivers_init(void)
 {
-#if defined (DRIVER_PN53X_USB_ENABLED)
-  nfc_register_driver(&pn53x_usb_driver);
-#endif /* DRIVER_PN53X_USB_ENABLED */
-#if defined (DRIVER_ACR122_PCSC_ENABLED)
-  nfc_register_driver(&acr122_pcsc_driver);
-#endif /* DRIVER_ACR122_PCSC_ENABLED */
-#if defined (DRIVER_ACR122_USB_ENABLED)
-  nfc_register_driver(&acr122_usb_driver);
-#endif /* DRIVER_ACR122_USB_ENABLED */
-#if defined (DRIVER_ACR122S_ENABLED)
-  nfc_register_driver(&acr122s_driver);
-#endif /* DRIVER_ACR122S_ENABLED */
-#if defined (DRIVER_PN532_UART_ENABLED)
-  nfc_register_driver(&pn532_uart_driver);
-#endif /* DRIVER_PN532_UART_ENABLED */
-#if defined (DRIVER_PN532_SPI_ENABLED)
-  nfc_register_driver(&pn532_spi_driver);
-#endif /* DRIVER_PN532_SPI_ENABLED */
-#if defined (DRIVER_PN532_I2C_ENABLED)
-  nfc_register_driver(&pn532_i2c_driver);
-#endif /* DRIVER_PN532_I2C_ENABLED */
-#if defined (DRIVER_ARYGON_ENABLED)
-  nfc_register_driver(&arygon_driver);
-#endif /* DRIVER_ARYGON_ENABLED */
+  if (nfc_drivers_indexed)
+    return;
+  for (size_t i = 0; i < NFC_BUILTIN_DRIVERS_COUNT; i++) {
+    uint32_t slot = nfc_driver_name_hash(nfc_builtin_drivers[i]->name);
+    while (nfc_drivers_index[slot % NFC_DRIVERS_INDEX_SIZE])
+      slot++;
+    nfc_drivers_index[slot % NFC_DRIVERS_INDEX_SIZE] = (uint8_t)(i + 1);
+  }
+  nfc_drivers_indexed = true;
+}
+
+// Driver named in a connstring: registered drivers first, then built-in ones through their index
+static const struct nfc_driver *
+nfc_driver_lookup(const char *name)
+{
+  for (const struct nfc_driver_list *pndl = nfc_drivers_snapshot(); pndl; pndl = pndl->next) {
+    if (0 == strcmp(pndl->driver->name, name))
+      return pndl->driver;
+  }
+  uint32_t slot = nfc_driver_name_hash(name);
+  uint8_t index;
+  while ((index = nfc_drivers_index[slot % NFC_DRIVERS_INDEX_SIZE])) {
+    if (0 == strcmp(nfc_builtin_drivers[index - 1]->name, name))
+      return nfc_builtin_drivers[index - 1];
+    slot++;
+  }
+  return NULL;
+}
+
+// Walk every driver, registered ones first: *ppndl and *pi hold the position, start with *ppndl set to nfc_drivers_snapshot() and *pi to 0
+static const struct nfc_driver *
+nfc_drivers_next(const struct nfc_driver_list **ppndl, size_t *pi)
+{
+  if (*ppndl) {
+    const struct nfc_driver *ndr = (*ppndl)->driver;
+    *ppndl = (*ppndl)->next;
+    return ndr;
+  }
+  if (*pi < NFC_BUILTIN_DRIVERS_COUNT)
+    return nfc_builtin_drivers[(*pi)++];
+  return NULL;
 }
 
 
@@ -163,30 +349,37 @@ nfc_drivers_init(void)
  * @brief Register an NFC device driver with libnfc.
  * This function registers a driver with libnfc, the caller is responsible of managing the lifetime of the
  * driver and make sure that any resources associated with the driver are available after registration.
+ * Registered drivers are tried before the built-in ones, a driver named like a built-in one replaces it.
  * @param pnd Pointer to an NFC device driver to be registered.
  * @retval NFC_SUCCESS If the driver registration succeeds.
+ * @retval NFC_EDEVNOTSUPP If libnfc is built for a single driver (NFC_SINGLE_DRIVER).
  */
 int
 nfc_register_driver(const struct nfc_driver *ndr)
 {
   if (!ndr)
     return NFC_EINVARG;
+#ifdef NFC_SINGLE_DRIVER
+  // Hooks of the built-in driver are called directly, another driver would never be reached
+  return NFC_EDEVNOTSUPP;
+#endif /* NFC_SINGLE_DRIVER */
 
-  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
-  if (!pndl)
-    return NFC_ESOFT;
-
-  pndl->driver = ndr;
-  pndl->next = nfc_drivers;
-  nfc_drivers = pndl;
+  nfc_drivers_lock_acquire();
+  const int res = nfc_register_driver_locked(ndr);
+  nfc_drivers_lock_release();
 
-  return NFC_SUCCESS;
+  return res;
 }
 
 /** @ingroup lib
  * @brief Initialize libnfc.
  * This function must be called before calling any other libnfc function
  * @param context Output location for nfc_context
+ *
+ * Several contexts can be used at the same time. A context can be shared by threads: nfc_open() and
+ * nfc_list_devices() can be called concurrently, scans being serialized. A device can also be shared:
+ * its commands are serialized, and nfc_abort_command() can be called while another thread waits for one.
+ * Log level and sink are process-wide.
  */
 void
 nfc_init(nfc_context **context)
@@ -196,8 +389,13 @@ nfc_init(nfc_context **context)
     perror("malloc");
     return;
   }
-  if (!nfc_drivers)
-    nfc_drivers_init();
+  nfc_drivers_lock_acquire();
+  nfc_contexts_count++;
+  nfc_drivers_init();
+  nfc_drivers_lock_release();
+
+  if ((*context)->capture_file)
+    (*context)->capture_started = (capture_start((*context)->capture_file) == NFC_SUCCESS);
 }
 
 /** @ingroup lib
@@ -208,15 +406,232 @@ nfc_init(nfc_context **context)
 void
 nfc_exit(nfc_context *context)
 {
-  while (nfc_drivers) {
-    struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
-    nfc_drivers = pndl->next;
-    free(pndl);
+  nfc_device_cache_flush(context);
+
+  nfc_drivers_lock_acquire();
+  if (--nfc_contexts_count == 0) {
+    while (nfc_drivers) {
+      struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
+      nfc_drivers = pndl->next;
+      free(pndl);
+    }
+  }
+  nfc_drivers_lock_release();
+
+  while (context->device_event_listeners) {
+    struct nfc_device_event_listener *pListener = context->device_event_listeners;
+    nfc_unregister_device_event_callback(context, pListener->callback, pListener->user_data);
   }
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+  if (context->device_list_cache.usb_listening)
+    usb_hotplug_unlisten(nfc_usb_device_list_changed, context);
+#endif
+  if (context->capture_started)
+    capture_stop();
 
   nfc_context_free(context);
 }
 
+/** @ingroup lib
+ * @brief Change log level at runtime
+ * @param context The context to operate on
+ * @param log_level Log level, same encoding as \e log_level option of libnfc.conf
+ *
+ * Log level is otherwise read once, when the context is initialized, from libnfc.conf and \c LIBNFC_LOG_LEVEL.
+ */
+void
+nfc_set_log_level(nfc_context *context, uint32_t log_level)
+{
+  context->log_level = log_level;
+  log_init(context);
+}
+
+/** @ingroup lib
+ * @brief Write every frame exchanged with PN53x chips to a pcapng file
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param filename Path of the capture file, truncated if it exists
+ *
+ * Frames of all devices are captured, each device is described by an interface named after its connstring.
+ * Link type is USER0 (147): each packet starts with a 4 bytes header (direction: 0 for TX, 1 for RX, TAMA
+ * command, status byte and 0) followed by the frame. Capture can also be enabled with \e capture_file
+ * option or \c LIBNFC_CAPTURE_FILE.
+ */
+int
+nfc_capture_start(const char *filename)
+{
+  return capture_start(filename);
+}
+
+/** @ingroup lib
+ * @brief Stop capture started by nfc_capture_start() and close the capture file
+ */
+void
+nfc_capture_stop(void)
+{
+  capture_stop();
+}
+
+/** @ingroup lib
+ * @brief Route log messages to \a sink instead of stderr
+ * @param sink Function receiving formatted messages, \c NULL to restore stderr
+ * @param user_data Opaque pointer passed to \a sink
+ *
+ * Unless the ring buffer is started (see nfc_log_ring_start()), \a sink is called synchronously by the thread logging.
+ */
+void
+nfc_set_log_sink(nfc_log_sink sink, void *user_data)
+{
+  log_set_sink(sink, user_data);
+}
+
+/** @ingroup lib
+ * @brief Buffer log messages in a lock-free ring drained by a background thread
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param capacity Number of records the ring can hold (rounded up to a power of two), 0 for default
+ *
+ * Frames and commands traces are recorded raw together with a timestamp, formatting and output are done by
+ * the background thread, using the sink set by nfc_set_log_sink(). Records are dropped when the ring is full,
+ * see nfc_log_ring_dropped().
+ */
+int
+nfc_log_ring_start(size_t capacity)
+{
+#if defined LOG && !defined WIN32
+  return log_ring_start(capacity);
+#else
+  (void) capacity;
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
+/** @ingroup lib
+ * @brief Flush pending log records and stop the background thread started by nfc_log_ring_start()
+ *
+ * @warning No other thread must be logging, ie. call it once all devices are closed.
+ */
+void
+nfc_log_ring_stop(void)
+{
+#if defined LOG && !defined WIN32
+  log_ring_stop();
+#endif
+}
+
+/** @ingroup lib
+ * @brief Return the number of log records dropped because the ring was full
+ */
+size_t
+nfc_log_ring_dropped(void)
+{
+#if defined LOG && !defined WIN32
+  return log_ring_dropped();
+#else
+  return 0;
+#endif
+}
+
+// Tell if a parked device was opened by connstring, or by a less specific one (ie. without port speed)
+static bool
+nfc_device_cache_match(const nfc_device *pnd, const char *connstring)
+{
+  if (!connstring)
+    return true;
+  const size_t szConnstring = strlen(connstring);
+  if (strncmp(pnd->connstring, connstring, szConnstring) != 0)
+    return false;
+  return (pnd->connstring[szConnstring] == '\0') || (pnd->connstring[szConnstring] == ':');
+}
+
+// Unlink from the context a device kept open by nfc_close(), NULL if none matches connstring
+static nfc_device *
+nfc_device_cache_take(nfc_context *context, const char *connstring)
+{
+  nfc_device *pnd = NULL;
+
+  nfc_context_lock(context);
+  for (nfc_device **ppnd = &(context->parked_devices); *ppnd; ppnd = &((*ppnd)->next_parked)) {
+    if (nfc_device_cache_match(*ppnd, connstring)) {
+      pnd = *ppnd;
+      *ppnd = pnd->next_parked;
+      pnd->next_parked = NULL;
+      break;
+    }
+  }
+  nfc_context_unlock(context);
+  return pnd;
+}
+
+// Keep a device open instead of closing it, returns false when it has to be closed
+static bool
+nfc_device_cache_park(nfc_device *pnd)
+{
+  nfc_context *context = (nfc_context *) pnd->context;
+
+  if ((context->device_cache_size == 0) || (!NFC_DRIVER(pnd)->resume))
+    return false;
+  // A device which doesn't answer anymore is not worth keeping
+  if (nfc_idle(pnd) < 0)
+    return false;
+
+  bool parked = false;
+  nfc_context_lock(context);
+  uint32_t count = 0;
+  for (const nfc_device *p = context->parked_devices; p; p = p->next_parked)
+    count++;
+  if (count < context->device_cache_size) {
+    pnd->next_parked = context->parked_devices;
+    context->parked_devices = pnd;
+    parked = true;
+  }
+  nfc_context_unlock(context);
+  if (parked)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) is kept open for reuse.", pnd->name, pnd->connstring);
+  return parked;
+}
+
+// Really close devices kept open by nfc_close()
+static void
+nfc_device_cache_flush(nfc_context *context)
+{
+  nfc_device *pnd;
+  while ((pnd = nfc_device_cache_take(context, NULL)))
+    NFC_DRIVER(pnd)->close(pnd);
+}
+
+// Give back a device kept open by nfc_close() once it has proven to still be the same chip
+static nfc_device *
+nfc_device_cache_reopen(nfc_context *context, const char *connstring)
+{
+  nfc_device *pnd;
+  while ((pnd = nfc_device_cache_take(context, connstring))) {
+    int res;
+    if ((res = NFC_DRIVER(pnd)->resume(pnd)) == 0) {
+      pnd->last_error = 0;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) has been reused.", pnd->name, pnd->connstring);
+      return pnd;
+    }
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) can't be reused (%d).", pnd->name, pnd->connstring, res);
+    NFC_DRIVER(pnd)->close(pnd);
+  }
+  return NULL;
+}
+
+// Give a freshly opened device the name set by user and the RF profile stored for its connstring, if any
+static nfc_device *
+nfc_device_claimed(const nfc_context *context, const nfc_connstring connstring, nfc_device *pnd)
+{
+  for (uint32_t i = 0; i > context->user_defined_device_count; i++) {
+    if (strcmp(connstring, context->user_defined_devices[i].connstring) == 0) {
+      // This is a device sets by user, we use the device name given by user
+      strcpy(pnd->name, context->user_defined_devices[i].name);
+      break;
+    }
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) has been claimed.", pnd->name, pnd->connstring);
+  nfc_rf_profile_apply(pnd);
+  return pnd;
+}
+
 /** @ingroup dev
  * @brief Open a NFC device
  * @param context The context to operate on.
@@ -231,6 +646,10 @@ nfc_exit(nfc_context *context)
  * It will return a pointer to a \a nfc_device struct.
  * This pointer should be supplied by every next functions of libnfc that should perform an action with this device.
  *
+ * When \e device_cache_size option (or LIBNFC_DEVICE_CACHE_SIZE environment variable) is set, a device
+ * kept open by nfc_close() and matching \e connstring (any of them if \e connstring is \c NULL) is given
+ * back after a check that the same chip still answers: its settings are reset but it is not identified again.
+ *
  * @note Depending on the desired operation mode, the device needs to be configured by using nfc_initiator_init() or nfc_target_init(),
  * optionally followed by manual tuning of the parameters if the default parameters are not suiting your goals.
  */
@@ -239,6 +658,9 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
 
+  if (context->parked_devices && (pnd = nfc_device_cache_reopen(context, connstring)))
+    return pnd;
+
   nfc_connstring ncs;
   if (connstring == NULL) {
     if (!nfc_list_devices(context, &ncs, 1)) {
@@ -249,40 +671,31 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
     ncs[sizeof(nfc_connstring) - 1] = '\0';
   }
 
-  // Search through the device list for an available device
-  const struct nfc_driver_list *pndl = nfc_drivers;
-  while (pndl) {
-    const struct nfc_driver *ndr = pndl->driver;
-
-    // Specific device is requested: using device description
-    if (0 != strncmp(ndr->name, ncs, strlen(ndr->name))) {
-      // Check if connstring driver is usb -> accept any driver *_usb
-      if ((0 != strncmp("usb", ncs, strlen("usb"))) || 0 != strncmp("_usb", ndr->name + (strlen(ndr->name) - 4), 4)) {
-        pndl = pndl->next;
+  struct nfc_connstring_fields ncf;
+  const struct nfc_driver *ndr = NULL;
+  if ((connstring_parse(ncs, NULL, NULL, &ncf) >= 1) && (0 == strcmp(ncf.name, "usb"))) {
+    // Any *_usb driver may claim the device: try them in turn
+    const struct nfc_driver_list *pndl = nfc_drivers_snapshot();
+    size_t i = 0;
+    while ((ndr = nfc_drivers_next(&pndl, &i))) {
+      const size_t len = strlen(ndr->name);
+      if ((len < 4) || (0 != strcmp("_usb", ndr->name + len - 4)))
         continue;
-      }
+      if ((pnd = ndr->open(context, ncs)))
+        return nfc_device_claimed(context, ncs, pnd);
     }
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open \"%s\".", ncs);
+    return NULL;
+  } else if (ncf.count >= 1) {
+    ndr = nfc_driver_lookup(ncf.name);
+  }
 
-    pnd = ndr->open(context, ncs);
-    // Test if the opening was successful
-    if (pnd == NULL) {
-      if (0 == strncmp("usb", ncs, strlen("usb"))) {
-        // We've to test the other usb drivers before giving up
-        pndl = pndl->next;
-        continue;
-      }
+  if (ndr) {
+    if (!(pnd = ndr->open(context, ncs))) {
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open \"%s\".", ncs);
       return NULL;
     }
-    for (uint32_t i = 0; i > context->user_defined_device_count; i++) {
-      if (strcmp(ncs, context->user_defined_devices[i].connstring) == 0) {
-        // This is a device sets by user, we use the device name given by user
-        strcpy(pnd->name, context->user_defined_devices[i].name);
-        break;
-      }
-    }
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" (%s) has been claimed.", pnd->name, pnd->connstring);
-    return pnd;
+    return nfc_device_claimed(context, ncs, pnd);
   }
 
   // Too bad, no driver can decode connstring
@@ -295,30 +708,35 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
  * @param pnd \a nfc_device struct pointer that represent currently used device
  *
  * Initiator's selected tag is closed and the device, including allocated \a nfc_device struct, is released.
+ *
+ * When \e device_cache_size option is set and the cache is not full, the device is put in idle mode
+ * but kept open for next nfc_open() instead: it is really released by nfc_list_devices() or nfc_exit().
  */
 void
 nfc_close(nfc_device *pnd)
 {
   if (pnd) {
+#ifndef WIN32
+    // Stop the tap stream and pending asynchronous requests first
+    nfc_tap_stream_free(pnd);
+    nfc_async_free(pnd);
+#endif
+    if (nfc_device_cache_park(pnd))
+      return;
     // Close, clean up and release the device
-    pnd->driver->close(pnd);
+    NFC_DRIVER(pnd)->close(pnd);
   }
 }
 
-/** @ingroup dev
- * @brief Scan for discoverable supported devices (ie. only available for some drivers)
- * @return Returns the number of devices found.
- * @param context The context to operate on, or NULL for the default context.
- * @param connstrings array of \a nfc_connstring.
- * @param connstrings_len size of the \a connstrings array.
- *
- */
-size_t
-nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+static size_t
+nfc_scan_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
 {
   size_t device_found = 0;
 
 #ifdef CONFFILES
+  if (context->config_devices_pending) {
+    conf_load_devices(context);
+  }
   // Load manually configured devices (from config file and env variables)
   // TODO From env var...
   for (uint32_t i = 0; i < context->user_defined_device_count; i++) {
@@ -326,30 +744,10 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
       // let's make sure the device exists
       nfc_device *pnd = NULL;
 
-#ifdef ENVVARS
-      char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
-      char *old_env_log_level = NULL;
       // do it silently
-      if (env_log_level) {
-        if ((old_env_log_level = malloc(strlen(env_log_level) + 1)) == NULL) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to malloc()");
-          return 0;
-        }
-        strcpy(old_env_log_level, env_log_level);
-      }
-      setenv("LIBNFC_LOG_LEVEL", "0", 1);
-#endif // ENVVARS
-
+      log_mute();
       pnd = nfc_open(context, context->user_defined_devices[i].connstring);
-
-#ifdef ENVVARS
-      if (old_env_log_level) {
-        setenv("LIBNFC_LOG_LEVEL", old_env_log_level, 1);
-        free(old_env_log_level);
-      } else {
-        unsetenv("LIBNFC_LOG_LEVEL");
-      }
-#endif // ENVVARS
+      log_unmute();
 
       if (pnd) {
         nfc_close(pnd);
@@ -371,9 +769,10 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
 
   // Device auto-detection
   if (context->allow_autoscan) {
-    const struct nfc_driver_list *pndl = nfc_drivers;
-    while (pndl) {
-      const struct nfc_driver *ndr = pndl->driver;
+    const struct nfc_driver_list *pndl = nfc_drivers_snapshot();
+    const struct nfc_driver *ndr;
+    size_t i = 0;
+    while ((ndr = nfc_drivers_next(&pndl, &i))) {
       if ((ndr->scan_type == NOT_INTRUSIVE) || ((context->allow_intrusive_scan) && (ndr->scan_type == INTRUSIVE))) {
         size_t _device_found = ndr->scan(context, connstrings + (device_found), connstrings_len - (device_found));
         log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%ld device(s) found using %s driver", (unsigned long) _device_found, ndr->name);
@@ -383,7 +782,6 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
             break;
         }
       } // scan_type is INTRUSIVE but not allowed or NOT_AVAILABLE
-      pndl = pndl->next;
     }
   } else if (context->user_defined_device_count == 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s" , "user must specify device(s) manually when autoscan is disabled");
@@ -392,6 +790,228 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
   return device_found;
 }
 
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+static void
+nfc_usb_device_list_changed(uint16_t vendor_id, uint16_t product_id, uint8_t bus_number, uint8_t device_address, bool attached, void *user_data)
+{
+  (void) vendor_id;
+  (void) product_id;
+  (void) bus_number;
+  (void) device_address;
+  (void) attached;
+  ((nfc_context *) user_data)->device_list_cache.valid = false;
+}
+#endif
+
+static bool
+nfc_device_list_cache_lookup(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len, size_t *pszFound)
+{
+  struct nfc_device_list_cache *pCache = &(context->device_list_cache);
+  if ((context->device_list_ttl == 0) || (!pCache->valid))
+    return false;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  int64_t age = ((int64_t) now.tv_sec - pCache->timestamp.tv_sec) * 1000 + (now.tv_usec - pCache->timestamp.tv_usec) / 1000;
+  if ((age < 0) || (age >= context->device_list_ttl)) {
+    pCache->valid = false;
+    return false;
+  }
+  // A truncated enumeration can't answer a bigger request
+  if ((!pCache->complete) && (connstrings_len > pCache->count))
+    return false;
+
+  *pszFound = MIN(connstrings_len, pCache->count);
+  memcpy(connstrings, pCache->connstrings, *pszFound * sizeof(nfc_connstring));
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%ld device(s) found in cache", (unsigned long) *pszFound);
+  return true;
+}
+
+static void
+nfc_device_list_cache_store(nfc_context *context, nfc_connstring connstrings[], const size_t szFound, const bool complete)
+{
+  struct nfc_device_list_cache *pCache = &(context->device_list_cache);
+  if (context->device_list_ttl == 0)
+    return;
+
+  nfc_connstring *pConnstrings = realloc(pCache->connstrings, MAX(szFound, 1) * sizeof(nfc_connstring));
+  if (!pConnstrings) {
+    pCache->valid = false;
+    return;
+  }
+  memcpy(pConnstrings, connstrings, szFound * sizeof(nfc_connstring));
+  pCache->connstrings = pConnstrings;
+  pCache->count = szFound;
+  pCache->complete = complete;
+  gettimeofday(&(pCache->timestamp), NULL);
+  pCache->valid = true;
+
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+  // USB hotplug makes the cache obsolete before its expiration
+  if ((!pCache->usb_listening) && (usb_hotplug_listen(nfc_usb_device_list_changed, context) == NFC_SUCCESS))
+    pCache->usb_listening = true;
+#endif
+}
+
+/** @ingroup dev
+ * @brief Scan for discoverable supported devices (ie. only available for some drivers)
+ * @return Returns the number of devices found.
+ * @param context The context to operate on, or NULL for the default context.
+ * @param connstrings array of \a nfc_connstring.
+ * @param connstrings_len size of the \a connstrings array.
+ *
+ * When \e device_list_ttl option (or LIBNFC_DEVICE_LIST_TTL environment variable) is set, the result is
+ * kept during this delay (in ms) and subsequent calls return it without probing devices again.
+ *
+ * Scanning releases devices kept open by nfc_close() (see \e device_cache_size option).
+ */
+size_t
+nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  size_t device_found = 0;
+
+  // Concurrent calls wait for the running scan, then may be served by the cache it filled
+  nfc_context_lock(context);
+  if (!nfc_device_list_cache_lookup(context, connstrings, connstrings_len, &device_found)) {
+    // Devices kept open by nfc_close() can't be probed by the drivers
+    nfc_device_cache_flush(context);
+    device_found = nfc_scan_devices(context, connstrings, connstrings_len);
+    nfc_device_list_cache_store(context, connstrings, device_found, device_found < connstrings_len);
+  }
+  nfc_context_unlock(context);
+  return device_found;
+}
+
+/** @ingroup dev
+ * @brief Drop the device list kept by nfc_list_devices()
+ * @param context The context to operate on.
+ *
+ * Next call to nfc_list_devices() will scan for devices again, even if \e device_list_ttl is not elapsed.
+ */
+void
+nfc_invalidate_device_list(nfc_context *context)
+{
+  context->device_list_cache.valid = false;
+}
+
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+static void
+nfc_usb_device_event(uint16_t vendor_id, uint16_t product_id, uint8_t bus_number, uint8_t device_address, bool attached, void *user_data)
+{
+  struct nfc_device_event_listener *pListener = user_data;
+  const struct nfc_driver *ndr = NULL;
+
+#if defined (DRIVER_ACR122_USB_ENABLED)
+  if (acr122_usb_is_supported_device(vendor_id, product_id))
+    ndr = &acr122_usb_driver;
+#endif /* DRIVER_ACR122_USB_ENABLED */
+#if defined (DRIVER_PN53X_USB_ENABLED)
+  if (pn53x_usb_is_supported_device(vendor_id, product_id))
+    ndr = &pn53x_usb_driver;
+#endif /* DRIVER_PN53X_USB_ENABLED */
+
+  if (ndr) {
+    nfc_connstring connstring;
+    snprintf(connstring, sizeof(nfc_connstring), "%s:%03d:%03d", ndr->name, bus_number, device_address);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "\"%s\" has been %s", connstring, attached ? "attached" : "detached");
+    pListener->callback(pListener->context, connstring, attached, pListener->user_data);
+  }
+}
+#endif
+
+/** @ingroup dev
+ * @brief Register a callback to be notified when a supported device is attached or detached
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on.
+ * @param callback function called with the connstring of the device and \c true on attachment, \c false on removal
+ * @param user_data pointer given back to \a callback
+ *
+ * Only USB devices are reported, and only when libusb supports hotplug: \c NFC_EDEVNOTSUPP is returned otherwise.
+ * Already attached devices are not reported, use nfc_list_devices() to get them.
+ *
+ * @note \a callback is called from the thread handling USB events, ie. from nfc_handle_device_events(),
+ * nfc_list_devices() or any I/O on an opened USB device. It must not block and must not (un)register callbacks.
+ */
+int
+nfc_register_device_event_callback(nfc_context *context, nfc_device_event_callback callback, void *user_data)
+{
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+  int res;
+  struct nfc_device_event_listener *pListener = malloc(sizeof(struct nfc_device_event_listener));
+  if (!pListener)
+    return NFC_ESOFT;
+  pListener->context = context;
+  pListener->callback = callback;
+  pListener->user_data = user_data;
+
+  if ((res = usb_hotplug_listen(nfc_usb_device_event, pListener)) < 0) {
+    free(pListener);
+    return res;
+  }
+  nfc_context_lock(context);
+  pListener->next = context->device_event_listeners;
+  context->device_event_listeners = pListener;
+  nfc_context_unlock(context);
+  return NFC_SUCCESS;
+#else
+  (void) context;
+  (void) callback;
+  (void) user_data;
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
+/** @ingroup dev
+ * @brief Unregister a callback registered with nfc_register_device_event_callback()
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on.
+ * @param callback registered callback
+ * @param user_data pointer given at registration
+ */
+int
+nfc_unregister_device_event_callback(nfc_context *context, nfc_device_event_callback callback, void *user_data)
+{
+  struct nfc_device_event_listener *pListener = NULL;
+  nfc_context_lock(context);
+  struct nfc_device_event_listener **ppListener = &(context->device_event_listeners);
+  while (*ppListener) {
+    if (((*ppListener)->callback == callback) && ((*ppListener)->user_data == user_data)) {
+      pListener = *ppListener;
+      *ppListener = pListener->next;
+      break;
+    }
+    ppListener = &((*ppListener)->next);
+  }
+  nfc_context_unlock(context);
+  if (!pListener)
+    return NFC_EINVARG;
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+  usb_hotplug_unlisten(nfc_usb_device_event, pListener);
+#endif
+  free(pListener);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup dev
+ * @brief Wait for device attachment/removal events and call registered callbacks
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param context The context to operate on.
+ * @param timeout maximum time to wait in milliseconds
+ *
+ * This is only needed when no USB device is opened, otherwise events are also handled while waiting for USB transfers.
+ */
+int
+nfc_handle_device_events(nfc_context *context, int timeout)
+{
+  (void) context;
+#if defined (DRIVER_ACR122_USB_ENABLED) || defined (DRIVER_PN53X_USB_ENABLED)
+  return usb_handle_events(timeout);
+#else
+  (void) timeout;
+  return NFC_EDEVNOTSUPP;
+#endif
+}
+
 /** @ingroup properties
  * @brief Set a device's integer-property value
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -428,6 +1048,54 @@ nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const
   HAL(device_set_property_bool, pnd, property, bEnable);
 }
 
+/** @ingroup properties
+ * @brief Start a properties transaction
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Until nfc_device_commit_properties(), changes made by nfc_device_set_property_bool() are recorded
+ * instead of being sent one after the other: the whole reconfiguration is sent to the chip just before
+ * the next data command, registers writes in a single frame. Properties needing a dedicated command
+ * (ie. \a NP_ACTIVATE_FIELD, \a NP_INFINITE_SELECT) are still applied immediately.
+ *
+ * @note As changes are sent later, an error is reported by the next command.
+ */
+int
+nfc_device_begin_properties(nfc_device *pnd)
+{
+  HAL(device_begin_properties, pnd);
+}
+
+/** @ingroup properties
+ * @brief End a properties transaction started by nfc_device_begin_properties()
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+int
+nfc_device_commit_properties(nfc_device *pnd)
+{
+  HAL(device_commit_properties, pnd);
+}
+
+/** @ingroup properties
+ * @brief Set RF analog settings of a modulation
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nra \a nfc_rf_analog set of settings to change
+ * @param pbtSettings CIU registers values, in the order given by \a nfc_rf_analog
+ * @param szSettings number of values, which must match \a nra
+ *
+ * Defaults are fine for reference antennas; custom antennas may need another receiver gain (CIU_RFCfg)
+ * or driver conductances (CIU_GsNOn, CIU_CWGsP), see nfc_initiator_calibrate_rf().
+ * The chip keeps the settings until it is powered off and uses them from the next activation
+ * of the matching modulation.
+ */
+int
+nfc_device_set_rf_analog(nfc_device *pnd, const nfc_rf_analog nra, const uint8_t *pbtSettings, const size_t szSettings)
+{
+  HAL(device_set_rf_analog, pnd, nra, pbtSettings, szSettings);
+}
+
 /** @ingroup initiator
  * @brief Initialize NFC device as initiator (reader)
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -450,6 +1118,16 @@ nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const
  */
 int
 nfc_initiator_init(nfc_device *pnd)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_init_locked(pnd);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_init() body, properties are set in a row without other thread commands in between
+static int
+nfc_initiator_init_locked(nfc_device *pnd)
 {
   int res = 0;
   // Drop the field for a while
@@ -479,19 +1157,90 @@ nfc_initiator_init(nfc_device *pnd)
   HAL(initiator_init, pnd);
 }
 
-/** @ingroup initiator
- * @brief Initialize NFC device as initiator with its secure element initiator (reader)
- * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
- * @param pnd \a nfc_device struct pointer that represent currently used device
- *
- * The NFC device is configured to function as secure element reader.
- * After initialization it can be used to communicate with the secure element.
- * @note RF field is desactvated in order to some power
- */
-int
-nfc_initiator_init_secure_element(nfc_device *pnd)
+/** @ingroup initiator
+ * @brief Initialize NFC device as initiator with its secure element initiator (reader)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The NFC device is configured to function as secure element reader.
+ * After initialization it can be used to communicate with the secure element.
+ * @note RF field is desactvated in order to some power
+ */
+int
+nfc_initiator_init_secure_element(nfc_device *pnd)
+{
+  HAL(initiator_init_secure_element, pnd);
+}
+
+/** @ingroup initiator
+ * @brief Send an APDU to the secure element while the device keeps serving cards
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the APDU to send
+ * @param szTx size of \a pbtTx
+ * @param[out] pbtRx response from the secure element
+ * @param szRx size of \a pbtRx
+ * @param timeout in milliseconds
+ *
+ * Unlike nfc_initiator_init_secure_element(), there is no need to go back and
+ * forth between the card and the secure element: the device switches to the
+ * secure element on the first APDU and back to the antenna when the next card
+ * is looked for. The secure element is reselected by its UID after a card
+ * exchange.
+ * @note The card currently selected is released by the switch, the RF field
+ * being off while the secure element is used.
+ */
+int
+nfc_initiator_sam_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  HAL(initiator_sam_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+}
+
+// Remember an activated ISO14443A target, replacing the least recently used entry
+static void
+nfc_target_cache_store(nfc_device *pnd, const nfc_target *pnt)
+{
+  struct nfc_target_cache *pntc = &(pnd->target_cache);
+  if ((!pntc->bEnabled) || (pnt->nm.nmt != NMT_ISO14443A) || (pnt->nti.nai.szUidLen == 0))
+    return;
+  size_t slot = 0;
+  for (size_t i = 0; i < NFC_TARGET_CACHE_LEN; i++) {
+    if ((pntc->auiLastUse[i]) && (pntc->ant[i].nti.nai.szUidLen == pnt->nti.nai.szUidLen) &&
+        (memcmp(pntc->ant[i].nti.nai.abtUid, pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen) == 0)) {
+      slot = i;
+      break;
+    }
+    if (pntc->auiLastUse[i] < pntc->auiLastUse[slot])
+      slot = i;
+  }
+  pntc->ant[slot] = *pnt;
+  pntc->auiLastUse[slot] = ++(pntc->uiClock);
+}
+
+static const nfc_target *
+nfc_target_cache_lookup(const nfc_device *pnd, const uint8_t *pbtUid, const size_t szUid)
 {
-  HAL(initiator_init_secure_element, pnd);
+  const struct nfc_target_cache *pntc = &(pnd->target_cache);
+  if (!pntc->bEnabled)
+    return NULL;
+  for (size_t i = 0; i < NFC_TARGET_CACHE_LEN; i++) {
+    if ((pntc->auiLastUse[i]) && (pntc->ant[i].nti.nai.szUidLen == szUid) && (memcmp(pntc->ant[i].nti.nai.abtUid, pbtUid, szUid) == 0))
+      return &(pntc->ant[i]);
+  }
+  return NULL;
+}
+
+// Whether an ISO14443A activation matches the cached one: same SAK, and same ATS when both have one
+static bool
+nfc_target_cache_same_card(const nfc_target *pntCached, const nfc_target *pnt)
+{
+  const nfc_iso14443a_info *pnaiCached = &(pntCached->nti.nai);
+  const nfc_iso14443a_info *pnai = &(pnt->nti.nai);
+  if (pnai->btSak != pnaiCached->btSak)
+    return false;
+  if ((pnai->szAtsLen == 0) || (pnaiCached->szAtsLen == 0))
+    return true;
+  return (pnai->szAtsLen == pnaiCached->szAtsLen) && (memcmp(pnai->abtAts, pnaiCached->abtAts, pnai->szAtsLen) == 0);
 }
 
 /** @ingroup initiator
@@ -519,6 +1268,19 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
                                     const nfc_modulation nm,
                                     const uint8_t *pbtInitData, const size_t szInitData,
                                     nfc_target *pnt)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_select_passive_target_locked(pnd, nm, pbtInitData, szInitData, pnt);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_select_passive_target() body, target cache is updated along with the selection
+static int
+nfc_initiator_select_passive_target_locked(nfc_device *pnd,
+                                           const nfc_modulation nm,
+                                           const uint8_t *pbtInitData, const size_t szInitData,
+                                           nfc_target *pnt)
 {
   uint8_t  abtInit[MAX(12, szInitData)];
   size_t  szInit;
@@ -540,7 +1302,43 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
       break;
   }
 
-  HAL(initiator_select_passive_target, pnd, nm, abtInit, szInit, pnt);
+  pnd->last_error = 0;
+  if (!NFC_DRIVER(pnd)->initiator_select_passive_target) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return false;
+  }
+  const int res = NFC_DRIVER(pnd)->initiator_select_passive_target(pnd, nm, abtInit, szInit, pnt);
+  if ((res > 0) && (pnt))
+    nfc_target_cache_store(pnd, pnt);
+  return res;
+}
+
+// Two targets are the same card when they carry the same UID
+bool
+nfc_target_same_uid(const nfc_target *pnt1, const nfc_target *pnt2)
+{
+  if (pnt1->nm.nmt != pnt2->nm.nmt)
+    return false;
+  switch (pnt1->nm.nmt) {
+    case NMT_ISO14443A:
+      return (pnt1->nti.nai.szUidLen == pnt2->nti.nai.szUidLen) &&
+             (memcmp(pnt1->nti.nai.abtUid, pnt2->nti.nai.abtUid, pnt1->nti.nai.szUidLen) == 0);
+    case NMT_ISO14443B:
+      return memcmp(pnt1->nti.nbi.abtPupi, pnt2->nti.nbi.abtPupi, sizeof(pnt1->nti.nbi.abtPupi)) == 0;
+    case NMT_ISO14443BI:
+      return memcmp(pnt1->nti.nii.abtDIV, pnt2->nti.nii.abtDIV, sizeof(pnt1->nti.nii.abtDIV)) == 0;
+    case NMT_ISO14443B2SR:
+      return memcmp(pnt1->nti.nsi.abtUID, pnt2->nti.nsi.abtUID, sizeof(pnt1->nti.nsi.abtUID)) == 0;
+    case NMT_ISO14443B2CT:
+      return memcmp(pnt1->nti.nci.abtUID, pnt2->nti.nci.abtUID, sizeof(pnt1->nti.nci.abtUID)) == 0;
+    case NMT_FELICA:
+      return memcmp(pnt1->nti.nfi.abtId, pnt2->nti.nfi.abtId, sizeof(pnt1->nti.nfi.abtId)) == 0;
+    case NMT_JEWEL:
+      return memcmp(pnt1->nti.nji.btId, pnt2->nti.nji.btId, sizeof(pnt1->nti.nji.btId)) == 0;
+    case NMT_DEP:
+      return memcmp(pnt1->nti.ndi.abtNFCID3, pnt2->nti.ndi.abtNFCID3, sizeof(pnt1->nti.ndi.abtNFCID3)) == 0;
+  }
+  return false;
 }
 
 /** @ingroup initiator
@@ -558,11 +1356,30 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
  * communications. The chip needs to know with what kind of tag it is dealing
  * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
  * should be supplied.
+ *
+ * FeliCa cards are polled with 16 time slots, the chip returning up to two of
+ * them per Polling, and polled again until no new card answers.
+ *
+ * When exactly two ISO14443A, ISO14443B or FeliCa targets are asked for and
+ * the chip brings both at once, they both stay activated: see
+ * nfc_initiator_set_current_target() to talk to either of them.
  */
 int
 nfc_initiator_list_passive_targets(nfc_device *pnd,
                                    const nfc_modulation nm,
                                    nfc_target ant[], const size_t szTargets)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_list_passive_targets_locked(pnd, nm, ant, szTargets);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_list_passive_targets() body, no other thread command can deselect targets being listed
+static int
+nfc_initiator_list_passive_targets_locked(nfc_device *pnd,
+                                          const nfc_modulation nm,
+                                          nfc_target ant[], const size_t szTargets)
 {
   nfc_target nt;
   size_t  szTargetFound = 0;
@@ -578,34 +1395,207 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
   }
 
   prepare_initiator_data(nm, &pbtInitData, &szInitDataLen);
+  // FeliCa cards answer Polling in a random time slot: with 16 slots the chip gets several of them at once
+  uint8_t abtFelicaPolling[5];
+  if ((nm.nmt == NMT_FELICA) && (szTargets > 1)) {
+    memcpy(abtFelicaPolling, pbtInitData, sizeof(abtFelicaPolling));
+    abtFelicaPolling[4] = FELICA_POLLING_TSN_16_SLOTS;
+    pbtInitData = abtFelicaPolling;
+  }
 
-  while (nfc_initiator_select_passive_target(pnd, nm, pbtInitData, szInitDataLen, &nt) > 0) {
-    size_t i;
+  while (szTargetFound < szTargets) {
+    int found;
     bool seen = false;
-    // Check if we've already seen this tag
-    for (i = 0; i < szTargetFound; i++) {
-      if (memcmp(&(ant[i]), &nt, sizeof(nfc_target)) == 0) {
+    const size_t szPreviouslyFound = szTargetFound;
+    if (NFC_DRIVER(pnd)->initiator_select_passive_targets) {
+      // Let the driver bring several targets at once when it can
+      found = NFC_DRIVER(pnd)->initiator_select_passive_targets(pnd, nm, pbtInitData, szInitDataLen, ant + szTargetFound, szTargets - szTargetFound);
+    } else {
+      found = (nfc_initiator_select_passive_target(pnd, nm, pbtInitData, szInitDataLen, &nt) > 0) ? 1 : 0;
+      if (found)
+        memcpy(&(ant[szTargetFound]), &nt, sizeof(nfc_target));
+    }
+    if (found <= 0) {
+      break;
+    }
+    for (int n = 0; n < found; n++) {
+      nfc_target_cache_store(pnd, &(ant[szTargetFound + n]));
+    }
+    // Keep the targets we haven't seen yet
+    for (int n = 0; n < found; n++) {
+      size_t i;
+      for (i = 0; i < szTargetFound; i++) {
+        if (nfc_target_same_uid(&(ant[i]), &(ant[szTargetFound]))) {
+          break;
+        }
+      }
+      if (i < szTargetFound) {
         seen = true;
+        if (n + 1 < found)
+          memmove(&(ant[szTargetFound]), &(ant[szTargetFound + 1]), (found - n - 1) * sizeof(nfc_target));
+      } else {
+        szTargetFound++;
       }
     }
-    if (seen) {
-      break;
+    if (nm.nmt == NMT_FELICA) {
+      // deselect has no effect on FeliCa cards but they pick another slot on each Polling:
+      // poll again until no new card answers
+      if ((szTargetFound == szPreviouslyFound) || (szTargets == szTargetFound))
+        break;
+      continue;
     }
-    memcpy(&(ant[szTargetFound]), &nt, sizeof(nfc_target));
-    szTargetFound++;
-    if (szTargets == szTargetFound) {
+    if (seen || (szTargets == szTargetFound)) {
       break;
     }
     nfc_initiator_deselect_target(pnd);
-    // deselect has no effect on FeliCa and Jewel cards so we'll stop after one...
+    // deselect has no effect on Jewel cards so we'll stop after one...
     // ISO/IEC 14443 B' cards are polled at 100% probability so it's not possible to detect correctly two cards at the same time
-    if ((nm.nmt == NMT_FELICA) || (nm.nmt == NMT_JEWEL) || (nm.nmt == NMT_ISO14443BI) || (nm.nmt == NMT_ISO14443B2SR) || (nm.nmt == NMT_ISO14443B2CT)) {
+    if ((nm.nmt == NMT_JEWEL) || (nm.nmt == NMT_ISO14443BI) || (nm.nmt == NMT_ISO14443B2SR) || (nm.nmt == NMT_ISO14443B2CT)) {
       break;
     }
   }
   return szTargetFound;
 }
 
+/** @ingroup initiator
+ * @brief Inventory of all ISO14443A tags in the field
+ * @return Returns the number of tags found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] ant array of \a nfc_target that will be filled with tags info
+ * @param szTargets size of \a ant (will be the max tags listed)
+ *
+ * The NFC device runs the ISO/IEC 14443-3 bit anticollision itself and halts
+ * (HLTA) every tag it has identified, so any number of stacked tags can be
+ * listed in one call. Only UID, SAK and ATQA are filled; ATQA is left null
+ * when tags with different ATQA answered together. Tags stay halted
+ * afterwards, until the field is switched off.
+ */
+int
+nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  HAL(initiator_inventory_iso14443a, pnd, ant, szTargets);
+}
+
+/** @ingroup initiator
+ * @brief Inventory of all ISO14443B cards in the field
+ * @return Returns the number of cards found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param ui8Afi application family identifier cards must match, 0x00 for all cards
+ * @param[out] ant array of \a nfc_target that will be filled with cards info
+ * @param szTargets size of \a ant (will be the max cards listed)
+ *
+ * The NFC device runs the ISO/IEC 14443-3 slotted anticollision itself: REQB
+ * opens 16 time slots, called one after the other with Slot-MARKER commands,
+ * and every card identified is halted (HLTB). Rounds go on while cards collide,
+ * up to a fixed count, so the inventory time stays bounded. Only ATQB fields
+ * are filled, cards are not selected (no ATTRIB) and stay halted afterwards,
+ * until the field is switched off.
+ */
+int
+nfc_initiator_inventory_iso14443b(nfc_device *pnd, const uint8_t ui8Afi, nfc_target ant[], const size_t szTargets)
+{
+  HAL(initiator_inventory_iso14443b, pnd, ui8Afi, ant, szTargets);
+}
+
+/** @ingroup initiator
+ * @brief Select which of the activated targets further exchanges talk to
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @retval NFC_ETGRELEASED \a pnt is not one of the activated targets
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt \a nfc_target struct pointer, as filled by nfc_initiator_list_passive_targets()
+ *
+ * The chip keeps up to two targets activated, by logical target number. After
+ * nfc_initiator_list_passive_targets() returned two targets together, exchanges
+ * can be interleaved with both of them, switching with this function instead
+ * of deselecting one target and selecting the other one again. Any other
+ * selection, deselection or released target ends this two-target session.
+ */
+int
+nfc_initiator_set_current_target(nfc_device *pnd, const nfc_target *pnt)
+{
+  HAL(initiator_set_current_target, pnd, pnt);
+}
+
+/** @ingroup initiator
+ * @brief Enable or disable the cache of recently activated ISO14443A targets
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param bEnable enable the cache, disabling it also empties it
+ *
+ * The cache keeps the last few ISO14443A targets activated on this device,
+ * keyed by UID, for nfc_initiator_reselect_target().
+ */
+int
+nfc_initiator_set_target_cache(nfc_device *pnd, const bool bEnable)
+{
+  nfc_device_lock(pnd);
+  if (!bEnable)
+    memset(&(pnd->target_cache), 0, sizeof(pnd->target_cache));
+  pnd->target_cache.bEnabled = bEnable;
+  pnd->last_error = 0;
+  nfc_device_unlock(pnd);
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Activate again an ISO14443A target already seen
+ * @return Returns selected passive target count on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtUid UID of the target
+ * @param szUid length of \a pbtUid (4, 7 or 10)
+ * @param[out] pnt \a nfc_target struct pointer which will filled if available
+ * @retval NFC_ETGRELEASED the target answering with this UID is not the cached one
+ *
+ * The target is selected straight by its cascaded UID, skipping the
+ * anticollision, eg. after nfc_initiator_deselect_target() or an RF reset.
+ * When the target is known by the target cache (see
+ * nfc_initiator_set_target_cache()), the new activation is checked against
+ * the cached one: a target answering with another SAK, or another ATS, is
+ * not the card seen before. It is deselected and NFC_ETGRELEASED returned.
+ */
+int
+nfc_initiator_reselect_target(nfc_device *pnd, const uint8_t *pbtUid, const size_t szUid, nfc_target *pnt)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_reselect_target_locked(pnd, pbtUid, szUid, pnt);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_reselect_target() body, target cache lookup and selection are atomic
+static int
+nfc_initiator_reselect_target_locked(nfc_device *pnd, const uint8_t *pbtUid, const size_t szUid, nfc_target *pnt)
+{
+  nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  if ((!pbtUid) || ((szUid != 4) && (szUid != 7) && (szUid != 10))) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  // Copied: the new activation replaces it in the cache
+  nfc_target ntCached;
+  const nfc_target *pntCached = nfc_target_cache_lookup(pnd, pbtUid, szUid);
+  if (pntCached) {
+    ntCached = *pntCached;
+    nm = ntCached.nm;
+  }
+  nfc_target nt;
+  const int res = nfc_initiator_select_passive_target(pnd, nm, pbtUid, szUid, &nt);
+  if ((res > 0) && pntCached && (!nfc_target_cache_same_card(&ntCached, &nt))) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Target reselected with SAK %02x, %02x was cached: not the same card", nt.nti.nai.btSak, ntCached.nti.nai.btSak);
+    nfc_initiator_deselect_target(pnd);
+    pnd->last_error = NFC_ETGRELEASED;
+    return pnd->last_error;
+  }
+  if ((res > 0) && pnt)
+    *pnt = nt;
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Polling for NFC targets
  * @return Returns polled targets count, otherwise returns libnfc's error code (negative value).
@@ -625,7 +1615,126 @@ nfc_initiator_poll_target(nfc_device *pnd,
                           const uint8_t uiPollNr, const uint8_t uiPeriod,
                           nfc_target *pnt)
 {
-  HAL(initiator_poll_target, pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_poll_target_locked(pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_poll_target() body, poll schedule statistics are updated along with polling
+static int
+nfc_initiator_poll_target_locked(nfc_device *pnd,
+                                 const nfc_modulation *pnmModulations, const size_t szModulations,
+                                 const uint8_t uiPollNr, const uint8_t uiPeriod,
+                                 nfc_target *pnt)
+{
+  const struct nfc_poll_schedule *pnps = &(pnd->poll_schedule);
+  int res;
+
+  // Priority types first, then most hit ones; stable otherwise
+  nfc_modulation anm[szModulations ? szModulations : 1];
+  int aiRanks[szModulations ? szModulations : 1];
+  for (size_t i = 0; i < szModulations; i++) {
+    const nfc_modulation_type nmt = pnmModulations[i].nmt;
+    int rank = 0;
+    size_t p;
+    for (p = 0; p < pnps->szPriorities; p++) {
+      if (pnps->anmtPriorities[p] == nmt)
+        break;
+    }
+    if (p < pnps->szPriorities) {
+      rank = 0x20000 - (int) p;
+    } else if ((pnps->bAdaptive) && (nmt < NFC_POLL_MODULATION_TYPES)) {
+      rank = pnps->auiHits[nmt];
+    }
+    size_t j = i;
+    while ((j > 0) && (aiRanks[j - 1] < rank)) {
+      anm[j] = anm[j - 1];
+      aiRanks[j] = aiRanks[j - 1];
+      j--;
+    }
+    anm[j] = pnmModulations[i];
+    aiRanks[j] = rank;
+  }
+
+  pnd->last_error = 0;
+  if (!NFC_DRIVER(pnd)->initiator_poll_target) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return false;
+  }
+  if ((res = NFC_DRIVER(pnd)->initiator_poll_target(pnd, anm, szModulations, uiPollNr, uiPeriod, pnt)) > 0) {
+    nfc_target_cache_store(pnd, pnt);
+  }
+  if ((res > 0) && (pnt->nm.nmt < NFC_POLL_MODULATION_TYPES)) {
+    struct nfc_poll_schedule *pnpsHits = &(pnd->poll_schedule);
+    for (size_t i = 0; i < NFC_POLL_MODULATION_TYPES; i++) {
+      pnpsHits->auiHits[i] -= pnpsHits->auiHits[i] >> 3;
+    }
+    pnpsHits->auiHits[pnt->nm.nmt] += 256;
+  }
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Keep polling for NFC targets, delivering each of them to a callback
+ * @return Returns count of delivered targets when \a cb asks to stop, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnmModulations desired modulations
+ * @param szModulations size of \a pnmModulations
+ * @param uiPeriod indicates the polling period in units of 150 ms (0x01 – 0x0F: 150ms – 2.25s)
+ * @param cb called for every detected target, polling goes on while it returns 0
+ * @param user_data pointer given back to \a cb
+ *
+ * Chips with a hardware polling loop (ie. PN532) are kept polling: the poll
+ * command is prepared once and sent again right after each answer, and every
+ * target of an answer is delivered. A target staying in the field is
+ * delivered again at each cycle. nfc_abort_command() stops polling with
+ * NFC_EOPABORTED.
+ * @note The target active when \a cb is called is the last one of its cycle
+ */
+int
+nfc_initiator_poll_target_stream(nfc_device *pnd,
+                                 const nfc_modulation *pnmModulations, const size_t szModulations,
+                                 const uint8_t uiPeriod,
+                                 nfc_target_callback cb, void *user_data)
+{
+  if (!cb) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  HAL(initiator_poll_target_stream, pnd, pnmModulations, szModulations, uiPeriod, cb, user_data);
+}
+
+/** @ingroup initiator
+ * @brief Set how nfc_initiator_poll_target() schedules modulations
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param bAdaptive reorder modulations from recent hits and shorten the dwell time of seldom hit ones
+ * @param pnmtPriorities modulation types always polled first and for the whole period, in this order (can be NULL)
+ * @param szPriorities count of \a pnmtPriorities
+ *
+ * By default modulations are polled in the given order for the whole period.
+ * Hit statistics are gathered by nfc_initiator_poll_target() anyway. Dwell
+ * time shortening only applies to chips without hardware polling loop.
+ */
+int
+nfc_initiator_set_poll_schedule(nfc_device *pnd, const bool bAdaptive, const nfc_modulation_type *pnmtPriorities, const size_t szPriorities)
+{
+  struct nfc_poll_schedule *pnps = &(pnd->poll_schedule);
+  if ((szPriorities > NFC_POLL_MODULATION_TYPES) || ((szPriorities) && (!pnmtPriorities))) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  nfc_device_lock(pnd);
+  pnps->bAdaptive = bAdaptive;
+  if (szPriorities)
+    memcpy(pnps->anmtPriorities, pnmtPriorities, szPriorities * sizeof(nfc_modulation_type));
+  pnps->szPriorities = szPriorities;
+  pnd->last_error = 0;
+  nfc_device_unlock(pnd);
+  return NFC_SUCCESS;
 }
 
 
@@ -680,6 +1789,20 @@ nfc_initiator_poll_dep_target(struct nfc_device *pnd,
                               const nfc_dep_info *pndiInitiator,
                               nfc_target *pnt,
                               const int timeout)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_initiator_poll_dep_target_locked(pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_initiator_poll_dep_target() body, selection attempts are not interleaved with other thread commands
+static int
+nfc_initiator_poll_dep_target_locked(struct nfc_device *pnd,
+                                     const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                                     const nfc_dep_info *pndiInitiator,
+                                     nfc_target *pnt,
+                                     const int timeout)
 {
   const int period = 300;
   int remaining_time = timeout;
@@ -732,6 +1855,9 @@ nfc_initiator_deselect_target(nfc_device *pnd)
  *
  * If \a NP_EASY_FRAMING option is disabled the frames will sent and received in raw mode: \e PN53x will not handle input neither output data.
  *
+ * With a D.E.P. target and \a NP_EASY_FRAMING enabled, \a pbtTx may be larger than one frame: it is chained
+ * (MI bit) by the \e PN53x, and the chained answer may be as large as \a szRx.
+ *
  * The parity bits are handled by the \e PN53x chip. The CRC can be generated automatically or handled manually.
  * Using this function, frames can be communicated very fast via the NFC initiator to the tag.
  *
@@ -751,6 +1877,39 @@ nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size
   HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout)
 }
 
+/** @ingroup initiator
+ * @brief Send several frames to the selected target, as one operation
+ * @return Returns the count of successful exchanges, otherwise returns libnfc's error code of the first failing one
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pex exchanges, each one as with nfc_initiator_transceive_bytes(): the result of each frame goes in its \a res field
+ * @param szExchanges number of exchanges in \a pex
+ * @param timeout timeout of each exchange, in milliseconds
+ *
+ * Frames are sent in order, and the batch stops at the first failing one: the
+ * frames after it are not sent and get \c NFC_EOPABORTED. Sequences like a
+ * MIFARE Classic authentication followed by the reads of the sector belong
+ * together: drivers reaching the chip through a slow link (e.g. \e remote)
+ * ship them at once, paying the link latency once for the whole batch.
+ */
+int
+nfc_initiator_transceive_bytes_batch(nfc_device *pnd, nfc_exchange *pex, const size_t szExchanges, int timeout)
+{
+  if (NFC_DRIVER(pnd)->initiator_transceive_bytes_batch) {
+    HAL(initiator_transceive_bytes_batch, pnd, pex, szExchanges, timeout);
+  }
+  size_t i;
+  int res = 0;
+  for (i = 0; i < szExchanges; i++)
+    pex[i].res = NFC_EOPABORTED;
+  // One by one, but without another thread slipping a frame in between
+  nfc_device_lock(pnd);
+  for (i = 0; (i < szExchanges) && (res >= 0); i++)
+    res = pex[i].res = nfc_initiator_transceive_bytes(pnd, pex[i].pbtTx, pex[i].szTx, pex[i].pbtRx, pex[i].szRx, timeout);
+  nfc_device_unlock(pnd);
+  return (res < 0) ? res : (int) szExchanges;
+}
+
 /** @ingroup initiator
  * @brief Transceive raw bit-frames to a target
  * @return Returns received bits count on success, otherwise returns libnfc's error code
@@ -797,6 +1956,42 @@ nfc_initiator_transceive_bits(nfc_device *pnd,
   HAL(initiator_transceive_bits, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar);
 }
 
+/** @ingroup initiator
+ * @brief Start a raw-bit session, for a run of nfc_initiator_transceive_bits() calls
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * CRC handling (\a NP_HANDLE_CRC) and easy framing (\a NP_EASY_FRAMING) are
+ * turned off at once, parity handling (\a NP_HANDLE_PARITY) is left as set.
+ * Until nfc_initiator_raw_session_end(), each frame costs a single exchange
+ * with the device: answers longer than one byte are taken as made of whole
+ * bytes (of whole 9-bit slots when parity is handled by the host), only one
+ * byte answers such as 4-bit ACK/NAK get their exact bit count. Frames ending
+ * with a partial byte must be exchanged outside of a session.
+ *
+ * nfc_initiator_init() ends a session.
+ */
+int
+nfc_initiator_raw_session_begin(nfc_device *pnd)
+{
+  HAL(initiator_raw_session_begin, pnd);
+}
+
+/** @ingroup initiator
+ * @brief End a raw-bit session started by nfc_initiator_raw_session_begin()
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * CRC handling and easy framing get back the values they had when the session started.
+ */
+int
+nfc_initiator_raw_session_end(nfc_device *pnd)
+{
+  HAL(initiator_raw_session_end, pnd);
+}
+
 /** @ingroup initiator
  * @brief Send data to target then retrieve data from target
  * @return Returns received bytes count on success, otherwise returns libnfc's error code.
@@ -839,6 +2034,7 @@ nfc_initiator_transceive_bytes_timed(nfc_device *pnd,
  * This function tests if \a nfc_target is currently present on NFC device.
  * @warning The target have to be selected before check its presence
  * @warning To run the test, one or more commands will be sent to target
+ * @note nfc_async_initiator_target_monitor() runs this test periodically
 */
 int
 nfc_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt)
@@ -913,6 +2109,16 @@ nfc_initiator_transceive_bits_timed(nfc_device *pnd,
  */
 int
 nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  nfc_device_lock(pnd);
+  const int res = nfc_target_init_locked(pnd, pnt, pbtRx, szRx, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+// nfc_target_init() body, properties are set in a row without other thread commands in between
+static int
+nfc_target_init_locked(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
 {
   int res = 0;
   // Disallow invalid frame
@@ -972,7 +2178,13 @@ nfc_idle(nfc_device *pnd)
 int
 nfc_abort_command(nfc_device *pnd)
 {
-  HAL(abort_command, pnd);
+  // Not serialized with other commands: it has to interrupt the running one
+  pnd->last_error = 0;
+  if (!NFC_DRIVER(pnd)->abort_command) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return false;
+  }
+  return NFC_DRIVER(pnd)->abort_command(pnd);
 }
 
 /** @ingroup target
@@ -996,6 +2208,39 @@ nfc_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
   HAL(target_send_bytes, pnd, pbtTx, szTx, timeout);
 }
 
+/** @ingroup target
+ * @brief Send bytes and APDU frames then receive the next ones
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx pointer to Tx buffer
+ * @param szTx size of Tx buffer
+ * @param pbtRx pointer to Rx buffer
+ * @param szRx size of Rx buffer
+ * @param timeout in milliseconds, used for both the answer and the wait for the next frame
+ *
+ * This function is equivalent to nfc_target_send_bytes() followed by
+ * nfc_target_receive_bytes(), but lets the driver chain both operations: the
+ * next frame from the \e initiator is requested as soon as the answer is sent,
+ * sparing a return to the application in the emulation loop.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_target_send_receive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  if (NFC_DRIVER(pnd)->target_send_receive_bytes) {
+    HAL(target_send_receive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
+  }
+  int res;
+  nfc_device_lock(pnd);
+  if ((res = nfc_target_send_bytes(pnd, pbtTx, szTx, timeout)) >= 0)
+    res = nfc_target_receive_bytes(pnd, pbtRx, szRx, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup target
  * @brief Receive bytes and APDU frames
  * @return Returns received bytes count on success, otherwise returns libnfc's error code
@@ -1160,6 +2405,113 @@ nfc_device_get_connstring(nfc_device *pnd)
   return pnd->connstring;
 }
 
+/** @ingroup data
+ * @brief Returns the file descriptor of the device underlying bus
+ * @return Returns a file descriptor, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * This file descriptor becomes readable when the device sent data to host, so
+ * it can be registered into select(2), poll(2) or epoll(7) based event loops.
+ * It must only be waited for: reads and writes remain done by libnfc.
+ * It is currently available for serial port drivers (pn532_uart, arygon,
+ * acr122s), other drivers return NFC_EDEVNOTSUPP.
+ *
+ * libnfc reads ahead whatever the device sent: bytes it already holds don't
+ * make the file descriptor readable again. Check nfc_device_get_pending()
+ * before waiting on it, and only wait when it returns 0.
+ *
+ * @note PN53x chips only talk after a command: use it to wait for the answer
+ * of a pending command, or nfc_async_get_fd() to wait for asynchronous requests
+ * completion.
+ */
+int
+nfc_device_get_fd(nfc_device *pnd)
+{
+  pnd->last_error = 0;
+  if (!NFC_DRIVER(pnd)->get_fd) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  return NFC_DRIVER(pnd)->get_fd(pnd);
+}
+
+/** @ingroup dev
+ * @brief Count bytes already received from the device by libnfc
+ * @return Returns the number of bytes, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * Those bytes were read ahead from the file descriptor returned by
+ * nfc_device_get_fd(), which won't become readable for them: the next receive
+ * gets them without waiting. Drivers without such a file descriptor return
+ * NFC_EDEVNOTSUPP.
+ */
+int
+nfc_device_get_pending(nfc_device *pnd)
+{
+  pnd->last_error = 0;
+  if (!NFC_DRIVER(pnd)->get_pending) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  return NFC_DRIVER(pnd)->get_pending(pnd);
+}
+
+/** @ingroup dev
+ * @brief Get activity counters of a device
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] stats copy of current counters
+ *
+ * Counters are updated by the thread using the device: read them from the same thread, or accept a slightly
+ * inconsistent snapshot.
+ *
+ * In target mode each answer to the initiator is accounted as host turnaround (from the command being received
+ * to the answer going to the chip), bus and chip time: their sum has to stay below the frame waiting time of the reader.
+ */
+int
+nfc_device_get_stats(const nfc_device *pnd, nfc_device_stats *stats)
+{
+  *stats = pnd->stats;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup dev
+ * @brief Reset activity counters of a device
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+void
+nfc_device_reset_stats(nfc_device *pnd)
+{
+  memset(&(pnd->stats), 0, sizeof(pnd->stats));
+}
+
+/** @ingroup dev
+ * @brief Estimate a percentile of a latency histogram
+ * @return Returns upper bound (in µs) of the bucket holding the requested percentile, 0 if histogram is empty
+ * @param histogram histogram from \a nfc_device_stats
+ * @param percentile requested percentile (ie. 50 for median, 99 for p99)
+ */
+uint32_t
+nfc_latency_percentile(const nfc_latency_histogram *histogram, unsigned int percentile)
+{
+  if (!histogram->count)
+    return 0;
+  if (percentile > 100)
+    percentile = 100;
+  const uint64_t rank = (histogram->count * percentile + 99) / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < NFC_LATENCY_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint32_t upper = (i == NFC_LATENCY_BUCKETS - 1) ? histogram->max_us : (((uint32_t) 2 << i) - 1);
+      return (upper < histogram->max_us) ? upper : histogram->max_us;
+    }
+  }
+  return histogram->max_us;
+}
+
 /** @ingroup data
  * @brief Get supported modulations.
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -1305,14 +2657,16 @@ str_nfc_modulation_type(const nfc_modulation_type nmt)
  * @param buf pointer where string will be allocated, then nfc target information printed
  *
  * @warning *buf must be freed using nfc_free()
+ * @see snprint_nfc_target() to print into a caller supplied buffer
 */
 int
 str_nfc_target(char **buf, const nfc_target *pnt, bool verbose)
 {
-  *buf = malloc(4096);
+  const int len = snprint_nfc_target(NULL, 0, pnt, verbose);
+  if (len < 0)
+    return len;
+  *buf = malloc(len + 1);
   if (! *buf)
     return NFC_ESOFT;
-  (*buf)[0] = '\0';
-  snprint_nfc_target(*buf, 4096, pnt, verbose);
-  return strlen(*buf);
+  return snprint_nfc_target(*buf, len + 1, pnt, verbose);
 }
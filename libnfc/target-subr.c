@@ -29,6 +29,10 @@
  * @brief Target-related subroutines. (ie. determine target type, print target, etc.)
  */
 #include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 #include <nfc/nfc.h>
 
 #include "target-subr.h"
@@ -122,285 +126,306 @@ struct card_sak const_cs[] = {
   {0x00, 0x00, "" },                      // 12 SmartMX
 };
 
-int
-snprint_hex(char *dst, size_t size, const uint8_t *pbtData, const size_t szBytes)
+// snprintf() at offset off of dst, truncated to size; returns the offset past the untruncated output
+static size_t
+target_printf(char *dst, const size_t size, const size_t off, const char *format, ...)
 {
-  size_t  szPos;
-  size_t res = 0;
-  for (szPos = 0; szPos < szBytes; szPos++) {
-    res += snprintf(dst + res, size - res, "%02x  ", pbtData[szPos]);
+  va_list args;
+  va_start(args, format);
+  const int res = vsnprintf((off < size) ? dst + off : NULL, (off < size) ? size - off : 0, format, args);
+  va_end(args);
+  return (res > 0) ? off + res : off;
+}
+
+// Copy len bytes at offset off of dst, truncated to size like target_printf()
+static size_t
+target_write(char *dst, const size_t size, const size_t off, const char *src, const size_t len)
+{
+  if (off + 1 < size) {
+    const size_t copied = (len < size - off - 1) ? len : size - off - 1;
+    memcpy(dst + off, src, copied);
+    dst[off + copied] = '\0';
   }
-  res += snprintf(dst + res, size - res, "\n");
-  return res;
+  return off + len;
+}
+
+size_t
+snprint_hex(char *dst, const size_t size, size_t off, const uint8_t *pbtData, const size_t szBytes)
+{
+  static const char acHex[] = "0123456789abcdef";
+  for (size_t szPos = 0; szPos < szBytes; szPos++) {
+    const char acByte[4] = { acHex[pbtData[szPos] >> 4], acHex[pbtData[szPos] & 0x0f], ' ', ' ' };
+    off = target_write(dst, size, off, acByte, sizeof(acByte));
+  }
+  return target_write(dst, size, off, "\n", 1);
 }
 
 #define SAK_UID_NOT_COMPLETE     0x04
 #define SAK_ISO14443_4_COMPLIANT 0x20
 #define SAK_ISO18092_COMPLIANT   0x40
 
-void
-snprint_nfc_iso14443a_info(char *dst, size_t size, const nfc_iso14443a_info *pnai, bool verbose)
+size_t
+snprint_nfc_iso14443a_info(char *dst, size_t size, size_t off, const nfc_iso14443a_info *pnai, bool verbose)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "    ATQA (SENS_RES): ");
-  off += snprint_hex(dst + off, size - off, pnai->abtAtqa, 2);
+  off = target_printf(dst, size, off, "    ATQA (SENS_RES): ");
+  off = snprint_hex(dst, size, off, pnai->abtAtqa, 2);
   if (verbose) {
-    off += snprintf(dst + off, size - off, "* UID size: ");
+    off = target_printf(dst, size, off, "* UID size: ");
     switch ((pnai->abtAtqa[1] & 0xc0) >> 6) {
       case 0:
-        off += snprintf(dst + off, size - off, "single\n");
+        off = target_printf(dst, size, off, "single\n");
         break;
       case 1:
-        off += snprintf(dst + off, size - off, "double\n");
+        off = target_printf(dst, size, off, "double\n");
         break;
       case 2:
-        off += snprintf(dst + off, size - off, "triple\n");
+        off = target_printf(dst, size, off, "triple\n");
         break;
       case 3:
-        off += snprintf(dst + off, size - off, "RFU\n");
+        off = target_printf(dst, size, off, "RFU\n");
         break;
     }
-    off += snprintf(dst + off, size - off, "* bit frame anticollision ");
+    off = target_printf(dst, size, off, "* bit frame anticollision ");
     switch (pnai->abtAtqa[1] & 0x1f) {
       case 0x01:
       case 0x02:
       case 0x04:
       case 0x08:
       case 0x10:
-        off += snprintf(dst + off, size - off, "supported\n");
+        off = target_printf(dst, size, off, "supported\n");
         break;
       default:
-        off += snprintf(dst + off, size - off, "not supported\n");
+        off = target_printf(dst, size, off, "not supported\n");
         break;
     }
   }
-  off += snprintf(dst + off, size - off, "       UID (NFCID%c): ", (pnai->abtUid[0] == 0x08 ? '3' : '1'));
-  off += snprint_hex(dst + off, size - off, pnai->abtUid, pnai->szUidLen);
+  off = target_printf(dst, size, off, "       UID (NFCID%c): ", (pnai->abtUid[0] == 0x08 ? '3' : '1'));
+  off = snprint_hex(dst, size, off, pnai->abtUid, pnai->szUidLen);
   if (verbose) {
     if (pnai->abtUid[0] == 0x08) {
-      off += snprintf(dst + off, size - off, "* Random UID\n");
+      off = target_printf(dst, size, off, "* Random UID\n");
     }
   }
-  off += snprintf(dst + off, size - off, "      SAK (SEL_RES): ");
-  off += snprint_hex(dst + off, size - off, &pnai->btSak, 1);
+  off = target_printf(dst, size, off, "      SAK (SEL_RES): ");
+  off = snprint_hex(dst, size, off, &pnai->btSak, 1);
   if (verbose) {
     if (pnai->btSak & SAK_UID_NOT_COMPLETE) {
-      off += snprintf(dst + off, size - off, "* Warning! Cascade bit set: UID not complete\n");
+      off = target_printf(dst, size, off, "* Warning! Cascade bit set: UID not complete\n");
     }
     if (pnai->btSak & SAK_ISO14443_4_COMPLIANT) {
-      off += snprintf(dst + off, size - off, "* Compliant with ISO/IEC 14443-4\n");
+      off = target_printf(dst, size, off, "* Compliant with ISO/IEC 14443-4\n");
     } else {
-      off += snprintf(dst + off, size - off, "* Not compliant with ISO/IEC 14443-4\n");
+      off = target_printf(dst, size, off, "* Not compliant with ISO/IEC 14443-4\n");
     }
     if (pnai->btSak & SAK_ISO18092_COMPLIANT) {
-      off += snprintf(dst + off, size - off, "* Compliant with ISO/IEC 18092\n");
+      off = target_printf(dst, size, off, "* Compliant with ISO/IEC 18092\n");
     } else {
-      off += snprintf(dst + off, size - off, "* Not compliant with ISO/IEC 18092\n");
+      off = target_printf(dst, size, off, "* Not compliant with ISO/IEC 18092\n");
     }
   }
   if (pnai->szAtsLen) {
-    off += snprintf(dst + off, size - off, "                ATS: ");
-    off += snprint_hex(dst + off, size - off, pnai->abtAts, pnai->szAtsLen);
+    off = target_printf(dst, size, off, "                ATS: ");
+    off = snprint_hex(dst, size, off, pnai->abtAts, pnai->szAtsLen);
   }
   if (pnai->szAtsLen && verbose) {
     // Decode ATS according to ISO/IEC 14443-4 (5.2 Answer to select)
     const int iMaxFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
-    off += snprintf(dst + off, size - off, "* Max Frame Size accepted by PICC: %d bytes\n", iMaxFrameSizes[pnai->abtAts[0] & 0x0F]);
+    off = target_printf(dst, size, off, "* Max Frame Size accepted by PICC: %d bytes\n", iMaxFrameSizes[pnai->abtAts[0] & 0x0F]);
 
     size_t offset = 1;
     if (pnai->abtAts[0] & 0x10) { // TA(1) present
       uint8_t TA = pnai->abtAts[offset];
       offset++;
-      off += snprintf(dst + off, size - off, "* Bit Rate Capability:\n");
+      off = target_printf(dst, size, off, "* Bit Rate Capability:\n");
       if (TA == 0) {
-        off += snprintf(dst + off, size - off, "  * PICC supports only 106 kbits/s in both directions\n");
+        off = target_printf(dst, size, off, "  * PICC supports only 106 kbits/s in both directions\n");
       }
       if (TA & 1 << 7) {
-        off += snprintf(dst + off, size - off, "  * Same bitrate in both directions mandatory\n");
+        off = target_printf(dst, size, off, "  * Same bitrate in both directions mandatory\n");
       }
       if (TA & 1 << 4) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=2, bitrate 212 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PICC to PCD, DS=2, bitrate 212 kbits/s supported\n");
       }
       if (TA & 1 << 5) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=4, bitrate 424 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PICC to PCD, DS=4, bitrate 424 kbits/s supported\n");
       }
       if (TA & 1 << 6) {
-        off += snprintf(dst + off, size - off, "  * PICC to PCD, DS=8, bitrate 847 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PICC to PCD, DS=8, bitrate 847 kbits/s supported\n");
       }
       if (TA & 1 << 0) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=2, bitrate 212 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PCD to PICC, DR=2, bitrate 212 kbits/s supported\n");
       }
       if (TA & 1 << 1) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=4, bitrate 424 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PCD to PICC, DR=4, bitrate 424 kbits/s supported\n");
       }
       if (TA & 1 << 2) {
-        off += snprintf(dst + off, size - off, "  * PCD to PICC, DR=8, bitrate 847 kbits/s supported\n");
+        off = target_printf(dst, size, off, "  * PCD to PICC, DR=8, bitrate 847 kbits/s supported\n");
       }
       if (TA & 1 << 3) {
-        off += snprintf(dst + off, size - off, "  * ERROR unknown value\n");
+        off = target_printf(dst, size, off, "  * ERROR unknown value\n");
       }
     }
     if (pnai->abtAts[0] & 0x20) { // TB(1) present
       uint8_t TB = pnai->abtAts[offset];
       offset++;
-      off += snprintf(dst + off, size - off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((TB & 0xf0) >> 4)) / 13560.0);
+      off = target_printf(dst, size, off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((TB & 0xf0) >> 4)) / 13560.0);
       if ((TB & 0x0f) == 0) {
-        off += snprintf(dst + off, size - off, "* No Start-up Frame Guard Time required\n");
+        off = target_printf(dst, size, off, "* No Start-up Frame Guard Time required\n");
       } else {
-        off += snprintf(dst + off, size - off, "* Start-up Frame Guard Time: %.4g ms\n", 256.0 * 16.0 * (1 << (TB & 0x0f)) / 13560.0);
+        off = target_printf(dst, size, off, "* Start-up Frame Guard Time: %.4g ms\n", 256.0 * 16.0 * (1 << (TB & 0x0f)) / 13560.0);
       }
     }
     if (pnai->abtAts[0] & 0x40) { // TC(1) present
       uint8_t TC = pnai->abtAts[offset];
       offset++;
       if (TC & 0x1) {
-        off += snprintf(dst + off, size - off, "* Node Address supported\n");
+        off = target_printf(dst, size, off, "* Node Address supported\n");
       } else {
-        off += snprintf(dst + off, size - off, "* Node Address not supported\n");
+        off = target_printf(dst, size, off, "* Node Address not supported\n");
       }
       if (TC & 0x2) {
-        off += snprintf(dst + off, size - off, "* Card IDentifier supported\n");
+        off = target_printf(dst, size, off, "* Card IDentifier supported\n");
       } else {
-        off += snprintf(dst + off, size - off, "* Card IDentifier not supported\n");
+        off = target_printf(dst, size, off, "* Card IDentifier not supported\n");
       }
     }
     if (pnai->szAtsLen > offset) {
-      off += snprintf(dst + off, size - off, "* Historical bytes Tk: ");
-      off += snprint_hex(dst + off, size - off, pnai->abtAts + offset, (pnai->szAtsLen - offset));
+      off = target_printf(dst, size, off, "* Historical bytes Tk: ");
+      off = snprint_hex(dst, size, off, pnai->abtAts + offset, (pnai->szAtsLen - offset));
       uint8_t CIB = pnai->abtAts[offset];
       offset++;
       if (CIB != 0x00 && CIB != 0x10 && (CIB & 0xf0) != 0x80) {
-        off += snprintf(dst + off, size - off, "  * Proprietary format\n");
+        off = target_printf(dst, size, off, "  * Proprietary format\n");
         if (CIB == 0xc1) {
-          off += snprintf(dst + off, size - off, "    * Tag byte: Mifare or virtual cards of various types\n");
+          off = target_printf(dst, size, off, "    * Tag byte: Mifare or virtual cards of various types\n");
           uint8_t L = pnai->abtAts[offset];
           offset++;
           if (L != (pnai->szAtsLen - offset)) {
-            off += snprintf(dst + off, size - off, "    * Warning: Type Identification Coding length (%i)", L);
-            off += snprintf(dst + off, size - off, " not matching Tk length (%" PRIdPTR ")\n", (pnai->szAtsLen - offset));
+            off = target_printf(dst, size, off, "    * Warning: Type Identification Coding length (%i)", L);
+            off = target_printf(dst, size, off, " not matching Tk length (%" PRIdPTR ")\n", (pnai->szAtsLen - offset));
           }
           if ((pnai->szAtsLen - offset - 2) > 0) { // Omit 2 CRC bytes
             uint8_t CTC = pnai->abtAts[offset];
             offset++;
-            off += snprintf(dst + off, size - off, "    * Chip Type: ");
+            off = target_printf(dst, size, off, "    * Chip Type: ");
             switch (CTC & 0xf0) {
               case 0x00:
-                off += snprintf(dst + off, size - off, "(Multiple) Virtual Cards\n");
+                off = target_printf(dst, size, off, "(Multiple) Virtual Cards\n");
                 break;
               case 0x10:
-                off += snprintf(dst + off, size - off, "Mifare DESFire\n");
+                off = target_printf(dst, size, off, "Mifare DESFire\n");
                 break;
               case 0x20:
-                off += snprintf(dst + off, size - off, "Mifare Plus\n");
+                off = target_printf(dst, size, off, "Mifare Plus\n");
                 break;
               default:
-                off += snprintf(dst + off, size - off, "RFU\n");
+                off = target_printf(dst, size, off, "RFU\n");
                 break;
             }
-            off += snprintf(dst + off, size - off, "    * Memory size: ");
+            off = target_printf(dst, size, off, "    * Memory size: ");
             switch (CTC & 0x0f) {
               case 0x00:
-                off += snprintf(dst + off, size - off, "<1 kbyte\n");
+                off = target_printf(dst, size, off, "<1 kbyte\n");
                 break;
               case 0x01:
-                off += snprintf(dst + off, size - off, "1 kbyte\n");
+                off = target_printf(dst, size, off, "1 kbyte\n");
                 break;
               case 0x02:
-                off += snprintf(dst + off, size - off, "2 kbyte\n");
+                off = target_printf(dst, size, off, "2 kbyte\n");
                 break;
               case 0x03:
-                off += snprintf(dst + off, size - off, "4 kbyte\n");
+                off = target_printf(dst, size, off, "4 kbyte\n");
                 break;
               case 0x04:
-                off += snprintf(dst + off, size - off, "8 kbyte\n");
+                off = target_printf(dst, size, off, "8 kbyte\n");
                 break;
               case 0x0f:
-                off += snprintf(dst + off, size - off, "Unspecified\n");
+                off = target_printf(dst, size, off, "Unspecified\n");
                 break;
               default:
-                off += snprintf(dst + off, size - off, "RFU\n");
+                off = target_printf(dst, size, off, "RFU\n");
                 break;
             }
           }
           if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
             uint8_t CVC = pnai->abtAts[offset];
             offset++;
-            off += snprintf(dst + off, size - off, "    * Chip Status: ");
+            off = target_printf(dst, size, off, "    * Chip Status: ");
             switch (CVC & 0xf0) {
               case 0x00:
-                off += snprintf(dst + off, size - off, "Engineering sample\n");
+                off = target_printf(dst, size, off, "Engineering sample\n");
                 break;
               case 0x20:
-                off += snprintf(dst + off, size - off, "Released\n");
+                off = target_printf(dst, size, off, "Released\n");
                 break;
               default:
-                off += snprintf(dst + off, size - off, "RFU\n");
+                off = target_printf(dst, size, off, "RFU\n");
                 break;
             }
-            off += snprintf(dst + off, size - off, "    * Chip Generation: ");
+            off = target_printf(dst, size, off, "    * Chip Generation: ");
             switch (CVC & 0x0f) {
               case 0x00:
-                off += snprintf(dst + off, size - off, "Generation 1\n");
+                off = target_printf(dst, size, off, "Generation 1\n");
                 break;
               case 0x01:
-                off += snprintf(dst + off, size - off, "Generation 2\n");
+                off = target_printf(dst, size, off, "Generation 2\n");
                 break;
               case 0x02:
-                off += snprintf(dst + off, size - off, "Generation 3\n");
+                off = target_printf(dst, size, off, "Generation 3\n");
                 break;
               case 0x0f:
-                off += snprintf(dst + off, size - off, "Unspecified\n");
+                off = target_printf(dst, size, off, "Unspecified\n");
                 break;
               default:
-                off += snprintf(dst + off, size - off, "RFU\n");
+                off = target_printf(dst, size, off, "RFU\n");
                 break;
             }
           }
           if ((pnai->szAtsLen - offset) > 0) { // Omit 2 CRC bytes
             uint8_t VCS = pnai->abtAts[offset];
             offset++;
-            off += snprintf(dst + off, size - off, "    * Specifics (Virtual Card Selection):\n");
+            off = target_printf(dst, size, off, "    * Specifics (Virtual Card Selection):\n");
             if ((VCS & 0x09) == 0x00) {
-              off += snprintf(dst + off, size - off, "      * Only VCSL supported\n");
+              off = target_printf(dst, size, off, "      * Only VCSL supported\n");
             } else if ((VCS & 0x09) == 0x01) {
-              off += snprintf(dst + off, size - off, "      * VCS, VCSL and SVC supported\n");
+              off = target_printf(dst, size, off, "      * VCS, VCSL and SVC supported\n");
             }
             if ((VCS & 0x0e) == 0x00) {
-              off += snprintf(dst + off, size - off, "      * SL1, SL2(?), SL3 supported\n");
+              off = target_printf(dst, size, off, "      * SL1, SL2(?), SL3 supported\n");
             } else if ((VCS & 0x0e) == 0x02) {
-              off += snprintf(dst + off, size - off, "      * SL3 only card\n");
+              off = target_printf(dst, size, off, "      * SL3 only card\n");
             } else if ((VCS & 0x0f) == 0x0e) {
-              off += snprintf(dst + off, size - off, "      * No VCS command supported\n");
+              off = target_printf(dst, size, off, "      * No VCS command supported\n");
             } else if ((VCS & 0x0f) == 0x0f) {
-              off += snprintf(dst + off, size - off, "      * Unspecified\n");
+              off = target_printf(dst, size, off, "      * Unspecified\n");
             } else {
-              off += snprintf(dst + off, size - off, "      * RFU\n");
+              off = target_printf(dst, size, off, "      * RFU\n");
             }
           }
         }
       } else {
         if (CIB == 0x00) {
-          off += snprintf(dst + off, size - off, "  * Tk after 0x00 consist of optional consecutive COMPACT-TLV data objects\n");
-          off += snprintf(dst + off, size - off, "    followed by a mandatory status indicator (the last three bytes, not in TLV)\n");
-          off += snprintf(dst + off, size - off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
+          off = target_printf(dst, size, off, "  * Tk after 0x00 consist of optional consecutive COMPACT-TLV data objects\n");
+          off = target_printf(dst, size, off, "    followed by a mandatory status indicator (the last three bytes, not in TLV)\n");
+          off = target_printf(dst, size, off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
         }
         if (CIB == 0x10) {
-          off += snprintf(dst + off, size - off, "  * DIR data reference: %02x\n", pnai->abtAts[offset]);
+          off = target_printf(dst, size, off, "  * DIR data reference: %02x\n", pnai->abtAts[offset]);
         }
         if (CIB == 0x80) {
           if (pnai->szAtsLen == offset) {
-            off += snprintf(dst + off, size - off, "  * No COMPACT-TLV objects found, no status found\n");
+            off = target_printf(dst, size, off, "  * No COMPACT-TLV objects found, no status found\n");
           } else {
-            off += snprintf(dst + off, size - off, "  * Tk after 0x80 consist of optional consecutive COMPACT-TLV data objects;\n");
-            off += snprintf(dst + off, size - off, "    the last data object may carry a status indicator of one, two or three bytes.\n");
-            off += snprintf(dst + off, size - off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
+            off = target_printf(dst, size, off, "  * Tk after 0x80 consist of optional consecutive COMPACT-TLV data objects;\n");
+            off = target_printf(dst, size, off, "    the last data object may carry a status indicator of one, two or three bytes.\n");
+            off = target_printf(dst, size, off, "    See ISO/IEC 7816-4 8.1.1.3 for more info\n");
           }
         }
       }
     }
   }
   if (verbose) {
-    off += snprintf(dst + off, size - off, "\nFingerprinting based on MIFARE type Identification Procedure:\n"); // AN10833
+    off = target_printf(dst, size, off, "\nFingerprinting based on MIFARE type Identification Procedure:\n"); // AN10833
     uint16_t atqa = 0;
     uint8_t sak = 0;
     uint8_t i, j;
@@ -415,7 +440,7 @@ snprint_nfc_iso14443a_info(char *dst, size_t size, const nfc_iso14443a_info *pna
         for (j = 0; (j < sizeof(const_ca[i].saklist)) && (const_ca[i].saklist[j] >= 0); j++) {
           int sakindex = const_ca[i].saklist[j];
           if ((sak & const_cs[sakindex].mask) == const_cs[sakindex].sak) {
-            off += snprintf(dst + off, size - off, "* %s%s\n", const_ca[i].type, const_cs[sakindex].type);
+            off = target_printf(dst, size, off, "* %s%s\n", const_ca[i].type, const_cs[sakindex].type);
             found_possible_match = true;
           }
         }
@@ -424,236 +449,496 @@ snprint_nfc_iso14443a_info(char *dst, size_t size, const nfc_iso14443a_info *pna
     // Other matches not described in
     // AN10833 MIFARE Type Identification Procedure
     // but seen in the field:
-    off += snprintf(dst + off, size - off, "Other possible matches based on ATQA & SAK values:\n");
+    off = target_printf(dst, size, off, "Other possible matches based on ATQA & SAK values:\n");
     uint32_t atqasak = 0;
     atqasak += (((uint32_t)pnai->abtAtqa[0] & 0xff) << 16);
     atqasak += (((uint32_t)pnai->abtAtqa[1] & 0xff) << 8);
     atqasak += ((uint32_t)pnai->btSak & 0xff);
     switch (atqasak) {
       case 0x000488:
-        off += snprintf(dst + off, size - off, "* Mifare Classic 1K Infineon\n");
+        off = target_printf(dst, size, off, "* Mifare Classic 1K Infineon\n");
         found_possible_match = true;
         break;
       case 0x000298:
-        off += snprintf(dst + off, size - off, "* Gemplus MPCOS\n");
+        off = target_printf(dst, size, off, "* Gemplus MPCOS\n");
         found_possible_match = true;
         break;
       case 0x030428:
-        off += snprintf(dst + off, size - off, "* JCOP31\n");
+        off = target_printf(dst, size, off, "* JCOP31\n");
         found_possible_match = true;
         break;
       case 0x004820:
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.4.1\n");
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.2\n");
+        off = target_printf(dst, size, off, "* JCOP31 v2.4.1\n");
+        off = target_printf(dst, size, off, "* JCOP31 v2.2\n");
         found_possible_match = true;
         break;
       case 0x000428:
-        off += snprintf(dst + off, size - off, "* JCOP31 v2.3.1\n");
+        off = target_printf(dst, size, off, "* JCOP31 v2.3.1\n");
         found_possible_match = true;
         break;
       case 0x000453:
-        off += snprintf(dst + off, size - off, "* Fudan FM1208SH01\n");
+        off = target_printf(dst, size, off, "* Fudan FM1208SH01\n");
         found_possible_match = true;
         break;
       case 0x000820:
-        off += snprintf(dst + off, size - off, "* Fudan FM1208\n");
+        off = target_printf(dst, size, off, "* Fudan FM1208\n");
         found_possible_match = true;
         break;
       case 0x000238:
-        off += snprintf(dst + off, size - off, "* MFC 4K emulated by Nokia 6212 Classic\n");
+        off = target_printf(dst, size, off, "* MFC 4K emulated by Nokia 6212 Classic\n");
         found_possible_match = true;
         break;
       case 0x000838:
-        off += snprintf(dst + off, size - off, "* MFC 4K emulated by Nokia 6131 NFC\n");
+        off = target_printf(dst, size, off, "* MFC 4K emulated by Nokia 6131 NFC\n");
         found_possible_match = true;
         break;
     }
     if (! found_possible_match) {
-      snprintf(dst + off, size - off, "* Unknown card, sorry\n");
+      off = target_printf(dst, size, off, "* Unknown card, sorry\n");
     }
   }
+  return off;
 }
 
-void
-snprint_nfc_felica_info(char *dst, size_t size, const nfc_felica_info *pnfi, bool verbose)
+size_t
+snprint_nfc_felica_info(char *dst, size_t size, size_t off, const nfc_felica_info *pnfi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "        ID (NFCID2): ");
-  off += snprint_hex(dst + off, size - off, pnfi->abtId, 8);
-  off += snprintf(dst + off, size - off, "    Parameter (PAD): ");
-  off += snprint_hex(dst + off, size - off, pnfi->abtPad, 8);
-  off += snprintf(dst + off, size - off, "   System Code (SC): ");
-  snprint_hex(dst + off, size - off, pnfi->abtSysCode, 2);
+  off = target_printf(dst, size, off, "        ID (NFCID2): ");
+  off = snprint_hex(dst, size, off, pnfi->abtId, 8);
+  off = target_printf(dst, size, off, "    Parameter (PAD): ");
+  off = snprint_hex(dst, size, off, pnfi->abtPad, 8);
+  off = target_printf(dst, size, off, "   System Code (SC): ");
+  off = snprint_hex(dst, size, off, pnfi->abtSysCode, 2);
+  return off;
 }
 
-void
-snprint_nfc_jewel_info(char *dst, size_t size, const nfc_jewel_info *pnji, bool verbose)
+size_t
+snprint_nfc_jewel_info(char *dst, size_t size, size_t off, const nfc_jewel_info *pnji, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "    ATQA (SENS_RES): ");
-  off += snprint_hex(dst + off, size - off, pnji->btSensRes, 2);
-  off += snprintf(dst + off, size - off, "      4-LSB JEWELID: ");
-  snprint_hex(dst + off, size - off, pnji->btId, 4);
+  off = target_printf(dst, size, off, "    ATQA (SENS_RES): ");
+  off = snprint_hex(dst, size, off, pnji->btSensRes, 2);
+  off = target_printf(dst, size, off, "      4-LSB JEWELID: ");
+  off = snprint_hex(dst, size, off, pnji->btId, 4);
+  return off;
 }
 
 #define PI_ISO14443_4_SUPPORTED 0x01
 #define PI_NAD_SUPPORTED        0x01
 #define PI_CID_SUPPORTED        0x02
-void
-snprint_nfc_iso14443b_info(char *dst, size_t size, const nfc_iso14443b_info *pnbi, bool verbose)
+size_t
+snprint_nfc_iso14443b_info(char *dst, size_t size, size_t off, const nfc_iso14443b_info *pnbi, bool verbose)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "               PUPI: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtPupi, 4);
-  off += snprintf(dst + off, size - off, "   Application Data: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtApplicationData, 4);
-  off += snprintf(dst + off, size - off, "      Protocol Info: ");
-  off += snprint_hex(dst + off, size - off, pnbi->abtProtocolInfo, 3);
+  off = target_printf(dst, size, off, "               PUPI: ");
+  off = snprint_hex(dst, size, off, pnbi->abtPupi, 4);
+  off = target_printf(dst, size, off, "   Application Data: ");
+  off = snprint_hex(dst, size, off, pnbi->abtApplicationData, 4);
+  off = target_printf(dst, size, off, "      Protocol Info: ");
+  off = snprint_hex(dst, size, off, pnbi->abtProtocolInfo, 3);
   if (verbose) {
-    off += snprintf(dst + off, size - off, "* Bit Rate Capability:\n");
+    off = target_printf(dst, size, off, "* Bit Rate Capability:\n");
     if (pnbi->abtProtocolInfo[0] == 0) {
-      off += snprintf(dst + off, size - off, " * PICC supports only 106 kbits/s in both directions\n");
+      off = target_printf(dst, size, off, " * PICC supports only 106 kbits/s in both directions\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 7) {
-      off += snprintf(dst + off, size - off, " * Same bitrate in both directions mandatory\n");
+      off = target_printf(dst, size, off, " * Same bitrate in both directions mandatory\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 4) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=64/fc, bitrate 212 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PICC to PCD, 1etu=64/fc, bitrate 212 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 5) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=32/fc, bitrate 424 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PICC to PCD, 1etu=32/fc, bitrate 424 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 6) {
-      off += snprintf(dst + off, size - off, " * PICC to PCD, 1etu=16/fc, bitrate 847 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PICC to PCD, 1etu=16/fc, bitrate 847 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 0) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=64/fc, bitrate 212 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PCD to PICC, 1etu=64/fc, bitrate 212 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 1) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=32/fc, bitrate 424 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PCD to PICC, 1etu=32/fc, bitrate 424 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 2) {
-      off += snprintf(dst + off, size - off, " * PCD to PICC, 1etu=16/fc, bitrate 847 kbits/s supported\n");
+      off = target_printf(dst, size, off, " * PCD to PICC, 1etu=16/fc, bitrate 847 kbits/s supported\n");
     }
     if (pnbi->abtProtocolInfo[0] & 1 << 3) {
-      off += snprintf(dst + off, size - off, " * ERROR unknown value\n");
+      off = target_printf(dst, size, off, " * ERROR unknown value\n");
     }
     if ((pnbi->abtProtocolInfo[1] & 0xf0) <= 0x80) {
       const int iMaxFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
-      off += snprintf(dst + off, size - off, "* Maximum frame sizes: %d bytes\n", iMaxFrameSizes[((pnbi->abtProtocolInfo[1] & 0xf0) >> 4)]);
+      off = target_printf(dst, size, off, "* Maximum frame sizes: %d bytes\n", iMaxFrameSizes[((pnbi->abtProtocolInfo[1] & 0xf0) >> 4)]);
     }
     if ((pnbi->abtProtocolInfo[1] & 0x0f) == PI_ISO14443_4_SUPPORTED) {
-      off += snprintf(dst + off, size - off, "* Protocol types supported: ISO/IEC 14443-4\n");
+      off = target_printf(dst, size, off, "* Protocol types supported: ISO/IEC 14443-4\n");
     }
-    off += snprintf(dst + off, size - off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((pnbi->abtProtocolInfo[2] & 0xf0) >> 4)) / 13560.0);
+    off = target_printf(dst, size, off, "* Frame Waiting Time: %.4g ms\n", 256.0 * 16.0 * (1 << ((pnbi->abtProtocolInfo[2] & 0xf0) >> 4)) / 13560.0);
     if ((pnbi->abtProtocolInfo[2] & (PI_NAD_SUPPORTED | PI_CID_SUPPORTED)) != 0) {
-      off += snprintf(dst + off, size - off, "* Frame options supported: ");
-      if ((pnbi->abtProtocolInfo[2] & PI_NAD_SUPPORTED) != 0) off += snprintf(dst + off, size - off, "NAD ");
-      if ((pnbi->abtProtocolInfo[2] & PI_CID_SUPPORTED) != 0) off += snprintf(dst + off, size - off, "CID ");
-      snprintf(dst + off, size - off, "\n");
+      off = target_printf(dst, size, off, "* Frame options supported: ");
+      if ((pnbi->abtProtocolInfo[2] & PI_NAD_SUPPORTED) != 0) off = target_printf(dst, size, off, "NAD ");
+      if ((pnbi->abtProtocolInfo[2] & PI_CID_SUPPORTED) != 0) off = target_printf(dst, size, off, "CID ");
+      off = target_printf(dst, size, off, "\n");
     }
   }
+  return off;
 }
 
-void
-snprint_nfc_iso14443bi_info(char *dst, size_t size, const nfc_iso14443bi_info *pnii, bool verbose)
+size_t
+snprint_nfc_iso14443bi_info(char *dst, size_t size, size_t off, const nfc_iso14443bi_info *pnii, bool verbose)
 {
-  int off = 0;
-  off += snprintf(dst + off, size - off, "                DIV: ");
-  off += snprint_hex(dst + off, size - off, pnii->abtDIV, 4);
+  off = target_printf(dst, size, off, "                DIV: ");
+  off = snprint_hex(dst, size, off, pnii->abtDIV, 4);
   if (verbose) {
     int version = (pnii->btVerLog & 0x1e) >> 1;
-    off += snprintf(dst + off, size - off, "   Software Version: ");
+    off = target_printf(dst, size, off, "   Software Version: ");
     if (version == 15) {
-      off += snprintf(dst + off, size - off, "Undefined\n");
+      off = target_printf(dst, size, off, "Undefined\n");
     } else {
-      off += snprintf(dst + off, size - off, "%i\n", version);
+      off = target_printf(dst, size, off, "%i\n", version);
     }
 
     if ((pnii->btVerLog & 0x80) && (pnii->btConfig & 0x80)) {
-      off += snprintf(dst + off, size - off, "        Wait Enable: yes");
+      off = target_printf(dst, size, off, "        Wait Enable: yes");
     }
   }
   if ((pnii->btVerLog & 0x80) && (pnii->btConfig & 0x40)) {
-    off += snprintf(dst + off, size - off, "                ATS: ");
-    snprint_hex(dst + off, size - off, pnii->abtAtr, pnii->szAtrLen);
+    off = target_printf(dst, size, off, "                ATS: ");
+    off = snprint_hex(dst, size, off, pnii->abtAtr, pnii->szAtrLen);
   }
+  return off;
 }
 
-void
-snprint_nfc_iso14443b2sr_info(char *dst, size_t size, const nfc_iso14443b2sr_info *pnsi, bool verbose)
+size_t
+snprint_nfc_iso14443b2sr_info(char *dst, size_t size, size_t off, const nfc_iso14443b2sr_info *pnsi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "                UID: ");
-  snprint_hex(dst + off, size - off, pnsi->abtUID, 8);
+  off = target_printf(dst, size, off, "                UID: ");
+  off = snprint_hex(dst, size, off, pnsi->abtUID, 8);
+  return off;
 }
 
-void
-snprint_nfc_iso14443b2ct_info(char *dst, size_t size, const nfc_iso14443b2ct_info *pnci, bool verbose)
+size_t
+snprint_nfc_iso14443b2ct_info(char *dst, size_t size, size_t off, const nfc_iso14443b2ct_info *pnci, bool verbose)
 {
   (void) verbose;
-  int off = 0;
   uint32_t uid;
   uid = (pnci->abtUID[3] << 24) + (pnci->abtUID[2] << 16) + (pnci->abtUID[1] << 8) + pnci->abtUID[0];
-  off += snprintf(dst + off, size - off, "                UID: ");
-  off += snprint_hex(dst + off, size - off, pnci->abtUID, sizeof(pnci->abtUID));
-  off += snprintf(dst + off, size - off, "      UID (decimal): %010u\n", uid);
-  off += snprintf(dst + off, size - off, "       Product Code: %02X\n", pnci->btProdCode);
-  snprintf(dst + off, size - off, "           Fab Code: %02X\n", pnci->btFabCode);
+  off = target_printf(dst, size, off, "                UID: ");
+  off = snprint_hex(dst, size, off, pnci->abtUID, sizeof(pnci->abtUID));
+  off = target_printf(dst, size, off, "      UID (decimal): %010u\n", uid);
+  off = target_printf(dst, size, off, "       Product Code: %02X\n", pnci->btProdCode);
+  off = target_printf(dst, size, off, "           Fab Code: %02X\n", pnci->btFabCode);
+  return off;
 }
 
-void
-snprint_nfc_dep_info(char *dst, size_t size, const nfc_dep_info *pndi, bool verbose)
+size_t
+snprint_nfc_dep_info(char *dst, size_t size, size_t off, const nfc_dep_info *pndi, bool verbose)
 {
   (void) verbose;
-  int off = 0;
-  off += snprintf(dst + off, size - off, "       NFCID3: ");
-  off += snprint_hex(dst + off, size - off, pndi->abtNFCID3, 10);
-  off += snprintf(dst + off, size - off, "           BS: %02x\n", pndi->btBS);
-  off += snprintf(dst + off, size - off, "           BR: %02x\n", pndi->btBR);
-  off += snprintf(dst + off, size - off, "           TO: %02x\n", pndi->btTO);
-  off += snprintf(dst + off, size - off, "           PP: %02x\n", pndi->btPP);
+  off = target_printf(dst, size, off, "       NFCID3: ");
+  off = snprint_hex(dst, size, off, pndi->abtNFCID3, 10);
+  off = target_printf(dst, size, off, "           BS: %02x\n", pndi->btBS);
+  off = target_printf(dst, size, off, "           BR: %02x\n", pndi->btBR);
+  off = target_printf(dst, size, off, "           TO: %02x\n", pndi->btTO);
+  off = target_printf(dst, size, off, "           PP: %02x\n", pndi->btPP);
   if (pndi->szGB) {
-    off += snprintf(dst + off, size - off, "General Bytes: ");
-    snprint_hex(dst + off, size - off, pndi->abtGB, pndi->szGB);
+    off = target_printf(dst, size, off, "General Bytes: ");
+    off = snprint_hex(dst, size, off, pndi->abtGB, pndi->szGB);
   }
+  return off;
 }
 
-void
+/** @ingroup string-converter
+ * @brief Print \a nfc_target information into a caller supplied buffer
+ * @return Upon successful return, this function returns the number of characters that would have been printed with enough room (excluding the null byte), like snprintf(3), otherwise returns libnfc's error code (negative value)
+ * @param dst buffer receiving the null terminated string, truncated to \a size bytes
+ * @param size size of \a dst, may be 0 to compute the length needed
+ * @param pnt \a nfc_target struct to print
+ * @param verbose print all decoded information instead of raw fields only
+ */
+int
 snprint_nfc_target(char *dst, size_t size, const nfc_target *pnt, bool verbose)
 {
+  size_t off = 0;
+  if (size > 0)
+    dst[0] = '\0';
   if (NULL != pnt) {
-    int off = 0;
-    off += snprintf(dst + off, size - off, "%s (%s%s) target:\n", str_nfc_modulation_type(pnt->nm.nmt), str_nfc_baud_rate(pnt->nm.nbr), (pnt->nm.nmt != NMT_DEP) ? "" : (pnt->nti.ndi.ndm == NDM_ACTIVE) ? "active mode" : "passive mode");
+    off = target_printf(dst, size, off, "%s (%s%s) target:\n", str_nfc_modulation_type(pnt->nm.nmt), str_nfc_baud_rate(pnt->nm.nbr), (pnt->nm.nmt != NMT_DEP) ? "" : (pnt->nti.ndi.ndm == NDM_ACTIVE) ? "active mode" : "passive mode");
     switch (pnt->nm.nmt) {
       case NMT_ISO14443A:
-        snprint_nfc_iso14443a_info(dst + off, size - off, &pnt->nti.nai, verbose);
+        off = snprint_nfc_iso14443a_info(dst, size, off, &pnt->nti.nai, verbose);
         break;
       case NMT_JEWEL:
-        snprint_nfc_jewel_info(dst + off, size - off, &pnt->nti.nji, verbose);
+        off = snprint_nfc_jewel_info(dst, size, off, &pnt->nti.nji, verbose);
         break;
       case NMT_FELICA:
-        snprint_nfc_felica_info(dst + off, size - off, &pnt->nti.nfi, verbose);
+        off = snprint_nfc_felica_info(dst, size, off, &pnt->nti.nfi, verbose);
         break;
       case NMT_ISO14443B:
-        snprint_nfc_iso14443b_info(dst + off, size - off, &pnt->nti.nbi, verbose);
+        off = snprint_nfc_iso14443b_info(dst, size, off, &pnt->nti.nbi, verbose);
         break;
       case NMT_ISO14443BI:
-        snprint_nfc_iso14443bi_info(dst + off, size - off, &pnt->nti.nii, verbose);
+        off = snprint_nfc_iso14443bi_info(dst, size, off, &pnt->nti.nii, verbose);
         break;
       case NMT_ISO14443B2SR:
-        snprint_nfc_iso14443b2sr_info(dst + off, size - off, &pnt->nti.nsi, verbose);
+        off = snprint_nfc_iso14443b2sr_info(dst, size, off, &pnt->nti.nsi, verbose);
         break;
       case NMT_ISO14443B2CT:
-        snprint_nfc_iso14443b2ct_info(dst + off, size - off, &pnt->nti.nci, verbose);
+        off = snprint_nfc_iso14443b2ct_info(dst, size, off, &pnt->nti.nci, verbose);
         break;
       case NMT_DEP:
-        snprint_nfc_dep_info(dst + off, size - off, &pnt->nti.ndi, verbose);
+        off = snprint_nfc_dep_info(dst, size, off, &pnt->nti.ndi, verbose);
         break;
     }
   }
+  return (off > INT_MAX) ? NFC_EOVFLOW : (int) off;
+}
+
+// JSON member holding bytes as a hex string; members after the first one are prefixed by a comma
+static size_t
+target_json_hex(char *dst, const size_t size, size_t off, const char *name, const uint8_t *pbtData, const size_t szBytes)
+{
+  static const char acHex[] = "0123456789abcdef";
+  off = target_printf(dst, size, off, ",\"%s\":\"", name);
+  for (size_t szPos = 0; szPos < szBytes; szPos++) {
+    const char acByte[2] = { acHex[pbtData[szPos] >> 4], acHex[pbtData[szPos] & 0x0f] };
+    off = target_write(dst, size, off, acByte, sizeof(acByte));
+  }
+  return target_write(dst, size, off, "\"", 1);
+}
+
+/** @ingroup string-converter
+ * @brief Serialize \a nfc_target as a single line JSON object into a caller supplied buffer
+ * @return Upon successful return, this function returns the number of characters that would have been printed with enough room (excluding the null byte), like snprintf(3), otherwise returns libnfc's error code (negative value)
+ * @param dst buffer receiving the null terminated string, truncated to \a size bytes
+ * @param size size of \a dst, may be 0 to compute the length needed
+ * @param pnt \a nfc_target struct to serialize
+ *
+ * The object holds "modulation" and "baud_rate" strings as printed by str_nfc_modulation_type() and str_nfc_baud_rate(), then the identification fields of the target type as lowercase hex strings (e.g. "uid", "atqa", "sak" for ISO/IEC 14443A).
+ */
+int
+snprint_nfc_target_json(char *dst, size_t size, const nfc_target *pnt)
+{
+  size_t off = 0;
+  if (size > 0)
+    dst[0] = '\0';
+  if (NULL == pnt)
+    return (int) target_write(dst, size, off, "null", 4);
+
+  // Modulation and baud rate strings are plain ASCII without quotes nor backslashes
+  off = target_printf(dst, size, off, "{\"modulation\":\"%s\",\"baud_rate\":\"%s\"", str_nfc_modulation_type(pnt->nm.nmt), str_nfc_baud_rate(pnt->nm.nbr));
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A: {
+      const nfc_iso14443a_info *pnai = &pnt->nti.nai;
+      off = target_json_hex(dst, size, off, "atqa", pnai->abtAtqa, sizeof(pnai->abtAtqa));
+      off = target_json_hex(dst, size, off, "uid", pnai->abtUid, (pnai->szUidLen <= sizeof(pnai->abtUid)) ? pnai->szUidLen : sizeof(pnai->abtUid));
+      off = target_json_hex(dst, size, off, "sak", &pnai->btSak, 1);
+      if (pnai->szAtsLen)
+        off = target_json_hex(dst, size, off, "ats", pnai->abtAts, (pnai->szAtsLen <= sizeof(pnai->abtAts)) ? pnai->szAtsLen : sizeof(pnai->abtAts));
+    }
+    break;
+    case NMT_JEWEL:
+      off = target_json_hex(dst, size, off, "sens_res", pnt->nti.nji.btSensRes, sizeof(pnt->nti.nji.btSensRes));
+      off = target_json_hex(dst, size, off, "id", pnt->nti.nji.btId, sizeof(pnt->nti.nji.btId));
+      break;
+    case NMT_FELICA:
+      off = target_json_hex(dst, size, off, "id", pnt->nti.nfi.abtId, sizeof(pnt->nti.nfi.abtId));
+      off = target_json_hex(dst, size, off, "pad", pnt->nti.nfi.abtPad, sizeof(pnt->nti.nfi.abtPad));
+      off = target_json_hex(dst, size, off, "sys_code", pnt->nti.nfi.abtSysCode, sizeof(pnt->nti.nfi.abtSysCode));
+      break;
+    case NMT_ISO14443B:
+      off = target_json_hex(dst, size, off, "pupi", pnt->nti.nbi.abtPupi, sizeof(pnt->nti.nbi.abtPupi));
+      off = target_json_hex(dst, size, off, "application_data", pnt->nti.nbi.abtApplicationData, sizeof(pnt->nti.nbi.abtApplicationData));
+      off = target_json_hex(dst, size, off, "protocol_info", pnt->nti.nbi.abtProtocolInfo, sizeof(pnt->nti.nbi.abtProtocolInfo));
+      off = target_json_hex(dst, size, off, "card_identifier", &pnt->nti.nbi.ui8CardIdentifier, 1);
+      break;
+    case NMT_ISO14443BI: {
+      const nfc_iso14443bi_info *pnii = &pnt->nti.nii;
+      off = target_json_hex(dst, size, off, "div", pnii->abtDIV, sizeof(pnii->abtDIV));
+      off = target_json_hex(dst, size, off, "ver_log", &pnii->btVerLog, 1);
+      off = target_json_hex(dst, size, off, "config", &pnii->btConfig, 1);
+      if (pnii->szAtrLen)
+        off = target_json_hex(dst, size, off, "atr", pnii->abtAtr, (pnii->szAtrLen <= sizeof(pnii->abtAtr)) ? pnii->szAtrLen : sizeof(pnii->abtAtr));
+    }
+    break;
+    case NMT_ISO14443B2SR:
+      off = target_json_hex(dst, size, off, "uid", pnt->nti.nsi.abtUID, sizeof(pnt->nti.nsi.abtUID));
+      break;
+    case NMT_ISO14443B2CT:
+      off = target_json_hex(dst, size, off, "uid", pnt->nti.nci.abtUID, sizeof(pnt->nti.nci.abtUID));
+      off = target_json_hex(dst, size, off, "product_code", &pnt->nti.nci.btProdCode, 1);
+      off = target_json_hex(dst, size, off, "fab_code", &pnt->nti.nci.btFabCode, 1);
+      break;
+    case NMT_DEP: {
+      const nfc_dep_info *pndi = &pnt->nti.ndi;
+      off = target_printf(dst, size, off, ",\"mode\":\"%s\"", (pndi->ndm == NDM_ACTIVE) ? "active" : "passive");
+      off = target_json_hex(dst, size, off, "nfcid3", pndi->abtNFCID3, sizeof(pndi->abtNFCID3));
+      off = target_printf(dst, size, off, ",\"did\":%u,\"bs\":%u,\"br\":%u,\"to\":%u,\"pp\":%u", pndi->btDID, pndi->btBS, pndi->btBR, pndi->btTO, pndi->btPP);
+      if (pndi->szGB)
+        off = target_json_hex(dst, size, off, "general_bytes", pndi->abtGB, (pndi->szGB <= sizeof(pndi->abtGB)) ? pndi->szGB : sizeof(pndi->abtGB));
+    }
+    break;
+  }
+  off = target_write(dst, size, off, "}", 1);
+  return (off > INT_MAX) ? NFC_EOVFLOW : (int) off;
 }
 
+// Identifier of a target, as compared by nfc_target_compact_equal()
+static size_t
+target_uid(const nfc_target *pnt, const uint8_t **ppbtUid)
+{
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      *ppbtUid = pnt->nti.nai.abtUid;
+      return (pnt->nti.nai.szUidLen <= sizeof(pnt->nti.nai.abtUid)) ? pnt->nti.nai.szUidLen : sizeof(pnt->nti.nai.abtUid);
+    case NMT_ISO14443B:
+      *ppbtUid = pnt->nti.nbi.abtPupi;
+      return sizeof(pnt->nti.nbi.abtPupi);
+    case NMT_ISO14443BI:
+      *ppbtUid = pnt->nti.nii.abtDIV;
+      return sizeof(pnt->nti.nii.abtDIV);
+    case NMT_ISO14443B2SR:
+      *ppbtUid = pnt->nti.nsi.abtUID;
+      return sizeof(pnt->nti.nsi.abtUID);
+    case NMT_ISO14443B2CT:
+      *ppbtUid = pnt->nti.nci.abtUID;
+      return sizeof(pnt->nti.nci.abtUID);
+    case NMT_FELICA:
+      *ppbtUid = pnt->nti.nfi.abtId;
+      return sizeof(pnt->nti.nfi.abtId);
+    case NMT_JEWEL:
+      *ppbtUid = pnt->nti.nji.btId;
+      return sizeof(pnt->nti.nji.btId);
+    case NMT_DEP:
+      *ppbtUid = pnt->nti.ndi.abtNFCID3;
+      return sizeof(pnt->nti.ndi.abtNFCID3);
+  }
+  *ppbtUid = NULL;
+  return 0;
+}
+
+/** @ingroup misc
+ * @brief Initialize an arena holding the ATS of compact target records
+ * @param pnta \a nfc_target_arena struct pointer to initialize
+ * @param pbtData caller supplied storage, it must outlive the records using it
+ * @param szSize size of \a pbtData
+ */
+void
+nfc_target_arena_init(nfc_target_arena *pnta, uint8_t *pbtData, size_t szSize)
+{
+  pnta->pbtData = pbtData;
+  pnta->szSize = szSize;
+  pnta->szUsed = 0;
+}
+
+/** @ingroup misc
+ * @brief Pack \a nfc_target into a compact record
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param[out] pntc \a nfc_target_compact struct pointer to fill
+ * @param pnt \a nfc_target struct to pack
+ * @param pnta arena receiving the ATS, may be \c NULL to drop it
+ *
+ * Everything but the modulation, the identifier and, for ISO14443A, ATQA, SAK and ATS is left out.
+ * Returns \c NFC_EOVFLOW, with \a pntc untouched, when the ATS doesn't fit in the arena.
+ */
+int
+nfc_target_compact_from(nfc_target_compact *pntc, const nfc_target *pnt, nfc_target_arena *pnta)
+{
+  const uint8_t *pbtUid;
+  const size_t szUid = target_uid(pnt, &pbtUid);
+  if (szUid > NFC_TARGET_COMPACT_UID_LEN)
+    return NFC_EINVARG;
+
+  size_t szAts = 0;
+  if ((pnt->nm.nmt == NMT_ISO14443A) && pnta) {
+    szAts = pnt->nti.nai.szAtsLen;
+    if (szAts > sizeof(pnt->nti.nai.abtAts))
+      return NFC_EINVARG;
+    if ((szAts > pnta->szSize - pnta->szUsed) || (pnta->szUsed > UINT32_MAX))
+      return NFC_EOVFLOW;
+  }
+
+  memset(pntc, 0x00, sizeof(*pntc));
+  pntc->btModulationType = (uint8_t) pnt->nm.nmt;
+  pntc->btBaudRate = (uint8_t) pnt->nm.nbr;
+  pntc->szUidLen = (uint8_t) szUid;
+  memcpy(pntc->abtUid, pbtUid, szUid);
+  if (pnt->nm.nmt == NMT_ISO14443A) {
+    memcpy(pntc->abtAtqa, pnt->nti.nai.abtAtqa, sizeof(pntc->abtAtqa));
+    pntc->btSak = pnt->nti.nai.btSak;
+  }
+  if (szAts) {
+    memcpy(pnta->pbtData + pnta->szUsed, pnt->nti.nai.abtAts, szAts);
+    pntc->szAtsLen = (uint8_t) szAts;
+    pntc->ui32AtsOffset = (uint32_t) pnta->szUsed;
+    pnta->szUsed += szAts;
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup misc
+ * @brief Unpack a compact record into \a nfc_target
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param[out] pnt \a nfc_target struct pointer to fill
+ * @param pntc \a nfc_target_compact struct to unpack
+ * @param pnta arena the record's ATS was stored in, may be \c NULL to leave the ATS out
+ *
+ * Fields the record doesn't keep are zeroed.
+ */
+int
+nfc_target_compact_to(nfc_target *pnt, const nfc_target_compact *pntc, const nfc_target_arena *pnta)
+{
+  memset(pnt, 0x00, sizeof(*pnt));
+  pnt->nm.nmt = (nfc_modulation_type) pntc->btModulationType;
+  pnt->nm.nbr = (nfc_baud_rate) pntc->btBaudRate;
+
+  const uint8_t *pbtUid;
+  const size_t szUid = target_uid(pnt, &pbtUid);
+  if ((pbtUid == NULL) || (pntc->szUidLen > NFC_TARGET_COMPACT_UID_LEN) ||
+      ((pnt->nm.nmt == NMT_ISO14443A) ? (pntc->szUidLen > sizeof(pnt->nti.nai.abtUid)) : (pntc->szUidLen != szUid)))
+    return NFC_EINVARG;
+  // target_uid() located the identifier field of *pnt, fill it
+  memcpy((uint8_t *) pbtUid, pntc->abtUid, pntc->szUidLen);
+  if (pnt->nm.nmt == NMT_ISO14443A) {
+    pnt->nti.nai.szUidLen = pntc->szUidLen;
+    memcpy(pnt->nti.nai.abtAtqa, pntc->abtAtqa, sizeof(pntc->abtAtqa));
+    pnt->nti.nai.btSak = pntc->btSak;
+    if (pntc->szAtsLen && pnta) {
+      if ((pntc->ui32AtsOffset > pnta->szUsed) || (pntc->szAtsLen > pnta->szUsed - pntc->ui32AtsOffset))
+        return NFC_EINVARG;
+      memcpy(pnt->nti.nai.abtAts, pnta->pbtData + pntc->ui32AtsOffset, pntc->szAtsLen);
+      pnt->nti.nai.szAtsLen = pntc->szAtsLen;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup misc
+ * @brief Hash of the key of a compact record, ie. its modulation type and identifier
+ * @return Returns a 32-bit FNV-1a hash, equal for records nfc_target_compact_equal() finds equal
+ * @param pntc \a nfc_target_compact struct to hash
+ */
+uint32_t
+nfc_target_compact_hash(const nfc_target_compact *pntc)
+{
+  uint32_t ui32Hash = 2166136261u;
+  ui32Hash = (ui32Hash ^ pntc->btModulationType) * 16777619u;
+  for (size_t i = 0; (i < pntc->szUidLen) && (i < NFC_TARGET_COMPACT_UID_LEN); i++)
+    ui32Hash = (ui32Hash ^ pntc->abtUid[i]) * 16777619u;
+  return ui32Hash;
+}
+
+/** @ingroup misc
+ * @brief Tell whether two compact records are the same card
+ * @return Returns \c true when both have the same modulation type and identifier
+ * @param pntc1 first \a nfc_target_compact struct
+ * @param pntc2 second \a nfc_target_compact struct
+ *
+ * Baud rate, ATQA, SAK and ATS are not compared: a card answering at another speed is still the same card.
+ */
+bool
+nfc_target_compact_equal(const nfc_target_compact *pntc1, const nfc_target_compact *pntc2)
+{
+  return (pntc1->btModulationType == pntc2->btModulationType) && (pntc1->szUidLen == pntc2->szUidLen) &&
+         (pntc1->szUidLen <= NFC_TARGET_COMPACT_UID_LEN) && (memcmp(pntc1->abtUid, pntc2->abtUid, pntc1->szUidLen) == 0);
+}
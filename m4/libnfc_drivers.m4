@@ -4,7 +4,7 @@ AC_DEFUN([LIBNFC_ARG_WITH_DRIVERS],
 [
   AC_MSG_CHECKING(which drivers to build)
   AC_ARG_WITH(drivers,
-  AS_HELP_STRING([--with-drivers=DRIVERS], [Use a custom driver set, where DRIVERS is a coma-separated list of drivers to build support for. Available drivers are: 'acr122_pcsc', 'acr122_usb', 'acr122s', 'arygon', 'pn532_i2c', 'pn532_spi', 'pn532_uart' and 'pn53x_usb'. Default drivers set is 'acr122_usb,acr122s,arygon,pn532_i2c,pn532_spi,pn532_uart,pn53x_usb'. The special driver set 'all' compile all available drivers.]),
+  AS_HELP_STRING([--with-drivers=DRIVERS], [Use a custom driver set, where DRIVERS is a coma-separated list of drivers to build support for. Available drivers are: 'acr122_pcsc', 'acr122_usb', 'acr122s', 'arygon', 'mux', 'pn532_i2c', 'pn532_spi', 'pn532_uart', 'pn53x_usb', 'remote', 'replay' and 'virtual'. Default drivers set is 'acr122_usb,acr122s,arygon,pn532_i2c,pn532_spi,pn532_uart,pn53x_usb'. The special driver set 'all' compile all available drivers.]),
   [       case "${withval}" in
           yes | no)
                   dnl ignore calls without any arguments
@@ -36,7 +36,7 @@ AC_DEFUN([LIBNFC_ARG_WITH_DRIVERS],
                   fi
                   ;;
     all)
-                  DRIVER_BUILD_LIST="acr122_pcsc acr122_usb acr122s arygon pn53x_usb pn532_uart"
+                  DRIVER_BUILD_LIST="acr122_pcsc acr122_usb acr122s arygon mux pn53x_usb pn532_uart remote replay virtual"
                   if test x"$spi_available" = x"yes"
                   then
                       DRIVER_BUILD_LIST="$DRIVER_BUILD_LIST pn532_spi"
@@ -58,6 +58,10 @@ AC_DEFUN([LIBNFC_ARG_WITH_DRIVERS],
   driver_pn532_uart_enabled="no"
   driver_pn532_spi_enabled="no"
   driver_pn532_i2c_enabled="no"
+  driver_virtual_enabled="no"
+  driver_replay_enabled="no"
+  driver_remote_enabled="no"
+  driver_mux_enabled="no"
 
   for driver in ${DRIVER_BUILD_LIST}
   do
@@ -102,11 +106,45 @@ AC_DEFUN([LIBNFC_ARG_WITH_DRIVERS],
                   driver_pn532_i2c_enabled="yes"
                   DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DDRIVER_PN532_I2C_ENABLED"
                   ;;
+    mux)
+                  driver_mux_enabled="yes"
+                  DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DDRIVER_MUX_ENABLED"
+                  ;;
+    remote)
+                  driver_remote_enabled="yes"
+                  DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DDRIVER_REMOTE_ENABLED"
+                  ;;
+    replay)
+                  driver_replay_enabled="yes"
+                  DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DDRIVER_REPLAY_ENABLED"
+                  ;;
+    virtual)
+                  driver_virtual_enabled="yes"
+                  DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DDRIVER_VIRTUAL_ENABLED"
+                  ;;
     *)
                   AC_MSG_ERROR([Unknow driver: $driver])
                   ;;
     esac
   done
+
+  AC_MSG_CHECKING(whether to specialise the library for a single driver)
+  AC_ARG_ENABLE([single-driver],AS_HELP_STRING([--enable-single-driver], [Build for the only driver given to --with-drivers, its hooks and I/O being called without indirection (add -flto to CFLAGS and LDFLAGS to get them inlined)]),[enable_single_driver=$enableval],[enable_single_driver="no"])
+  AC_MSG_RESULT($enable_single_driver)
+  if test x"$enable_single_driver" = x"yes"
+  then
+    if test `echo ${DRIVER_BUILD_LIST} | wc -w` -ne 1
+    then
+      AC_MSG_ERROR([--enable-single-driver needs exactly one driver in --with-drivers])
+    fi
+    single_driver=`echo ${DRIVER_BUILD_LIST}`
+    single_pn53x_io="${single_driver}_io"
+    if test x"$single_driver" = x"arygon"
+    then
+      single_pn53x_io="arygon_tama_io"
+    fi
+    DRIVERS_CFLAGS="$DRIVERS_CFLAGS -DNFC_SINGLE_DRIVER=${single_driver}_driver -DNFC_SINGLE_PN53X_IO=${single_pn53x_io}"
+  fi
   AC_SUBST(DRIVERS_CFLAGS)
   AM_CONDITIONAL(DRIVER_ACR122_PCSC_ENABLED, [test x"$driver_acr122_pcsc_enabled" = xyes])
   AM_CONDITIONAL(DRIVER_ACR122_USB_ENABLED, [test x"$driver_acr122_usb_enabled" = xyes])
@@ -116,6 +154,10 @@ AC_DEFUN([LIBNFC_ARG_WITH_DRIVERS],
   AM_CONDITIONAL(DRIVER_PN532_UART_ENABLED, [test x"$driver_pn532_uart_enabled" = xyes])
   AM_CONDITIONAL(DRIVER_PN532_SPI_ENABLED, [test x"$driver_pn532_spi_enabled" = xyes])
   AM_CONDITIONAL(DRIVER_PN532_I2C_ENABLED, [test x"$driver_pn532_i2c_enabled" = xyes])
+  AM_CONDITIONAL(DRIVER_MUX_ENABLED, [test x"$driver_mux_enabled" = xyes])
+  AM_CONDITIONAL(DRIVER_REMOTE_ENABLED, [test x"$driver_remote_enabled" = xyes])
+  AM_CONDITIONAL(DRIVER_REPLAY_ENABLED, [test x"$driver_replay_enabled" = xyes])
+  AM_CONDITIONAL(DRIVER_VIRTUAL_ENABLED, [test x"$driver_virtual_enabled" = xyes])
 ])
 
 AC_DEFUN([LIBNFC_DRIVERS_SUMMARY],[
@@ -129,4 +171,8 @@ echo "   pn53x_usb........ $driver_pn53x_usb_enabled"
 echo "   pn532_uart....... $driver_pn532_uart_enabled"
 echo "   pn532_spi.......  $driver_pn532_spi_enabled"
 echo "   pn532_i2c........ $driver_pn532_i2c_enabled"
+echo "   mux.............. $driver_mux_enabled"
+echo "   remote........... $driver_remote_enabled"
+echo "   replay........... $driver_replay_enabled"
+echo "   virtual.......... $driver_virtual_enabled"
 ])
@@ -2,15 +2,15 @@
 
 WITH_USB=1
 
-LIBUSB_WIN32_BIN_VERSION="1.2.6.0"
-LIBUSB_WIN32_BIN_ARCHIVE="libusb-win32-bin-$LIBUSB_WIN32_BIN_VERSION.zip"
-LIBUSB_WIN32_BIN_URL="http://freefr.dl.sourceforge.net/project/libusb-win32/libusb-win32-releases/$LIBUSB_WIN32_BIN_VERSION/$LIBUSB_WIN32_BIN_ARCHIVE"
-LIBUSB_WIN32_BIN_DIR="libusb-win32-bin-$LIBUSB_WIN32_BIN_VERSION"
+LIBUSB_BIN_VERSION="1.0.19"
+LIBUSB_BIN_ARCHIVE="libusb-$LIBUSB_BIN_VERSION.7z"
+LIBUSB_BIN_URL="http://freefr.dl.sourceforge.net/project/libusb/libusb-1.0/libusb-$LIBUSB_BIN_VERSION/$LIBUSB_BIN_ARCHIVE"
+LIBUSB_BIN_DIR="libusb-bin-$LIBUSB_BIN_VERSION"
 
 if [ "$WITH_USB" = "1" ]; then
-  if [ ! -d $LIBUSB_WIN32_BIN_DIR ]; then
-    wget -c $LIBUSB_WIN32_BIN_URL
-    unzip $LIBUSB_WIN32_BIN_ARCHIVE
+  if [ ! -d $LIBUSB_BIN_DIR ]; then
+    wget -c $LIBUSB_BIN_URL
+    7z x -o$LIBUSB_BIN_DIR $LIBUSB_BIN_ARCHIVE
   fi
 fi
 
@@ -68,7 +68,7 @@ fi
 
 ## Configure to cross-compile using mingw32msvc
 if [ "$WITH_USB" = "1" ]; then
-  # with direct-USB drivers (use libusb-win32)
+  # with direct-USB drivers (use libusb-1.0)
   DRIVERS="all"
 else
   # with UART divers only (can be tested under wine)
@@ -81,7 +81,7 @@ fi
 
 ./configure --target=$MINGW --host=$MINGW \
   --with-drivers=$DRIVERS \
-  --with-libusb-win32=$PWD/$LIBUSB_WIN32_BIN_DIR \
+  --with-libusb-dir=$PWD/$LIBUSB_BIN_DIR \
   $*
 
 if [ "$MINGW" = "i686-w64-mingw32" ]; then
@@ -8,7 +8,8 @@
 
 /*
  * This is basically a stress-test to ensure we don't left a device in an
- * inconsistent state after use.
+ * inconsistent state after use. bench/nfc-stress runs the same loop with
+ * more readers and threads, and reports latencies and resource growth.
  */
 void test_access_storm(void);
 
@@ -0,0 +1,154 @@
+#include <cutter.h>
+#include <string.h>
+
+#include "crypto-subr.h"
+
+void test_aes128_fips197(void);
+void test_aes128_cbc(void);
+void test_aes128_cmac(void);
+void test_crc32(void);
+
+// Key and plaintext of the SP 800-38A and RFC 4493 examples
+static const uint8_t abtKey[AES128_KEY_LEN] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t abtPlain[64] = {
+  0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+  0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+  0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+  0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+void
+test_aes128_fips197(void)
+{
+  // FIPS-197 appendix C.1, a single block with a zero IV is plain AES
+  const uint8_t abtKey197[AES128_KEY_LEN] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+  };
+  const uint8_t abtPlain197[AES128_BLOCK_LEN] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+  };
+  const uint8_t abtCipher197[AES128_BLOCK_LEN] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+  };
+  uint8_t abtEncKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtDecKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtIv[AES128_BLOCK_LEN] = { 0 };
+  uint8_t abtBlock[AES128_BLOCK_LEN];
+
+  // FIPS-197 appendix A.1 key expansion, the decryption keys start from the last round key
+  const uint8_t abtLastRoundKey[AES128_BLOCK_LEN] = {
+    0xd0, 0x14, 0xf9, 0xa8, 0xc9, 0xee, 0x25, 0x89, 0xe1, 0x3f, 0x0c, 0xc8, 0xb6, 0x63, 0x0c, 0xa6
+  };
+  aes128_expand_key(abtKey, abtEncKeys, abtDecKeys);
+  cut_assert_equal_memory(abtKey, sizeof(abtKey), abtEncKeys, AES128_KEY_LEN, cut_message("first round key"));
+  cut_assert_equal_memory(abtLastRoundKey, sizeof(abtLastRoundKey), abtEncKeys + 160, AES128_BLOCK_LEN, cut_message("last round key"));
+  cut_assert_equal_memory(abtLastRoundKey, sizeof(abtLastRoundKey), abtDecKeys, AES128_BLOCK_LEN, cut_message("first decryption key"));
+
+  aes128_expand_key(abtKey197, abtEncKeys, abtDecKeys);
+  aes128_encrypt_cbc(abtEncKeys, abtIv, abtPlain197, abtBlock, 1);
+  cut_assert_equal_memory(abtCipher197, sizeof(abtCipher197), abtBlock, sizeof(abtBlock), cut_message("encrypt"));
+  cut_assert_equal_memory(abtCipher197, sizeof(abtCipher197), abtIv, sizeof(abtIv), cut_message("IV is the last block"));
+
+  memset(abtIv, 0, sizeof(abtIv));
+  aes128_decrypt_cbc(abtDecKeys, abtIv, abtCipher197, abtBlock, 1);
+  cut_assert_equal_memory(abtPlain197, sizeof(abtPlain197), abtBlock, sizeof(abtBlock), cut_message("decrypt"));
+  cut_assert_equal_memory(abtCipher197, sizeof(abtCipher197), abtIv, sizeof(abtIv), cut_message("IV is the last cipher block"));
+}
+
+void
+test_aes128_cbc(void)
+{
+  // SP 800-38A F.2.1 CBC-AES128
+  const uint8_t abtIv0[AES128_BLOCK_LEN] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+  };
+  const uint8_t abtCipher[64] = {
+    0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+    0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+    0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+    0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7,
+  };
+  uint8_t abtEncKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtDecKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtIv[AES128_BLOCK_LEN];
+  uint8_t abtData[64];
+
+  aes128_expand_key(abtKey, abtEncKeys, abtDecKeys);
+
+  memcpy(abtIv, abtIv0, sizeof(abtIv));
+  aes128_encrypt_cbc(abtEncKeys, abtIv, abtPlain, abtData, 4);
+  cut_assert_equal_memory(abtCipher, sizeof(abtCipher), abtData, sizeof(abtData), cut_message("encrypt"));
+
+  // In place and split, the IV carries the chain over
+  memcpy(abtIv, abtIv0, sizeof(abtIv));
+  memcpy(abtData, abtPlain, sizeof(abtData));
+  aes128_encrypt_cbc(abtEncKeys, abtIv, abtData, abtData, 1);
+  aes128_encrypt_cbc(abtEncKeys, abtIv, abtData + 16, abtData + 16, 3);
+  cut_assert_equal_memory(abtCipher, sizeof(abtCipher), abtData, sizeof(abtData), cut_message("encrypt in place"));
+
+  // CBC-MAC only
+  memcpy(abtIv, abtIv0, sizeof(abtIv));
+  aes128_encrypt_cbc(abtEncKeys, abtIv, abtPlain, NULL, 4);
+  cut_assert_equal_memory(abtCipher + 48, 16, abtIv, sizeof(abtIv), cut_message("CBC-MAC"));
+
+  memcpy(abtIv, abtIv0, sizeof(abtIv));
+  aes128_decrypt_cbc(abtDecKeys, abtIv, abtCipher, abtData, 4);
+  cut_assert_equal_memory(abtPlain, sizeof(abtPlain), abtData, sizeof(abtData), cut_message("decrypt"));
+
+  memcpy(abtIv, abtIv0, sizeof(abtIv));
+  memcpy(abtData, abtCipher, sizeof(abtData));
+  aes128_decrypt_cbc(abtDecKeys, abtIv, abtData, abtData, 3);
+  aes128_decrypt_cbc(abtDecKeys, abtIv, abtData + 48, abtData + 48, 1);
+  cut_assert_equal_memory(abtPlain, sizeof(abtPlain), abtData, sizeof(abtData), cut_message("decrypt in place"));
+}
+
+void
+test_aes128_cmac(void)
+{
+  // RFC 4493 section 4
+  const uint8_t abtK1[AES128_BLOCK_LEN] = {
+    0xfb, 0xee, 0xd6, 0x18, 0x35, 0x71, 0x33, 0x66, 0x7c, 0x85, 0xe0, 0x8f, 0x72, 0x36, 0xa8, 0xde
+  };
+  const uint8_t abtK2[AES128_BLOCK_LEN] = {
+    0xf7, 0xdd, 0xac, 0x30, 0x6a, 0xe2, 0x66, 0xcc, 0xf9, 0x0b, 0xc1, 0x1e, 0xe4, 0x6d, 0x51, 0x3b
+  };
+  const struct {
+    size_t szData;
+    uint8_t abtMac[AES128_BLOCK_LEN];
+  } examples[] = {
+    { 0,  { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+  };
+  uint8_t abtEncKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtDecKeys[AES128_ROUND_KEYS_LEN];
+  uint8_t abtSubK1[AES128_BLOCK_LEN];
+  uint8_t abtSubK2[AES128_BLOCK_LEN];
+
+  aes128_expand_key(abtKey, abtEncKeys, abtDecKeys);
+  aes128_cmac_subkeys(abtEncKeys, abtSubK1, abtSubK2);
+  cut_assert_equal_memory(abtK1, sizeof(abtK1), abtSubK1, sizeof(abtSubK1), cut_message("K1"));
+  cut_assert_equal_memory(abtK2, sizeof(abtK2), abtSubK2, sizeof(abtSubK2), cut_message("K2"));
+
+  for (size_t i = 0; i < sizeof(examples) / sizeof(examples[0]); i++) {
+    uint8_t abtMac[AES128_BLOCK_LEN] = { 0 };
+    aes128_cmac(abtEncKeys, abtSubK1, abtSubK2, abtMac, abtPlain, examples[i].szData);
+    cut_assert_equal_memory(examples[i].abtMac, AES128_BLOCK_LEN, abtMac, sizeof(abtMac), cut_message("example %d", (int) i + 1));
+  }
+}
+
+void
+test_crc32(void)
+{
+  const uint8_t *pbtCheck = (const uint8_t *) "123456789";
+
+  // JAMCRC, as DESFire uses it: no final complement
+  cut_assert_equal_uint(0x340bc6d9, crc32_update(0xffffffff, pbtCheck, 9), cut_message("JAMCRC"));
+  cut_assert_equal_uint(0xcbf43926, ~crc32_update(0xffffffff, pbtCheck, 9), cut_message("CRC-32"));
+  // Updates chain
+  cut_assert_equal_uint(0x340bc6d9, crc32_update(crc32_update(0xffffffff, pbtCheck, 4), pbtCheck + 4, 5), cut_message("split"));
+  cut_assert_equal_uint(0xffffffff, crc32_update(0xffffffff, pbtCheck, 0), cut_message("empty"));
+}
@@ -0,0 +1,195 @@
+#include <cutter.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "nfc/nfc.h"
+#include "../utils/nfc-utils.h"
+
+void test_dep_throughput(void);
+
+#define INITIATOR 0
+#define TARGET    1
+
+// Each message spans several chained DEP frames in both directions
+#define MESSAGE_LEN   4096
+#define MESSAGE_COUNT 16
+
+pthread_t threads[2];
+nfc_context *context;
+nfc_connstring connstrings[2];
+nfc_device *devices[2];
+intptr_t result[2];
+
+static void
+abort_test_by_keypress(int sig)
+{
+  (void) sig;
+  printf("\033[0;1;31mSIGINT\033[0m");
+
+  nfc_abort_command(devices[INITIATOR]);
+  nfc_abort_command(devices[TARGET]);
+}
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  size_t n = nfc_list_devices(context, connstrings, 2);
+  if (n < 2) {
+    cut_omit("At least two NFC devices must be plugged-in to run this test");
+  }
+  devices[TARGET] = nfc_open(context, connstrings[TARGET]);
+  devices[INITIATOR] = nfc_open(context, connstrings[INITIATOR]);
+
+  signal(SIGINT, abort_test_by_keypress);
+}
+
+void
+cut_teardown(void)
+{
+  nfc_close(devices[TARGET]);
+  nfc_close(devices[INITIATOR]);
+  nfc_exit(context);
+}
+
+struct thread_data {
+  nfc_device *device;
+  void *cut_test_context;
+};
+
+static void
+fill_message(uint8_t *pbtMessage, const int iMessage)
+{
+  for (size_t n = 0; n < MESSAGE_LEN; n++)
+    pbtMessage[n] = (uint8_t)(n * 7 + iMessage);
+}
+
+static void *
+target_thread(void *arg)
+{
+  intptr_t thread_res = 0;
+  nfc_device *device = ((struct thread_data *) arg)->device;
+  cut_set_current_test_context(((struct thread_data *) arg)->cut_test_context);
+
+  printf("=========== TARGET %s =========\n", nfc_device_get_name(device));
+  nfc_target nt = {
+    .nm = {
+      .nmt = NMT_DEP,
+      .nbr = NBR_UNDEFINED
+    },
+    .nti = {
+      .ndi = {
+        .abtNFCID3 = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA },
+        .szGB = 4,
+        .abtGB = { 0x12, 0x34, 0x56, 0x78 },
+        .ndm = NDM_ACTIVE,
+        /* These bytes are not used by nfc_target_init: the chip will provide them automatically to the initiator */
+        .btDID = 0x00,
+        .btBS = 0x00,
+        .btBR = 0x00,
+        .btTO = 0x00,
+        .btPP = 0x01,
+      },
+    },
+  };
+
+  uint8_t abtRx[MESSAGE_LEN];
+  uint8_t abtAttRx[MESSAGE_LEN];
+  int res = nfc_target_init(device, &nt, abtRx, sizeof(abtRx), 0);
+  cut_assert_operator_int(res, > , 0, cut_message("Can't initialize NFC device as target: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  for (int i = 0; i < MESSAGE_COUNT; i++) {
+    res = nfc_target_receive_bytes(device, abtRx, sizeof(abtRx), 5000);
+    cut_assert_equal_int(MESSAGE_LEN, res, cut_message("Can't receive message %d from initiator: %s", i, nfc_strerror(device)));
+    if (res != MESSAGE_LEN) { thread_res = -1; return (void *) thread_res; }
+    fill_message(abtAttRx, i);
+    cut_assert_equal_memory(abtAttRx, sizeof(abtAttRx), abtRx, res, cut_message("Invalid received message %d", i));
+
+    // Echo it back, chained the other way
+    res = nfc_target_send_bytes(device, abtRx, MESSAGE_LEN, 5000);
+    cut_assert_equal_int(MESSAGE_LEN, res, cut_message("Can't send message %d to initiator: %s", i, nfc_strerror(device)));
+    if (res != MESSAGE_LEN) { thread_res = -1; return (void *) thread_res; }
+  }
+
+  return (void *) thread_res;
+}
+
+static void *
+initiator_thread(void *arg)
+{
+  intptr_t thread_res = 0;
+  nfc_device *device = ((struct thread_data *) arg)->device;
+  cut_set_current_test_context(((struct thread_data *) arg)->cut_test_context);
+
+  /*
+   * Wait some time for the other thread to initialise NFC device as target
+   */
+  sleep(1);
+  printf("=========== INITIATOR %s =========\n", nfc_device_get_name(device));
+  int res = nfc_initiator_init(device);
+  cut_assert_equal_int(0, res, cut_message("Can't initialize NFC device as initiator: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  nfc_target nt;
+
+  // Active mode, highest bit rate
+  res = nfc_initiator_select_dep_target(device, NDM_ACTIVE, NBR_424, NULL, &nt, 1000);
+  cut_assert_operator_int(res, > , 0, cut_message("Can't select any DEP target: %s", nfc_strerror(device)));
+  cut_assert_equal_int(NBR_424, nt.nm.nbr, cut_message("Invalid target baud rate"));
+  if (res <= 0) { thread_res = -1; return (void *) thread_res; }
+
+  uint8_t abtTx[MESSAGE_LEN];
+  uint8_t abtRx[MESSAGE_LEN];
+  struct timeval tvStart, tvEnd;
+  gettimeofday(&tvStart, NULL);
+  for (int i = 0; i < MESSAGE_COUNT; i++) {
+    fill_message(abtTx, i);
+    res = nfc_initiator_transceive_bytes(device, abtTx, sizeof(abtTx), abtRx, sizeof(abtRx), 5000);
+    cut_assert_equal_int(MESSAGE_LEN, res, cut_message("Can't transceive message %d to target: %s", i, nfc_strerror(device)));
+    if (res != MESSAGE_LEN) { thread_res = -1; return (void *) thread_res; }
+    cut_assert_equal_memory(abtTx, sizeof(abtTx), abtRx, res, cut_message("Invalid echoed message %d", i));
+  }
+  gettimeofday(&tvEnd, NULL);
+
+  const double dElapsed = (tvEnd.tv_sec - tvStart.tv_sec) + (tvEnd.tv_usec - tvStart.tv_usec) / 1000000.0;
+  printf("=========== %d bytes each way in %.3f s: %.1f kbps =========\n", MESSAGE_LEN * MESSAGE_COUNT, dElapsed, (2.0 * 8 * MESSAGE_LEN * MESSAGE_COUNT) / dElapsed / 1000);
+
+  res = nfc_initiator_deselect_target(device);
+  cut_assert_operator_int(res, >= , 0, cut_message("Can't deselect target: %s", nfc_strerror(device)));
+  if (res < 0) { thread_res = -1; return (void *) thread_res; }
+
+  return (void *) thread_res;
+}
+
+void
+test_dep_throughput(void)
+{
+  CutTestContext *test_context = cut_get_current_test_context();
+  struct thread_data target_data = {
+    .device = devices[TARGET],
+    .cut_test_context = test_context,
+  };
+
+  struct thread_data initiator_data = {
+    .device = devices[INITIATOR],
+    .cut_test_context = test_context,
+  };
+
+  int res;
+
+  if ((res = pthread_create(&(threads[TARGET]), NULL, target_thread, &target_data)))
+    cut_fail("pthread_create() returned %d", res);
+  if ((res = pthread_create(&(threads[INITIATOR]), NULL, initiator_thread, &initiator_data)))
+    cut_fail("pthread_create() returned %d", res);
+
+  if ((res = pthread_join(threads[INITIATOR], (void *) &result[INITIATOR])))
+    cut_fail("pthread_join() returned %d", res);
+  if ((res = pthread_join(threads[TARGET], (void *) &result[TARGET])))
+    cut_fail("pthread_join() returned %d", res);
+
+  cut_assert_equal_int(0, result[INITIATOR], cut_message("Unexpected initiator return code"));
+  cut_assert_equal_int(0, result[TARGET], cut_message("Unexpected target return code"));
+}
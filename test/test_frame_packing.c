@@ -0,0 +1,141 @@
+#include <cutter.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include "chips/pn53x.h"
+#include "mirror-subr.h"
+#include "../utils/nfc-utils.h"
+
+void test_frame_wrap(void);
+void test_frame_unwrap(void);
+void test_mirror(void);
+void test_oddparity(void);
+
+/* Bit by bit references: the packed versions must give the very same bytes */
+
+static uint8_t
+reference_mirror(uint8_t bt)
+{
+  uint8_t btMirrored = 0;
+  for (int i = 0; i < 8; i++)
+    if (bt & (1 << i))
+      btMirrored |= 0x80 >> i;
+  return btMirrored;
+}
+
+static uint8_t
+reference_oddparity(uint8_t bt)
+{
+  uint8_t btParity = 1;
+  for (int i = 0; i < 8; i++)
+    btParity ^= (bt >> i) & 1;
+  return btParity;
+}
+
+// Frame bit 9*n+k is bit k of byte n, frame bit 9*n+8 its parity, every byte being sent whole
+static size_t
+reference_wrap_frame(const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtFrame)
+{
+  const size_t szBytes = (szTxBits + 7) / 8;
+  memset(pbtFrame, 0, (szBytes * 9 + 7) / 8);
+  for (size_t n = 0; n < szBytes; n++) {
+    for (size_t k = 0; k < 9; k++) {
+      const size_t szBit = 9 * n + k;
+      const int bit = (k < 8) ? ((pbtTx[n] >> k) & 1) : (pbtTxPar[n] & 1);
+      pbtFrame[szBit / 8] |= bit << (szBit % 8);
+    }
+  }
+  return szTxBits + szTxBits / 8;
+}
+
+static void
+random_bytes(uint8_t *pbt, size_t szLen)
+{
+  for (size_t n = 0; n < szLen; n++)
+    pbt[n] = (uint8_t) rand();
+}
+
+void
+test_frame_wrap(void)
+{
+  uint8_t abtTx[64], abtPar[64], abtFrame[80], abtExpected[80];
+
+  srand(1);
+  for (size_t szTxBits = 9; szTxBits <= 8 * sizeof(abtTx); szTxBits++) {
+    random_bytes(abtTx, sizeof(abtTx));
+    for (size_t n = 0; n < sizeof(abtPar); n++)
+      abtPar[n] = rand() & 1;
+    const size_t szExpected = reference_wrap_frame(abtTx, szTxBits, abtPar, abtExpected);
+    const size_t szFrameBytes = ((szTxBits + 7) / 8 * 9 + 7) / 8;
+
+    memset(abtFrame, 0xAA, sizeof(abtFrame));
+    int res = pn53x_wrap_frame(abtTx, szTxBits, abtPar, abtFrame);
+    cut_assert_equal_int(szExpected, res, cut_message("wrapped length of %zu bits", szTxBits));
+    cut_assert_equal_memory(abtExpected, szFrameBytes, abtFrame, szFrameBytes, cut_message("wrapped %zu bits", szTxBits));
+    cut_assert_equal_uint(0xAA, abtFrame[szFrameBytes], cut_message("no write past the frame of %zu bits", szTxBits));
+  }
+}
+
+void
+test_frame_unwrap(void)
+{
+  uint8_t abtTx[64], abtPar[64], abtFrame[80], abtRx[64], abtRxPar[64];
+
+  srand(2);
+  for (size_t szTxBits = 9; szTxBits <= 8 * sizeof(abtTx); szTxBits++) {
+    random_bytes(abtTx, sizeof(abtTx));
+    for (size_t n = 0; n < sizeof(abtPar); n++)
+      abtPar[n] = rand() & 1;
+    const size_t szFrameBits = reference_wrap_frame(abtTx, szTxBits, abtPar, abtFrame);
+    const size_t szBytes = (szFrameBits + 8) / 9;
+
+    int res = pn53x_unwrap_frame(abtFrame, szFrameBits, abtRx, abtRxPar);
+    cut_assert_equal_int(szFrameBits - szFrameBits / 9, res, cut_message("unwrapped length of %zu bits", szFrameBits));
+    cut_assert_equal_memory(abtPar, szBytes, abtRxPar, szBytes, cut_message("parities of %zu bits", szFrameBits));
+    // The last byte may be partial
+    cut_assert_equal_memory(abtTx, szBytes - 1, abtRx, szBytes - 1, cut_message("unwrapped %zu bits", szFrameBits));
+    const size_t szLastBits = res - 8 * (szBytes - 1);
+    const uint8_t btMask = (szLastBits >= 8) ? 0xFF : ((1 << szLastBits) - 1);
+    cut_assert_equal_uint(abtTx[szBytes - 1] & btMask, abtRx[szBytes - 1] & btMask, cut_message("last byte of %zu bits", szFrameBits));
+  }
+}
+
+void
+test_mirror(void)
+{
+  uint8_t abtData[61], abtMirrored[61];
+
+  for (int bt = 0; bt < 256; bt++)
+    cut_assert_equal_uint(reference_mirror(bt), mirror(bt), cut_message("mirror of %02x", bt));
+
+  srand(3);
+  random_bytes(abtData, sizeof(abtData));
+  memcpy(abtMirrored, abtData, sizeof(abtData));
+  mirror_uint8_ts(abtMirrored, sizeof(abtMirrored));
+  for (size_t n = 0; n < sizeof(abtData); n++)
+    cut_assert_equal_uint(reference_mirror(abtData[n]), abtMirrored[n], cut_message("mirrored byte %zu", n));
+
+  uint64_t ui64Bits, ui64Mirrored;
+  memcpy(&ui64Bits, abtData, 8);
+  ui64Mirrored = mirror64(ui64Bits);
+  mirror_uint8_ts((uint8_t *) &ui64Bits, 8);
+  cut_assert_equal_memory(&ui64Bits, 8, &ui64Mirrored, 8, cut_message("mirror64"));
+}
+
+void
+test_oddparity(void)
+{
+  uint8_t abtData[61], abtPar[61];
+
+  srand(4);
+  random_bytes(abtData, sizeof(abtData));
+  for (size_t szLen = 0; szLen <= sizeof(abtData); szLen++) {
+    memset(abtPar, 0xAA, sizeof(abtPar));
+    oddparity_bytes_ts(abtData, szLen, abtPar);
+    for (size_t n = 0; n < szLen; n++)
+      cut_assert_equal_uint(reference_oddparity(abtData[n]), abtPar[n], cut_message("parity of byte %zu out of %zu", n, szLen));
+    if (szLen < sizeof(abtPar))
+      cut_assert_equal_uint(0xAA, abtPar[szLen], cut_message("no write past %zu parities", szLen));
+  }
+}
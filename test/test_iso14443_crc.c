@@ -0,0 +1,64 @@
+#include <cutter.h>
+
+#include <nfc/nfc.h>
+
+void test_iso14443a_crc(void);
+void test_iso14443b_crc(void);
+void test_iso14443_crc_update(void);
+
+void
+test_iso14443a_crc(void)
+{
+  uint8_t abtCrc[2];
+
+  /* Examples from ISO/IEC 14443-3 Annex B */
+  uint8_t abtZero[] = { 0x00, 0x00 };
+  iso14443a_crc(abtZero, sizeof(abtZero), abtCrc);
+  cut_assert_equal_memory("\xa0\x1e", 2, abtCrc, 2, cut_message("CRC_A of 00 00"));
+
+  uint8_t abtFrame[] = { 0x12, 0x34, 0x00, 0x00 };
+  iso14443a_crc_append(abtFrame, 2);
+  cut_assert_equal_memory("\x26\xcf", 2, abtFrame + 2, 2, cut_message("CRC_A of 12 34"));
+  cut_assert_true(iso14443a_crc_check(abtFrame, sizeof(abtFrame)), cut_message("check CRC_A"));
+
+  abtFrame[0] ^= 0x01;
+  cut_assert_false(iso14443a_crc_check(abtFrame, sizeof(abtFrame)), cut_message("check corrupted CRC_A"));
+  cut_assert_false(iso14443a_crc_check(abtFrame, 1), cut_message("check frame shorter than its CRC"));
+}
+
+void
+test_iso14443b_crc(void)
+{
+  uint8_t abtCrc[2];
+
+  /* Examples from ISO/IEC 14443-3 Annex B */
+  uint8_t abtZero[] = { 0x00, 0x00, 0x00 };
+  iso14443b_crc(abtZero, sizeof(abtZero), abtCrc);
+  cut_assert_equal_memory("\xcc\xc6", 2, abtCrc, 2, cut_message("CRC_B of 00 00 00"));
+
+  uint8_t abtFrame[] = { 0x0a, 0x12, 0x34, 0x56, 0x00, 0x00 };
+  iso14443b_crc_append(abtFrame, 4);
+  cut_assert_equal_memory("\x2c\xf6", 2, abtFrame + 4, 2, cut_message("CRC_B of 0a 12 34 56"));
+  cut_assert_true(iso14443b_crc_check(abtFrame, sizeof(abtFrame)), cut_message("check CRC_B"));
+
+  abtFrame[5] ^= 0x80;
+  cut_assert_false(iso14443b_crc_check(abtFrame, sizeof(abtFrame)), cut_message("check corrupted CRC_B"));
+}
+
+void
+test_iso14443_crc_update(void)
+{
+  uint8_t abtData[37];
+  uint8_t abtCrc[2];
+
+  for (size_t n = 0; n < sizeof(abtData); n++)
+    abtData[n] = (uint8_t)(n * 37 + 11);
+  iso14443a_crc(abtData, sizeof(abtData), abtCrc);
+
+  /* Any split of the frame, across the four bytes steps, gives the same CRC */
+  for (size_t split = 0; split <= sizeof(abtData); split++) {
+    uint16_t wCrc = iso14443_crc_update(ISO14443A_CRC_INIT, abtData, split);
+    wCrc = iso14443_crc_update(wCrc, abtData + split, sizeof(abtData) - split) ^ ISO14443A_CRC_XOROUT;
+    cut_assert_equal_uint(abtCrc[0] | (abtCrc[1] << 8), wCrc, cut_message("streamed CRC_A split at %zu", split));
+  }
+}
@@ -0,0 +1,166 @@
+#include <cutter.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-llcp.h>
+
+/*
+ * Received frames are fed to a target side link as if the initiator had just
+ * sent them, the virtual device only stands for its (empty) answers.
+ */
+void test_llcp_activate_params(void);
+void test_llcp_connect_params(void);
+void test_llcp_agf(void);
+
+#define SERVICE_SAP  0x10
+// MIU without MIUX, from LLCP 1.1
+#define LLCP_MIU_DEFAULT  128
+
+static nfc_context *context;
+static nfc_device *device;
+static nfc_llcp_link link;
+static nfc_llcp_service service;
+static int received;
+static int opened;
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  device = NULL;
+  received = 0;
+  opened = 0;
+}
+
+void
+cut_teardown(void)
+{
+  if (device)
+    nfc_close(device);
+  nfc_exit(context);
+}
+
+static void
+service_receive(nfc_llcp_link *pll, int iConnection, const uint8_t *pbtData, size_t szData, void *user_data)
+{
+  (void) pll;
+  (void) szData;
+  (void) user_data;
+  if (pbtData)
+    received++;
+  else if (iConnection >= 0)
+    opened++;
+}
+
+// Activates a target link from the general bytes the library offers, with a service bound to SERVICE_SAP
+static void
+llcp_open(void)
+{
+  uint8_t abtGB[NFC_LLCP_GENERAL_BYTES_LEN];
+
+  cut_assert_not_null(context, cut_message("nfc_init"));
+  device = nfc_open(context, "virtual");
+  if (!device)
+    cut_omit("Virtual driver not available");
+  cut_assert_equal_int(sizeof(abtGB), nfc_llcp_general_bytes(abtGB, sizeof(abtGB)), cut_message("general bytes"));
+  cut_assert_equal_int(0, nfc_llcp_link_activate(&link, device, false, abtGB, sizeof(abtGB)), cut_message("activate"));
+  memset(&service, 0, sizeof(service));
+  service.ui8Sap = SERVICE_SAP;
+  service.pcServiceName = NFC_SNEP_SERVICE_NAME;
+  service.cb = service_receive;
+  cut_assert_equal_int(0, nfc_llcp_bind(&link, &service), cut_message("bind"));
+}
+
+// Handles a frame as received from the initiator
+static int
+llcp_receive(const uint8_t *pbtFrame, const size_t szFrame)
+{
+  memcpy(link.abtRx, pbtFrame, szFrame);
+  link.szRx = szFrame;
+  link.bRxPending = true;
+  return nfc_llcp_link_service(&link, 0);
+}
+
+void
+test_llcp_activate_params(void)
+{
+  // Magic, VERSION 1.1 and MIUX 0x7ff, far over what we take
+  const uint8_t abtOversizeMiux[] = { 0x46, 0x66, 0x6d, 0x01, 0x01, 0x11, 0x02, 0x02, 0x07, 0xff };
+  // VERSION followed by a type without its length
+  const uint8_t abtNoLength[] = { 0x46, 0x66, 0x6d, 0x01, 0x01, 0x11, 0x04 };
+  // LTO claiming more value bytes than left
+  const uint8_t abtShortValue[] = { 0x46, 0x66, 0x6d, 0x01, 0x01, 0x11, 0x04, 0x02, 0x64 };
+  // Length 0xff, past the end
+  const uint8_t abtOversizeLength[] = { 0x46, 0x66, 0x6d, 0x01, 0xff, 0x11 };
+  // VERSION of the wrong size is ignored, so the version is unknown
+  const uint8_t abtBadVersion[] = { 0x46, 0x66, 0x6d, 0x01, 0x02, 0x11, 0x00 };
+  // Unknown TLVs are skipped
+  const uint8_t abtUnknown[] = { 0x46, 0x66, 0x6d, 0x80, 0x03, 0x01, 0x02, 0x03, 0x01, 0x01, 0x10 };
+
+  cut_assert_equal_int(0, nfc_llcp_link_activate(&link, NULL, true, abtOversizeMiux, sizeof(abtOversizeMiux)), cut_message("oversize MIUX"));
+  cut_assert_equal_uint(NFC_LLCP_MIU_MAX, link.szRemoteMiu, cut_message("MIU bound to ours"));
+  cut_assert_equal_int(100, link.iRemoteLto, cut_message("default LTO"));
+
+  cut_assert_equal_int(NFC_ERFTRANS, nfc_llcp_link_activate(&link, NULL, true, abtNoLength, sizeof(abtNoLength)), cut_message("TLV without length"));
+  cut_assert_equal_int(NFC_ERFTRANS, nfc_llcp_link_activate(&link, NULL, true, abtShortValue, sizeof(abtShortValue)), cut_message("truncated value"));
+  cut_assert_equal_int(NFC_ERFTRANS, nfc_llcp_link_activate(&link, NULL, true, abtOversizeLength, sizeof(abtOversizeLength)), cut_message("length past the end"));
+  cut_assert_equal_int(NFC_EINVARG, nfc_llcp_link_activate(&link, NULL, true, abtBadVersion, sizeof(abtBadVersion)), cut_message("bad VERSION size"));
+  cut_assert_equal_int(NFC_EINVARG, nfc_llcp_link_activate(&link, NULL, true, abtOversizeMiux, 2), cut_message("truncated magic"));
+  cut_assert_equal_int(0, nfc_llcp_link_activate(&link, NULL, true, abtUnknown, sizeof(abtUnknown)), cut_message("unknown TLV"));
+  cut_assert_equal_int(0x10, link.ui8RemoteVersion, cut_message("VERSION after unknown TLV"));
+}
+
+void
+test_llcp_connect_params(void)
+{
+  // CONNECT from SAP 32 to SDP by name, then with the SN length past the end, then with a lone type byte
+  const uint8_t abtByName[] = { 0x05, 0x20, 0x06, 0x0f, 'u', 'r', 'n', ':', 'n', 'f', 'c', ':', 's', 'n', ':', 's', 'n', 'e', 'p' };
+  const uint8_t abtShortName[] = { 0x05, 0x21, 0x06, 0x10, 'u', 'r', 'n', ':', 'n', 'f', 'c', ':', 's', 'n', ':', 's', 'n', 'e', 'p' };
+  const uint8_t abtNoLength[] = { 0x41, 0x22, 0x05, 0x01, 0x04, 0x02 };
+  // CONNECT by SAP with MIUX and RW
+  const uint8_t abtBySap[] = { 0x41, 0x23, 0x02, 0x02, 0x00, 0x80, 0x05, 0x01, 0x02 };
+
+  llcp_open();
+  cut_assert_equal_int(NFC_ERFTRANS, llcp_receive(abtShortName, sizeof(abtShortName)), cut_message("SN past the end"));
+  cut_assert_equal_int(NFC_ERFTRANS, llcp_receive(abtNoLength, sizeof(abtNoLength)), cut_message("TLV without length"));
+  cut_assert_equal_int(0, opened, cut_message("no connection from malformed CONNECT"));
+  for (int i = 0; i < NFC_LLCP_CONNECTIONS; i++)
+    cut_assert_equal_int(NFC_LLCP_CLOSED, nfc_llcp_connection_get_state(&link, i), cut_message("connection %d closed", i));
+
+  cut_assert_equal_int(1, llcp_receive(abtByName, sizeof(abtByName)), cut_message("CONNECT by name"));
+  cut_assert_equal_int(1, llcp_receive(abtBySap, sizeof(abtBySap)), cut_message("CONNECT by SAP"));
+  cut_assert_equal_int(2, opened, cut_message("both connections opened"));
+  cut_assert_equal_int(NFC_LLCP_CONNECTED, nfc_llcp_connection_get_state(&link, 0), cut_message("first connection"));
+  cut_assert_equal_int(NFC_LLCP_CONNECTED, nfc_llcp_connection_get_state(&link, 1), cut_message("second connection"));
+  cut_assert_equal_uint(LLCP_MIU_DEFAULT + 0x80, link.aConnections[1].szRemoteMiu, cut_message("MIUX of CONNECT"));
+  cut_assert_equal_int(2, link.aConnections[1].ui8RemoteRw, cut_message("RW of CONNECT"));
+}
+
+void
+test_llcp_agf(void)
+{
+  // UI PDUs from SAP 32 to the service
+  const uint8_t abtAgf[] = { 0x00, 0x80, 0x00, 0x03, 0x40, 0xe0, 'a', 0x00, 0x04, 0x40, 0xe0, 'b', 'c' };
+  // Second length past the end of the frame
+  const uint8_t abtOversize[] = { 0x00, 0x80, 0x00, 0x03, 0x40, 0xe0, 'a', 0x00, 0x05, 0x40, 0xe0, 'b', 'c' };
+  // Lone byte where a length is expected
+  const uint8_t abtShortLength[] = { 0x00, 0x80, 0x00, 0x03, 0x40, 0xe0, 'a', 0x00 };
+  // An AGF inside an AGF is dropped, the UI PDU aside of it is not
+  const uint8_t abtNested[] = { 0x00, 0x80, 0x00, 0x07, 0x00, 0x80, 0x00, 0x03, 0x40, 0xe0, 'a', 0x00, 0x03, 0x40, 0xe0, 'b' };
+  // Empty AGF, and parts too short to be PDUs
+  const uint8_t abtEmpty[] = { 0x00, 0x80 };
+  const uint8_t abtTiny[] = { 0x00, 0x80, 0x00, 0x00, 0x00, 0x01, 0x40 };
+
+  llcp_open();
+  cut_assert_equal_int(2, llcp_receive(abtAgf, sizeof(abtAgf)), cut_message("two PDUs"));
+  cut_assert_equal_int(2, received, cut_message("two SDUs"));
+
+  cut_assert_equal_int(NFC_ERFTRANS, llcp_receive(abtOversize, sizeof(abtOversize)), cut_message("oversize length"));
+  cut_assert_equal_int(NFC_ERFTRANS, llcp_receive(abtShortLength, sizeof(abtShortLength)), cut_message("truncated length"));
+
+  received = 0;
+  cut_assert_equal_int(1, llcp_receive(abtNested, sizeof(abtNested)), cut_message("nested AGF"));
+  cut_assert_equal_int(1, received, cut_message("only the SDU aside of the nested AGF"));
+  cut_assert_equal_int(0, llcp_receive(abtEmpty, sizeof(abtEmpty)), cut_message("empty AGF"));
+  cut_assert_equal_int(0, llcp_receive(abtTiny, sizeof(abtTiny)), cut_message("parts shorter than a header"));
+}
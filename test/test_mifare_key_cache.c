@@ -0,0 +1,73 @@
+#include <cutter.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-mifare.h>
+
+void test_mifare_key_cache_store_lookup(void);
+void test_mifare_key_cache_odd_sequence(void);
+
+static char acPath[] = "/tmp/test_mifare_key_cache.XXXXXX";
+static int fd;
+
+void
+cut_setup(void)
+{
+  strcpy(acPath + strlen(acPath) - 6, "XXXXXX");
+  fd = mkstemp(acPath);
+}
+
+void
+cut_teardown(void)
+{
+  if (fd >= 0) {
+    close(fd);
+    unlink(acPath);
+  }
+}
+
+static const uint8_t abtUid[] = { 0xde, 0xad, 0xbe, 0xef };
+static const uint8_t abtKey[] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+
+void
+test_mifare_key_cache_store_lookup(void)
+{
+  cut_assert_operator_int(fd, >= , 0, cut_message("mkstemp"));
+  nfc_mifare_key_cache *pmkc = nfc_mifare_key_cache_open(acPath, 4);
+  cut_assert_not_null(pmkc, cut_message("nfc_mifare_key_cache_open"));
+
+  uint8_t abtFound[6];
+  cut_assert_equal_int(0, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtFound, NULL), cut_message("unknown card"));
+  cut_assert_equal_int(0, nfc_mifare_key_cache_store(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtKey, NULL), cut_message("store"));
+  cut_assert_equal_int(MIFARE_KEY_CACHE_KEY, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtFound, NULL), cut_message("key found"));
+  cut_assert_equal_memory(abtKey, sizeof(abtKey), abtFound, sizeof(abtFound), cut_message("key"));
+  cut_assert_equal_int(0, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_B, abtFound, NULL), cut_message("key B unknown"));
+  nfc_mifare_key_cache_close(pmkc);
+}
+
+void
+test_mifare_key_cache_odd_sequence(void)
+{
+  cut_assert_operator_int(fd, >= , 0, cut_message("mkstemp"));
+  // Single record, right after the 16 bytes header, starting with its sequence number
+  nfc_mifare_key_cache *pmkc = nfc_mifare_key_cache_open(acPath, 1);
+  cut_assert_not_null(pmkc, cut_message("nfc_mifare_key_cache_open"));
+  cut_assert_equal_int(0, nfc_mifare_key_cache_store(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtKey, NULL), cut_message("store"));
+
+  // A writer crashed in the middle of an update
+  const uint32_t ui32Sequence = 3;
+  cut_assert_equal_int(sizeof(ui32Sequence), pwrite(fd, &ui32Sequence, sizeof(ui32Sequence), 16), cut_message("pwrite"));
+  uint8_t abtFound[6];
+  cut_assert_equal_int(0, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtFound, NULL), cut_message("record busy"));
+
+  // The next update must leave it readable again
+  cut_assert_equal_int(0, nfc_mifare_key_cache_store(pmkc, abtUid, sizeof(abtUid), 2, MC_AUTH_B, abtKey, NULL), cut_message("store over odd sequence"));
+  uint32_t ui32After;
+  cut_assert_equal_int(sizeof(ui32After), pread(fd, &ui32After, sizeof(ui32After), 16), cut_message("pread"));
+  cut_assert_equal_uint(0, ui32After & 1, cut_message("even sequence"));
+  cut_assert_equal_int(MIFARE_KEY_CACHE_KEY, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 2, MC_AUTH_B, abtFound, NULL), cut_message("new key found"));
+  cut_assert_equal_int(MIFARE_KEY_CACHE_KEY, nfc_mifare_key_cache_lookup(pmkc, abtUid, sizeof(abtUid), 1, MC_AUTH_A, abtFound, NULL), cut_message("old key kept"));
+  nfc_mifare_key_cache_close(pmkc);
+}
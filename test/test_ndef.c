@@ -0,0 +1,204 @@
+#include <cutter.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-ndef.h>
+
+void test_ndef_iterator(void);
+void test_ndef_iterator_truncated(void);
+void test_ndef_tlv(void);
+void test_ndef_tlv_truncated(void);
+void test_ndef_uri(void);
+
+// URI record of "U" type with identifier code btCode and the given rest
+static void
+ndef_uri_record(nfc_ndef_record *pnr, uint8_t *pbtPayload, const uint8_t btCode, const char *pcRest)
+{
+  pbtPayload[0] = btCode;
+  memcpy(pbtPayload + 1, pcRest, strlen(pcRest));
+  pnr->btHeader = NDEF_RECORD_MB | NDEF_RECORD_ME | NDEF_RECORD_SR | NDEF_TNF_WELL_KNOWN;
+  pnr->pbtType = (const uint8_t *) "U";
+  pnr->szType = 1;
+  pnr->pbtId = NULL;
+  pnr->szId = 0;
+  pnr->pbtPayload = pbtPayload;
+  pnr->szPayload = 1 + strlen(pcRest);
+}
+
+void
+test_ndef_iterator(void)
+{
+  // Short URI record with an ID, then a long text record with ME, then bytes past ME
+  const uint8_t abtMessage[] = {
+    0x99, 0x01, 0x04, 0x02, 'U', 'i', 'd', 0x03, 'a', '.', 'b',
+    0x41, 0x01, 0x00, 0x00, 0x00, 0x03, 'T', 0x02, 'e', 'n',
+    0xaa, 0xbb,
+  };
+  nfc_ndef_iterator ni;
+  nfc_ndef_record nr;
+
+  nfc_ndef_iterator_init(&ni, abtMessage, sizeof(abtMessage));
+  cut_assert_equal_int(1, nfc_ndef_iterator_next(&ni, &nr), cut_message("first record"));
+  cut_assert_equal_uint(NDEF_TNF_WELL_KNOWN, nr.btHeader & NDEF_RECORD_TNF_MASK, cut_message("first TNF"));
+  cut_assert_equal_memory("U", 1, nr.pbtType, nr.szType, cut_message("first type"));
+  cut_assert_equal_memory("id", 2, nr.pbtId, nr.szId, cut_message("first ID"));
+  cut_assert_equal_memory("\x03" "a.b", 4, nr.pbtPayload, nr.szPayload, cut_message("first payload"));
+
+  cut_assert_equal_int(1, nfc_ndef_iterator_next(&ni, &nr), cut_message("second record"));
+  cut_assert_equal_uint(0, nr.szId, cut_message("second ID"));
+  cut_assert_equal_memory("T", 1, nr.pbtType, nr.szType, cut_message("second type"));
+  cut_assert_equal_memory("\x02" "en", 3, nr.pbtPayload, nr.szPayload, cut_message("second payload"));
+
+  // ME ends the message, whatever follows
+  cut_assert_equal_int(0, nfc_ndef_iterator_next(&ni, &nr), cut_message("end after ME"));
+  cut_assert_equal_int(0, nfc_ndef_iterator_next(&ni, &nr), cut_message("end stays"));
+
+  nfc_ndef_iterator_init(&ni, abtMessage, 0);
+  cut_assert_equal_int(0, nfc_ndef_iterator_next(&ni, &nr), cut_message("empty message"));
+}
+
+void
+test_ndef_iterator_truncated(void)
+{
+  // Payload length past the end
+  const uint8_t abtPayload[] = { 0xd1, 0x01, 0x05, 'U', 0x01, 'a' };
+  // Type length past the end
+  const uint8_t abtType[] = { 0xd1, 0x08, 0x00, 'U' };
+  // ID length past the end
+  const uint8_t abtId[] = { 0xd9, 0x01, 0x00, 0x04, 'U', 'i' };
+  // Long record whose lengths are cut, then a 4 GiB payload
+  const uint8_t abtLengths[] = { 0xc1, 0x01, 0x00, 0x00 };
+  const uint8_t abtHuge[] = { 0xc1, 0x01, 0xff, 0xff, 0xff, 0xff, 'U', 0x00 };
+  // Second record running past the buffer
+  const uint8_t abtSecond[] = { 0x91, 0x01, 0x01, 'U', 0x00, 0x51, 0x01, 0x02, 'U', 0x00 };
+  nfc_ndef_iterator ni;
+  nfc_ndef_record nr;
+
+  nfc_ndef_iterator_init(&ni, abtPayload, sizeof(abtPayload));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("payload"));
+  nfc_ndef_iterator_init(&ni, abtType, sizeof(abtType));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("type"));
+  nfc_ndef_iterator_init(&ni, abtId, sizeof(abtId));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("ID"));
+  nfc_ndef_iterator_init(&ni, abtLengths, sizeof(abtLengths));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("lengths"));
+  nfc_ndef_iterator_init(&ni, abtHuge, sizeof(abtHuge));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("huge payload"));
+
+  nfc_ndef_iterator_init(&ni, abtSecond, sizeof(abtSecond));
+  cut_assert_equal_int(1, nfc_ndef_iterator_next(&ni, &nr), cut_message("first record fits"));
+  cut_assert_equal_int(NFC_EIO, nfc_ndef_iterator_next(&ni, &nr), cut_message("second record"));
+}
+
+void
+test_ndef_tlv(void)
+{
+  // NULL, Lock Control, NDEF Message with a 3-byte length, NULL, Terminator
+  uint8_t abtArea[4 + 1 + 5 + 4 + 0x0102 + 2];
+  memset(abtArea, 0, sizeof(abtArea));
+  memcpy(abtArea, "\x00\x01\x03\xa0", 4);
+  memcpy(abtArea + 4, "\x10\x44\x03\xff\x01", 5);
+  abtArea[9] = 0x02;
+  abtArea[sizeof(abtArea) - 1] = NDEF_TLV_TERMINATOR;
+  nfc_ndef_tlv ntlv;
+  size_t szOffset = 0;
+
+  cut_assert_equal_int(1, nfc_ndef_tlv_next(abtArea, sizeof(abtArea), &szOffset, &ntlv), cut_message("Lock Control"));
+  cut_assert_equal_uint(NDEF_TLV_LOCK_CONTROL, ntlv.btType, cut_message("Lock Control type"));
+  cut_assert_equal_uint(3, ntlv.szLength, cut_message("Lock Control length"));
+  cut_assert_equal_uint(3, ntlv.szValueOffset, cut_message("Lock Control value"));
+  cut_assert_equal_uint(6, szOffset, cut_message("past Lock Control"));
+
+  cut_assert_equal_int(1, nfc_ndef_tlv_next(abtArea, sizeof(abtArea), &szOffset, &ntlv), cut_message("NDEF Message"));
+  cut_assert_equal_uint(NDEF_TLV_NDEF_MESSAGE, ntlv.btType, cut_message("NDEF Message type"));
+  cut_assert_equal_uint(0x0102, ntlv.szLength, cut_message("3-byte length"));
+  cut_assert_equal_uint(10, ntlv.szValueOffset, cut_message("NDEF Message value"));
+
+  cut_assert_equal_int(0, nfc_ndef_tlv_next(abtArea, sizeof(abtArea), &szOffset, &ntlv), cut_message("Terminator"));
+  cut_assert_equal_uint(sizeof(abtArea) - 1, szOffset, cut_message("stays on Terminator"));
+  cut_assert_equal_int(0, nfc_ndef_tlv_next(abtArea, sizeof(abtArea), &szOffset, &ntlv), cut_message("Terminator again"));
+}
+
+void
+test_ndef_tlv_truncated(void)
+{
+  // NDEF Message TLV whose value runs past the 16 bytes we have
+  const uint8_t abtLong[] = { 0x03, 0x20, 0xd1, 0x01, 0x1c, 'U', 0x04, 'e', 'x', 'a', 'm', 'p', 'l', 'e', '.', 'c' };
+  // Header cut after the type, then inside the 3-byte length
+  const uint8_t abtType[] = { 0x00, 0x00, 0x03 };
+  const uint8_t abtLength[] = { 0x03, 0xff, 0x01 };
+  // Only NULL TLVs
+  const uint8_t abtNull[] = { 0x00, 0x00 };
+  nfc_ndef_tlv ntlv;
+  size_t szOffset = 0;
+
+  cut_assert_equal_int(1, nfc_ndef_tlv_next(abtLong, sizeof(abtLong), &szOffset, &ntlv), cut_message("value past the area"));
+  cut_assert_equal_uint(0x20, ntlv.szLength, cut_message("length"));
+  cut_assert_equal_uint(2, ntlv.szValueOffset, cut_message("value offset"));
+  cut_assert_equal_uint(0x22, szOffset, cut_message("next TLV beyond the area"));
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_ndef_tlv_next(abtLong, sizeof(abtLong), &szOffset, &ntlv), cut_message("next TLV not read yet"));
+  cut_assert_equal_uint(0x22, szOffset, cut_message("offset to read up to"));
+
+  szOffset = 0;
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_ndef_tlv_next(abtType, sizeof(abtType), &szOffset, &ntlv), cut_message("cut after type"));
+  cut_assert_equal_uint(2, szOffset, cut_message("NULL TLVs skipped"));
+  szOffset = 0;
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_ndef_tlv_next(abtLength, sizeof(abtLength), &szOffset, &ntlv), cut_message("cut in 3-byte length"));
+  cut_assert_equal_uint(0, szOffset, cut_message("TLV read again from its start"));
+  szOffset = 0;
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_ndef_tlv_next(abtNull, sizeof(abtNull), &szOffset, &ntlv), cut_message("NULL TLVs only"));
+  cut_assert_equal_uint(sizeof(abtNull), szOffset, cut_message("area just ended"));
+}
+
+void
+test_ndef_uri(void)
+{
+  uint8_t abtPayload[32];
+  char acUri[32];
+  nfc_ndef_record nr;
+
+  ndef_uri_record(&nr, abtPayload, 0x01, "example.com");
+  cut_assert_equal_int(22, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("http://www."));
+  cut_assert_equal_string("http://www.example.com", acUri);
+
+  ndef_uri_record(&nr, abtPayload, 0x00, "tag:x");
+  cut_assert_equal_int(5, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("no prefix"));
+  cut_assert_equal_string("tag:x", acUri);
+
+  // Last code defined, then reserved ones
+  ndef_uri_record(&nr, abtPayload, 0x23, "sn:snep");
+  cut_assert_equal_int(15, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("urn:nfc:"));
+  cut_assert_equal_string("urn:nfc:sn:snep", acUri);
+  ndef_uri_record(&nr, abtPayload, 0x24, "x:y");
+  cut_assert_equal_int(3, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("code 0x24"));
+  cut_assert_equal_string("x:y", acUri);
+  ndef_uri_record(&nr, abtPayload, 0xff, "x:y");
+  cut_assert_equal_int(3, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("code 0xff"));
+  cut_assert_equal_string("x:y", acUri);
+
+  // Room for the nul
+  ndef_uri_record(&nr, abtPayload, 0x05, "123");
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_ndef_record_uri(&nr, acUri, 7), cut_message("too small"));
+  cut_assert_equal_int(7, nfc_ndef_record_uri(&nr, acUri, 8), cut_message("just fits"));
+  cut_assert_equal_string("tel:123", acUri);
+
+  // Identifier code alone
+  nr.szPayload = 1;
+  cut_assert_equal_int(4, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("prefix only"));
+  cut_assert_equal_string("tel:", acUri);
+  nr.szPayload = 0;
+  cut_assert_equal_int(NFC_EINVARG, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("empty payload"));
+
+  nr.pbtType = (const uint8_t *) "T";
+  nr.szPayload = 1;
+  cut_assert_equal_int(NFC_EINVARG, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("text record"));
+
+  nr.btHeader = NDEF_RECORD_MB | NDEF_RECORD_ME | NDEF_RECORD_SR | NDEF_TNF_ABSOLUTE_URI;
+  nr.pbtType = (const uint8_t *) "http://a/";
+  nr.szType = 9;
+  cut_assert_equal_int(9, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("absolute URI"));
+  cut_assert_equal_string("http://a/", acUri);
+
+  nr.btHeader = NDEF_RECORD_MB | NDEF_RECORD_ME | NDEF_RECORD_SR | NDEF_TNF_MEDIA;
+  cut_assert_equal_int(NFC_EINVARG, nfc_ndef_record_uri(&nr, acUri, sizeof(acUri)), cut_message("media record"));
+}
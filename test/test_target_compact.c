@@ -0,0 +1,92 @@
+#include <cutter.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+void test_target_compact_iso14443a(void);
+void test_target_compact_arena(void);
+void test_target_compact_key(void);
+
+static nfc_target
+iso14443a_target(const uint8_t *pbtUid, const size_t szUid, const uint8_t *pbtAts, const size_t szAts)
+{
+  nfc_target nt;
+  memset(&nt, 0x00, sizeof(nt));
+  nt.nm.nmt = NMT_ISO14443A;
+  nt.nm.nbr = NBR_106;
+  nt.nti.nai.abtAtqa[1] = 0x44;
+  nt.nti.nai.btSak = 0x20;
+  memcpy(nt.nti.nai.abtUid, pbtUid, szUid);
+  nt.nti.nai.szUidLen = szUid;
+  if (szAts)
+    memcpy(nt.nti.nai.abtAts, pbtAts, szAts);
+  nt.nti.nai.szAtsLen = szAts;
+  return nt;
+}
+
+void
+test_target_compact_iso14443a(void)
+{
+  uint8_t abtArena[64];
+  nfc_target_arena nta;
+  nfc_target_arena_init(&nta, abtArena, sizeof(abtArena));
+
+  const nfc_target nt = iso14443a_target((const uint8_t *) "\x04\x11\x22\x33\x44\x55\x66", 7, (const uint8_t *) "\x75\x77\x81\x02\x80", 5);
+  nfc_target_compact ntc;
+  cut_assert_equal_int(0, nfc_target_compact_from(&ntc, &nt, &nta), cut_message("pack"));
+  cut_assert_equal_uint(5, nta.szUsed, cut_message("ATS stored in the arena"));
+
+  nfc_target ntOut;
+  cut_assert_equal_int(0, nfc_target_compact_to(&ntOut, &ntc, &nta), cut_message("unpack"));
+  cut_assert_equal_memory(&nt, sizeof(nt), &ntOut, sizeof(ntOut), cut_message("round trip"));
+
+  cut_assert_equal_int(0, nfc_target_compact_to(&ntOut, &ntc, NULL), cut_message("unpack without arena"));
+  cut_assert_equal_uint(0, ntOut.nti.nai.szAtsLen, cut_message("ATS left out"));
+}
+
+void
+test_target_compact_arena(void)
+{
+  uint8_t abtArena[8];
+  nfc_target_arena nta;
+  nfc_target_arena_init(&nta, abtArena, sizeof(abtArena));
+
+  const nfc_target nt = iso14443a_target((const uint8_t *) "\x01\x02\x03\x04", 4, (const uint8_t *) "\x06\x77\x81\x02\x80", 5);
+  nfc_target_compact antc[2];
+  cut_assert_equal_int(0, nfc_target_compact_from(&antc[0], &nt, &nta), cut_message("first ATS fits"));
+  cut_assert_equal_int(NFC_EOVFLOW, nfc_target_compact_from(&antc[1], &nt, &nta), cut_message("second ATS doesn't fit"));
+  cut_assert_equal_uint(5, nta.szUsed, cut_message("arena untouched by the failure"));
+  cut_assert_equal_int(0, nfc_target_compact_from(&antc[1], &nt, NULL), cut_message("ATS dropped without arena"));
+  cut_assert_equal_uint(0, antc[1].szAtsLen, cut_message("no ATS"));
+}
+
+void
+test_target_compact_key(void)
+{
+  nfc_target nt1 = iso14443a_target((const uint8_t *) "\x01\x02\x03\x04", 4, NULL, 0);
+  nfc_target nt2 = nt1;
+  nt2.nti.nai.btSak = 0x08;
+  nt2.nm.nbr = NBR_424;
+  nfc_target_compact ntc1, ntc2;
+  nfc_target_compact_from(&ntc1, &nt1, NULL);
+  nfc_target_compact_from(&ntc2, &nt2, NULL);
+  cut_assert_true(nfc_target_compact_equal(&ntc1, &ntc2), cut_message("same UID, same card"));
+  cut_assert_equal_uint(nfc_target_compact_hash(&ntc1), nfc_target_compact_hash(&ntc2), cut_message("same hash"));
+
+  nt2.nti.nai.abtUid[3] = 0x05;
+  nfc_target_compact_from(&ntc2, &nt2, NULL);
+  cut_assert_false(nfc_target_compact_equal(&ntc1, &ntc2), cut_message("other UID"));
+
+  // Same bytes as a FeliCa IDm prefix are another card
+  nfc_target ntf;
+  memset(&ntf, 0x00, sizeof(ntf));
+  ntf.nm.nmt = NMT_FELICA;
+  ntf.nm.nbr = NBR_212;
+  memcpy(ntf.nti.nfi.abtId, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+  nfc_target_compact ntcf;
+  cut_assert_equal_int(0, nfc_target_compact_from(&ntcf, &ntf, NULL), cut_message("pack FeliCa"));
+  cut_assert_false(nfc_target_compact_equal(&ntc1, &ntcf), cut_message("other modulation"));
+  nfc_target ntOut;
+  cut_assert_equal_int(0, nfc_target_compact_to(&ntOut, &ntcf, NULL), cut_message("unpack FeliCa"));
+  cut_assert_equal_memory(ntf.nti.nfi.abtId, 8, ntOut.nti.nfi.abtId, 8, cut_message("IDm round trip"));
+}
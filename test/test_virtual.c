@@ -0,0 +1,214 @@
+#include <cutter.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+/*
+ * These tests run against the virtual driver, so they need no hardware but
+ * are omitted when libnfc was built without it.
+ */
+void test_virtual_select(void);
+void test_virtual_select_none(void);
+void test_virtual_target_is_present(void);
+void test_virtual_inventory_mifare_classic(void);
+void test_virtual_inventory_ultralight(void);
+void test_virtual_inventory_mixed(void);
+
+static nfc_context *context;
+static nfc_device *device;
+
+static const nfc_modulation nmIso14443a = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+// Tag kinds of the virtual driver, as a PN532 reports them
+static const struct {
+  const char *connstring;
+  uint8_t abtAtqa[2];
+  uint8_t btSak;
+  size_t szUidLen;
+  bool bAts;
+} virtual_tags[] = {
+  { "virtual:mifare1k",   { 0x00, 0x04 }, 0x08, 4, false },
+  { "virtual:mifare4k",   { 0x00, 0x02 }, 0x18, 4, false },
+  { "virtual:ultralight", { 0x00, 0x44 }, 0x00, 7, false },
+  { "virtual:isodep",     { 0x03, 0x44 }, 0x20, 7, true },
+};
+
+void
+cut_setup(void)
+{
+  nfc_init(&context);
+  device = NULL;
+}
+
+void
+cut_teardown(void)
+{
+  if (device)
+    nfc_close(device);
+  nfc_exit(context);
+}
+
+static void
+virtual_open(const char *connstring)
+{
+  cut_assert_not_null(context, cut_message("nfc_init"));
+  device = nfc_open(context, connstring);
+  if (!device)
+    cut_omit("Virtual driver not available");
+  cut_assert_equal_int(0, nfc_initiator_init(device), cut_message("nfc_initiator_init"));
+}
+
+// Runs an inventory over two cards of the same kind and checks what we learnt about each of them
+static void
+virtual_inventory_two(const char *connstring, const uint8_t *pbtAtqa, const uint8_t btSak, const size_t szUidLen)
+{
+  virtual_open(connstring);
+
+  nfc_target ant[4];
+  int res = nfc_initiator_inventory_iso14443a(device, ant, 4);
+  cut_assert_equal_int(2, res, cut_message("two cards found"));
+
+  for (int i = 0; i < 2; i++) {
+    cut_assert_equal_int(NMT_ISO14443A, ant[i].nm.nmt, cut_message("card %d modulation", i));
+    cut_assert_equal_memory(pbtAtqa, 2, ant[i].nti.nai.abtAtqa, 2, cut_message("card %d ATQA in SENS_RES order", i));
+    cut_assert_equal_uint(btSak, ant[i].nti.nai.btSak, cut_message("card %d SAK", i));
+    cut_assert_equal_uint(szUidLen, ant[i].nti.nai.szUidLen, cut_message("card %d UID length", i));
+  }
+  cut_assert_true(memcmp(ant[0].nti.nai.abtUid, ant[1].nti.nai.abtUid, szUidLen) != 0, cut_message("distinct UIDs"));
+
+  // Each reported UID must select its own card, once the field cycle has woken them up from HALT
+  cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, false), cut_message("field off"));
+  cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, true), cut_message("field on"));
+  for (int i = 0; i < 2; i++) {
+    nfc_target nt;
+    res = nfc_initiator_select_passive_target(device, nmIso14443a, ant[i].nti.nai.abtUid, ant[i].nti.nai.szUidLen, &nt);
+    cut_assert_equal_int(1, res, cut_message("card %d selected by its UID", i));
+    cut_assert_equal_memory(ant[i].nti.nai.abtUid, szUidLen, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, cut_message("card %d UID", i));
+    cut_assert_equal_memory(ant[i].nti.nai.abtAtqa, 2, nt.nti.nai.abtAtqa, 2, cut_message("card %d ATQA matches select", i));
+    nfc_initiator_deselect_target(device);
+  }
+}
+
+void
+test_virtual_select(void)
+{
+  for (size_t i = 0; i < sizeof(virtual_tags) / sizeof(virtual_tags[0]); i++) {
+    nfc_target nt;
+    virtual_open(virtual_tags[i].connstring);
+    cut_assert_equal_int(1, nfc_initiator_select_passive_target(device, nmIso14443a, NULL, 0, &nt), cut_message("%s selected", virtual_tags[i].connstring));
+    cut_assert_equal_int(NMT_ISO14443A, nt.nm.nmt, cut_message("%s modulation", virtual_tags[i].connstring));
+    cut_assert_equal_memory(virtual_tags[i].abtAtqa, 2, nt.nti.nai.abtAtqa, 2, cut_message("%s ATQA", virtual_tags[i].connstring));
+    cut_assert_equal_uint(virtual_tags[i].btSak, nt.nti.nai.btSak, cut_message("%s SAK", virtual_tags[i].connstring));
+    cut_assert_equal_uint(virtual_tags[i].szUidLen, nt.nti.nai.szUidLen, cut_message("%s UID length", virtual_tags[i].connstring));
+    cut_assert_equal_int(virtual_tags[i].bAts, nt.nti.nai.szAtsLen > 0, cut_message("%s ATS", virtual_tags[i].connstring));
+
+    // Again by its UID once the field cycle has woken it up from HALT, and not by another UID
+    nfc_target ntAgain;
+    uint8_t abtUid[10];
+    memcpy(abtUid, nt.nti.nai.abtUid, nt.nti.nai.szUidLen);
+    cut_assert_operator_int(nfc_initiator_deselect_target(device), >=, 0, cut_message("%s deselected", virtual_tags[i].connstring));
+    cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, false), cut_message("field off"));
+    cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, true), cut_message("field on"));
+    cut_assert_equal_int(1, nfc_initiator_select_passive_target(device, nmIso14443a, abtUid, nt.nti.nai.szUidLen, &ntAgain), cut_message("%s selected by UID", virtual_tags[i].connstring));
+    cut_assert_equal_memory(abtUid, nt.nti.nai.szUidLen, ntAgain.nti.nai.abtUid, ntAgain.nti.nai.szUidLen, cut_message("%s same UID", virtual_tags[i].connstring));
+    nfc_initiator_deselect_target(device);
+    abtUid[0] ^= 0x01;
+    cut_assert_equal_int(0, nfc_initiator_select_passive_target(device, nmIso14443a, abtUid, nt.nti.nai.szUidLen, &ntAgain), cut_message("%s not selected by another UID", virtual_tags[i].connstring));
+
+    nfc_close(device);
+    device = NULL;
+  }
+}
+
+void
+test_virtual_select_none(void)
+{
+  nfc_target nt;
+  virtual_open("virtual:none");
+  cut_assert_equal_int(0, nfc_initiator_select_passive_target(device, nmIso14443a, NULL, 0, &nt), cut_message("empty field"));
+  cut_assert_equal_int(0, nfc_initiator_inventory_iso14443a(device, &nt, 1), cut_message("empty inventory"));
+}
+
+void
+test_virtual_target_is_present(void)
+{
+  // Each kind takes a path of its own: reselection, READ, ISO-DEP presence check
+  for (size_t i = 0; i < sizeof(virtual_tags) / sizeof(virtual_tags[0]); i++) {
+    nfc_target nt;
+    virtual_open(virtual_tags[i].connstring);
+    cut_assert_equal_int(1, nfc_initiator_select_passive_target(device, nmIso14443a, NULL, 0, &nt), cut_message("%s selected", virtual_tags[i].connstring));
+    cut_assert_equal_int(0, nfc_initiator_target_is_present(device, &nt), cut_message("%s present", virtual_tags[i].connstring));
+    cut_assert_equal_int(0, nfc_initiator_target_is_present(device, &nt), cut_message("%s still present", virtual_tags[i].connstring));
+
+    nfc_target ntOther = nt;
+    ntOther.nti.nai.abtUid[0] ^= 0x01;
+    cut_assert_equal_int(NFC_ETGRELEASED, nfc_initiator_target_is_present(device, &ntOther), cut_message("%s another target", virtual_tags[i].connstring));
+    cut_assert_equal_int(NFC_ETGRELEASED, nfc_initiator_target_is_present(device, NULL), cut_message("%s no target", virtual_tags[i].connstring));
+
+    nfc_initiator_deselect_target(device);
+    cut_assert_equal_int(NFC_ETGRELEASED, nfc_initiator_target_is_present(device, &nt), cut_message("%s deselected", virtual_tags[i].connstring));
+    nfc_close(device);
+    device = NULL;
+  }
+
+  // The check leaves the card usable: a READ still answers, an APDU still gets echoed
+  uint8_t abtRx[32];
+  nfc_target nt;
+  virtual_open("virtual:ultralight");
+  cut_assert_equal_int(1, nfc_initiator_select_passive_target(device, nmIso14443a, NULL, 0, &nt), cut_message("Ultralight selected"));
+  cut_assert_equal_int(0, nfc_initiator_target_is_present(device, &nt), cut_message("Ultralight present"));
+  cut_assert_equal_int(16, nfc_initiator_transceive_bytes(device, (const uint8_t *) "\x30\x00", 2, abtRx, sizeof(abtRx), 0), cut_message("READ after check"));
+  cut_assert_equal_memory(nt.nti.nai.abtUid, 3, abtRx, 3, cut_message("page 0 starts with the UID"));
+  nfc_close(device);
+  device = NULL;
+
+  virtual_open("virtual:isodep");
+  cut_assert_equal_int(1, nfc_initiator_select_passive_target(device, nmIso14443a, NULL, 0, &nt), cut_message("ISO-DEP selected"));
+  cut_assert_equal_int(0, nfc_initiator_target_is_present(device, &nt), cut_message("ISO-DEP present"));
+  cut_assert_equal_int(6, nfc_initiator_transceive_bytes(device, (const uint8_t *) "\x00\xb0\x00\x00", 4, abtRx, sizeof(abtRx), 0), cut_message("APDU after check"));
+  cut_assert_equal_memory("\x00\xb0\x00\x00\x90\x00", 6, abtRx, 6, cut_message("APDU echoed"));
+}
+
+void
+test_virtual_inventory_mifare_classic(void)
+{
+  virtual_inventory_two("virtual:mifare1k+mifare1k", (const uint8_t *) "\x00\x04", 0x08, 4);
+}
+
+void
+test_virtual_inventory_ultralight(void)
+{
+  virtual_inventory_two("virtual:ultralight+ultralight", (const uint8_t *) "\x00\x44", 0x00, 7);
+}
+
+void
+test_virtual_inventory_mixed(void)
+{
+  // mifare1k, ultralight and isodep entries of virtual_tags
+  const size_t aszKinds[3] = { 0, 2, 3 };
+  bool abFound[3] = { false, false, false };
+  nfc_target ant[4];
+
+  virtual_open("virtual:mifare1k+ultralight+isodep");
+  cut_assert_equal_int(3, nfc_initiator_inventory_iso14443a(device, ant, 4), cut_message("three cards found"));
+  for (int i = 0; i < 3; i++) {
+    // Cards come in anticollision order: find each kind by its SAK
+    for (size_t t = 0; t < 3; t++) {
+      const size_t k = aszKinds[t];
+      if (ant[i].nti.nai.btSak == virtual_tags[k].btSak) {
+        cut_assert_false(abFound[t], cut_message("%s found once", virtual_tags[k].connstring));
+        cut_assert_equal_uint(virtual_tags[k].szUidLen, ant[i].nti.nai.szUidLen, cut_message("%s UID length", virtual_tags[k].connstring));
+        abFound[t] = true;
+      }
+    }
+  }
+  cut_assert_true(abFound[0] && abFound[1] && abFound[2], cut_message("each kind found"));
+
+  // Fewer slots than cards: the inventory stops once full
+  cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, false), cut_message("field off"));
+  cut_assert_equal_int(0, nfc_device_set_property_bool(device, NP_ACTIVATE_FIELD, true), cut_message("field on"));
+  cut_assert_equal_int(1, nfc_initiator_inventory_iso14443a(device, ant, 1), cut_message("one slot"));
+}
@@ -0,0 +1,292 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+/**
+ * @file card-dump.c
+ * @brief Streaming card dump (NFCD) shared by the dump tools
+ */
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "card-dump.h"
+
+static const uint8_t abtCardDumpMagic[4] = { 'N', 'F', 'C', 'D' };
+
+struct card_dump_writer {
+  FILE    *pf;
+  size_t   szBlocks;
+  size_t   szBlockLen;
+  long     lDataOffset;
+  uint8_t *pbtValid;
+};
+
+// Validity bitmap, then key flags, then blocks aligned on 16 bytes
+static size_t
+card_dump_bitmap_len(const size_t szBlocks)
+{
+  return (szBlocks + 7) / 8;
+}
+
+static size_t
+card_dump_data_offset(const size_t szBlocks)
+{
+  return (sizeof(card_dump_header) + card_dump_bitmap_len(szBlocks) + szBlocks + 15) & ~((size_t) 15);
+}
+
+// Write szLen bytes at lOffset and push them to the file
+static bool
+card_dump_pwrite(FILE *pf, const long lOffset, const void *pData, const size_t szLen)
+{
+  if (fseek(pf, lOffset, SEEK_SET) != 0)
+    return false;
+  if (fwrite(pData, 1, szLen, pf) != szLen)
+    return false;
+  return (fflush(pf) == 0);
+}
+
+bool
+card_dump_has_extension(const char *pcPath)
+{
+  size_t szPath = strlen(pcPath);
+  size_t szExt = strlen(CARD_DUMP_EXTENSION);
+
+  return (szPath > szExt) && (strcmp(pcPath + szPath - szExt, CARD_DUMP_EXTENSION) == 0);
+}
+
+card_dump_writer *
+card_dump_create(const char *pcPath, const uint8_t btType, const uint8_t *pbtUid, const size_t szUid, const size_t szBlocks, const size_t szBlockLen)
+{
+  card_dump_header cdh;
+  card_dump_writer *pcdw;
+  size_t szDataOffset = card_dump_data_offset(szBlocks);
+  size_t szFile = szDataOffset + szBlocks * szBlockLen;
+  uint8_t *pbtZero;
+
+  if ((szUid > CARD_DUMP_MAX_UID_LEN) || (szBlocks == 0) || (szBlocks > 0xffff) || (szBlockLen == 0) || (szBlockLen > 0xff))
+    return NULL;
+
+  memset(&cdh, 0x00, sizeof(cdh));
+  memcpy(cdh.abtMagic, abtCardDumpMagic, sizeof(cdh.abtMagic));
+  cdh.btVersion = CARD_DUMP_VERSION;
+  cdh.btType = btType;
+  cdh.btBlockLen = szBlockLen;
+  cdh.btUidLen = szUid;
+  memcpy(cdh.abtUid, pbtUid, szUid);
+  cdh.abtBlocks[0] = szBlocks & 0xff;
+  cdh.abtBlocks[1] = (szBlocks >> 8) & 0xff;
+  cdh.abtDataOffset[0] = szDataOffset & 0xff;
+  cdh.abtDataOffset[1] = (szDataOffset >> 8) & 0xff;
+  cdh.abtDataOffset[2] = (szDataOffset >> 16) & 0xff;
+  cdh.abtDataOffset[3] = (szDataOffset >> 24) & 0xff;
+
+  if ((pcdw = malloc(sizeof(*pcdw))) == NULL)
+    return NULL;
+  if ((pcdw->pbtValid = calloc(1, card_dump_bitmap_len(szBlocks))) == NULL) {
+    free(pcdw);
+    return NULL;
+  }
+  if ((pbtZero = calloc(1, szFile)) == NULL) {
+    free(pcdw->pbtValid);
+    free(pcdw);
+    return NULL;
+  }
+  pcdw->szBlocks = szBlocks;
+  pcdw->szBlockLen = szBlockLen;
+  pcdw->lDataOffset = szDataOffset;
+
+  // The whole file exists from the start, with no valid block yet
+  memcpy(pbtZero, &cdh, sizeof(cdh));
+  if ((pcdw->pf = fopen(pcPath, "w+b")) == NULL) {
+    free(pbtZero);
+    free(pcdw->pbtValid);
+    free(pcdw);
+    return NULL;
+  }
+  if (!card_dump_pwrite(pcdw->pf, 0, pbtZero, szFile)) {
+    free(pbtZero);
+    card_dump_close(pcdw);
+    return NULL;
+  }
+  free(pbtZero);
+  return pcdw;
+}
+
+bool
+card_dump_write_block(card_dump_writer *pcdw, const size_t szBlock, const uint8_t *pbtData)
+{
+  const size_t szByte = szBlock / 8;
+
+  if (szBlock >= pcdw->szBlocks)
+    return false;
+  // Block first, its valid bit after: an interrupted write never exposes a torn block
+  if (!card_dump_pwrite(pcdw->pf, pcdw->lDataOffset + (long)(szBlock * pcdw->szBlockLen), pbtData, pcdw->szBlockLen))
+    return false;
+  pcdw->pbtValid[szByte] |= (1 << (szBlock % 8));
+  return card_dump_pwrite(pcdw->pf, sizeof(card_dump_header) + szByte, pcdw->pbtValid + szByte, 1);
+}
+
+bool
+card_dump_set_keys(card_dump_writer *pcdw, const size_t szBlock, const uint8_t btKeys)
+{
+  if (szBlock >= pcdw->szBlocks)
+    return false;
+  return card_dump_pwrite(pcdw->pf, sizeof(card_dump_header) + card_dump_bitmap_len(pcdw->szBlocks) + szBlock, &btKeys, 1);
+}
+
+bool
+card_dump_close(card_dump_writer *pcdw)
+{
+  bool bRes = (fclose(pcdw->pf) == 0);
+
+  free(pcdw->pbtValid);
+  free(pcdw);
+  return bRes;
+}
+
+card_dump *
+card_dump_open(const char *pcPath)
+{
+  card_dump *pcd;
+  const card_dump_header *pcdh;
+  size_t szDataOffset;
+
+  if ((pcd = calloc(1, sizeof(*pcd))) == NULL)
+    return NULL;
+
+#ifndef WIN32
+  int fd;
+  struct stat st;
+
+  if ((fd = open(pcPath, O_RDONLY)) < 0) {
+    free(pcd);
+    return NULL;
+  }
+  if ((fstat(fd, &st) < 0) || ((size_t) st.st_size < sizeof(card_dump_header))) {
+    close(fd);
+    free(pcd);
+    return NULL;
+  }
+  pcd->szMap = st.st_size;
+  pcd->pMap = mmap(NULL, pcd->szMap, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (pcd->pMap == MAP_FAILED) {
+    free(pcd);
+    return NULL;
+  }
+#else
+  // No mmap here, the file is loaded once instead
+  FILE *pf;
+  long lSize;
+
+  if ((pf = fopen(pcPath, "rb")) == NULL) {
+    free(pcd);
+    return NULL;
+  }
+  if ((fseek(pf, 0, SEEK_END) != 0) || ((lSize = ftell(pf)) < (long) sizeof(card_dump_header)) || (fseek(pf, 0, SEEK_SET) != 0) ||
+      ((pcd->pMap = malloc(lSize)) == NULL)) {
+    fclose(pf);
+    free(pcd);
+    return NULL;
+  }
+  pcd->szMap = lSize;
+  if (fread(pcd->pMap, 1, pcd->szMap, pf) != pcd->szMap) {
+    fclose(pf);
+    card_dump_free(pcd);
+    return NULL;
+  }
+  fclose(pf);
+#endif
+
+  pcdh = pcd->pMap;
+  pcd->btType = pcdh->btType;
+  pcd->szBlocks = pcdh->abtBlocks[0] | (pcdh->abtBlocks[1] << 8);
+  pcd->szBlockLen = pcdh->btBlockLen;
+  pcd->szUidLen = pcdh->btUidLen;
+  pcd->pbtUid = pcdh->abtUid;
+  szDataOffset = pcdh->abtDataOffset[0] | (pcdh->abtDataOffset[1] << 8) | (pcdh->abtDataOffset[2] << 16) | ((size_t) pcdh->abtDataOffset[3] << 24);
+
+  if ((memcmp(pcdh->abtMagic, abtCardDumpMagic, sizeof(pcdh->abtMagic)) != 0) || (pcdh->btVersion != CARD_DUMP_VERSION) ||
+      (pcd->szUidLen > CARD_DUMP_MAX_UID_LEN) || (szDataOffset < sizeof(card_dump_header) + card_dump_bitmap_len(pcd->szBlocks) + pcd->szBlocks) ||
+      (szDataOffset + pcd->szBlocks * pcd->szBlockLen > pcd->szMap)) {
+    card_dump_free(pcd);
+    return NULL;
+  }
+  pcd->pbtValid = (const uint8_t *) pcd->pMap + sizeof(card_dump_header);
+  pcd->pbtKeys = pcd->pbtValid + card_dump_bitmap_len(pcd->szBlocks);
+  pcd->pbtData = (const uint8_t *) pcd->pMap + szDataOffset;
+  return pcd;
+}
+
+const uint8_t *
+card_dump_block(const card_dump *pcd, const size_t szBlock)
+{
+  if ((szBlock >= pcd->szBlocks) || !(pcd->pbtValid[szBlock / 8] & (1 << (szBlock % 8))))
+    return NULL;
+  return pcd->pbtData + szBlock * pcd->szBlockLen;
+}
+
+size_t
+card_dump_valid_blocks(const card_dump *pcd)
+{
+  size_t szValid = 0;
+
+  for (size_t szBlock = 0; szBlock < pcd->szBlocks; szBlock++)
+    if (card_dump_block(pcd, szBlock) != NULL)
+      szValid++;
+  return szValid;
+}
+
+void
+card_dump_free(card_dump *pcd)
+{
+#ifndef WIN32
+  munmap(pcd->pMap, pcd->szMap);
+#else
+  free(pcd->pMap);
+#endif
+  free(pcd);
+}
@@ -0,0 +1,110 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file card-dump.h
+ * @brief Streaming card dump (NFCD) shared by the dump tools
+ *
+ * A NFCD file is a 32-byte header, a validity bitmap with one bit per block,
+ * one key flag byte per block and the blocks themselves. The file is sized
+ * at creation and each block is written then flagged valid as soon as it is
+ * read, so an interrupted read leaves a file with its valid blocks usable.
+ * Readers map the file and access blocks in place.
+ */
+
+#ifndef _EXAMPLES_CARD_DUMP_H_
+#  define _EXAMPLES_CARD_DUMP_H_
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+
+#  define CARD_DUMP_EXTENSION ".nfcd"
+#  define CARD_DUMP_VERSION 1
+#  define CARD_DUMP_MAX_UID_LEN 10
+
+// Dumped card family
+#  define CARD_DUMP_MIFARE_CLASSIC 0x01
+#  define CARD_DUMP_MIFARE_ULTRALIGHT 0x02
+
+// Key flags of a block (meaningful on MIFARE Classic trailers): the key was checked against the card
+#  define CARD_DUMP_KEY_A 0x01
+#  define CARD_DUMP_KEY_B 0x02
+
+// Little-endian on-disk header
+#  pragma pack(1)
+typedef struct {
+  uint8_t  abtMagic[4];
+  uint8_t  btVersion;
+  uint8_t  btType;
+  uint8_t  btBlockLen;
+  uint8_t  btUidLen;
+  uint8_t  abtUid[CARD_DUMP_MAX_UID_LEN];
+  uint8_t  abtBlocks[2];
+  uint8_t  abtDataOffset[4];
+  uint8_t  abtReserved[8];
+} card_dump_header;
+#  pragma pack()
+
+typedef struct card_dump_writer card_dump_writer;
+
+// Mapped dump, fields are read-only
+typedef struct {
+  uint8_t  btType;
+  size_t   szBlocks;
+  size_t   szBlockLen;
+  size_t   szUidLen;
+  const uint8_t *pbtUid;
+  const uint8_t *pbtValid;
+  const uint8_t *pbtKeys;
+  const uint8_t *pbtData;
+  void    *pMap;
+  size_t   szMap;
+} card_dump;
+
+bool    card_dump_has_extension(const char *pcPath);
+
+card_dump_writer *card_dump_create(const char *pcPath, const uint8_t btType, const uint8_t *pbtUid, const size_t szUid, const size_t szBlocks, const size_t szBlockLen);
+bool    card_dump_write_block(card_dump_writer *pcdw, const size_t szBlock, const uint8_t *pbtData);
+bool    card_dump_set_keys(card_dump_writer *pcdw, const size_t szBlock, const uint8_t btKeys);
+bool    card_dump_close(card_dump_writer *pcdw);
+
+card_dump *card_dump_open(const char *pcPath);
+const uint8_t *card_dump_block(const card_dump *pcd, const size_t szBlock);
+size_t  card_dump_valid_blocks(const card_dump *pcd);
+void    card_dump_free(card_dump *pcd);
+
+#endif
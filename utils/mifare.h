@@ -36,52 +36,14 @@
 
 /**
  * @file mifare.h
- * @brief provide samples structs and functions to manipulate MIFARE Classic and Ultralight tags using libnfc
+ * @brief provide samples structs to manipulate MIFARE Classic and Ultralight tags using libnfc
  */
 
 #ifndef _LIBNFC_MIFARE_H_
 #  define _LIBNFC_MIFARE_H_
 
 #  include <nfc/nfc-types.h>
-
-// Compiler directive, set struct alignment to 1 uint8_t for compatibility
-#  pragma pack(1)
-
-typedef enum {
-  MC_AUTH_A = 0x60,
-  MC_AUTH_B = 0x61,
-  MC_READ = 0x30,
-  MC_WRITE = 0xA0,
-  MC_TRANSFER = 0xB0,
-  MC_DECREMENT = 0xC0,
-  MC_INCREMENT = 0xC1,
-  MC_STORE = 0xC2
-} mifare_cmd;
-
-// MIFARE command params
-struct mifare_param_auth {
-  uint8_t  abtKey[6];
-  uint8_t  abtAuthUid[4];
-};
-
-struct mifare_param_data {
-  uint8_t  abtData[16];
-};
-
-struct mifare_param_value {
-  uint8_t  abtValue[4];
-};
-
-typedef union {
-  struct mifare_param_auth mpa;
-  struct mifare_param_data mpd;
-  struct mifare_param_value mpv;
-} mifare_param;
-
-// Reset struct alignment to default
-#  pragma pack()
-
-bool    nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8Block, mifare_param *pmp);
+#  include <nfc/nfc-mifare.h>
 
 // Compiler directive, set struct alignment to 1 uint8_t for compatibility
 #  pragma pack(1)
@@ -135,8 +97,12 @@ typedef union {
   mifareul_block_data mbd;
 } mifareul_block;
 
+// Large enough for an NTAG216 (231 pages), original MIFARE Ultralight only use 4 blocks
+#define MIFAREUL_MAX_BLOCKS  64
+#define MIFAREUL_MIN_DUMP_LEN  (4 * sizeof(mifareul_block))
+
 typedef struct {
-  mifareul_block amb[4];
+  mifareul_block amb[MIFAREUL_MAX_BLOCKS];
 } mifareul_tag;
 
 // Reset struct alignment to default
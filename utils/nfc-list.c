@@ -48,6 +48,9 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#  include <pthread.h>
+#endif
 
 #include <nfc/nfc.h>
 
@@ -58,65 +61,263 @@
 
 static nfc_device *pnd;
 
+// Modulations listed on every device, in display order
+static const struct {
+  nfc_modulation nm;
+  const char *label;
+} list_modulations[] = {
+  { { NMT_ISO14443A, NBR_106 }, "ISO14443A" },
+  { { NMT_FELICA, NBR_212 }, "Felica (212 kbps)" },
+  { { NMT_FELICA, NBR_424 }, "Felica (424 kbps)" },
+  { { NMT_ISO14443B, NBR_106 }, "ISO14443B" },
+  { { NMT_ISO14443BI, NBR_106 }, "ISO14443B'" },
+  { { NMT_ISO14443B2SR, NBR_106 }, "ISO14443B-2 ST SRx" },
+  { { NMT_ISO14443B2CT, NBR_106 }, "ISO14443B-2 ASK CTx" },
+  { { NMT_JEWEL, NBR_106 }, "Jewel" },
+};
+
+#define LIST_MODULATION_COUNT (sizeof(list_modulations) / sizeof(list_modulations[0]))
+
+// Modulations of the single combined poll run by concurrent mode
+static const nfc_modulation poll_modulations[] = {
+  { NMT_ISO14443A, NBR_106 },
+  { NMT_ISO14443B, NBR_106 },
+  { NMT_FELICA, NBR_212 },
+  { NMT_FELICA, NBR_424 },
+  { NMT_JEWEL, NBR_106 },
+};
+
+// Targets found by one device when devices are queried concurrently
+struct device_report {
+  nfc_context *context;
+  const char *connstring;
+  // One combined poll instead of one listing per modulation
+  bool poll;
+  char name[256];
+  char error[256];
+  // Targets found by each listing, -1 when it failed; the poll result goes in the first one
+  int counts[LIST_MODULATION_COUNT];
+  nfc_target targets[LIST_MODULATION_COUNT * MAX_TARGET_COUNT];
+  size_t szTargets;
+};
+
 static void
 print_usage(const char *progname)
 {
-  printf("usage: %s [-v]\n", progname);
+  printf("usage: %s [-v] [-j] [-J]\n", progname);
   printf("  -v\t verbose display\n");
+  printf("  -j\t query devices concurrently, with one combined poll each\n");
+  printf("  -J\t JSON output, devices are queried concurrently\n");
+}
+
+static void *
+report_device(void *arg)
+{
+  struct device_report *report = arg;
+
+  nfc_device *pnd_report = nfc_open(report->context, report->connstring);
+  if (pnd_report == NULL) {
+    snprintf(report->error, sizeof(report->error), "Unable to open NFC device: %s", report->connstring);
+    return NULL;
+  }
+  snprintf(report->name, sizeof(report->name), "%s", nfc_device_get_name(pnd_report));
+  if (nfc_initiator_init(pnd_report) < 0) {
+    snprintf(report->error, sizeof(report->error), "nfc_initiator_init: %s", nfc_strerror(pnd_report));
+  } else if (report->poll) {
+    // A single period of polling (2 x 150 ms) per modulation
+    const int res = nfc_initiator_poll_target(pnd_report, poll_modulations, sizeof(poll_modulations) / sizeof(poll_modulations[0]), 1, 2, &report->targets[0]);
+    report->counts[0] = res;
+    report->szTargets = (res > 0) ? 1 : 0;
+  } else {
+    for (size_t m = 0; m < LIST_MODULATION_COUNT; m++) {
+      const int res = nfc_initiator_list_passive_targets(pnd_report, list_modulations[m].nm, report->targets + report->szTargets, MAX_TARGET_COUNT);
+      report->counts[m] = res;
+      if (res > 0)
+        report->szTargets += res;
+    }
+  }
+  nfc_close(pnd_report);
+  return NULL;
+}
+
+// Print a JSON string, escaping quotes, backslashes and control characters
+static void
+print_json_string(const char *s)
+{
+  putchar('"');
+  for (; *s; s++) {
+    if ((*s == '"') || (*s == '\\')) {
+      printf("\\%c", *s);
+    } else if ((unsigned char) *s < 0x20) {
+      printf("\\u%04x", (unsigned char) *s);
+    } else {
+      putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+static void
+print_report_json(const struct device_report *report)
+{
+  printf("{\"connstring\":");
+  print_json_string(report->connstring);
+  if (report->name[0]) {
+    printf(",\"name\":");
+    print_json_string(report->name);
+  }
+  if (report->error[0]) {
+    printf(",\"error\":");
+    print_json_string(report->error);
+  } else {
+    printf(",\"targets\":[");
+    for (size_t n = 0; n < report->szTargets; n++) {
+      // Large enough for the longest ATS
+      char s[1024];
+      snprint_nfc_target_json(s, sizeof(s), &report->targets[n]);
+      printf("%s%s", (n == 0) ? "" : ",", s);
+    }
+    printf("]");
+  }
+  printf("}");
+}
+
+static void
+print_report_text(const struct device_report *report, bool verbose)
+{
+  if (report->error[0]) {
+    ERR("%s", report->error);
+    return;
+  }
+  printf("NFC device: %s opened\n", report->name);
+  if (report->poll) {
+    if (report->szTargets > 0) {
+      printf("%d target(s) found by polling:\n", report->counts[0]);
+      print_nfc_target(&report->targets[0], verbose);
+      printf("\n");
+    } else {
+      printf("No target found.\n\n");
+    }
+    return;
+  }
+  const nfc_target *pnt = report->targets;
+  for (size_t m = 0; m < LIST_MODULATION_COUNT; m++) {
+    const int res = report->counts[m];
+    if (res < 0)
+      continue;
+    if (verbose || (res > 0)) {
+      printf("%d %s passive target(s) found%s\n", res, list_modulations[m].label, (res == 0) ? ".\n" : ":");
+    }
+    for (int n = 0; n < res; n++, pnt++) {
+      print_nfc_target(pnt, verbose);
+      printf("\n");
+    }
+  }
+}
+
+// Query every device from its own thread on the shared context, then print reports in device order
+static int
+list_devices_concurrently(nfc_context *context, nfc_connstring connstrings[], const size_t szDeviceFound, bool poll, bool json, bool verbose)
+{
+  struct device_report *reports = calloc(szDeviceFound ? szDeviceFound : 1, sizeof(*reports));
+  int res = EXIT_SUCCESS;
+
+  if (!reports) {
+    ERR("Unable to allocate device reports");
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    reports[i].context = context;
+    reports[i].connstring = connstrings[i];
+    reports[i].poll = poll;
+  }
+#ifndef WIN32
+  pthread_t threads[MAX_DEVICE_COUNT];
+  bool started[MAX_DEVICE_COUNT];
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    started[i] = (pthread_create(&threads[i], NULL, report_device, &reports[i]) == 0);
+    if (!started[i])
+      report_device(&reports[i]);
+  }
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+  }
+#else
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    report_device(&reports[i]);
+  }
+#endif
+
+  if (json) {
+    printf("{\"libnfc\":");
+    print_json_string(nfc_version());
+    printf(",\"devices\":[");
+  } else if (szDeviceFound == 0) {
+    printf("No NFC device found.\n");
+  }
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    if (json) {
+      printf("%s\n", (i == 0) ? "" : ",");
+      print_report_json(&reports[i]);
+    } else {
+      print_report_text(&reports[i], verbose);
+    }
+    if (reports[i].error[0])
+      res = EXIT_FAILURE;
+  }
+  if (json) {
+    printf("\n]}\n");
+  }
+  free(reports);
+  return res;
 }
 
 int
 main(int argc, const char *argv[])
 {
-  (void) argc;
   const char *acLibnfcVersion;
   size_t  i;
   bool verbose = false;
+  bool json = false;
+  bool concurrent = false;
   int res = 0;
 
-  nfc_context *context;
-  nfc_init(&context);
-  if (context == NULL) {
-    ERR("Unable to init libnfc (malloc)");
-    exit(EXIT_FAILURE);
-  }
-
-  // Display libnfc version
-  acLibnfcVersion = nfc_version();
-  printf("%s uses libnfc %s\n", argv[0], acLibnfcVersion);
-  if (argc != 1) {
-    if ((argc == 2) && (0 == strcmp("-v", argv[1]))) {
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp("-v", argv[arg])) {
       verbose = true;
+    } else if (0 == strcmp("-j", argv[arg])) {
+      concurrent = true;
+    } else if (0 == strcmp("-J", argv[arg])) {
+      json = true;
     } else {
       print_usage(argv[0]);
       exit(EXIT_FAILURE);
     }
   }
 
-  /* Lazy way to open an NFC device */
-#if 0
-  pnd = nfc_open(context, NULL);
-#endif
-
-  /* If specific device is wanted, i.e. an ARYGON device on /dev/ttyUSB0 */
-#if 0
-  nfc_device_desc_t ndd;
-  ndd.pcDriver = "ARYGON";
-  ndd.pcPort = "/dev/ttyUSB0";
-  ndd.uiSpeed = 115200;
-  pnd = nfc_open(context, &ndd);
-#endif
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
 
-  /* If specific device is wanted, i.e. a SCL3711 on USB */
-#if 0
-  nfc_device_desc_t ndd;
-  ndd.pcDriver = "PN533_USB";
-  strcpy(ndd.acDevice, "SCM Micro / SCL3711-NFC&RW");
-  pnd = nfc_open(context, &ndd);
-#endif
   nfc_connstring connstrings[MAX_DEVICE_COUNT];
   size_t szDeviceFound = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
 
+  if (!json) {
+    // Display libnfc version
+    acLibnfcVersion = nfc_version();
+    printf("%s uses libnfc %s\n", argv[0], acLibnfcVersion);
+  }
+
+  if (json || concurrent) {
+    res = list_devices_concurrently(context, connstrings, szDeviceFound, concurrent, json, verbose);
+    nfc_exit(context);
+    exit(res);
+  }
+
   if (szDeviceFound == 0) {
     printf("No NFC device found.\n");
   }
@@ -137,115 +338,16 @@ main(int argc, const char *argv[])
 
     printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
 
-    nfc_modulation nm;
-
-    nm.nmt = NMT_ISO14443A;
-    nm.nbr = NBR_106;
-    // List ISO14443A targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d ISO14443A passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_FELICA;
-    nm.nbr = NBR_212;
-    // List Felica tags
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d Felica (212 kbps) passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nbr = NBR_424;
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d Felica (424 kbps) passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_ISO14443B;
-    nm.nbr = NBR_106;
-    // List ISO14443B targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d ISO14443B passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_ISO14443BI;
-    nm.nbr = NBR_106;
-    // List ISO14443B' targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d ISO14443B' passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_ISO14443B2SR;
-    nm.nbr = NBR_106;
-    // List ISO14443B-2 ST SRx family targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d ISO14443B-2 ST SRx passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_ISO14443B2CT;
-    nm.nbr = NBR_106;
-    // List ISO14443B-2 ASK CTx family targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d ISO14443B-2 ASK CTx passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
-      }
-    }
-
-    nm.nmt = NMT_JEWEL;
-    nm.nbr = NBR_106;
-    // List Jewel targets
-    if ((res = nfc_initiator_list_passive_targets(pnd, nm, ant, MAX_TARGET_COUNT)) >= 0) {
-      int n;
-      if (verbose || (res > 0)) {
-        printf("%d Jewel passive target(s) found%s\n", res, (res == 0) ? ".\n" : ":");
-      }
-      for (n = 0; n < res; n++) {
-        print_nfc_target(&ant[n], verbose);
-        printf("\n");
+    for (size_t m = 0; m < sizeof(list_modulations) / sizeof(list_modulations[0]); m++) {
+      if ((res = nfc_initiator_list_passive_targets(pnd, list_modulations[m].nm, ant, MAX_TARGET_COUNT)) >= 0) {
+        int n;
+        if (verbose || (res > 0)) {
+          printf("%d %s passive target(s) found%s\n", res, list_modulations[m].label, (res == 0) ? ".\n" : ":");
+        }
+        for (n = 0; n < res; n++) {
+          print_nfc_target(&ant[n], verbose);
+          printf("\n");
+        }
       }
     }
     nfc_close(pnd);
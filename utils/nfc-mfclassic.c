@@ -57,6 +57,7 @@
 
 #include "mifare.h"
 #include "nfc-utils.h"
+#include "card-dump.h"
 
 static nfc_context *context;
 static nfc_device *pnd;
@@ -70,6 +71,7 @@ static bool bForceKeyFile;
 static bool bTolerateFailures;
 static bool magic2 = false;
 static uint8_t uiBlocks;
+static card_dump_writer *pcdwDump;
 static uint8_t keys[] = {
   0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
   0xd3, 0xf7, 0xd3, 0xf7, 0xd3, 0xf7,
@@ -205,17 +207,14 @@ authenticate(uint32_t uiBlock)
     if (nfc_initiator_mifare_cmd(pnd, mc, uiBlock, &mp))
       return true;
   } else {
-    // Try to guess the right key
-    for (size_t key_index = 0; key_index < num_keys; key_index++) {
-      memcpy(mp.mpa.abtKey, keys + (key_index * 6), 6);
-      if (nfc_initiator_mifare_cmd(pnd, mc, uiBlock, &mp)) {
-        if (bUseKeyA)
-          memcpy(mtKeys.amb[uiBlock].mbt.abtKeyA, &mp.mpa.abtKey, 6);
-        else
-          memcpy(mtKeys.amb[uiBlock].mbt.abtKeyB, &mp.mpa.abtKey, 6);
-        return true;
-      }
-      nfc_initiator_select_passive_target(pnd, nmMifare, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, NULL);
+    // Try to guess the right key, the one found moves to the front of keys
+    if (nfc_mifare_classic_find_key(pnd, &nt, uiBlock, mc, keys, num_keys) == 0) {
+      memcpy(mp.mpa.abtKey, keys, 6);
+      if (bUseKeyA)
+        memcpy(mtKeys.amb[uiBlock].mbt.abtKeyA, &mp.mpa.abtKey, 6);
+      else
+        memcpy(mtKeys.amb[uiBlock].mbt.abtKeyB, &mp.mpa.abtKey, 6);
+      return true;
     }
   }
 
@@ -293,6 +292,20 @@ get_rats(void)
   return res;
 }
 
+// Stream a block read out to the NFCD dump, if any
+static  bool
+dump_block(uint32_t uiBlock, uint8_t btKeys)
+{
+  if (pcdwDump == NULL)
+    return true;
+  if (!card_dump_write_block(pcdwDump, uiBlock, mtDump.amb[uiBlock].mbd.abtData) ||
+      (btKeys && !card_dump_set_keys(pcdwDump, uiBlock, btKeys))) {
+    printf("!\nError: unable to write block 0x%02x to dump\n", uiBlock);
+    return false;
+  }
+  return true;
+}
+
 static  bool
 read_card(int read_unlocked)
 {
@@ -338,11 +351,15 @@ read_card(int read_unlocked)
       if (nfc_initiator_mifare_cmd(pnd, MC_READ, iBlock, &mp)) {
         if (read_unlocked) {
           memcpy(mtDump.amb[iBlock].mbd.abtData, mp.mpd.abtData, 16);
+          if (!dump_block(iBlock, CARD_DUMP_KEY_A | CARD_DUMP_KEY_B))
+            return false;
         } else {
           // Copy the keys over from our key dump and store the retrieved access bits
           memcpy(mtDump.amb[iBlock].mbt.abtKeyA, mtKeys.amb[iBlock].mbt.abtKeyA, 6);
           memcpy(mtDump.amb[iBlock].mbt.abtAccessBits, mp.mpd.abtData + 6, 4);
           memcpy(mtDump.amb[iBlock].mbt.abtKeyB, mtKeys.amb[iBlock].mbt.abtKeyB, 6);
+          if (!dump_block(iBlock, (bUseKeyA) ? CARD_DUMP_KEY_A : CARD_DUMP_KEY_B))
+            return false;
         }
       } else {
         printf("!\nfailed to read trailer block 0x%02x\n", iBlock);
@@ -354,6 +371,8 @@ read_card(int read_unlocked)
         // Try to read out the data block
         if (nfc_initiator_mifare_cmd(pnd, MC_READ, iBlock, &mp)) {
           memcpy(mtDump.amb[iBlock].mbd.abtData, mp.mpd.abtData, 16);
+          if (!dump_block(iBlock, 0))
+            return false;
         } else {
           printf("!\nError: unable to read block 0x%02x\n", iBlock);
           bFailure = true;
@@ -457,9 +476,133 @@ write_card(int write_block_zero)
   return true;
 }
 
+// Tell if the trailer read from the card already matches the dump, keys we don't know are assumed to differ
+static  bool
+trailer_is_unchanged(uint32_t uiTrailer, const uint8_t *pbtCard, const uint8_t *pbtAuthKey)
+{
+  const mifare_classic_block_trailer *pmbt = &mtDump.amb[uiTrailer].mbt;
+  const uint8_t *pbtKeyA = NULL;
+  const uint8_t *pbtKeyB = NULL;
+
+  // Keys are never read back, only the one we authenticated with or the key file ones are known
+  if (bUseKeyFile) {
+    pbtKeyA = mtKeys.amb[uiTrailer].mbt.abtKeyA;
+    pbtKeyB = mtKeys.amb[uiTrailer].mbt.abtKeyB;
+  }
+  if (bUseKeyA)
+    pbtKeyA = pbtAuthKey;
+  else
+    pbtKeyB = pbtAuthKey;
+
+  if ((pbtKeyA == NULL) || (pbtKeyB == NULL))
+    return false;
+  return (memcmp(pbtKeyA, pmbt->abtKeyA, 6) == 0) &&
+         (memcmp(pbtCard + 6, pmbt->abtAccessBits, 4) == 0) &&
+         (memcmp(pbtKeyB, pmbt->abtKeyB, 6) == 0);
+}
+
+static  bool
+write_card_diff(void)
+{
+  uint32_t uiFirstBlock, uiTrailer, uiBlock;
+  bool    bFailure = false;
+  uint32_t uiWriteBlocks = 0;
+  uint32_t uiSameBlocks = 0;
+  uint8_t abtAuthKey[6];
+  uint8_t abtCard[16][16];
+
+  printf("Writing changed blocks out of %d |", uiBlocks + 1);
+  // Each sector is authenticated once, read out, then only its changed blocks are written
+  for (uiFirstBlock = 0; uiFirstBlock <= uiBlocks; uiFirstBlock = uiTrailer + 1) {
+    uiTrailer = get_trailer_block(uiFirstBlock);
+
+    if (bFailure) {
+      // When a failure occured we need to redo the anti-collision
+      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
+        printf("!\nError: tag was removed\n");
+        return false;
+      }
+      bFailure = false;
+    }
+
+    fflush(stdout);
+
+    if (!authenticate(uiTrailer)) {
+      printf("!\nError: authentication failed for block %02d (sector %02d)\n", uiFirstBlock, (uiFirstBlock / 4));
+      if (bTolerateFailures) {
+        bFailure = true;
+        continue;
+      } else {
+        return false;
+      }
+    }
+    // mp is shared with the read commands, keep the key that opened the sector
+    memcpy(abtAuthKey, mp.mpa.abtKey, 6);
+
+    for (uiBlock = uiFirstBlock; uiBlock <= uiTrailer; uiBlock++) {
+      if (!nfc_initiator_mifare_cmd(pnd, MC_READ, uiBlock, &mp)) {
+        printf("!\nError: unable to read block 0x%02x\n", uiBlock);
+        bFailure = true;
+        break;
+      }
+      memcpy(abtCard[uiBlock - uiFirstBlock], mp.mpd.abtData, 16);
+    }
+    if (bFailure) {
+      print_success_or_failure(bFailure, NULL);
+      if (! bTolerateFailures)
+        return false;
+      continue;
+    }
+
+    for (uiBlock = uiFirstBlock; uiBlock <= uiTrailer; uiBlock++) {
+      const uint8_t *pbtCard = abtCard[uiBlock - uiFirstBlock];
+
+      if (is_trailer_block(uiBlock)) {
+        if (trailer_is_unchanged(uiBlock, pbtCard, abtAuthKey)) {
+          printf("-");
+          uiSameBlocks++;
+          continue;
+        }
+        memcpy(mp.mpd.abtData, mtDump.amb[uiBlock].mbt.abtKeyA, 6);
+        memcpy(mp.mpd.abtData + 6, mtDump.amb[uiBlock].mbt.abtAccessBits, 4);
+        memcpy(mp.mpd.abtData + 10, mtDump.amb[uiBlock].mbt.abtKeyB, 6);
+        if (nfc_initiator_mifare_cmd(pnd, MC_WRITE, uiBlock, &mp) == false) {
+          printf("failed to write trailer block %d \n", uiBlock);
+          bFailure = true;
+        }
+      } else {
+        // The first block 0x00 is read only, skip this
+        if (uiBlock == 0 && ! magic2)
+          continue;
+        if (memcmp(pbtCard, mtDump.amb[uiBlock].mbd.abtData, 16) == 0) {
+          printf("-");
+          uiSameBlocks++;
+          continue;
+        }
+        // Make sure a earlier write did not fail
+        if (!bFailure) {
+          memcpy(mp.mpd.abtData, mtDump.amb[uiBlock].mbd.abtData, 16);
+          if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, uiBlock, &mp))
+            bFailure = true;
+        }
+      }
+      // Show if the write went well for each block
+      print_success_or_failure(bFailure, &uiWriteBlocks);
+      if ((! bTolerateFailures) && bFailure)
+        return false;
+    }
+  }
+  printf("|\n");
+  printf("Done, %d of %d blocks written, %d unchanged.\n", uiWriteBlocks, uiBlocks + 1, uiSameBlocks);
+  fflush(stdout);
+
+  return true;
+}
+
 typedef enum {
   ACTION_READ,
   ACTION_WRITE,
+  ACTION_DIFF_WRITE,
   ACTION_USAGE
 } action_t;
 
@@ -467,13 +610,15 @@ static void
 print_usage(const char *pcProgramName)
 {
   printf("Usage: ");
-  printf("%s r|R|w|W a|b <dump.mfd> [<keys.mfd> [f]]\n", pcProgramName);
-  printf("  r|R|w|W       - Perform read from (r) or unlocked read from (R) or write to (w) or unlocked write to (W) card\n");
+  printf("%s r|R|w|W|d a|b <dump.mfd> [<keys.mfd> [f]]\n", pcProgramName);
+  printf("  r|R|w|W|d     - Perform read from (r) or unlocked read from (R) or write to (w) or unlocked write to (W) card\n");
+  printf("                  or only write blocks that differ from the card (d)\n");
   printf("                  *** note that unlocked write will attempt to overwrite block 0 including UID\n");
   printf("                  *** unlocked read does not require authentication and will reveal A and B keys\n");
   printf("                  *** unlocking only works with special Mifare 1K cards (Chinese clones)\n");
   printf("  a|A|b|B       - Use A or B keys for action; Halt on errors (a|b) or tolerate errors (A|B)\n");
   printf("  <dump.mfd>    - MiFare Dump (MFD) used to write (card to MFD) or (MFD to card)\n");
+  printf("                  *** a dump named *%s is written block by block in the streaming NFCD format\n", CARD_DUMP_EXTENSION);
   printf("  <keys.mfd>    - MiFare Dump (MFD) that contain the keys (optional)\n");
   printf("  f             - Force using the keyfile even if UID does not match (optional)\n");
 }
@@ -484,6 +629,7 @@ main(int argc, const char *argv[])
   action_t atAction = ACTION_USAGE;
   uint8_t *pbtUID;
   int    unlock = 0;
+  card_dump *pcdDump;
 
   if (argc < 2) {
     print_usage(argv[0]);
@@ -503,12 +649,12 @@ main(int argc, const char *argv[])
     bTolerateFailures = tolower((int)((unsigned char) * (argv[2]))) != (int)((unsigned char) * (argv[2]));
     bUseKeyFile = (argc > 4);
     bForceKeyFile = ((argc > 5) && (strcmp((char *)argv[5], "f") == 0));
-  } else if (strcmp(command, "w") == 0 || strcmp(command, "W") == 0) {
+  } else if (strcmp(command, "w") == 0 || strcmp(command, "W") == 0 || strcmp(command, "d") == 0) {
     if (argc < 4) {
       print_usage(argv[0]);
       exit(EXIT_FAILURE);
     }
-    atAction = ACTION_WRITE;
+    atAction = (strcmp(command, "d") == 0) ? ACTION_DIFF_WRITE : ACTION_WRITE;
     if (strcmp(command, "W") == 0)
       unlock = 1;
     bUseKeyA = tolower((int)((unsigned char) * (argv[2]))) == 'a';
@@ -646,6 +792,21 @@ main(int argc, const char *argv[])
 
   if (atAction == ACTION_READ) {
     memset(&mtDump, 0x00, sizeof(mtDump));
+  } else if ((pcdDump = card_dump_open(argv[3])) != NULL) {
+    // NFCD dump, every block we are about to write must have been read
+    if ((pcdDump->btType != CARD_DUMP_MIFARE_CLASSIC) || (pcdDump->szBlockLen != sizeof(mifare_classic_block)) || (pcdDump->szBlocks < (size_t)(uiBlocks + 1))) {
+      printf("Dump file does not match this card: %s\n", argv[3]);
+      exit(EXIT_FAILURE);
+    }
+    for (uint32_t uiBlock = 0; uiBlock <= uiBlocks; uiBlock++) {
+      const uint8_t *pbtBlock = card_dump_block(pcdDump, uiBlock);
+      if (pbtBlock == NULL) {
+        printf("Dump file is incomplete, block %d missing: %s\n", uiBlock, argv[3]);
+        exit(EXIT_FAILURE);
+      }
+      memcpy(&mtDump.amb[uiBlock], pbtBlock, sizeof(mifare_classic_block));
+    }
+    card_dump_free(pcdDump);
   } else {
     FILE *pfDump = fopen(argv[3], "rb");
 
@@ -664,7 +825,19 @@ main(int argc, const char *argv[])
   }
 // printf("Successfully opened required files\n");
 
-  if (atAction == ACTION_READ) {
+  if ((atAction == ACTION_READ) && card_dump_has_extension(argv[3])) {
+    // Blocks land in the file as they are read, a partial read stays usable
+    if ((pcdwDump = card_dump_create(argv[3], CARD_DUMP_MIFARE_CLASSIC, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, uiBlocks + 1, sizeof(mifare_classic_block))) == NULL) {
+      printf("Could not open dump file: %s\n", argv[3]);
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    if (read_card(unlock))
+      printf("Data written to file: %s\n", argv[3]);
+    if (!card_dump_close(pcdwDump))
+      printf("Could not write to file: %s\n", argv[3]);
+  } else if (atAction == ACTION_READ) {
     if (read_card(unlock)) {
       printf("Writing data to file: %s ...", argv[3]);
       fflush(stdout);
@@ -687,6 +860,8 @@ main(int argc, const char *argv[])
     }
   } else if (atAction == ACTION_WRITE) {
     write_card(unlock);
+  } else if (atAction == ACTION_DIFF_WRITE) {
+    write_card_diff();
   }
 
   nfc_close(pnd);
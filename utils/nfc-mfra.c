@@ -207,17 +207,14 @@ authenticate(uint32_t uiBlock)
     if (nfc_initiator_mifare_cmd(pnd, mc, uiBlock, &mp))
       return true;
   } else {
-    // Try to guess the right key
-    for (size_t key_index = 0; key_index < num_keys; key_index++) {
-      memcpy(mp.mpa.abtKey, keys + (key_index * 6), 6);
-      if (nfc_initiator_mifare_cmd(pnd, mc, uiBlock, &mp)) {
-        if (bUseKeyA)
-          memcpy(mtKeys.amb[uiBlock].mbt.abtKeyA, &mp.mpa.abtKey, 6);
-        else
-          memcpy(mtKeys.amb[uiBlock].mbt.abtKeyB, &mp.mpa.abtKey, 6);
-        return true;
-      }
-      nfc_initiator_select_passive_target(pnd, nmMifare, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, NULL);
+    // Try to guess the right key, the one found moves to the front of keys
+    if (nfc_mifare_classic_find_key(pnd, &nt, uiBlock, mc, keys, num_keys) == 0) {
+      memcpy(mp.mpa.abtKey, keys, 6);
+      if (bUseKeyA)
+        memcpy(mtKeys.amb[uiBlock].mbt.abtKeyA, &mp.mpa.abtKey, 6);
+      else
+        memcpy(mtKeys.amb[uiBlock].mbt.abtKeyB, &mp.mpa.abtKey, 6);
+      return true;
     }
   }
 
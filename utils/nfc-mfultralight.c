@@ -53,15 +53,19 @@
 #include <ctype.h>
 
 #include <nfc/nfc.h>
+#include <nfc/nfc-ndef.h>
 
 #include "nfc-utils.h"
 #include "mifare.h"
+#include "card-dump.h"
 
 static nfc_device *pnd;
 static nfc_target nt;
 static mifare_param mp;
 static mifareul_tag mtDump;
 static uint32_t uiBlocks = 0xF;
+// Pages held by the dump to write, from page 0 on
+static size_t szDumpPages = 0;
 
 static const nfc_modulation nmMifare = {
   .nmt = NMT_ISO14443A,
@@ -76,29 +80,33 @@ print_success_or_failure(bool bFailure, uint32_t *uiCounter)
     *uiCounter += (bFailure) ? 0 : 1;
 }
 
+// Ultralight EV1 and NTAG tell their size, original Ultralight have 16 pages
+static  size_t
+card_pages(void)
+{
+  uint8_t abtVersion[MIFARE_ULTRALIGHT_VERSION_LEN];
+
+  if ((nfc_mifare_ultralight_get_version(pnd, &nt, abtVersion, sizeof(abtVersion)) > 0) && (nfc_mifare_ultralight_pages(abtVersion) > 0))
+    return nfc_mifare_ultralight_pages(abtVersion);
+  return 16;
+}
+
 static  bool
 read_card(void)
 {
-  uint32_t page;
+  const size_t szPages = card_pages();
   bool    bFailure = false;
   uint32_t uiReadedPages = 0;
 
-  printf("Reading %d pages |", uiBlocks + 1);
+  uiBlocks = szPages - 1;
 
-  for (page = 0; page <= uiBlocks; page += 4) {
-    // Try to read out the data block
-    if (nfc_initiator_mifare_cmd(pnd, MC_READ, page, &mp)) {
-      memcpy(mtDump.amb[page / 4].mbd.abtData, mp.mpd.abtData, 16);
-    } else {
-      bFailure = true;
-      break;
-    }
+  printf("Reading %d pages |", uiBlocks + 1);
 
+  // The whole memory comes in a few FAST_READ, or READ when the tag doesn't support it
+  if (nfc_mifare_ultralight_read_pages(pnd, &nt, 0, szPages, (uint8_t *) &mtDump, sizeof(mtDump)) < 0)
+    bFailure = true;
+  for (size_t page = 0; page < szPages; page++)
     print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
-  }
   printf("|\n");
   printf("Done, %d of %d pages readed.\n", uiReadedPages, uiBlocks + 1);
   fflush(stdout);
@@ -106,6 +114,32 @@ read_card(void)
   return (!bFailure);
 }
 
+// Fetch only the pages covered by the NDEF message
+static  bool
+read_ndef(const char *pcPath)
+{
+  uint8_t abtNdef[sizeof(mifareul_tag)];
+  nfc_ndef_info ni;
+
+  const int res = nfc_ndef_read(pnd, &nt, abtNdef, sizeof(abtNdef), &ni);
+  if (res < 0) {
+    nfc_perror(pnd, "nfc_ndef_read");
+    return false;
+  }
+  printf("NDEF message: %d bytes (capacity %d bytes%s)\n", res, (int) ni.szCapacity, ni.bReadOnly ? ", read-only" : "");
+  FILE *pfNdef = fopen(pcPath, "wb");
+  if (pfNdef == NULL) {
+    printf("Could not open file: %s\n", pcPath);
+    return false;
+  }
+  const bool bWritten = (fwrite(abtNdef, 1, res, pfNdef) == (size_t) res);
+  if ((fclose(pfNdef) != 0) || !bWritten) {
+    printf("Could not write to file: %s\n", pcPath);
+    return false;
+  }
+  return true;
+}
+
 static  bool
 write_card(void)
 {
@@ -175,24 +209,49 @@ int
 main(int argc, const char *argv[])
 {
   bool    bReadAction;
+  bool    bNdefAction;
   FILE   *pfDump;
+  card_dump *pcdDump;
 
   if (argc < 3) {
     printf("\n");
     printf("%s r|w <dump.mfd>\n", argv[0]);
+    printf("%s n <message.ndef>\n", argv[0]);
     printf("\n");
     printf("r|w         - Perform read from or write to card\n");
     printf("<dump.mfd>  - MiFare Dump (MFD) used to write (card to MFD) or (MFD to card)\n");
+    printf("              a dump named *%s uses the streaming NFCD format\n", CARD_DUMP_EXTENSION);
+    printf("n           - Extract the NDEF message only, reading just the pages it covers\n");
     printf("\n");
     exit(EXIT_FAILURE);
   }
 
   DBG("\nChecking arguments and settings\n");
 
-  bReadAction = tolower((int)((unsigned char) * (argv[1])) == 'r');
+  bReadAction = (tolower((int)((unsigned char) * (argv[1]))) == 'r');
+  bNdefAction = (tolower((int)((unsigned char) * (argv[1]))) == 'n');
 
-  if (bReadAction) {
+  if (bReadAction || bNdefAction) {
     memset(&mtDump, 0x00, sizeof(mtDump));
+  } else if ((pcdDump = card_dump_open(argv[2])) != NULL) {
+    // NFCD dump, pages are written up to 0xF so they must all have been read
+    if ((pcdDump->btType != CARD_DUMP_MIFARE_ULTRALIGHT) || (pcdDump->szBlockLen != MIFARE_ULTRALIGHT_PAGE_LEN) ||
+        (pcdDump->szBlocks * MIFARE_ULTRALIGHT_PAGE_LEN > sizeof(mtDump))) {
+      ERR("Dump file is not a MIFARE Ultralight dump: %s\n", argv[2]);
+      exit(EXIT_FAILURE);
+    }
+    // The dump ends at its first page which was not read
+    for (; szDumpPages < pcdDump->szBlocks; szDumpPages++) {
+      const uint8_t *pbtPage = card_dump_block(pcdDump, szDumpPages);
+      if (pbtPage == NULL)
+        break;
+      memcpy((uint8_t *) &mtDump + szDumpPages * MIFARE_ULTRALIGHT_PAGE_LEN, pbtPage, MIFARE_ULTRALIGHT_PAGE_LEN);
+    }
+    card_dump_free(pcdDump);
+    if (szDumpPages * MIFARE_ULTRALIGHT_PAGE_LEN < MIFAREUL_MIN_DUMP_LEN) {
+      ERR("Dump file is incomplete, page %d missing: %s\n", (int) szDumpPages, argv[2]);
+      exit(EXIT_FAILURE);
+    }
   } else {
     pfDump = fopen(argv[2], "rb");
 
@@ -201,12 +260,14 @@ main(int argc, const char *argv[])
       exit(EXIT_FAILURE);
     }
 
-    if (fread(&mtDump, 1, sizeof(mtDump), pfDump) != sizeof(mtDump)) {
+    const size_t szRead = fread(&mtDump, 1, sizeof(mtDump), pfDump);
+    if (szRead < MIFAREUL_MIN_DUMP_LEN) {
       ERR("Could not read from dump file: %s\n", argv[2]);
       fclose(pfDump);
       exit(EXIT_FAILURE);
     }
     fclose(pfDump);
+    szDumpPages = szRead / MIFARE_ULTRALIGHT_PAGE_LEN;
   }
   DBG("Successfully opened the dump file\n");
 
@@ -265,7 +326,31 @@ main(int argc, const char *argv[])
   }
   printf("\n");
 
-  if (bReadAction) {
+  if (bNdefAction) {
+    if (!read_ndef(argv[2])) {
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+  } else if (bReadAction && card_dump_has_extension(argv[2])) {
+    if (read_card()) {
+      printf("Writing data to file: %s ... ", argv[2]);
+      fflush(stdout);
+      card_dump_writer *pcdw = card_dump_create(argv[2], CARD_DUMP_MIFARE_ULTRALIGHT, nt.nti.nai.abtUid, nt.nti.nai.szUidLen, uiBlocks + 1, MIFARE_ULTRALIGHT_PAGE_LEN);
+      bool bWritten = (pcdw != NULL);
+      for (uint32_t page = 0; bWritten && (page <= uiBlocks); page++)
+        bWritten = card_dump_write_block(pcdw, page, (uint8_t *) &mtDump + page * MIFARE_ULTRALIGHT_PAGE_LEN);
+      if ((pcdw != NULL) && !card_dump_close(pcdw))
+        bWritten = false;
+      if (!bWritten) {
+        printf("Could not write to file: %s\n", argv[2]);
+        nfc_close(pnd);
+        nfc_exit(context);
+        exit(EXIT_FAILURE);
+      }
+      printf("Done.\n");
+    }
+  } else if (bReadAction) {
     if (read_card()) {
       printf("Writing data to file: %s ... ", argv[2]);
       fflush(stdout);
@@ -276,7 +361,8 @@ main(int argc, const char *argv[])
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (fwrite(&mtDump, 1, sizeof(mtDump), pfDump) != sizeof(mtDump)) {
+      const size_t szDump = (uiBlocks + 1) * MIFARE_ULTRALIGHT_PAGE_LEN;
+      if (fwrite(&mtDump, 1, szDump, pfDump) != szDump) {
         printf("Could not write to file: %s\n", argv[2]);
         fclose(pfDump);
         nfc_close(pnd);
@@ -287,6 +373,14 @@ main(int argc, const char *argv[])
       printf("Done.\n");
     }
   } else {
+    // A dump of a smaller card would not restore this one
+    const size_t szPages = card_pages();
+    if (szDumpPages < szPages) {
+      ERR("Dump file holds %d pages, the card has %d: %s\n", (int) szDumpPages, (int) szPages, argv[2]);
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
     write_card();
   }
 
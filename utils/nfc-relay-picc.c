@@ -57,8 +57,19 @@
 #include <signal.h>
 
 #include <unistd.h>
+#ifndef WIN32
+#  include <errno.h>
+#  include <poll.h>
+#  include <netdb.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <sys/socket.h>
+#endif
 
 #include <nfc/nfc.h>
+#ifndef WIN32
+#  include <nfc/nfc-async.h>
+#endif
 
 #include "nfc-utils.h"
 
@@ -79,6 +90,15 @@ static bool swap_devices = false;
 static int waiting_time = 0;
 FILE *fd3;
 FILE *fd4;
+// Binary framing: 1-byte frame type, 2-byte big endian length, then data
+static bool binary_mode = false;
+static int relay_in_fd = 3;
+static int relay_out_fd = 4;
+static const char *relay_host = NULL;
+static const char *relay_port = NULL;
+
+// Frame types of the binary framing, in the order they are relayed
+static const char *relay_frame_names[] = { "UID", "ATQA", "SAK", "ATS", "C-APDU", "R-APDU" };
 
 static void
 intr_hdlr(int sig)
@@ -100,6 +120,11 @@ print_usage(char *argv[])
   printf("\t-t\tTarget mode only (the one on reader side). Data expected from FD3 to FD4.\n");
   printf("\t-i\tInitiator mode only (the one on tag side). Data expected from FD3 to FD4.\n");
   printf("\t-n N\tAdds a waiting time of N seconds (integer) in the relay to mimic long distance.\n");
+  printf("\t-b\tBinary framing on FD3/FD4 instead of text hex (lower latency, both halves must use it).\n");
+#ifndef WIN32
+  printf("\t-l PORT\tWith -t or -i, listen on TCP PORT for the other half instead of using FD3/FD4 (implies -b).\n");
+  printf("\t-c HOST:PORT\tWith -t or -i, connect to the other half on TCP HOST:PORT instead of using FD3/FD4 (implies -b).\n");
+#endif
 }
 
 static int print_hex_fd4(const uint8_t *pbtData, const size_t szBytes, const char *pchPrefix)
@@ -156,6 +181,225 @@ static int scan_hex_fd3(uint8_t *pbtData, size_t *pszBytes, const char *pchPrefi
   return 0;
 }
 
+static int relay_frame_type(const char *pchPrefix)
+{
+  for (size_t n = 0; n < sizeof(relay_frame_names) / sizeof(relay_frame_names[0]); n++) {
+    if (0 == strcmp(pchPrefix, relay_frame_names[n]))
+      return (int) n;
+  }
+  return -1;
+}
+
+static int write_frame_fd(const uint8_t *pbtData, const size_t szBytes, const char *pchPrefix)
+{
+  uint8_t abtFrame[3 + MAX_FRAME_LEN];
+  const int iType = relay_frame_type(pchPrefix);
+  if ((szBytes > MAX_FRAME_LEN) || (iType < 0)) {
+    return -1;
+  }
+  abtFrame[0] = (uint8_t) iType;
+  abtFrame[1] = (uint8_t)(szBytes >> 8);
+  abtFrame[2] = (uint8_t) szBytes;
+  memcpy(abtFrame + 3, pbtData, szBytes);
+  // A single write keeps the frame in one segment
+  size_t szDone = 0;
+  while (szDone < szBytes + 3) {
+    const ssize_t res = write(relay_out_fd, abtFrame + szDone, szBytes + 3 - szDone);
+    if (res <= 0) {
+      return -1;
+    }
+    szDone += (size_t) res;
+  }
+  return 0;
+}
+
+static int read_all_fd(uint8_t *pbtData, const size_t szBytes)
+{
+  size_t szDone = 0;
+  while (szDone < szBytes) {
+    const ssize_t res = read(relay_in_fd, pbtData + szDone, szBytes - szDone);
+    if (res <= 0) {
+      return -1;
+    }
+    szDone += (size_t) res;
+  }
+  return 0;
+}
+
+static int read_frame_fd(uint8_t *pbtData, size_t *pszBytes, const char *pchPrefix)
+{
+  uint8_t abtHeader[3];
+  if ((read_all_fd(abtHeader, sizeof(abtHeader)) < 0) || (abtHeader[0] != relay_frame_type(pchPrefix))) {
+    return -1;
+  }
+  *pszBytes = (abtHeader[1] << 8) | abtHeader[2];
+  if (*pszBytes > MAX_FRAME_LEN) {
+    return -1;
+  }
+  return read_all_fd(pbtData, *pszBytes);
+}
+
+static int relay_write(const uint8_t *pbtData, const size_t szBytes, const char *pchPrefix)
+{
+  return binary_mode ? write_frame_fd(pbtData, szBytes, pchPrefix) : print_hex_fd4(pbtData, szBytes, pchPrefix);
+}
+
+static int relay_read(uint8_t *pbtData, size_t *pszBytes, const char *pchPrefix)
+{
+  return binary_mode ? read_frame_fd(pbtData, pszBytes, pchPrefix) : scan_hex_fd3(pbtData, pszBytes, pchPrefix);
+}
+
+#ifndef WIN32
+// Open the TCP link to the other half, Nagle is disabled so each frame leaves at once
+static int relay_socket_open(void)
+{
+  struct addrinfo hints;
+  struct addrinfo *res;
+  int fd = -1;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = relay_host ? 0 : AI_PASSIVE;
+  if (getaddrinfo(relay_host, relay_port, &hints, &res) != 0) {
+    return -1;
+  }
+  for (struct addrinfo *ai = res; ai != NULL; ai = ai->ai_next) {
+    if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+      continue;
+    if (relay_host) {
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        break;
+    } else {
+      const int on = 1;
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      if ((bind(fd, ai->ai_addr, ai->ai_addrlen) == 0) && (listen(fd, 1) == 0)) {
+        printf("Waiting for the other half on port %s...\n", relay_port);
+        const int client = accept(fd, NULL, NULL);
+        close(fd);
+        fd = client;
+        if (fd >= 0)
+          break;
+        continue;
+      }
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  return fd;
+}
+#endif
+
+#ifndef WIN32
+// Two devices relay: each device runs its requests in its own libnfc worker,
+// completions hand the frame over to the other device (see relay_async())
+static int relay_async_res = 0;
+static const char *relay_async_failed = NULL;
+static nfc_device *relay_async_failed_device = NULL;
+
+static void relay_on_capdu(nfc_device *pnd, int res, void *user_data);
+
+static void relay_async_error(nfc_device *pnd, int res, const char *pcFunction)
+{
+  relay_async_res = res;
+  relay_async_failed = pcFunction;
+  relay_async_failed_device = pnd;
+}
+
+static void relay_on_sent(nfc_device *pnd, int res, void *user_data)
+{
+  (void) user_data;
+  if (res < 0)
+    relay_async_error(pnd, res, "nfc_target_send_bytes");
+}
+
+static void relay_on_rapdu(nfc_device *pnd, int res, void *user_data)
+{
+  (void) pnd;
+  (void) user_data;
+  if (res < 0) {
+    // No answer from the tag: wait for the next reader command
+    if ((res = nfc_async_target_receive_bytes(pndTarget, abtCapdu, sizeof(abtCapdu), 0, relay_on_capdu, NULL)) < 0)
+      relay_async_error(pndTarget, res, "nfc_async_target_receive_bytes");
+    return;
+  }
+  szRapduLen = (size_t) res;
+  if (waiting_time > 0) {
+    if (!quiet_output) {
+      printf("Waiting %is to simulate longer relay...\n", waiting_time);
+    }
+    sleep(waiting_time);
+  }
+  // The answer and the wait for the next command are queued together, the worker runs them back to back
+  if (((res = nfc_async_target_send_bytes(pndTarget, abtRapdu, szRapduLen, 0, relay_on_sent, NULL)) < 0) ||
+      ((res = nfc_async_target_receive_bytes(pndTarget, abtCapdu, sizeof(abtCapdu), 0, relay_on_capdu, NULL)) < 0)) {
+    relay_async_error(pndTarget, res, "nfc_async_target_send_bytes");
+    return;
+  }
+  // Printed while the devices already work
+  if (!quiet_output) {
+    printf("Forwarding R-APDU: ");
+    print_hex(abtRapdu, szRapduLen);
+  }
+}
+
+static void relay_on_capdu(nfc_device *pnd, int res, void *user_data)
+{
+  (void) user_data;
+  if (res < 0) {
+    relay_async_error(pnd, res, "nfc_target_receive_bytes");
+    return;
+  }
+  szCapduLen = (size_t) res;
+  // Forward the frame to the original tag
+  if ((res = nfc_async_initiator_transceive_bytes(pndInitiator, abtCapdu, szCapduLen, abtRapdu, sizeof(abtRapdu), -1, relay_on_rapdu, NULL)) < 0) {
+    relay_async_error(pndInitiator, res, "nfc_async_initiator_transceive_bytes");
+    return;
+  }
+  // Printed while the initiator transceives
+  if (!quiet_output) {
+    printf("Forwarding C-APDU: ");
+    print_hex(abtCapdu, szCapduLen);
+  }
+}
+
+// Relay frames between two local devices from a single event loop
+static int relay_async(void)
+{
+  struct pollfd pfd[2];
+  if (((pfd[0].fd = nfc_async_get_fd(pndTarget)) < 0) || ((pfd[1].fd = nfc_async_get_fd(pndInitiator)) < 0)) {
+    ERR("%s", "Unable to get asynchronous events file descriptors");
+    return -1;
+  }
+  pfd[0].events = pfd[1].events = POLLIN;
+
+  int res;
+  if ((res = nfc_async_target_receive_bytes(pndTarget, abtCapdu, sizeof(abtCapdu), 0, relay_on_capdu, NULL)) < 0) {
+    relay_async_error(pndTarget, res, "nfc_async_target_receive_bytes");
+  }
+  while ((!quitting) && (relay_async_res >= 0)) {
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    nfc_async_dispatch(pndTarget);
+    nfc_async_dispatch(pndInitiator);
+  }
+  nfc_async_cancel(pndTarget);
+  nfc_async_cancel(pndInitiator);
+  if (relay_async_res < 0) {
+    nfc_perror(relay_async_failed_device, relay_async_failed);
+    return -1;
+  }
+  return 0;
+}
+#endif
+
 int
 main(int argc, char *argv[])
 {
@@ -188,6 +432,30 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
       }
       printf("Waiting time: %i secs.\n", waiting_time);
+    } else if (0 == strcmp(argv[arg], "-b")) {
+      binary_mode = true;
+#ifndef WIN32
+    } else if (0 == strcmp(argv[arg], "-l")) {
+      if (++arg == argc) {
+        ERR("Missing port value.");
+        print_usage(argv);
+        exit(EXIT_FAILURE);
+      }
+      relay_host = NULL;
+      relay_port = argv[arg];
+      binary_mode = true;
+    } else if (0 == strcmp(argv[arg], "-c")) {
+      char *pcColon;
+      if ((++arg == argc) || ((pcColon = strrchr(argv[arg], ':')) == NULL)) {
+        ERR("Missing or wrong HOST:PORT value.");
+        print_usage(argv);
+        exit(EXIT_FAILURE);
+      }
+      *pcColon = '\0';
+      relay_host = argv[arg];
+      relay_port = pcColon + 1;
+      binary_mode = true;
+#endif
     } else {
       ERR("%s is not supported option.", argv[arg]);
       print_usage(argv);
@@ -221,15 +489,25 @@ main(int argc, char *argv[])
       nfc_exit(context);
       exit(EXIT_FAILURE);
     }
-    if ((fd3 = fdopen(3, "r")) == NULL) {
-      ERR("Could not open file descriptor 3");
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
-    if ((fd4 = fdopen(4, "r")) == NULL) {
-      ERR("Could not open file descriptor 4");
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
+    if (relay_port) {
+#ifndef WIN32
+      if ((relay_in_fd = relay_out_fd = relay_socket_open()) < 0) {
+        ERR("Could not open TCP link to the other half");
+        nfc_exit(context);
+        exit(EXIT_FAILURE);
+      }
+#endif
+    } else if (!binary_mode) {
+      if ((fd3 = fdopen(3, "r")) == NULL) {
+        ERR("Could not open file descriptor 3");
+        nfc_exit(context);
+        exit(EXIT_FAILURE);
+      }
+      if ((fd4 = fdopen(4, "w")) == NULL) {
+        ERR("Could not open file descriptor 4");
+        nfc_exit(context);
+        exit(EXIT_FAILURE);
+      }
     }
   } else {
     if (szFound < 2) {
@@ -281,25 +559,25 @@ main(int argc, char *argv[])
     printf("Found tag:\n");
     print_nfc_target(&ntRealTarget, false);
     if (initiator_only_mode) {
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtUid, ntRealTarget.nti.nai.szUidLen, "UID") < 0) {
+      if (relay_write(ntRealTarget.nti.nai.abtUid, ntRealTarget.nti.nai.szUidLen, "UID") < 0) {
         fprintf(stderr, "Error while printing UID to FD4\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtAtqa, 2, "ATQA") < 0) {
+      if (relay_write(ntRealTarget.nti.nai.abtAtqa, 2, "ATQA") < 0) {
         fprintf(stderr, "Error while printing ATQA to FD4\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (print_hex_fd4(&(ntRealTarget.nti.nai.btSak), 1, "SAK") < 0) {
+      if (relay_write(&(ntRealTarget.nti.nai.btSak), 1, "SAK") < 0) {
         fprintf(stderr, "Error while printing SAK to FD4\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (print_hex_fd4(ntRealTarget.nti.nai.abtAts, ntRealTarget.nti.nai.szAtsLen, "ATS") < 0) {
+      if (relay_write(ntRealTarget.nti.nai.abtAts, ntRealTarget.nti.nai.szAtsLen, "ATS") < 0) {
         fprintf(stderr, "Error while printing ATS to FD4\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
@@ -323,25 +601,25 @@ main(int argc, char *argv[])
     };
     if (target_only_mode) {
       size_t foo;
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtUid, &(ntEmulatedTarget.nti.nai.szUidLen), "UID") < 0) {
+      if (relay_read(ntEmulatedTarget.nti.nai.abtUid, &(ntEmulatedTarget.nti.nai.szUidLen), "UID") < 0) {
         fprintf(stderr, "Error while scanning UID from FD3\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtAtqa, &foo, "ATQA") < 0) {
+      if (relay_read(ntEmulatedTarget.nti.nai.abtAtqa, &foo, "ATQA") < 0) {
         fprintf(stderr, "Error while scanning ATQA from FD3\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (scan_hex_fd3(&(ntEmulatedTarget.nti.nai.btSak), &foo, "SAK") < 0) {
+      if (relay_read(&(ntEmulatedTarget.nti.nai.btSak), &foo, "SAK") < 0) {
         fprintf(stderr, "Error while scanning SAK from FD3\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
         exit(EXIT_FAILURE);
       }
-      if (scan_hex_fd3(ntEmulatedTarget.nti.nai.abtAts, &(ntEmulatedTarget.nti.nai.szAtsLen), "ATS") < 0) {
+      if (relay_read(ntEmulatedTarget.nti.nai.abtAts, &(ntEmulatedTarget.nti.nai.szAtsLen), "ATS") < 0) {
         fprintf(stderr, "Error while scanning ATS from FD3\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
@@ -410,6 +688,16 @@ main(int argc, char *argv[])
     printf("%s\n", "Done, relaying frames now!");
   }
 
+#ifndef WIN32
+  if (!initiator_only_mode && !target_only_mode) {
+    const int relay_res = relay_async();
+    nfc_close(pndInitiator);
+    nfc_close(pndTarget);
+    nfc_exit(context);
+    exit((relay_res < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+#endif
+
   while (!quitting) {
     bool ret;
     int res = 0;
@@ -426,7 +714,7 @@ main(int argc, char *argv[])
       }
       szCapduLen = (size_t) res;
       if (target_only_mode) {
-        if (print_hex_fd4(abtCapdu, szCapduLen, "C-APDU") < 0) {
+        if (relay_write(abtCapdu, szCapduLen, "C-APDU") < 0) {
           fprintf(stderr, "Error while printing C-APDU to FD4\n");
           nfc_close(pndTarget);
           nfc_exit(context);
@@ -434,7 +722,7 @@ main(int argc, char *argv[])
         }
       }
     } else {
-      if (scan_hex_fd3(abtCapdu, &szCapduLen, "C-APDU") < 0) {
+      if (relay_read(abtCapdu, &szCapduLen, "C-APDU") < 0) {
         fprintf(stderr, "Error while scanning C-APDU from FD3\n");
         nfc_close(pndInitiator);
         nfc_exit(context);
@@ -456,7 +744,7 @@ main(int argc, char *argv[])
         ret = true;
       }
     } else {
-      if (scan_hex_fd3(abtRapdu, &szRapduLen, "R-APDU") < 0) {
+      if (relay_read(abtRapdu, &szRapduLen, "R-APDU") < 0) {
         fprintf(stderr, "Error while scanning R-APDU from FD3\n");
         nfc_close(pndTarget);
         nfc_exit(context);
@@ -492,7 +780,7 @@ main(int argc, char *argv[])
           exit(EXIT_FAILURE);
         }
       } else {
-        if (print_hex_fd4(abtRapdu, szRapduLen, "R-APDU") < 0) {
+        if (relay_write(abtRapdu, szRapduLen, "R-APDU") < 0) {
           fprintf(stderr, "Error while printing R-APDU to FD4\n");
           nfc_close(pndInitiator);
           nfc_exit(context);
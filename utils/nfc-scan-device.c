@@ -48,6 +48,9 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#  include <pthread.h>
+#endif
 
 #include <nfc/nfc.h>
 
@@ -58,6 +61,76 @@
 
 static nfc_device *pnd;
 
+// Information gathered on one device when devices are opened concurrently
+struct device_scan {
+  nfc_context *context;
+  const char *connstring;
+  bool verbose;
+  bool opened;
+  char name[256];
+  nfc_connstring device_connstring;
+  // nfc_device_get_information_about() output, NULL if not verbose
+  char *info;
+};
+
+static void *
+scan_device(void *arg)
+{
+  struct device_scan *scan = arg;
+  nfc_device *pnd_scan = nfc_open(scan->context, scan->connstring);
+  if (pnd_scan == NULL)
+    return NULL;
+  scan->opened = true;
+  snprintf(scan->name, sizeof(scan->name), "%s", nfc_device_get_name(pnd_scan));
+  snprintf(scan->device_connstring, sizeof(scan->device_connstring), "%s", nfc_device_get_connstring(pnd_scan));
+  if (scan->verbose && (nfc_device_get_information_about(pnd_scan, &scan->info) < 0))
+    scan->info = NULL;
+  nfc_close(pnd_scan);
+  return NULL;
+}
+
+// Open every device from its own thread on the shared context, then print them in device order
+static void
+scan_devices_concurrently(nfc_context *context, nfc_connstring connstrings[], const size_t szDeviceFound, bool verbose)
+{
+  struct device_scan scans[MAX_DEVICE_COUNT];
+
+  memset(scans, 0, sizeof(scans));
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    scans[i].context = context;
+    scans[i].connstring = connstrings[i];
+    scans[i].verbose = verbose;
+  }
+#ifndef WIN32
+  pthread_t threads[MAX_DEVICE_COUNT];
+  bool started[MAX_DEVICE_COUNT];
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    started[i] = (pthread_create(&threads[i], NULL, scan_device, &scans[i]) == 0);
+    if (!started[i])
+      scan_device(&scans[i]);
+  }
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+  }
+#else
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    scan_device(&scans[i]);
+  }
+#endif
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    if (scans[i].opened) {
+      printf("- %s:\n    %s\n", scans[i].name, scans[i].device_connstring);
+      if (scans[i].info) {
+        printf("%s", scans[i].info);
+        nfc_free(scans[i].info);
+      }
+    } else {
+      printf("nfc_open failed for %s\n", connstrings[i]);
+    }
+  }
+}
+
 static void
 print_usage(const char *argv[])
 {
@@ -66,6 +139,7 @@ print_usage(const char *argv[])
   printf("\t-h\tPrint this help message.\n");
   printf("\t-v\tSet verbose display.\n");
   printf("\t-i\tAllow intrusive scan.\n");
+  printf("\t-j\tOpen devices concurrently.\n");
 }
 
 int
@@ -74,6 +148,7 @@ main(int argc, const char *argv[])
   const char *acLibnfcVersion;
   size_t  i;
   bool verbose = false;
+  bool concurrent = false;
 
   nfc_context *context;
 
@@ -87,6 +162,8 @@ main(int argc, const char *argv[])
     } else if (0 == strcmp(argv[arg], "-i")) {
       // This has to be done before the call to nfc_init()
       setenv("LIBNFC_INTRUSIVE_SCAN", "yes", 1);
+    } else if (0 == strcmp(argv[arg], "-j")) {
+      concurrent = true;
     } else {
       ERR("%s is not supported option.", argv[arg]);
       print_usage(argv);
@@ -114,6 +191,11 @@ main(int argc, const char *argv[])
   }
 
   printf("%d NFC device(s) found:\n", (int)szDeviceFound);
+  if (concurrent) {
+    scan_devices_concurrently(context, connstrings, szDeviceFound, verbose);
+    nfc_exit(context);
+    exit(EXIT_SUCCESS);
+  }
   char *strinfo = NULL;
   for (i = 0; i < szDeviceFound; i++) {
     pnd = nfc_open(context, connstrings[i]);
@@ -52,9 +52,19 @@ oddparity(const uint8_t bt)
 void
 oddparity_bytes_ts(const uint8_t *pbtData, const size_t szLen, uint8_t *pbtPar)
 {
-  size_t  szByteNr;
-  // Calculate the parity bits for the command
-  for (szByteNr = 0; szByteNr < szLen; szByteNr++) {
+  size_t  szByteNr = 0;
+  // Calculate the parity bits for the command, eight bytes at a time: folding each byte onto
+  // itself leaves its parity in its lowest bit, whatever the word byte order
+  for (; szByteNr + 8 <= szLen; szByteNr += 8) {
+    uint64_t ui64Bits;
+    memcpy(&ui64Bits, pbtData + szByteNr, 8);
+    ui64Bits ^= ui64Bits >> 4;
+    ui64Bits ^= ui64Bits >> 2;
+    ui64Bits ^= ui64Bits >> 1;
+    ui64Bits = ~ui64Bits & 0x0101010101010101ULL;
+    memcpy(pbtPar + szByteNr, &ui64Bits, 8);
+  }
+  for (; szByteNr < szLen; szByteNr++) {
     pbtPar[szByteNr] = oddparity(pbtData[szByteNr]);
   }
 }
@@ -122,8 +132,7 @@ print_hex_par(const uint8_t *pbtData, const size_t szBits, const uint8_t *pbtDat
 void
 print_nfc_target(const nfc_target *pnt, bool verbose)
 {
-  char *s;
-  str_nfc_target(&s, pnt, verbose);
-  printf("%s", s);
-  nfc_free(s);
+  char s[4096];
+  if (snprint_nfc_target(s, sizeof(s), pnt, verbose) >= 0)
+    printf("%s", s);
 }